@@ -1,7 +1,7 @@
-#include "../timing.h"
 #include <compartment.h>
 #include <debug.hh>
 #include <locks.hh>
+#include <perf.hh>
 
 using Debug = ConditionalDebug<DEBUG_ALLOCBENCH, "Allocator benchmark">;
 
@@ -15,26 +15,41 @@ void __cheri_compartment("allocbench") run()
 	// output the first time that allocation happens.
 	free(malloc(16));
 	heap_quarantine_empty();
-	printf("#board\tsize\ttime\n");
+	cheriot::perf::print_header("size", "time");
 	const size_t MinimumSize = 32;
 	const size_t MaximumSize = 131072;
 	const size_t TotalSize   = 1024 * 1024;
 	for (size_t size = MinimumSize; size <= MaximumSize; size <<= 1)
 	{
-		size_t allocations = TotalSize / size;
-		auto   start       = rdcycle();
-		for (size_t i = 0; i < allocations; i++)
-		{
-			void *ptr = malloc(size);
-			Debug::Assert(ptr != nullptr, "Allocation {} of {} {}-byte allocations failed.", i, allocations, size);
-			free(ptr);
-		}
-		auto end = rdcycle();
-		printf(__XSTRING(BOARD) "\t%ld\t%ld\n", static_cast<int>(size), end - start);
+		size_t  allocations = TotalSize / size;
+		int64_t time        = cheriot::perf::elapsed([&]() {
+			for (size_t i = 0; i < allocations; i++)
+			{
+				void *ptr = malloc(size);
+				Debug::Assert(ptr != nullptr,
+				              "Allocation {} of {} {}-byte allocations failed.",
+				              i,
+				              allocations,
+				              size);
+				free(ptr);
+			}
+		});
+		cheriot::perf::print_row(size, time);
 		auto quota = heap_quota_remaining(MALLOC_CAPABILITY);
 		Debug::Invariant(quota == MALLOC_QUOTA, "Quota remaining {}, should be {}", quota, MALLOC_QUOTA);
 		Debug::log("Flushing quarantine");
 		heap_quarantine_empty();
 		Debug::log("Flushed quarantine");
 	}
+	// With allocator statistics enabled, report how long the allocator lock
+	// was held, including the longest single critical section.
+	HeapStatistics stats;
+	if (heap_statistics(&stats) == 0)
+	{
+		cheriot::perf::print_header(
+		  "lock acquisitions", "lock held cycles", "max lock hold");
+		cheriot::perf::print_row(stats.lockAcquisitions,
+		                         stats.lockHeldCycles,
+		                         stats.lockMaxHeldCycles);
+	}
 }
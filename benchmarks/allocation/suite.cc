@@ -0,0 +1,345 @@
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <debug.hh>
+#include <ds/xoroshiro.h>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdlib.h>
+#include <thread.h>
+
+using Debug = ConditionalDebug<DEBUG_ALLOCSUITE, "Allocator benchmark suite">;
+
+/**
+ * Replay allocation traces drawn from realistic size distributions on
+ * several threads at once, each allocating against its own quota.
+ *
+ * Each thread keeps a fixed number of live slots.  Every operation frees the
+ * slots whose lifetime has expired and then allocates one object, so most
+ * objects live for a few operations and some live for hundreds.  For each
+ * distribution and thread, the suite reports the number of allocations, the
+ * total cycles (from which throughput follows), the p50, p99 and maximum
+ * allocation latency, the number of allocations slower than `StallCycles`
+ * (which have almost always waited for revocation), and the number of
+ * allocations that failed because they exceeded the quota or timed out.
+ *
+ * When the allocator is built with `--allocator-statistics=y`, the first
+ * thread also samples the free bytes and the largest free chunk as the trace
+ * runs.  The ratio of the two is a measure of fragmentation.
+ */
+
+namespace
+{
+	/// Number of threads running the suite.  Must match the firmware.
+	constexpr uint32_t Threads = 3;
+
+	/// Number of allocations that each thread makes for each distribution.
+	constexpr size_t Operations = 512;
+
+	/// Number of objects that each thread may have live at once.
+	constexpr size_t Slots = 32;
+
+	/// Allocations slower than this are counted as stalls.
+	constexpr int64_t StallCycles = 20000;
+
+	/// The first thread samples fragmentation after this many operations.
+	constexpr size_t FragmentationInterval = 64;
+
+	/**
+	 * Allocations wait for no more than this many ticks.  An allocation that
+	 * times out, or exceeds the thread's quota, is counted as failed.
+	 */
+	constexpr int32_t AllocationTimeout = 10;
+
+	/// The quota of each thread.
+	constexpr size_t Quotas[Threads] = {8 * 1024, 32 * 1024, 64 * 1024};
+
+	DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(smallQuota, Quotas[0]);
+	DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(mediumQuota, Quotas[1]);
+	DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(largeQuota, Quotas[2]);
+
+	/// Counter used as a barrier between distributions.
+	cheriot::atomic<uint32_t> arrived;
+
+	/// Counter used to give each thread an index.
+	cheriot::atomic<uint32_t> nextThread;
+
+	/// Allocation latencies, one buffer for each thread.
+	int64_t latencies[Threads][Operations];
+
+	/// A sample of the heap's fragmentation.
+	struct FragmentationSample
+	{
+		/// The number of operations completed by the first thread.
+		size_t operation;
+		/// Free bytes in the heap.
+		size_t freeBytes;
+		/// The size of the largest free chunk.
+		size_t largestFreeChunk;
+	};
+
+	/// Fragmentation samples taken by the first thread.
+	FragmentationSample fragmentation[Operations / FragmentationInterval];
+
+	/// The number of valid entries in `fragmentation`.
+	size_t fragmentationSamples;
+
+	/**
+	 * Wait for all threads to reach the barrier for `round`.
+	 */
+	void barrier(uint32_t round)
+	{
+		uint32_t target = (round + 1) * Threads;
+		uint32_t value  = ++arrived;
+		if (value == target)
+		{
+			arrived.notify_all();
+			return;
+		}
+		while (value < target)
+		{
+			arrived.wait(value);
+			value = arrived;
+		}
+	}
+
+	using Random = ds::xoroshiro::P64R32;
+
+	/**
+	 * Sizes drawn uniformly between 16 and 1024 bytes.
+	 */
+	size_t uniform_size(Random &random)
+	{
+		return 16 + random() % (1024 - 16 + 1);
+	}
+
+	/**
+	 * Sizes from a network stack: mostly small control packets and
+	 * acknowledgements, with some full-MTU frames.
+	 */
+	size_t bimodal_size(Random &random)
+	{
+		if (random() % 5 == 0)
+		{
+			return 1500 + random() % 37;
+		}
+		return 64 + random() % 65;
+	}
+
+	/**
+	 * Sizes whose logarithm is approximately normally distributed, with a
+	 * median of 128 bytes, as for the buffers and objects of a typical
+	 * application.  The base-2 logarithm is kept as a fixed-point number
+	 * with eight fractional bits and is the sum of four uniform variables.
+	 */
+	size_t log_normal_size(Random &random)
+	{
+		uint32_t sum = 0;
+		for (int i = 0; i < 4; i++)
+		{
+			sum += random() & 0xff;
+		}
+		// Mean 7 (128 bytes), between 4 (16 bytes) and about 10.
+		uint32_t log2Size = (4 << 8) + (sum * 3) / 2;
+		return ((256 + (log2Size & 0xff)) << (log2Size >> 8)) >> 8;
+	}
+
+	/**
+	 * Returns the number of operations for which an object lives.  Most
+	 * objects are short-lived, one in four lives for hundreds of operations.
+	 */
+	size_t lifetime(Random &random)
+	{
+		if (random() % 4 == 0)
+		{
+			return 64 + random() % 193;
+		}
+		return 1 + random() % 4;
+	}
+
+	/**
+	 * Record a fragmentation sample after `operation` operations, if the
+	 * allocator collects statistics.
+	 */
+	void sample_fragmentation(size_t operation)
+	{
+		HeapStatistics stats;
+		if (heap_statistics(&stats) != 0)
+		{
+			return;
+		}
+		fragmentation[fragmentationSamples++] = {
+		  operation, stats.freeBytes, stats.largestFreeChunk};
+	}
+
+	/**
+	 * Replay one trace of `Operations` allocations with sizes drawn by
+	 * `size`, allocating against `heap`.
+	 */
+	template<typename SizeFn>
+	void measure(const char *name,
+	             SizeFn    &&size,
+	             uint32_t    thread,
+	             SObj        heap,
+	             uint32_t    round)
+	{
+		struct Slot
+		{
+			void  *object;
+			size_t expiry;
+		};
+		Slot   slots[Slots] = {};
+		Random random{static_cast<uint32_t>(round * Threads + thread + 1)};
+		if (thread == 0)
+		{
+			fragmentationSamples = 0;
+		}
+		barrier(round);
+		int64_t *samples = latencies[thread];
+		size_t   stalls  = 0;
+		size_t   failed  = 0;
+		int64_t  total   = cheriot::perf::elapsed([&]() {
+			for (size_t op = 0; op < Operations; op++)
+			{
+				// Free everything that has expired.  If no slot is free,
+				// free the one that would expire soonest.
+				Slot *target = nullptr;
+				for (auto &slot : slots)
+				{
+					if ((slot.object != nullptr) && (slot.expiry <= op))
+					{
+						heap_free(heap, slot.object);
+						slot.object = nullptr;
+					}
+				}
+				for (auto &slot : slots)
+				{
+					if (slot.object == nullptr)
+					{
+						target = &slot;
+						break;
+					}
+					if ((target == nullptr) || (slot.expiry < target->expiry))
+					{
+						target = &slot;
+					}
+				}
+				if (target->object != nullptr)
+				{
+					heap_free(heap, target->object);
+					target->object = nullptr;
+				}
+				size_t  bytes = size(random);
+				Timeout t{AllocationTimeout};
+				int64_t latency = cheriot::perf::elapsed([&]() {
+					target->object = heap_allocate(
+					  &t,
+					  heap,
+					  bytes,
+					  AllocateWaitRevocationNeeded | AllocateWaitHeapFull);
+				});
+				samples[op]    = latency;
+				target->expiry = op + lifetime(random);
+				if (!__builtin_cheri_tag_get(target->object))
+				{
+					target->object = nullptr;
+					failed++;
+				}
+				if (latency > StallCycles)
+				{
+					stalls++;
+				}
+				if ((thread == 0) && ((op + 1) % FragmentationInterval == 0))
+				{
+					sample_fragmentation(op + 1);
+				}
+			}
+		});
+		for (auto &slot : slots)
+		{
+			if (slot.object != nullptr)
+			{
+				heap_free(heap, slot.object);
+			}
+		}
+		auto stats = cheriot::perf::statistics(samples, Operations);
+		cheriot::perf::print_row(name,
+		                         thread,
+		                         Quotas[thread],
+		                         Operations,
+		                         total,
+		                         stats.median,
+		                         stats.p99,
+		                         stats.maximum,
+		                         stalls,
+		                         failed);
+		// Wait for the other threads so that the fragmentation table is not
+		// interleaved with their rows.
+		barrier(round + 1);
+		if (thread == 0)
+		{
+			if (fragmentationSamples > 0)
+			{
+				cheriot::perf::print_header("fragmentation distribution",
+				                            "operation",
+				                            "free bytes",
+				                            "largest free chunk");
+			}
+			for (size_t i = 0; i < fragmentationSamples; i++)
+			{
+				cheriot::perf::print_row(name,
+				                         fragmentation[i].operation,
+				                         fragmentation[i].freeBytes,
+				                         fragmentation[i].largestFreeChunk);
+			}
+			heap_quarantine_empty();
+		}
+		barrier(round + 2);
+	}
+} // namespace
+
+void __cheri_compartment("allocsuite") run()
+{
+	uint32_t thread         = nextThread++;
+	SObj     heaps[Threads] = {STATIC_SEALED_VALUE(smallQuota),
+	                           STATIC_SEALED_VALUE(mediumQuota),
+	                           STATIC_SEALED_VALUE(largeQuota)};
+	Debug::Assert(thread < Threads, "Too many threads ({})", thread);
+	SObj heap = heaps[thread];
+	if (thread == 0)
+	{
+		// Make sure sail doesn't print annoying log messages in the middle
+		// of the output the first time that allocation happens.
+		free(malloc(16));
+		heap_quarantine_empty();
+	}
+	uint32_t round = 0;
+	auto     header = [&]() {
+		if (thread == 0)
+		{
+			cheriot::perf::print_header("distribution",
+			                            "thread",
+			                            "quota",
+			                            "allocations",
+			                            "total",
+			                            "p50",
+			                            "p99",
+			                            "max",
+			                            "stalls",
+			                            "failed");
+		}
+	};
+	header();
+	measure("uniform", uniform_size, thread, heap, round);
+	round += 3;
+	header();
+	measure("bimodal", bimodal_size, thread, heap, round);
+	round += 3;
+	header();
+	measure("log-normal", log_normal_size, thread, heap, round);
+	round += 3;
+	// Last one out exits the simulator.
+	if (++arrived == (round + 1) * Threads)
+	{
+		simulation_exit(0);
+	}
+}
@@ -33,3 +33,43 @@ firmware("allocator-benchmark")
             },
         }, {expand = false})
     end)
+
+debugOption("allocsuite");
+compartment("allocsuite")
+    add_deps("crt", "freestanding", "atomic", "stdio", "debug")
+    add_rules("cheriot.component-debug")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("suite.cc")
+
+-- Firmware image for the size-distribution suite.  The three threads have
+-- the same priority, so their allocations interleave, and each allocates
+-- against its own quota.  Build the allocator with
+-- --allocator-statistics=y to also report fragmentation.
+firmware("allocator-benchmark-suite")
+    add_deps("allocsuite")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "allocsuite",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x800,
+                trusted_stack_frames = 4
+            },
+            {
+                compartment = "allocsuite",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x800,
+                trusted_stack_frames = 4
+            },
+            {
+                compartment = "allocsuite",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x800,
+                trusted_stack_frames = 4
+            },
+        }, {expand = false})
+    end)
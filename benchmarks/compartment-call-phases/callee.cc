@@ -0,0 +1,35 @@
+#include "callee.h"
+#include "../stack.h"
+#include <perf.h>
+
+uint64_t noop_args0()
+{
+	return perf_cycles();
+}
+
+uint64_t noop_args2(int, int)
+{
+	return perf_cycles();
+}
+
+uint64_t noop_args4(int, int, int, int)
+{
+	return perf_cycles();
+}
+
+uint64_t noop_args6(int, int, int, int, int, int)
+{
+	return perf_cycles();
+}
+
+CHERIOT_BOUNDED_STACK_EXPORT("_Z12noop_boundedv");
+__cheriot_minimum_stack(0x20) uint64_t noop_bounded()
+{
+	return perf_cycles();
+}
+
+uint64_t dirty_return(size_t bytes)
+{
+	use_stack(bytes);
+	return perf_cycles();
+}
@@ -0,0 +1,10 @@
+#include <compartment.h>
+#include <stddef.h>
+#include <stdint.h>
+
+uint64_t __cheri_compartment("callee") noop_args0();
+uint64_t __cheri_compartment("callee") noop_args2(int, int);
+uint64_t __cheri_compartment("callee") noop_args4(int, int, int, int);
+uint64_t __cheri_compartment("callee") noop_args6(int, int, int, int, int, int);
+uint64_t __cheri_compartment("callee") noop_bounded();
+uint64_t __cheri_compartment("callee") dirty_return(size_t bytes);
@@ -0,0 +1,160 @@
+#include "../stack.h"
+#include "callee.h"
+#include <compartment.h>
+#include <perf.hh>
+#include <stdio.h>
+
+/**
+ * Break the cost of a cross-compartment call down by phase.
+ *
+ * The switcher cannot be timed from inside without perturbing it, so each
+ * phase is estimated by timing callees that differ in only one respect: the
+ * number of arguments, whether the callee has a bounded stack, how much of
+ * the caller's stack is dirty, how much stack the callee dirties, and how
+ * deep the caller's stack already is.
+ *
+ * The output is two tables in the format of `perf.hh`.  Rows whose second
+ * column is `call` are raw timings, rows whose second column is `phase` are
+ * the estimates derived from them.  Both include the board and whether it has
+ * a stack high water mark, so the output from each configuration built by
+ * `scripts/build_benchmark_configs.sh` can be concatenated.
+ */
+
+namespace
+{
+#ifdef CONFIG_MSHWM
+	constexpr int HasStackHighWaterMark = 1;
+#else
+	constexpr int HasStackHighWaterMark = 0;
+#endif
+
+	/**
+	 * The cycles from the caller to the start of the callee, and from the
+	 * end of the callee back to the caller.
+	 */
+	struct Timing
+	{
+		int64_t call;
+		int64_t ret;
+	};
+
+	/**
+	 * Time a call to `fn`, which must return the cycle count at the start of
+	 * the callee.  The call is made twice and the second is timed, so that
+	 * the stack below the caller is clean unless `dirty` bytes of it are
+	 * dirtied first.
+	 */
+	template<typename Fn>
+	__noinline Timing time_call(size_t dirty, Fn &&fn)
+	{
+		return CHERI::with_interrupts_disabled([&]() {
+			fn();
+			if (dirty > 0)
+			{
+				use_stack(dirty);
+			}
+			uint64_t start  = perf_cycles();
+			uint64_t middle = fn();
+			uint64_t end    = perf_cycles();
+			return Timing{static_cast<int64_t>(middle - start),
+			              static_cast<int64_t>(end - middle)};
+		});
+	}
+
+	/**
+	 * Time a call to `fn` with an extra `depth` bytes of the caller's stack
+	 * in use.
+	 */
+	template<typename Fn>
+	__noinline Timing time_call_at_depth(size_t depth, size_t dirty, Fn &&fn)
+	{
+		volatile uint8_t frame[depth + 1];
+		frame[0] = 0;
+		return time_call(dirty, fn);
+	}
+
+	/**
+	 * Print a raw timing.
+	 */
+	void report(const char *callee, size_t depth, size_t dirty, Timing timing)
+	{
+		cheriot::perf::print_row("call",
+		                         HasStackHighWaterMark,
+		                         callee,
+		                         depth,
+		                         dirty,
+		                         timing.call,
+		                         timing.ret);
+	}
+
+	/**
+	 * Print a phase estimate.
+	 */
+	void report_phase(const char *phase, int64_t cycles)
+	{
+		cheriot::perf::print_row("phase", HasStackHighWaterMark, phase, cycles);
+	}
+} // namespace
+
+void __cheri_compartment("caller") run()
+{
+	cheriot::perf::print_header("record",
+	                            "mshwm",
+	                            "callee",
+	                            "depth",
+	                            "dirty",
+	                            "call cycles",
+	                            "return cycles");
+
+	// Argument count: fewer arguments means more registers to zero.
+	Timing args0 = time_call(0, [] { return noop_args0(); });
+	Timing args2 = time_call(0, [] { return noop_args2(1, 2); });
+	Timing args4 = time_call(0, [] { return noop_args4(1, 2, 3, 4); });
+	Timing args6 = time_call(0, [] { return noop_args6(1, 2, 3, 4, 5, 6); });
+	report("noop_args0", 0, 0, args0);
+	report("noop_args2", 0, 0, args2);
+	report("noop_args4", 0, 0, args4);
+	report("noop_args6", 0, 0, args6);
+
+	// A bounded-stack callee has only a small window zeroed.
+	Timing bounded = time_call(0, [] { return noop_bounded(); });
+	report("noop_bounded", 0, 0, bounded);
+
+	// Stack depth and high water mark state: how much of the caller's stack
+	// is dirty before the call.
+	static constexpr size_t Depths[] = {0, 0x100, 0x400};
+	static constexpr size_t Dirty[]  = {0, 0x100, 0x400};
+	Timing dirtyDeepest{};
+	for (size_t depth : Depths)
+	{
+		for (size_t dirty : Dirty)
+		{
+			Timing timing = time_call_at_depth(
+			  depth, dirty, [] { return noop_args0(); });
+			report("noop_args0", depth, dirty, timing);
+			if ((depth == 0) && (dirty == Dirty[2]))
+			{
+				dirtyDeepest = timing;
+			}
+		}
+	}
+
+	// Return-path zeroing: how much stack the callee dirties.
+	Timing dirtyReturn{};
+	for (size_t dirty : Dirty)
+	{
+		Timing timing = time_call(0, [=] { return dirty_return(dirty); });
+		report("dirty_return", 0, dirty, timing);
+		dirtyReturn = timing;
+	}
+
+	cheriot::perf::print_header("record", "mshwm", "phase", "cycles");
+	// The bounded callee's call path is the trusted-stack push, the stack
+	// chop, unsealing the export entry and loading the callee's state, with
+	// almost no zeroing.
+	report_phase("call_fixed", bounded.call);
+	report_phase("call_stack_zeroing", dirtyDeepest.call - bounded.call);
+	report_phase("argument_zeroing", args0.call - args6.call);
+	report_phase("return_fixed", bounded.ret);
+	report_phase("return_stack_zeroing", dirtyReturn.ret - args0.ret);
+}
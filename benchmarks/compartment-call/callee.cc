@@ -1,5 +1,15 @@
 #include "callee.h"
-#include "../timing.h"
+#include <perf.h>
 
-int  noop_return_rdcycle() { return rdcycle(); }
+uint64_t noop_return_rdcycle()
+{
+	return perf_cycles();
+}
 
+// The same function, but with a small bounded stack so that the switcher
+// zeroes only the bytes that it can use.
+CHERIOT_BOUNDED_STACK_EXPORT("_Z27noop_return_rdcycle_boundedv");
+__cheriot_minimum_stack(0x20) uint64_t noop_return_rdcycle_bounded()
+{
+	return perf_cycles();
+}
@@ -1,3 +1,5 @@
 #include <compartment.h>
+#include <stdint.h>
 
-int __cheri_compartment("callee") noop_return_rdcycle();
+uint64_t __cheri_compartment("callee") noop_return_rdcycle();
+uint64_t __cheri_compartment("callee") noop_return_rdcycle_bounded();
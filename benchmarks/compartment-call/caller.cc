@@ -1,16 +1,40 @@
-#include "../timing.h"
+#include "../stack.h"
 #include "callee.h"
 #include <compartment.h>
 #include <locks.hh>
+#include <perf.hh>
 #include <stdio.h>
 #include <vector>
 
+namespace
+{
+	/**
+	 * Time a call to `fn`, which must return the cycle count in the callee.
+	 * Returns the cycles for the whole call, for the call path and for the
+	 * return path.
+	 */
+	template<typename Fn>
+	std::tuple<int64_t, int64_t, int64_t> time_call(Fn &&fn)
+	{
+		return CHERI::with_interrupts_disabled([&]() {
+			uint64_t start  = perf_cycles();
+			uint64_t middle = fn();
+			uint64_t end    = perf_cycles();
+			return std::tuple<int64_t, int64_t, int64_t>{
+			  end - start, middle - start, end - middle};
+		});
+	}
+} // namespace
+
 void __cheri_compartment("caller") run()
 {
-	static std::array<std::tuple<size_t, int, int, int>, 5> results;
-	static int                                              nextResult = 0;
-	static TicketLock                                       lock;
-	static bool                                             headerWritten;
+	static std::array<
+	  std::tuple<size_t, int64_t, int64_t, int64_t, int64_t, int64_t, int64_t>,
+	  5>
+	                  results;
+	static int        nextResult = 0;
+	static TicketLock lock;
+	static bool       headerWritten;
 	size_t stackSize = get_stack_size();
 	// Make sure that we hit the lock last if we have the biggest stack.  We
 	// don't have enough stack space for the log call on the smallest stacks.
@@ -20,23 +44,41 @@ void __cheri_compartment("caller") run()
 		thread_sleep(&timeout);
 	}
 	LockGuard g{lock};
-	auto [full, callPath, returnPath] = CHERI::with_interrupts_disabled([&]() {
-		auto start  = rdcycle();
-		auto middle = noop_return_rdcycle();
-		auto end    = rdcycle();
-		return std::tuple{end - start, middle - start, end - middle};
-	});
-	results[nextResult++]             = {stackSize, full, callPath, returnPath};
+	auto [full, callPath, returnPath] =
+	  time_call([]() { return noop_return_rdcycle(); });
+	auto [boundedFull, boundedCallPath, boundedReturnPath] =
+	  time_call([]() { return noop_return_rdcycle_bounded(); });
+	results[nextResult++] = {stackSize,
+	                         full,
+	                         callPath,
+	                         returnPath,
+	                         boundedFull,
+	                         boundedCallPath,
+	                         boundedReturnPath};
 	if (stackSize == 0x1000)
 	{
-		printf("#board\tstack size\tfull call\tcall\treturn\n");
-		for (auto [stackSize, full, callPath, returnPath] : results)
+		cheriot::perf::print_header("stack size",
+		                            "full call",
+		                            "call",
+		                            "return",
+		                            "bounded full call",
+		                            "bounded call",
+		                            "bounded return");
+		for (auto [stackSize,
+		           full,
+		           callPath,
+		           returnPath,
+		           boundedFull,
+		           boundedCallPath,
+		           boundedReturnPath] : results)
 		{
-			printf(__XSTRING(BOARD) "\t%d\t%d\t%d\t%d\n",
-			       stackSize,
-			       full,
-			       callPath,
-			       returnPath);
+			cheriot::perf::print_row(stackSize,
+			                         full,
+			                         callPath,
+			                         returnPath,
+			                         boundedFull,
+			                         boundedCallPath,
+			                         boundedReturnPath);
 		}
 	}
 }
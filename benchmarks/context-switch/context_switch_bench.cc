@@ -0,0 +1,193 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <timeout.h>
+
+/**
+ * Measure the cost of switching between two threads in the same compartment.
+ *
+ * Two threads with the same priority run the benchmark.  Each switch goes
+ * through the switcher's exception entry, spills the outgoing thread's
+ * registers to its trusted stack, calls the scheduler, and reloads the
+ * incoming thread's registers.  The benchmark measures three ways of getting
+ * there:
+ *
+ *  - `yield`: each thread calls `yield`, so every round trip is two explicit
+ *    (`ecall`) switches.
+ *  - `futex`: the threads hand a token back and forth with a futex, so every
+ *    round trip is two wakes, each followed by a wait that blocks, and so
+ *    adds a cross-compartment call into the scheduler to each switch.
+ *  - `interrupt`: one thread lowers its priority and spins while the other
+ *    sleeps for a tick.  The timer interrupt preempts the spinning thread,
+ *    and the sample is the time from the last cycle count that it recorded to
+ *    the first that the woken thread records.
+ *
+ * Samples are in cycles and are taken by the first thread to start.
+ */
+
+namespace
+{
+	/// Number of samples for each measurement.
+	constexpr size_t Iterations = 200;
+
+	/// Number of threads running the benchmark.
+	constexpr uint32_t Threads = 2;
+
+	/**
+	 * The priority that the spinning thread drops to in the interrupt
+	 * measurement, below the priority of both threads in the firmware.
+	 */
+	constexpr uint8_t SpinnerPriority = 1;
+
+	/// Counter used as a barrier between measurements.
+	cheriot::atomic<uint32_t> arrived;
+
+	/// Futex word passed between the threads in the ping-pong measurement.
+	cheriot::atomic<uint32_t> turn;
+
+	/**
+	 * The low 32 bits of the cycle counter, most recently recorded by the
+	 * spinning thread in the interrupt measurement.
+	 */
+	volatile uint32_t lastSpin;
+
+	/// Set when the spinning thread should stop.
+	volatile bool spinDone;
+
+	/// Samples for the current measurement.
+	int64_t samples[Iterations];
+
+	/**
+	 * Wait for both threads to reach the barrier for `round`.
+	 */
+	void barrier(uint32_t round)
+	{
+		uint32_t target = (round + 1) * Threads;
+		uint32_t value  = ++arrived;
+		if (value == target)
+		{
+			arrived.notify_all();
+			return;
+		}
+		while (value < target)
+		{
+			arrived.wait(value);
+			value = arrived;
+		}
+	}
+
+	/**
+	 * Measure two yields, one by each thread.
+	 */
+	void measure_yield(bool recorder)
+	{
+		for (size_t i = 0; i < Iterations; i++)
+		{
+			uint64_t start = perf_cycles();
+			yield();
+			if (recorder)
+			{
+				samples[i] = perf_cycles() - start;
+			}
+		}
+	}
+
+	/**
+	 * Measure passing a token through a futex to the other thread and back.
+	 */
+	void measure_futex(uint32_t me, bool recorder)
+	{
+		for (size_t i = 0; i < Iterations; i++)
+		{
+			uint64_t start    = perf_cycles();
+			uint32_t expected = (i * Threads) + me;
+			uint32_t value;
+			while ((value = turn) != expected)
+			{
+				turn.wait(value);
+			}
+			turn++;
+			turn.notify_one();
+			if (recorder)
+			{
+				// The first sample includes waiting for the other thread to
+				// start, skip it.
+				samples[i] = (i == 0) ? 0 : perf_cycles() - start;
+			}
+		}
+	}
+
+	/**
+	 * One thread sleeps for a tick at a time and measures how long it takes
+	 * to start running after the timer interrupt preempts the other thread,
+	 * which spins at a lower priority.
+	 */
+	void measure_interrupt(bool recorder)
+	{
+		if (!recorder)
+		{
+			thread_priority_set(SpinnerPriority);
+			while (!spinDone)
+			{
+				lastSpin = perf_cycles();
+			}
+			return;
+		}
+		size_t count = 0;
+		for (size_t i = 0; i < Iterations; i++)
+		{
+			Timeout t{1};
+			lastSpin = 0;
+			thread_sleep(&t, ThreadSleepNoEarlyWake);
+			uint32_t now  = perf_cycles();
+			uint32_t then = lastSpin;
+			// If the other thread did not run (for example, because it had
+			// not yet lowered its priority), there is no sample.
+			if (then != 0)
+			{
+				samples[count++] = now - then;
+			}
+		}
+		spinDone = true;
+		cheriot::perf::print_statistics(
+		  cheriot::perf::statistics(samples, count), "interrupt");
+	}
+} // namespace
+
+void __cheri_compartment("context_switch_bench") run()
+{
+	static cheriot::atomic<uint32_t> started;
+	uint32_t                         me       = started++;
+	bool                             recorder = (me == 0);
+	if (recorder)
+	{
+		cheriot::perf::print_statistics_header("switch");
+	}
+	uint32_t round = 0;
+	barrier(round++);
+	measure_yield(recorder);
+	if (recorder)
+	{
+		cheriot::perf::print_statistics(
+		  cheriot::perf::statistics(samples, Iterations), "yield");
+	}
+	barrier(round++);
+	measure_futex(me, recorder);
+	if (recorder)
+	{
+		cheriot::perf::print_statistics(
+		  cheriot::perf::statistics(samples + 1, Iterations - 1), "futex");
+	}
+	barrier(round++);
+	measure_interrupt(recorder);
+	if (recorder)
+	{
+		simulation_exit(0);
+	}
+}
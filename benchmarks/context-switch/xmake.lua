@@ -0,0 +1,43 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT context-switch benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+compartment("context_switch_bench")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("context_switch_bench.cc")
+
+-- Firmware image for the benchmark.  The two threads have the same priority
+-- so that each yield switches to the other.  One drops to priority 1 for the
+-- interrupt measurement.
+firmware("context-switch-benchmark")
+    add_deps("crt", "freestanding", "atomic", "stdio", "string", "debug")
+    add_deps("context_switch_bench")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "context_switch_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            {
+                compartment = "context_switch_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            }
+        }, {expand = false})
+    end)
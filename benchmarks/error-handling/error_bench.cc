@@ -0,0 +1,50 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include "faults.h"
+#include <cheri.hh>
+#include <perf.hh>
+#include <simulator.h>
+
+/**
+ * Measure the cost of recovering from a fault in a called compartment.
+ *
+ * Each sample is one cross-compartment call, with interrupts disabled, to a
+ * function that executes an illegal instruction.  The rows are:
+ *
+ *  - `no fault`: the same call without the fault, as a baseline.
+ *  - `resume`: a stackful `compartment_error_handler` skips the instruction
+ *    and returns `InstallContext`.  This copies the register state to the
+ *    handler's stack and back.
+ *  - `unwind`: the stackless handler from `unwind_error_handler` jumps to the
+ *    enclosing `CHERIOT_HANDLER` block, without copying register state.
+ *  - `force unwind`: the compartment has no handler and so the switcher
+ *    unwinds to the caller, which sees `-ECOMPARTMENTFAIL`.
+ *
+ * The cost of the fault is the difference from the baseline.
+ */
+
+namespace
+{
+	/// Number of samples for each row.
+	constexpr size_t Samples = 100;
+
+	template<typename Fn>
+	void measure(const char *name, Fn &&fn)
+	{
+		auto stats = cheriot::perf::measure<Samples>([&]() {
+			CHERI::with_interrupts_disabled([&]() { fn(); });
+		});
+		cheriot::perf::print_statistics(stats, name);
+	}
+} // namespace
+
+void __cheri_compartment("error_bench") run()
+{
+	cheriot::perf::print_statistics_header("recovery");
+	measure("no fault", []() { no_fault(); });
+	measure("resume", []() { fault_and_resume(); });
+	measure("unwind", []() { fault_and_unwind(); });
+	measure("force unwind", []() { fault_and_force_unwind(); });
+	simulation_exit(0);
+}
@@ -0,0 +1,30 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include "faults.h"
+#include <priv/riscv.h>
+
+extern "C" ErrorRecoveryBehaviour
+compartment_error_handler(ErrorState *frame, size_t mcause, size_t)
+{
+	if (mcause != priv::MCAUSE_ILLEGAL_INSTRUCTION)
+	{
+		return ErrorRecoveryBehaviour::ForceUnwind;
+	}
+	// Skip the 16-bit illegal instruction.
+	frame->pcc = static_cast<char *>(frame->pcc) + 2;
+	return ErrorRecoveryBehaviour::InstallContext;
+}
+
+int no_fault()
+{
+	return 0;
+}
+
+int fault_and_resume()
+{
+	// This cannot use `__builtin_trap` because the compiler knows that it does
+	// not return.
+	asm volatile("c.unimp");
+	return 0;
+}
@@ -0,0 +1,10 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include "faults.h"
+
+int fault_and_force_unwind()
+{
+	asm volatile("c.unimp");
+	return 0;
+}
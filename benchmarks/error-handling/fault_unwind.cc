@@ -0,0 +1,16 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include "faults.h"
+#include <unwind.h>
+
+int fault_and_unwind()
+{
+	volatile int ret = 0;
+	CHERIOT_DURING
+	asm volatile("c.unimp");
+	CHERIOT_HANDLER
+	ret = 1;
+	CHERIOT_END_HANDLER
+	return ret;
+}
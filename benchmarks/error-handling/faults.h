@@ -0,0 +1,26 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <stdint.h>
+
+/// Returns without faulting, as a baseline for the cost of the call.
+int __cheri_compartment("fault_resume") no_fault();
+
+/**
+ * Executes an illegal instruction.  The compartment's stackful error handler
+ * skips it and resumes.
+ */
+int __cheri_compartment("fault_resume") fault_and_resume();
+
+/**
+ * Executes an illegal instruction in a `CHERIOT_DURING` block, which the
+ * stackless handler from `unwind_error_handler` unwinds to.
+ */
+int __cheri_compartment("fault_unwind") fault_and_unwind();
+
+/**
+ * Executes an illegal instruction in a compartment with no error handler, so
+ * the switcher forcibly unwinds to the caller.
+ */
+int __cheri_compartment("fault_unhandled") fault_and_force_unwind();
@@ -0,0 +1,46 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT error-handling benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+-- Compartments that fault, each recovering in a different way.
+compartment("fault_resume")
+    add_files("fault_resume.cc")
+
+compartment("fault_unwind")
+    -- The stackless error handler must be linked into the compartment.
+    add_deps("unwind_error_handler")
+    add_files("fault_unwind.cc")
+
+compartment("fault_unhandled")
+    add_files("fault_unhandled.cc")
+
+compartment("error_bench")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("error_bench.cc")
+
+-- Firmware image for the benchmark.
+firmware("error-handling-benchmark")
+    add_deps("crt", "freestanding", "atomic", "stdio", "string", "debug")
+    add_deps("error_bench", "fault_resume", "fault_unwind", "fault_unhandled")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "error_bench",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x800,
+                trusted_stack_frames = 3
+            }
+        }, {expand = false})
+    end)
@@ -0,0 +1,11 @@
+#include "callee.h"
+#include "../stack.h"
+
+/**
+ * Dirty `bytes` of stack, so that the switcher has that much to zero when
+ * this returns.
+ */
+void dirty_stack(size_t bytes)
+{
+	use_stack(bytes);
+}
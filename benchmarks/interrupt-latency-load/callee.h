@@ -0,0 +1,4 @@
+#include <compartment.h>
+#include <stddef.h>
+
+void __cheri_compartment("irq_load_callee") dirty_stack(size_t bytes);
@@ -0,0 +1,202 @@
+#include "callee.h"
+#include <atomic>
+#include <compartment.h>
+#include <debug.hh>
+#include <futex.h>
+#include <perf.hh>
+#include <platform-timer.hh>
+#include <simulator.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <timeout.h>
+
+/**
+ * Measure the latency from a timer interrupt to the thread that it wakes
+ * while the rest of the system is busy in one of several ways.
+ *
+ * The measuring thread has the highest priority.  For each sample, it reads
+ * the timer, sleeps for one tick and reads the timer again on waking.  The
+ * latency is the time that elapsed beyond the tick, so it includes the
+ * (constant) cost of entering `thread_sleep` as well as the time that the
+ * interrupt was held off and the cost of delivering it.  The `idle` scenario
+ * gives the baseline.  Times are in timer cycles, not CPU cycles.
+ *
+ * In every other scenario, one or more lower-priority load threads run while
+ * the measuring thread sleeps:
+ *
+ *  - `revocation` frees memory and empties the quarantine, so that the
+ *    allocator is usually in a revocation pass.
+ *  - `switcher_zeroing` calls a compartment that dirties a large stack, so
+ *    that the switcher is usually zeroing stack.
+ *  - `debug_logging` writes debug messages to the UART.
+ *  - `timed_futexes` has several threads repeatedly blocking on futexes with
+ *    short timeouts, so that the timer queue is full.
+ *
+ * The output is a table in the format of `perf.hh`, with one row per
+ * scenario giving the statistics of its samples.  Each row includes the board
+ * and the revoker, so the output from each configuration built by
+ * `scripts/build_benchmark_configs.sh` can be concatenated.
+ */
+
+namespace
+{
+	/**
+	 * The scenarios, in the order in which they are run.
+	 */
+	enum Scenario : uint32_t
+	{
+		Idle,
+		Revocation,
+		SwitcherZeroing,
+		DebugLogging,
+		TimedFutexes,
+		Done
+	};
+
+	constexpr const char *ScenarioNames[] = {
+	  "idle",
+	  "revocation",
+	  "switcher_zeroing",
+	  "debug_logging",
+	  "timed_futexes",
+	};
+
+#ifdef SOFTWARE_REVOKER
+	constexpr const char *Revoker = "software";
+#elifdef TEMPORAL_SAFETY
+	constexpr const char *Revoker = "hardware";
+#elifdef CHERIOT_FAKE_REVOKER
+	constexpr const char *Revoker = "fake";
+#else
+	constexpr const char *Revoker = "none";
+#endif
+
+	/**
+	 * The number of samples taken in each scenario.
+	 */
+	constexpr size_t Samples = 100;
+
+	/**
+	 * The number of bytes of stack that the switcher-zeroing load dirties in
+	 * each call.
+	 */
+	constexpr size_t DirtyBytes = 0x800;
+
+	/**
+	 * The scenario that is currently running.  Load threads wait on this for
+	 * their scenario to start.
+	 */
+	std::atomic<uint32_t> scenario;
+
+	/**
+	 * Run `body` repeatedly whenever `mine` is the current scenario, blocking
+	 * in between.
+	 */
+	[[noreturn]] void run_load(Scenario mine, auto &&body)
+	{
+		while (true)
+		{
+			uint32_t current;
+			while ((current = scenario.load()) != mine)
+			{
+				scenario.wait(current);
+			}
+			body();
+		}
+	}
+
+	/**
+	 * Take one latency sample: the number of timer cycles beyond one tick
+	 * that a one-tick sleep took.
+	 */
+	int32_t sample()
+	{
+		Timeout  t{1};
+		uint64_t start = TimerCore::time();
+		thread_sleep(&t, ThreadSleepNoEarlyWake);
+		uint64_t end = TimerCore::time();
+		return static_cast<int32_t>(end - start - TIMERCYCLES_PER_TICK);
+	}
+
+	/**
+	 * Sample the latency in the current scenario and print a row with the
+	 * statistics of the samples.
+	 */
+	void measure(Scenario which)
+	{
+		static int64_t samples[Samples];
+		scenario = which;
+		scenario.notify_all();
+		for (auto &s : samples)
+		{
+			s = sample();
+		}
+		cheriot::perf::print_statistics(
+		  cheriot::perf::statistics(samples, Samples),
+		  Revoker,
+		  ScenarioNames[which]);
+	}
+} // namespace
+
+/**
+ * The measuring thread.  Runs each scenario in turn and then exits.
+ */
+void __cheri_compartment("irq_load") run()
+{
+	TimerCore::init();
+	cheriot::perf::print_statistics_header("revoker", "scenario");
+	for (uint32_t s = Idle; s < Done; s++)
+	{
+		measure(static_cast<Scenario>(s));
+	}
+	scenario = Done;
+	scenario.notify_all();
+	simulation_exit(0);
+}
+
+/**
+ * Load thread that keeps the allocator revoking.
+ */
+void __cheri_compartment("irq_load") load_revocation()
+{
+	run_load(Revocation, []() {
+		free(malloc(256));
+		heap_quarantine_empty();
+	});
+}
+
+/**
+ * Load thread that keeps the switcher zeroing stack on compartment return.
+ */
+void __cheri_compartment("irq_load") load_switcher_zeroing()
+{
+	run_load(SwitcherZeroing, []() { dirty_stack(DirtyBytes); });
+}
+
+/**
+ * Load thread that keeps the debug logger writing.
+ */
+void __cheri_compartment("irq_load") load_debug_logging()
+{
+	using Debug = ConditionalDebug<true, "Interrupt latency load">;
+	run_load(DebugLogging, []() {
+		static uint32_t line;
+		Debug::log("Writing debug line {} to keep the UART busy", line++);
+	});
+}
+
+/**
+ * Load threads that block on futexes with short timeouts, so that the timer
+ * queue always has several entries.  Each thread uses a different timeout so
+ * that their expiries are spread out.
+ */
+void __cheri_compartment("irq_load") load_timed_futex()
+{
+	run_load(TimedFutexes, []() {
+		Timeout t(1 + thread_id_get() % 3);
+		futex_timed_wait(&t,
+		                 reinterpret_cast<const uint32_t *>(&scenario),
+		                 TimedFutexes);
+	});
+}
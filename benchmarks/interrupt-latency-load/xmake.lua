@@ -0,0 +1,56 @@
+-- Copyright Microsoft and CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT interrupt latency under load benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+compartment("irq_load_callee")
+    add_files("callee.cc")
+
+compartment("irq_load")
+    add_defines("MALLOC_QUOTA=4096")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("suite.cc")
+
+-- Firmware image for the benchmark.  The measuring thread has the highest
+-- priority so that it preempts the load threads as soon as its sleep ends.
+-- The load threads idle on a futex until their scenario starts.
+firmware("interrupt-latency-load-benchmark")
+    add_deps("crt", "freestanding", "atomic", "stdio", "string", "debug")
+    add_deps("irq_load", "irq_load_callee")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        local load_thread = function(entry_point, stack_size)
+            return {
+                compartment = "irq_load",
+                priority = 1,
+                entry_point = entry_point,
+                stack_size = stack_size,
+                trusted_stack_frames = 3
+            }
+        end
+        target:values_set("threads", {
+            {
+                compartment = "irq_load",
+                priority = 3,
+                entry_point = "run",
+                stack_size = 0x800,
+                trusted_stack_frames = 3
+            },
+            load_thread("load_revocation", 0x400),
+            load_thread("load_switcher_zeroing", 0x1000),
+            load_thread("load_debug_logging", 0x800),
+            load_thread("load_timed_futex", 0x400),
+            load_thread("load_timed_futex", 0x400),
+            load_thread("load_timed_futex", 0x400),
+            load_thread("load_timed_futex", 0x400),
+        }, {expand = false})
+    end)
@@ -1,8 +1,9 @@
-#include "../timing.h"
+#include "../stack.h"
 #include <compartment.h>
 #include <debug.hh>
 #include <event.h>
 #include <locks.hh>
+#include <perf.hh>
 #include <simulator.h>
 #include <thread.h>
 #include <timeout.h>
@@ -15,7 +16,7 @@ using Debug = ConditionalDebug<DEBUG_INTERRUPT_BENCH, "Interrupt benchmark">;
 namespace
 {
 	std::atomic<uint32_t> event;
-	int                   start;
+	uint64_t              start;
 } // namespace
 
 /**
@@ -42,22 +43,21 @@ void __cheri_compartment("interrupt_bench") entry_high_priority()
 		if (!headerWritten)
 		{
 			Debug::log("Thread {} creating event", threadID);
-			printf("#board\tstack size\ttotal\n");
+			cheriot::perf::print_header("stack size", "total");
 			headerWritten = true;
 		}
 
-		int    end       = CHERI::with_interrupts_disabled([&]() {
-            uint32_t bits = 0;
-            Debug::log("Thread {} releasing ticket lock", threadID);
-            g.unlock();
-            Debug::log("Thread {} waiting on event", threadID);
-            event.wait(0);
-            int time = rdcycle();
-            Debug::Invariant(event == 1, "Futex woke spuriously");
-            return time;
-		         });
+		uint64_t end = CHERI::with_interrupts_disabled([&]() {
+			Debug::log("Thread {} releasing ticket lock", threadID);
+			g.unlock();
+			Debug::log("Thread {} waiting on event", threadID);
+			event.wait(0);
+			uint64_t time = perf_cycles();
+			Debug::Invariant(event == 1, "Futex woke spuriously");
+			return time;
+		});
 		size_t stackSize = get_stack_size();
-		printf(__XSTRING(BOARD) "\t%d\t%d\n", stackSize, end - start);
+		cheriot::perf::print_row(stackSize, static_cast<int64_t>(end - start));
 	}
 
 	// Last one out turns off the lights. This relies on all threads
@@ -97,7 +97,7 @@ void __cheri_compartment("interrupt_bench") entry_low_priority()
 			uint32_t bits = 0;
 			Debug::log("Low thread setting event");
 			event = 1;
-			start = rdcycle();
+			start = perf_cycles();
 			event.notify_all();
 		});
 	}
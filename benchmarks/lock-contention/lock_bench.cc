@@ -0,0 +1,120 @@
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <locks.hh>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdio.h>
+#include <thread.h>
+
+/**
+ * Measure the cost of acquiring a contended flag lock, with and without
+ * spinning before sleeping.
+ *
+ * Two threads of the same priority repeatedly acquire a lock, run a short
+ * critical section, and release it.  When the scheduler preempts a thread in
+ * the critical section, the other thread finds the lock held.  A plain
+ * `FlagLock` sleeps immediately, an adaptive lock spins first for the number
+ * of cycles given in the output.
+ *
+ * For each lock and thread, the output gives the total cycles for all
+ * iterations, the number of acquisitions that took more than
+ * `SlowAcquireCycles` (which have been through the scheduler), and the
+ * longest acquisition.
+ */
+
+namespace
+{
+	/// Number of acquisitions per thread for each lock.
+	constexpr int Iterations = 2000;
+
+	/// Acquisitions slower than this are counted as contended.
+	constexpr int SlowAcquireCycles = 1000;
+
+	/// Number of threads running the benchmark.
+	constexpr uint32_t Threads = 2;
+
+	/// Counter used as a barrier between locks.
+	cheriot::atomic<uint32_t> arrived;
+
+	/// Shared state updated in the critical section.
+	volatile uint32_t shared;
+
+	/**
+	 * Wait for both threads to reach the barrier for `round`.
+	 */
+	void barrier(uint32_t round)
+	{
+		uint32_t target = (round + 1) * Threads;
+		uint32_t value  = ++arrived;
+		if (value == target)
+		{
+			arrived.notify_all();
+			return;
+		}
+		while (value < target)
+		{
+			arrived.wait(value);
+			value = arrived;
+		}
+	}
+
+	/**
+	 * Run the benchmark for one lock.
+	 */
+	template<typename Lock>
+	void measure(const char *name, uint32_t spinCycles, uint32_t round)
+	{
+		static Lock lock;
+		barrier(round);
+		int64_t total   = 0;
+		int     slow    = 0;
+		int64_t longest = 0;
+		for (int i = 0; i < Iterations; i++)
+		{
+			uint64_t start = perf_cycles();
+			lock.lock();
+			uint64_t acquired = perf_cycles();
+			// A critical section of a few dozen cycles.
+			for (int j = 0; j < 8; j++)
+			{
+				shared = shared + 1;
+			}
+			lock.unlock();
+			uint64_t end = perf_cycles();
+			total += end - start;
+			int64_t latency = acquired - start;
+			if (latency > SlowAcquireCycles)
+			{
+				slow++;
+			}
+			if (latency > longest)
+			{
+				longest = latency;
+			}
+		}
+		cheriot::perf::print_row(
+		  name, spinCycles, thread_id_get(), total, slow, longest);
+	}
+} // namespace
+
+void __cheri_compartment("lock_bench") run()
+{
+	static bool headerWritten;
+	if (!headerWritten)
+	{
+		headerWritten = true;
+		cheriot::perf::print_header(
+		  "lock", "spin cycles", "thread", "total", "slow", "longest");
+	}
+	uint32_t round = 0;
+	measure<FlagLock>("FlagLock", 0, round++);
+	measure<FlagLockAdaptiveGeneric<50>>("FlagLockAdaptive", 50, round++);
+	measure<FlagLockAdaptive>(
+	  "FlagLockAdaptive", FlagLockDefaultSpinCycles, round++);
+	measure<FlagLockAdaptiveGeneric<1000>>("FlagLockAdaptive", 1000, round++);
+	// Last one out exits the simulator.
+	if (++arrived == (round + 1) * Threads)
+	{
+		simulation_exit(0);
+	}
+}
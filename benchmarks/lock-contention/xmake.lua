@@ -0,0 +1,42 @@
+-- Copyright Microsoft and CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT contended lock benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+compartment("lock_bench")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("lock_bench.cc")
+
+-- Firmware image for the benchmark.  The two threads have the same priority
+-- so that they are preempted by each other, sometimes while holding the lock.
+firmware("lock-contention-benchmark")
+    add_deps("crt", "freestanding", "atomic", "stdio", "string", "debug", "locks")
+    add_deps("lock_bench")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "lock_bench",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            {
+                compartment = "lock_bench",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            }
+        }, {expand = false})
+    end)
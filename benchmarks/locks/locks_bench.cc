@@ -0,0 +1,342 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <locks.hh>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <timeout.h>
+
+/**
+ * Microbenchmarks for the locking primitives and the futex calls that they
+ * are built on.
+ *
+ * Four threads run the benchmark.  The first has a higher priority in the
+ * firmware than the others and records most of the results.  Each thread's
+ * role is fixed by its thread ID, so the firmware must contain no other
+ * threads.  The benchmark prints three tables, all in cycles:
+ *
+ *  - `uncontended` and `contended`: the cost of an acquire / release pair
+ *    for each primitive, first on one thread with no competition and then
+ *    on all four threads at the same priority, acquiring in a loop with a
+ *    short critical section.  Semaphores are measured as a get / put pair on
+ *    a semaphore with a count of one.
+ *  - `wake`: the time from a `futex_wake` call to the first and to the last
+ *    of 1 to 3 waiters running.  The waker runs at a lower priority than the
+ *    waiters, so each waiter runs as soon as it is woken.
+ *  - `boost`: the time for a high-priority thread to acquire a
+ *    `FlagLockPriorityInherited` held by a low-priority thread that a
+ *    medium-priority thread is starving.  This includes lending priority to
+ *    the holder, switching to it, and its release waking the waiter.
+ */
+
+namespace
+{
+	/// Number of threads running the benchmark.
+	constexpr uint32_t Threads = 4;
+
+	/// Number of samples for each measurement.
+	constexpr size_t Iterations = 100;
+
+	/// The priority of the first thread in the firmware.
+	constexpr uint8_t HighPriority = 3;
+
+	/// The priority of the other threads in the firmware.
+	constexpr uint8_t MediumPriority = 2;
+
+	/// Priority that threads drop to when they must not preempt others.
+	constexpr uint8_t LowPriority = 1;
+
+	/**
+	 * A counting semaphore with a maximum count of one, with the lock
+	 * interface so that it can be measured in the same way as the locks.
+	 */
+	class Semaphore
+	{
+		CountingSemaphoreState state{1, 1};
+
+		public:
+		void lock()
+		{
+			Timeout t{UnlimitedTimeout};
+			semaphore_get(&t, &state);
+		}
+
+		void unlock()
+		{
+			semaphore_put(&state);
+		}
+	};
+
+	/// Counter used as a barrier between measurements.
+	cheriot::atomic<uint32_t> arrived;
+
+	/// Samples recorded by each thread.
+	int64_t samples[Threads][Iterations];
+
+	/// Shared state updated in critical sections.
+	volatile uint32_t shared;
+
+	/**
+	 * Wait for all threads to reach the barrier for `round`.
+	 */
+	void barrier(uint32_t round)
+	{
+		uint32_t target = (round + 1) * Threads;
+		uint32_t value  = ++arrived;
+		if (value == target)
+		{
+			arrived.notify_all();
+			return;
+		}
+		while (value < target)
+		{
+			arrived.wait(value);
+			value = arrived;
+		}
+	}
+
+	/**
+	 * Measure one primitive, uncontended on the first thread and then
+	 * contended on all threads.
+	 */
+	template<typename Lock>
+	void measure_lock(const char *name, uint32_t me, uint32_t &round)
+	{
+		static Lock lock;
+		if (me == 0)
+		{
+			cheriot::perf::print_statistics(
+			  cheriot::perf::measure<Iterations>([&]() {
+				  lock.lock();
+				  lock.unlock();
+			  }),
+			  "uncontended",
+			  name,
+			  1);
+			// Run the contended measurement at the same priority as the
+			// other threads.
+			thread_priority_set(MediumPriority);
+		}
+		barrier(round++);
+		for (size_t i = 0; i < Iterations; i++)
+		{
+			uint64_t start = perf_cycles();
+			lock.lock();
+			// A critical section of a few dozen cycles.
+			for (int j = 0; j < 8; j++)
+			{
+				shared = shared + 1;
+			}
+			lock.unlock();
+			samples[me][i] = perf_cycles() - start;
+		}
+		barrier(round++);
+		if (me == 0)
+		{
+			thread_priority_set(HighPriority);
+			cheriot::perf::print_statistics(
+			  cheriot::perf::statistics(&samples[0][0], Threads * Iterations),
+			  "contended",
+			  name,
+			  Threads);
+		}
+	}
+
+	/// The futex word for the wake measurement.
+	cheriot::atomic<uint32_t> wakeWord;
+
+	/// Number of waiters that have started waiting in this iteration.
+	cheriot::atomic<uint32_t> waitersReady;
+
+	/// Number of waiters that have run after the wake in this iteration.
+	cheriot::atomic<uint32_t> waitersRun;
+
+	/// The low 32 bits of the cycle counter just before the wake.
+	volatile uint32_t wakeTime;
+
+	/// The latency of the first and last waiter to run in this iteration.
+	volatile uint32_t firstRun, lastRun;
+
+	/**
+	 * Measure the time from a wake to each of `waiters` waiting threads
+	 * running.  Threads 1 to `waiters` wait, the first thread wakes them.
+	 */
+	void measure_wake(uint32_t me, uint32_t waiters, uint32_t &round)
+	{
+		if (me == 0)
+		{
+			thread_priority_set(LowPriority);
+		}
+		barrier(round++);
+		for (uint32_t i = 0; i < Iterations; i++)
+		{
+			if (me == 0)
+			{
+				// The waiters have a higher priority, so this runs only once
+				// all of them are blocked.
+				while (waitersReady != (i + 1) * waiters)
+				{
+					yield();
+				}
+				wakeTime = perf_cycles();
+				wakeWord = i + 1;
+				wakeWord.notify_all();
+				// All of the waiters have run and blocked again.
+				samples[0][i] = firstRun;
+				samples[1][i] = lastRun;
+			}
+			else if (me <= waiters)
+			{
+				++waitersReady;
+				wakeWord.wait(i);
+				uint32_t latency = static_cast<uint32_t>(perf_cycles()) -
+				                   static_cast<uint32_t>(wakeTime);
+				uint32_t run = ++waitersRun;
+				if (run == (i * waiters) + 1)
+				{
+					firstRun = latency;
+				}
+				if (run == (i + 1) * waiters)
+				{
+					lastRun = latency;
+				}
+			}
+		}
+		barrier(round++);
+		if (me == 0)
+		{
+			thread_priority_set(HighPriority);
+			cheriot::perf::print_statistics(
+			  cheriot::perf::statistics(samples[0], Iterations),
+			  "wake first",
+			  "futex",
+			  waiters);
+			cheriot::perf::print_statistics(
+			  cheriot::perf::statistics(samples[1], Iterations),
+			  "wake last",
+			  "futex",
+			  waiters);
+			wakeWord     = 0;
+			waitersReady = 0;
+			waitersRun   = 0;
+		}
+		barrier(round++);
+	}
+
+	/// The lock that the low-priority thread holds in the boost measurement.
+	FlagLockPriorityInherited boostLock;
+
+	/// The iteration for which the low-priority thread holds `boostLock`.
+	cheriot::atomic<uint32_t> held;
+
+	/// The iteration for which the high-priority thread wants `boostLock`.
+	volatile uint32_t requested;
+
+	/// The iteration for which the medium-priority thread should spin.
+	cheriot::atomic<uint32_t> spinStart;
+
+	/// The iteration for which the medium-priority thread should stop.
+	volatile uint32_t spinStop;
+
+	/**
+	 * Measure priority-inheritance boost latency.  The first thread (high
+	 * priority) waits for a lock held by the second (low priority) while the
+	 * third (medium priority) spins, so the holder runs only if it is
+	 * boosted.
+	 */
+	void measure_boost(uint32_t me, uint32_t &round)
+	{
+		if (me == 1)
+		{
+			thread_priority_set(LowPriority);
+		}
+		barrier(round++);
+		for (uint32_t i = 1; i <= Iterations; i++)
+		{
+			switch (me)
+			{
+				case 0:
+				{
+					// Wait until the low-priority thread holds the lock.
+					uint32_t value;
+					while ((value = held) != i)
+					{
+						held.wait(value);
+					}
+					// Start the medium-priority thread spinning.  It runs
+					// once this thread blocks.
+					spinStart = i;
+					spinStart.notify_one();
+					requested      = i;
+					uint64_t start = perf_cycles();
+					boostLock.lock();
+					samples[0][i - 1] = perf_cycles() - start;
+					spinStop          = i;
+					boostLock.unlock();
+					break;
+				}
+				case 1:
+					boostLock.lock();
+					held = i;
+					held.notify_one();
+					while (requested != i) {}
+					boostLock.unlock();
+					break;
+				case 2:
+				{
+					uint32_t value;
+					while ((value = spinStart) != i)
+					{
+						spinStart.wait(value);
+					}
+					while (spinStop != i) {}
+					break;
+				}
+			}
+		}
+		if (me == 1)
+		{
+			thread_priority_set(MediumPriority);
+		}
+		barrier(round++);
+		if (me == 0)
+		{
+			cheriot::perf::print_statistics(
+			  cheriot::perf::statistics(samples[0], Iterations),
+			  "boost",
+			  "FlagLockPriorityInherited",
+			  3);
+		}
+	}
+} // namespace
+
+void __cheri_compartment("locks_bench") run()
+{
+	// Thread IDs start at 1 and follow the order of the firmware's threads.
+	uint32_t me    = thread_id_get() - 1;
+	uint32_t round = 0;
+	if (me == 0)
+	{
+		cheriot::perf::print_statistics_header(
+		  "measurement", "primitive", "threads");
+	}
+	measure_lock<FlagLock>("FlagLock", me, round);
+	measure_lock<FlagLockPriorityInherited>(
+	  "FlagLockPriorityInherited", me, round);
+	measure_lock<TicketLock>("TicketLock", me, round);
+	measure_lock<RecursiveMutex>("RecursiveMutex", me, round);
+	measure_lock<Semaphore>("Semaphore", me, round);
+	for (uint32_t waiters = 1; waiters < Threads; waiters++)
+	{
+		measure_wake(me, waiters, round);
+	}
+	measure_boost(me, round);
+	if (me == 0)
+	{
+		simulation_exit(0);
+	}
+}
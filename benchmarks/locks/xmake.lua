@@ -0,0 +1,57 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT lock and futex benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+compartment("locks_bench")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("locks_bench.cc")
+
+-- Firmware image for the benchmark.  The benchmark assigns roles by thread
+-- ID, so these must be the only threads.  The first thread has the highest
+-- priority; the others lower their priorities as each measurement needs.
+firmware("locks-benchmark")
+    add_deps("crt", "freestanding", "atomic", "stdio", "string", "debug", "locks")
+    add_deps("locks_bench")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "locks_bench",
+                priority = 3,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            {
+                compartment = "locks_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            {
+                compartment = "locks_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            },
+            {
+                compartment = "locks_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 3
+            }
+        }, {expand = false})
+    end)
@@ -0,0 +1,88 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Measure `memcmp` and the constant-time comparisons for sizes from 8 bytes
+ * to 4 KiB, on equal buffers so that every byte is compared.
+ *
+ * `memcmp` is compared with the byte-at-a-time loop that it replaced, with
+ * both buffers word aligned (the word path) and with one buffer a byte off
+ * (the byte path).  A final column shows `memcmp` with a difference in the
+ * first byte, which is the early-out that `timingsafe_memcmp` deliberately
+ * does not take.
+ */
+
+namespace
+{
+	/// Number of calls per measurement.
+	constexpr int Iterations = 16;
+
+	/// Largest size measured.
+	constexpr size_t MaxSize = 4096;
+
+	alignas(4) unsigned char first[MaxSize + 4];
+	alignas(4) unsigned char second[MaxSize + 4];
+	alignas(4) unsigned char different[MaxSize];
+
+	/**
+	 * The byte-at-a-time comparison.  This is `noinline` so that the
+	 * compiler cannot specialise it for the call site any more than the
+	 * library version can be.
+	 */
+	__noinline int bytewise_memcmp(const void *s1, const void *s2, size_t n)
+	{
+		auto *p1 = static_cast<const unsigned char *>(s1);
+		auto *p2 = static_cast<const unsigned char *>(s2);
+		for (; n != 0; n--, p1++, p2++)
+		{
+			if (*p1 != *p2)
+			{
+				return *p1 - *p2;
+			}
+		}
+		return 0;
+	}
+
+	/**
+	 * Returns the mean number of cycles for `Iterations` calls to `fn`.  The
+	 * result of each call is stored to a volatile so that the comparison is
+	 * not removed.
+	 */
+	int64_t time(auto &&fn)
+	{
+		static volatile int result;
+		return cheriot::perf::mean(Iterations, [&]() { result = fn(); });
+	}
+} // namespace
+
+void __cheri_compartment("memcmp_bench") run()
+{
+	memset(first, 0x5a, sizeof(first));
+	memset(second, 0x5a, sizeof(second));
+	memset(different, 0xa5, sizeof(different));
+	cheriot::perf::print_header("size",
+	                            "bytewise",
+	                            "memcmp aligned",
+	                            "memcmp byte",
+	                            "timingsafe_memcmp",
+	                            "timingsafe_bcmp",
+	                            "memcmp early");
+	for (size_t size = 8; size <= MaxSize; size *= 2)
+	{
+		cheriot::perf::print_row(
+		  size,
+		  time([&]() { return bytewise_memcmp(first, second, size); }),
+		  time([&]() { return memcmp(first, second, size); }),
+		  time([&]() { return memcmp(first, second + 1, size); }),
+		  time([&]() { return timingsafe_memcmp(first, second, size); }),
+		  time([&]() { return timingsafe_bcmp(first, second, size); }),
+		  time([&]() { return memcmp(first, different, size); }));
+	}
+	simulation_exit(0);
+}
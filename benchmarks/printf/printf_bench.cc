@@ -0,0 +1,68 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdio.h>
+
+/**
+ * Measure `snprintf` for the kinds of format string used to build telemetry
+ * records: long literal runs, small and large decimal numbers, hexadecimal,
+ * and strings.
+ */
+
+namespace
+{
+	/// Number of calls per measurement.
+	constexpr int Iterations = 32;
+
+	/// Output buffer.
+	char buffer[128];
+
+	/**
+	 * Returns the mean number of cycles for `Iterations` calls to `fn`.
+	 */
+	int64_t time(auto &&fn)
+	{
+		return cheriot::perf::mean(Iterations, fn);
+	}
+
+	void report(const char *name, int64_t cycles)
+	{
+		cheriot::perf::print_row(name, cycles);
+	}
+} // namespace
+
+void __cheri_compartment("printf_bench") run()
+{
+	cheriot::perf::print_header("format", "cycles");
+	report("literal", time([]() {
+		       snprintf(buffer,
+		                sizeof(buffer),
+		                "{\"device\":\"sensor\",\"status\":\"ok\"}");
+	       }));
+	report("small decimal", time([]() {
+		       snprintf(buffer, sizeof(buffer), "%d %d %d", 1, 22, 333);
+	       }));
+	report("large decimal", time([]() {
+		       snprintf(
+		         buffer, sizeof(buffer), "%u %d", 4294967295U, -1234567890);
+	       }));
+	report("hex", time([]() {
+		       snprintf(buffer, sizeof(buffer), "%x %08x", 0xc0ffee, 0x1234);
+	       }));
+	report("string", time([]() {
+		       snprintf(buffer, sizeof(buffer), "%s=%s", "temperature", "21");
+	       }));
+	report("telemetry", time([]() {
+		       snprintf(buffer,
+		                sizeof(buffer),
+		                "{\"id\":%u,\"temp\":%d,\"hum\":%d,\"flags\":\"%x\"}",
+		                12345U,
+		                -21,
+		                48,
+		                0x5a);
+	       }));
+	simulation_exit(0);
+}
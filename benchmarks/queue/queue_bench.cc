@@ -0,0 +1,354 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <multiwaiter.h>
+#include <perf.hh>
+#include <queue.h>
+#include <simulator.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <timeout.h>
+
+/**
+ * Measure the throughput and one-way latency of message queues.
+ *
+ * One thread sends `Messages` messages and the other receives them, for each
+ * combination of:
+ *
+ *  - the queue interface: the library (`queue_send` / `queue_receive`), the
+ *    library's single-producer, single-consumer queue, the `message_queue`
+ *    compartment's sealed endpoints (`queue_send_sealed` /
+ *    `queue_receive_sealed`), or the library with a consumer that waits on a
+ *    multiwaiter before each receive;
+ *  - the element size;
+ *  - the queue depth; and
+ *  - whether the producer and consumer have the same priority or one of
+ *    them runs at a lower priority.
+ *
+ * The producer writes the low 32 bits of the cycle counter into the first
+ * word of each message and the consumer records the difference on receipt,
+ * so the latency includes any time that the message waits in the queue.
+ * Throughput is reported as messages per million cycles (multiply by the
+ * clock frequency in MHz for messages per second) over the time between the
+ * threads starting and the last message arriving.
+ */
+
+namespace
+{
+	/// Number of messages sent for each configuration.
+	constexpr size_t Messages = 128;
+
+	/// Number of threads running the benchmark.
+	constexpr uint32_t Threads = 2;
+
+	/// Element sizes to measure, in bytes.  Each holds at least a timestamp.
+	constexpr size_t ElementSizes[] = {4, 32, 128};
+
+	/// Largest element size.
+	constexpr size_t MaxElementSize = 128;
+
+	/// Queue depths to measure, in elements.
+	constexpr size_t Depths[] = {1, 8};
+
+	/// The priority of both threads in the firmware.
+	constexpr uint8_t HighPriority = 2;
+
+	/// The priority that the lower-priority thread drops to.
+	constexpr uint8_t LowPriority = 1;
+
+	/// The interfaces that the benchmark measures.
+	enum class Interface
+	{
+		Library,
+		SingleProducerConsumer,
+		Sealed,
+		Multiwaiter,
+	};
+
+	/// The relative priorities of the producer and consumer.
+	enum class Priorities
+	{
+		Equal,
+		ProducerHigher,
+		ConsumerHigher,
+	};
+
+	/// Counter used as a barrier between configurations.
+	cheriot::atomic<uint32_t> arrived;
+
+	/// The queue for library and multiwaiter configurations.
+	MessageQueue *queue;
+
+	/// The queue handle returned from `queue_create_sealed`.
+	SObj sealedQueue;
+
+	/// The send-only endpoint for sealed configurations.
+	SObj sendHandle;
+
+	/// The receive-only endpoint for sealed configurations.
+	SObj receiveHandle;
+
+	/// One-way latencies recorded by the consumer.
+	int64_t latencies[Messages];
+
+	/**
+	 * Wait for both threads to reach the barrier for `round`.
+	 */
+	void barrier(uint32_t round)
+	{
+		uint32_t target = (round + 1) * Threads;
+		uint32_t value  = ++arrived;
+		if (value == target)
+		{
+			arrived.notify_all();
+			return;
+		}
+		while (value < target)
+		{
+			arrived.wait(value);
+			value = arrived;
+		}
+	}
+
+	const char *interface_name(Interface interface)
+	{
+		switch (interface)
+		{
+			case Interface::Library:
+				return "library";
+			case Interface::SingleProducerConsumer:
+				return "spsc";
+			case Interface::Sealed:
+				return "sealed";
+			case Interface::Multiwaiter:
+				return "multiwaiter";
+		}
+		return "unknown";
+	}
+
+	const char *priorities_name(Priorities priorities)
+	{
+		switch (priorities)
+		{
+			case Priorities::Equal:
+				return "equal";
+			case Priorities::ProducerHigher:
+				return "producer";
+			case Priorities::ConsumerHigher:
+				return "consumer";
+		}
+		return "unknown";
+	}
+
+	/**
+	 * Create the queue for one configuration.  Called by the producer.
+	 */
+	void queue_setup(Interface interface, size_t elementSize, size_t depth)
+	{
+		Timeout t{UnlimitedTimeout};
+		switch (interface)
+		{
+			case Interface::Library:
+			case Interface::Multiwaiter:
+				queue_create(&t, MALLOC_CAPABILITY, &queue, elementSize, depth);
+				break;
+			case Interface::SingleProducerConsumer:
+				queue_create_single_producer_consumer(
+				  &t, MALLOC_CAPABILITY, &queue, elementSize, depth);
+				break;
+			case Interface::Sealed:
+				queue_create_sealed(
+				  &t, MALLOC_CAPABILITY, &sealedQueue, elementSize, depth);
+				queue_send_handle_create_sealed(
+				  &t, MALLOC_CAPABILITY, sealedQueue, &sendHandle);
+				queue_receive_handle_create_sealed(
+				  &t, MALLOC_CAPABILITY, sealedQueue, &receiveHandle);
+				break;
+		}
+	}
+
+	/**
+	 * Destroy the queue for one configuration.  Called by the producer.
+	 */
+	void queue_teardown(Interface interface)
+	{
+		if (interface == Interface::Sealed)
+		{
+			Timeout t{UnlimitedTimeout};
+			queue_destroy_sealed(&t, MALLOC_CAPABILITY, sendHandle);
+			queue_destroy_sealed(&t, MALLOC_CAPABILITY, receiveHandle);
+			queue_destroy_sealed(&t, MALLOC_CAPABILITY, sealedQueue);
+			return;
+		}
+		queue_destroy(MALLOC_CAPABILITY, queue);
+	}
+
+	/**
+	 * Send `Messages` messages, each stamped with the cycle counter.
+	 */
+	void produce(Interface interface)
+	{
+		alignas(void *) uint8_t buffer[MaxElementSize] = {};
+		for (size_t i = 0; i < Messages; i++)
+		{
+			Timeout t{UnlimitedTimeout};
+			*reinterpret_cast<uint32_t *>(buffer) =
+			  static_cast<uint32_t>(perf_cycles());
+			if (interface == Interface::Sealed)
+			{
+				queue_send_sealed(&t, sendHandle, buffer);
+			}
+			else
+			{
+				queue_send(&t, queue, buffer);
+			}
+		}
+	}
+
+	/**
+	 * Receive `Messages` messages and record their latencies.
+	 */
+	void consume(Interface interface, MultiWaiter *multiwaiter)
+	{
+		alignas(void *) uint8_t buffer[MaxElementSize];
+		for (size_t i = 0; i < Messages; i++)
+		{
+			Timeout t{UnlimitedTimeout};
+			switch (interface)
+			{
+				case Interface::Library:
+				case Interface::SingleProducerConsumer:
+					queue_receive(&t, queue, buffer);
+					break;
+				case Interface::Sealed:
+					queue_receive_sealed(&t, receiveHandle, buffer);
+					break;
+				case Interface::Multiwaiter:
+					while (true)
+					{
+						EventWaiterSource event;
+						multiwaiter_queue_receive_init(&event, queue);
+						multiwaiter_wait(&t, multiwaiter, &event, 1);
+						Timeout noWait{0};
+						if (queue_receive(&noWait, queue, buffer) == 0)
+						{
+							break;
+						}
+					}
+					break;
+			}
+			uint32_t now = static_cast<uint32_t>(perf_cycles());
+			latencies[i] = now - *reinterpret_cast<uint32_t *>(buffer);
+		}
+	}
+
+	/**
+	 * Run one configuration.  The producer is the thread with `me == 0`.
+	 */
+	void measure(uint32_t     me,
+	             Interface    interface,
+	             size_t       elementSize,
+	             size_t       depth,
+	             Priorities   priorities,
+	             MultiWaiter *multiwaiter,
+	             uint32_t    &round)
+	{
+		bool producer = (me == 0);
+		if (producer)
+		{
+			queue_setup(interface, elementSize, depth);
+		}
+		bool lower = (producer && (priorities == Priorities::ConsumerHigher)) ||
+		             (!producer && (priorities == Priorities::ProducerHigher));
+		if (lower)
+		{
+			thread_priority_set(LowPriority);
+		}
+		barrier(round++);
+		uint64_t start = perf_cycles();
+		if (producer)
+		{
+			produce(interface);
+		}
+		else
+		{
+			consume(interface, multiwaiter);
+		}
+		uint64_t end = perf_cycles();
+		if (lower)
+		{
+			thread_priority_set(HighPriority);
+		}
+		barrier(round++);
+		if (producer)
+		{
+			queue_teardown(interface);
+		}
+		else
+		{
+			auto stats = cheriot::perf::statistics(latencies, Messages);
+			cheriot::perf::print_row(
+			  interface_name(interface),
+			  elementSize,
+			  depth,
+			  priorities_name(priorities),
+			  static_cast<int64_t>(Messages * 1'000'000 / (end - start)),
+			  stats.median,
+			  stats.p99,
+			  stats.maximum);
+		}
+	}
+} // namespace
+
+void __cheri_compartment("queue_bench") run()
+{
+	static cheriot::atomic<uint32_t> started;
+	uint32_t                         me          = started++;
+	MultiWaiter                     *multiwaiter = nullptr;
+	if (me != 0)
+	{
+		Timeout t{UnlimitedTimeout};
+		multiwaiter_create(&t, MALLOC_CAPABILITY, &multiwaiter, 1);
+		cheriot::perf::print_header("interface",
+		                            "element size",
+		                            "depth",
+		                            "higher priority",
+		                            "messages/Mcycle",
+		                            "p50",
+		                            "p99",
+		                            "max");
+	}
+	uint32_t round = 0;
+	for (auto interface : {Interface::Library,
+	                       Interface::SingleProducerConsumer,
+	                       Interface::Sealed,
+	                       Interface::Multiwaiter})
+	{
+		for (size_t elementSize : ElementSizes)
+		{
+			for (size_t depth : Depths)
+			{
+				for (auto priorities : {Priorities::Equal,
+				                        Priorities::ProducerHigher,
+				                        Priorities::ConsumerHigher})
+				{
+					measure(me,
+					        interface,
+					        elementSize,
+					        depth,
+					        priorities,
+					        multiwaiter,
+					        round);
+				}
+			}
+		}
+	}
+	barrier(round++);
+	if (me != 0)
+	{
+		multiwaiter_delete(MALLOC_CAPABILITY, multiwaiter);
+		simulation_exit(0);
+	}
+}
@@ -0,0 +1,44 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT message queue benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+compartment("queue_bench")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("queue_bench.cc")
+
+-- Firmware image for the benchmark.  Both threads have the same priority in
+-- the firmware, one of them drops to a lower priority for the
+-- configurations where the producer or consumer has priority.
+firmware("queue-benchmark")
+    add_deps("crt", "freestanding", "atomic", "stdio", "string", "debug")
+    add_deps("message_queue", "message_queue_library")
+    add_deps("queue_bench")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "queue_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x600,
+                trusted_stack_frames = 4
+            },
+            {
+                compartment = "queue_bench",
+                priority = 2,
+                entry_point = "run",
+                stack_size = 0x600,
+                trusted_stack_frames = 4
+            }
+        }, {expand = false})
+    end)
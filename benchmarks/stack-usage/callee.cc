@@ -1,15 +1,16 @@
 #include "callee.h"
-#include "../timing.h"
+#include "../stack.h"
+#include <perf.h>
 
-int noop_return(size_t s)
+uint64_t noop_return(size_t s)
 {
 	use_stack(s);
-	return rdcycle();
+	return perf_cycles();
 }
 
-int noop_call(int start)
+int64_t noop_call(uint64_t start)
 {
-	int end = rdcycle();
+	uint64_t end = perf_cycles();
 	check_stack_zeroed();
 	return end - start;
 }
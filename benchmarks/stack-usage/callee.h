@@ -1,4 +1,5 @@
 #include <compartment.h>
+#include <stdint.h>
 
-int __cheri_compartment("callee") noop_return(size_t s);
-int __cheri_compartment("callee") noop_call(int start);
+uint64_t __cheri_compartment("callee") noop_return(size_t s);
+int64_t __cheri_compartment("callee") noop_call(uint64_t start);
@@ -1,21 +1,22 @@
-#include "../timing.h"
+#include "../stack.h"
 #include "callee.h"
 #include <compartment.h>
 #include <locks.hh>
+#include <perf.hh>
 
 void __cheri_compartment("caller") run()
 {
-	printf("#board\tstack_use\tcall\treturn\n");
+	cheriot::perf::print_header("stack_use", "call", "return");
 	for (size_t s = 1; s < 0x1000; s <<= 1)
 	{
 		auto [callPath, returnPath] = CHERI::with_interrupts_disabled([&]() {
 			use_stack(s);
-			auto callPath   = noop_call(rdcycle());
-			auto returnPath = noop_return(s);
-			returnPath      = rdcycle() - returnPath;
+			int64_t  callPath   = noop_call(perf_cycles());
+			uint64_t calleeTime = noop_return(s);
+			int64_t  returnPath = perf_cycles() - calleeTime;
 			check_stack_zeroed();
 			return std::tuple{callPath, returnPath};
 		});
-		printf(__XSTRING(BOARD) "\t%d\t%d\t%d\n", s, callPath, returnPath);
+		cheriot::perf::print_row(s, callPath, returnPath);
 	}
 }
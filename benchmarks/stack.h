@@ -1,27 +1,12 @@
 #include <cheri.hh>
 
+/**
+ * Stack helpers for the benchmarks.  Benchmarks measure time with the counters
+ * and harness in `perf.hh`.
+ */
+
 namespace
 {
-	/**
-	 * Read the cycle counter.
-	 */
-	int rdcycle()
-	{
-		int cycles;
-#ifdef SAIL
-		// On Sail, report the number of instructions, the cycle count is
-		// meaningless.
-		__asm__ volatile("csrr %0, minstret" : "=r"(cycles));
-#elifdef IBEX
-		// CHERIoT-Ibex does not yet implement rdcycle, so read the CSR
-		// directly.
-		__asm__ volatile("csrr %0, mcycle" : "=r"(cycles));
-#else
-		__asm__ volatile("rdcycle %0" : "=r"(cycles));
-#endif
-		return cycles;
-	}
-
 	/**
 	 * Utility function to return the size of the current stack based on the
 	 * length of csp capability register. If used in a thread entry point this
@@ -0,0 +1,191 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * Compare the word-at-a-time string functions in the `string` library with
+ * the byte-at-a-time loops that they replaced.
+ *
+ * Each function is run over strings of several lengths, starting both at a
+ * word-aligned address and one byte after one.  The string is the only thing
+ * in its allocation, so the bounds end just after the terminator and the
+ * library versions have to finish bytewise for the last partial word.
+ *
+ * `strstr` is compared with the naive search that it replaced, on the
+ * worst case for that search: a haystack of `a`s and a needle of `a`s that
+ * ends in `b`.
+ */
+
+namespace
+{
+	/// Number of calls per measurement.
+	constexpr int Iterations = 64;
+
+	/// Longest string measured.
+	constexpr size_t MaxLength = 256;
+
+	/// Buffer for the strings, with room for a misaligned start.
+	alignas(4) char buffer[MaxLength + 8];
+	alignas(4) char other[MaxLength + 8];
+
+	// The byte-at-a-time versions.  These are `noinline` so that the compiler
+	// cannot specialise them for the call site any more than the library
+	// versions can be.
+
+	__noinline size_t bytewise_strlen(const char *str)
+	{
+		const char *s;
+		for (s = str; *s; ++s) {}
+		return s - str;
+	}
+
+	__noinline char *bytewise_strchr(const char *s, int intChar)
+	{
+		char c = (char)intChar;
+		while (*s != c)
+		{
+			if (!*s++)
+			{
+				return nullptr;
+			}
+		}
+		return const_cast<char *>(s);
+	}
+
+	__noinline void *bytewise_memchr(const void *voidString, int intChar, size_t n)
+	{
+		const unsigned char  c = (unsigned char)intChar;
+		const unsigned char *s = (const unsigned char *)voidString;
+		for (size_t i = 0; i != n; i++)
+		{
+			if (*s == c)
+			{
+				return const_cast<unsigned char *>(s);
+			}
+			s++;
+		}
+		return nullptr;
+	}
+
+	__noinline int bytewise_strcmp(const char *s1, const char *s2)
+	{
+		while (*s1 == *s2++)
+		{
+			if (*s1++ == '\0')
+			{
+				return 0;
+			}
+		}
+		return *(const unsigned char *)s1 - *(const unsigned char *)(s2 - 1);
+	}
+
+	__noinline char *naive_strnstr(const char *haystack,
+	                               const char *needle,
+	                               size_t      haystackLength)
+	{
+		size_t needleLen = strlen(needle);
+
+		while ((haystackLength > needleLen) && (*haystack != 0))
+		{
+			if (strncmp(haystack, needle, needleLen) == 0)
+			{
+				return const_cast<char *>(haystack);
+			}
+			haystack++;
+			haystackLength--;
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Fill `target` with a string of `length` non-zero characters, starting
+	 * `offset` bytes in, and return a pointer bounded to the string and its
+	 * terminator.
+	 */
+	char *make_string(char *target, size_t offset, size_t length)
+	{
+		char *s = target + offset;
+		for (size_t i = 0; i < length; i++)
+		{
+			s[i] = static_cast<char>('a' + (i % 26));
+		}
+		s[length] = '\0';
+		return static_cast<char *>(
+		  __builtin_cheri_bounds_set_exact(s, length + 1));
+	}
+
+	/**
+	 * Returns the mean number of cycles for `Iterations` calls to `fn`.
+	 */
+	int64_t time(auto &&fn)
+	{
+		return cheriot::perf::mean(Iterations, fn);
+	}
+
+	void report(const char *function,
+	            size_t      offset,
+	            size_t      length,
+	            int64_t     bytewise,
+	            int64_t     wordwise)
+	{
+		cheriot::perf::print_row(function, offset, length, bytewise, wordwise);
+	}
+} // namespace
+
+void __cheri_compartment("string_bench") run()
+{
+	static constexpr size_t Lengths[] = {3, 8, 16, 31, 64, 128, MaxLength};
+	cheriot::perf::print_header(
+	  "function", "offset", "length", "bytewise", "wordwise");
+	for (size_t offset : {0, 1})
+	{
+		for (size_t length : Lengths)
+		{
+			char *s = make_string(buffer, offset, length);
+			char *t = make_string(other, offset, length);
+			// Search for the terminator, which is the worst case for
+			// `strchr` and `memchr`.
+			report("strlen",
+			       offset,
+			       length,
+			       time([&]() { bytewise_strlen(s); }),
+			       time([&]() { strlen(s); }));
+			report("strchr",
+			       offset,
+			       length,
+			       time([&]() { bytewise_strchr(s, '\0'); }),
+			       time([&]() { strchr(s, '\0'); }));
+			report("memchr",
+			       offset,
+			       length,
+			       time([&]() { bytewise_memchr(s, '\0', length + 1); }),
+			       time([&]() { memchr(s, '\0', length + 1); }));
+			report("strcmp",
+			       offset,
+			       length,
+			       time([&]() { bytewise_strcmp(s, t); }),
+			       time([&]() { strcmp(s, t); }));
+		}
+	}
+	for (size_t length : Lengths)
+	{
+		// A needle of up to 16 bytes, which is not in the haystack.
+		size_t needleLength = length < 17 ? length - 1 : 16;
+		memset(buffer, 'a', length);
+		buffer[length] = '\0';
+		memset(other, 'a', needleLength - 1);
+		other[needleLength - 1] = 'b';
+		other[needleLength]     = '\0';
+		report("strstr",
+		       0,
+		       length,
+		       time([&]() { naive_strnstr(buffer, other, SIZE_MAX); }),
+		       time([&]() { strstr(buffer, other); }));
+	}
+	simulation_exit(0);
+}
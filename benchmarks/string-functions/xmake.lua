@@ -0,0 +1,34 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT string function benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+-- Support libraries
+includes(path.join(sdkdir, "lib"))
+
+option("board")
+    set_default("sail")
+
+compartment("string_bench")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_files("string_bench.cc")
+
+-- Firmware image for the benchmark.
+firmware("string-functions-benchmark")
+    add_deps("crt", "freestanding", "stdio", "string", "debug")
+    add_deps("string_bench")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "string_bench",
+                priority = 1,
+                entry_point = "run",
+                stack_size = 0x400,
+                trusted_stack_frames = 2
+            }
+        }, {expand = false})
+    end)
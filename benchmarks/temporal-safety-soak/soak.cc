@@ -0,0 +1,258 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <debug.hh>
+#include <ds/xoroshiro.h>
+#include <perf.hh>
+#include <simulator.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <tick_macros.h>
+
+using Debug = ConditionalDebug<DEBUG_SOAK, "Temporal safety soak">;
+
+/**
+ * Measure the steady-state behaviour of quarantine and revocation under
+ * sustained allocation churn.
+ *
+ * Three threads allocate and free continuously, each with its own pattern of
+ * sizes and hold times (`Patterns`) and its own quota.  A fourth thread
+ * wakes every `SOAK_REPORT_SECONDS` seconds and prints one row covering the
+ * interval since the previous report:
+ *
+ *  - the bytes in quarantine and free at the end of the interval (from
+ *    `heap_statistics`, so -1 unless the allocator is built with
+ *    `--allocator-statistics=y`),
+ *  - revocation passes started per second (likewise),
+ *  - the allocations made, the number that failed (quota exceeded or timed
+ *    out) and the number that blocked for longer than `StallCycles`, which
+ *    are almost always waiting for revocation,
+ *  - the share of CPU time, in parts per thousand, that the churn threads
+ *    spent inside allocator calls and inside allocations that blocked.  With
+ *    the software revoker, sweeping happens inside allocator calls, so this
+ *    includes it; with a hardware revoker, revocation costs CPU time only
+ *    through blocking and the allocator's own work.
+ *
+ * The soak runs for `SOAK_SECONDS` seconds, or forever if that is zero.
+ */
+
+namespace
+{
+	/// Number of churn threads.  Must match the firmware.
+	constexpr uint32_t Threads = 3;
+
+	/// Number of objects that each thread may have live at once.
+	constexpr size_t Slots = 32;
+
+	/// Allocations slower than this are counted as blocked.
+	constexpr int64_t StallCycles = 20000;
+
+	/// Allocations wait for no more than this many ticks.
+	constexpr int32_t AllocationTimeout = 10;
+
+	/**
+	 * The allocation pattern of one churn thread.  Sizes are uniform in
+	 * `[minimumSize, maximumSize]` and each object is held for a uniform
+	 * number of the thread's operations in `[minimumHold, maximumHold]`.
+	 * After every `burst` operations, the thread sleeps for one tick so that
+	 * the revoker and the other threads can run.
+	 */
+	struct Pattern
+	{
+		const char *name;
+		size_t      quota;
+		size_t      minimumSize;
+		size_t      maximumSize;
+		size_t      minimumHold;
+		size_t      maximumHold;
+		size_t      burst;
+	};
+
+	/// The patterns for the churn threads, one each.
+	constexpr Pattern Patterns[Threads] = {
+	  // Many small, short-lived objects, such as messages.
+	  {"small-short", 8 * 1024, 16, 128, 1, 4, 256},
+	  // Medium buffers held for a while, such as packets in flight.
+	  {"medium-held", 32 * 1024, 256, 2048, 8, 64, 64},
+	  // Occasional large objects held for a long time.
+	  {"large-long", 64 * 1024, 2048, 8192, 32, 256, 16},
+	};
+
+	DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(smallQuota, Patterns[0].quota);
+	DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(mediumQuota, Patterns[1].quota);
+	DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(largeQuota, Patterns[2].quota);
+
+	/**
+	 * Counters updated by the churn threads and read (and reset) by the
+	 * reporter.
+	 */
+	struct Counters
+	{
+		cheriot::atomic<uint32_t> allocations;
+		cheriot::atomic<uint32_t> failed;
+		cheriot::atomic<uint32_t> blocked;
+		cheriot::atomic<uint64_t> allocatorCycles;
+		cheriot::atomic<uint64_t> blockedCycles;
+	};
+
+	/// The counters for the current interval.
+	Counters counters;
+
+	/// Counter used to give each churn thread an index.
+	cheriot::atomic<uint32_t> nextThread;
+
+	using Random = ds::xoroshiro::P64R32;
+
+	/// Returns a value drawn uniformly from `[minimum, maximum]`.
+	size_t uniform(Random &random, size_t minimum, size_t maximum)
+	{
+		return minimum + random() % (maximum - minimum + 1);
+	}
+
+	/// Returns `value` and sets it to zero.
+	template<typename T>
+	T take(cheriot::atomic<T> &value)
+	{
+		return value.exchange(0);
+	}
+
+	/// Returns `part` as parts per thousand of `whole`.
+	int64_t per_mille(uint64_t part, uint64_t whole)
+	{
+		return whole == 0 ? 0 : static_cast<int64_t>(part * 1000 / whole);
+	}
+} // namespace
+
+void __cheri_compartment("soak") churn()
+{
+	uint32_t thread = nextThread++;
+	Debug::Assert(thread < Threads, "Too many threads ({})", thread);
+	SObj heaps[Threads] = {STATIC_SEALED_VALUE(smallQuota),
+	                       STATIC_SEALED_VALUE(mediumQuota),
+	                       STATIC_SEALED_VALUE(largeQuota)};
+	SObj           heap    = heaps[thread];
+	const Pattern &pattern = Patterns[thread];
+	struct Slot
+	{
+		void  *object;
+		size_t expiry;
+	};
+	Slot   slots[Slots] = {};
+	Random random{thread + 1};
+	for (size_t op = 0;; op++)
+	{
+		// Free everything that has expired.  If no slot is free, free the
+		// one that would expire soonest.
+		Slot    *target         = nullptr;
+		uint64_t allocatorStart = perf_cycles();
+		for (auto &slot : slots)
+		{
+			if ((slot.object != nullptr) && (slot.expiry <= op))
+			{
+				heap_free(heap, slot.object);
+				slot.object = nullptr;
+			}
+		}
+		for (auto &slot : slots)
+		{
+			if (slot.object == nullptr)
+			{
+				target = &slot;
+				break;
+			}
+			if ((target == nullptr) || (slot.expiry < target->expiry))
+			{
+				target = &slot;
+			}
+		}
+		if (target->object != nullptr)
+		{
+			heap_free(heap, target->object);
+			target->object = nullptr;
+		}
+		size_t bytes =
+		  uniform(random, pattern.minimumSize, pattern.maximumSize);
+		Timeout  t{AllocationTimeout};
+		uint64_t start = perf_cycles();
+		target->object = heap_allocate(
+		  &t, heap, bytes, AllocateWaitRevocationNeeded | AllocateWaitHeapFull);
+		uint64_t end     = perf_cycles();
+		int64_t  latency = end - start;
+		target->expiry =
+		  op + uniform(random, pattern.minimumHold, pattern.maximumHold);
+		counters.allocations++;
+		counters.allocatorCycles += end - allocatorStart;
+		if (!__builtin_cheri_tag_get(target->object))
+		{
+			target->object = nullptr;
+			counters.failed++;
+		}
+		if (latency > StallCycles)
+		{
+			counters.blocked++;
+			counters.blockedCycles += latency;
+		}
+		if ((op + 1) % pattern.burst == 0)
+		{
+			Timeout sleep{1};
+			thread_sleep(&sleep);
+		}
+	}
+}
+
+void __cheri_compartment("soak") report()
+{
+	cheriot::perf::print_header("seconds",
+	                            "quarantine bytes",
+	                            "free bytes",
+	                            "passes/s",
+	                            "allocations",
+	                            "failed",
+	                            "blocked",
+	                            "allocator %o",
+	                            "blocked %o");
+	HeapStatistics stats;
+	bool           haveStatistics = heap_statistics(&stats) == 0;
+	uint32_t       passes         = haveStatistics ? stats.revocationPasses : 0;
+	uint64_t       last           = perf_cycles();
+	for (uint32_t seconds = SOAK_REPORT_SECONDS;
+	     (SOAK_SECONDS == 0) || (seconds <= SOAK_SECONDS);
+	     seconds += SOAK_REPORT_SECONDS)
+	{
+		Timeout t{MS_TO_TICKS(SOAK_REPORT_SECONDS * 1000)};
+		thread_sleep(&t, ThreadSleepNoEarlyWake);
+		uint64_t now = perf_cycles();
+		// There is one core, so the churn threads' cycles together are at
+		// most the elapsed cycles.
+		uint64_t elapsed = now - last;
+		last             = now;
+		int64_t quarantine      = -1;
+		int64_t freeBytes       = -1;
+		int64_t passesPerSecond = -1;
+		if (haveStatistics && (heap_statistics(&stats) == 0))
+		{
+			quarantine = stats.quarantineFinishedBytes;
+			for (uint32_t i = 0; i < stats.quarantinePendingRings; i++)
+			{
+				quarantine += stats.quarantinePendingBytes[i];
+			}
+			freeBytes = stats.freeBytes;
+			passesPerSecond =
+			  (stats.revocationPasses - passes) / SOAK_REPORT_SECONDS;
+			passes = stats.revocationPasses;
+		}
+		cheriot::perf::print_row(
+		  seconds,
+		  quarantine,
+		  freeBytes,
+		  passesPerSecond,
+		  take(counters.allocations),
+		  take(counters.failed),
+		  take(counters.blocked),
+		  per_mille(take(counters.allocatorCycles), elapsed),
+		  per_mille(take(counters.blockedCycles), elapsed));
+	}
+	simulation_exit(0);
+}
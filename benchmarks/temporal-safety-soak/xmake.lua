@@ -0,0 +1,70 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+set_project("CHERIoT temporal-safety soak benchmark");
+sdkdir = "../../sdk"
+includes(sdkdir)
+set_toolchains("cheriot-clang")
+
+option("board")
+    set_default("sail")
+
+option("soak-seconds")
+    set_default("0")
+    set_description("How long to run the soak for, in seconds (0 to run forever)")
+    set_showmenu(true)
+
+option("soak-report-seconds")
+    set_default("10")
+    set_description("Seconds between reports")
+    set_showmenu(true)
+
+debugOption("soak");
+compartment("soak")
+    add_deps("crt", "freestanding", "atomic", "stdio", "debug")
+    add_rules("cheriot.component-debug")
+    add_defines("BOARD=" .. tostring(get_config("board")))
+    add_defines("SOAK_SECONDS=" .. tostring(get_config("soak-seconds")))
+    add_defines("SOAK_REPORT_SECONDS=" .. tostring(get_config("soak-report-seconds")))
+    add_files("soak.cc")
+
+-- Firmware image for the benchmark.  The three churn threads have the same
+-- priority, so their allocations and frees interleave.  The reporter runs at
+-- a higher priority so that reports are on time, but sleeps between them.
+-- Build the allocator with --allocator-statistics=y to report quarantine
+-- sizes and revocation passes.
+firmware("temporal-safety-soak")
+    add_deps("soak")
+    on_load(function(target)
+        target:values_set("board", "$(board)")
+        target:values_set("threads", {
+            {
+                compartment = "soak",
+                priority = 1,
+                entry_point = "churn",
+                stack_size = 0x600,
+                trusted_stack_frames = 4
+            },
+            {
+                compartment = "soak",
+                priority = 1,
+                entry_point = "churn",
+                stack_size = 0x600,
+                trusted_stack_frames = 4
+            },
+            {
+                compartment = "soak",
+                priority = 1,
+                entry_point = "churn",
+                stack_size = 0x600,
+                trusted_stack_frames = 4
+            },
+            {
+                compartment = "soak",
+                priority = 2,
+                entry_point = "report",
+                stack_size = 0x600,
+                trusted_stack_frames = 4
+            },
+        }, {expand = false})
+    end)
@@ -5,6 +5,7 @@
 #include <debug.hh>
 #include <fail-simulator-on-error.h>
 #include <microvium/microvium.h>
+#include <microvium/microvium_arena.h>
 #include <platform-uart.hh>
 
 /// Expose debugging features unconditionally for this compartment.
@@ -19,10 +20,16 @@ namespace
 	 * microvium --output-bytes hello.js > bytecode.inc
 	 * ```
 	 */
-	uint8_t bytecode[] =
+	const uint8_t bytecode[] =
 #include "bytecode.inc"
 	  ;
 
+	/**
+	 * Memory for the VM.  Using a dedicated arena rather than the shared heap
+	 * bounds the VM's memory use.
+	 */
+	alignas(void *) uint8_t arenaMemory[2048];
+
 	/// Constant for the print function exposed to JavaScript->C++ FFI
 	static constexpr mvm_HostFunctionID ImportPrint = 1;
 
@@ -95,10 +102,13 @@ void __cheri_compartment("hello") say_hello()
 	// Load the JavaScript bytecode snapshot
 	{
 		mvm_VM *rawVm;
+		auto *arena =
+		  microvium_arena_create(arenaMemory, sizeof(arenaMemory));
+		Debug::Assert(arena != nullptr, "Failed to create arena");
 		err = mvm_restore(&rawVm,
-		                  bytecode,
+		                  const_cast<uint8_t *>(bytecode),
 		                  sizeof(bytecode),
-		                  MALLOC_CAPABILITY,
+		                  arena,
 		                  ::resolve_import);
 		Debug::Assert(
 		  err == MVM_E_SUCCESS, "Failed to parse bytecode: {}", err);
@@ -131,11 +141,19 @@ void __cheri_compartment("hello") say_hello()
 
 	// Run the GC to shrink the heap as much as possible and report usage.
 	Debug::log("Running GC");
-	mvm_runGC(vm.get(), true);
+	size_t reclaimed = microvium_collect(vm.get(), true);
 	reportMemory();
 
 	// Report the peak usage
 	Debug::log("Peak heap used: {} bytes, peak stack used: {} bytes",
 	           stats.virtualHeapHighWaterMark,
 	           stats.stackHighWaterMark);
+
+	// Report the arena usage
+	MicroviumArenaStatistics arenaStats;
+	microvium_statistics(vm.get(), &arenaStats);
+	Debug::log("GC reclaimed {} bytes, arena peak use: {} of {} bytes",
+	           reclaimed,
+	           arenaStats.peakUsed,
+	           arenaStats.capacity);
 }
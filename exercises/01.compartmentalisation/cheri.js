@@ -97,3 +97,55 @@ export const get_permissions = vmImport(10);
  * to leak the value.
  */
 export const check_secret = vmImport(11);
+
+/*******************************************************************************
+ * Batched calls.  Each call to an imported function above is a separate
+ * transition from JavaScript to C++.  A batch runs several of them in a
+ * single transition.
+ ******************************************************************************/
+
+/**
+ * run_batch(bytes)
+ *
+ * Runs the calls encoded in a Uint8Array and returns their results as a
+ * Uint8Array of 32-bit little-endian integers.  Use `batch` rather than
+ * calling this directly.
+ */
+export const run_batch = vmImport(12);
+
+/**
+ * batch(calls)
+ *
+ * Runs up to 16 calls in one transition and returns an array of their
+ * results.  Each call is an array of the number of the imported function
+ * (the argument to `vmImport` above) followed by up to three integer
+ * arguments, for example:
+ *
+ *   batch([[6, 0], [9, 0], [5, 1, 0, 8]])
+ *
+ * gets the address and length of register 0 and then stores register 1 at
+ * offset 8 from register 0.  Functions that return nothing give 0, `print`
+ * cannot be batched.
+ */
+export function batch(calls) {
+	const RecordSize = 13;
+	const bytes = new Uint8Array(calls.length * RecordSize);
+	for (let i = 0; i < calls.length; i++) {
+		const call = calls[i];
+		const offset = i * RecordSize;
+		bytes[offset] = call[0];
+		for (let arg = 0; arg < 3; arg++) {
+			const value = (arg + 1 < call.length) ? call[arg + 1] : 0;
+			for (let byte = 0; byte < 4; byte++) {
+				bytes[offset + 1 + arg * 4 + byte] = (value >> (byte * 8)) & 0xff;
+			}
+		}
+	}
+	const raw = run_batch(bytes);
+	const results = [];
+	for (let i = 0; i < calls.length; i++) {
+		results[i] = raw[i * 4] | (raw[i * 4 + 1] << 8) |
+			(raw[i * 4 + 2] << 16) | (raw[i * 4 + 3] << 24);
+	}
+	return results;
+}
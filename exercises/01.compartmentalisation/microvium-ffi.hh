@@ -5,7 +5,9 @@
 #include <functional>
 #include <magic_enum/magic_enum.hpp>
 #include <microvium/microvium.h>
+#include <string.h>
 #include <tuple>
+#include <utility>
 
 /**
  * Code related to the JavaScript interpreter.
@@ -32,6 +34,7 @@ namespace
 		GetLength,
 		GetPermissions,
 		CheckSecret,
+		RunBatch,
 	};
 
 	/// Constant for the say_hello function exposed to C++->JavaScript FFI
@@ -149,6 +152,18 @@ namespace
 		}
 	}
 
+	/**
+	 * Build a tuple of arguments from the integers in a batch record.
+	 */
+	template<typename Tuple>
+	__always_inline Tuple batch_arguments(const int32_t *args)
+	{
+		return [&]<size_t... Idx>(std::index_sequence<Idx...>) {
+			return Tuple{static_cast<std::tuple_element_t<Idx, Tuple>>(
+			  args[Idx])...};
+		}(std::make_index_sequence<std::tuple_size_v<Tuple>>());
+	}
+
 	/**
 	 * Helper template to extract the arguments from a function type.
 	 */
@@ -352,6 +367,86 @@ namespace
 	template<>
 	constexpr static auto ExportedFn<CheckSecret> = check_secret;
 
+	/**
+	 * Size of each call in a batch: a one-byte `Exports` value followed by
+	 * three 32-bit little-endian arguments.  Arguments that a function does
+	 * not take are ignored.
+	 */
+	static constexpr size_t BatchRecordSize = 1 + 3 * sizeof(int32_t);
+
+	/**
+	 * The largest number of calls in a batch.
+	 */
+	static constexpr size_t MaxBatchCalls = 16;
+
+	/**
+	 * Call `Fn` with arguments from a batch record, returning its result
+	 * coerced to an integer (zero for functions that return nothing).
+	 * Returns false if `Fn` cannot be called from a batch because it takes or
+	 * returns something other than integers or booleans.
+	 */
+	template<auto Fn>
+	__always_inline bool call_batched(const int32_t *args, int32_t &result)
+	{
+		using TupleType = typename FunctionSignature<
+		  std::remove_pointer_t<decltype(Fn)>>::ArgumentType;
+		using ReturnType = decltype(std::apply(Fn, std::declval<TupleType>()));
+		if constexpr (std::tuple_size_v<TupleType> > 3)
+		{
+			return false;
+		}
+		else if constexpr (std::is_void_v<ReturnType>)
+		{
+			std::apply(Fn, batch_arguments<TupleType>(args));
+			result = 0;
+			return true;
+		}
+		else if constexpr (std::is_same_v<ReturnType, int32_t> ||
+		                   std::is_same_v<ReturnType, bool>)
+		{
+			result = std::apply(Fn, batch_arguments<TupleType>(args));
+			return true;
+		}
+		return false;
+	}
+
+	/**
+	 * Run the calls encoded in `bytes` (see `BatchRecordSize`), in order, and
+	 * write each one's result into `results`.  Only functions defined with
+	 * `ExportedFn` can be batched.
+	 */
+	mvm_TeError
+	run_batch(const uint8_t *bytes, size_t calls, int32_t *results)
+	{
+		for (size_t i = 0; i < calls; i++)
+		{
+			const uint8_t *record = bytes + i * BatchRecordSize;
+			int32_t        args[3];
+			memcpy(args, record + 1, sizeof(args));
+			bool called = magic_enum::enum_switch(
+			  [&](auto val) {
+				  constexpr Exports Export = val;
+				  if constexpr (std::is_null_pointer_v<std::remove_cv_t<
+				                  decltype(ExportedFn<Export>)>>)
+				  {
+					  return false;
+				  }
+				  else
+				  {
+					  return call_batched<ExportedFn<Export>>(args,
+					                                          results[i]);
+				  }
+			  },
+			  Exports(record[0]),
+			  false);
+			if (!called)
+			{
+				return MVM_E_UNEXPECTED;
+			}
+		}
+		return MVM_E_SUCCESS;
+	}
+
 	/**
 	 * Base template for exported functions.  Forwards to the function defined
 	 * with `ExportedFn<E>`.
@@ -394,6 +489,44 @@ namespace
 		return MVM_E_SUCCESS;
 	}
 
+	/**
+	 * Run a batch of calls passed from JavaScript as a `Uint8Array` and
+	 * return their results as a `Uint8Array` of 32-bit little-endian
+	 * integers.  This costs one transition from JavaScript to C++ for the
+	 * whole batch, rather than one per call.  The batch is copied before it
+	 * is run, because the calls may allocate and move the array.
+	 */
+	template<>
+	mvm_TeError exported_function<RunBatch>(mvm_VM            *vm,
+	                                        mvm_HostFunctionID funcID,
+	                                        mvm_Value         *result,
+	                                        mvm_Value         *args,
+	                                        uint8_t            argCount)
+	{
+		uint8_t *bytes;
+		size_t   size;
+		if ((argCount < 1) ||
+		    (mvm_uint8ArrayToBytes(vm, args[0], &bytes, &size) !=
+		     MVM_E_SUCCESS) ||
+		    (size % BatchRecordSize != 0) ||
+		    (size > MaxBatchCalls * BatchRecordSize))
+		{
+			return MVM_E_UNEXPECTED;
+		}
+		uint8_t batch[MaxBatchCalls * BatchRecordSize];
+		int32_t results[MaxBatchCalls];
+		size_t  calls = size / BatchRecordSize;
+		memcpy(batch, bytes, size);
+		if (mvm_TeError err = run_batch(batch, calls, results);
+		    err != MVM_E_SUCCESS)
+		{
+			return err;
+		}
+		*result = mvm_uint8ArrayFromBytes(
+		  vm, reinterpret_cast<uint8_t *>(results), calls * sizeof(int32_t));
+		return MVM_E_SUCCESS;
+	}
+
 	/**
 	 * Callback from microvium that resolves imports.
 	 *
@@ -6,6 +6,7 @@ import optparse, re, bisect, sys, subprocess
 
 nm_re=re.compile('([0-9a-f]+) . (.+)')
 trace_re=re.compile('(?P<pc>[0-9a-fA-F]{8})')
+sched_re=re.compile('sched-trace (?P<cycles>\\w+) (?P<event>\\w+) (?P<thread>\\w+) (?P<detail>\\w+) (?P<argument>\\w+)')
 
 def usage(msg):
     sys.stderr.write(msg + "\n")
@@ -68,13 +69,70 @@ def annotate_trace(options):
         else:
             print(line[:-1])
 
+def symbolise(names, addr):
+    if not names:
+        return f"0x{addr:08x}"
+    addresses = [a for (a, _) in names]
+    i = bisect.bisect_right(addresses, addr) - 1
+    if i < 0:
+        return f"0x{addr:08x}"
+    (base, sym) = names[i]
+    return f"0x{addr:08x} ({sym}+0x{addr - base:x})"
+
+def thread_name(thread):
+    return "idle" if thread == 0 else f"thread {thread}"
+
+def describe_sched_event(names, event, thread, detail, argument):
+    if event == 1:
+        return f"switch to {thread_name(thread)} from {thread_name(argument)}"
+    if event == 2:
+        pi = " (priority inheriting)" if detail else ""
+        return f"{thread_name(thread)} waits on futex {symbolise(names, argument)}{pi}"
+    if event == 3:
+        return f"{thread_name(thread)} woken from futex {symbolise(names, argument)}"
+    if event == 4:
+        return f"interrupt entry (mcause 0x{argument:08x}) in {thread_name(thread)}"
+    if event == 5:
+        return f"interrupt exit (mcause 0x{argument:08x}) to {thread_name(thread)}"
+    if event == 6:
+        return f"{thread_name(thread)} priority {argument} -> {detail}"
+    return f"unknown event {event} for {thread_name(thread)} ({detail}, 0x{argument:08x})"
+
+def annotate_sched_trace(options):
+    """
+    Render the scheduler event log printed by scheduler_trace_dump().  Symbol
+    names are optional and are used to name futex addresses.
+    """
+    names = get_names(options) if (options.exe_file or options.nm_file) else None
+    if options.trace_file is None:
+        trace_file=sys.stdin
+    else:
+        trace_file=open(options.trace_file, 'r')
+    first_cycles = None
+    prev_cycles = None
+    for line in trace_file:
+        m = sched_re.search(line)
+        if not m:
+            continue
+        (cycles, event, thread, detail, argument) = (int(m.group(g), 0) for g in ('cycles', 'event', 'thread', 'detail', 'argument'))
+        if first_cycles is None:
+            first_cycles = prev_cycles = cycles
+        print(f"{cycles - first_cycles:12d} (+{cycles - prev_cycles:8d}) | {describe_sched_event(names, event, thread, detail, argument)}")
+        prev_cycles = cycles
+
 if __name__=="__main__":
     parser = optparse.OptionParser("""%prog --exe <EXE> --trace <TRACE>
     Simple script to annotate an instruction trace with function names.
-    Assumes the first 8 digit hex number in each input line is the program counter.""")
+    Assumes the first 8 digit hex number in each input line is the program counter.
+    With --scheduler, instead renders the scheduler event log printed by
+    scheduler_trace_dump(), using symbol names (if provided) for futexes.""")
     parser.add_option('-e','--exe', dest="exe_file", help="Elf file containing symbol names")
     parser.add_option('-N','--nm', dest="nm_file", help="File containing output of nm (alternative to elf file)")
     parser.add_option('-t','--trace', dest="trace_file", help="Trace file to annotate (default stdin)", default=None)
     parser.add_option('-w','--width', help="Width to pad input lines to before annotating", type=int, default=70)
+    parser.add_option('-s','--scheduler', dest="scheduler", action="store_true", help="Render a scheduler event log rather than an instruction trace", default=False)
     (opts, args) = parser.parse_args()
-    annotate_trace(opts)
+    if opts.scheduler:
+        annotate_sched_trace(opts)
+    else:
+        annotate_trace(opts)
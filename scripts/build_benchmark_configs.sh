@@ -4,6 +4,14 @@
 # board description files to enable and disable different combinations of
 # hardware features.  Also patches include paths to keep track of the original
 # locations.
+#
+# Benchmarks that are tracked for regressions (for example,
+# interrupt-latency-load and compartment-call-phases) should be built for each
+# of the sail, ibex-safe-simulator and sonata boards:
+#
+#   for B in sail ibex-safe-simulator sonata ; do
+#       build_benchmark_configs.sh sdk/boards/$B.json benchmarks/<name> <sdk>
+#   done
 
 set -e
 
@@ -99,7 +107,11 @@ for I in ${CONFIGS}; do
 	cd ..
 done
 
-# Let the user know where we put them all.
+# Let the user know where we put them all.  Benchmarks print tables (in the
+# format of sdk/include/perf.hh) that include the board in each row, and
+# benchmarks that depend on the configuration (for example,
+# compartment-call-phases) include that too, so the output of every
+# configuration can be concatenated.
 for I in ${CONFIGS}; do
 	echo Benchmark built in ${DIR}/$I
 done
@@ -0,0 +1,84 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, re, sys, collections
+from cheriot_elf import FirmwareImage
+from stack_sizes import find_components, export_names, owner, import_entry_size
+
+count_re=re.compile('call-count (?P<offset>0x[0-9a-fA-F]+|\\d+) (?P<count>0x[0-9a-fA-F]+|\\d+)')
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def read_counts(log):
+    """
+    Returns a dictionary mapping offsets into the compartment export tables to
+    call counts, from the output of `switcher_call_counters_dump`.  If the
+    counters are dumped more than once, the last value for each entry wins.
+    """
+    counts={}
+    for line in log:
+        m=count_re.search(line)
+        if m:
+            counts[int(m.group('offset'), 0)]=int(m.group('count'), 0)
+    return counts
+
+def callers(image, components):
+    """
+    Returns a dictionary mapping each compartment export entry address to the
+    names of the compartments that import it directly.
+    """
+    result=collections.defaultdict(set)
+    for component in components:
+        (start, end) = component.imports
+        for entry in range(start + import_entry_size, end - import_entry_size + 1, import_entry_size):
+            address=image.read_u32(entry)
+            if image.read_u32(entry + 4) != 0 or (address & 1):
+                continue
+            target=owner(components, address)
+            if target is not None and not target.is_library:
+                result[address].add(component.name)
+    return result
+
+def call_counters(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware ELF file")
+    image=FirmwareImage(args[0])
+    if '__compartment_export_tables' not in image.symbols:
+        usage(f"{args[0]} does not define __compartment_export_tables")
+    base=image.symbols['__compartment_export_tables']
+    log=open(options.log_file, 'r') if options.log_file else sys.stdin
+    counts=read_counts(log)
+    components=find_components(image)
+    names=export_names(image)
+    if options.dot:
+        print("digraph calls {")
+        for (address, importers) in sorted(callers(image, components).items()):
+            count=counts.get(address - base, 0)
+            target=owner(components, address)
+            label=names.get(address, hex(address))
+            for importer in sorted(importers):
+                print(f'\t"{importer}" -> "{target.name}" [label="{label}\\n{count}", penwidth={1 + count.bit_length()}];')
+        print("}")
+        return
+    for (offset, count) in sorted(counts.items(), key=lambda c: -c[1]):
+        address=base + offset
+        component=owner(components, address)
+        where=component.name if component else "?"
+        print(f"{count:10d}  {where}: {names.get(address, hex(address))}")
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--dot] [--log <file>] <ELF>
+    Map the call counts printed by switcher_call_counters_dump (in firmware
+    built with --switcher-call-counters=y) to the export entries of the given
+    firmware image.  By default, prints the exports in decreasing order of
+    call count.  With --dot, prints the compartment import graph in graphviz
+    format, with each edge labelled and weighted by the number of calls to
+    the export.  Counts are per export rather than per caller, so an export
+    imported by several compartments has the same count on each edge.""")
+    parser.add_option('-d','--dot', dest="dot", action="store_true", help="Print a weighted import graph", default=False)
+    parser.add_option('-l','--log', dest="log_file", help="Console output containing the counters (default: stdin)", metavar="FILE")
+    (opts, args) = parser.parse_args()
+    call_counters(opts, args)
@@ -0,0 +1,75 @@
+# Copyright Microsoft and CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+"""
+Minimal reader for the 32-bit little-endian ELF files produced by the
+firmware link step, shared by the firmware post-processing scripts.
+"""
+
+import struct
+
+class FirmwareImage:
+    """
+    The loadable contents, sections, and symbols of a firmware ELF file.
+
+    `segments` is a list of (address, bytes) pairs for each loadable segment.
+    `sections` maps section names to (address, size) pairs.  `symbols` maps
+    symbol names (including the linker script's local symbols) to values.
+    `symbol_list` holds every (name, value) pair, including local symbols of
+    the same name from different compartments, in symbol table order.
+    """
+    def __init__(self, path):
+        with open(path, 'rb') as f:
+            data = f.read()
+        if data[0:4] != b'\x7fELF' or data[4] != 1 or data[5] != 1:
+            raise ValueError(f"{path} is not a 32-bit little-endian ELF file")
+        (phoff, shoff) = struct.unpack_from('<II', data, 28)
+        (phentsize, phnum, shentsize, shnum, shstrndx) = struct.unpack_from('<HHHHH', data, 42)
+        self.segments=[]
+        for i in range(phnum):
+            (p_type, offset, vaddr, paddr, filesz) = struct.unpack_from('<IIIII', data, phoff + i * phentsize)
+            # PT_LOAD
+            if p_type == 1 and filesz != 0:
+                self.segments.append((paddr, data[offset:offset + filesz]))
+        headers=[struct.unpack_from('<IIIIIIIIII', data, shoff + i * shentsize) for i in range(shnum)]
+        def string_table(index):
+            header=headers[index]
+            return data[header[4]:header[4] + header[5]]
+        def string(table, offset):
+            return table[offset:table.index(b'\0', offset)].decode()
+        names=string_table(shstrndx)
+        self.sections={}
+        self.symbols={}
+        self.symbol_list=[]
+        for (name, sh_type, flags, addr, offset, size, link, info, align, entsize) in headers:
+            self.sections[string(names, name)] = (addr, size)
+            # SHT_SYMTAB
+            if sh_type != 2:
+                continue
+            strings=string_table(link)
+            for sym in range(offset, offset + size, entsize):
+                (st_name, st_value) = struct.unpack_from('<II', data, sym)
+                self.symbols[string(strings, st_name)] = st_value
+                self.symbol_list.append((string(strings, st_name), st_value))
+
+    def read(self, address, size):
+        """
+        Returns `size` bytes of the loaded image at `address`.  Bytes that are
+        not in any loadable segment read as zero.
+        """
+        out=bytearray(size)
+        for (start, payload) in self.segments:
+            low=max(start, address)
+            high=min(start + len(payload), address + size)
+            if low < high:
+                out[low - address:high - address] = payload[low - start:high - start]
+        return bytes(out)
+
+    def read_u8(self, address):
+        return self.read(address, 1)[0]
+
+    def read_u16(self, address):
+        return struct.unpack('<H', self.read(address, 2))[0]
+
+    def read_u32(self, address):
+        return struct.unpack('<I', self.read(address, 4))[0]
@@ -0,0 +1,113 @@
+#!/usr/bin/env python3
+# Copyright CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, json, sys
+from cheriot_elf import FirmwareImage
+from stack_sizes import find_components, export_table_header_size
+from call_counters import read_counts
+
+columns=('code', 'data', 'bss', 'exports', 'imports', 'sealed_objects')
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def component_sizes(image, component):
+    """
+    Returns a dictionary of the sizes in bytes of each part of `component`,
+    from the symbols and sections that the firmware linker script defines for
+    it.  Parts that the linker script does not describe for this component
+    (for example, the globals of a library) are zero.
+    """
+    symbols=image.symbols
+    name=component.name
+    def span(start, end):
+        if start in symbols and end in symbols:
+            return symbols[end] - symbols[start]
+        return 0
+    def section(suffix):
+        return image.sections.get('.' + name + suffix, (0, 0))[1]
+    (import_start, import_end)=component.imports
+    imports=import_end - import_start
+    globals_size=section('_globals')
+    data=span('.' + name + '_globals', '.' + name + '_bss_start')
+    return {
+        'code': max(section('_code') - imports, 0),
+        'data': data,
+        'bss': max(globals_size - data, 0),
+        'exports': component.exports[1] - component.exports[0],
+        'imports': imports,
+        'sealed_objects': span('.' + name + '_sealed_objects_start', '.' + name + '_sealed_objects_end'),
+    }
+
+def call_counts(image, components, log):
+    """
+    Returns a dictionary mapping component names to the total number of calls
+    to their exports in the switcher call counter dump in `log`.
+    """
+    base=image.symbols['__compartment_export_tables']
+    totals={}
+    for (offset, count) in read_counts(log).items():
+        address=base + offset
+        for c in components:
+            if c.exports[0] + export_table_header_size <= address < c.exports[1]:
+                totals[c.name]=totals.get(c.name, 0) + count
+    return totals
+
+def code_size_report(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware ELF file")
+    image=FirmwareImage(args[0])
+    components=find_components(image)
+    report={ c.name: component_sizes(image, c) for c in components }
+    if options.calls_file:
+        with open(options.calls_file, 'r') as log:
+            for (name, calls) in call_counts(image, components, log).items():
+                report[name]['calls']=calls
+    baseline={}
+    if options.baseline_file:
+        with open(options.baseline_file, 'r') as f:
+            baseline=json.load(f)
+    if options.json_file:
+        with open(options.json_file, 'w') as out:
+            json.dump(report, out, indent=2, sort_keys=True)
+    print(f"{'component':24s}" + ''.join(f"{c:>16s}" for c in columns) +
+          ("  code/call" if options.calls_file else ""))
+    grown=False
+    names=sorted(set(report) | set(baseline))
+    totals={ c: 0 for c in columns }
+    for name in names:
+        sizes=report.get(name, {})
+        old=baseline.get(name, {})
+        line=f"{name:24s}"
+        for c in columns:
+            size=sizes.get(c, 0)
+            totals[c] += size
+            delta=size - old.get(c, 0) if options.baseline_file else 0
+            grown=grown or delta > 0
+            line += f"{size:>9d}" + (f" ({delta:+d})" if delta else "").rjust(7)
+        if sizes.get('calls'):
+            line += f"  {sizes['code'] / sizes['calls']:9.2f}"
+        print(line)
+    print(f"{'total':24s}" + ''.join(f"{totals[c]:>9d}       " for c in columns))
+    if options.check and grown:
+        sys.stderr.write("Some components are larger than in the baseline\n")
+        sys.exit(1)
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--json <file>] [--baseline <file>] [--calls <file>] [--check] <ELF>
+    Print the size in bytes of the code, initialised and zeroed globals,
+    export table, import table and static sealed objects of each compartment
+    and library in a firmware image.  With --json, also write the sizes to
+    a file that can later be used as a --baseline, in which case each size
+    is printed with its change from the baseline.  With --calls, read the
+    console output of switcher_call_counters_dump (in firmware built with
+    --switcher-call-counters=y) and print the bytes of code per call to each
+    component's exports.""")
+    parser.add_option('-j','--json', dest="json_file", help="Write the sizes to this file", metavar="FILE")
+    parser.add_option('-b','--baseline', dest="baseline_file", help="Compare with the sizes in this file", metavar="FILE")
+    parser.add_option('-l','--calls', dest="calls_file", help="Console output containing the switcher call counters", metavar="FILE")
+    parser.add_option('-c','--check', dest="check", action="store_true", help="Exit with an error if any size is larger than in the baseline", default=False)
+    (opts, args) = parser.parse_args()
+    code_size_report(opts, args)
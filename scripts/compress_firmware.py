@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, struct, sys
+from cheriot_elf import FirmwareImage
+
+# Must match CompressedImageHeader::Magic in sdk/core/loader/boot.cc
+magic=0x347a6c63
+# LZ4 block format limits: the last five bytes are always literals and the
+# last match must start at least twelve bytes before the end.
+last_literals=5
+match_limit=12
+min_match=4
+max_offset=0xffff
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def write_length(out, length):
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+def write_sequence(out, literals, offset=0, match_length=0):
+    literal_length=len(literals)
+    token=min(literal_length, 15) << 4
+    if offset:
+        token |= min(match_length - min_match, 15)
+    out.append(token)
+    if literal_length >= 15:
+        write_length(out, literal_length - 15)
+    out += literals
+    if offset:
+        out += struct.pack('<H', offset)
+        if match_length - min_match >= 15:
+            write_length(out, match_length - min_match - 15)
+
+def lz4_compress(data):
+    """
+    Compress `data` as a single LZ4 block, using a greedy match finder that
+    remembers the most recent position of each four-byte sequence.
+    """
+    out=bytearray()
+    table={}
+    anchor=0
+    i=0
+    end=len(data)
+    while i < end - match_limit:
+        key=data[i:i + min_match]
+        candidate=table.get(key)
+        table[key]=i
+        if candidate is None or i - candidate > max_offset:
+            i += 1
+            continue
+        length=min_match
+        limit=end - last_literals - i
+        while length < limit and data[candidate + length] == data[i + length]:
+            length += 1
+        write_sequence(out, data[anchor:i], i - candidate, length)
+        i += length
+        anchor=i
+    write_sequence(out, data[anchor:])
+    return bytes(out)
+
+def ihex_record(out, record_type, address, payload):
+    record=bytes([len(payload), (address >> 8) & 0xff, address & 0xff, record_type]) + payload
+    checksum=(-sum(record)) & 0xff
+    out.write(':' + record.hex().upper() + f"{checksum:02X}\n")
+
+def write_ihex(out, chunks, entry):
+    upper=None
+    for (address, payload) in chunks:
+        for i in range(0, len(payload), 16):
+            line_address=address + i
+            if (line_address >> 16) != upper:
+                upper=line_address >> 16
+                ihex_record(out, 4, 0, struct.pack('>H', upper))
+            ihex_record(out, 0, line_address & 0xffff, payload[i:i + 16])
+    # Start linear address
+    ihex_record(out, 5, 0, struct.pack('>I', entry))
+    ihex_record(out, 1, 0, b'')
+
+def compress_firmware(options, args):
+    if len(args) != 2:
+        usage("Expected an input ELF file and an output hex file")
+    image=FirmwareImage(args[0])
+    (segments, symbols) = (image.segments, image.symbols)
+    for symbol in ('__compressible_start', '__compressible_end', '__compressed_image', '__export_mem_heap_end', '_start'):
+        if symbol not in symbols:
+            usage(f"{args[0]} does not define {symbol}")
+    start=symbols['__compressible_start']
+    end=symbols['__compressible_end']
+    # Flatten the compressible range, leaving anything not loaded as zero.
+    region=bytearray(end - start)
+    chunks=[]
+    for (address, payload) in segments:
+        segment_end=address + len(payload)
+        if address < start:
+            chunks.append((address, payload[:max(0, min(segment_end, start) - address)]))
+        if segment_end > end:
+            skip=max(0, end - address)
+            chunks.append((address + skip, payload[skip:]))
+        overlap_start=max(address, start)
+        overlap_end=min(segment_end, end)
+        if overlap_start < overlap_end:
+            region[overlap_start - start:overlap_end - start] = payload[overlap_start - address:overlap_end - address]
+    compressed=lz4_compress(bytes(region))
+    blob=struct.pack('<III', magic, len(compressed), len(region)) + compressed
+    blob_address=symbols['__compressed_image']
+    if blob_address + len(blob) > symbols['__export_mem_heap_end']:
+        usage(f"Compressed data ({len(blob)} bytes at 0x{blob_address:x}) does not fit in memory")
+    chunks.append((blob_address, blob))
+    chunks=[c for c in chunks if len(c[1]) != 0]
+    with open(args[1], 'w') as out:
+        write_ihex(out, sorted(chunks, key=lambda c: c[0]), symbols['_start'])
+    if options.verbose:
+        loaded=sum(len(c[1]) for c in chunks)
+        print(f"Compressed {len(region)} bytes to {len(compressed)}, {loaded} bytes loaded in total")
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [-v] <ELF> <HEX>
+    Write an Intel HEX image of a firmware ELF file in which the compartments'
+    export tables, code, and globals are stored LZ4-compressed after the end
+    of the image.  The loader decompresses them at boot.  The firmware must be
+    built with --compressed-image=y.""")
+    parser.add_option('-v','--verbose', dest="verbose", action="store_true", help="Report the compression ratio", default=False)
+    (opts, args) = parser.parse_args()
+    compress_firmware(opts, args)
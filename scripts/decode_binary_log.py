@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, struct, sys
+from cheriot_elf import FirmwareImage
+
+# Must match BinaryRecordMarker and BinaryCallbackKind in
+# sdk/lib/debug/debug.cc.
+record_marker=0x1e
+callback_kind=0x7f
+
+# Must match DebugFormatArgumentKind in sdk/include/__debug.h.
+(kind_bool, kind_character, kind_signed32, kind_unsigned32, kind_signed64,
+ kind_unsigned64, kind_pointer, kind_permissions, kind_cstring,
+ kind_string_view) = range(10)
+
+# Permission bits, in the order that the device prints them.  Must match
+# CheriPermission* in sdk/include/cheri.h.
+permission_groups=[
+    [(0, 'G')],
+    [(5, 'R'), (2, 'W'), (6, 'c'), (1, 'g'), (3, 'm'), (4, 'l')],
+    [(8, 'X'), (7, 'a')],
+    [(10, 'S'), (9, 'U'), (11, '0')]]
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+class Truncated(Exception):
+    """
+    Raised when the log ends in the middle of a record.
+    """
+    pass
+
+class Reader:
+    """
+    Cursor over the bytes of the log.
+    """
+    def __init__(self, data):
+        self.data=data
+        self.offset=0
+
+    def bytes(self, count):
+        if self.offset + count > len(self.data):
+            raise Truncated()
+        value=self.data[self.offset:self.offset + count]
+        self.offset += count
+        return value
+
+    def u8(self):
+        return self.bytes(1)[0]
+
+    def u32(self):
+        return struct.unpack('<I', self.bytes(4))[0]
+
+    def u64(self):
+        return struct.unpack('<Q', self.bytes(8))[0]
+
+    def string(self):
+        end=self.data.find(b'\0', self.offset)
+        if end < 0:
+            raise Truncated()
+        value=self.data[self.offset:end].decode(errors='replace')
+        self.offset=end + 1
+        return value
+
+def image_string(image, address):
+    """
+    Returns the null-terminated string at `address` in the firmware image.
+    """
+    out=bytearray()
+    while len(out) < 4096:
+        c=image.read_u8(address + len(out))
+        if c == 0:
+            return out.decode(errors='replace')
+        out.append(c)
+    return f"<no string at 0x{address:x}>"
+
+def permissions(raw):
+    return ' '.join(''.join(c if raw & (1 << bit) else '-' for (bit, c) in group) for group in permission_groups)
+
+def signed(value, bits):
+    return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+def read_argument(reader):
+    """
+    Reads one argument and returns it formatted as the device would have
+    formatted it.
+    """
+    kind=reader.u8()
+    if kind == kind_bool:
+        return 'true' if reader.u8() else 'false'
+    if kind == kind_character:
+        return chr(reader.u8())
+    if kind == kind_signed32:
+        return str(signed(reader.u32(), 32))
+    if kind == kind_unsigned32:
+        return f"0x{reader.u32():x}"
+    if kind == kind_signed64:
+        return str(signed(reader.u64(), 64))
+    if kind == kind_unsigned64:
+        return f"0x{reader.u64():x}"
+    if kind == kind_permissions:
+        return permissions(reader.u32())
+    if kind == kind_pointer:
+        (address, base, length, flags)=(reader.u32(), reader.u32(), reader.u32(), reader.u32())
+        valid='true' if flags & (1 << 31) else 'false'
+        return f"0x{address:x} (v:{valid} 0x{base:x}-0x{(base + length) & 0xffffffff:x} l:0x{length:x} o:0x{(flags >> 16) & 0x7fff:x} p: {permissions(flags & 0xffff)})"
+    if kind in (kind_cstring, kind_string_view, callback_kind):
+        return reader.string()
+    return "<invalid argument kind>"
+
+def format_message(fmt, arguments):
+    if not arguments:
+        return fmt
+    out=[]
+    i=0
+    index=0
+    while i < len(fmt):
+        if fmt.startswith('{}', i):
+            out.append(arguments[index] if index < len(arguments) else "<missing argument>")
+            index += 1
+            i += 2
+            continue
+        out.append(fmt[i])
+        i += 1
+    return ''.join(out)
+
+def decode(image, data, out, colour):
+    (magenta, reset)=("\x1b[35m", "\x1b[0m") if colour else ("", "")
+    reader=Reader(data)
+    while reader.offset < len(data):
+        start=data.find(bytes([record_marker]), reader.offset)
+        if start < 0:
+            start=len(data)
+        # Anything between records (boot messages, failure reports) is
+        # already text.
+        out.write(data[reader.offset:start].decode(errors='replace'))
+        if start == len(data):
+            break
+        reader.offset=start + 1
+        try:
+            context=image_string(image, reader.u32())
+            fmt=image_string(image, reader.u32())
+            arguments=[read_argument(reader) for i in range(reader.u8())]
+        except Truncated:
+            out.write("<truncated record>\n")
+            break
+        out.write(f"{magenta}{context}{reset}: {format_message(fmt, arguments)}\n")
+
+def decode_binary_log(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware ELF file")
+    image=FirmwareImage(args[0])
+    log=open(options.log_file, 'rb') if options.log_file else sys.stdin.buffer
+    decode(image, log.read(), sys.stdout, not options.no_colour)
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--log <file>] [--no-colour] <ELF>
+    Format the output of firmware built with --debug-log-binary=y.  Each
+    binary record identifies its context and format strings by address, so
+    the ELF file must be the one that produced the log.  Text between records,
+    such as assertion failure reports, is copied through unchanged.""")
+    parser.add_option('-l','--log', dest="log_file", help="Console output to decode (default: stdin)", metavar="FILE")
+    parser.add_option('-n','--no-colour', dest="no_colour", action="store_true", help="Do not colour the context of each message", default=False)
+    (opts, args) = parser.parse_args()
+    decode_binary_log(opts, args)
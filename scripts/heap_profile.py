@@ -0,0 +1,91 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, re, bisect, sys, subprocess, collections
+
+nm_re=re.compile('([0-9a-f]+) [tTwW] (.+)')
+entry_re=re.compile('site (?P<site>0x[0-9a-fA-F]+|\\d+) owner (?P<owner>-?\\d+) size (?P<size>\\d+) claimed (?P<claimed>true|false)')
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def get_names(options):
+    if options.exe_file:
+        p = subprocess.Popen(['nm','--demangle', options.exe_file],stdout=subprocess.PIPE,text=True)
+        nm_file = p.stdout
+    elif options.nm_file:
+        nm_file = open(options.nm_file, 'r')
+    else:
+        return None
+    names=[]
+    for line in nm_file:
+        m=nm_re.match(line)
+        if m and not m.group(2).startswith('.'):
+            names.append((int(m.group(1), 16), m.group(2)))
+    names.sort(key=lambda x: x[0])
+    return names
+
+def site_name(names, site):
+    """
+    Site identifiers are the low 16 bits of a return address.  Report every
+    function that contains an address with those low bits.
+    """
+    if site == 0:
+        return "unknown"
+    if not names:
+        return f"0x{site:04x}"
+    (addresses, syms) = list(zip(*names))
+    candidates=[]
+    base = addresses[0] & ~0xffff
+    while base <= addresses[-1]:
+        addr = base | site
+        i = bisect.bisect_right(addresses, addr) - 1
+        if i >= 0 and addresses[i] <= addr and syms[i] not in candidates:
+            candidates.append(syms[i])
+        base += 0x10000
+    if not candidates:
+        return f"0x{site:04x}"
+    return f"0x{site:04x} ({' / '.join(candidates)})"
+
+def print_table(title, rows):
+    print(title)
+    print(f"{'bytes':>10s} {'count':>7s} {'claimed':>7s}  key")
+    for (key, (size, count, claimed)) in sorted(rows.items(), key=lambda x: -x[1][0]):
+        print(f"{size:10d} {count:7d} {claimed:7d}  {key}")
+    print()
+
+def heap_profile(options):
+    names = get_names(options)
+    if options.dump_file is None:
+        dump_file=sys.stdin
+    else:
+        dump_file=open(options.dump_file, 'r')
+    by_site=collections.defaultdict(lambda: [0, 0, 0])
+    by_owner=collections.defaultdict(lambda: [0, 0, 0])
+    for line in dump_file:
+        m = entry_re.search(line)
+        if not m:
+            continue
+        site=int(m.group('site'), 0)
+        owner=int(m.group('owner'))
+        size=int(m.group('size'))
+        claimed=1 if m.group('claimed') == 'true' else 0
+        for (table, key) in ((by_site, site), (by_owner, owner)):
+            table[key][0] += size
+            table[key][1] += 1
+            table[key][2] += claimed
+    print_table("Live heap by allocation site:", {site_name(names, k): v for (k, v) in by_site.items()})
+    print_table("Live heap by quota owner:", {f"owner {k}" if k != 0 else "no owner (claims only)": v for (k, v) in by_owner.items()})
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--exe <EXE>] [--dump <DUMP>]
+    Summarise the output of heap_profile_dump, grouping live allocations by
+    allocation site and by quota owner.  If an ELF file or nm output is
+    provided, site identifiers are resolved to candidate function names.""")
+    parser.add_option('-e','--exe', dest="exe_file", help="Elf file containing symbol names")
+    parser.add_option('-N','--nm', dest="nm_file", help="File containing output of nm (alternative to elf file)")
+    parser.add_option('-d','--dump', dest="dump_file", help="Console output containing a heap profile dump (default stdin)", default=None)
+    (opts, args) = parser.parse_args()
+    heap_profile(opts)
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+# Copyright CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, json, re, sys
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def load_board(path):
+    """
+    Load a board description.  These use hexadecimal integer literals, which
+    are not valid JSON, so convert them to decimal first.
+    """
+    text=open(path, 'r').read()
+    text=re.sub(r'\b0x([0-9a-fA-F]+)\b', lambda m: str(int(m.group(1), 16)), text)
+    return json.loads(text)
+
+def integer_from_hex_string(contents, offset, length):
+    """
+    Decode the little-endian integer of `length` bytes at `offset` in the
+    hexadecimal `contents` of a static sealed object in the report.
+    """
+    data=bytes.fromhex(contents.replace(' ', ''))
+    return int.from_bytes(data[offset:offset + length], 'little')
+
+def is_allocator_capability(entry):
+    sealing_type=entry.get('sealing_type', {})
+    return entry.get('kind') == 'SealedObject' and \
+        sealing_type.get('compartment') == 'alloc' and \
+        sealing_type.get('key') == 'MallocKey'
+
+def heap_quotas(report):
+    """
+    Returns a dictionary mapping each compartment to the sum of the quotas of
+    the allocator capabilities that it holds.  The allocator never lets a
+    quota be exceeded, so this is the most heap that each compartment can
+    have allocated at once.
+    """
+    quotas={}
+    for (name, compartment) in report.get('compartments', {}).items():
+        total=sum(integer_from_hex_string(entry['contents'], 0, 4)
+                  for entry in compartment.get('imports', [])
+                  if is_allocator_capability(entry))
+        if total != 0:
+            quotas[name]=total
+    return quotas
+
+def call_graph(report):
+    """
+    Returns a dictionary mapping each compartment to the set of compartments
+    that it may call, including through the libraries that it calls.
+    """
+    compartments=report.get('compartments', {})
+    def direct(name, kind):
+        return { entry.get('compartment_name') or entry.get('library_name')
+                 for entry in compartments.get(name, {}).get('imports', [])
+                 if entry.get('kind') == kind }
+    graph={}
+    for name in compartments:
+        targets=set()
+        visited=set()
+        pending=[name]
+        while pending:
+            current=pending.pop()
+            if current in visited:
+                continue
+            visited.add(current)
+            targets |= direct(current, 'CompartmentExport')
+            pending += direct(current, 'LibraryFunction')
+        targets.discard(None)
+        targets.discard(name)
+        graph[name]=targets
+    return graph
+
+def call_depth(graph, name, path=()):
+    """
+    Returns the maximum number of nested compartment calls starting with a
+    call to `name`, or None if the import graph reachable from `name`
+    contains a cycle.
+    """
+    if name in path:
+        return None
+    depth=1
+    for target in graph.get(name, ()):
+        inner=call_depth(graph, target, path + (name,))
+        if inner is None:
+            return None
+        depth=max(depth, 1 + inner)
+    return depth
+
+def memory_budget(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware report JSON file")
+    report=json.load(open(args[0], 'r'))
+    quotas=heap_quotas(report)
+    graph=call_graph(report)
+    threads=[]
+    for thread in report.get('threads', []):
+        compartment=thread.get('compartment_name')
+        threads.append({
+            'compartment': compartment,
+            'entry_point': thread.get('entry_point'),
+            'stack_size': thread.get('stack_size', 0),
+            'trusted_stack_size': thread.get('trusted_stack_size', 0),
+            'call_depth': call_depth(graph, compartment),
+        })
+    budget={
+        'heap_quotas': quotas,
+        'heap_quota_total': sum(quotas.values()),
+        'stack_total': sum(t['stack_size'] for t in threads),
+        'trusted_stack_total': sum(t['trusted_stack_size'] for t in threads),
+        'threads': threads,
+    }
+    if options.board_file:
+        board=load_board(options.board_file)
+        heap=board.get('heap', {})
+        start=heap.get('start')
+        if start is None and options.heap_start:
+            start=int(options.heap_start, 0)
+        if start is not None and 'end' in heap:
+            budget['heap_size']=heap['end'] - start
+            budget['heap_headroom']=budget['heap_size'] - budget['heap_quota_total']
+    json.dump(budget, sys.stdout, indent=2, sort_keys=True)
+    print()
+    if options.check and budget.get('heap_headroom', 0) < 0:
+        sys.stderr.write("The allocator quotas add up to more than the heap\n")
+        sys.exit(1)
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--board <json>] [--heap-start <address>] [--check] <report>
+    Estimate the worst-case memory use of a firmware image from the firmware
+    report written by the final link (<firmware>.json), and print it as JSON.
+    The heap estimate is the sum of the quotas of all allocator capabilities,
+    per compartment and in total.  Stack and trusted stack memory are the sums
+    over all threads.  Each thread's call depth is the longest chain of
+    compartment calls in the import graph from its entry compartment
+    (null if the graph contains a cycle), which is the number of trusted
+    stack frames that it may need.
+
+    With --board, also compare the quota total with the size of the board's
+    heap.  If the board description does not give the start of the heap, it
+    must be passed with --heap-start (the value of __export_mem_heap in the
+    firmware image).  With --check, exit with an error if the quotas exceed
+    the heap.""")
+    parser.add_option('-b','--board', dest="board_file", help="Board description to compare the heap quotas with", metavar="FILE")
+    parser.add_option('-s','--heap-start', dest="heap_start", help="Start address of the heap", metavar="ADDRESS")
+    parser.add_option('-c','--check', dest="check", action="store_true", help="Exit with an error if the heap quotas exceed the heap", default=False)
+    (opts, args) = parser.parse_args()
+    memory_budget(opts, args)
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+# Copyright CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, re, struct, sys
+from cheriot_elf import FirmwareImage
+
+count_re=re.compile('pgo-count (?P<address>0x[0-9a-fA-F]+|\\d+) (?P<count>0x[0-9a-fA-F]+|\\d+)')
+
+# The magic number of a raw profile from a 32-bit target.
+raw_magic_32=(255 << 56) | (ord('l') << 48) | (ord('p') << 40) | (ord('r') << 32) | (ord('o') << 24) | (ord('f') << 16) | (ord('R') << 8) | 129
+# The raw profile version written.  Later versions of llvm-profdata still
+# read it.
+raw_version=8
+# The size of a function description in the firmware image.  The function
+# and value-profiling pointers are capabilities, so the descriptions are
+# larger than those that a 32-bit target writes to a raw profile.
+image_record_size=48
+# The size of a function description in a 32-bit raw profile.
+raw_record_size=40
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def read_counts(log):
+    """
+    Returns a dictionary mapping counter addresses to values, from the output
+    of `pgo_counters_dump`.  If the counters are dumped more than once, the
+    last value for each counter wins.
+    """
+    counts={}
+    for line in log:
+        m=count_re.search(line)
+        if m:
+            counts[int(m.group('address'), 0)]=int(m.group('count'), 0)
+    return counts
+
+def ranges(image, prefix):
+    """
+    Returns the (start, end) address pairs of the regions that each
+    compartment's linker script labels `<prefix>_start` and `<prefix>_end`.
+    The labels are local to each compartment, so there is one pair for each
+    instrumented compartment.  Regions do not overlap, so sorting the starts
+    and the ends pairs them up.
+    """
+    starts=sorted(v for (n, v) in image.symbol_list if n == prefix + '_start')
+    ends=sorted(v for (n, v) in image.symbol_list if n == prefix + '_end')
+    if len(starts) != len(ends):
+        usage(f"Mismatched {prefix} labels in the firmware image")
+    return [(s, e) for (s, e) in zip(starts, ends) if s < e]
+
+def functions(image):
+    """
+    Returns a list of (name hash, function hash, counter address, counter
+    count) tuples for each function description in the firmware image.  The
+    counter pointer in each description is relative to the description.
+    """
+    result=[]
+    for (start, end) in ranges(image, '__pgo_data'):
+        for record in range(start, end - image_record_size + 1, image_record_size):
+            (name, function, counters) = struct.unpack('<QQi', image.read(record, 20))
+            num_counters=image.read_u32(record + 40)
+            result.append((name, function, record + counters, num_counters))
+    return result
+
+def pgo_profraw(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware ELF file")
+    if not options.output:
+        usage("Expected an output file (--output)")
+    image=FirmwareImage(args[0])
+    records=functions(image)
+    if not records:
+        usage(f"{args[0]} was not built with --pgo=generate")
+    log=open(options.log_file, 'r') if options.log_file else sys.stdin
+    counts=read_counts(log)
+    names=b''.join(image.read(s, e - s) for (s, e) in ranges(image, '__pgo_names'))
+    names_padding=(8 - len(names) % 8) % 8
+    data=bytearray()
+    counters=bytearray()
+    for (i, (name, function, address, num_counters)) in enumerate(records):
+        # Raw profiles record counter pointers relative to the function
+        # description and the header's counters delta, which is zero here.
+        # The reader moves the delta back by one description for each
+        # description that it reads.
+        offset=(len(counters) - i * raw_record_size) & 0xffffffff
+        data += struct.pack('<QQIIIIHH4x', name, function, offset, 0, 0, num_counters, 0, 0)
+        for counter in range(num_counters):
+            counters += struct.pack('<Q', counts.get(address + counter * 8, 0))
+    header=struct.pack('<11Q',
+                       raw_magic_32,
+                       raw_version,
+                       0,                         # BinaryIdsSize
+                       len(records),              # DataSize
+                       0,                         # PaddingBytesBeforeCounters
+                       len(counters) // 8,        # CountersSize
+                       0,                         # PaddingBytesAfterCounters
+                       len(names),                # NamesSize
+                       0,                         # CountersDelta
+                       0,                         # NamesDelta
+                       1)                         # ValueKindLast
+    with open(options.output, 'wb') as f:
+        f.write(header + data + counters + names + bytes(names_padding))
+    unmatched=set(counts) - set(a + c * 8 for (_, _, a, n) in records for c in range(n))
+    if unmatched:
+        sys.stderr.write(f"Warning: {len(unmatched)} counters in the log are not in {args[0]}\n")
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog --output <file> [--log <file>] <ELF>
+    Write a raw LLVM profile from the counters printed by pgo_counters_dump
+    (in firmware built with --pgo=generate) and the function descriptions in
+    the given firmware image.  Merge the result with `llvm-profdata merge`
+    and pass the merged profile to --pgo-profile with --pgo=use.  Counters
+    that were not printed are zero.""")
+    parser.add_option('-l','--log', dest="log_file", help="Console output containing the counters (default: stdin)", metavar="FILE")
+    parser.add_option('-o','--output', dest="output", help="Raw profile to write", metavar="FILE")
+    (opts, args) = parser.parse_args()
+    pgo_profraw(opts, args)
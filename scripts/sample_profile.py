@@ -0,0 +1,101 @@
+#!/usr/bin/env python3
+# Copyright CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, re, bisect, sys, subprocess, collections
+from cheriot_elf import FirmwareImage
+from stack_sizes import find_components
+
+nm_re=re.compile('([0-9a-f]+) [tTwW] (.+)')
+sample_re=re.compile('sched-profile (?P<thread>0x[0-9a-fA-F]+|\\d+) (?P<compartment>0x[0-9a-fA-F]+|\\d+) (?P<pc>0x[0-9a-fA-F]+|\\d+)')
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def function_names(options, elf):
+    """
+    Returns a sorted list of (address, name) pairs for the functions in the
+    firmware image, from `nm` or from a saved `nm` output file.
+    """
+    if options.nm_file:
+        nm_file=open(options.nm_file, 'r')
+    else:
+        p=subprocess.Popen([options.nm_tool, '--demangle', elf], stdout=subprocess.PIPE, text=True)
+        nm_file=p.stdout
+    names=[]
+    for line in nm_file:
+        m=nm_re.match(line)
+        if m and not m.group(2).startswith('.'):
+            names.append((int(m.group(1), 16), m.group(2)))
+    names.sort(key=lambda x: x[0])
+    return names
+
+def read_samples(log):
+    """
+    Returns a list of (thread, compartment, pc) tuples from the output of
+    `scheduler_profile_dump`.
+    """
+    samples=[]
+    for line in log:
+        m=sample_re.search(line)
+        if m:
+            samples.append(tuple(int(m.group(g), 0) for g in ('thread', 'compartment', 'pc')))
+    return samples
+
+def sample_profile(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware ELF file")
+    image=FirmwareImage(args[0])
+    compartments={c.exports[0]: c.name for c in find_components(image)}
+    names=function_names(options, args[0])
+    addresses=[a for (a, _) in names]
+    def function(pc):
+        i=bisect.bisect_right(addresses, pc) - 1
+        return names[i][1] if i >= 0 else hex(pc)
+    def compartment(thread, base):
+        if thread == 0:
+            return "idle"
+        return compartments.get(base, hex(base))
+    log=open(options.log_file, 'r') if options.log_file else sys.stdin
+    samples=read_samples(log)
+    if not samples:
+        usage("No sched-profile samples found")
+    stacks=collections.Counter()
+    for (thread, base, pc) in samples:
+        stacks[(thread, compartment(thread, base), function(pc))] += 1
+    if options.folded:
+        for ((thread, where, name), count) in sorted(stacks.items()):
+            print(f"thread {thread};{where};{name} {count}")
+        return
+    total=len(samples)
+    by_compartment=collections.Counter()
+    by_function=collections.Counter()
+    for ((thread, where, name), count) in stacks.items():
+        by_compartment[where] += count
+        by_function[(where, name)] += count
+    print(f"{total} samples")
+    print()
+    print(f"{'samples':>10s} {'%':>6s}  compartment")
+    for (where, count) in by_compartment.most_common():
+        print(f"{count:10d} {100 * count / total:6.2f}  {where}")
+    print()
+    print(f"{'samples':>10s} {'%':>6s}  function")
+    for ((where, name), count) in by_function.most_common(options.top):
+        print(f"{count:10d} {100 * count / total:6.2f}  {where}: {name}")
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--folded] [--log <file>] <ELF>
+    Symbolise the samples printed by scheduler_profile_dump (in firmware built
+    with --scheduler-profile-samples=N) using the given firmware image.  By
+    default, prints the number of samples in each compartment and in the most
+    frequently sampled functions.  With --folded, prints one line per thread,
+    compartment and function in the folded-stack format read by flame graph
+    tools such as flamegraph.pl and speedscope.""")
+    parser.add_option('-f','--folded', dest="folded", action="store_true", help="Print folded stacks for flame graphs", default=False)
+    parser.add_option('-l','--log', dest="log_file", help="Console output containing the samples (default: stdin)", metavar="FILE")
+    parser.add_option('-n','--nm', dest="nm_file", help="Output of nm --demangle for the firmware image (default: run nm)", metavar="FILE")
+    parser.add_option('--nm-tool', dest="nm_tool", help="The nm program to run (default: %default)", default="llvm-nm")
+    parser.add_option('-t','--top', dest="top", type="int", help="Number of functions to print (default: %default)", default=20)
+    (opts, args) = parser.parse_args()
+    sample_profile(opts, args)
@@ -0,0 +1,304 @@
+#!/usr/bin/env python3
+# Copyright Microsoft and CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, sys, re
+from cheriot_elf import FirmwareImage
+
+# Layout constants, which must match sdk/core/loader/types.h and the
+# switcher.
+export_table_header_size=20
+export_entry_sealing_type=0b100000
+import_entry_size=8
+thread_config_size=22
+trusted_stack_frame_size=24
+# Must match STACK_ENTRY_RESERVED_SPACE in sdk/core/switcher/misc-assembly.h
+stack_entry_reserved_space=16
+
+peak_re=re.compile('stack-peak (?P<offset>0x[0-9a-fA-F]+|\\d+) (?P<peak>0x[0-9a-fA-F]+|\\d+)')
+
+privileged=('scheduler', 'allocator', 'token_library', 'software_revoker', 'switcher')
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+class Component:
+    """
+    A compartment or library: its export table range, import table range, and
+    whether calls to it are cross-compartment calls.
+    """
+    def __init__(self, name, exports, imports, is_library):
+        self.name=name
+        self.exports=exports
+        self.imports=imports
+        self.is_library=is_library
+
+def find_components(image):
+    symbols=image.symbols
+    components=[]
+    names=set()
+    for symbol in symbols:
+        m=re.match(r'^\.(.+)_export_table$', symbol)
+        if m:
+            names.add(m.group(1))
+    for name in sorted(names):
+        exports=(symbols['.' + name + '_export_table'], symbols['.' + name + '_export_table_end'])
+        if '.' + name + '_import_start' in symbols:
+            imports=(symbols['.' + name + '_import_start'], symbols['.' + name + '_import_end'])
+        elif '.' + name + '_code_start' in symbols:
+            imports=(symbols['.' + name + '_code_start'], symbols['.' + name + '_imports_end'])
+        else:
+            imports=(0, 0)
+        # Libraries have no globals.
+        is_library=(name in ('token_library', 'switcher')) or \
+            ((name not in privileged) and ('.' + name + '_globals' not in symbols))
+        components.append(Component(name, exports, imports, is_library))
+    return components
+
+def owner(components, address):
+    for c in components:
+        if c.exports[0] + export_table_header_size <= address < c.exports[1]:
+            return c
+    return None
+
+def export_names(image):
+    names={}
+    for (name, value) in image.symbols.items():
+        if name.startswith('__export_') or name.startswith('__library_export_'):
+            names[value]=name
+    return names
+
+def call_targets(image, components, component, visited=None):
+    """
+    Returns the addresses of the compartment export entries that code in
+    `component` may call, including through the libraries that it calls.
+    Without a call graph inside the compartment, every export is assumed to
+    be able to reach every import.
+    """
+    if visited is None:
+        visited=set()
+    if component.name in visited:
+        return set()
+    visited.add(component.name)
+    targets=set()
+    (start, end) = component.imports
+    # The first entry is the switcher, the last is a terminator.
+    for entry in range(start + import_entry_size, end - import_entry_size + 1, import_entry_size):
+        address=image.read_u32(entry)
+        size=image.read_u32(entry + 4)
+        if size != 0:
+            continue
+        target=owner(components, address & ~1)
+        if target is None:
+            continue
+        if address & 1:
+            # Library calls run in the caller's compartment.
+            if target.is_library:
+                targets |= call_targets(image, components, target, visited)
+            continue
+        if target.is_library:
+            continue
+        if image.read_u8(address + 3) & export_entry_sealing_type:
+            continue
+        targets.add(address)
+    return targets
+
+def analyse(image, components):
+    """
+    Returns a function that computes, for an export entry, the maximum number
+    of compartments on a call chain starting at that entry and the stack size
+    that such a chain needs.  Both are None if the entry can reach itself.
+    """
+    memo={}
+    active=set()
+    targets={}
+    def visit(address):
+        if address in memo:
+            return memo[address]
+        if address in active:
+            return (None, None, True)
+        active.add(address)
+        component=owner(components, address)
+        if component.name not in targets:
+            targets[component.name]=call_targets(image, components, component)
+        own_stack=image.read_u8(address + 2) * 8
+        unannotated=(own_stack == 0)
+        depth=1
+        stack=own_stack
+        for target in targets[component.name]:
+            (target_depth, target_stack, target_unannotated) = visit(target)
+            unannotated |= target_unannotated
+            if target_depth is None:
+                depth=None
+                stack=None
+                continue
+            if depth is not None:
+                depth=max(depth, target_depth + 1)
+                stack=max(stack, own_stack + stack_entry_reserved_space + target_stack)
+        active.discard(address)
+        memo[address]=(depth, stack, unannotated)
+        return memo[address]
+    return visit
+
+def stack_peaks(image, log, check):
+    """
+    Compare the peak stack use of each export, from the output of
+    `switcher_stack_peaks_dump`, with the stack that its minimum stack
+    annotation reserves.  If the peaks are dumped more than once, the last
+    value for each entry wins.
+    """
+    if '__compartment_export_tables' not in image.symbols:
+        usage("The firmware image does not define __compartment_export_tables")
+    base=image.symbols['__compartment_export_tables']
+    peaks={}
+    for line in log:
+        m=peak_re.search(line)
+        if m:
+            peaks[int(m.group('offset'), 0)]=int(m.group('peak'), 0)
+    components=find_components(image)
+    names=export_names(image)
+    exceeded=False
+    print(f"{'peak':>7s} {'declared':>8s}  entry point")
+    for (offset, peak) in sorted(peaks.items()):
+        address=base + offset
+        component=owner(components, address)
+        where=component.name if component else "?"
+        own_stack=image.read_u8(address + 2) * 8
+        if own_stack == 0:
+            declared="-"
+            note=""
+        else:
+            reserved=own_stack + stack_entry_reserved_space
+            declared=f"0x{reserved:x}"
+            note=" (exceeds declared)" if peak > reserved else ""
+            exceeded |= peak > reserved
+        print(f"{hex(peak):>7s} {declared:>8s}  {where}: {names.get(address, hex(address))}{note}")
+    if check and exceeded:
+        sys.stderr.write("Some exports used more stack than their minimum stack annotation\n")
+        sys.exit(1)
+
+def calibrate(image, log, margin, check):
+    """
+    Suggest a minimum stack annotation for every compartment export from the
+    peaks in the output of `switcher_stack_peaks_dump`, taking the largest
+    value for each entry if the peaks are dumped more than once (for example,
+    from several runs concatenated).  The suggestion is the peak less the
+    space that the switcher reserves, plus `margin`, rounded up to the
+    eight-byte granularity of the annotation.  Exports that have no peak were
+    not exercised and are listed so that coverage can be extended.
+    """
+    if '__compartment_export_tables' not in image.symbols:
+        usage("The firmware image does not define __compartment_export_tables")
+    base=image.symbols['__compartment_export_tables']
+    peaks={}
+    for line in log:
+        m=peak_re.search(line)
+        if m:
+            address=base + int(m.group('offset'), 0)
+            peaks[address]=max(peaks.get(address, 0), int(m.group('peak'), 0))
+    names=export_names(image)
+    unexercised=[]
+    under_provisioned=False
+    print(f"{'peak':>7s} {'declared':>8s} {'suggested':>9s}  entry point")
+    for component in find_components(image):
+        if component.is_library:
+            continue
+        (start, end)=component.exports
+        for address in range(start + export_table_header_size, end, 4):
+            if image.read_u8(address + 3) & export_entry_sealing_type:
+                continue
+            name=f"{component.name}: {names.get(address, hex(address))}"
+            if address not in peaks:
+                unexercised.append(name)
+                continue
+            peak=peaks[address]
+            declared=image.read_u8(address + 2) * 8
+            needed=max(peak - stack_entry_reserved_space, 0) + margin
+            suggested=(needed + 7) & ~7
+            note=""
+            if declared < suggested:
+                note=" (under-provisioned)"
+                under_provisioned=True
+            elif declared > suggested:
+                note=" (over-provisioned)"
+            print(f"{hex(peak):>7s} {hex(declared):>8s} {hex(suggested):>9s}  {name}{note}")
+    for name in unexercised:
+        print(f"{'-':>7s} {'-':>8s} {'-':>9s}  {name} (not exercised)")
+    if check and under_provisioned:
+        sys.stderr.write("Some exports declare less stack than their calibrated peak needs\n")
+        sys.exit(1)
+
+def stack_sizes(options, args):
+    if len(args) != 1:
+        usage("Expected a firmware ELF file")
+    image=FirmwareImage(args[0])
+    if options.calibrate_file:
+        with open(options.calibrate_file, 'r') as log:
+            calibrate(image, log, options.margin, options.check)
+        return
+    if options.peaks_file:
+        with open(options.peaks_file, 'r') as log:
+            stack_peaks(image, log, options.check)
+        return
+    for symbol in ('__thread_count',):
+        if symbol not in image.symbols:
+            usage(f"{args[0]} does not define {symbol}")
+    if '.loader_trusted_stack' not in image.sections:
+        usage(f"{args[0]} does not have a .loader_trusted_stack section")
+    trusted_stack_base=image.sections['.loader_trusted_stack'][1]
+    components=find_components(image)
+    names=export_names(image)
+    visit=analyse(image, components)
+    thread_count=image.read_u16(image.symbols['__thread_count'])
+    under_provisioned=False
+    print(f"{'thread':>6s} {'frames':>13s} {'stack':>17s}  entry point")
+    for thread in range(thread_count):
+        config=image.symbols['__thread_count'] + 2 + thread * thread_config_size
+        entry=image.read_u32(config + 2)
+        stack_size=image.read_u16(config + 10)
+        trusted_stack_size=image.read_u16(config + 16)
+        frames=(trusted_stack_size - trusted_stack_base) // trusted_stack_frame_size
+        (depth, stack, unannotated) = visit(entry)
+        if depth is None:
+            needed_frames="unbounded"
+            needed_stack="unbounded"
+        else:
+            needed_frames=str(depth)
+            # The thread entry also needs its reserved space.
+            stack += stack_entry_reserved_space
+            needed_stack=f"0x{stack:x}"
+            if depth > frames or stack > stack_size:
+                under_provisioned=True
+        note=" (some entry points have no minimum stack annotation)" if unannotated else ""
+        print(f"{thread + 1:6d} {frames:>4d} / {needed_frames:>6s} 0x{stack_size:>5x} / {needed_stack:>7s}  {names.get(entry, hex(entry))}{note}")
+    if options.check and under_provisioned:
+        sys.stderr.write("Some threads have fewer trusted stack frames or less stack than their call graph may need\n")
+        sys.exit(1)
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog [--check] [--peaks <file> | --calibrate <file>] <ELF>
+    For each thread in a firmware image, report the configured number of
+    trusted stack frames and stack size beside the number that the
+    cross-compartment import graph and the entry points' minimum stack
+    annotations require.  Every export of a compartment is assumed to be able
+    to call every compartment export that the compartment (or a library that
+    it calls) imports, so the results are an upper bound.  Threads whose call
+    graph contains a cycle are reported as unbounded.
+
+    With --peaks, instead compare the peak stack use of each export, from the
+    console output of switcher_stack_peaks_dump (in firmware built with
+    --switcher-stack-peaks=y), with the stack that its minimum stack
+    annotation reserves, including the space that the switcher reserves on
+    entry.
+
+    With --calibrate, suggest a value for each compartment export's minimum
+    stack annotation from the peaks in the console output of a calibration
+    run, which is the test suite built with --switcher-stack-peaks=y.  Exports
+    that the run did not call are listed as not exercised.""")
+    parser.add_option('-c','--check', dest="check", action="store_true", help="Exit with an error if any thread is under-provisioned or, with --peaks or --calibrate, any export used more stack than it declared", default=False)
+    parser.add_option('-p','--peaks', dest="peaks_file", help="Compare with the peaks in this console output", metavar="FILE")
+    parser.add_option('--calibrate', dest="calibrate_file", help="Suggest minimum stack annotations from the peaks in this console output", metavar="FILE")
+    parser.add_option('--margin', dest="margin", type="int", help="Bytes to add to each suggested minimum stack annotation (default 0)", default=0)
+    (opts, args) = parser.parse_args()
+    stack_sizes(opts, args)
@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Copyright CHERIoT Contributors.
+# SPDX-License-Identifier: MIT
+
+import optparse, json, os, shutil, subprocess, sys
+
+def usage(msg):
+    sys.stderr.write(msg + "\n")
+    sys.exit(1)
+
+def imported_symbols(report):
+    """
+    Returns the set of export symbols that any compartment or library in the
+    firmware report imports.
+    """
+    used=set()
+    def visit(value):
+        if isinstance(value, dict):
+            if 'export_symbol' in value:
+                used.add(value['export_symbol'])
+            for v in value.values():
+                visit(v)
+        elif isinstance(value, list):
+            for v in value:
+                visit(v)
+    for component in report.get('compartments', {}).values():
+        visit(component.get('imports', []))
+    return used
+
+def unused_exports(report, name, used, keep):
+    """
+    Returns the function exports of the component called `name` that are not
+    imported by any compartment and are not thread entry points.
+    """
+    component=report.get('compartments', {}).get(name, {})
+    return sorted(e['export_symbol'] for e in component.get('exports', [])
+                  if e.get('kind') == 'Function' and
+                  e['export_symbol'] not in used and
+                  e['export_symbol'] not in keep)
+
+def discard_script(ldscript, symbols):
+    """
+    Returns the text of `ldscript` with a leading /DISCARD/ output section
+    for the export entries of `symbols`.  Earlier rules take precedence, so
+    these sections are dropped rather than placed in the export table, and
+    the code that only they reference is then garbage collected.
+    """
+    text=open(ldscript, 'r').read()
+    start=text.index('SECTIONS\n{') + len('SECTIONS\n{')
+    discards=''.join(f"\n\t\t*(.compartment_exports.{s});" for s in symbols)
+    return text[:start] + "\n\t/DISCARD/ :\n\t{" + discards + "\n\t}" + text[start:]
+
+def strip_unused_exports(options):
+    if not (options.report and options.manifest):
+        usage("Expected --report and --manifest")
+    report=json.load(open(options.report, 'r'))
+    manifest=json.load(open(options.manifest, 'r'))
+    keep=set(options.keep)
+    used=imported_symbols(report)
+    os.makedirs(manifest['output_dir'], exist_ok=True)
+    firmware_ldscript=open(manifest['firmware_ldscript'], 'r').read()
+    for component in manifest['components']:
+        symbols=unused_exports(report, component['name'], used, keep)
+        output=component['stripped']
+        firmware_ldscript=firmware_ldscript.replace(component['output'], output)
+        if not symbols:
+            shutil.copyfile(component['output'], output)
+            continue
+        if options.verbose:
+            for symbol in symbols:
+                print(f"Dropping unused export {symbol}")
+        ldscript=output + '.ldscript'
+        open(ldscript, 'w').write(discard_script(component['ldscript'], symbols))
+        subprocess.run([manifest['ld'], "--script=" + ldscript, "--compartment",
+                        "--gc-sections", "--relax", "-o", output] +
+                       component['objects'], check=True)
+    open(manifest['stripped_firmware_ldscript'], 'w').write(firmware_ldscript)
+
+if __name__=="__main__":
+    parser = optparse.OptionParser("""%prog --report <json> --manifest <json> [--keep <symbol>]...
+    Relink the compartments and libraries listed in the manifest without the
+    function exports that, according to the firmware report from a first
+    link, nothing imports, and write a copy of the firmware linker script that
+    uses the relinked components.  Exports named with --keep (thread entry
+    points) are always kept.  Components whose exports are all used are
+    copied unchanged.  The manifest is written by the firmware rule when
+    building with --strip-unused-exports=y.""")
+    parser.add_option('-r','--report', dest="report", help="Firmware report from the first link", metavar="FILE")
+    parser.add_option('-m','--manifest', dest="manifest", help="Components to relink", metavar="FILE")
+    parser.add_option('-k','--keep', dest="keep", action="append", help="Export symbol to keep even if not imported", default=[], metavar="SYMBOL")
+    parser.add_option('-v','--verbose', dest="verbose", action="store_true", help="Print each export that is dropped", default=False)
+    (opts, args) = parser.parse_args()
+    strip_unused_exports(opts)
@@ -6,7 +6,9 @@
 #include "alloc_config.h"
 #include "compartment-macros.h"
 #include "revoker.h"
+#include "statistics.h"
 #include <algorithm>
+#include <bit>
 #include <cdefs.h>
 #include <cheri.hh>
 #include <cheriot-atomic.hh>
@@ -14,6 +16,7 @@
 #include <ds/linked_list.h>
 #include <ds/pointer.h>
 #include <ds/ring_buffer.h>
+#include <ds/xoroshiro.h>
 #include <errno.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -507,6 +510,51 @@ static inline size_t pad_request(size_t req)
 	return ((req) + sizeof(MChunkHeader) + MallocAlignMask) & ~MallocAlignMask;
 }
 
+/**
+ * The largest length that a capability with a zero exponent can represent.
+ * Any base and any length up to this are precisely representable, so requests
+ * of up to this size need no rounding or alignment for their bounds beyond
+ * `MallocAlignment` and skip the representability calculations.
+ */
+constexpr size_t MaxAlwaysPreciseLength = 511;
+
+/**
+ * Returns the size to allocate for a request of `bytes` bytes: the length of
+ * representable bounds for it, rounded up to `MallocAlignment`.  Returns 0 if
+ * `bytes` is too large to represent.
+ */
+static inline size_t representable_request(size_t bytes)
+{
+	if (bytes <= MaxAlwaysPreciseLength)
+	{
+		return (bytes + MallocAlignMask) & ~MallocAlignMask;
+	}
+	return (CHERI::representable_length(bytes) + MallocAlignMask) &
+	       ~MallocAlignMask;
+}
+
+/**
+ * Returns the alignment that representable bounds for `bytes` bytes need.
+ */
+static inline size_t representable_request_alignment(size_t bytes)
+{
+	if (bytes <= MaxAlwaysPreciseLength)
+	{
+		return 1;
+	}
+	return -CHERI::representable_alignment_mask(bytes);
+}
+
+/**
+ * Returns true if a capability with base `base` and length `length` is
+ * precisely representable.
+ */
+static inline bool is_precise_body(ptraddr_t base, size_t length)
+{
+	return (length <= MaxAlwaysPreciseLength) ||
+	       CHERI::is_precise_range(base, length);
+}
+
 /*
  * Chunk headers are also, sort of, a linked list encoding.  They're not a ring
  * and not exactly a typical list, in that the first and last nodes rely on "out
@@ -685,6 +733,28 @@ constexpr size_t MinRequest = MinChunkSize - sizeof(MChunkHeader);
 
 static_assert(MinChunkSize == CHERIOTHeapMinChunkSize);
 
+/**
+ * The largest chunk size (including the header) that is served from the
+ * size-class cache.  This covers requests of up to 128 bytes.
+ */
+constexpr size_t SizeClassMaxChunkSize = 128 + sizeof(MChunkHeader);
+/**
+ * The number of size classes in the size-class cache.  Size classes are exact
+ * chunk sizes, one per `MallocAlignment` step from `MinChunkSize` to
+ * `SizeClassMaxChunkSize`.  If the cache is disabled, we keep a single
+ * (unused) class to avoid zero-length arrays in `MState`.
+ */
+constexpr size_t NSizeClasses =
+  SizeClassCacheEnabled
+    ? ((SizeClassMaxChunkSize - MinChunkSize) >> MallocAlignShift) + 1
+    : 1;
+/**
+ * The maximum number of chunks held in each size class.  Cached chunks are not
+ * consolidated with their neighbours, so this bounds the amount of
+ * fragmentation that the cache can introduce.
+ */
+constexpr size_t SizeClassCacheDepth = 8;
+
 // true if cap address a has acceptable alignment
 static inline bool is_aligned(CHERI::Capability<void> a)
 {
@@ -889,11 +959,13 @@ class MState
 	 * threaded through MChunk::ring-s.  We don't struct-ure these together to
 	 * avoid some padding.  We use a small ring buffer Cursors object to tell us
 	 * which one to use.  There's some redundancy in this aggregate encoding,
-	 * but it's small.
+	 * but it's small.  The total size of the chunks on each ring is tracked so
+	 * that we can tell how much quarantined memory is already safe to reuse.
 	 */
 	static constexpr size_t QuarantineRings = 2;
 	RingSentinel            quarantinePendingChunks[QuarantineRings];
 	size_t                  quarantinePendingEpoch[QuarantineRings];
+	size_t                  quarantinePendingSize[QuarantineRings];
 	ds::ring_buffer::Cursors<Debug, QuarantineRings, uint8_t>
 	  quarantinePendingRing;
 
@@ -911,12 +983,41 @@ class MState
 	 */
 	RingSentinel quarantineFinishedSentinel;
 
+	/**
+	 * The total size of the chunks on the finished quarantine ring.  This is
+	 * memory that can be returned to the free bins without waiting for
+	 * revocation.
+	 */
+	size_t quarantineFinishedSize;
+
 	auto quarantine_finished_get()
 	{
 		return rederive<RingSentinel>(
 		  CHERI::Capability{&quarantineFinishedSentinel}.address());
 	}
 
+	/*
+	 * Size-class caches.  Small chunks that have finished quarantine are kept
+	 * here, rather than being returned to the bins, so that allocations of
+	 * exactly the same chunk size can be satisfied in O(1).  Chunks on these
+	 * rings remain marked as in use (with no owner), so they are never
+	 * consolidated with their neighbours and are skipped by anything that
+	 * walks the heap looking for live objects.  Their bodies are zero apart
+	 * from their ring linkage and their shadow bits are clear, exactly as if
+	 * they had been returned to a bin.  Use size_class_cache_at() for access
+	 * to ensure proper CHERI bounds!
+	 */
+	RingSentinel sizeClassCache[NSizeClasses];
+	/// The number of chunks on each of the `sizeClassCache` rings.
+	uint8_t sizeClassCacheOccupancy[NSizeClasses];
+
+	// Returns the size-class cache ring for index i.
+	auto size_class_cache_at(BIndex i)
+	{
+		return rederive<RingSentinel>(
+		  CHERI::Capability{&sizeClassCache[i]}.address());
+	}
+
 	// bitmap telling which bins are empty which are not
 	Binmap smallmap;
 	Binmap treemap;
@@ -924,11 +1025,40 @@ class MState
 	size_t heapFreeSize;
 	size_t heapQuarantineSize;
 
+	/**
+	 * With lazy zeroing, the address above which memory in this space has not
+	 * been zeroed since boot.  Unused memory below it is zero apart from chunk
+	 * headers and free-chunk linkages, as is the whole heap without lazy
+	 * zeroing.  Memory is only ever allocated at or below it, and it is moved
+	 * up as allocations reach beyond it.
+	 */
+	ptraddr_t zeroedTop;
+
+	/**
+	 * Counters reported by `heap_statistics`.  This is empty unless the
+	 * allocator is built with statistics support.
+	 */
+	[[no_unique_address]] AllocatorStatistics<StatisticsEnabled> statistics;
+
+	/**
+	 * The generator that chooses where `ok_malloc_state_sample` starts.
+	 */
+	ds::xoroshiro::P64R32 sanityRandom;
+
 	/**
 	 * The number of entries currently in the `hazardQuarantine` array.
 	 */
 	size_t hazardQuarantineOccupancy = 0;
 
+	/**
+	 * A coarse index of the hazard pointers, rebuilt by `hazard_list_begin`.
+	 * The heap is divided into 32 equal regions and bit `n` is set if any
+	 * valid hazard pointer starts in region `n`.  This lets
+	 * `hazard_pointer_check` skip walking every slot of every thread for
+	 * objects that no hazard pointer can refer to.
+	 */
+	uint32_t hazardSummary = 0;
+
 	/**
 	 * Returns true if there are no objects in the `hazardQuarantine` array.
 	 */
@@ -1023,9 +1153,23 @@ class MState
 		{
 			quarantinePendingChunk.reset();
 		}
+		for (auto &pendingSize : quarantinePendingSize)
+		{
+			pendingSize = 0;
+		}
 		quarantinePendingRing.reset();
 		quarantineFinishedSentinel.reset();
-		heapQuarantineSize = 0;
+		quarantineFinishedSize = 0;
+		heapQuarantineSize     = 0;
+		statistics.reset();
+		sanityRandom.set_state(heapStart.address());
+
+		// Initialise the size-class caches.
+		for (BIndex i = 0; i < NSizeClasses; ++i)
+		{
+			size_class_cache_at(i)->reset();
+			sizeClassCacheOccupancy[i] = 0;
+		}
 	}
 
 	/**
@@ -1046,6 +1190,9 @@ class MState
 		epoch++;
 		*lockWord = (epoch << 16) | thread_id_get();
 		epoch++;
+		// No thread can successfully add a hazard pointer while the epoch is
+		// odd, so the summary remains valid until the guard is released.
+		hazard_summary_build();
 		struct Guard
 		{
 			volatile uint32_t *lockWord;
@@ -1139,22 +1286,21 @@ class MState
 	 * object.  This allows it to be skipped when freeing all objects allocated
 	 * with a given quota.
 	 *
+	 * If `alignment` (a power of two) is greater than the alignment that
+	 * representable bounds require, the allocation is aligned to it instead.
+	 * The leading slack is split off and returned to the free pool by
+	 * `mspace_memalign`, so only the requested size is charged to the quota.
+	 *
 	 * @return User pointer if request can be satisfied, or a tag type
 	 * representing the error otherwise.
 	 */
 	AllocationResult mspace_dispatch(size_t   bytes,
 	                                 size_t  &quota,
 	                                 uint16_t identifier,
-	                                 bool     isSealed = false)
+	                                 bool     isSealed  = false,
+	                                 size_t   alignment = 0)
 	{
-		if (!hazard_quarantine_is_empty())
-		{
-			auto guard = hazard_list_begin();
-			hazard_pointers_recheck();
-		}
-		size_t alignSize =
-		  (CHERI::representable_length(bytes) + MallocAlignMask) &
-		  ~MallocAlignMask;
+		size_t alignSize = representable_request(bytes);
 		// This 0 size check is for:
 		// 1. We choose to return nullptr for 0-byte requests.
 		// 2. crrl overflows to 0 if bytes is too big. Force failure.
@@ -1162,9 +1308,10 @@ class MState
 		{
 			return AllocationFailurePermanent{};
 		}
+		statistics.record_allocation(bytes);
 		// Check this first so that quota exhaustion doesn't return temporary
 		// failure.
-		if (heapTotalSize < alignSize)
+		if ((heapTotalSize < alignSize) || (heapTotalSize < alignment))
 		{
 			return AllocationFailurePermanent{};
 		}
@@ -1178,7 +1325,9 @@ class MState
 			return AllocationFailureQuotaExceeded{};
 		}
 		CHERI::Capability<void> ret{mspace_memalign(
-		  alignSize, -CHERI::representable_alignment_mask(bytes))};
+		  alignSize,
+		  std::max<size_t>(alignment,
+		                   representable_request_alignment(bytes)))};
 		if (ret == nullptr)
 		{
 			auto neededSize = alignSize + sizeof(MChunkHeader);
@@ -1211,23 +1360,23 @@ class MState
 			return AllocationFailureQuotaExceeded{};
 		}
 
-		if constexpr (DEBUG_ALLOCATOR)
+		if constexpr (DEBUG_ALLOCATOR && (MStateSanitySamples == 0))
 		{
 			// Periodically sanity check the entire state for this mspace.
-			static size_t           sanityCounter        = 0;
-			static constexpr size_t MStateSanityInterval = 128;
+			static size_t sanityCounter = 0;
 			if (sanityCounter % MStateSanityInterval == 0)
 			{
 				ok_malloc_state();
 			}
 			++sanityCounter;
 		}
+		ok_malloc_state_sample();
 
 		size_t bodySize        = header->size_get() - sizeof(MChunkHeader);
 		header->isSealedObject = isSealed;
 		header->set_owner(identifier);
 		quota -= header->size_get();
-		if (CHERI::is_precise_range(ret.address(), bodySize))
+		if (is_precise_body(ret.address(), bodySize))
 		{
 			// Can we use this whole chunk as is? Yes!
 			ret.bounds() = bodySize;
@@ -1249,6 +1398,76 @@ class MState
 		return ret;
 	}
 
+	/**
+	 * Try to grow the in-use chunk `p` in place so that its body can hold
+	 * `bytes` bytes, by absorbing the free chunk that follows it.  Any part of
+	 * the free chunk that is not needed is returned to the free bins.
+	 *
+	 * This succeeds only if the successor is free and large enough, if the
+	 * current base is sufficiently aligned for a precise capability of the new
+	 * length, and if the growth fits in `quota`.  On success, `quota` is
+	 * decremented by the growth in chunk size and this returns true.  On
+	 * failure, nothing is modified.
+	 *
+	 * The absorbed memory is zero (free chunk bodies are zero apart from their
+	 * linkages, which `unlink_chunk` clears) and its shadow bits are clear, so
+	 * it can be handed to the owner directly.
+	 */
+	bool mspace_grow_in_place(MChunkHeader &p, size_t bytes, size_t &quota)
+	{
+		size_t alignSize = representable_request(bytes);
+		if (alignSize == 0)
+		{
+			return false;
+		}
+		ptraddr_t base = p.body().address();
+		if ((base & (representable_request_alignment(bytes) - 1)) != 0)
+		{
+			return false;
+		}
+		size_t nb   = (alignSize < MinRequest) ? MinChunkSize
+		                                       : pad_request(alignSize);
+		size_t size = p.size_get();
+		if (nb <= size)
+		{
+			return true;
+		}
+		MChunkHeader *next = p.cell_next();
+		if (next->is_in_use())
+		{
+			return false;
+		}
+		size_t nextSize = next->size_get();
+		if (size + nextSize < nb)
+		{
+			return false;
+		}
+		size_t rsize   = size + nextSize - nb;
+		size_t newSize = (rsize >= MinChunkSize) ? nb : size + nextSize;
+		if (newSize - size > quota)
+		{
+			return false;
+		}
+
+		unlink_chunk(MChunk::from_header(next), nextSize);
+		heapFreeSize -= nextSize;
+		ds::linked_list::unsafe_remove_link(&p, next);
+		next->clear();
+		// next is no longer a header. Clear the shadow bit.
+		revoker.shadow_paint_single(CHERI::Capability{next}.address(), false);
+		p.mark_in_use();
+		if (rsize >= MinChunkSize)
+		{
+			// The remainder inherits the in-use bit and is then freed, which
+			// also accounts for it in heapFreeSize.
+			mspace_free_internal(p.split(nb));
+		}
+		zero_unzeroed(p.body(), CHERI::Capability{p.cell_next()}.address());
+		quota -= p.size_get() - size;
+		ok_in_use_chunk(&p);
+		return true;
+	}
+
 	/**
 	 * Returns
 	 * the size of the allocation associated with `chunk`.
@@ -1257,7 +1476,7 @@ class MState
 	{
 		size_t    bodySize = chunk.size_get() - sizeof(MChunkHeader);
 		ptraddr_t base     = chunk.body().address();
-		if (!CHERI::is_precise_range(base, bodySize))
+		if (!is_precise_body(base, bodySize))
 		{
 			/*
 			 * If we can't give a precise capability covering the whole chunk,
@@ -1282,6 +1501,13 @@ class MState
 	 */
 	bool hazard_pointer_check(Capability<void> allocation)
 	{
+		// If no hazard pointer starts in the regions that this allocation
+		// covers, none can be a subset of it.
+		if ((hazardSummary & hazard_summary_bits(allocation.base(),
+		                                         allocation.top())) == 0)
+		{
+			return false;
+		}
 		// It is now safe to walk the hazard list.
 		Capability<void *> hazards =
 		  const_cast<void **>(SHARED_OBJECT_WITH_PERMISSIONS(
@@ -1295,13 +1521,57 @@ class MState
 			{
 				Debug::log("Found hazard pointer for {} (thread: {})",
 				           allocation,
-				           ((i / 2) + 1));
+				           ((i / CHERIOT_HAZARD_POINTERS_PER_THREAD) + 1));
 				return true;
 			}
 		}
 		return false;
 	}
 
+	/**
+	 * Returns the bits in `hazardSummary` that correspond to the heap regions
+	 * overlapping `[base, top)`.  Ranges outside the heap map to no bits.
+	 */
+	uint32_t hazard_summary_bits(ptraddr_t base, ptraddr_t top)
+	{
+		ptraddr_t heapBase = heapStart.base();
+		ptraddr_t heapTop  = heapStart.top();
+		if ((top <= heapBase) || (base >= heapTop) || (top <= base))
+		{
+			return 0;
+		}
+		base = std::max(base, heapBase);
+		top  = std::min(top, heapTop);
+		// Choose a region size such that the heap spans at most 32 regions.
+		size_t shift = std::bit_width((heapTop - heapBase - 1) >> 5);
+		size_t first = (base - heapBase) >> shift;
+		size_t last  = (top - 1 - heapBase) >> shift;
+		return ((2U << last) - 1) & ~((1U << first) - 1);
+	}
+
+	/**
+	 * Rebuild `hazardSummary` from the current contents of every thread's
+	 * hazard slots.
+	 */
+	void hazard_summary_build()
+	{
+		Capability<void *> hazards =
+		  const_cast<void **>(SHARED_OBJECT_WITH_PERMISSIONS(
+		    void *, allocator_hazard_pointers, true, false, true, false));
+		size_t   pointers = hazards.length() / sizeof(void *);
+		uint32_t summary  = 0;
+		for (size_t i = 0; i < pointers; i++)
+		{
+			Capability hazardPointer{hazards[i]};
+			if (hazardPointer.is_valid())
+			{
+				summary |= hazard_summary_bits(hazardPointer.base(),
+				                               hazardPointer.base() + 1);
+			}
+		}
+		hazardSummary = summary;
+	}
+
 	/**
 	 * Recheck all of the pointers in the hazard quarantine and free any that
 	 * are no longer on active hazard lists.
@@ -1430,7 +1700,32 @@ class MState
 		 */
 		quarantine_pending_push(epoch, &chunk);
 		heapQuarantineSize += chunk.size_get();
+		ok_malloc_state_sample();
+
+		/*
+		 * Draining quarantine and kicking the revoker are left to
+		 * `quarantine_maintain`, which callers run in a separate critical
+		 * section so that a waiting allocation can take the lock in between.
+		 */
+		return isDoubleFree ? -EINVAL : 0;
+	}
 
+	/**
+	 * Quarantine and revocation bookkeeping that is not needed to complete
+	 * any single allocation or free.  Rechecks the hazard quarantine, moves
+	 * some chunks whose revocation has finished back to the free pool, and
+	 * starts revocation if the quarantine has grown too large.
+	 *
+	 * This should be run once for each object freed, but it does not need to
+	 * be in the same critical section as the free.
+	 */
+	void quarantine_maintain()
+	{
+		if (!hazard_quarantine_is_empty())
+		{
+			auto guard = hazard_list_begin();
+			hazard_pointers_recheck();
+		}
 		/*
 		 * Perhaps there has been some progress on revocation.  Dequeue 3 times.
 		 * 3 is chosen randomly. At least 2 is needed for easy argument that the
@@ -1438,8 +1733,6 @@ class MState
 		 */
 		mspace_qtbin_deqn(3);
 		mspace_bg_revoker_kick();
-
-		return isDoubleFree ? -EINVAL : 0;
 	}
 
 	/**
@@ -1484,14 +1777,62 @@ class MState
 	}
 
 	/**
-	 * Try to dequeue some objects from quarantine.
+	 * Try to dequeue some objects from quarantine.  If `neededSize` (the
+	 * requested size of an allocation that is waiting for memory) is large,
+	 * prefer releasing the largest chunks that are already safe to reuse.  If
+	 * free memory plus the memory that is already safe to reuse cannot
+	 * satisfy `neededSize`, start revocation immediately rather than waiting
+	 * until the finished quarantine has been drained.
 	 *
 	 * Returns true if any objects were dequeued, false otherwise.
 	 */
-	__always_inline bool quarantine_dequeue()
+	__always_inline bool quarantine_dequeue(size_t neededSize = 0)
 	{
+		bool dequeued = false;
+		if (neededSize > MaxSmallRequest)
+		{
+			quarantine_pending_to_finished();
+			if ((heapFreeSize + quarantineFinishedSize) <
+			    (neededSize + sizeof(MChunkHeader)))
+			{
+				mspace_bg_revoker_kick<true>();
+			}
+			dequeued = mspace_qtbin_deq_largest();
+		}
 		// 4 chosen by fair die roll.
-		return mspace_qtbin_deqn(4) > 0;
+		return (mspace_qtbin_deqn(4) > 0) || dequeued;
+	}
+
+	/**
+	 * Fill in `out` with the statistics collected by this MState and a
+	 * snapshot of its quarantine and free-space state.  Does not fill in the
+	 * lock statistics, which are owned by the caller.
+	 */
+	void statistics_get(HeapStatistics &out)
+	{
+		statistics.copy_to(out);
+		out.revocationPasses = (revoker.system_epoch_get() + 1) / 2;
+		out.quarantinePendingRings = 0;
+		decltype(quarantinePendingRing)::Ix head, tail;
+		if (quarantinePendingRing.head_get(head) &&
+		    quarantinePendingRing.tail_get(tail))
+		{
+			for (auto ix = head;; ix = (ix + 1) % QuarantineRings)
+			{
+				out.quarantinePendingEpoch[out.quarantinePendingRings] =
+				  quarantinePendingEpoch[ix];
+				out.quarantinePendingBytes[out.quarantinePendingRings] =
+				  quarantinePendingSize[ix];
+				out.quarantinePendingRings++;
+				if (ix == tail)
+				{
+					break;
+				}
+			}
+		}
+		out.quarantineFinishedBytes = quarantineFinishedSize;
+		out.freeBytes               = heapFreeSize;
+		out.largestFreeChunk        = largest_free_chunk_size();
 	}
 
 	private:
@@ -1520,12 +1861,63 @@ class MState
 		return false;
 	}
 
+	/**
+	 * The number of capability words that `capaligned_zero` clears in each
+	 * iteration of its main loop.
+	 */
+	static constexpr size_t ZeroUnroll = 4;
+
+	/**
+	 * Zero `size` bytes at `start`, which must be capability aligned.
+	 *
+	 * Free chunks are always zero (`mspace_malloc_success` checks this), so
+	 * this, on free, is the only place where heap memory is zeroed and
+	 * allocation never needs to.  Large frees spend most of their time here
+	 * with the allocator lock held, so the loop is unrolled to clear
+	 * `ZeroUnroll` words per iteration.  The barrier between groups stops
+	 * the compiler from turning the loop into a call to `memset`.
+	 */
 	static void capaligned_zero(void *start, size_t size)
 	{
-		capaligned_range_do(start, size, [](void **word) {
-			*word = nullptr;
-			return false;
-		});
+		Debug::Assert((size & (sizeof(void *) - 1)) == 0,
+		              "Cap range is not aligned");
+		void **word = static_cast<void **>(start);
+		void **end  = word + size / sizeof(void *);
+		while (static_cast<size_t>(end - word) >= ZeroUnroll)
+		{
+			for (size_t i = 0; i < ZeroUnroll; i++)
+			{
+				word[i] = nullptr;
+			}
+			word += ZeroUnroll;
+			asm volatile("" ::: "memory");
+		}
+		while (word < end)
+		{
+			*word++ = nullptr;
+		}
+	}
+
+	/**
+	 * With lazy zeroing, zero the part of the chunk body from `start` to `end`
+	 * that is above `zeroedTop` and move `zeroedTop` up to `end`.  Without
+	 * lazy zeroing, the loader zeroes the whole heap and this does nothing.
+	 */
+	void zero_unzeroed(CHERI::Capability<void> start, ptraddr_t end)
+	{
+		if constexpr (LazyZeroing)
+		{
+			if (end <= zeroedTop)
+			{
+				return;
+			}
+			if (start.address() < zeroedTop)
+			{
+				start.address() = zeroedTop;
+			}
+			capaligned_zero(start, end - start.address());
+			zeroedTop = end;
+		}
 	}
 
 	/**
@@ -1873,6 +2265,35 @@ class MState
 			return false;
 		});
 	}
+	// Sanity check size class cache i.
+	void ok_size_class_cache(BIndex i)
+	{
+		if constexpr (!DEBUG_ALLOCATOR || !SizeClassCacheEnabled)
+		{
+			return;
+		}
+		size_t count = 0;
+		size_class_cache_at(i)->search([&](auto pRing) {
+			auto pHeader = MChunkHeader::from_body(MChunk::from_ring(pRing));
+			ok_in_use_chunk(pHeader);
+			Debug::Assert(pHeader->size_get() == size_class_index2size(i),
+			              "Chunk {} has size {} but is in size class for {}",
+			              pHeader,
+			              pHeader->size_get(),
+			              size_class_index2size(i));
+			Debug::Assert(pHeader->ownerID == 0,
+			              "Cached chunk {} has owner {}",
+			              pHeader,
+			              pHeader->ownerID);
+			count++;
+			return false;
+		});
+		Debug::Assert(count == sizeClassCacheOccupancy[i],
+		              "Size class {} contains {} chunks, expected {}",
+		              i,
+		              count,
+		              sizeClassCacheOccupancy[i]);
+	}
 	// Sanity check the entire malloc state in this MState.
 	void ok_malloc_state()
 	{
@@ -1895,6 +2316,61 @@ class MState
 		{
 			ok_treebin(i);
 		}
+		for (i = 0; i < NSizeClasses; ++i)
+		{
+			ok_size_class_cache(i);
+		}
+	}
+
+	/**
+	 * Sanity check up to `MStateSanitySamples` consecutive chunks in this
+	 * MState.
+	 *
+	 * The run starts at the first chunk in a randomly chosen bin, or at the
+	 * start of the heap if that bin is empty, and continues in address order,
+	 * so it checks in-use chunks and the boundary tags between neighbours as
+	 * well as free chunks.  Free chunks move between bins as the heap is
+	 * used, so the runs cover the whole heap over time.
+	 */
+	void ok_malloc_state_sample()
+	{
+		if constexpr (!DEBUG_ALLOCATOR || (MStateSanitySamples == 0))
+		{
+			return;
+		}
+		BIndex        bin     = sanityRandom() % (NSmallBins + NTreeBins);
+		MChunkHeader *chunk   = heapStart.cast<MChunkHeader>();
+		ptraddr_t     heapEnd = heapStart.top();
+		if (bin < NSmallBins)
+		{
+			if (is_smallmap_marked(bin))
+			{
+				chunk = MChunkHeader::from_body(
+				  MChunk::from_ring(smallbin_at(bin)->first()));
+			}
+		}
+		else if (TChunk *t = *treebin_at(bin - NSmallBins); t != nullptr)
+		{
+			chunk = MChunkHeader::from_body(t);
+		}
+		for (size_t i = 0; i < MStateSanitySamples; i++)
+		{
+			MChunkHeader *next = chunk->cell_next();
+			// The footer at the end of the heap is not a real chunk.
+			if (CHERI::Capability{next}.address() >= heapEnd)
+			{
+				break;
+			}
+			if (chunk->is_in_use())
+			{
+				ok_in_use_chunk(chunk);
+			}
+			else
+			{
+				ok_free_chunk(chunk);
+			}
+			chunk = next;
+		}
 	}
 
 	private:
@@ -2466,6 +2942,8 @@ class MState
 		{
 			quarantine_finished_get()->append(qring->take_all());
 		}
+		quarantineFinishedSize += quarantinePendingSize[oldestPendingIx];
+		quarantinePendingSize[oldestPendingIx] = 0;
 
 		quarantinePendingRing.head_advance();
 	}
@@ -2497,10 +2975,12 @@ class MState
 			Debug::Assert(opened, "Failed to open epoch ring");
 
 			quarantinePendingEpoch[youngestPendingIx] = epoch;
+			quarantinePendingSize[youngestPendingIx]  = 0;
 		}
 
 		quarantine_pending_get(youngestPendingIx)
 		  ->append_emplace(&(new (header->body()) MChunk())->ring);
+		quarantinePendingSize[youngestPendingIx] += header->size_get();
 	}
 
 	/**
@@ -2532,6 +3012,15 @@ class MState
 		{
 			shouldKick = heapQuarantineSize > heapFreeSize / 4 * 3;
 		}
+		if constexpr (Revocation::SupportsSweepRate<Revocation::Revoker>)
+		{
+			// Sweep gently unless free memory is running out.
+			bool urgent = Force || (heapFreeSize < heapTotalSize / 8) ||
+			              (heapQuarantineSize > heapFreeSize);
+			revoker.system_bg_revoker_rate_set(
+			  urgent ? Revocation::SweepRate::Aggressive
+			         : Revocation::SweepRate::Gentle);
+		}
 		if (Force || shouldKick)
 		{
 			revoker.system_bg_revoker_kick();
@@ -2565,31 +3054,225 @@ class MState
 				}
 			}
 
-			MChunk       *fore       = MChunk::from_ring(quarantine->first());
-			MChunkHeader *foreHeader = MChunkHeader::from_body(fore);
+			quarantine_release(MChunk::from_ring(quarantine->first()));
+			dequeued++;
+		}
+		return dequeued;
+	}
 
-			/*
-			 * Detach from quarantine and zero the ring linkage; the rest of
-			 * this chunk, apart from its header, is also zero, thanks to the
-			 * capaligned_zero() done in mspace_free() before the chunk was
-			 * put into quarantine.  mspace_free_internal() will either rebuild
-			 * this cons cell, if it cannot consolidate backwards, or it will
-			 * discard the idea that this is a link cell at all by detaching
-			 * and clearing fore's header.
-			 */
-			ds::linked_list::unsafe_remove(&fore->ring);
-			fore->metadata_clear();
+	/**
+	 * Take a chunk off the finished quarantine ring and return it to the
+	 * size-class cache or the free bins.
+	 */
+	void quarantine_release(MChunk *fore)
+	{
+		MChunkHeader *foreHeader = MChunkHeader::from_body(fore);
+
+		/*
+		 * Detach from quarantine and zero the ring linkage; the rest of
+		 * this chunk, apart from its header, is also zero, thanks to the
+		 * capaligned_zero() done in mspace_free() before the chunk was
+		 * put into quarantine.  mspace_free_internal() will either rebuild
+		 * this cons cell, if it cannot consolidate backwards, or it will
+		 * discard the idea that this is a link cell at all by detaching
+		 * and clearing fore's header.
+		 */
+		ds::linked_list::unsafe_remove(&fore->ring);
+		fore->metadata_clear();
 
-			heapQuarantineSize -= foreHeader->size_get();
+		heapQuarantineSize -= foreHeader->size_get();
+		quarantineFinishedSize -= foreHeader->size_get();
 
-			/* Clear the shadow bits that marked this region as quarantined */
-			revoker.shadow_paint_range<false>(foreHeader->body().address(),
-			                                  foreHeader->cell_next());
+		/* Clear the shadow bits that marked this region as quarantined */
+		revoker.shadow_paint_range<false>(foreHeader->body().address(),
+		                                  foreHeader->cell_next());
 
+		if (!size_class_cache_insert(foreHeader))
+		{
 			mspace_free_internal(foreHeader);
-			dequeued++;
 		}
-		return dequeued;
+	}
+
+	/**
+	 * Returns the size (including the header) of the largest chunk in the
+	 * free bins, or 0 if the bins are empty.  Sizes in the right subtree of a
+	 * tree bin are all larger than those in the left, so the largest chunk is
+	 * found by walking down the highest non-empty tree preferring right
+	 * children.
+	 */
+	size_t largest_free_chunk_size()
+	{
+		if (treemap != 0)
+		{
+			BIndex  i       = 31 - __builtin_clz(treemap);
+			size_t  largest = 0;
+			TChunk *t       = *treebin_at(i);
+			while (t != nullptr)
+			{
+				largest =
+				  std::max(largest, MChunkHeader::from_body(t)->size_get());
+				t = (t->child[1] != nullptr) ? t->child[1] : t->child[0];
+			}
+			return largest;
+		}
+		if (smallmap != 0)
+		{
+			return small_index2size(31 - __builtin_clz(smallmap));
+		}
+		return 0;
+	}
+
+	/**
+	 * The maximum number of finished-quarantine chunks that
+	 * `mspace_qtbin_deq_largest` will inspect.  This bounds the time spent
+	 * with the lock held.
+	 */
+	static constexpr size_t QuarantineLargestScanLimit = 16;
+
+	/**
+	 * Release the largest of the first `QuarantineLargestScanLimit` chunks on
+	 * the finished quarantine ring.  Large allocations are more likely to be
+	 * satisfied by one large chunk (and whatever it consolidates with) than
+	 * by the same number of arbitrary chunks from the head of the ring.
+	 *
+	 * Returns true if a chunk was released, false if the finished ring is
+	 * empty.
+	 */
+	bool mspace_qtbin_deq_largest()
+	{
+		auto quarantine = quarantine_finished_get();
+		if (quarantine->is_empty())
+		{
+			quarantine_pending_to_finished();
+			if (quarantine->is_empty())
+			{
+				return false;
+			}
+		}
+		MChunk *largest     = nullptr;
+		size_t  largestSize = 0;
+		size_t  scanned     = 0;
+		quarantine->search([&](auto pRing) {
+			MChunk *chunk = MChunk::from_ring(pRing);
+			size_t  size  = MChunkHeader::from_body(chunk)->size_get();
+			if (size > largestSize)
+			{
+				largest     = chunk;
+				largestSize = size;
+			}
+			return ++scanned >= QuarantineLargestScanLimit;
+		});
+		quarantine_release(largest);
+		return true;
+	}
+
+	/**
+	 * Is a chunk of size `size` (including the header) eligible for the
+	 * size-class cache?
+	 */
+	static bool is_size_class(size_t size)
+	{
+		return SizeClassCacheEnabled && (size <= SizeClassMaxChunkSize);
+	}
+
+	// The index of the size class for chunks of size `size`.
+	static BIndex size_class_index(size_t size)
+	{
+		return (size - MinChunkSize) >> MallocAlignShift;
+	}
+
+	// Convert a size class index to the chunk size that it contains.
+	static size_t size_class_index2size(BIndex i)
+	{
+		return MinChunkSize + (static_cast<size_t>(i) << MallocAlignShift);
+	}
+
+	/**
+	 * Try to place a chunk that has just left quarantine in the size-class
+	 * cache.  The chunk must still be marked as in use and must have had its
+	 * shadow bits cleared.
+	 *
+	 * Returns true if the chunk was cached, false if the caller should return
+	 * it to the free bins.
+	 */
+	bool size_class_cache_insert(MChunkHeader *p)
+	{
+		size_t size = p->size_get();
+		if (!is_size_class(size))
+		{
+			return false;
+		}
+		BIndex i = size_class_index(size);
+		if (sizeClassCacheOccupancy[i] >= SizeClassCacheDepth)
+		{
+			return false;
+		}
+		ok_in_use_chunk(p);
+		// Sealed-object marks persist through quarantine, drop them now.
+		p->isSealedObject = false;
+		size_class_cache_at(i)->append_emplace(
+		  &(new (p->body()) MChunk())->ring);
+		sizeClassCacheOccupancy[i]++;
+		// Cached chunks are available for allocation and so count as free.
+		heapFreeSize += size;
+		return true;
+	}
+
+	/**
+	 * Take a chunk of exactly `nb` bytes (including the header) from the
+	 * size-class cache, if one is available.  The returned chunk is marked as
+	 * in use and has had its linkages cleared.
+	 */
+	MChunkHeader *size_class_cache_take(size_t nb)
+	{
+		if (!is_size_class(nb))
+		{
+			return nullptr;
+		}
+		BIndex i     = size_class_index(nb);
+		auto   cache = size_class_cache_at(i);
+		if (cache->is_empty())
+		{
+			return nullptr;
+		}
+		MChunk *p = MChunk::from_ring(cache->unsafe_take_first());
+		p->metadata_clear();
+		sizeClassCacheOccupancy[i]--;
+		MChunkHeader *pHeader = MChunkHeader::from_body(p);
+		ok_malloced_chunk(pHeader, nb);
+		return pHeader;
+	}
+
+	/**
+	 * Return every chunk in the size-class caches to the free bins, allowing
+	 * them to be consolidated with their neighbours.  This is used when an
+	 * allocation cannot be satisfied from the bins alone.
+	 *
+	 * Returns true if any chunks were released.
+	 */
+	bool size_class_cache_flush()
+	{
+		if constexpr (!SizeClassCacheEnabled)
+		{
+			return false;
+		}
+		bool released = false;
+		for (BIndex i = 0; i < NSizeClasses; ++i)
+		{
+			auto cache = size_class_cache_at(i);
+			while (!cache->is_empty())
+			{
+				MChunk *p = MChunk::from_ring(cache->unsafe_take_first());
+				p->metadata_clear();
+				MChunkHeader *pHeader = MChunkHeader::from_body(p);
+				// mspace_free_internal will account for this as free again.
+				heapFreeSize -= pHeader->size_get();
+				mspace_free_internal(pHeader);
+				released = true;
+			}
+			sizeClassCacheOccupancy[i] = 0;
+		}
+		return released;
 	}
 
 	/**
@@ -2600,6 +3283,7 @@ class MState
 		// If we reached here, then it means we took a real chunk off the free
 		// list without errors. Zero the user portion metadata.
 		size_t size = p->size_get();
+		zero_unzeroed(p->body(), CHERI::Capability{p->cell_next()}.address());
 		/*
 		 * We sanity check that things off the free list are indeed zeroed out,
 		 * and none corresponds to a set shadow bit. We need to wrap *word
@@ -2626,16 +3310,14 @@ class MState
 	}
 
 	/**
-	 * This is the only function that takes memory from the free list. All other
-	 * wrappers that take memory must call this in the end.
+	 * Search the free bins for a chunk large enough to hold `bytes`.  Returns
+	 * the chunk, marked as in use and with its linkages cleared, or nullptr if
+	 * there is no suitable chunk.
 	 */
-	MChunkHeader *mspace_malloc_internal(size_t bytes)
+	MChunkHeader *mspace_malloc_from_bins(size_t bytes)
 	{
 		size_t nb;
 
-		/* Move O(1) nodes from quarantine, if any are available */
-		quarantine_dequeue();
-
 		if (bytes <= MaxSmallRequest)
 		{
 			BIndex idx;
@@ -2649,6 +3331,7 @@ class MState
 				auto p = unlink_first_small_chunk(idx);
 				p->mark_in_use();
 				ok_malloced_chunk(p, nb);
+				statistics.count(&HeapStatistics::smallBinHits);
 				return p;
 			}
 
@@ -2668,6 +3351,7 @@ class MState
 				}
 				p->mark_in_use();
 				ok_malloced_chunk(p, nb);
+				statistics.count(&HeapStatistics::smallBinHits);
 				return p;
 			}
 
@@ -2675,6 +3359,7 @@ class MState
 			if (treemap != 0 && (p = tmalloc_small(nb)) != nullptr)
 			{
 				ok_malloced_chunk(p, nb);
+				statistics.count(&HeapStatistics::treeBinHits);
 				return p;
 			}
 		}
@@ -2685,6 +3370,57 @@ class MState
 			if (treemap != 0 && (p = tmalloc_large(nb)) != nullptr)
 			{
 				ok_malloced_chunk(p, nb);
+				statistics.count(&HeapStatistics::treeBinHits);
+				return p;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * This is the only function that takes memory from the free list. All other
+	 * wrappers that take memory must call this in the end.
+	 */
+	MChunkHeader *mspace_malloc_internal(size_t bytes)
+	{
+		/*
+		 * Exact-size hits in the size-class cache avoid searching the bins
+		 * entirely.
+		 */
+		size_t nb = (bytes < MinRequest) ? MinChunkSize : pad_request(bytes);
+		if (auto *p = size_class_cache_take(nb))
+		{
+			statistics.count(&HeapStatistics::sizeClassCacheHits);
+			return p;
+		}
+
+		if (auto *p = mspace_malloc_from_bins(bytes))
+		{
+			return p;
+		}
+		statistics.count(&HeapStatistics::binMisses);
+
+		/*
+		 * Quarantine is normally drained by `quarantine_maintain` after frees,
+		 * outside of allocation.  Only when the bins miss, move O(1) nodes
+		 * from quarantine, if any are available, and try again.
+		 */
+		if (quarantine_dequeue())
+		{
+			if (auto *p = mspace_malloc_from_bins(bytes))
+			{
+				return p;
+			}
+		}
+
+		/*
+		 * The cache may be holding memory that, once consolidated, would
+		 * satisfy this request.  Release it and try again.
+		 */
+		if (size_class_cache_flush())
+		{
+			if (auto *p = mspace_malloc_from_bins(bytes))
+			{
 				return p;
 			}
 		}
@@ -2732,6 +3468,9 @@ class MState
 		{
 			return p;
 		}
+		// The leading and trailing space is returned to the free bins
+		// without being zeroed, so zero the whole chunk first.
+		zero_unzeroed(p->body(), CHERI::Capability{p->cell_next()}.address());
 
 		ptraddr_t memAddress = p->body().address();
 		if ((memAddress % alignment) != 0)
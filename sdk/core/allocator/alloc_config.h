@@ -16,14 +16,147 @@ using Debug = ConditionalDebug<DEBUG_ALLOCATOR, "Allocator">;
 #	define RTCHECK(e) (1)
 #else
 #	define RTCHECK(e) (e)
+#endif
+
+/**
+ * In debug builds, the number of allocations between sanity checks of the
+ * entire state of a memory space.  Used only if `MStateSanitySamples` is
+ * zero.
+ */
 constexpr size_t MStateSanityInterval = 128;
+
+/**
+ * In debug builds, the number of chunks to sanity check on each allocation
+ * and free, or zero to check the entire state every `MStateSanityInterval`
+ * allocations instead.  Sampling bounds the cost of each operation, so that
+ * the timing of debug builds stays representative, while still covering the
+ * heap over time.
+ */
+constexpr size_t MStateSanitySamples =
+#ifdef CHERIOT_ALLOCATOR_SANITY_SAMPLES
+  CHERIOT_ALLOCATOR_SANITY_SAMPLES
+#else
+  0
 #endif
+  ;
 
 constexpr size_t MallocAlignShift = 3;
 
 constexpr size_t MallocAlignment = 1U << MallocAlignShift;
 constexpr size_t MallocAlignMask = MallocAlignment - 1;
 
+/**
+ * Is the size-class cache enabled?  When enabled, small chunks that have
+ * finished quarantine are kept on per-size rings so that allocations of common
+ * small sizes can be satisfied without searching the free bins.
+ */
+constexpr bool SizeClassCacheEnabled =
+#ifdef CHERIOT_ALLOCATOR_SIZE_CLASS_CACHE
+  CHERIOT_ALLOCATOR_SIZE_CLASS_CACHE
+#else
+  false
+#endif
+  ;
+
+/**
+ * Is statistics collection enabled?  When enabled, the allocator counts
+ * allocation sizes, bin hits and misses, and time spent holding its lock, and
+ * reports them via `heap_statistics`.
+ */
+constexpr bool StatisticsEnabled =
+#ifdef CHERIOT_ALLOCATOR_STATISTICS
+  CHERIOT_ALLOCATOR_STATISTICS
+#else
+  false
+#endif
+  ;
+
+/**
+ * Should the hardware revoker sweep only the regions of memory that can hold
+ * capabilities (stacks, globals and static objects, and the heap), one after
+ * another, rather than a single range?  Ignored for revokers that cannot be
+ * given a range.
+ */
+constexpr bool HardwareRevokerRegions =
+#ifdef CHERIOT_HARDWARE_REVOKER_REGIONS
+  CHERIOT_HARDWARE_REVOKER_REGIONS
+#else
+  false
+#endif
+  ;
+
+/**
+ * The number of bytes that the hardware revoker sweeps at a time when there
+ * is little memory pressure, or zero to always sweep at full speed.  Ignored
+ * for revokers that cannot be given a range.
+ */
+constexpr size_t HardwareRevokerGentleChunk =
+#ifdef CHERIOT_HARDWARE_REVOKER_GENTLE_CHUNK
+  CHERIOT_HARDWARE_REVOKER_GENTLE_CHUNK
+#else
+  0
+#endif
+  ;
+
+/**
+ * The number of entries in the hashed claim index, or zero to disable it.
+ * When enabled, claims are found in constant time rather than by walking the
+ * claimed object's list of claims.  Must be a power of two.
+ */
+constexpr size_t ClaimIndexSize =
+#ifdef CHERIOT_ALLOCATOR_CLAIM_INDEX_SIZE
+  CHERIOT_ALLOCATOR_CLAIM_INDEX_SIZE
+#else
+  0
+#endif
+  ;
+
+/**
+ * The number of entries in the owner index, or zero to disable it.  When
+ * enabled, each allocator capability has a list of the chunks that it owns, so
+ * `heap_free_all` visits only those chunks rather than walking the whole heap.
+ * Must be a power of two.
+ */
+constexpr size_t OwnerIndexSize =
+#ifdef CHERIOT_ALLOCATOR_OWNER_INDEX_SIZE
+  CHERIOT_ALLOCATOR_OWNER_INDEX_SIZE
+#else
+  0
+#endif
+  ;
+
+/**
+ * Is lazy zeroing enabled?  When enabled, the loader does not zero the heap at
+ * boot and each memory space zeroes its memory as it is first allocated.
+ */
+constexpr bool LazyZeroing =
+#ifdef CHERIOT_ALLOCATOR_LAZY_ZERO
+  true
+#else
+  false
+#endif
+  ;
+
+/**
+ * Is allocation-site profiling enabled?  When enabled, the allocator records
+ * the call-site identifier passed in the allocation flags for each live
+ * allocation and `heap_profile_dump` reports the live heap.
+ */
+constexpr bool ProfilingEnabled =
+#ifdef CHERIOT_ALLOCATOR_PROFILING
+  true
+#else
+  false
+#endif
+  ;
+
+/**
+ * The number of live allocations whose call site can be recorded when
+ * profiling is enabled.  Allocations beyond this are reported with an unknown
+ * site.  Must be a power of two.
+ */
+constexpr size_t ProfilingIndexSize = ProfilingEnabled ? 256 : 0;
+
 constexpr StackCheckMode StackMode =
 #if CHERIOT_STACK_CHECKS_ALLOCATOR
   StackCheckMode::Asserting
@@ -4,10 +4,12 @@
 #include "alloc.h"
 #include "revoker.h"
 #include "token.h"
+#include <array>
 #include <compartment.h>
 #include <errno.h>
 #include <futex.h>
 #include <locks.hh>
+#include <pgo.h>
 #include <priv/riscv.h>
 #include <riscvreg.h>
 #include <stdint.h>
@@ -46,8 +48,25 @@ namespace
 		size_t quota;
 		/// A unique identifier for this pool.
 		uint16_t identifier;
+		/// The preferred heap region, one of `HeapRegion`.
+		uint16_t region;
+		/**
+		 * The first of this capability's entries in the owner index (encoded
+		 * as a slot number plus one), or zero if it has none.
+		 */
+		uint16_t ownedHead;
+		/**
+		 * The number of chunks owned by this capability that are not in the
+		 * owner index.
+		 */
+		uint16_t ownedUnindexed;
+		/// The number of live claim objects allocated with this capability.
+		uint16_t claimsHeld;
 	};
 
+	static_assert(offsetof(PrivateAllocatorCapabilityState, region) ==
+	              offsetof(AllocatorCapabilityState, region));
+
 	static_assert(sizeof(PrivateAllocatorCapabilityState) <=
 	              sizeof(AllocatorCapabilityState));
 	static_assert(alignof(PrivateAllocatorCapabilityState) <=
@@ -56,13 +75,189 @@ namespace
 	// the global memory space
 	MState *gm;
 
+#ifdef CHERIOT_HEAP_FAST_END
+	/**
+	 * The memory space for the fast region of the heap, below
+	 * `CHERIOT_HEAP_FAST_END`, or null if too little of that region is left
+	 * after the firmware image.  This is used only by allocator capabilities
+	 * that prefer fast memory.
+	 */
+	MState *fastGM;
+#endif
+
+#ifdef CHERIOT_ALLOCATOR_LARGE_REGION_SIZE
+	/**
+	 * The memory space for large objects, carved from the top of the heap, or
+	 * null if the heap is too small to hold it.  Allocations of at least
+	 * `LargeObjectThreshold` bytes try this first, so that large buffers do
+	 * not fragment the memory used for small objects.
+	 */
+	MState *largeGM;
+
+	/**
+	 * The smallest allocation that is placed in the large-object region.
+	 */
+	constexpr size_t LargeObjectThreshold =
+	  CHERIOT_ALLOCATOR_LARGE_OBJECT_THRESHOLD;
+
+	/**
+	 * The granularity of allocations in the large-object region.  Rounding
+	 * large requests up to a multiple of this means that the chunks they
+	 * leave behind when freed can be reused by other large requests without
+	 * leaving slivers between them.
+	 */
+	constexpr size_t LargeObjectGranule = 512;
+#endif
+
+	/// The number of memory spaces that the heap may be divided into.
+	constexpr size_t MemorySpaces = 1
+#ifdef CHERIOT_HEAP_FAST_END
+	                                + 1
+#endif
+#ifdef CHERIOT_ALLOCATOR_LARGE_REGION_SIZE
+	                                + 1
+#endif
+	  ;
+
+	/**
+	 * Returns all of the memory spaces, starting with the default one.
+	 * Entries for regions that are not in use are null.
+	 */
+	std::array<MState *, MemorySpaces> memory_spaces()
+	{
+		return {gm,
+#ifdef CHERIOT_HEAP_FAST_END
+		        fastGM,
+#endif
+#ifdef CHERIOT_ALLOCATOR_LARGE_REGION_SIZE
+		        largeGM,
+#endif
+		};
+	}
+
+	/**
+	 * Returns the memory space that manages `address`, which must be in the
+	 * heap.
+	 */
+	MState *mstate_for(ptraddr_t address)
+	{
+#ifdef CHERIOT_HEAP_FAST_END
+		// The fast region is below the default one.
+		if ((fastGM != nullptr) && (address < gm->heapStart.base()))
+		{
+			return fastGM;
+		}
+#endif
+#ifdef CHERIOT_ALLOCATOR_LARGE_REGION_SIZE
+		// The large-object region is above the default one.
+		if ((largeGM != nullptr) && (address >= largeGM->heapStart.base()))
+		{
+			return largeGM;
+		}
+#endif
+		return gm;
+	}
+
+	/**
+	 * Returns the lowest address in any memory space that can hold a chunk.
+	 * Chunk addresses are encoded relative to this.
+	 */
+	ptraddr_t heap_encoding_base()
+	{
+#ifdef CHERIOT_HEAP_FAST_END
+		if (fastGM != nullptr)
+		{
+			return fastGM->heapStart.address();
+		}
+#endif
+		return gm->heapStart.address();
+	}
+
+	/// Returns the number of free bytes in all memory spaces.
+	size_t heap_free_size()
+	{
+		size_t freeSize = 0;
+		for (MState *space : memory_spaces())
+		{
+			if (space != nullptr)
+			{
+				freeSize += space->heapFreeSize;
+			}
+		}
+		return freeSize;
+	}
+
+	/**
+	 * Returns the number of bytes that are free or in quarantine in all
+	 * memory spaces, an upper bound on what can be allocated once the
+	 * quarantine has drained.
+	 */
+	size_t heap_reclaimable_size()
+	{
+		size_t size = 0;
+		for (MState *space : memory_spaces())
+		{
+			if (space != nullptr)
+			{
+				size += space->heapFreeSize + space->heapQuarantineSize;
+			}
+		}
+		return size;
+	}
+
+	/**
+	 * Wrapper around a lock that publishes the free size of the heap in the
+	 * `allocator_free_bytes` shared object each time that the lock is
+	 * released, so that `heap_available_fast` can read it without calling
+	 * into the allocator.  This exposes the same interface as the wrapped
+	 * lock, so it can be used with `LockGuard`.
+	 */
+	template<typename Lock>
+	class PublishingLock
+	{
+		/// The underlying lock.
+		Lock wrappedLock;
+
+		public:
+		/// Acquire the lock, blocking indefinitely.
+		void lock()
+		{
+			wrappedLock.lock();
+		}
+
+		/// Try to acquire the lock, blocking until `timeout` expires.
+		bool try_lock(Timeout *timeout)
+		{
+			return wrappedLock.try_lock(timeout);
+		}
+
+		/// Publish the free size and release the lock.
+		void unlock()
+		{
+			*SHARED_OBJECT_WITH_PERMISSIONS(
+			  size_t, allocator_free_bytes, true, true, false, false) =
+			  heap_free_size();
+			wrappedLock.unlock();
+		}
+
+		/// Returns the underlying lock.
+		Lock &wrapped()
+		{
+			return wrappedLock;
+		}
+	};
+
 	/**
 	 * A global lock for the allocator.  This is acquired in public API
 	 * functions, all internal functions should assume that it is held. If
 	 * allocation fails for transient reasons then the lock will be dropped and
-	 * reacquired over the yield.
+	 * reacquired over the yield.  When statistics are enabled, the lock also
+	 * records how long it is held.
 	 */
-	FlagLockPriorityInherited lock;
+	PublishingLock<std::conditional_t<StatisticsEnabled,
+	                                  TimedLock<FlagLockPriorityInherited>,
+	                                  FlagLockPriorityInherited>>
+	  lock;
 
 	/**
 	 * @brief Take a memory region and initialise a memory space for it. The
@@ -96,18 +291,35 @@ namespace
 			return nullptr;
 		}
 
-		Capability m{tbase.cast<MState>()};
-
 		size_t hazardQuarantineSize =
 		  Capability{
 		    SHARED_OBJECT_WITH_PERMISSIONS(
 		      void *, allocator_hazard_pointers, true, false, true, false)}
 		    .length();
 
+		if constexpr (LazyZeroing)
+		{
+			// The loader has not zeroed the heap, but the memory-space
+			// metadata and the hazard quarantine must start out zero.  The
+			// barrier stops the compiler from turning this into a call to
+			// `memset`.
+			void **word = tbase.cast<void *>().get();
+			for (size_t i = 0;
+			     i < (msize + hazardQuarantineSize) / sizeof(void *);
+			     i++)
+			{
+				word[i] = nullptr;
+				asm volatile("" ::: "memory");
+			}
+		}
+
+		Capability m{tbase.cast<MState>()};
+
 		m.bounds()            = sizeof(*m);
 		m->heapStart          = tbase;
 		m->heapStart.bounds() = tsize;
 		m->heapStart.address() += msize + hazardQuarantineSize;
+		m->zeroedTop = m->heapStart.address() + sizeof(MChunkHeader);
 		m->init_bins();
 
 		// Carve off the front of the heap space to use for the hazard
@@ -124,6 +336,25 @@ namespace
 		return m;
 	}
 
+	/**
+	 * Returns the address at or below `split` at which `heap` can be divided
+	 * into two memory spaces.  The split point is rounded down until both
+	 * halves have representable bounds.
+	 */
+	[[maybe_unused]] ptraddr_t heap_split_point(Capability<void> heap,
+	                                            ptraddr_t        split)
+	{
+		split &= ~MallocAlignMask;
+		ptraddr_t previous;
+		do
+		{
+			previous = split;
+			split &= representable_alignment_mask(heap.top() - split);
+			split &= representable_alignment_mask(split - heap.base());
+		} while (split != previous);
+		return split;
+	}
+
 	void check_gm()
 	{
 		if (gm == nullptr)
@@ -137,16 +368,167 @@ namespace
 			                                   /*loadMutable*/ true));
 
 			revoker.init();
+#ifdef CHERIOT_HEAP_FAST_END
+			// Give the heap below the end of fast memory its own memory
+			// space.
+			ptraddr_t fastEnd = heap_split_point(heap, CHERIOT_HEAP_FAST_END);
+			if ((fastEnd > heap.base()) && (fastEnd < heap.top()))
+			{
+				Capability fast = heap;
+				fast.bounds() = fastEnd - heap.base();
+				fastGM = mstate_init(fast, fast.bounds());
+				if (fastGM != nullptr)
+				{
+					ptraddr_t top  = heap.top();
+					heap.address() = fastEnd;
+					heap.bounds()  = top - fastEnd;
+				}
+			}
+#endif
+#ifdef CHERIOT_ALLOCATOR_LARGE_REGION_SIZE
+			// Give the top of the heap its own memory space for large
+			// objects.
+			if (heap.length() > CHERIOT_ALLOCATOR_LARGE_REGION_SIZE)
+			{
+				ptraddr_t largeStart = heap_split_point(
+				  heap, heap.top() - CHERIOT_ALLOCATOR_LARGE_REGION_SIZE);
+				if ((largeStart > heap.base()) && (largeStart < heap.top()))
+				{
+					Capability large = heap;
+					large.address()  = largeStart;
+					large.bounds()   = heap.top() - largeStart;
+					largeGM          = mstate_init(large, large.bounds());
+					if (largeGM != nullptr)
+					{
+						heap.bounds() = largeStart - heap.base();
+					}
+				}
+			}
+#endif
 			gm = mstate_init(heap, heap.bounds());
 			Debug::Assert(gm != nullptr, "gm should not be null");
 		}
 	}
 
 	/**
-	 * Futex value to allow a thread to wait for another thread to free an
-	 * object.
+	 * A thread that is blocked in `malloc_internal` waiting for memory to be
+	 * freed.  Each waiter lives on the stack of its thread and is linked into
+	 * `allocationWaiters` while the heap lock is held.
+	 */
+	struct AllocationWaiter
+	{
+		/// The next waiter, in the order in which they will be woken.
+		AllocationWaiter *next;
+		/// The capability whose quota the allocation is charged to.
+		PrivateAllocatorCapabilityState *capability;
+		/// The number of bytes requested.
+		size_t bytes;
+		/// The priority of the waiting thread when it started waiting.
+		int priority;
+		/// Futex word, set to 1 when the waiter is woken.
+		cheriot::atomic<uint32_t> woken;
+	};
+
+	/**
+	 * Threads waiting for memory, highest priority first and, within a
+	 * priority, smallest request first (and then in arrival order).  Frees
+	 * wake only the waiters whose requests may now fit, rather than every
+	 * blocked thread.  Protected by the heap lock.
+	 */
+	AllocationWaiter *allocationWaiters;
+
+	/**
+	 * Add `waiter` to `allocationWaiters`.  Called with the heap lock held.
+	 */
+	void allocation_waiter_insert(AllocationWaiter &waiter)
+	{
+		AllocationWaiter **link = &allocationWaiters;
+		while ((*link != nullptr) &&
+		       (((*link)->priority > waiter.priority) ||
+		        (((*link)->priority == waiter.priority) &&
+		         ((*link)->bytes <= waiter.bytes))))
+		{
+			link = &(*link)->next;
+		}
+		waiter.next = *link;
+		*link       = &waiter;
+	}
+
+	/**
+	 * Remove `waiter` from `allocationWaiters` if it has not already been
+	 * removed by `allocation_waiters_wake`.  Called with the heap lock held.
+	 */
+	void allocation_waiter_remove(AllocationWaiter &waiter)
+	{
+		for (AllocationWaiter **link = &allocationWaiters; *link != nullptr;
+		     link                    = &(*link)->next)
+		{
+			if (*link == &waiter)
+			{
+				*link = waiter.next;
+				return;
+			}
+		}
+	}
+
+	/**
+	 * Wake the threads blocked in `malloc_internal` whose requests may now
+	 * be satisfied, in priority order.  Each woken request is deducted from
+	 * the memory that is considered available, so a free wakes only as many
+	 * waiters as it could satisfy.  Called with the heap lock held, after
+	 * memory has been freed.
+	 */
+	void allocation_waiters_wake()
+	{
+		if (allocationWaiters == nullptr)
+		{
+			return;
+		}
+		size_t available = heap_reclaimable_size();
+		for (AllocationWaiter **link = &allocationWaiters; *link != nullptr;)
+		{
+			AllocationWaiter *waiter = *link;
+			if ((waiter->bytes > available) ||
+			    (waiter->bytes > waiter->capability->quota))
+			{
+				link = &waiter->next;
+				continue;
+			}
+			Debug::log("Waking thread blocked on a {}-byte allocation",
+			           waiter->bytes);
+			available -= waiter->bytes;
+			*link         = waiter->next;
+			waiter->woken = 1;
+			waiter->woken.notify_one();
+		}
+	}
+
+	/**
+	 * Run the quarantine bookkeeping owed for `frees` objects that have just
+	 * been freed, then wake any threads blocked allocating memory that can now
+	 * succeed.  Called with the heap lock held by `g`.
+	 *
+	 * The lock is dropped and reacquired before each round of bookkeeping.  The
+	 * lock inherits priority, so a higher-priority thread that is waiting to
+	 * allocate runs between rounds rather than behind all of them, and the
+	 * longest critical section is a single free or a single round.
 	 */
-	cheriot::atomic<int32_t> freeFutex = -1;
+	void quarantine_maintain(LockGuard<decltype(lock)> &g, size_t frees = 1)
+	{
+		for (size_t i = 0; i < frees; i++)
+		{
+			g.unlock();
+			g.lock();
+			for (MState *space : memory_spaces())
+			{
+				if (space != nullptr)
+				{
+					space->quarantine_maintain();
+				}
+			}
+		}
+		allocation_waiters_wake();
+	}
 
 	/**
 	 * Helper that returns true if the timeout value permits sleeping.
@@ -233,6 +615,304 @@ namespace
 		return true;
 	}
 
+	/**
+	 * Encode the address of a chunk header as a shifted offset from the start
+	 * of the heap, for use as a claim or allocation-site index key.
+	 */
+	uint16_t chunk_encode(MChunkHeader &chunk)
+	{
+		return (Capability{&chunk}.address() - heap_encoding_base()) >>
+		       MallocAlignShift;
+	}
+
+	/**
+	 * Hashed index from live allocations to the allocation-site identifier
+	 * that was passed when they were allocated.  This is used only when
+	 * profiling is enabled.  Allocations with an unknown site, or that do not
+	 * fit in the index, are not recorded.
+	 */
+	class AllocationSiteIndex
+	{
+		/**
+		 * An index entry.  `chunk` is an encoded chunk address.  An entry with
+		 * a zero `site` is empty.
+		 */
+		struct Entry
+		{
+			uint16_t chunk;
+			uint16_t site;
+		};
+
+		/// The number of consecutive slots searched for each key.
+		static constexpr size_t ProbeWindow =
+		  std::min<size_t>(4, ProfilingIndexSize);
+
+		/// The index storage.
+		Entry entries[ProfilingIndexSize > 0 ? ProfilingIndexSize : 1];
+
+		/// Call `f` for each entry in the window for the given key.
+		template<typename F>
+		bool window_search(uint16_t chunk, F f)
+		{
+			size_t first = (chunk * 0x9e37U) & (ProfilingIndexSize - 1);
+			for (size_t i = 0; i < ProbeWindow; i++)
+			{
+				if (f(entries[(first + i) & (ProfilingIndexSize - 1)]))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		public:
+		static_assert((ProfilingIndexSize & (ProfilingIndexSize - 1)) == 0,
+		              "Profiling index size must be a power of two");
+
+		/// Returns the site recorded for `chunk`, or zero if it is unknown.
+		uint16_t find(uint16_t chunk)
+		{
+			uint16_t site = 0;
+			window_search(chunk, [&](Entry &entry) {
+				if ((entry.site != 0) && (entry.chunk == chunk))
+				{
+					site = entry.site;
+					return true;
+				}
+				return false;
+			});
+			return site;
+		}
+
+		/// Record that `chunk` was allocated from `site`.
+		void insert(uint16_t chunk, uint16_t site)
+		{
+			window_search(chunk, [&](Entry &entry) {
+				if (entry.site == 0)
+				{
+					entry = {chunk, site};
+					return true;
+				}
+				return false;
+			});
+		}
+
+		/// Forget `chunk`, which is being freed.
+		void remove(uint16_t chunk)
+		{
+			window_search(chunk, [&](Entry &entry) {
+				if ((entry.site != 0) && (entry.chunk == chunk))
+				{
+					entry.site = 0;
+					return true;
+				}
+				return false;
+			});
+		}
+	};
+
+	/**
+	 * The global allocation-site index, if profiling is enabled.
+	 */
+	AllocationSiteIndex allocationSites;
+
+	/**
+	 * Returns the chunk header whose address `chunk_encode` encoded as
+	 * `encoded`.
+	 */
+	MChunkHeader &chunk_decode(uint16_t encoded)
+	{
+		ptraddr_t address =
+		  heap_encoding_base() + (ptraddr_t(encoded) << MallocAlignShift);
+		Capability<MChunkHeader> chunk{
+		  mstate_for(address)->heapStart.cast<MChunkHeader>()};
+		chunk.address() = address;
+		return *chunk;
+	}
+
+	/**
+	 * Optional index of the chunks owned by each allocator capability.  Each
+	 * chunk hashes to a window of `ProbeWindow` slots and is recorded in any
+	 * free slot in its window.  The entries for each capability form a doubly
+	 * linked list whose head is in the capability.  Chunks that do not fit
+	 * are counted in the capability's `ownedUnindexed` and `heap_free_all`
+	 * falls back to walking the whole heap for that capability.
+	 */
+	class OwnerIndex
+	{
+		/**
+		 * An index entry.  `chunk` is an encoded chunk address, `next` and
+		 * `prev` are slot numbers plus one, or zero at the ends of the list.
+		 * An entry with a zero `owner` is empty.
+		 */
+		struct Entry
+		{
+			uint16_t chunk;
+			uint16_t owner;
+			uint16_t next;
+			uint16_t prev;
+		};
+
+		/// The number of consecutive slots searched for each key.
+		static constexpr size_t ProbeWindow =
+		  std::min<size_t>(4, OwnerIndexSize);
+
+		/// The index storage.
+		Entry entries[OwnerIndexSize > 0 ? OwnerIndexSize : 1];
+
+		/// Returns the entry for a slot number plus one.
+		Entry &entry(uint16_t slot)
+		{
+			return entries[slot - 1];
+		}
+
+		/**
+		 * Returns the slot number plus one of the first entry in the window
+		 * for `chunk` for which `f` returns true, or zero if there is none.
+		 */
+		template<typename F>
+		uint16_t window_search(uint16_t chunk, F f)
+		{
+			size_t first = (chunk * 0x9e37U) & (OwnerIndexSize - 1);
+			for (size_t i = 0; i < ProbeWindow; i++)
+			{
+				size_t slot = (first + i) & (OwnerIndexSize - 1);
+				if (f(entries[slot]))
+				{
+					return slot + 1;
+				}
+			}
+			return 0;
+		}
+
+		public:
+		/// Is the index enabled in this build?
+		static constexpr bool Enabled = OwnerIndexSize > 0;
+		static_assert((OwnerIndexSize & (OwnerIndexSize - 1)) == 0,
+		              "Owner index size must be a power of two");
+		static_assert(OwnerIndexSize < std::numeric_limits<uint16_t>::max(),
+		              "Owner index slot numbers must fit in 16 bits");
+
+		/// Record that `owner` now owns the chunk encoded as `chunk`.
+		void insert(PrivateAllocatorCapabilityState &owner, uint16_t chunk)
+		{
+			uint16_t slot = window_search(
+			  chunk, [](Entry &entry) { return entry.owner == 0; });
+			if (slot == 0)
+			{
+				owner.ownedUnindexed++;
+				return;
+			}
+			entry(slot) = {chunk, owner.identifier, owner.ownedHead, 0};
+			if (owner.ownedHead != 0)
+			{
+				entry(owner.ownedHead).prev = slot;
+			}
+			owner.ownedHead = slot;
+		}
+
+		/// Forget the chunk encoded as `chunk`, which `owner` no longer owns.
+		void remove(PrivateAllocatorCapabilityState &owner, uint16_t chunk)
+		{
+			uint16_t slot = window_search(chunk, [&](Entry &entry) {
+				return (entry.owner == owner.identifier) &&
+				       (entry.chunk == chunk);
+			});
+			if (slot == 0)
+			{
+				owner.ownedUnindexed--;
+				return;
+			}
+			Entry &removed = entry(slot);
+			if (removed.prev != 0)
+			{
+				entry(removed.prev).next = removed.next;
+			}
+			else
+			{
+				owner.ownedHead = removed.next;
+			}
+			if (removed.next != 0)
+			{
+				entry(removed.next).prev = removed.prev;
+			}
+			removed.owner = 0;
+		}
+
+		/**
+		 * Call `f` with each indexed chunk that `owner` owns.  `f` may remove
+		 * the chunk that it is called with from the index.
+		 */
+		template<typename F>
+		void for_each(PrivateAllocatorCapabilityState &owner, F f)
+		{
+			for (uint16_t slot = owner.ownedHead; slot != 0;)
+			{
+				Entry &current = entry(slot);
+				slot           = current.next;
+				f(chunk_decode(current.chunk));
+			}
+		}
+	};
+
+	/**
+	 * The global owner index, if enabled.
+	 */
+	OwnerIndex ownerIndex;
+
+	/**
+	 * Allocate `bytes` bytes in the memory spaces that `capability` may use.
+	 * Large objects try the large-object region (if there is one) first.
+	 * Capabilities that prefer fast memory then try the fast region, falling
+	 * back to the default region, which is the only one used by others.
+	 * A non-zero `alignment` is passed to `MState::mspace_dispatch`.
+	 * Returns the result from the last memory space that was tried, along
+	 * with that memory space.
+	 */
+	std::pair<MState::AllocationResult, MState *>
+	mspace_dispatch(size_t                           bytes,
+	                PrivateAllocatorCapabilityState *capability,
+	                bool                             isSealedAllocation,
+	                size_t                           alignment = 0)
+	{
+#ifdef CHERIOT_ALLOCATOR_LARGE_REGION_SIZE
+		if ((largeGM != nullptr) && (bytes >= LargeObjectThreshold))
+		{
+			size_t rounded = (bytes + LargeObjectGranule - 1) &
+			                 ~(LargeObjectGranule - 1);
+			auto   ret     = largeGM->mspace_dispatch(rounded,
+			                                          capability->quota,
+			                                          capability->identifier,
+			                                          isSealedAllocation,
+			                                          alignment);
+			if (std::holds_alternative<Capability<void>>(ret))
+			{
+				return {ret, largeGM};
+			}
+		}
+#endif
+#ifdef CHERIOT_HEAP_FAST_END
+		if ((capability->region == HeapRegionFast) && (fastGM != nullptr))
+		{
+			auto ret = fastGM->mspace_dispatch(bytes,
+			                                   capability->quota,
+			                                   capability->identifier,
+			                                   isSealedAllocation,
+			                                   alignment);
+			if (std::holds_alternative<Capability<void>>(ret))
+			{
+				return {ret, fastGM};
+			}
+		}
+#endif
+		return {gm->mspace_dispatch(bytes,
+		                            capability->quota,
+		                            capability->identifier,
+		                            isSealedAllocation,
+		                            alignment),
+		        gm};
+	}
+
 	/**
 	 * Malloc implementation.  Allocates `bytes` bytes of memory.  If `timeout`
 	 * is greater than zero, may block for that many ticks.  If `timeout` is the
@@ -247,25 +927,46 @@ namespace
 	 *
 	 * If `isSealedAllocation` is true, then the allocation is marked as sealed
 	 * and excluded during `heap_free_all`.
+	 *
+	 * If `alignment` is non-zero, the allocation is aligned to at least that
+	 * many bytes.
 	 */
 	void *malloc_internal(size_t                           bytes,
 	                      LockGuard<decltype(lock)>      &&g,
 	                      PrivateAllocatorCapabilityState *capability,
 	                      Timeout                         *timeout,
 	                      bool     isSealedAllocation = false,
-	                      uint32_t flags              = AllocateWaitAny)
+	                      uint32_t flags              = AllocateWaitAny,
+	                      size_t   alignment          = 0)
 	{
 		check_gm();
+		// The upper bits of the flags carry the allocation site.
+		uint16_t site = flags >> HEAP_ALLOCATION_SITE_SHIFT;
+		flags &= AllocateWaitAny;
 
 		do
 		{
-			auto ret = gm->mspace_dispatch(bytes,
-			                               capability->quota,
-			                               capability->identifier,
-			                               isSealedAllocation);
+			auto [ret, space] =
+			  mspace_dispatch(bytes, capability, isSealedAllocation, alignment);
 			if (std::holds_alternative<Capability<void>>(ret))
 			{
-				return std::get<Capability<void>>(ret);
+				Capability<void> allocation = std::get<Capability<void>>(ret);
+				if constexpr (OwnerIndex::Enabled)
+				{
+					ownerIndex.insert(
+					  *capability,
+					  chunk_encode(*MChunkHeader::from_body(allocation)));
+				}
+				if constexpr (ProfilingEnabled)
+				{
+					if (site != 0)
+					{
+						allocationSites.insert(
+						  chunk_encode(*MChunkHeader::from_body(allocation)),
+						  site);
+					}
+				}
+				return allocation;
 			}
 			// If the call is non-blocking (`flags` is
 			// `AllocateWaitNone`, or `timeout` is 0), fail now.
@@ -294,18 +995,27 @@ namespace
 				// presently, consolidate chunks in quarantine and each chunk
 				// requires individual attention to merge back into the free
 				// pool (and consolidate with neighbors), and each round here
-				// moves at most O(1) chunks out of quarantine.
-				if (!gm->quarantine_dequeue())
+				// moves at most O(1) chunks out of quarantine.  Passing the
+				// size lets large requests reclaim the largest safe chunks
+				// first and start revocation early if it will be needed.
+				if (!space->quarantine_dequeue(bytes))
 				{
 					Debug::log("Quarantine has enough memory to satisfy "
 					           "allocation, kicking revoker");
 
 					revoker.system_bg_revoker_kick();
 
-					if constexpr (Revocation::Revoker::IsAsynchronous)
+					// Revokers that can notify us of completion let us sleep
+					// until the epoch passes rather than polling.
+					if constexpr (Revocation::Revoker::IsAsynchronous ||
+					              Revocation::SupportsInterruptNotification<
+					                Revocation::Revoker>)
 					{
-						wait_for_background_revoker(
-						  timeout, needsRevocation->waitingEpoch, g);
+						if (!wait_for_background_revoker(
+						      timeout, needsRevocation->waitingEpoch, g))
+						{
+							return nullptr;
+						}
 					}
 					else
 					{
@@ -345,27 +1055,33 @@ namespace
 				Debug::log("Not enough free space to handle {}-byte "
 				           "allocation, sleeping",
 				           bytes);
-				// Use the current free space as the sleep futex value.  This
-				// means that the `wait` call will fail if the amount of free
-				// memory changes between dropping the lock and waiting, unless
-				// a matched number of allocations and frees happen (in which
-				// case, we're happy to sleep because we still can't manage
-				// this allocation).
-				auto expected = gm->heapFreeSize;
-				freeFutex     = expected;
+				// Join the wait list while holding the lock, so that a free
+				// between dropping the lock and waiting sets `woken` and the
+				// wait returns immediately.
+				AllocationWaiter waiter{
+				  nullptr, capability, bytes, thread_priority_get(), 0};
+				allocation_waiter_insert(waiter);
 				// If there are things on the hazard list, wake after one tick
 				// and see if they have gone away.  Otherwise, wait until we
 				// have some newly freed objects.
-				Timeout t{gm->hazard_quarantine_is_empty() ? timeout->remaining
-				                                           : 1};
+				Timeout t{space->hazard_quarantine_is_empty()
+				            ? timeout->remaining
+				            : 1};
 				// Drop the lock while yielding
 				g.unlock();
-				freeFutex.wait(&t, expected);
+				waiter.woken.wait(&t, 0);
 				timeout->elapse(t.elapsed);
 				Debug::log("Woke from futex wake");
-				if (!reacquire_lock(timeout, g))
+				// The waiter must be off the list before this frame is
+				// popped, so take the lock even if the timeout has expired.
+				// Frees hold it only briefly.
+				g.lock();
+				allocation_waiter_remove(waiter);
+				// Objects whose hazards have been dropped are released only by
+				// quarantine maintenance, so run it before retrying.
+				if (!space->hazard_quarantine_is_empty())
 				{
-					return nullptr;
+					space->quarantine_maintain();
 				}
 				continue;
 			}
@@ -421,26 +1137,29 @@ namespace
 		 * heap.
 		 */
 		uint16_t encodedNext = 0;
+		/**
+		 * Previous 'pointer', encoded in the same way as `encodedNext`.  Zero
+		 * indicates that this is the first claim on the chunk.  This allows a
+		 * claim found via the claim index to be unlinked without walking the
+		 * list.
+		 */
+		uint16_t encodedPrev = 0;
 		/**
 		 * Saturating reference count.  We use one to indicate a single
 		 * reference count rather than zero to slightly simplify the logic at
 		 * the expense of saturating one increment earlier than we need to.  It
 		 * is highly unlikely that any vaguely sensible code will ever
-		 * encounter the saturation case, so this is unlikely to be a problem.
-		 * It might become one if we ever move to using a 16-bit reference
-		 * count (which would require a different allocation path for claim
-		 * structures to make sense).
+		 * hold 65,534 claims on the same object from the same allocator
+		 * capability, so this is unlikely to be a problem.  Saturated claims
+		 * are never dropped.
 		 */
-		uint32_t referenceCount = 1;
+		uint16_t referenceCount = 1;
 
 		/**
 		 * Private constructor, creates a new claim with a single reference
 		 * count.
 		 */
-		Claim(uint16_t identifier, uint16_t nextClaim)
-		  : allocatorIdentifier(identifier), encodedNext(nextClaim)
-		{
-		}
+		Claim(uint16_t identifier) : allocatorIdentifier(identifier) {}
 
 		/**
 		 * Destructor is private, claims should always be destroyed via
@@ -557,8 +1276,7 @@ namespace
 		 * Returns a pointer to the new allocation on success, nullptr on
 		 * failure.
 		 */
-		static Claim *create(PrivateAllocatorCapabilityState &capability,
-		                     uint16_t                         next)
+		static Claim *create(PrivateAllocatorCapabilityState &capability)
 		{
 			auto space = gm->mspace_dispatch(
 			  sizeof(Claim), capability.quota, capability.identifier);
@@ -567,7 +1285,41 @@ namespace
 				return nullptr;
 			}
 			return new (std::get<Capability<void>>(space))
-			  Claim(capability.identifier, next);
+			  Claim(capability.identifier);
+		}
+
+		/**
+		 * Insert `claim` at the head of the claims list for `chunk`.
+		 */
+		static void link(MChunkHeader &chunk, Claim *claim)
+		{
+			uint16_t encoded   = claim->encode_address();
+			claim->encodedNext = chunk.claims;
+			claim->encodedPrev = 0;
+			if (Claim *head = from_encoded_offset(chunk.claims))
+			{
+				head->encodedPrev = encoded;
+			}
+			chunk.claims = encoded;
+		}
+
+		/**
+		 * Remove `claim` from the claims list for `chunk`.
+		 */
+		static void unlink(MChunkHeader &chunk, Claim *claim)
+		{
+			if (Claim *prev = from_encoded_offset(claim->encodedPrev))
+			{
+				prev->encodedNext = claim->encodedNext;
+			}
+			else
+			{
+				chunk.claims = claim->encodedNext;
+			}
+			if (Claim *next = from_encoded_offset(claim->encodedNext))
+			{
+				next->encodedPrev = claim->encodedPrev;
+			}
 		}
 
 		/**
@@ -618,52 +1370,186 @@ namespace
 		 */
 		static Claim *from_encoded_offset(uint16_t offset)
 		{
-			if (offset == 0)
+			if (offset == 0)
+			{
+				return nullptr;
+			}
+			// Claims are always allocated in the default memory space.
+			Capability<Claim> ret{gm->heapStart.cast<Claim>()};
+			ret.address() = heap_encoding_base() + (offset << MallocAlignShift);
+			ret.bounds() = sizeof(Claim);
+			return ret;
+		}
+
+		/**
+		 * Encode the address of this object in a 16-bit value.
+		 */
+		uint16_t encode_address()
+		{
+			ptraddr_t address = Capability{this}.address();
+			address -= heap_encoding_base();
+			Debug::Assert((address & MallocAlignMask) == 0,
+			              "Claim at address {} is insufficiently aligned",
+			              address);
+			address >>= MallocAlignShift;
+			Debug::Assert(address <= std::numeric_limits<uint16_t>::max(),
+			              "Encoded claim address is too large: {}",
+			              address);
+			return address;
+		}
+	};
+	static_assert(sizeof(Claim) <= (1 << MallocAlignShift),
+	              "Claims should fit in the smallest possible allocation");
+
+	/**
+	 * Optional hashed index over all claims, keyed on the claimed chunk and
+	 * the claim's owner.  Each key hashes to a window of `ProbeWindow` slots
+	 * and a claim is recorded in any free slot in its window.  Claims that do
+	 * not fit are counted in `unindexed` and are found by walking the chunk's
+	 * claims list instead.  While every claim is indexed, lookups (including
+	 * those that find no claim) take constant time regardless of how many
+	 * compartments have claimed an object.
+	 */
+	class ClaimIndex
+	{
+		/**
+		 * An index entry.  Both fields are encoded as shifted offsets from the
+		 * start of the heap.  An entry with a zero `claim` is empty.
+		 */
+		struct Entry
+		{
+			uint16_t chunk;
+			uint16_t claim;
+		};
+
+		/// The number of consecutive slots searched for each key.
+		static constexpr size_t ProbeWindow = std::min<size_t>(4, ClaimIndexSize);
+
+		/// The index storage.
+		Entry entries[ClaimIndexSize > 0 ? ClaimIndexSize : 1];
+
+		/// The number of live claims that are not recorded in `entries`.
+		size_t unindexed = 0;
+
+		/// Returns the first slot in the window for a given key.
+		static size_t slot_for(uint16_t chunk, uint16_t owner)
+		{
+			return ((chunk * 0x9e37U) ^ owner) & (ClaimIndexSize - 1);
+		}
+
+		/// Call `f` for each entry in the window for the given key.
+		template<typename F>
+		bool window_search(uint16_t chunk, uint16_t owner, F f)
+		{
+			size_t first = slot_for(chunk, owner);
+			for (size_t i = 0; i < ProbeWindow; i++)
+			{
+				if (f(entries[(first + i) & (ClaimIndexSize - 1)]))
+				{
+					return true;
+				}
+			}
+			return false;
+		}
+
+		public:
+		/// Is the index enabled in this build?
+		static constexpr bool Enabled = ClaimIndexSize > 0;
+		static_assert((ClaimIndexSize & (ClaimIndexSize - 1)) == 0,
+		              "Claim index size must be a power of two");
+
+		/**
+		 * Look up the claim owned by `owner` on the chunk encoded as `chunk`.
+		 * Sets `complete` to true if a null result is authoritative (every
+		 * claim is indexed).
+		 */
+		Claim *find(uint16_t chunk, uint16_t owner, bool &complete)
+		{
+			Claim *found = nullptr;
+			window_search(chunk, owner, [&](Entry &entry) {
+				if ((entry.claim != 0) && (entry.chunk == chunk))
+				{
+					Claim *claim = Claim::from_encoded_offset(entry.claim);
+					if (claim->owner() == owner)
+					{
+						found = claim;
+						return true;
+					}
+				}
+				return false;
+			});
+			complete = (unindexed == 0);
+			return found;
+		}
+
+		/// Record a newly created claim on the chunk encoded as `chunk`.
+		void insert(uint16_t chunk, Claim *claim)
+		{
+			uint16_t encoded = claim->encode_address();
+			if (!window_search(chunk, claim->owner(), [&](Entry &entry) {
+				    if (entry.claim == 0)
+				    {
+					    entry = {chunk, encoded};
+					    return true;
+				    }
+				    return false;
+			    }))
 			{
-				return nullptr;
+				unindexed++;
 			}
-			Capability<Claim> ret{gm->heapStart.cast<Claim>()};
-			ret.address() += offset << MallocAlignShift;
-			ret.bounds() = sizeof(Claim);
-			return ret;
 		}
 
-		/**
-		 * Encode the address of this object in a 16-bit value.
-		 */
-		uint16_t encode_address()
+		/// Forget a claim that is about to be destroyed.
+		void remove(uint16_t chunk, Claim *claim)
 		{
-			ptraddr_t address = Capability{this}.address();
-			address -= gm->heapStart.address();
-			Debug::Assert((address & MallocAlignMask) == 0,
-			              "Claim at address {} is insufficiently aligned",
-			              address);
-			address >>= MallocAlignShift;
-			Debug::Assert(address <= std::numeric_limits<uint16_t>::max(),
-			              "Encoded claim address is too large: {}",
-			              address);
-			return address;
+			uint16_t encoded = claim->encode_address();
+			if (!window_search(chunk, claim->owner(), [&](Entry &entry) {
+				    if (entry.claim == encoded)
+				    {
+					    entry.claim = 0;
+					    return true;
+				    }
+				    return false;
+			    }))
+			{
+				unindexed--;
+			}
 		}
 	};
-	static_assert(sizeof(Claim) <= (1 << MallocAlignShift),
-	              "Claims should fit in the smallest possible allocation");
 
 	/**
-	 * Find a claim if one exists.  Returns a reference to the next pointer
-	 * that refers to this claim.
+	 * The global claim index, if enabled.
 	 */
-	std::pair<uint16_t &, Claim *> claim_find(uint16_t      owner,
-	                                          MChunkHeader &chunk)
+	ClaimIndex claimIndex;
+
+	/**
+	 * Find a claim if one exists.  Returns nullptr if `owner` holds no claim
+	 * on `chunk`.
+	 */
+	Claim *claim_find(uint16_t owner, MChunkHeader &chunk)
 	{
+		if (chunk.claims == 0)
+		{
+			return nullptr;
+		}
+		if constexpr (ClaimIndex::Enabled)
+		{
+			bool   complete;
+			Claim *claim = claimIndex.find(chunk_encode(chunk), owner, complete);
+			if ((claim != nullptr) || complete)
+			{
+				return claim;
+			}
+		}
 		for (Claim::Iterator i{&chunk.claims}, end; i != end; ++i)
 		{
 			Claim *claim = *i;
 			if (claim->owner() == owner)
 			{
-				return {*i.pointer(), claim};
+				return claim;
 			}
 		}
-		return {chunk.claims, nullptr};
+		return nullptr;
 	}
 
 	/**
@@ -673,7 +1559,7 @@ namespace
 	bool claim_add(PrivateAllocatorCapabilityState &owner, MChunkHeader &chunk)
 	{
 		Debug::log("Adding claim for {}", owner.identifier);
-		auto [next, claim] = claim_find(owner.identifier, chunk);
+		Claim *claim = claim_find(owner.identifier, chunk);
 		if (claim)
 		{
 			Debug::log("Adding second claim");
@@ -691,7 +1577,7 @@ namespace
 			}
 			owner.quota -= size;
 		}
-		claim = Claim::create(owner, next);
+		claim = Claim::create(owner);
 		if (claim != nullptr)
 		{
 			Debug::log("Allocated new claim");
@@ -701,8 +1587,22 @@ namespace
 			{
 				chunk.ownerID = 0;
 				claim->reference_add();
+				if constexpr (OwnerIndex::Enabled)
+				{
+					ownerIndex.remove(owner, chunk_encode(chunk));
+				}
+			}
+			if constexpr (OwnerIndex::Enabled)
+			{
+				ownerIndex.insert(owner,
+				                  chunk_encode(*MChunkHeader::from_body(claim)));
+				owner.claimsHeld++;
+			}
+			Claim::link(chunk, claim);
+			if constexpr (ClaimIndex::Enabled)
+			{
+				claimIndex.insert(chunk_encode(chunk), claim);
 			}
-			next = claim->encode_address();
 			return true;
 		}
 		// If we failed to allocate the claim object, undo adding this to our
@@ -727,7 +1627,7 @@ namespace
 	{
 		Debug::log(
 		  "Trying to drop claim with {} ({})", owner.identifier, &owner);
-		auto [next, claim] = claim_find(owner.identifier, chunk);
+		Claim *claim = claim_find(owner.identifier, chunk);
 		// If there is no claim, fail.
 		if (claim == nullptr)
 		{
@@ -741,7 +1641,17 @@ namespace
 		// away, destroy this claim structure.
 		if (claim->reference_remove())
 		{
-			next        = claim->encoded_next();
+			if constexpr (ClaimIndex::Enabled)
+			{
+				claimIndex.remove(chunk_encode(chunk), claim);
+			}
+			Claim::unlink(chunk, claim);
+			if constexpr (OwnerIndex::Enabled)
+			{
+				ownerIndex.remove(owner,
+				                  chunk_encode(*MChunkHeader::from_body(claim)));
+				owner.claimsHeld--;
+			}
 			size_t size = chunk.size_get();
 			owner.quota += size;
 			Claim::destroy(owner, claim);
@@ -752,6 +1662,25 @@ namespace
 		return true;
 	}
 
+	/**
+	 * Free a chunk that has no remaining owner or claims, forgetting its
+	 * allocation site.
+	 */
+	int chunk_free(MChunkHeader &chunk, size_t bodySize)
+	{
+		MState  *space   = mstate_for(Capability{&chunk}.address());
+		uint16_t encoded = chunk_encode(chunk);
+		int      ret     = space->mspace_free(chunk, bodySize);
+		if constexpr (ProfilingEnabled)
+		{
+			if (ret == 0)
+			{
+				allocationSites.remove(encoded);
+			}
+		}
+		return ret;
+	}
+
 	/**
 	 * Having found a chunk, try to free it with the provided owner.  The size
 	 * of the chunk is provided by the caller as `bodySize`.  If `isPrecise` is
@@ -779,9 +1708,13 @@ namespace
 			}
 			size_t chunkSize = chunk.size_get();
 			chunk.ownerID    = 0;
+			if constexpr (OwnerIndex::Enabled)
+			{
+				ownerIndex.remove(owner, chunk_encode(chunk));
+			}
 			if (chunk.claims == 0)
 			{
-				int ret = gm->mspace_free(chunk, bodySize);
+				int ret = chunk_free(chunk, bodySize);
 				// If free fails, don't manipulate the quota.
 				if (ret == 0)
 				{
@@ -801,7 +1734,7 @@ namespace
 		{
 			if ((chunk.claims == 0) && (chunk.ownerID == 0))
 			{
-				return gm->mspace_free(chunk, bodySize);
+				return chunk_free(chunk, bodySize);
 			}
 			return 0;
 		}
@@ -824,19 +1757,49 @@ namespace
 		}
 		check_gm();
 		// Find the chunk that corresponds to this allocation.
-		auto *chunk = gm->allocation_start(mem.address());
+		MState *space = mstate_for(mem.address());
+		auto   *chunk = space->allocation_start(mem.address());
 		if (!chunk)
 		{
 			return -EINVAL;
 		}
 		ptraddr_t start    = chunk->body().address();
-		size_t    bodySize = gm->chunk_body_size(*chunk);
+		size_t    bodySize = space->chunk_body_size(*chunk);
 		// Is the pointer that we're freeing a pointer to the entire allocation?
 		bool isPrecise = (start == mem.base()) && (bodySize == mem.length());
 		return heap_free_chunk(
 		  *capability, *chunk, bodySize, isPrecise, reallyFree);
 	}
 
+	/**
+	 * Add a claim on `pointer` for `capability`.  Returns the size of the
+	 * allocation claimed, `-EINVAL` if `pointer` is not a valid heap pointer,
+	 * or `-ENOMEM` if the quota is insufficient or a claim cannot be
+	 * allocated.  Must be called with the lock held.
+	 */
+	ssize_t heap_claim_internal(PrivateAllocatorCapabilityState &capability,
+	                            void                            *pointer)
+	{
+		if (!Capability{pointer}.is_valid())
+		{
+			Debug::log("Invalid claimed cap");
+			return -EINVAL;
+		}
+		MState *space = mstate_for(Capability{pointer}.address());
+		auto   *chunk = space->allocation_start(Capability{pointer}.address());
+		if (chunk == nullptr)
+		{
+			Debug::log("chunk not found");
+			return -EINVAL;
+		}
+		if (claim_add(capability, *chunk))
+		{
+			return space->chunk_body_size(*chunk);
+		}
+		Debug::log("failed to add claim");
+		return -ENOMEM;
+	}
+
 } // namespace
 
 __cheriot_minimum_stack(0x90) ssize_t
@@ -852,22 +1815,121 @@ __cheriot_minimum_stack(0x90) ssize_t
 	return cap->quota;
 }
 
+__cheriot_minimum_stack(0x90) const volatile size_t *
+  heap_quota_remaining_pointer(struct SObjStruct *heapCapability)
+{
+	STACK_CHECK(0x90);
+	LockGuard g{lock};
+	auto     *cap = malloc_capability_unseal(heapCapability);
+	if (cap == nullptr)
+	{
+		return nullptr;
+	}
+	Capability<const volatile size_t> quota{&cap->quota};
+	quota.bounds() = sizeof(cap->quota);
+	quota.permissions() &= PermissionSet{Permission::Load, Permission::Global};
+	return quota;
+}
+
 __cheriot_minimum_stack(0xc0) void heap_quarantine_empty()
 {
 	STACK_CHECK(0xc0);
 	LockGuard g{lock};
-	while (gm->heapQuarantineSize > 0)
+	for (MState *space : memory_spaces())
 	{
-		if (!gm->quarantine_dequeue())
+		while ((space != nullptr) && (space->heapQuarantineSize > 0))
 		{
-			revoker.system_bg_revoker_kick();
+			if (!space->quarantine_dequeue())
+			{
+				revoker.system_bg_revoker_kick();
+			}
+			g.unlock();
+			yield();
+			g.lock();
 		}
-		g.unlock();
-		yield();
-		g.lock();
 	}
 }
 
+__cheriot_minimum_stack(0x90) int heap_statistics(HeapStatistics *stats)
+{
+	STACK_CHECK(0x90);
+	if constexpr (!StatisticsEnabled)
+	{
+		return -ENOTSUP;
+	}
+	LockGuard g{lock};
+	if (!check_pointer<PermissionSet{Permission::Store}>(stats,
+	                                                     sizeof(*stats)))
+	{
+		return -EINVAL;
+	}
+	check_gm();
+	gm->statistics_get(*stats);
+	lock_statistics_get(lock.wrapped(), *stats);
+	return 0;
+}
+
+__cheriot_minimum_stack(0x80) int heap_revocation_progress()
+{
+	STACK_CHECK(0x80);
+	if constexpr (Revocation::SupportsProgressReporting<Revocation::Revoker>)
+	{
+		return revoker.system_progress_get();
+	}
+	else
+	{
+		return -ENOTSUP;
+	}
+}
+
+__cheriot_minimum_stack(0x100) int heap_profile_dump()
+{
+	STACK_CHECK(0x100);
+	if constexpr (!ProfilingEnabled)
+	{
+		return -ENOTSUP;
+	}
+	using Profile = ConditionalDebug<ProfilingEnabled, "Heap profile">;
+	LockGuard g{lock};
+	check_gm();
+	for (MState *space : memory_spaces())
+	{
+		if (space == nullptr)
+		{
+			continue;
+		}
+		auto      chunk   = space->heapStart.cast<MChunkHeader>();
+		ptraddr_t heapEnd = chunk.top();
+		do
+		{
+			// Chunks in quarantine or the size-class cache are marked as in
+			// use but have neither an owner nor claims.
+			if (chunk->is_in_use() &&
+			    ((chunk->ownerID != 0) || (chunk->claims != 0)))
+			{
+				Profile::log("site {} owner {} size {} claimed {}",
+				             allocationSites.find(chunk_encode(*chunk)),
+				             static_cast<int>(chunk->ownerID),
+				             static_cast<int>(chunk->size_get()),
+				             chunk->claims != 0);
+			}
+			chunk = static_cast<MChunkHeader *>(chunk->cell_next());
+		} while (chunk.address() < heapEnd);
+	}
+	return 0;
+}
+
+__cheriot_minimum_stack(0x100) int heap_pgo_dump()
+{
+	STACK_CHECK(0x100);
+#ifdef CHERIOT_PGO_GENERATE
+	pgo_counters_dump<ConditionalDebug<true, "Allocator profile">>();
+	return 0;
+#else
+	return -ENOTSUP;
+#endif
+}
+
 __cheriot_minimum_stack(0x210) void *heap_allocate(Timeout *timeout,
                                                    SObj     heapCapability,
                                                    size_t   bytes,
@@ -893,6 +1955,170 @@ __cheriot_minimum_stack(0x210) void *heap_allocate(Timeout *timeout,
 	return malloc_internal(bytes, std::move(g), cap, timeout, false, flags);
 }
 
+__cheriot_minimum_stack(0x210) void *
+  heap_allocate_aligned(Timeout *timeout,
+                        SObj     heapCapability,
+                        size_t   bytes,
+                        size_t   alignment,
+                        uint32_t flags)
+{
+	STACK_CHECK(0x210);
+	if (!check_timeout_pointer(timeout) || (alignment == 0) ||
+	    ((alignment & (alignment - 1)) != 0))
+	{
+		return nullptr;
+	}
+	LockGuard g{lock};
+	auto     *cap = malloc_capability_unseal(heapCapability);
+	if (cap == nullptr)
+	{
+		return nullptr;
+	}
+	if (!check_pointer<PermissionSet{Permission::Load, Permission::Store}>(
+	      timeout))
+	{
+		return nullptr;
+	}
+	return malloc_internal(
+	  bytes, std::move(g), cap, timeout, false, flags, alignment);
+}
+
+__cheriot_minimum_stack(0x230) void *heap_reallocate(Timeout *timeout,
+                                                     SObj     heapCapability,
+                                                     void    *pointer,
+                                                     size_t   bytes,
+                                                     uint32_t flags)
+{
+	STACK_CHECK(0x230);
+	if (!check_timeout_pointer(timeout))
+	{
+		return nullptr;
+	}
+	LockGuard g{lock};
+	auto     *cap = malloc_capability_unseal(heapCapability);
+	if (cap == nullptr)
+	{
+		return nullptr;
+	}
+	if (!check_pointer<PermissionSet{Permission::Load, Permission::Store}>(
+	      timeout))
+	{
+		return nullptr;
+	}
+	check_gm();
+	// Find the chunk and check that the caller owns it and has passed a
+	// pointer to the whole allocation, as for `heap_free`.
+	auto check = [&](Capability<void> mem) -> MChunkHeader * {
+		if (!mem.is_valid())
+		{
+			return nullptr;
+		}
+		MState *space = mstate_for(mem.address());
+		auto   *chunk = space->allocation_start(mem.address());
+		if ((chunk == nullptr) || (chunk->owner() != cap->identifier) ||
+		    chunk->isSealedObject || (chunk->body().address() != mem.base()) ||
+		    (space->chunk_body_size(*chunk) != mem.length()))
+		{
+			return nullptr;
+		}
+		return chunk;
+	};
+	Capability<void> mem{pointer};
+	MChunkHeader    *chunk = check(mem);
+	if ((chunk == nullptr) || (bytes == 0))
+	{
+		return nullptr;
+	}
+	size_t oldSize = mem.length();
+	// Shrinking is never done in place: existing capabilities to the object
+	// would retain access to the released tail.  If the object would not get
+	// smaller by at least a minimum-sized chunk, keep it.
+	if ((bytes <= oldSize) && (oldSize - bytes < MinChunkSize))
+	{
+		return pointer;
+	}
+	// Growing in place extends the chunk, so only the owner may be charged
+	// for it.  Claimants are refunded the size of the chunk when they drop
+	// their claim, so claimed objects are always moved.
+	MState *space = mstate_for(mem.address());
+	if ((bytes > oldSize) && (chunk->claims == 0) &&
+	    space->mspace_grow_in_place(*chunk, bytes, cap->quota))
+	{
+		Capability<void> ret{chunk->body()};
+		ret.bounds() = space->chunk_body_size(*chunk);
+		ret.permissions() &= mem.permissions();
+		return ret;
+	}
+	// Otherwise, allocate a new object, copy, and free the old one.
+	void *newObject =
+	  malloc_internal(bytes, std::move(g), cap, timeout, false, flags);
+	if (newObject == nullptr)
+	{
+		return nullptr;
+	}
+	// Allocation may have dropped the lock, so the original object may have
+	// been freed by another thread.
+	chunk = check(mem);
+	if (chunk == nullptr)
+	{
+		heap_free_internal(heapCapability, newObject, true);
+		return nullptr;
+	}
+	memcpy(newObject, pointer, std::min(bytes, oldSize));
+	heap_free_internal(heapCapability, pointer, true);
+	return newObject;
+}
+
+__cheriot_minimum_stack(0x230) ssize_t
+  heap_allocate_batch(Timeout *timeout,
+                      SObj     heapCapability,
+                      void   **objects,
+                      size_t   count,
+                      size_t   bytes,
+                      uint32_t flags)
+{
+	STACK_CHECK(0x230);
+	if (!check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	size_t arraySize;
+	if (__builtin_mul_overflow(count, sizeof(void *), &arraySize))
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock};
+	auto     *cap = malloc_capability_unseal(heapCapability);
+	if (cap == nullptr)
+	{
+		return -EPERM;
+	}
+	size_t allocated = 0;
+	while (allocated < count)
+	{
+		// Check the arguments on every iteration: the lock may have been
+		// dropped while blocking and, while we hold the lock, neither object
+		// can be freed out from under us.
+		if (!check_pointer<PermissionSet{Permission::Load, Permission::Store}>(
+		      timeout) ||
+		    !check_pointer<PermissionSet{Permission::Store,
+		                                 Permission::LoadStoreCapability}>(
+		      objects, arraySize))
+		{
+			return allocated > 0 ? allocated : -EINVAL;
+		}
+		void *ptr =
+		  malloc_internal(bytes, std::move(g), cap, timeout, false, flags);
+		// If the allocation failed, we may not hold the lock any more.
+		if (ptr == nullptr)
+		{
+			break;
+		}
+		objects[allocated++] = ptr;
+	}
+	return allocated;
+}
+
 __cheriot_minimum_stack(0x1c0) ssize_t
   heap_claim(SObj heapCapability, void *pointer)
 {
@@ -904,23 +2130,48 @@ __cheriot_minimum_stack(0x1c0) ssize_t
 		Debug::log("Invalid heap cap");
 		return 0;
 	}
-	if (!Capability{pointer}.is_valid())
+	ssize_t claimed = heap_claim_internal(*cap, pointer);
+	return claimed > 0 ? claimed : 0;
+}
+
+__cheriot_minimum_stack(0x1d0) ssize_t heap_claim_many(SObj     heapCapability,
+                                                       void   **pointers,
+                                                       ssize_t *results,
+                                                       size_t   count)
+{
+	STACK_CHECK(0x1d0);
+	size_t pointersSize;
+	size_t resultsSize;
+	if (__builtin_mul_overflow(count, sizeof(void *), &pointersSize) ||
+	    __builtin_mul_overflow(count, sizeof(ssize_t), &resultsSize))
 	{
-		Debug::log("Invalid claimed cap");
-		return 0;
+		return -EINVAL;
 	}
-	auto *chunk = gm->allocation_start(Capability{pointer}.address());
-	if (chunk == nullptr)
+	LockGuard g{lock};
+	auto     *cap = malloc_capability_unseal(heapCapability);
+	if (cap == nullptr)
 	{
-		Debug::log("chunk not found");
-		return 0;
+		return -EPERM;
 	}
-	if (claim_add(*cap, *chunk))
+	// Claims never free memory, so neither array can be freed while we hold
+	// the lock and checking them once is sufficient.
+	if (!check_pointer<PermissionSet{Permission::Load,
+	                                 Permission::LoadStoreCapability}>(
+	      pointers, pointersSize) ||
+	    !check_pointer<PermissionSet{Permission::Store}>(results, resultsSize))
 	{
-		return gm->chunk_body_size(*chunk);
+		return -EINVAL;
 	}
-	Debug::log("failed to add claim");
-	return 0;
+	ssize_t claimed = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		results[i] = heap_claim_internal(*cap, pointers[i]);
+		if (results[i] > 0)
+		{
+			claimed++;
+		}
+	}
+	return claimed;
 }
 
 __cheriot_minimum_stack(0x260) int heap_can_free(SObj  heapCapability,
@@ -947,15 +2198,94 @@ __cheriot_minimum_stack(0x260) int heap_free(SObj  heapCapability,
 		return ret;
 	}
 
-	// If there are any threads blocked allocating memory, wake them up.
-	if (freeFutex != -1)
+	quarantine_maintain(g);
+
+	return 0;
+}
+
+__cheriot_minimum_stack(0x280) ssize_t
+  heap_free_batch(SObj heapCapability, void **objects, size_t count)
+{
+	STACK_CHECK(0x280);
+	size_t arraySize;
+	if (__builtin_mul_overflow(count, sizeof(void *), &arraySize))
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock};
+	if (malloc_capability_unseal(heapCapability) == nullptr)
+	{
+		return -EPERM;
+	}
+	if (!check_pointer<PermissionSet{Permission::Load,
+	                                 Permission::LoadStoreCapability}>(
+	      objects, arraySize))
+	{
+		return -EINVAL;
+	}
+	ssize_t freed = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		void *object = objects[i];
+		if (object == nullptr)
+		{
+			continue;
+		}
+		if (heap_free_internal(heapCapability, object, true) == 0)
+		{
+			freed++;
+		}
+	}
+
+	if (freed > 0)
+	{
+		quarantine_maintain(g, freed);
+	}
+
+	return freed;
+}
+
+__cheriot_minimum_stack(0x280) ssize_t heap_release_many(SObj   heapCapability,
+                                                         void **pointers,
+                                                         int   *results,
+                                                         size_t count)
+{
+	STACK_CHECK(0x280);
+	size_t pointersSize;
+	size_t resultsSize;
+	if (__builtin_mul_overflow(count, sizeof(void *), &pointersSize) ||
+	    __builtin_mul_overflow(count, sizeof(int), &resultsSize))
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock};
+	if (malloc_capability_unseal(heapCapability) == nullptr)
+	{
+		return -EPERM;
+	}
+	if (!check_pointer<PermissionSet{Permission::Load,
+	                                 Permission::LoadStoreCapability}>(
+	      pointers, pointersSize) ||
+	    !check_pointer<PermissionSet{Permission::Store}>(results, resultsSize))
+	{
+		return -EINVAL;
+	}
+	ssize_t released = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		results[i] = heap_free_internal(heapCapability, pointers[i], true);
+		if (results[i] == 0)
+		{
+			released++;
+		}
+	}
+
+	if (released > 0)
 	{
-		Debug::log("Some threads are blocking on allocations, waking them");
-		freeFutex = -1;
-		freeFutex.notify_all();
+		quarantine_maintain(g, released);
 	}
 
-	return 0;
+	return released;
 }
 
 __cheriot_minimum_stack(0x190) ssize_t heap_free_all(SObj heapCapability)
@@ -969,29 +2299,51 @@ __cheriot_minimum_stack(0x190) ssize_t heap_free_all(SObj heapCapability)
 		return -EPERM;
 	}
 
-	auto      chunk   = gm->heapStart.cast<MChunkHeader>();
-	ptraddr_t heapEnd = chunk.top();
-	ssize_t   freed   = 0;
-	do
-	{
-		if (chunk->is_in_use() && !chunk->isSealedObject)
+	ssize_t freed        = 0;
+	size_t  freedObjects = 0;
+	auto    freeChunk    = [&](MState *space, MChunkHeader &chunk) {
+		if (chunk.is_in_use() && !chunk.isSealedObject)
 		{
-			auto size = chunk->size_get();
+			auto size = chunk.size_get();
 			if (heap_free_chunk(
-			      *capability, *chunk, gm->chunk_body_size(*chunk)) == 0)
+			      *capability, chunk, space->chunk_body_size(chunk)) == 0)
 			{
 				freed += size;
+				freedObjects++;
+			}
+		}
+	};
+	// If the owner index has all of this capability's chunks, visit only
+	// those.  Claims are not indexed by claimant, so capabilities holding
+	// claims must walk the heap to find the claimed objects.
+	if (OwnerIndex::Enabled && (capability->ownedUnindexed == 0) &&
+	    (capability->claimsHeld == 0))
+	{
+		ownerIndex.for_each(*capability, [&](MChunkHeader &chunk) {
+			freeChunk(mstate_for(Capability{&chunk}.address()), chunk);
+		});
+	}
+	else
+	{
+		for (MState *space : memory_spaces())
+		{
+			if (space == nullptr)
+			{
+				continue;
 			}
+			auto      chunk   = space->heapStart.cast<MChunkHeader>();
+			ptraddr_t heapEnd = chunk.top();
+			do
+			{
+				freeChunk(space, *chunk);
+				chunk = static_cast<MChunkHeader *>(chunk->cell_next());
+			} while (chunk.address() < heapEnd);
 		}
-		chunk = static_cast<MChunkHeader *>(chunk->cell_next());
-	} while (chunk.address() < heapEnd);
+	}
 
-	// If there are any threads blocked allocating memory, wake them up.
-	if ((freeFutex > 0) && (freed > 0))
+	if (freedObjects > 0)
 	{
-		Debug::log("Some threads are blocking on allocations, waking them");
-		freeFutex = 0;
-		freeFutex.notify_all();
+		quarantine_maintain(g, freedObjects);
 	}
 
 	return freed;
@@ -1036,6 +2388,36 @@ namespace
 	 */
 	uint32_t nextSealingType = std::numeric_limits<uint32_t>::max();
 
+	/// The number of destroyed sealing types that can wait to be reused.
+	constexpr size_t RecycledSealingTypes = 16;
+
+	/**
+	 * A sealing type released by `token_key_destroy`.  Objects sealed with it
+	 * may still have been in quarantine when it was released, so it is not
+	 * reused until the revoker has finished the pass that invalidates any
+	 * handles to them.
+	 */
+	struct RecycledSealingType
+	{
+		/// The sealing type.
+		uint32_t type;
+		/// The revocation epoch that must finish before it is reused.
+		uint32_t epoch;
+	};
+
+	/// Sealing types that are waiting to be reused.
+	RecycledSealingType recycledSealingTypes[RecycledSealingTypes];
+
+	/// The number of valid entries in `recycledSealingTypes`.
+	size_t recycledSealingTypeCount;
+
+	/**
+	 * Lock protecting sealing type allocation.  This doesn't touch any other
+	 * data structures and so has its own lock, which is acquired after the
+	 * heap lock if both are needed.
+	 */
+	FlagLock sealingTypeLock;
+
 	/**
 	 * Helper that unseals `in` if it is a valid sealed capability sealed with
 	 * our hardware sealing key.  Returns the unsealed pointer, `nullptr` if it
@@ -1126,8 +2508,9 @@ namespace
 		// requested alignment beyond 8, this will be a no-op.
 		obj.align_down(MallocAlignment);
 
-		obj->type   = key.address();
-		auto sealed = obj;
+		obj->type         = key.address();
+		obj->handleOffset = 0;
+		auto sealed       = obj;
 		sealed.seal(allocatorSealingKey);
 		obj.address() += ObjHdrSize; // Exclude the header.
 		obj.bounds() = obj.top() - obj.address();
@@ -1139,15 +2522,27 @@ namespace
 
 SKey token_key_new()
 {
-	// This needs protecting against races but doesn't touch any other data
-	// structures and so can have its own lock.
-	static FlagLock tokenLock;
-	LockGuard       g{tokenLock};
-	auto            keyRoot = softwareSealingKey;
+	LockGuard g{sealingTypeLock};
+	auto      keyRoot = softwareSealingKey;
 	// For now, strip the user permissions.  We might want to use them for
 	// permit-allocate and permit-free.
 	keyRoot.permissions() &=
 	  {Permission::Global, Permission::Seal, Permission::Unseal};
+	// Prefer a destroyed sealing type, if one is safe to reuse.
+	for (size_t i = 0; i < recycledSealingTypeCount; i++)
+	{
+		if (revoker.has_revocation_finished_for_epoch(
+		      recycledSealingTypes[i].epoch))
+		{
+			auto key      = keyRoot;
+			key.address() = recycledSealingTypes[i].type;
+			key.bounds()  = 1;
+			recycledSealingTypes[i] =
+			  recycledSealingTypes[--recycledSealingTypeCount];
+			Debug::log("Reused sealing capability: {}", key);
+			return key;
+		}
+	}
 	// Allocate sealing types from the top.
 	if (keyRoot.base() < nextSealingType - 1)
 	{
@@ -1228,11 +2623,13 @@ __cheriot_minimum_stack(0x260) int token_obj_destroy(SObj heapCapability,
 	void *unsealed;
 	{
 		LockGuard g{lock};
-		unsealed = unseal_internal(key, object);
-		if (unsealed == nullptr)
+		SealedAllocation sealedObject = unseal_internal(key, object);
+		// Objects in a token pool are returned with `token_pool_free`.
+		if ((sealedObject == nullptr) || (sealedObject->handleOffset != 0))
 		{
 			return -EINVAL;
 		}
+		unsealed = sealedObject;
 		// At this point, we drop and reacquire the lock. This is better for
 		// code reuse and heap_free will catch races because it will check the
 		// revocation state.
@@ -1242,6 +2639,59 @@ __cheriot_minimum_stack(0x260) int token_obj_destroy(SObj heapCapability,
 	return heap_free(heapCapability, unsealed);
 }
 
+__cheriot_minimum_stack(0x280) ssize_t
+  token_obj_destroy_batch(SObj   heapCapability,
+                          SKey   key,
+                          SObj  *objects,
+                          size_t count)
+{
+	STACK_CHECK(0x280);
+	size_t arraySize;
+	if (__builtin_mul_overflow(count, sizeof(SObj), &arraySize))
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock};
+	if (malloc_capability_unseal(heapCapability) == nullptr)
+	{
+		return -EPERM;
+	}
+	if (!check_pointer<PermissionSet{Permission::Load,
+	                                 Permission::LoadStoreCapability}>(
+	      objects, arraySize))
+	{
+		return -EINVAL;
+	}
+	// Unlike `token_obj_destroy`, hold the lock for the whole batch.  Each
+	// object is freed before the next is unsealed, so the load barrier strips
+	// the tag from any later copy of an object that has been destroyed.
+	ssize_t destroyed = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (objects[i] == nullptr)
+		{
+			continue;
+		}
+		SealedAllocation sealedObject = unseal_internal(key, objects[i]);
+		// Objects in a token pool are returned with `token_pool_free`.
+		if ((sealedObject == nullptr) || (sealedObject->handleOffset != 0))
+		{
+			continue;
+		}
+		if (heap_free_internal(heapCapability, sealedObject, true) == 0)
+		{
+			destroyed++;
+		}
+	}
+
+	if (destroyed > 0)
+	{
+		quarantine_maintain(g, destroyed);
+	}
+
+	return destroyed;
+}
+
 __cheriot_minimum_stack(0xf0) int token_obj_can_destroy(SObj heapCapability,
                                                         SKey key,
                                                         SObj object)
@@ -1250,11 +2700,13 @@ __cheriot_minimum_stack(0xf0) int token_obj_can_destroy(SObj heapCapability,
 	void *unsealed;
 	{
 		LockGuard g{lock};
-		unsealed = unseal_internal(key, object);
-		if (unsealed == nullptr)
+		SealedAllocation sealedObject = unseal_internal(key, object);
+		// Objects in a token pool are returned with `token_pool_free`.
+		if ((sealedObject == nullptr) || (sealedObject->handleOffset != 0))
 		{
 			return -EINVAL;
 		}
+		unsealed = sealedObject;
 		// At this point, we drop and reacquire the lock. This is better for
 		// code reuse and heap_can_free will catch races because it will check
 		// the revocation state.
@@ -1264,7 +2716,515 @@ __cheriot_minimum_stack(0xf0) int token_obj_can_destroy(SObj heapCapability,
 	return heap_can_free(heapCapability, unsealed);
 }
 
+namespace
+{
+	/**
+	 * The number of generations of handles that each token pool slot has
+	 * before it is retired.  Each generation's handle has a different base,
+	 * so this many bases must fit before the object header.
+	 */
+	constexpr size_t TokenPoolGenerations = 8;
+
+	/// Marker for the end of a token pool slot list.
+	constexpr uint16_t TokenPoolEndOfList = UINT16_MAX;
+
+	/**
+	 * A slot in a token pool.
+	 */
+	struct TokenPoolSlot
+	{
+		/**
+		 * The slot's allocation, unsealed, with bounds covering the whole
+		 * allocation and the address of the object header.  This is null for
+		 * slots that have been retired and not yet replaced.
+		 */
+		SealedAllocation memory;
+		/// The index of the next slot in the free or retired list.
+		uint16_t next;
+		/// The generation of the current (or next) handle to this slot.
+		uint8_t generation;
+		/// Is the slot currently allocated?
+		bool inUse;
+	};
+
+	/**
+	 * The state for a token pool.  This is stored in a sealed object
+	 * allocated from the pool owner's quota and is followed by the slots.
+	 */
+	struct TokenPool
+	{
+		/// The heap capability that slot allocations are charged to.
+		SObj heapCapability;
+		/// The sealing type of the objects in this pool.
+		ptraddr_t key;
+		/// The size of the unsealed part of each object.
+		size_t objectSize;
+		/// The size of each slot's allocation.
+		size_t slotSize;
+		/**
+		 * The size of the area before each object header that holds the
+		 * bases of successive generations of handles.
+		 */
+		size_t generationArea;
+		/// The distance between the bases of successive generations.
+		size_t generationStride;
+		/// The number of slots.
+		uint16_t count;
+		/// The first free slot.
+		uint16_t freeList;
+		/**
+		 * The first retired slot.  Retired slots have been freed to the heap
+		 * and are replaced when the free list is empty.
+		 */
+		uint16_t retiredList;
+
+		/// Returns the slots, which follow this structure.
+		TokenPoolSlot *slots()
+		{
+			return reinterpret_cast<TokenPoolSlot *>(this + 1);
+		}
+	};
+
+	/**
+	 * Lock protecting the state of all token pools.  This is acquired before
+	 * the heap lock if both are needed.
+	 */
+	FlagLock tokenPoolLock;
+
+	/// The sealing key for pool handles, allocated with the first pool.
+	SKey tokenPoolKey;
+
+	/**
+	 * Returns the state of the pool that `pool` is a handle to, or null if it
+	 * is not a valid pool handle.
+	 */
+	TokenPool *token_pool_unseal(SObj pool)
+	{
+		if (tokenPoolKey == nullptr)
+		{
+			return nullptr;
+		}
+		return token_unseal<TokenPool>(tokenPoolKey, pool);
+	}
+
+	/**
+	 * Returns the handle for generation `generation` of the slot whose
+	 * memory is `memory`, unsealed.  The handle is untagged if its bounds are
+	 * not representable.
+	 */
+	SealedAllocation token_pool_handle(TokenPool       &pool,
+	                                   SealedAllocation memory,
+	                                   size_t           generation)
+	{
+		size_t offset =
+		  pool.generationArea - generation * pool.generationStride;
+		SealedAllocation handle = memory;
+		handle.address() -= offset;
+		handle.bounds() = memory.top() - handle.address();
+		handle.address() += offset;
+		return handle;
+	}
+
+	/**
+	 * Allocate the memory for a slot in `pool`.  Returns null if the
+	 * allocation fails or if the handles for some generations of the slot
+	 * would not be representable.
+	 */
+	SealedAllocation token_pool_slot_allocate(TokenPool &pool,
+	                                          Timeout   *timeout)
+	{
+		LockGuard g{lock};
+		auto     *capability = malloc_capability_unseal(pool.heapCapability);
+		if (capability == nullptr)
+		{
+			return nullptr;
+		}
+		SealedAllocation memory{static_cast<SObj>(malloc_internal(
+		  pool.slotSize, std::move(g), capability, timeout, true))};
+		if (memory == nullptr)
+		{
+			return nullptr;
+		}
+		memory.address() = memory.top() - pool.objectSize - ObjHdrSize;
+		for (size_t i = 0; i < TokenPoolGenerations; i++)
+		{
+			if (!token_pool_handle(pool, memory, i).is_valid())
+			{
+				Debug::log("Token pool handle {} for {} is not representable",
+				           i,
+				           memory);
+				LockGuard freeGuard{lock};
+				heap_free_internal(pool.heapCapability, memory, true);
+				return nullptr;
+			}
+		}
+		return memory;
+	}
+
+	/**
+	 * Free the memory for a slot and any other memory that the pool holds.
+	 * Called with the heap lock held by `g`.  If there are threads blocked
+	 * allocating memory, wake them.
+	 */
+	void token_pool_memory_free(TokenPool                 &pool,
+	                            SealedAllocation           memory,
+	                            LockGuard<decltype(lock)> &g)
+	{
+		if (heap_free_internal(pool.heapCapability, memory, true) != 0)
+		{
+			return;
+		}
+		quarantine_maintain(g);
+	}
+} // namespace
+
+__cheriot_minimum_stack(0x280) SObj token_pool_create(Timeout *timeout,
+                                                      SObj     heapCapability,
+                                                      SKey     rawKey,
+                                                      size_t   size,
+                                                      size_t   count)
+{
+	STACK_CHECK(0x280);
+	SealingKey key{rawKey};
+	if (!check_timeout_pointer(timeout) ||
+	    !PermissionSet{Permission::Seal, Permission::Unseal}.can_derive_from(
+	      key.permissions()) ||
+	    (count == 0) || (count >= TokenPoolEndOfList) ||
+	    !Capability{heapCapability}.permissions().contains(Permission::Global))
+	{
+		return INVALID_SOBJ;
+	}
+	size_t objectSize = __builtin_align_up(CHERI::representable_length(size),
+	                                       MallocAlignment);
+	if ((size == 0) || (objectSize < size))
+	{
+		Debug::log("Token pool object size {} is not representable", size);
+		return INVALID_SOBJ;
+	}
+	// Space the generations' bases far enough apart that each handle can be
+	// precisely represented.  The alignment that a length requires depends
+	// on the length, which depends on the stride, so iterate to a fixed
+	// point (which takes at most two steps).
+	size_t stride = 1;
+	for (size_t i = 0; i < 2; i++)
+	{
+		size_t length = TokenPoolGenerations * stride + ObjHdrSize + objectSize;
+		stride = std::max<size_t>(
+		  stride, ~CHERI::representable_alignment_mask(length) + 1);
+	}
+	size_t area =
+	  __builtin_align_up(TokenPoolGenerations * stride, MallocAlignment);
+	size_t slotSize;
+	if (__builtin_add_overflow(area + ObjHdrSize, objectSize, &slotSize))
+	{
+		return INVALID_SOBJ;
+	}
+	{
+		LockGuard g{tokenPoolLock};
+		if (tokenPoolKey == nullptr)
+		{
+			tokenPoolKey = token_key_new();
+		}
+	}
+	if (tokenPoolKey == nullptr)
+	{
+		return INVALID_SOBJ;
+	}
+	auto [sealed, unsealed] = allocate_sealed_unsealed(
+	  timeout,
+	  heapCapability,
+	  tokenPoolKey,
+	  sizeof(TokenPool) + count * sizeof(TokenPoolSlot),
+	  {Permission::Seal, Permission::Unseal});
+	if (sealed == nullptr)
+	{
+		return INVALID_SOBJ;
+	}
+	auto *pool             = static_cast<TokenPool *>(unsealed);
+	pool->heapCapability   = heapCapability;
+	pool->key              = key.address();
+	pool->objectSize       = objectSize;
+	pool->slotSize         = slotSize;
+	pool->generationArea   = area;
+	pool->generationStride = stride;
+	pool->count            = count;
+	pool->freeList         = 0;
+	pool->retiredList      = TokenPoolEndOfList;
+	TokenPoolSlot *slots   = pool->slots();
+	for (size_t i = 0; i < count; i++)
+	{
+		slots[i].next = (i + 1 < count) ? i + 1 : TokenPoolEndOfList;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		slots[i].memory = token_pool_slot_allocate(*pool, timeout);
+		if (slots[i].memory == nullptr)
+		{
+			token_pool_destroy(heapCapability, sealed);
+			return INVALID_SOBJ;
+		}
+	}
+	return sealed;
+}
+
+__cheriot_minimum_stack(0x260) SObj
+  token_pool_alloc(SObj pool, SKey rawKey, void **unsealed)
+{
+	STACK_CHECK(0x260);
+	LockGuard  g{tokenPoolLock};
+	TokenPool *state = token_pool_unseal(pool);
+	SealingKey key{rawKey};
+	if ((state == nullptr) || (key == nullptr) ||
+	    (key.address() != state->key) ||
+	    !key.permissions().contains(Permission::Seal) ||
+	    ((unsealed != nullptr) &&
+	     !check_pointer<PermissionSet{Permission::Store,
+	                                  Permission::LoadStoreCapability}>(
+	       unsealed)))
+	{
+		return INVALID_SOBJ;
+	}
+	TokenPoolSlot *slots = state->slots();
+	uint16_t       index = state->freeList;
+	if (index != TokenPoolEndOfList)
+	{
+		state->freeList = slots[index].next;
+	}
+	else
+	{
+		// Replace a retired slot, if there is one.
+		index = state->retiredList;
+		if (index == TokenPoolEndOfList)
+		{
+			return INVALID_SOBJ;
+		}
+		Timeout noWait{0};
+		slots[index].memory = token_pool_slot_allocate(*state, &noWait);
+		if (slots[index].memory == nullptr)
+		{
+			return INVALID_SOBJ;
+		}
+		state->retiredList = slots[index].next;
+	}
+	TokenPoolSlot &slot = slots[index];
+	slot.inUse          = true;
+	SealedAllocation handle =
+	  token_pool_handle(*state, slot.memory, slot.generation);
+	handle->type         = state->key;
+	handle->handleOffset = handle.address() - handle.base();
+	if (unsealed != nullptr)
+	{
+		SealedAllocation object = slot.memory;
+		object.address() += ObjHdrSize;
+		object.bounds() = object.top() - object.address();
+		*unsealed       = object;
+	}
+	handle.seal(allocatorSealingKey);
+	return handle;
+}
+
+__cheriot_minimum_stack(0x260) int token_pool_free(SObj pool,
+                                                   SKey key,
+                                                   SObj object)
+{
+	STACK_CHECK(0x260);
+	LockGuard  g{tokenPoolLock};
+	TokenPool *state = token_pool_unseal(pool);
+	if ((state == nullptr) || (SealingKey{key} == nullptr) ||
+	    (SealingKey{key}.address() != state->key))
+	{
+		return -EINVAL;
+	}
+	// This fails for stale handles, because their base does not match the
+	// current generation.
+	Capability<void> unsealed = token_unseal<void>(key, object);
+	if (!unsealed.is_valid())
+	{
+		return -EINVAL;
+	}
+	TokenPoolSlot *slots = state->slots();
+	for (size_t i = 0; i < state->count; i++)
+	{
+		TokenPoolSlot &slot = slots[i];
+		if (!slot.inUse ||
+		    (slot.memory.address() + ObjHdrSize != unsealed.address()))
+		{
+			continue;
+		}
+		// Invalidate the current handle and clear the object for its next
+		// owner.
+		slot.inUse         = false;
+		slot.memory->type  = 0;
+		memset(unsealed, 0, unsealed.length());
+		if (++slot.generation < TokenPoolGenerations)
+		{
+			slot.next       = state->freeList;
+			state->freeList = i;
+			return 0;
+		}
+		// The slot has used all of its generations.  Free it so that the
+		// revoker invalidates any remaining handles and unsealed pointers.
+		{
+			LockGuard heapGuard{lock};
+			token_pool_memory_free(*state, slot.memory, heapGuard);
+		}
+		slot.memory        = nullptr;
+		slot.generation    = 0;
+		slot.next          = state->retiredList;
+		state->retiredList = i;
+		return 0;
+	}
+	return -EINVAL;
+}
+
+__cheriot_minimum_stack(0x260) int token_pool_destroy(SObj heapCapability,
+                                                      SObj pool)
+{
+	STACK_CHECK(0x260);
+	LockGuard        g{tokenPoolLock};
+	SealedAllocation sealedState = unseal_internal(tokenPoolKey, pool);
+	TokenPool       *state       = token_pool_unseal(pool);
+	if ((sealedState == nullptr) || (state == nullptr))
+	{
+		return -EINVAL;
+	}
+	LockGuard heapGuard{lock};
+	if (int ret = heap_free_internal(heapCapability, sealedState, false);
+	    ret != 0)
+	{
+		return ret;
+	}
+	TokenPoolSlot *slots = state->slots();
+	for (size_t i = 0; i < state->count; i++)
+	{
+		if (slots[i].memory != nullptr)
+		{
+			token_pool_memory_free(*state, slots[i].memory, heapGuard);
+		}
+	}
+	// Make sure that nothing can unseal the pool state between freeing it
+	// and the revoker invalidating the handle.
+	sealedState->type = 0;
+	heap_free_internal(heapCapability, sealedState, true);
+	return 0;
+}
+
+namespace
+{
+	/**
+	 * Returns the header of the sealed object in `chunk`, which must be an
+	 * in-use sealed-object chunk, or null if its body is entirely zero.  The
+	 * header may be preceded by alignment padding or, in a token pool slot, by
+	 * the generation area, but both are zero because the allocator zeroes
+	 * memory on free, and the header is never entirely zero while the object
+	 * is live.
+	 */
+	SObjStruct *sealed_chunk_header(MChunkHeader &chunk)
+	{
+		Capability<uint64_t> granule = chunk.body<uint64_t>();
+		size_t               count =
+		  (chunk.size_get() - sizeof(MChunkHeader)) / sizeof(uint64_t);
+		for (size_t i = 0; i < count; i++, granule++)
+		{
+			if (*granule != 0)
+			{
+				return reinterpret_cast<SObjStruct *>(granule.get());
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Returns true if `chunk`, which must be an in-use sealed-object chunk,
+	 * holds an object sealed with `type` or the state of a token pool for
+	 * objects sealed with `type`.
+	 */
+	bool sealed_chunk_uses_type(MChunkHeader &chunk, ptraddr_t type)
+	{
+		SObjStruct *header = sealed_chunk_header(chunk);
+		if (header == nullptr)
+		{
+			return false;
+		}
+		if (header->type == type)
+		{
+			return true;
+		}
+		return (tokenPoolKey != nullptr) &&
+		       (header->type == Capability{tokenPoolKey}.address()) &&
+		       (reinterpret_cast<TokenPool *>(header->data)->key == type);
+	}
+} // namespace
+
+__cheriot_minimum_stack(0x1a0) int token_key_destroy(SKey rawKey)
+{
+	STACK_CHECK(0x1a0);
+	Capability key{rawKey};
+	if (!key.is_valid() || key.is_sealed() || (key.length() != 1) ||
+	    (key.address() != key.base()) ||
+	    !key.permissions().contains(Permission::Seal, Permission::Unseal))
+	{
+		return -EINVAL;
+	}
+	// Pools refer to their key without holding an object sealed with it, so
+	// they must not be created or destroyed during the walk.
+	LockGuard poolGuard{tokenPoolLock};
+	LockGuard g{lock};
+	{
+		LockGuard typeGuard{sealingTypeLock};
+		// Only types that `token_key_new` has handed out may be destroyed.
+		if ((key.address() < nextSealingType) ||
+		    (key.base() < softwareSealingKey.base()))
+		{
+			return -EINVAL;
+		}
+		for (size_t i = 0; i < recycledSealingTypeCount; i++)
+		{
+			if (recycledSealingTypes[i].type == key.address())
+			{
+				return -EINVAL;
+			}
+		}
+	}
+	for (MState *space : memory_spaces())
+	{
+		if (space == nullptr)
+		{
+			continue;
+		}
+		auto      chunk   = space->heapStart.cast<MChunkHeader>();
+		ptraddr_t heapEnd = chunk.top();
+		do
+		{
+			if (chunk->is_in_use() && chunk->isSealedObject)
+			{
+				if (sealed_chunk_uses_type(*chunk, key.address()))
+				{
+					Debug::log("Sealing key {} still has live objects", key);
+					return -EBUSY;
+				}
+			}
+			chunk = static_cast<MChunkHeader *>(chunk->cell_next());
+		} while (chunk.address() < heapEnd);
+	}
+
+	LockGuard typeGuard{sealingTypeLock};
+	if (recycledSealingTypeCount == RecycledSealingTypes)
+	{
+		// The type is still destroyed, but is never reused.
+		return 0;
+	}
+	// As with quarantine, objects freed in an odd epoch are invalidated by
+	// the end of the next even one.
+	uint32_t epoch = revoker.system_epoch_get();
+	epoch += epoch & 1;
+	recycledSealingTypes[recycledSealingTypeCount++] = {
+	  static_cast<uint32_t>(key.address()), epoch};
+	revoker.system_bg_revoker_kick();
+	return 0;
+}
+
 size_t heap_available()
 {
-	return gm->heapFreeSize;
+	return heap_free_size();
 }
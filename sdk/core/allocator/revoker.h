@@ -4,7 +4,9 @@
 #pragma once
 #include "alloc_config.h"
 #include "software_revoker.h"
+#include <cheri.hh>
 #include <concepts>
+#include <futex.h>
 #include <riscvreg.h>
 #include <stdint.h>
 #include <utils.hh>
@@ -56,6 +58,19 @@ namespace Revocation
 			} -> std::same_as<bool>;
 	};
 
+	/**
+	 * Revokers that can report how far through a revocation pass they are.
+	 * `system_progress_get` returns a percentage, which is 0 if revocation is
+	 * not running.
+	 */
+	template<typename T>
+	concept SupportsProgressReporting = requires(T v)
+	{
+		{
+			v.system_progress_get()
+			} -> std::same_as<uint32_t>;
+	};
+
 	/**
 	 * Class for interacting with the shadow bitmap.  This bitmap controls the
 	 * behaviour of a hardware load barrier, which will invalidate capabilities
@@ -131,6 +146,44 @@ namespace Revocation
 		               shadow_mask_bits_below_address(ShadowWordSizeBits -
 		                                              1)) == WordT(-1));
 
+		/**
+		 * The number of shadow words that `shadow_fill_words` writes in each
+		 * iteration of its main loop.
+		 */
+		static constexpr size_t FillUnroll = 4;
+
+		/**
+		 * Set every word of the bitmap in `[baseWordIx, topWordIx)` to
+		 * `value`, from the highest index to the lowest (see
+		 * `shadow_paint_range` for why the order matters).
+		 *
+		 * Large frees paint many words with the allocator lock held, so the
+		 * loop is unrolled to write `FillUnroll` words per iteration.
+		 * `WordT` is the width of the shadow memory's interface and CHERIoT
+		 * has no wider integer stores, so this is the cheapest way to fill
+		 * the bitmap.  The barrier between groups stops the compiler from
+		 * turning the loop into a call to `memset`, which would fill
+		 * upwards.
+		 */
+		__always_inline void
+		shadow_fill_words(size_t baseWordIx, size_t topWordIx, WordT value)
+		{
+			size_t wordIx = topWordIx;
+			while (wordIx - baseWordIx >= FillUnroll)
+			{
+				for (size_t i = 1; i <= FillUnroll; i++)
+				{
+					shadowCap[wordIx - i] = value;
+				}
+				wordIx -= FillUnroll;
+				asm volatile("" ::: "memory");
+			}
+			while (wordIx > baseWordIx)
+			{
+				shadowCap[--wordIx] = value;
+			}
+		}
+
 		public:
 		/**
 		 * @brief Set or clear the single shadow bit for an address.
@@ -225,14 +278,10 @@ namespace Revocation
 			}
 
 			/*
-			 * This loop is underflow-safe, since topWordIx is strictly greater
+			 * This is underflow-safe, since topWordIx is strictly greater
 			 * than baseWordIx after the test for equality above.
 			 */
-			for (size_t shadowWordIx = topWordIx - 1; baseWordIx < shadowWordIx;
-			     shadowWordIx--)
-			{
-				shadowCap[shadowWordIx] = midWord;
-			}
+			shadow_fill_words(baseWordIx + 1, topWordIx, midWord);
 
 			if constexpr (Fill)
 			{
@@ -271,13 +320,319 @@ namespace Revocation
 		}
 	};
 
+	/**
+	 * Hardware revokers that can be told which range of memory to sweep.
+	 * The range must not be changed while a sweep is running.
+	 */
+	template<typename T>
+	concept SupportsSweepRanges = requires(T v, ptraddr_t base, ptraddr_t top)
+	{
+		{
+			v.system_bg_revoker_range_set(base, top)
+			} -> std::same_as<void>;
+	};
+
+	/**
+	 * How fast a revoker should sweep.
+	 */
+	enum class SweepRate
+	{
+		/**
+		 * Sweep in small pieces, advancing only when the allocator next
+		 * checks on the revoker, so that sweeping competes less with other
+		 * code for memory bandwidth.
+		 */
+		Gentle,
+		/// Sweep as fast as possible.
+		Aggressive,
+	};
+
+	/**
+	 * Revokers whose sweep rate can be set.  The new rate applies from the
+	 * next piece of memory that the revoker starts to sweep.
+	 */
+	template<typename T>
+	concept SupportsSweepRate = requires(T v, SweepRate rate)
+	{
+		{
+			v.system_bg_revoker_rate_set(rate)
+			} -> std::same_as<void>;
+	};
+
+	/**
+	 * Wrapper around a hardware revoker that sweeps only the regions of
+	 * memory that can hold capabilities: the thread stacks, the globals and
+	 * static objects, and the heap.  The code between the stacks and the
+	 * globals (and, on boards with a fixed heap start, anything between the
+	 * static objects and the heap) is skipped.  If `HardwareRevokerRegions`
+	 * is false, there is a single region from the globals to the end of the
+	 * heap.
+	 *
+	 * The device sweeps one region at a time.  A pass of this revoker is a
+	 * sweep of every region in address order and has its own epoch, with the
+	 * same meaning as the device's: the low bit is set while a pass is
+	 * running.  Each query advances to the next region if the device has
+	 * finished the current one.  The allocator may call this without holding
+	 * its lock (while waiting for a pass), so state changes are made with
+	 * interrupts disabled.
+	 *
+	 * At the `Gentle` sweep rate, regions are swept in pieces of at most
+	 * `HardwareRevokerGentleChunk` bytes.  The next piece starts only when
+	 * the allocator next queries the revoker, so the device is idle between
+	 * allocator calls instead of competing with running code for memory.
+	 */
+	template<typename Device>
+	requires SupportsSweepRanges<Device>
+	class RegionSweeper : public Device
+	{
+		/**
+		 * A range of memory to sweep.
+		 */
+		struct Region
+		{
+			/// The first address to sweep.
+			ptraddr_t base;
+			/// The address after the last one to sweep.
+			ptraddr_t top;
+		};
+
+		/**
+		 * Regions that are separated by at most this many bytes are swept
+		 * together.  Sweeping a small gap is cheaper than waiting for the
+		 * allocator to notice that one region has finished and start the
+		 * next.
+		 */
+		static constexpr size_t MergeDistance = 1024;
+
+		/// The regions to sweep, in address order.
+		Region regions[3];
+
+		/// The number of valid entries in `regions`.
+		size_t regionCount;
+
+		/// The region that the device is sweeping, if a pass is running.
+		size_t currentRegion;
+
+		/// The start of the piece of the current region being swept.
+		ptraddr_t chunkBase;
+
+		/// The end of the piece of the current region being swept.
+		ptraddr_t chunkTop;
+
+		/// The rate at which to sweep.
+		SweepRate rate;
+
+		/// The device's epoch when the current region's sweep was started.
+		uint32_t deviceEpoch;
+
+		/// The epoch of passes over all regions.
+		uint32_t epoch;
+
+		/**
+		 * Add `[base, top)` to the set of regions, merging it with the
+		 * previous region if they are close.
+		 */
+		void region_add(ptraddr_t base, ptraddr_t top)
+		{
+			if (base >= top)
+			{
+				return;
+			}
+			if (regionCount > 0)
+			{
+				Region &previous = regions[regionCount - 1];
+				if ((base >= previous.top) &&
+				    (base - previous.top <= MergeDistance))
+				{
+					previous.top = top;
+					return;
+				}
+			}
+			regions[regionCount++] = {base, top};
+		}
+
+		/**
+		 * Start the device sweeping the current region from `chunkBase`, to
+		 * the end of the region or, at the gentle rate, for at most one
+		 * chunk.
+		 */
+		void region_start()
+		{
+			ptraddr_t top = regions[currentRegion].top;
+			if ((HardwareRevokerGentleChunk > 0) &&
+			    (rate == SweepRate::Gentle) &&
+			    (top - chunkBase > HardwareRevokerGentleChunk))
+			{
+				top = chunkBase + HardwareRevokerGentleChunk;
+			}
+			chunkTop = top;
+			Device::system_bg_revoker_range_set(chunkBase, chunkTop);
+			deviceEpoch = Device::system_epoch_get();
+			Device::system_bg_revoker_kick();
+		}
+
+		/**
+		 * If the device has finished sweeping the current piece, start the
+		 * next piece of the region, the next region or, if that was the
+		 * last, finish the pass.
+		 */
+		void advance()
+		{
+			CHERI::with_interrupts_disabled([&]() {
+				if (((epoch & 1) == 1) &&
+				    Device::template has_revocation_finished_for_epoch<false>(
+				      deviceEpoch))
+				{
+					if (chunkTop < regions[currentRegion].top)
+					{
+						chunkBase = chunkTop;
+						region_start();
+					}
+					else if (++currentRegion == regionCount)
+					{
+						epoch++;
+					}
+					else
+					{
+						chunkBase = regions[currentRegion].base;
+						region_start();
+					}
+				}
+			});
+		}
+
+		public:
+		/**
+		 * Initialise the device and compute the regions from the firmware's
+		 * memory layout.
+		 */
+		void init()
+		{
+			extern char __stack_space_start, __stack_space_end, __compart_cgps,
+			  __shared_objects_end, __export_mem_heap, __export_mem_heap_end;
+			Device::init();
+			regionCount = 0;
+			if constexpr (HardwareRevokerRegions)
+			{
+				region_add(LA_ABS(__stack_space_start),
+				           LA_ABS(__stack_space_end));
+				region_add(LA_ABS(__compart_cgps), LA_ABS(__shared_objects_end));
+				region_add(LA_ABS(__export_mem_heap),
+				           LA_ABS(__export_mem_heap_end));
+			}
+			else
+			{
+				region_add(LA_ABS(__compart_cgps),
+				           LA_ABS(__export_mem_heap_end));
+			}
+			currentRegion = regionCount;
+			epoch         = 0;
+			rate          = SweepRate::Aggressive;
+		}
+
+		/**
+		 * Set the rate for the rest of the current pass and later passes.
+		 */
+		void system_bg_revoker_rate_set(SweepRate newRate)
+		{
+			rate = newRate;
+		}
+
+		/**
+		 * Returns the revocation epoch.  This is the number of passes over
+		 * all regions that have started or finished.
+		 */
+		uint32_t system_epoch_get()
+		{
+			advance();
+			return epoch;
+		}
+
+		/**
+		 * Queries whether the specified revocation epoch has finished.
+		 */
+		template<bool AllowPartial = false>
+		uint32_t has_revocation_finished_for_epoch(uint32_t previousEpoch)
+		{
+			auto current = system_epoch_get();
+			// As for the devices, unsigned subtraction handles wrapping.
+			std::make_signed_t<decltype(current)> distance =
+			  current - previousEpoch;
+			if (AllowPartial)
+			{
+				return distance >= 0;
+			}
+			// If the current epoch is odd then the epoch needs to be at least
+			// two more, to capture the fact that this is a complete epoch.
+			decltype(distance) minimumRequired = 1 + (previousEpoch & 1);
+			return distance > minimumRequired;
+		}
+
+		/**
+		 * Start a pass, if one is not already running.
+		 */
+		void system_bg_revoker_kick()
+		{
+			advance();
+			CHERI::with_interrupts_disabled([&]() {
+				if ((epoch & 1) == 0)
+				{
+					epoch++;
+					currentRegion = 0;
+					chunkBase     = regions[0].base;
+					region_start();
+				}
+			});
+		}
+
+		/**
+		 * Block until the pass epoch `targetEpoch` has been reached, waiting
+		 * for the device to finish each region in turn.
+		 */
+		bool wait_for_completion(Timeout *timeout,
+		                         uint32_t targetEpoch) requires(
+		  SupportsInterruptNotification<Device>)
+		{
+			// A thread is blocked until the pass finishes, so finish it
+			// quickly.
+			rate = SweepRate::Aggressive;
+			while (!has_revocation_finished_for_epoch<true>(targetEpoch))
+			{
+				// If the last pass finished before reaching the target, start
+				// another.
+				system_bg_revoker_kick();
+				// The device's epoch is odd while it sweeps a region and
+				// advances to the next even value when it finishes.
+				if (!Device::wait_for_completion(timeout, deviceEpoch + 2))
+				{
+					return false;
+				}
+			}
+			return true;
+		}
+	};
+
+	/**
+	 * The device that `HardwareAccelerator` drives: the board's revoker,
+	 * wrapped in a `RegionSweeper` if the `hardware-revoker-regions` or
+	 * `hardware-revoker-gentle-chunk` build options are enabled and the
+	 * device supports sweeping ranges.
+	 */
+	template<typename T>
+	using SweepDevice =
+	  std::conditional_t<(HardwareRevokerRegions ||
+	                      (HardwareRevokerGentleChunk > 0)) &&
+	                       SupportsSweepRanges<T>,
+	                     RegionSweeper<T>,
+	                     T>;
+
 	template<typename WordT,
 	         size_t TCMBaseAddr,
 	         template<typename, size_t>
 	         typename Revoker>
 	requires IsHardwareRevokerDevice<Revoker<WordT, TCMBaseAddr>>
 	class HardwareAccelerator : public Bitmap<WordT, TCMBaseAddr>,
-	                            public Revoker<WordT, TCMBaseAddr>
+	                            public SweepDevice<Revoker<WordT, TCMBaseAddr>>
 	{
 		public:
 		/**
@@ -292,7 +647,7 @@ namespace Revocation
 		void init()
 		{
 			Bitmap<WordT, TCMBaseAddr>::init();
-			Revoker<WordT, TCMBaseAddr>::init();
+			SweepDevice<Revoker<WordT, TCMBaseAddr>>::init();
 		}
 	};
 
@@ -353,11 +708,21 @@ namespace Revocation
 
 		public:
 		/**
-		 * Software sweeping is implemented synchronously now. The sweeping is
-		 * done when memory is under pressure or malloc() failed. malloc() and
+		 * By default, software sweeping is synchronous. The sweeping is done
+		 * when memory is under pressure or malloc() failed. malloc() and
 		 * free() only return when a certain amount of sweeping is done.
+		 *
+		 * With `--software-revoker-background-thread=y`, an idle-priority
+		 * thread in the revoker compartment does the sweeping and the
+		 * allocator only starts passes and checks the epoch.
 		 */
-		static constexpr bool IsAsynchronous = false;
+		static constexpr bool IsAsynchronous =
+#ifdef CHERIOT_SOFTWARE_REVOKER_BACKGROUND_THREAD
+		  true
+#else
+		  false
+#endif
+		  ;
 
 		/**
 		 * Initialise the software revoker.
@@ -386,8 +751,9 @@ namespace Revocation
 		{
 			auto current = *epoch;
 			// If the revoker is running, prod it to do a bit more work every
-			// time that it's queried.
-			if ((current & 1) == 1)
+			// time that it's queried, unless its background thread is doing
+			// the work.
+			if (!IsAsynchronous && ((current & 1) == 1))
 			{
 				revoker_tick();
 				current = *epoch;
@@ -412,11 +778,65 @@ namespace Revocation
 			return distance > minimumRequired;
 		}
 
+		/**
+		 * Returns the percentage of the current revocation pass that has
+		 * completed, or 0 if revocation is not running.
+		 */
+		uint32_t system_progress_get()
+		{
+			return revoker_progress_get();
+		}
+
 		/// Start revocation running.
 		void system_bg_revoker_kick()
 		{
 			revoker_tick();
 		}
+
+		/**
+		 * Block until a complete revocation pass has run since `epoch`.
+		 * Without a background thread, the software revoker makes progress
+		 * only when it is called, so this performs one slice of work each
+		 * time it wakes.  Between slices it sleeps on the epoch futex for at
+		 * most one tick, so it wakes as soon as another thread completes the
+		 * pass rather than waiting out the tick.  With a background thread,
+		 * this sleeps on the epoch futex until the pass finishes or the
+		 * timeout expires.
+		 */
+		bool wait_for_completion(Timeout *timeout, uint32_t epoch)
+		{
+			while (!has_revocation_finished_for_epoch<false>(epoch))
+			{
+				if (!timeout->may_block())
+				{
+					return false;
+				}
+				uint32_t current = *this->epoch;
+				// If no pass is running, start one.
+				if ((current & 1) == 0)
+				{
+					revoker_tick();
+					current = *this->epoch;
+				}
+				// Recheck after reading the futex word, another thread may
+				// have finished the pass since we last looked.
+				if (has_revocation_finished_for_epoch<false>(epoch))
+				{
+					return true;
+				}
+				if constexpr (IsAsynchronous)
+				{
+					futex_timed_wait(timeout, this->epoch, current);
+				}
+				else
+				{
+					Timeout slice{1};
+					futex_timed_wait(&slice, this->epoch, current);
+					timeout->elapse(slice.elapsed);
+				}
+			}
+			return true;
+		}
 	};
 
 	template<typename WordT, size_t TCMBaseAddr>
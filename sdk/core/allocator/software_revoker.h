@@ -6,14 +6,37 @@
 
 /**
  * Prod the software revoker to do some work.  This does not do a complete
- * revocation pass, it will scan a region of memory and then return.
+ * revocation pass, it will scan a region of memory and then return.  With a
+ * background thread (see `revoker_background_run`), this starts a pass if
+ * one is not running and does not scan.
  */
 [[cheri::interrupt_state(disabled)]] __cheri_compartment(
   "software_revoker") void revoker_tick();
 
+/**
+ * Entry point for the software revoker's background thread, which the
+ * firmware rule adds when building with
+ * `--software-revoker-background-thread=y`.  This never returns: it sleeps
+ * until a revocation pass starts and then scans memory, one tick at a time,
+ * until the pass is complete.  `revoker_tick` then only starts passes.
+ */
+__cheri_compartment("software_revoker") void revoker_background_run();
+
 /**
  * Returns a read-only capability to the current revocation epoch.  If the low
  * bit of the epoch is 1 then revocation is running.  The revocation epoch will
  * wrap, the caller is responsible for handling overflow.
+ *
+ * The epoch may be used as a futex word: the revoker calls `futex_wake` on it
+ * each time that it changes.
  */
 const uint32_t *__cheri_compartment("software_revoker") revoker_epoch_get();
+
+/**
+ * Returns an estimate of how far through the current revocation pass the
+ * revoker is, as a percentage of the words that it must scan.  Returns 0 if
+ * revocation is not running.  A running pass never reports 100: completion is
+ * reported by the epoch advancing to an even value.
+ */
+[[cheri::interrupt_state(disabled)]] __cheri_compartment(
+  "software_revoker") uint32_t revoker_progress_get();
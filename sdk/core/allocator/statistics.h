@@ -0,0 +1,155 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <bit>
+#include <riscvreg.h>
+#include <stdlib.h>
+#include <timeout.h>
+
+/**
+ * Statistics collected by the allocator.  This is the disabled
+ * specialisation: every operation is a no-op and the object is empty, so
+ * an `MState` built without statistics support pays nothing for it.
+ */
+template<bool Enabled>
+struct AllocatorStatistics
+{
+	/// Reset all counters to zero.
+	void reset() {}
+
+	/// Increment one of the counters in `HeapStatistics`.
+	void count(uint32_t HeapStatistics::*) {}
+
+	/// Record an allocation request of `bytes` bytes in the histogram.
+	void record_allocation(size_t) {}
+
+	/// Copy the collected counters into `out`.
+	void copy_to(HeapStatistics &) {}
+};
+
+/**
+ * Statistics collected by the allocator.  This specialisation stores the
+ * counters in the layout that is reported to callers, so reporting is a copy.
+ */
+template<>
+struct AllocatorStatistics<true>
+{
+	HeapStatistics data;
+
+	/// Reset all counters to zero.
+	void reset()
+	{
+		data = {};
+	}
+
+	/// Increment one of the counters in `HeapStatistics`.
+	void count(uint32_t HeapStatistics::*field)
+	{
+		(data.*field)++;
+	}
+
+	/// Record an allocation request of `bytes` bytes in the histogram.
+	void record_allocation(size_t bytes)
+	{
+		size_t bucket = 0;
+		if (bytes > 16)
+		{
+			bucket = std::bit_width(bytes - 1) - 4;
+		}
+		if (bucket >= HEAP_STATISTICS_HISTOGRAM_BUCKETS)
+		{
+			bucket = HEAP_STATISTICS_HISTOGRAM_BUCKETS - 1;
+		}
+		data.allocationSizeHistogram[bucket]++;
+	}
+
+	/// Copy the collected counters into `out`.
+	void copy_to(HeapStatistics &out)
+	{
+		out = data;
+	}
+};
+
+/**
+ * Wrapper around a lock that records how many times it has been acquired and
+ * for how many cycles it has been held in total.  This exposes the same
+ * interface as the wrapped lock, so it can be used with `LockGuard`.
+ */
+template<typename Lock>
+class TimedLock
+{
+	/// The underlying lock.
+	Lock wrappedLock;
+
+	/// The cycle count at the point when the lock was last acquired.
+	uint64_t acquiredAt = 0;
+
+	/// Record that the lock has been acquired.
+	void acquired()
+	{
+		acquiredAt = rdcycle64();
+		acquisitions++;
+	}
+
+	public:
+	/// The number of times that the lock has been acquired.
+	uint32_t acquisitions = 0;
+
+	/// The total number of cycles for which the lock has been held.
+	uint64_t heldCycles = 0;
+
+	/// The largest number of cycles for which the lock has been held at once.
+	uint32_t maxHeldCycles = 0;
+
+	/// Acquire the lock, blocking indefinitely.
+	void lock()
+	{
+		wrappedLock.lock();
+		acquired();
+	}
+
+	/// Try to acquire the lock, blocking until `timeout` expires.
+	bool try_lock(Timeout *timeout)
+	{
+		if (wrappedLock.try_lock(timeout))
+		{
+			acquired();
+			return true;
+		}
+		return false;
+	}
+
+	/// Release the lock.
+	void unlock()
+	{
+		uint64_t held = rdcycle64() - acquiredAt;
+		heldCycles += held;
+		if (held > maxHeldCycles)
+		{
+			maxHeldCycles = static_cast<uint32_t>(held);
+		}
+		wrappedLock.unlock();
+	}
+};
+
+/**
+ * Copy lock statistics into `out`.  Locks that do not record statistics
+ * report nothing.
+ */
+template<typename Lock>
+void lock_statistics_get(Lock &, HeapStatistics &)
+{
+}
+
+/**
+ * Copy the statistics recorded by a `TimedLock` into `out`.
+ */
+template<typename Lock>
+void lock_statistics_get(TimedLock<Lock> &lock, HeapStatistics &out)
+{
+	out.lockAcquisitions  = lock.acquisitions;
+	out.lockHeldCycles    = lock.heldCycles;
+	out.lockMaxHeldCycles = lock.maxHeldCycles;
+}
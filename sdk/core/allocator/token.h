@@ -44,8 +44,13 @@ struct SObjStruct
 {
 	/// The sealing type for this object.
 	uint32_t type;
-	/// Padding for alignment
-	uint32_t padding;
+	/**
+	 * For objects in a token pool, the distance from the base of the current
+	 * handle to this header, which changes each time that the object is
+	 * recycled so that stale handles cannot be unsealed.  Zero for other
+	 * objects.
+	 */
+	uint32_t handleOffset;
 	/// The real data for this.
 	char data[];
 };
@@ -91,6 +96,7 @@ struct DebugFormatArgumentAdaptor<SealingKey>
 #include <assembly-helpers.h>
 
 EXPORT_ASSEMBLY_OFFSET(TokenSObj, type, 0);
+EXPORT_ASSEMBLY_OFFSET(TokenSObj, handleOffset, 4);
 EXPORT_ASSEMBLY_OFFSET(TokenSObj, data, 8);
 EXPORT_ASSEMBLY_NAME(CheriSealTypeAllocator, 11);
 EXPORT_ASSEMBLY_NAME(CheriSealTypeStaticToken, 12);
@@ -23,6 +23,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <thread-local.h>
 
 using namespace CHERI;
 
@@ -467,6 +468,134 @@ namespace
 	 */
 	Capability<void> trustedStackKey;
 
+	/**
+	 * Index of the export tables of the libraries and compartments, sorted by
+	 * start address.  Import resolution uses this to find the export table
+	 * that contains an address with a binary search, rather than scanning
+	 * every library and compartment for every import.
+	 *
+	 * The linker script cannot sort, so the loader builds the index once,
+	 * before populating import tables.  Images with more libraries and
+	 * compartments than the index can hold fall back to a linear scan.
+	 */
+	class ExportTableIndex
+	{
+		/// The maximum number of export tables that the index can hold.
+		static constexpr size_t Capacity = 128;
+
+		/// Convenience type for the compartment headers.
+		using Header = ImgHdr::CompartmentHeader;
+
+		/**
+		 * Indexes into the image's `libraries_and_compartments()` range,
+		 * sorted by export table start address.
+		 */
+		std::array<uint16_t, Capacity> entries{};
+
+		/// The number of valid elements in `entries`.
+		size_t count = 0;
+
+		/// True if the image has more export tables than `Capacity`.
+		bool overflowed = false;
+
+		public:
+		/**
+		 * Build the index for `image`.  Export tables with no entries can
+		 * never contain an import target and are omitted.
+		 */
+		void build(const ImgHdr &image)
+		{
+			auto          range   = image.libraries_and_compartments();
+			const Header *headers = range.begin();
+			auto          total = static_cast<size_t>(range.end() - headers);
+			if (total > Capacity)
+			{
+				Debug::log("{} export tables is too many to index, import "
+				           "resolution will scan all of them",
+				           static_cast<uint32_t>(total));
+				overflowed = true;
+				return;
+			}
+			count = 0;
+			// Insertion sort.  The linker usually lays out compartments in
+			// address order, so this is normally linear.
+			for (size_t i = 0; i < total; i++)
+			{
+				ptraddr_t start = headers[i].exportTable.start();
+				if (headers[i].exportTable.size() == 0)
+				{
+					continue;
+				}
+				size_t j = count++;
+				while ((j > 0) &&
+				       (headers[entries[j - 1]].exportTable.start() > start))
+				{
+					entries[j] = entries[j - 1];
+					j--;
+				}
+				entries[j] = static_cast<uint16_t>(i);
+			}
+		}
+
+		/**
+		 * Returns the header of the library or compartment whose export
+		 * table completely contains an object of type `T` at `address`, or
+		 * nullptr if there is no such library or compartment.
+		 */
+		template<typename T>
+		const Header *find(const ImgHdr &image, ptraddr_t address) const
+		{
+			const Header *headers = image.libraries_and_compartments().begin();
+			if (overflowed)
+			{
+				for (auto &header : image.libraries_and_compartments())
+				{
+					if (contains<T>(header.exportTable, address))
+					{
+						return &header;
+					}
+				}
+				return nullptr;
+			}
+			// Find the last export table that starts at or before `address`.
+			size_t low  = 0;
+			size_t high = count;
+			while (low < high)
+			{
+				size_t middle = (low + high) / 2;
+				if (headers[entries[middle]].exportTable.start() <= address)
+				{
+					low = middle + 1;
+				}
+				else
+				{
+					high = middle;
+				}
+			}
+			if (low == 0)
+			{
+				return nullptr;
+			}
+			const Header *header = &headers[entries[low - 1]];
+			return contains<T>(header->exportTable, address) ? header
+			                                                 : nullptr;
+		}
+
+		/**
+		 * Returns true if `header` is one of the image's libraries, false if
+		 * it is one of the compartments.
+		 */
+		static bool is_library(const ImgHdr &image, const Header *header)
+		{
+			return header < image.compartments().begin();
+		}
+	};
+
+	/**
+	 * The export table index for this image.
+	 */
+	ExportTableIndex exportTableIndex;
+
 	/**
 	 * Find an export table target.  This looks for the `target` address within
 	 * all of the export tables in the image.  The `size` parameter is used if
@@ -592,15 +721,14 @@ namespace
 				return seal_entry(pcc, ent->interrupt_status());
 			};
 			// If this is a libcall, set it up
-			for (auto &lib : image.libraries())
+			if (auto *lib = exportTableIndex.find<ExportEntry>(
+			      image, possibleLibcall);
+			    (lib != nullptr) && ExportTableIndex::is_library(image, lib))
 			{
-				if (contains<ExportEntry>(lib.exportTable, possibleLibcall))
-				{
-					// Library export tables are not used after the loader has
-					// run; our linker script places them to the end of the
-					// image, which we make available for the heap.
-					return createLibCall(build_pcc(lib));
-				}
+				// Library export tables are not used after the loader has
+				// run; our linker script places them to the end of the
+				// image, which we make available for the heap.
+				return createLibCall(build_pcc(*lib));
 			}
 			for (auto &compartment : image.privilegedCompartments)
 			{
@@ -677,18 +805,59 @@ namespace
 					};
 					bool found = findExport(image.allocator());
 					found |= findExport(image.scheduler());
-					for (auto &compartment : image.compartments())
+					if (!found)
 					{
-						if (found)
+						if (auto *compartment =
+						      exportTableIndex.find<ExportEntry>(image,
+						                                         typeAddress);
+						    (compartment != nullptr) &&
+						    !ExportTableIndex::is_library(image, compartment))
 						{
-							break;
+							findExport(*compartment);
 						}
-						found = findExport(compartment);
 					}
 					Debug::Invariant(*sealingType != typeAddress,
 					                 "Invalid sealed object {}",
 					                 typeAddress);
 				}
+				if (entry.is_unsealed_payload())
+				{
+					// Only the compartment that exports the sealing type may
+					// see the payload directly.  It could otherwise unseal the
+					// object itself, so this grants no new rights but saves an
+					// unseal on each use.
+					auto ownsType = [&](auto &compartment) {
+						auto &table = compartment.exportTable;
+						// Entries follow the header, which is not padded.
+						ptraddr_t address =
+						  table.start() +
+						  offsetof(ExportTable, errorHandlerStackless) +
+						  sizeof(uint16_t);
+						for (; contains<ExportEntry>(table, address);
+						     address += sizeof(ExportEntry))
+						{
+							auto exportEntry =
+							  build<ExportEntry>(table, address);
+							if (exportEntry->is_sealing_type() &&
+							    (exportEntry->functionStart == *sealingType))
+							{
+								return true;
+							}
+						}
+						return false;
+					};
+					Debug::Invariant(ownsType(sourceCompartment),
+					                 "Compartment does not own the sealing type "
+					                 "of static sealed object {}",
+					                 entry.address);
+					// The payload follows the sealing type and a padding word
+					// (see `DECLARE_STATIC_SEALED_VALUE`).
+					constexpr size_t HeaderSize = 2 * sizeof(uint32_t);
+					Capability payload = build(entry.address + HeaderSize,
+					                           entry.size() - HeaderSize);
+					Debug::log("Static sealed object payload: {}", payload);
+					return payload;
+				}
 				Capability sealedObject = build(entry.address, entry.size());
 				// Seal with the allocator's sealing key
 				sealedObject.seal(
@@ -706,12 +875,12 @@ namespace
 			}
 		}
 
-		for (auto &compartment : image.compartments())
+		if (auto *compartment =
+		      exportTableIndex.find<ExportEntry>(image, entry.address);
+		    (compartment != nullptr) &&
+		    !ExportTableIndex::is_library(image, compartment))
 		{
-			if (contains<ExportEntry>(compartment.exportTable, entry.address))
-			{
-				return buildExportEntry(compartment);
-			}
+			return buildExportEntry(*compartment);
 		}
 
 		return buildMMIO();
@@ -829,9 +998,10 @@ namespace
 	 */
 	void boot_threads_create(const ImgHdr &image, ThreadLoaderInfo *threadInfo)
 	{
-		// Two hazard pointers per thread.  More makes free slow, fewer is hard
+		// Hazard pointers per thread.  More makes free slower, fewer is hard
 		// to use.
-		static constexpr size_t HazardPointersPerThread = 2;
+		static constexpr size_t HazardPointersPerThread =
+		  CHERIOT_HAZARD_POINTERS_PER_THREAD;
 		Capability<void *>      hazardPointers =
 		  build<void *,
 		        Root::Type::RWGlobal,
@@ -863,29 +1033,40 @@ namespace
 		for (size_t i = 0; const auto &config : image.threads())
 		{
 			Debug::log("Creating thread {}", i);
-			auto findCompartment = [&]() -> auto &
-			{
-				for (auto &compartment : image.compartments())
+			// Find the compartment that exports the entry point.  This is
+			// usually an unprivileged compartment, but the software revoker
+			// may also own a thread.
+			Capability<void> pcc;
+			Capability<void> cgp;
+			Capability<void> exportTable;
+			auto             findCompartment = [&](const auto &compartment) {
+				Debug::log("Looking in export table {}+{}",
+				           compartment.exportTable.start(),
+				           compartment.exportTable.size());
+				if (!contains(compartment.exportTable, config.entryPoint))
 				{
-					Debug::log("Looking in export table {}+{}",
-					           compartment.exportTable.start(),
-					           compartment.exportTable.size());
-					if (contains(compartment.exportTable, config.entryPoint))
-					{
-						return compartment;
-					}
+					return false;
 				}
-				Debug::Invariant(
-				  false, "Compartment entry point is not a valid export");
-				__builtin_unreachable();
+				Debug::log("Creating thread in compartment {}", &compartment);
+				pcc         = build_pcc(compartment);
+				cgp         = build_cgp(compartment);
+				exportTable = build(compartment.exportTable);
+				return true;
 			};
-			const auto &compartment = findCompartment();
-			Debug::log("Creating thread in compartment {}", &compartment);
-			auto pcc = build_pcc(compartment);
+			bool found = false;
+			for (auto &compartment : image.compartments())
+			{
+				found = found || findCompartment(compartment);
+			}
+			for (auto &compartment : image.privilegedCompartments)
+			{
+				found = found || findCompartment(compartment);
+			}
+			Debug::Invariant(found,
+			                 "Compartment entry point is not a valid export");
 			pcc.address() +=
 			  build<ExportEntry>(config.entryPoint)->functionStart;
 			Debug::log("New thread's pcc will be {}", pcc);
-			void *cgp = build_cgp(compartment);
 			Debug::log("New thread's cgp will be {}", cgp);
 
 			auto threadTStack =
@@ -950,19 +1131,27 @@ namespace
 			  (priv::MSTATUS_MPIE |
 			   (priv::MSTATUS_PRV_M << priv::MSTATUS_MPP_SHIFT));
 #ifdef CONFIG_MSHWM
-			threadTStack->mshwm  = stack.top();
-			threadTStack->mshwmb = stack.base();
+			threadTStack->mshwm       = stack.top();
+			threadTStack->mshwmb      = stack.base();
+			threadTStack->mshwmLowest = stack.top();
 #endif
 			// Set the thread ID that the switcher will return for this thread.
 			// This is indexed from 1, so 0 can be used to indicate the idle
 			// thread.
 			threadTStack->threadID = i + 1;
+			// The switcher stores the thread ID at the top of the stack on
+			// each compartment call.  Do the same for the first invocation.
+			static_assert(INVOCATION_LOCAL_THREAD_ID_OFFSET ==
+			                STACK_ENTRY_RESERVED_SPACE,
+			              "Thread ID must be at the bottom of the reserved "
+			              "space");
+			*stack.cast<uint16_t>().get() = i + 1;
 
 			threadTStack->frameoffset = offsetof(TrustedStack, frames[1]);
-			threadTStack->frames[0].calleeExportTable =
-			  build(compartment.exportTable);
+			threadTStack->frames[0].calleeExportTable = exportTable;
 			// Special case: The first frame has the initial csp.
-			threadTStack->frames[0].csp = stack;
+			threadTStack->frames[0].csp         = stack;
+			threadTStack->frames[0].stackLowest = stack.address();
 
 			Debug::log("Thread's trusted stack is {}", threadTStack);
 
@@ -970,11 +1159,230 @@ namespace
 
 			threadInfo[i].trustedStack = threadTStack;
 			threadInfo[i].priority     = config.priority;
+			threadInfo[i].period       = config.period;
+			threadInfo[i].budget       = config.budget;
 			i++;
 		}
 		Debug::log("Finished creating threads");
 	}
 
+#if CHERIOT_LOADER_COMPRESSED_IMAGE
+	/**
+	 * Header of a compressed firmware image, written by
+	 * `scripts/compress_firmware.py` at `__compressed_image`, immediately
+	 * after the end of the image.  The compressed data follows the header.
+	 */
+	struct CompressedImageHeader
+	{
+		/// Magic value used to recognise a compressed image.
+		static constexpr uint32_t Magic = 0x347a6c63;
+
+		/// Must be `Magic` for a compressed image.
+		uint32_t magic;
+
+		/// Length in bytes of the compressed data.
+		uint32_t compressedSize;
+
+		/// Length in bytes of the data once decompressed.
+		uint32_t uncompressedSize;
+	};
+
+	/**
+	 * Decompress the compressible part of the image (the compartments' export
+	 * tables, code, globals, and sealed and shared objects) from the LZ4 block
+	 * that `scripts/compress_firmware.py` placed after the end of the image.
+	 *
+	 * This is a single forward pass over the compressed data, so it needs no
+	 * space other than the destination.  It runs before anything reads the
+	 * compressible part of the image.  If there is no compressed data then
+	 * the image was loaded uncompressed (for example, from the ELF file) and
+	 * this does nothing.
+	 */
+	void decompress_image()
+	{
+		ptraddr_t destinationStart = LA_ABS(__compressible_start);
+		size_t    destinationSize =
+		  LA_ABS(__compressible_end) - LA_ABS(__compressible_start);
+		auto header =
+		  build<const CompressedImageHeader>(LA_ABS(__compressed_image));
+		if ((header->magic != CompressedImageHeader::Magic) ||
+		    (header->uncompressedSize != destinationSize))
+		{
+			Debug::log("No compressed image found, assuming it is already "
+			           "decompressed");
+			return;
+		}
+		ptraddr_t sourceStart =
+		  LA_ABS(__compressed_image) + sizeof(CompressedImageHeader);
+		Debug::Invariant(sourceStart + header->compressedSize <=
+		                   LA_ABS(__export_mem_heap_end),
+		                 "Compressed image ({} bytes) extends past the end of "
+		                 "memory",
+		                 header->compressedSize);
+		Debug::log("Decompressing {} bytes to {} bytes at {}",
+		           header->compressedSize,
+		           header->uncompressedSize,
+		           destinationStart);
+		const uint8_t *source =
+		  build<const uint8_t,
+		        Root::Type::RWGlobal,
+		        Root::Permissions<Root::Type::RWGlobal>,
+		        false>(sourceStart, header->compressedSize);
+		const uint8_t *sourceEnd = source + header->compressedSize;
+		uint8_t       *destination =
+		  build<uint8_t,
+		        Root::Type::RWGlobal,
+		        Root::Permissions<Root::Type::RWGlobal>,
+		        false>(destinationStart, destinationSize);
+		uint8_t *const destinationBase = destination;
+		uint8_t *const destinationEnd  = destination + destinationSize;
+		// Read an LZ4 length extension: a run of 255 bytes terminated by a
+		// byte less than 255, all added to the 4-bit length in the token.
+		auto readLength = [&](size_t length) {
+			uint8_t next;
+			do
+			{
+				Debug::Invariant(source < sourceEnd,
+				                 "Truncated compressed image");
+				next = *source++;
+				length += next;
+			} while (next == 255);
+			return length;
+		};
+		while (source < sourceEnd)
+		{
+			uint8_t token         = *source++;
+			size_t  literalLength = token >> 4;
+			if (literalLength == 15)
+			{
+				literalLength = readLength(literalLength);
+			}
+			Debug::Invariant(
+			  (literalLength <= static_cast<size_t>(sourceEnd - source)) &&
+			    (literalLength <=
+			     static_cast<size_t>(destinationEnd - destination)),
+			  "Invalid literal run in compressed image");
+			memcpy(destination, source, literalLength);
+			destination += literalLength;
+			source += literalLength;
+			// The last sequence has literals and no match.
+			if (source == sourceEnd)
+			{
+				break;
+			}
+			Debug::Invariant(sourceEnd - source >= 2,
+			                 "Truncated compressed image");
+			size_t offset = source[0] | (size_t{source[1]} << 8);
+			source += 2;
+			size_t matchLength = token & 0xf;
+			if (matchLength == 15)
+			{
+				matchLength = readLength(matchLength);
+			}
+			matchLength += 4;
+			Debug::Invariant(
+			  (offset != 0) &&
+			    (offset <=
+			     static_cast<size_t>(destination - destinationBase)) &&
+			    (matchLength <=
+			     static_cast<size_t>(destinationEnd - destination)),
+			  "Invalid match in compressed image");
+			// Matches may overlap their own output, so copy byte by byte.
+			for (const uint8_t *match = destination - offset;
+			     matchLength > 0;
+			     matchLength--)
+			{
+				*destination++ = *match++;
+			}
+		}
+		Debug::Invariant(destination == destinationEnd,
+		                 "Compressed image decompressed to {} bytes, expected "
+		                 "{}",
+		                 static_cast<uint32_t>(destination - destinationBase),
+		                 static_cast<uint32_t>(destinationSize));
+	}
+#endif
+
+	/**
+	 * Returns true if the `size` bytes at `start` are all between `base` and
+	 * `top`.
+	 */
+	bool is_in_range(ptraddr_t start, size_t size, ptraddr_t base, ptraddr_t top)
+	{
+		return (start >= base) && (start + size <= top);
+	}
+
+	/**
+	 * Copy the code that the firmware placed in fast instruction memory from
+	 * its load image, which follows the rest of the code in the image.  This
+	 * runs before anything reads or writes that code, including the import
+	 * tables and sealing keys in it.
+	 */
+	void copy_fast_code()
+	{
+		size_t size = LA_ABS(__fast_code_end) - LA_ABS(__fast_code_start);
+		if (size == 0)
+		{
+			return;
+		}
+		Debug::log("Copying {} bytes of code to fast memory at {}",
+		           size,
+		           LA_ABS(__fast_code_start));
+		auto *destination = build<uint8_t,
+		                          Root::Type::RWGlobal,
+		                          Root::Permissions<Root::Type::RWGlobal>,
+		                          false>(LA_ABS(__fast_code_start), size);
+		auto *source      = build<const uint8_t,
+		                          Root::Type::RWGlobal,
+		                          Root::Permissions<Root::Type::RWGlobal>,
+		                          false>(LA_ABS(__fast_code_load_start), size);
+		memcpy(destination, source, size);
+	}
+
+	/**
+	 * Set the bounded-stack flag on each export table entry listed with
+	 * `CHERIOT_BOUNDED_STACK_EXPORT`.  Only compartment entry points may be
+	 * marked.
+	 */
+	void mark_bounded_stack_exports(const ImgHdr &image)
+	{
+		for (ptraddr_t marker = LA_ABS(__bounded_stack_exports);
+		     marker < LA_ABS(__bounded_stack_exports_end);
+		     marker += sizeof(uint32_t))
+		{
+			ptraddr_t entryAddress = *build<uint32_t>(marker);
+			auto      markExport   = [&](auto &compartment) {
+				if (!contains<ExportEntry>(compartment.exportTable,
+				                           entryAddress))
+				{
+					return false;
+				}
+				auto exportEntry =
+				  build<ExportEntry>(compartment.exportTable, entryAddress);
+				Debug::Invariant(!exportEntry->is_sealing_type(),
+				                 "Bounded stack marker {} refers to a sealing "
+				                 "type",
+				                 entryAddress);
+				exportEntry->flags |= ExportEntry::BoundedStack;
+				return true;
+			};
+			bool found = markExport(image.allocator());
+			found |= markExport(image.scheduler());
+			for (auto &compartment : image.compartments())
+			{
+				if (found)
+				{
+					break;
+				}
+				found = markExport(compartment);
+			}
+			Debug::Invariant(found,
+			                 "Bounded stack marker {} does not refer to an "
+			                 "export table entry",
+			                 entryAddress);
+		}
+	}
+
 	/**
 	 * Resolve capability relocations.
 	 *
@@ -998,17 +1406,55 @@ namespace
 			}
 		} capRelocsSection;
 
-		// Find the library compartment that contains an address in its code or
-		// data section.
-		auto findCompartment = [&](ptraddr_t address) -> auto &
+		// The capabilities that relocations for one compartment are derived
+		// from.  The linker emits the relocations for each compartment
+		// together, so these are built once for each run of relocations that
+		// target the same compartment, rather than once for each relocation.
+		struct
 		{
+			/// The compartment that the roots below were built for.
+			const ImgHdr::CompartmentHeader *compartment = nullptr;
+			/// Compartment's PCC, used to derive function pointers.
+			Capability<void> pcc;
+			/**
+			 * Compartment's PCC with execute dropped.  Used for pointers to
+			 * read-only globals.
+			 */
+			Capability<void> ropcc;
+			/**
+			 * Compartment's globals region, used to derive pointers to globals
+			 * and to write to globals.
+			 */
+			Capability<void> cgp;
+			/// Compartment's code region, used to write to read-only data.
+			Capability<void> code;
+		} roots;
+
+		// Find the library compartment that contains an address in its code or
+		// data section and build the roots for it, unless the roots for the
+		// previous relocation already cover it.
+		auto findCompartment = [&](ptraddr_t address) {
+			if ((roots.compartment != nullptr) &&
+			    (contains(roots.compartment->code, address) ||
+			     contains(roots.compartment->data, address)))
+			{
+				return;
+			}
 			Debug::log("Capreloc address is {}", address);
 			for (auto &compartment : image.libraries_and_compartments())
 			{
 				if (contains(compartment.code, address) ||
 				    contains(compartment.data, address))
 				{
-					return compartment;
+					roots.compartment = &compartment;
+					roots.pcc         = build_pcc(compartment);
+					roots.ropcc       = roots.pcc;
+					roots.ropcc.permissions() &=
+					  roots.pcc.permissions().without(Permission::Execute);
+					roots.cgp  = build_cgp(compartment, false);
+					roots.code = build<void, Root::Type::RWGlobal>(
+					  compartment.code);
+					return;
 				}
 			}
 			Debug::Invariant(false, "Cannot find compartment for cap reloc");
@@ -1023,33 +1469,15 @@ namespace
 			Debug::log(
 			  "Capreloc address: {}, base: {}", reloc.addr, reloc.base);
 			// Find the compartment that this relocation applies to.
-			const auto &compartment = findCompartment(reloc.addr);
-
-			// Compartment's PCC, used to derive function pointers.
-			auto pcc = build_pcc(compartment);
-			// Compartment's PCC with execute dropped.  Used for pointers to
-			// read-only globals.
-			auto ropcc = pcc;
-			ropcc.permissions() &=
-			  pcc.permissions().without(Permission::Execute);
-			// Compartment's globals region, used to derive pointers to globals
-			// and to write to globals.
-			auto cgp = build_cgp(compartment, false);
-
-			Capability<void> locationRegion;
+			findCompartment(reloc.addr);
+			const auto &compartment = *roots.compartment;
+
 			// Cap relocs for a compartment must point to that compartment's
-			// code or data regions.
-			if (contains(compartment.code, reloc.addr))
-			{
-				locationRegion =
-				  build<void, Root::Type::RWGlobal>(compartment.code);
-			}
-			else if (contains(compartment.data, reloc.addr))
-			{
-				locationRegion = cgp;
-			}
-			// The location is the address of the reloc, bounded to the region.
-			Capability<void *> location{locationRegion.cast<void *>()};
+			// code or data regions.  The location is the address of the
+			// reloc, bounded to the region.
+			Capability<void *> location{
+			  (contains(compartment.code, reloc.addr) ? roots.code : roots.cgp)
+			    .cast<void *>()};
 			location.address()      = reloc.addr;
 			size_t           offset = reloc.offset;
 			Capability<void> cap;
@@ -1061,17 +1489,17 @@ namespace
 				// FIXME: In our ABI the linker should emit function pointer
 				// bounds to be the whole .pcc section, not a single function.
 				offset += reloc.base - compartment.code.start();
-				cap = pcc;
+				cap = roots.pcc;
 			}
 			else
 			{
 				if (contains(compartment.code, reloc.base))
 				{
-					cap = ropcc;
+					cap = roots.ropcc;
 				}
 				else if (contains(compartment.data, reloc.base))
 				{
-					cap = cgp;
+					cap = roots.cgp;
 				}
 				else
 				{
@@ -1090,11 +1518,126 @@ namespace
 			Debug::log("Writing cap reloc {}\nto  {}\nPCC {}\nCGP {}",
 			           cap,
 			           location,
-			           pcc,
-			           cgp);
+			           roots.pcc,
+			           roots.cgp);
 			*location = cap;
 		}
 	}
+
+	/**
+	 * Boot-time profile.  When `ProfileLoader` is true, this records the
+	 * cycle counter around each loader phase and reports the cycles spent in
+	 * each phase (and, for the per-compartment phases, in each compartment)
+	 * with `Profile::log`.  Each report is on a line starting with
+	 * `boot-profile`.  When `ProfileLoader` is false, every method is empty.
+	 *
+	 * Cycles spent writing the reports to the UART are excluded from the
+	 * phase and total counts, so enabling the profile does not inflate the
+	 * numbers that it reports.  Counts are truncated to 32 bits.
+	 */
+	class BootProfile
+	{
+		/// Cycle counter on entry to the loader.
+		uint64_t bootStart = 0;
+
+		/// Cycle counter at the start of the current phase.
+		uint64_t phaseStart = 0;
+
+		/// Cycles spent reporting during the current phase.
+		uint64_t phaseReporting = 0;
+
+		/// Cycles spent reporting since entry to the loader.
+		uint64_t totalReporting = 0;
+
+		/**
+		 * Log a profile line, accounting the time taken to do so as
+		 * reporting time.
+		 */
+		template<typename... Args>
+		void report(DebugFormatString<std::type_identity_t<Args>...> fmt,
+		            Args... args)
+		{
+			uint64_t start = rdcycle64();
+			Profile::log(fmt, args...);
+			uint64_t cost = rdcycle64() - start;
+			phaseReporting += cost;
+			totalReporting += cost;
+		}
+
+		public:
+		/**
+		 * Start the profile.  This should be constructed as early as possible
+		 * in the loader.
+		 */
+		BootProfile()
+		{
+			if constexpr (ProfileLoader)
+			{
+				bootStart  = rdcycle64();
+				phaseStart = bootStart;
+			}
+		}
+
+		/**
+		 * Report the phase called `name` as finished and start the next one.
+		 */
+		void phase(const char *name)
+		{
+			if constexpr (ProfileLoader)
+			{
+				uint64_t now = rdcycle64();
+				uint64_t elapsed = now - phaseStart - phaseReporting;
+				report("boot-profile phase {} {}",
+				       name,
+				       static_cast<uint32_t>(elapsed));
+				phaseReporting = 0;
+				phaseStart     = rdcycle64();
+			}
+		}
+
+		/**
+		 * Run `body` for the compartment described by `header` as part of the
+		 * phase called `name` and report the cycles that it took along with
+		 * the compartment's code address.
+		 */
+		void compartment(const char *name, const auto &header, auto &&body)
+		{
+			if constexpr (ProfileLoader)
+			{
+				uint64_t start = rdcycle64();
+				body();
+				uint64_t elapsed = rdcycle64() - start;
+				report("boot-profile compartment {} {} {}",
+				       name,
+				       header.code.start(),
+				       static_cast<uint32_t>(elapsed));
+			}
+			else
+			{
+				body();
+			}
+		}
+
+		/**
+		 * Report the cycles from reset to the end of the loader and the
+		 * cycles spent in the loader.  The heap is zeroed by the boot
+		 * assembly after the loader returns and so is reported as its size
+		 * only.
+		 */
+		void finish()
+		{
+			if constexpr (ProfileLoader)
+			{
+				uint64_t now = rdcycle64();
+				report("boot-profile heap-zero-bytes {}",
+				       static_cast<uint32_t>(LA_ABS(__export_mem_heap_end) -
+				                             LA_ABS(__export_mem_heap)));
+				report("boot-profile total {} since-reset {}",
+				       static_cast<uint32_t>(now - bootStart - totalReporting),
+				       static_cast<uint32_t>(now - totalReporting));
+			}
+		}
+	};
 } // namespace
 
 // The parameters are passed by the boot assembly sequence.
@@ -1117,6 +1660,8 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 	// caller and which can subsequently be passed to the scheduler.
 	SchedulerEntryInfo ret;
 
+	BootProfile profile;
+
 	// Populate the 4 roots from system registers.
 	Root::install_root<Root::ISAType::Execute>(almightyPCC);
 	Root::install_root<Root::ISAType::Seal>(almightySeal);
@@ -1132,14 +1677,22 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 	uart->init();
 
 	// Set up the UART that's used for debug output.
-	if constexpr (DebugLoader)
+	if constexpr (DebugLoader || ProfileLoader)
 	{
-		// Set the UART.  `Debug::log` and `Debug::Invariant` work after this
-		// point.
+		// Set the UART.  `Debug::log`, `Debug::Invariant`, and `Profile::log`
+		// work after this point.
 		LoaderWriter::set_uart(uart);
 	}
 
 	Debug::log("UART initialised!");
+
+#if CHERIOT_LOADER_COMPRESSED_IMAGE
+	// Nothing before this point reads the compressible part of the image.
+	decompress_image();
+	profile.phase("decompress");
+#endif
+	copy_fast_code();
+
 	Debug::log("Header: {}", &imgHdr);
 	Debug::log("Magic number: {}", imgHdr.magic);
 
@@ -1148,34 +1701,42 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 	                 imgHdr.magic);
 
 	// Do some sanity checking on the headers.
-	ptraddr_t lastCodeEnd = LA_ABS(__compart_pccs);
-	ptraddr_t lastDataEnd = LA_ABS(__compart_cgps);
-	int       i           = 0;
+	ptraddr_t lastCodeEnd     = LA_ABS(__compart_pccs);
+	ptraddr_t lastFastCodeEnd = LA_ABS(__fast_code_start);
+	ptraddr_t lastDataEnd     = LA_ABS(__compart_cgps);
+	int       i               = 0;
 	Debug::log("Checking compartments");
 	for (auto &header : imgHdr.libraries_and_compartments())
 	{
 		Debug::log("Checking compartment headers for compartment {}", i);
+		// Code is either with the rest of the code in the image or in fast
+		// instruction memory.  Each range is in the same order as the headers.
+		bool isFast = is_in_range(header.code.start(),
+		                          header.code.size(),
+		                          LA_ABS(__fast_code_start),
+		                          LA_ABS(__fast_code_end));
+		ptraddr_t &previousEnd = isFast ? lastFastCodeEnd : lastCodeEnd;
 		Debug::Invariant(
-		  header.code.start() >= LA_ABS(__compart_pccs),
-		  "Compartment {} PCC ({}) is before the PCC section start {}",
-		  i,
-		  header.code.start(),
-		  LA_ABS(__compart_pccs));
-		Debug::Invariant(
-		  header.code.start() + header.code.size() <=
-		    LA_ABS(__compart_pccs_end),
-		  "Compartment {} PCC ({} + {}) extends after the PCC section end {}",
+		  isFast || is_in_range(header.code.start(),
+		                        header.code.size(),
+		                        LA_ABS(__compart_pccs),
+		                        LA_ABS(__compart_pccs_end)),
+		  "Compartment {} PCC ({} + {}) is outside the PCC section ({}--{}) "
+		  "and fast code ({}--{})",
 		  i,
 		  header.code.start(),
 		  header.code.size(),
-		  LA_ABS(__compart_pccs_end));
+		  LA_ABS(__compart_pccs),
+		  LA_ABS(__compart_pccs_end),
+		  LA_ABS(__fast_code_start),
+		  LA_ABS(__fast_code_end));
 		Debug::Invariant(
-		  header.code.start() >= lastCodeEnd,
+		  header.code.start() >= previousEnd,
 		  "Compartment {} overlaps previous compartment ({} < {}",
 		  i,
 		  header.code.start(),
-		  lastCodeEnd);
-		lastCodeEnd = header.code.start() + header.code.size();
+		  previousEnd);
+		previousEnd = header.code.start() + header.code.size();
 		if (header.data.size() != 0)
 		{
 			Debug::Invariant(
@@ -1202,8 +1763,11 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 		lastDataEnd = header.data.start() + header.data.size();
 		i++;
 	}
+	profile.phase("headers");
 
 	populate_caprelocs(imgHdr);
+	mark_bounded_stack_exports(imgHdr);
+	profile.phase("caprelocs");
 
 	auto switcherPCC = build<void, Root::Type::Execute, SwitcherPccPermissions>(
 	  imgHdr.switcher.code);
@@ -1300,6 +1864,7 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 	              FirstDynamicSoftware,
 	              DynamicSealingLength,
 	              sizeof(void *));
+	profile.phase("sealing-keys");
 
 	// Set up export tables
 
@@ -1329,35 +1894,49 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 		expTablePtr->pcc = build_pcc(compartment);
 		expTablePtr->cgp = build_cgp(compartment);
 	}
+	profile.phase("export-tables");
 
 	Debug::log("First pass to find sealing key imports");
 
 	// Populate import entries that refer to static sealing keys first.
 	for (auto &compartment : imgHdr.privilegedCompartments)
 	{
-		populate_static_sealing_keys(imgHdr, compartment);
+		profile.compartment("static-sealing-keys", compartment, [&]() {
+			populate_static_sealing_keys(imgHdr, compartment);
+		});
 	}
 
 	for (auto &compartment : imgHdr.libraries_and_compartments())
 	{
-		populate_static_sealing_keys(imgHdr, compartment);
+		profile.compartment("static-sealing-keys", compartment, [&]() {
+			populate_static_sealing_keys(imgHdr, compartment);
+		});
 	}
+	profile.phase("static-sealing-keys");
 
 	Debug::log("Creating import tables");
 
+	exportTableIndex.build(imgHdr);
+
 	// Populate import tables.
 	for (auto &compartment : imgHdr.privilegedCompartments)
 	{
-		populate_imports(imgHdr, compartment, switcherPCC);
+		profile.compartment("imports", compartment, [&]() {
+			populate_imports(imgHdr, compartment, switcherPCC);
+		});
 	}
 
 	for (auto &compartment : imgHdr.libraries_and_compartments())
 	{
-		populate_imports(imgHdr, compartment, switcherPCC);
+		profile.compartment("imports", compartment, [&]() {
+			populate_imports(imgHdr, compartment, switcherPCC);
+		});
 	}
+	profile.phase("imports");
 
 	Debug::log("Creating boot threads\n");
 	boot_threads_create(imgHdr, ret.threads);
+	profile.phase("threads");
 	// Provide the switcher with the capabilities for entering the scheduler.
 	void *schedCGP = build_cgp(imgHdr.scheduler());
 	auto  exceptionEntryOffset =
@@ -1374,6 +1953,30 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 	  schedExceptionEntry;
 	*build<void *>(imgHdr.switcher.code, imgHdr.switcher.scheduler_cgp()) =
 	  schedCGP;
+#ifdef CHERIOT_SWITCHER_CALL_COUNTERS
+	// Give the switcher the call counters, one 32-bit counter for each word of
+	// the compartment export tables.
+	*build<void *>(imgHdr.switcher.code, LA_ABS(switcher_call_counters)) =
+	  build<void,
+	        Root::Type::RWGlobal,
+	        PermissionSet{
+	          Permission::Global, Permission::Load, Permission::Store}>(
+	    LA_ABS(__cheriot_shared_object_switcher_call_counters),
+	    LA_ABS(__cheriot_shared_object_switcher_call_counters_end) -
+	      LA_ABS(__cheriot_shared_object_switcher_call_counters));
+#endif
+#ifdef CHERIOT_SWITCHER_STACK_PEAKS
+	// Give the switcher the stack peaks, one 32-bit record for each word of
+	// the compartment export tables.
+	*build<void *>(imgHdr.switcher.code, LA_ABS(switcher_stack_peaks)) =
+	  build<void,
+	        Root::Type::RWGlobal,
+	        PermissionSet{
+	          Permission::Global, Permission::Load, Permission::Store}>(
+	    LA_ABS(__cheriot_shared_object_switcher_stack_peaks),
+	    LA_ABS(__cheriot_shared_object_switcher_stack_peaks_end) -
+	      LA_ABS(__cheriot_shared_object_switcher_stack_peaks));
+#endif
 	// The scheduler will inherit our stack once we're done with it
 	Capability<void> csp = ({
 		register void *cspRegister asm("csp");
@@ -1467,6 +2070,8 @@ extern "C" SchedulerEntryInfo loader_entry_point(const ImgHdr &imgHdr,
 
 	ret.schedPCC = schedPCC;
 	ret.schedCGP = schedCGP;
+	profile.phase("scheduler-entry");
+	profile.finish();
 	return ret;
 }
 
@@ -563,4 +563,15 @@ namespace
 	 * initialises the UART.
 	 */
 	using Debug = LoaderDebug<DebugLoader>;
+
+	/**
+	 * Is boot-time profiling enabled in the loader?
+	 */
+	static constexpr bool ProfileLoader = CHERIOT_LOADER_BOOT_PROFILE;
+
+	/**
+	 * Output interface for the boot-time profile.  This writes only if
+	 * `ProfileLoader` is true, independently of `DebugLoader`.
+	 */
+	using Profile = LoaderDebug<ProfileLoader>;
 } // namespace
@@ -808,6 +808,16 @@ namespace loader
 			 * The location for the trusted stack for this thread.
 			 */
 			AddressRange trustedStack;
+			/**
+			 * The period of this thread, in ticks, if it is deadline
+			 * scheduled, or zero otherwise.
+			 */
+			uint16_t period;
+			/**
+			 * The number of ticks that this thread may run for in each
+			 * period.  Zero if the thread is not deadline scheduled.
+			 */
+			uint16_t budget;
 		};
 
 		/**
@@ -901,16 +911,24 @@ namespace loader
 		                                          PermitLoadStoreCapabilities |
 		                                          PermitLoadMutable;
 
+		/**
+		 * Bit in `sizeAndPermissions` indicating that this import of a static
+		 * sealed object should be the unsealed payload, rather than the
+		 * sealed object.  This must match
+		 * `CHERIOT_STATIC_SEALED_PAYLOAD_IMPORT` in `compartment-macros.h`.
+		 */
+		static constexpr size_t UnsealedPayload = (1UL << 24);
+
 		/**
 		 * Mask for the space reserved for permissions.
 		 */
 		static constexpr size_t ReservedPermissionsMask = 0xff000000;
 
 		/**
-		 * Mask for the space not used yet for permissions.
+		 * Mask for the space not used yet for permissions or flags.
 		 */
 		static constexpr size_t UnusedPermissionsMask =
-		  ReservedPermissionsMask & ~PermissionsMask;
+		  ReservedPermissionsMask & ~(PermissionsMask | UnsealedPayload);
 
 		static_assert(
 		  (PermissionsMask & ReservedPermissionsMask) == PermissionsMask,
@@ -963,6 +981,15 @@ namespace loader
 			return sizeAndPermissions & SizeMask;
 		}
 
+		/**
+		 * Returns true if this is an import of the unsealed payload of a
+		 * static sealed object.
+		 */
+		[[nodiscard]] bool is_unsealed_payload() const
+		{
+			return (sizeAndPermissions & UnsealedPayload) != 0;
+		}
+
 		/**
 		 * The permissions requested for this MMIO export.
 		 */
@@ -1100,6 +1127,19 @@ namespace loader
 
 		static_assert((InterruptStatusMask & SealingTypeEntry) == 0);
 
+		/**
+		 * The flag indicating that this function uses no more stack than
+		 * `minimumStackSize`.  The switcher gives the callee a stack bounded
+		 * to that size (plus the space that it reserves for unwinding) and
+		 * zeroes only that window on call and return, rather than the whole
+		 * of the caller's unused stack.  This is set by the loader for entries
+		 * listed with `CHERIOT_BOUNDED_STACK_EXPORT`.
+		 */
+		static constexpr uint8_t BoundedStack = uint8_t(0b1000000);
+
+		static_assert(((InterruptStatusMask | SealingTypeEntry) &
+		               BoundedStack) == 0);
+
 		/**
 		 * The offset from the start of this compartment's PCC of the called
 		 * function.
@@ -1117,7 +1157,8 @@ namespace loader
 		/**
 		 * Flags.  The low three bits indicate the number of registers that
 		 * should be passed in the compartment switcher.  The next two bits
-		 * indicate the interrupt status.  The remaining three are currently
+		 * indicate the interrupt status.  The next two are
+		 * `SealingTypeEntry` and `BoundedStack`.  The high bit is currently
 		 * unused.
 		 */
 		uint8_t flags;
@@ -1139,6 +1180,15 @@ namespace loader
 		{
 			return (flags & SealingTypeEntry);
 		}
+
+		/**
+		 * Returns true if callers of this export table entry should give it
+		 * a stack bounded to its minimum stack size.
+		 */
+		bool has_bounded_stack()
+		{
+			return (flags & BoundedStack);
+		}
 	};
 
 #include "../switcher/export-table-assembly.h"
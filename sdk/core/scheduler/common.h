@@ -30,6 +30,67 @@ namespace
 #endif
 	  ;
 
+	/**
+	 * Are interrupts delivered directly to the thread bound to them, with
+	 * PLIC threshold masking while that thread runs?
+	 */
+	constexpr bool InterruptHandlerThreads =
+#ifdef SCHEDULER_INTERRUPT_HANDLER_THREADS
+	  SCHEDULER_INTERRUPT_HANDLER_THREADS
+#else
+	  false
+#endif
+	  ;
+
+	/**
+	 * The number of entries in the scheduler trace ring buffer, or zero if
+	 * tracing is disabled.
+	 */
+	constexpr size_t TraceEntries =
+#ifdef SCHEDULER_TRACE_ENTRIES
+	  SCHEDULER_TRACE_ENTRIES
+#else
+	  0
+#endif
+	  ;
+
+	/**
+	 * The number of samples in the sampling profiler's ring buffer, or zero
+	 * if profiling is disabled.
+	 */
+	constexpr size_t ProfileSamples =
+#ifdef SCHEDULER_PROFILE_SAMPLES
+	  SCHEDULER_PROFILE_SAMPLES
+#else
+	  0
+#endif
+	  ;
+
+	/**
+	 * The number of cycles between profiler samples while a thread is
+	 * running, or zero to sample only on timer interrupts that are needed for
+	 * scheduling.
+	 */
+	constexpr uint64_t ProfilePeriod =
+#if defined(SCHEDULER_PROFILE_PERIOD) && defined(SCHEDULER_PROFILE_SAMPLES)
+	  (SCHEDULER_PROFILE_SAMPLES > 0) ? SCHEDULER_PROFILE_PERIOD : 0
+#else
+	  0
+#endif
+	  ;
+
+	/**
+	 * Are some threads limited to a CPU budget in each replenishment period
+	 * (the `cpu_budget` and `cpu_period` thread options)?
+	 */
+	constexpr bool CpuBudgets =
+#ifdef SCHEDULER_CPU_BUDGETS
+	  true
+#else
+	  false
+#endif
+	  ;
+
 	using Debug = ConditionalDebug<DebugScheduler, "Scheduler">;
 
 	constexpr StackCheckMode StackMode =
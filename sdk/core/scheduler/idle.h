@@ -0,0 +1,142 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "thread.h"
+#include "timer.h"
+#include <array>
+#include <platform-idle.hh>
+#include <stdint.h>
+#include <thread.h>
+
+namespace
+{
+	static_assert(IsIdleController<IdleController>,
+	              "Platform's idle controller does not meet the required "
+	              "interface");
+	static_assert(IdleController::States.size() > 0,
+	              "Platform's idle controller must provide at least one state");
+
+	/**
+	 * Selection of the low-power state that the idle thread waits in.
+	 * Platforms that have only a plain `wfi` state pay nothing for this.
+	 */
+	class Idle final : private IdleController
+	{
+		/// The number of states that the platform provides.
+		static constexpr size_t StateCount = States.size();
+
+		/// Does the platform have any state deeper than a plain `wfi`?
+		static constexpr bool HasDeepStates = StateCount > 1;
+
+		/**
+		 * The longest wake latency that each thread tolerates, in timer
+		 * cycles, indexed by thread ID minus one.
+		 */
+		inline static std::array<uint32_t, CONFIG_THREADS_NUM> latencyLimits;
+
+		/// The state that the idle thread was last prepared to enter.
+		inline static size_t activeState = 0;
+
+		/// Has `enter` been called without a matching `exit`?
+		inline static bool isIdle = false;
+
+		/// The time at which `activeState` was entered.
+		inline static uint64_t enteredAt = 0;
+
+		/**
+		 * Returns the shortest wake latency that any thread tolerates.
+		 */
+		static uint32_t latency_limit()
+		{
+			uint32_t limit = ThreadWakeLatencyUnlimited;
+			for (uint32_t threadLimit : latencyLimits)
+			{
+				limit = std::min(limit, threadLimit);
+			}
+			return limit;
+		}
+
+		public:
+		/// The number of times that each state has been entered.
+		inline static std::array<uint32_t, StateCount> entries;
+
+		/**
+		 * The number of timer cycles spent in each state, including the
+		 * time taken to enter and leave it.  This is recorded only on
+		 * platforms with deep states.
+		 */
+		inline static std::array<uint64_t, StateCount> residency;
+
+		/**
+		 * Initialise the state, before any thread runs.
+		 */
+		static void init()
+		{
+			latencyLimits.fill(ThreadWakeLatencyUnlimited);
+		}
+
+		/**
+		 * Record that the thread with the given ID tolerates a wake latency
+		 * of at most `cycles`.
+		 */
+		static void latency_limit_set(uint16_t threadId, uint32_t cycles)
+		{
+			latencyLimits[threadId - 1] = cycles;
+		}
+
+		/**
+		 * Choose a state for the idle thread, which is about to run, and
+		 * prepare the hardware to enter it.  The state is the deepest one
+		 * whose transition cost is less than the time until the next timer
+		 * expiry and whose wake latency every thread tolerates.  This should
+		 * be called after `Timer::update`.
+		 */
+		static void enter()
+		{
+			size_t state = 0;
+			if constexpr (HasDeepStates)
+			{
+				uint64_t now       = Timer::time();
+				uint64_t next      = Timer::next_wake();
+				uint64_t available = (next > now) ? next - now : 0;
+				uint32_t limit     = latency_limit();
+				for (size_t i = StateCount - 1; i > 0; i--)
+				{
+					if ((States[i].transitionCycles < available) &&
+					    (States[i].wakeLatencyCycles <= limit))
+					{
+						state = i;
+						break;
+					}
+				}
+				enteredAt = now;
+			}
+			activeState = state;
+			isIdle      = true;
+			entries[state]++;
+			IdleController::enter(state);
+		}
+
+		/**
+		 * Leave the state that the idle thread was waiting in.  This should
+		 * be called on entry to the scheduler from the idle thread.
+		 */
+		static void exit()
+		{
+			// The first entry to the scheduler, at boot, is from the idle
+			// thread before it has been given a state.
+			if (!isIdle)
+			{
+				return;
+			}
+			isIdle = false;
+			IdleController::exit(activeState);
+			if constexpr (HasDeepStates)
+			{
+				residency[activeState] += Timer::time() - enteredAt;
+			}
+		}
+	};
+} // namespace
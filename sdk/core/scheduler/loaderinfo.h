@@ -18,4 +18,8 @@ struct ThreadLoaderInfo
 	TrustedStack *trustedStack;
 	/// Thread priority. The higher the more prioritised.
 	uint16_t priority;
+	/// Period in ticks for deadline-scheduled threads, zero for others.
+	uint16_t period;
+	/// Ticks of CPU time per period for deadline-scheduled threads.
+	uint16_t budget;
 };
@@ -4,10 +4,15 @@
 #define CHERIOT_NO_AMBIENT_MALLOC
 #define CHERIOT_NO_NEW_DELETE
 #include "../switcher/tstack.h"
+#include "idle.h"
 #include "multiwait.h"
 #include "plic.h"
+#include "profile.h"
 #include "thread.h"
 #include "timer.h"
+#include "trace.h"
+#include <array>
+#include <bit>
 #include <cdefs.h>
 #include <cheri.hh>
 #include <compartment.h>
@@ -20,6 +25,7 @@
 #include <simulator.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <switcher.h>
 #include <thread.h>
 #include <token.h>
 
@@ -45,9 +51,109 @@ static uint64_t cyclesAtLastSchedulingEvent;
 namespace
 {
 	/**
-	 * Priority-sorted list of threads waiting for a futex.
+	 * The number of compartments that can have cycles accounted to them.
 	 */
-	Thread *futexWaitingList;
+	constexpr size_t AccountingCompartments = Accounting ? 32 : 0;
+
+	/**
+	 * Cycles accounted to each compartment, identified by the base of its
+	 * export table.  Entries are allocated in the order in which compartments
+	 * are first seen and are never freed.
+	 */
+	std::array<CompartmentCycles, AccountingCompartments> compartmentCycles;
+
+	/**
+	 * The number of entries in `compartmentCycles` that are in use.
+	 */
+	size_t compartmentCyclesUsed;
+
+	/**
+	 * Charge `cycles` to the compartment whose export table starts at
+	 * `compartment`.  If the table is full, the cycles are charged only to the
+	 * thread.
+	 */
+	void compartment_cycles_charge(ptraddr_t compartment, uint64_t cycles)
+	{
+		for (size_t i = 0; i < compartmentCyclesUsed; i++)
+		{
+			if (compartmentCycles[i].compartment == compartment)
+			{
+				compartmentCycles[i].cycles += cycles;
+				return;
+			}
+		}
+		if (compartmentCyclesUsed < compartmentCycles.size())
+		{
+			compartmentCycles[compartmentCyclesUsed++] = {compartment, cycles};
+			return;
+		}
+		Debug::log("No space to account cycles for compartment {}",
+		           compartment);
+	}
+} // namespace
+
+namespace
+{
+	/**
+	 * The number of futex wait queues.  Waiters are distributed across these
+	 * by futex address so that wake and priority-boost operations need to
+	 * visit only the threads waiting on addresses that hash to the same queue.
+	 * Must be a power of two.
+	 */
+	constexpr size_t FutexWaitQueues = 8;
+	static_assert((FutexWaitQueues & (FutexWaitQueues - 1)) == 0,
+	              "The number of futex wait queues must be a power of two");
+
+	/**
+	 * Priority-sorted lists of threads waiting for a futex, indexed by
+	 * `futex_wait_queue_index`.
+	 */
+	Thread *futexWaitingLists[FutexWaitQueues];
+
+	/**
+	 * The number of priority-inheriting waiters on each of the futex wait
+	 * queues.  Queues with no such waiters cannot contribute a priority boost
+	 * and are skipped when calculating one.
+	 */
+	uint8_t futexPriorityInheritingWaiters[FutexWaitQueues];
+
+	/**
+	 * Returns the index of the wait queue for the futex at address `key`.
+	 * Futex words are 4-byte aligned, so the low bits carry no information.
+	 */
+	size_t futex_wait_queue_index(ptraddr_t key)
+	{
+		constexpr size_t Shift = 32 - std::countr_zero(FutexWaitQueues);
+		return ((key >> 2) * 0x9e3779b1U) >> Shift;
+	}
+
+	/**
+	 * Returns the wait queue for the futex at address `key`.
+	 */
+	Thread *&futex_wait_queue(ptraddr_t key)
+	{
+		return futexWaitingLists[futex_wait_queue_index(key)];
+	}
+
+	/**
+	 * Add `delta` to each of the futex waiter summary entries whose bits are
+	 * set in `buckets`.  Multiwaiters, which wait for several futexes at once,
+	 * pass several bits; single futex waits pass one.
+	 */
+	void futex_waiter_summary_update(uint64_t buckets, int delta)
+	{
+		static_assert(CONFIG_THREADS_NUM < std::numeric_limits<uint8_t>::max(),
+		              "Futex waiter summary entries are too small");
+		static_assert(FUTEX_WAITER_SUMMARY_BUCKETS == 64,
+		              "Futex waiter summary buckets must fit in a bitmask");
+		auto *summary = SHARED_OBJECT_WITH_PERMISSIONS(
+		  uint8_t, scheduler_futex_waiters, true, true, false, false);
+		while (buckets != 0)
+		{
+			summary[std::countr_zero(buckets)] += delta;
+			buckets &= buckets - 1;
+		}
+	}
 
 	/**
 	 * The value used for priority-boosting futexes that are not actually
@@ -64,16 +170,27 @@ namespace
 	 * add a new thread to that list and so another priority can be provided,
 	 * which will be used if it is larger than any of the priorities of the
 	 * other waiters.
+	 *
+	 * The boosting threads may be waiting on any futex owned by `threadID`,
+	 * so this visits every queue that has priority-inheriting waiters.
 	 */
 	uint8_t priority_boost_for_thread(uint16_t threadID, uint8_t priority = 0)
 	{
-		Thread::walk_thread_list(futexWaitingList, [&](Thread *thread) {
-			if ((thread->futexPriorityInheriting) &&
-			    (thread->futexPriorityBoostedThread == threadID))
+		for (size_t i = 0; i < FutexWaitQueues; i++)
+		{
+			if (futexPriorityInheritingWaiters[i] == 0)
 			{
-				priority = std::max(priority, thread->priority_get());
+				continue;
 			}
-		});
+			Thread::walk_thread_list(
+			  futexWaitingLists[i], [&](Thread *thread) {
+				  if ((thread->futexPriorityInheriting) &&
+				      (thread->futexPriorityBoostedThread == threadID))
+				  {
+					  priority = std::max(priority, thread->priority_get());
+				  }
+			  });
+		}
 		return priority;
 	}
 
@@ -83,9 +200,9 @@ namespace
 	 */
 	void priority_boost_update(ptraddr_t key, uint16_t threadID)
 	{
-		Thread::walk_thread_list(futexWaitingList, [&](Thread *thread) {
+		Thread::walk_thread_list(futex_wait_queue(key), [&](Thread *thread) {
 			if ((thread->futexPriorityInheriting) &&
-			    (thread->futexWaitAddress = key))
+			    (thread->futexWaitAddress == key))
 			{
 				thread->futexPriorityBoostedThread = threadID;
 			}
@@ -104,9 +221,9 @@ namespace
 	 */
 	void priority_boost_reset(ptraddr_t key, uint16_t threadID)
 	{
-		Thread::walk_thread_list(futexWaitingList, [&](Thread *thread) {
+		Thread::walk_thread_list(futex_wait_queue(key), [&](Thread *thread) {
 			if ((thread->futexPriorityInheriting) &&
-			    (thread->futexWaitAddress = key))
+			    (thread->futexWaitAddress == key))
 			{
 				if (thread->futexPriorityBoostedThread == threadID)
 				{
@@ -143,12 +260,14 @@ namespace
 		// success.
 		int woke = 0;
 		Thread::walk_thread_list(
-		  futexWaitingList,
+		  futex_wait_queue(key),
 		  [&](Thread *thread) {
 			  if (thread->futexWaitAddress == key)
 			  {
 				  shouldRecalculatePriorityBoost |=
 				    thread->futexPriorityInheriting;
+				  trace_record(
+				    SchedulerTraceFutexWake, thread->id_get(), key);
 				  shouldYield = thread->ready(Thread::WakeReason::Futex);
 				  count--;
 				  woke++;
@@ -164,6 +283,10 @@ namespace
 			woke += multiwaitersWoken;
 			shouldYield |= (multiwaitersWoken > 0);
 		}
+		else
+		{
+			MultiWaiterInternal::trigger_registered(key);
+		}
 		return {shouldYield, shouldRecalculatePriorityBoost, woke};
 	}
 
@@ -192,6 +315,44 @@ namespace sched
 		return &(reinterpret_cast<Thread *>(threadSpaces))[threadId - 1];
 	}
 
+	/**
+	 * Wake the threads waiting for the interrupt whose futex word is `word`.
+	 * Returns true if a reschedule is needed.
+	 */
+	bool interrupt_wake(uint32_t &word)
+	{
+		if constexpr (InterruptHandlerThreads)
+		{
+			// If the bound handler is the only thread waiting for this
+			// interrupt, wake it directly rather than searching the wait
+			// queues and multiwaiters.
+			ptraddr_t key = Capability{&word}.address();
+			Thread   *handler =
+			  get_thread(InterruptController::master().handler_for(word));
+			auto *summary = SHARED_OBJECT_WITH_PERMISSIONS(
+			  uint8_t, scheduler_futex_waiters, true, false, false, false);
+			if ((handler != nullptr) && (handler->futexWaitAddress == key) &&
+			    (summary[futex_waiter_summary_bucket(key)] == 1))
+			{
+				trace_record(SchedulerTraceFutexWake, handler->id_get(), key);
+				return handler->ready(Thread::WakeReason::Futex);
+			}
+		}
+		// Wake anyone sleeping on this futex.  Interrupt futexes are not
+		// priority inheriting.
+		return std::get<0>(futex_wake(Capability{&word}.address()));
+	}
+
+#ifdef SCHEDULER_CPU_BUDGETS
+	/// The CPU budgets of threads and groups of threads.
+	CpuBudget cpuBudgets[] = {SCHEDULER_CPU_BUDGETS};
+
+	/// The index in `cpuBudgets` of each thread's budget, or -1 for none.
+	constexpr int8_t ThreadCpuBudgets[] = {SCHEDULER_THREAD_CPU_BUDGETS};
+	static_assert(sizeof(ThreadCpuBudgets) == CONFIG_THREADS_NUM,
+	              "Every thread must have a CPU budget index");
+#endif
+
 	[[cheri::interrupt_state(disabled)]] void __cheri_compartment("sched")
 	  scheduler_entry(const ThreadLoaderInfo *info)
 	{
@@ -206,12 +367,22 @@ namespace sched
 		{
 			Debug::log("Created thread for trusted stack {}",
 			           info[i].trustedStack);
-			Thread *th = new (threadSpace)
-			  Thread(info[i].trustedStack, i + 1, info[i].priority);
+			Thread *th = new (threadSpace) Thread(info[i].trustedStack,
+			                                      i + 1,
+			                                      info[i].priority,
+			                                      info[i].period,
+			                                      info[i].budget);
+#ifdef SCHEDULER_CPU_BUDGETS
+			if (ThreadCpuBudgets[i] >= 0)
+			{
+				th->cpu_budget_set(&cpuBudgets[ThreadCpuBudgets[i]]);
+			}
+#endif
 			th->ready(Thread::WakeReason::Timer);
 			i++;
 		}
 
+		Idle::init();
 		InterruptController::master_init();
 		Timer::interrupt_setup();
 	}
@@ -262,10 +433,32 @@ namespace sched
 			  thread ? thread->cycles : Thread::idleThreadCycles;
 			auto elapsedCycles = currentCycles - cyclesAtLastSchedulingEvent;
 			threadCycleCounter += elapsedCycles;
+			// Charge the compartment that the outgoing thread is running in.
+			// The idle thread is accounted only as idle time.
+			if (thread)
+			{
+				compartment_cycles_charge(
+				  switcher_thread_compartment(sealedTStack), elapsedCycles);
+			}
 		}
 
 		ExceptionGuard g{[=]() { sched_panic(mcause, mepc, mtval); }};
 
+		auto threadID = [](Thread *thread) -> uint16_t {
+			return thread ? thread->id_get() : 0;
+		};
+		Thread *previousThread = Thread::current_get();
+		bool    isInterrupt    = mcause & MCAUSE_INTR;
+		if (previousThread == nullptr)
+		{
+			Idle::exit();
+		}
+		if (isInterrupt)
+		{
+			trace_record(
+			  SchedulerTraceInterruptEntry, threadID(previousThread), mcause);
+		}
+
 		bool tick = false;
 		switch (mcause)
 		{
@@ -278,7 +471,17 @@ namespace sched
 				break;
 			}
 			case MCAUSE_INTR | MCAUSE_MTIME:
-				schedNeeded = true;
+				if constexpr (ProfileSamples > 0)
+				{
+					profile_sample(
+					  threadID(previousThread),
+					  previousThread ? switcher_thread_compartment(sealedTStack)
+					                 : 0,
+					  mepc);
+				}
+				// Interrupts that were armed only to take a profiler sample
+				// should not perturb scheduling.
+				schedNeeded = !Timer::is_profile_only();
 				tick        = true;
 				break;
 			case MCAUSE_INTR | MCAUSE_MEXTERN:
@@ -289,10 +492,15 @@ namespace sched
 					  // the way into the scheduler sleeping on its old value
 					  // will still see this update.
 					  word++;
-					  // Wake anyone sleeping on this futex.  Interrupt futexes
-					  // are not priority inheriting.
-					  std::tie(schedNeeded, std::ignore, std::ignore) =
-					    futex_wake(Capability{&word}.address());
+					  // Coalesced interrupts wake waiters only once enough
+					  // have fired or the timer reaches their deadline.
+					  if (InterruptController::master().coalesce(
+					        word,
+					        InterruptController::AnyCoalesced ? Timer::time()
+					                                          : 0))
+					  {
+						  schedNeeded = interrupt_wake(word);
+					  }
 				  });
 				tick = schedNeeded;
 				break;
@@ -313,9 +521,18 @@ namespace sched
 			default:
 				sched_panic(mcause, mepc, mtval);
 		}
+		// Charge a deadline-scheduled or budgeted thread for the time that it
+		// ran.  This may take it off the run queue.
+		if (Thread::deadline_charge())
+		{
+			schedNeeded = true;
+		}
 		if (tick || !Thread::any_ready())
 		{
 			Timer::expiretimers();
+			InterruptController::master().coalesce_expire(
+			  Timer::time(),
+			  [&](uint32_t &word) { schedNeeded |= interrupt_wake(word); });
 		}
 		auto newContext =
 		  schedNeeded ? Thread::schedule(sealedTStack) : sealedTStack;
@@ -325,6 +542,28 @@ namespace sched
 #endif
 		Timer::update();
 
+		Thread *nextThread = Thread::current_get();
+		if (nextThread == nullptr)
+		{
+			Idle::enter();
+		}
+		if (nextThread != previousThread)
+		{
+			trace_record(SchedulerTraceContextSwitch,
+			             threadID(nextThread),
+			             threadID(previousThread));
+			if constexpr (InterruptHandlerThreads)
+			{
+				InterruptController::master().threshold_for_thread(
+				  threadID(nextThread));
+			}
+		}
+		if (isInterrupt)
+		{
+			trace_record(
+			  SchedulerTraceInterruptExit, threadID(nextThread), mcause);
+		}
+
 		if constexpr (Accounting)
 		{
 			cyclesAtLastSchedulingEvent = rdcycle64();
@@ -392,6 +631,65 @@ namespace sched
 		});
 	}
 
+	/**
+	 * The maximum number of owners along a chain of priority-inheriting
+	 * futexes that a priority change is propagated to.  This bounds the time
+	 * spent with interrupts disabled and ensures that propagation terminates
+	 * if the chain contains a cycle (a deadlock).
+	 */
+	constexpr size_t PriorityInheritanceMaxDepth = 8;
+
+	/**
+	 * Propagate a change in the priority of `thread` along the chain of
+	 * priority-inheriting futex owners.  If `thread` is itself blocked on a
+	 * priority-inheriting futex, the owner of that futex has its boost
+	 * recalculated, and so on until a thread that is not blocked, or whose
+	 * priority does not change, is reached.
+	 */
+	void priority_boost_propagate(Thread *thread)
+	{
+		for (size_t depth = 0; depth < PriorityInheritanceMaxDepth; depth++)
+		{
+			// Check the sleep queue first: the futex fields share storage
+			// with the multiwaiter pointer and are meaningful only for
+			// threads on a futex wait queue.
+			if (thread->is_ready() ||
+			    (thread->sleepQueue !=
+			     &futex_wait_queue(thread->futexWaitAddress)) ||
+			    !thread->futexPriorityInheriting)
+			{
+				return;
+			}
+			Thread *owner = get_thread(thread->futexPriorityBoostedThread);
+			if (owner == nullptr)
+			{
+				return;
+			}
+			uint8_t oldPriority = owner->priority_get();
+			owner->priority_boost(priority_boost_for_thread(owner->id_get()));
+			if (owner->priority_get() == oldPriority)
+			{
+				return;
+			}
+			thread = owner;
+		}
+		Debug::log("Priority inheritance chain from thread {} is longer than "
+		           "{}, not propagating further",
+		           thread->id_get(),
+		           PriorityInheritanceMaxDepth);
+	}
+
+	/**
+	 * Block the current thread until it receives a notification or until
+	 * `timeout` expires.
+	 */
+	void notification_block(Thread *current, Timeout *timeout)
+	{
+		current->notificationWaiting = true;
+		current->suspend(timeout, nullptr);
+		current->notificationWaiting = false;
+	}
+
 } // namespace sched
 
 using namespace sched;
@@ -399,7 +697,7 @@ using namespace sched;
 // thread APIs
 SystickReturn __cheri_compartment("sched") thread_systemtick_get()
 {
-	uint64_t      ticks = Thread::ticksSinceBoot;
+	uint64_t      ticks = ticks_since_boot();
 	uint32_t      hi    = ticks >> 32;
 	uint32_t      lo    = ticks;
 	SystickReturn ret   = {.lo = lo, .hi = hi};
@@ -407,6 +705,24 @@ SystickReturn __cheri_compartment("sched") thread_systemtick_get()
 	return ret;
 }
 
+uint64_t __cheri_compartment("sched") thread_time_cycles_get()
+{
+	return timer_now() - Timer::boot_time();
+}
+
+__cheriot_minimum_stack(0x90) int __cheri_compartment("sched")
+  thread_microsecond_sleep(uint32_t microseconds)
+{
+	STACK_CHECK(0x90);
+	uint64_t expiry =
+	  timer_now() + (uint64_t(microseconds) * CPU_TIMER_HZ) / 1'000'000;
+	// This is not a yield, so the timer is the only thing that wakes the
+	// thread, and the timer is armed for the expiry time itself.
+	Thread::current_get()->suspend(expiry, nullptr);
+	yield();
+	return 0;
+}
+
 __cheriot_minimum_stack(0x90) int __cheri_compartment("sched")
   thread_sleep(Timeout *timeout, uint32_t flags)
 {
@@ -422,6 +738,175 @@ __cheriot_minimum_stack(0x90) int __cheri_compartment("sched")
 	return 0;
 }
 
+__cheriot_minimum_stack(0x60) int __cheri_compartment("sched")
+  thread_period_wait()
+{
+	STACK_CHECK(0x60);
+	Thread *current = Thread::current_get();
+	if (!current->is_deadline_scheduled())
+	{
+		return -EPERM;
+	}
+	current->deadline_throttle();
+	yield();
+	return 0;
+}
+
+__cheriot_minimum_stack(0x80) int __cheri_compartment("sched")
+  thread_priority_set(uint8_t priority)
+{
+	STACK_CHECK(0x80);
+	Thread *current = Thread::current_get();
+	if (priority > current->priority_maximum())
+	{
+		return -EPERM;
+	}
+	int previous = current->base_priority_set(priority);
+	current->priority_boost(priority_boost_for_thread(current->id_get()));
+	// If we've dropped below another runnable thread, let it run.
+	if (!current->is_highest_priority())
+	{
+		yield();
+	}
+	return previous;
+}
+
+int thread_priority_get()
+{
+	return Thread::current_get()->priority_get();
+}
+
+int thread_wake_latency_limit_set(uint32_t cycles)
+{
+	Idle::latency_limit_set(Thread::current_get()->id_get(), cycles);
+	return 0;
+}
+
+int thread_idle_state_statistics(uint32_t             state,
+                                 IdleStateStatistics *statistics)
+{
+	if ((state >= Idle::entries.size()) ||
+	    !check_pointer<PermissionSet{Permission::Store}>(statistics))
+	{
+		return -EINVAL;
+	}
+	statistics->cycles  = Idle::residency[state];
+	statistics->entries = Idle::entries[state];
+	statistics->transitionCycles =
+	  IdleController::States[state].transitionCycles;
+	return 0;
+}
+
+__cheriot_minimum_stack(0x80) int __cheri_compartment("sched")
+  thread_notify(uint16_t threadID, uint32_t value, uint32_t action)
+{
+	STACK_CHECK(0x80);
+	Thread *thread = get_thread(threadID);
+	if (thread == nullptr)
+	{
+		return -EINVAL;
+	}
+	switch (action)
+	{
+		case ThreadNotifyNoAction:
+			break;
+		case ThreadNotifySetBits:
+			thread->notificationValue |= value;
+			break;
+		case ThreadNotifyIncrement:
+			thread->notificationValue++;
+			break;
+		case ThreadNotifySetValueWithoutOverwrite:
+			if (thread->notificationPending)
+			{
+				return -EAGAIN;
+			}
+			[[fallthrough]];
+		case ThreadNotifySetValueWithOverwrite:
+			thread->notificationValue = value;
+			break;
+		default:
+			return -EINVAL;
+	}
+	thread->notificationPending = true;
+	if (thread->notificationWaiting)
+	{
+		thread->notificationWaiting = false;
+		if (thread->ready(Thread::WakeReason::Futex))
+		{
+			yield();
+		}
+	}
+	return 0;
+}
+
+__cheriot_minimum_stack(0x90) int __cheri_compartment("sched")
+  thread_notify_wait(Timeout  *timeout,
+                     uint32_t  clearOnEntry,
+                     uint32_t  clearOnExit,
+                     uint32_t *value)
+{
+	STACK_CHECK(0x90);
+	if (!check_timeout_pointer(timeout) ||
+	    ((value != nullptr) &&
+	     !check_pointer<PermissionSet{Permission::Store}>(value)))
+	{
+		return -EINVAL;
+	}
+	Thread *current = Thread::current_get();
+	if (!current->notificationPending)
+	{
+		current->notificationValue &= ~clearOnEntry;
+		notification_block(current, timeout);
+	}
+	// The value pointer may have been freed while we were blocked.
+	if (Capability{value}.is_valid())
+	{
+		*value = current->notificationValue;
+	}
+	if (!current->notificationPending)
+	{
+		return -ETIMEDOUT;
+	}
+	current->notificationValue &= ~clearOnExit;
+	current->notificationPending = false;
+	return 0;
+}
+
+__cheriot_minimum_stack(0x90) int __cheri_compartment("sched")
+  thread_notify_take(Timeout *timeout, _Bool clearOnExit, uint32_t *value)
+{
+	STACK_CHECK(0x90);
+	if (!check_timeout_pointer(timeout) ||
+	    !check_pointer<PermissionSet{Permission::Store}>(value))
+	{
+		return -EINVAL;
+	}
+	Thread *current = Thread::current_get();
+	// A notification that leaves the value at zero does not satisfy the
+	// take, so keep waiting for the rest of the timeout.
+	while ((current->notificationValue == 0) && (timeout->remaining != 0))
+	{
+		current->notificationPending = false;
+		notification_block(current, timeout);
+		if (!Capability{timeout}.is_valid())
+		{
+			break;
+		}
+	}
+	uint32_t count               = current->notificationValue;
+	current->notificationPending = false;
+	if (count != 0)
+	{
+		current->notificationValue = clearOnExit ? 0 : count - 1;
+	}
+	if (Capability{value}.is_valid())
+	{
+		*value = count;
+	}
+	return (count == 0) ? -ETIMEDOUT : 0;
+}
+
 __cheriot_minimum_stack(0xb0) int futex_timed_wait(Timeout        *timeout,
                                                    const uint32_t *address,
                                                    uint32_t        expected,
@@ -448,6 +933,11 @@ __cheriot_minimum_stack(0xb0) int futex_timed_wait(Timeout        *timeout,
 	           timeout->remaining);
 	bool      isPriorityInheriting         = flags & FutexPriorityInheritance;
 	ptraddr_t key                          = Capability{address}.address();
+	if constexpr (InterruptHandlerThreads)
+	{
+		InterruptController::master().handler_bind(key,
+		                                           currentThread->id_get());
+	}
 	currentThread->futexWaitAddress        = key;
 	currentThread->futexPriorityInheriting = isPriorityInheriting;
 	Thread  *owningThread                  = nullptr;
@@ -476,17 +966,38 @@ __cheriot_minimum_stack(0xb0) int futex_timed_wait(Timeout        *timeout,
 		priority_boost_update(key, owningThreadID);
 		owningThread->priority_boost(priority_boost_for_thread(
 		  owningThreadID, currentThread->priority_get()));
+		// If the owner is itself blocked on a priority-inheriting futex, boost
+		// the owner of that one too.
+		priority_boost_propagate(owningThread);
 	}
-	currentThread->suspend(timeout, &futexWaitingList);
+	trace_record(SchedulerTraceFutexWait,
+	             currentThread->id_get(),
+	             key,
+	             isPriorityInheriting);
+	size_t queue = futex_wait_queue_index(key);
+	futexPriorityInheritingWaiters[queue] += isPriorityInheriting;
+	// Record the queue and summary bucket in the thread, because
+	// `futex_requeue` may move us to a futex in another queue and bucket.
+	currentThread->futexWaitQueue     = queue;
+	currentThread->futexSummaryBucket = futex_waiter_summary_bucket(key);
+	futex_waiter_summary_update(uint64_t(1)
+	                              << currentThread->futexSummaryBucket,
+	                            1);
+	currentThread->suspend(timeout, &futexWaitingLists[queue]);
+	futex_waiter_summary_update(uint64_t(1)
+	                              << currentThread->futexSummaryBucket,
+	                            -1);
 	bool timedout                   = currentThread->futexWaitAddress == 0;
 	currentThread->futexWaitAddress = 0;
 	if (isPriorityInheriting)
 	{
+		futexPriorityInheritingWaiters[currentThread->futexWaitQueue]--;
 		Debug::log("Undoing priority boost of {} by {}",
 		           owningThread->id_get(),
 		           currentThread->id_get());
 		// Recalculate the priority boost from the remaining waiters, if any.
 		owningThread->priority_boost(priority_boost_for_thread(owningThreadID));
+		priority_boost_propagate(owningThread);
 	}
 	// If we woke up from a timer, report timeout.
 	if (timedout)
@@ -550,6 +1061,108 @@ __cheriot_minimum_stack(0xa0) int futex_wake(uint32_t *address, uint32_t count)
 	return woke;
 }
 
+__cheriot_minimum_stack(0xb0) int futex_requeue(uint32_t *address,
+                                                uint32_t *target,
+                                                uint32_t  expected,
+                                                uint32_t  wakeCount,
+                                                uint32_t  requeueCount)
+{
+	STACK_CHECK(0xb0);
+	if (!check_pointers(
+	      pointer_check<PermissionSet{Permission::Store}>(address),
+	      pointer_check<PermissionSet{Permission::Load, Permission::Store}>(
+	        target)))
+	{
+		return -EINVAL;
+	}
+	// Interrupts are disabled, so nothing can change the target between
+	// this check and the requeue.
+	if (*target != expected)
+	{
+		return -EAGAIN;
+	}
+	ptraddr_t key         = Capability{address}.address();
+	ptraddr_t targetKey   = Capability{target}.address();
+	bool      shouldYield = false;
+	int       woke        = 0;
+	if (wakeCount > 0)
+	{
+		std::tie(shouldYield, std::ignore, woke) = futex_wake(key, wakeCount);
+	}
+	if ((key == targetKey) || (requeueCount == 0))
+	{
+		if (shouldYield)
+		{
+			yield();
+		}
+		return woke;
+	}
+	size_t queueIndex       = futex_wait_queue_index(key);
+	size_t targetQueueIndex = futex_wait_queue_index(targetKey);
+	size_t bucket           = futex_waiter_summary_bucket(targetKey);
+	// Requeued priority-inheriting waiters boost the owner of the target, as
+	// they would if they had waited on it directly.
+	uint16_t targetOwnerID = expected;
+	if (get_thread(targetOwnerID) == nullptr)
+	{
+		targetOwnerID = FutexBoostNotThread;
+	}
+	// The owner of `address` that the requeued threads were boosting, if
+	// any.  Waiters on one priority-inheriting futex all boost the same
+	// thread, because each new waiter updates the others.
+	uint16_t oldOwnerID  = FutexBoostNotThread;
+	bool     boostsMoved = false;
+	int      moved       = 0;
+	Thread::walk_thread_list(
+	  futexWaitingLists[queueIndex],
+	  [&](Thread *thread) {
+		  if (thread->futexWaitAddress != key)
+		  {
+			  return;
+		  }
+		  thread->futexWaitAddress = targetKey;
+		  if (thread->futexPriorityInheriting)
+		  {
+			  boostsMoved = true;
+			  oldOwnerID  = thread->futexPriorityBoostedThread;
+			  futexPriorityInheritingWaiters[queueIndex]--;
+			  futexPriorityInheritingWaiters[targetQueueIndex]++;
+			  thread->futexPriorityBoostedThread = targetOwnerID;
+		  }
+		  if (queueIndex != targetQueueIndex)
+		  {
+			  thread->sleep_queue_move(&futexWaitingLists[targetQueueIndex]);
+			  thread->futexWaitQueue = targetQueueIndex;
+		  }
+		  futex_waiter_summary_update(
+		    uint64_t(1) << thread->futexSummaryBucket, -1);
+		  thread->futexSummaryBucket = bucket;
+		  futex_waiter_summary_update(uint64_t(1) << bucket, 1);
+		  requeueCount--;
+		  moved++;
+	  },
+	  [&]() { return requeueCount == 0; });
+	// Move the priority boost from the old owner to the new one.  Either may
+	// be the caller, so check whether it should still be running.
+	if (boostsMoved)
+	{
+		for (uint16_t ownerID : {oldOwnerID, targetOwnerID})
+		{
+			if (Thread *owner = get_thread(ownerID); owner != nullptr)
+			{
+				owner->priority_boost(priority_boost_for_thread(ownerID));
+				priority_boost_propagate(owner);
+			}
+		}
+		shouldYield |= !Thread::current_get()->is_highest_priority();
+	}
+	if (shouldYield)
+	{
+		yield();
+	}
+	return woke + moved;
+}
+
 __cheriot_minimum_stack(0x60) int multiwaiter_create(
   Timeout           *timeout,
   struct SObjStruct *heapCapability,
@@ -590,6 +1203,11 @@ __cheriot_minimum_stack(0xc0) int multiwaiter_wait(Timeout           *timeout,
 {
 	STACK_CHECK(0xc0);
 	return typed_op<MultiWaiterInternal>(waiter, [&](MultiWaiterInternal &mw) {
+		if (mw.is_registered())
+		{
+			Debug::log("One-shot wait on a registered multiwaiter");
+			return -EINVAL;
+		}
 		if (newEventsCount > mw.capacity())
 		{
 			Debug::log("Too many events");
@@ -618,7 +1236,13 @@ __cheriot_minimum_stack(0xc0) int multiwaiter_wait(Timeout           *timeout,
 				Debug::log("Sleeping for {} ticks", timeout->remaining);
 				if (timeout->may_block())
 				{
+					// Record this thread in the futex waiter summary for each
+					// futex until it resumes.  The multiwaiter may be freed
+					// while we sleep, so keep the set of buckets here.
+					uint64_t buckets = mw.futex_waiter_summary_buckets();
+					futex_waiter_summary_update(buckets, 1);
 					mw.wait(timeout);
+					futex_waiter_summary_update(buckets, -1);
 					// If we yielded then it's possible for either of the
 					// pointers that we were passed to have been freed out from
 					// under us.
@@ -643,6 +1267,124 @@ __cheriot_minimum_stack(0xc0) int multiwaiter_wait(Timeout           *timeout,
 	});
 }
 
+__cheriot_minimum_stack(0xa0) int multiwaiter_register(
+  MultiWaiter       *waiter,
+  EventWaiterSource *events,
+  size_t             eventsCount)
+{
+	STACK_CHECK(0xa0);
+	return typed_op<MultiWaiterInternal>(waiter, [&](MultiWaiterInternal &mw) {
+		if (eventsCount > mw.capacity())
+		{
+			Debug::log("Too many events");
+			return -EINVAL;
+		}
+		if ((eventsCount > 0) &&
+		    !check_pointer<PermissionSet{Permission::Load,
+		                                 Permission::LoadStoreCapability}>(
+		      events, eventsCount * sizeof(EventWaiterSource)))
+		{
+			Debug::log("Invalid events pointer: {}", events);
+			return -EINVAL;
+		}
+		// A registration counts as a waiter in the futex waiter summary for
+		// as long as it exists, so that wakes are never skipped for futexes
+		// that it monitors.
+		if (mw.is_registered())
+		{
+			futex_waiter_summary_update(mw.futex_waiter_summary_buckets(), -1);
+		}
+		if (!mw.register_events(events, eventsCount))
+		{
+			Debug::log("Registering events returned error");
+			return -EINVAL;
+		}
+		if (mw.is_registered())
+		{
+			futex_waiter_summary_update(mw.futex_waiter_summary_buckets(), 1);
+		}
+		return 0;
+	});
+}
+
+__cheriot_minimum_stack(0xd0) int multiwaiter_wait_registered(
+  Timeout     *timeout,
+  MultiWaiter *waiter,
+  uint32_t    *ready,
+  uint32_t    *timedOut)
+{
+	STACK_CHECK(0xd0);
+	if (!check_pointer<PermissionSet{Permission::Store}>(ready) ||
+	    ((timedOut != nullptr) &&
+	     !check_pointer<PermissionSet{Permission::Store}>(timedOut)))
+	{
+		return -EINVAL;
+	}
+	return typed_op<MultiWaiterInternal>(waiter, [&](MultiWaiterInternal &mw) {
+		if (!mw.is_registered())
+		{
+			Debug::log("Registered wait on a multiwaiter with no registration");
+			return -EINVAL;
+		}
+		if (!check_timeout_pointer(timeout))
+		{
+			return -EINVAL;
+		}
+		Ticks untilDeadline = mw.ticks_to_deadline(ticks_since_boot());
+		if (!mw.has_ready_events() && (untilDeadline != 0) &&
+		    timeout->may_block())
+		{
+			if (untilDeadline < timeout->remaining)
+			{
+				// Sleep only until the earliest per-event timeout and then
+				// charge the time to the caller's timeout.
+				Timeout limit{untilDeadline};
+				limit.slack = timeout->slack;
+				mw.wait(&limit);
+				if (Capability{timeout}.is_valid())
+				{
+					timeout->elapse(limit.elapsed);
+				}
+			}
+			else
+			{
+				mw.wait(timeout);
+			}
+			// The multiwaiter or the result pointers may have been freed
+			// while we slept.
+			if (!Capability{&mw}.is_valid() || !Capability{ready}.is_valid() ||
+			    ((timedOut != nullptr) && !Capability{timedOut}.is_valid()))
+			{
+				return -EINVAL;
+			}
+		}
+		uint32_t fired   = mw.take_ready();
+		uint32_t expired = mw.take_timed_out(ticks_since_boot());
+		*ready           = fired;
+		if (timedOut != nullptr)
+		{
+			*timedOut = expired;
+		}
+		return ((fired | expired) == 0) ? -ETIMEDOUT : 0;
+	});
+}
+
+__cheriot_minimum_stack(0x70) int multiwaiter_registered_timeout_set(
+  MultiWaiter *waiter,
+  size_t       index,
+  Ticks        timeout)
+{
+	STACK_CHECK(0x70);
+	return typed_op<MultiWaiterInternal>(waiter, [&](MultiWaiterInternal &mw) {
+		if (!mw.timeout_set(index, ticks_since_boot(), timeout))
+		{
+			Debug::log("No registered event {} to time out", index);
+			return -EINVAL;
+		}
+		return 0;
+	});
+}
+
 namespace
 {
 	/**
@@ -701,11 +1443,82 @@ namespace
 	return -EPERM;
 }
 
+namespace
+{
+	/**
+	 * A capability authorising changes to thread priorities.
+	 */
+	struct ThreadPriorityCapability : Handle</*IsDynamic=*/false>
+	{
+		/**
+		 * Sealing type used by `Handle`.
+		 */
+		static SKey sealing_type()
+		{
+			return STATIC_SEALING_TYPE(ThreadPriorityKey);
+		}
+
+		/**
+		 * The public structure state.
+		 */
+		ThreadPriorityCapabilityState state;
+	};
+} // namespace
+
+__cheriot_minimum_stack(0x80) int __cheri_compartment("sched")
+  thread_priority_set_for(struct SObjStruct *sealed,
+                          uint16_t           threadID,
+                          uint8_t            priority)
+{
+	STACK_CHECK(0x80);
+	auto *capability =
+	  ThreadPriorityCapability::unseal<ThreadPriorityCapability>(sealed);
+	Thread *thread = get_thread(threadID);
+	if ((thread == nullptr) || (priority >= ThreadPrioNum))
+	{
+		return -EINVAL;
+	}
+	if ((capability == nullptr) ||
+	    ((capability->state.threadID != 0) &&
+	     (capability->state.threadID != threadID)) ||
+	    (priority > capability->state.maximumPriority))
+	{
+		return -EPERM;
+	}
+	int previous = thread->base_priority_set(priority);
+	// Recompute the effective priority, keeping any boost from threads
+	// waiting on locks that this thread holds.  This moves the thread between
+	// run queues, or within its sleep queue, if the priority changes.
+	thread->priority_boost(priority_boost_for_thread(threadID));
+	// The change may affect threads whose boost came from this thread.
+	priority_boost_propagate(thread);
+	if (!Thread::current_get()->is_highest_priority())
+	{
+		yield();
+	}
+	return previous;
+}
+
 uint16_t thread_count()
 {
 	return CONFIG_THREADS_NUM;
 }
 
+[[cheri::interrupt_state(disabled)]] int
+thread_stack_high_water_mark(uint16_t threadID)
+{
+#ifdef CONFIG_MSHWM
+	Thread *thread = get_thread(threadID);
+	if (thread == nullptr)
+	{
+		return -EINVAL;
+	}
+	return switcher_thread_stack_high_water_mark(thread->tStackPtr);
+#else
+	return -ENOTSUP;
+#endif
+}
+
 #ifdef SCHEDULER_ACCOUNTING
 [[cheri::interrupt_state(disabled)]] uint64_t thread_elapsed_cycles_idle()
 {
@@ -721,4 +1534,21 @@ uint16_t thread_count()
 	// that have occurred in the current quantum.
 	return Thread::current_get()->cycles + currentCycles;
 }
+
+[[cheri::interrupt_state(disabled)]] int
+thread_elapsed_cycles_compartments(CompartmentCycles *buffer, size_t count)
+{
+	// Bound the count so that the size calculation cannot overflow.
+	count = std::min(count, compartmentCyclesUsed);
+	if (!check_pointer<PermissionSet{Permission::Store}>(
+	      buffer, count * sizeof(CompartmentCycles)))
+	{
+		return -EINVAL;
+	}
+	for (size_t i = 0; i < count; i++)
+	{
+		buffer[i] = compartmentCycles[i];
+	}
+	return compartmentCyclesUsed;
+}
 #endif
@@ -4,6 +4,7 @@
 #pragma once
 #include "thread.h"
 #include <errno.h>
+#include <futex.h>
 #include <multiwaiter.h>
 #include <riscvreg.h>
 #include <stdint.h>
@@ -13,6 +14,8 @@ namespace
 {
 	using namespace CHERI;
 
+	void futex_waiter_summary_update(uint64_t buckets, int delta);
+
 	/**
 	 * Structure describing state for waiting for a single event source.
 	 *
@@ -27,13 +30,20 @@ namespace
 		 */
 		void *eventSource = nullptr;
 		/**
-		 * Event-type value.
+		 * Event-type value.  For edge-triggered futexes, this is the value
+		 * that the futex word had when the event was last armed or reported.
+		 * For registered events with `FlagDeadline` set, this is the low 32
+		 * bits of the tick count at which the event times out.
 		 */
 		uint32_t eventValue = 0;
 		/**
 		 * Event-type-specific flags.
 		 */
 		unsigned flags : 6 = 0;
+		/// Flag: the event is an edge-triggered futex.
+		static constexpr unsigned FlagEdgeTriggered = 1;
+		/// Flag: the registered event has a timeout in `eventValue`.
+		static constexpr unsigned FlagDeadline = 2;
 		/**
 		 * Value indicating the events that have occurred.  The zero value is
 		 * reserved to indicate that this event has not been triggered,
@@ -62,15 +72,27 @@ namespace
 		/**
 		 * Reset method.  Takes a pointer to the futex word and the
 		 * user-provided value describing when it should fire.
+		 *
+		 * If `edgeTriggered` is true and this event was already an
+		 * edge-triggered event for the same futex, `value` is ignored and
+		 * the event fires only if the futex word has changed since it was
+		 * last armed or reported, so a word that stays at a value that
+		 * differs from `value` does not fire on every wait.
 		 */
-		bool reset(uint32_t *address, uint32_t value)
+		bool reset(uint32_t *address, uint32_t value, bool edgeTriggered = false)
 		{
-			eventSource = reinterpret_cast<void *>(
+			void *source = reinterpret_cast<void *>(
 			  static_cast<uintptr_t>(Capability{address}.address()));
-			eventValue  = value;
-			flags       = 0;
+			if (edgeTriggered && (flags & FlagEdgeTriggered) &&
+			    (eventSource == source))
+			{
+				value = eventValue;
+			}
+			eventSource = source;
+			eventValue  = *address;
+			flags       = edgeTriggered ? FlagEdgeTriggered : 0;
 			readyEvents = 0;
-			if (*address != value)
+			if (eventValue != value)
 			{
 				set_ready(1);
 				return true;
@@ -78,6 +100,16 @@ namespace
 			return false;
 		}
 
+		/**
+		 * Returns true if this event has a timeout that has expired by tick
+		 * `now` (the low 32 bits of the tick count).
+		 */
+		bool deadline_passed(uint32_t now)
+		{
+			return (flags & FlagDeadline) &&
+			       (static_cast<int32_t>(now - eventValue) >= 0);
+		}
+
 		/**
 		 * Trigger method that is called when a futex is notified.  Checks for
 		 * matches against the address.
@@ -115,9 +147,10 @@ namespace
 		private:
 		/**
 		 * We place a limit on the number of waiters in an event queue to
-		 * bound the time spent traversing them.
+		 * bound the time spent traversing them.  This must be no more than
+		 * the number of bits in `readyMask`.
 		 */
-		static constexpr size_t MaxMultiWaiterSize = 8;
+		static constexpr size_t MaxMultiWaiterSize = 32;
 
 		/**
 		 * The maximum number of events in this multiwaiter.
@@ -127,12 +160,28 @@ namespace
 		 * The current number of events in this multiwaiter.
 		 */
 		uint8_t usedLength = 0;
+		/**
+		 * True if the events are a persistent registration (see
+		 * `register_events`) rather than the set for a single wait.
+		 */
+		bool isRegistered = false;
+		/**
+		 * For registered multiwaiters, a bitmap of the indexes of events that
+		 * have fired since they were last collected by `take_ready`.
+		 */
+		uint32_t readyMask = 0;
 
 		/**
 		 * Multiwaiters are added to a list in between being triggered
 		 */
 		MultiWaiterInternal *next = nullptr;
 
+		/**
+		 * Link in the list of registered multiwaiters, which are triggered
+		 * even when no thread is waiting on them.
+		 */
+		MultiWaiterInternal *nextRegistered = nullptr;
+
 		/**
 		 * The array of events that we're waiting for.  This is variable sized
 		 * and must be the last field of the structure.
@@ -187,7 +236,7 @@ namespace
 		                   size_t             length,
 		                   int               &error)
 		{
-			static_assert(sizeof(MultiWaiterInternal) <= 2 * sizeof(void *),
+			static_assert(sizeof(MultiWaiterInternal) <= 3 * sizeof(void *),
 			              "Header for event queue is too large");
 			if (length > MaxMultiWaiterSize)
 			{
@@ -243,13 +292,174 @@ namespace
 				{
 					return EventOperationResult::Error;
 				}
-				eventTriggered |= events[i].reset(address, newEvents[i].value);
+				eventTriggered |= events[i].reset(
+				  address,
+				  newEvents[i].value,
+				  newEvents[i].kind == EventWaiterFutexEdgeTriggered);
 			}
 			usedLength = count;
 			return eventTriggered ? EventOperationResult::Wake
 			                      : EventOperationResult::Sleep;
 		}
 
+		/**
+		 * Returns true if this multiwaiter holds a persistent registration.
+		 */
+		bool is_registered()
+		{
+			return isRegistered;
+		}
+
+		/**
+		 * Returns true if any registered events have fired since the last
+		 * call to `take_ready`.
+		 */
+		bool has_ready_events()
+		{
+			return readyMask != 0;
+		}
+
+		/**
+		 * Returns a bitmask of the futex waiter summary buckets (see
+		 * `futex_waiter_summary_bucket`) for the events in this multiwaiter.
+		 */
+		uint64_t futex_waiter_summary_buckets()
+		{
+			static_assert(FUTEX_WAITER_SUMMARY_BUCKETS == 64,
+			              "Futex waiter summary buckets must fit in a bitmask");
+			uint64_t buckets = 0;
+			for (EventWaiter &event : *this)
+			{
+				buckets |= uint64_t(1) << futex_waiter_summary_bucket(
+				             Capability{event.eventSource}.address());
+			}
+			return buckets;
+		}
+
+		/**
+		 * Replace the events in this multiwaiter with a persistent
+		 * registration of `count` events from `newEvents`, or remove the
+		 * registration if `count` is zero.  Registered events are triggered
+		 * whether or not a thread is waiting, and the events that have fired
+		 * are collected with `take_ready`, so waiting does not reset or scan
+		 * the events.  The caller is responsible for ensuring that `newEvents`
+		 * is a valid capability and that `count` is within the capacity of
+		 * this object, and for updating the futex waiter summary.
+		 */
+		bool register_events(EventWaiterSource *newEvents, size_t count)
+		{
+			unregister();
+			for (size_t i = 0; i < count; i++)
+			{
+				auto *address = static_cast<uint32_t *>(newEvents[i].eventSource);
+				if (!check_pointer<PermissionSet{Permission::Load}>(address))
+				{
+					return false;
+				}
+			}
+			usedLength = 0;
+			for (size_t i = 0; i < count; i++)
+			{
+				auto *address = static_cast<uint32_t *>(newEvents[i].eventSource);
+				if (events[i].reset(address, newEvents[i].value))
+				{
+					readyMask |= 1U << i;
+				}
+			}
+			if (count > 0)
+			{
+				usedLength     = count;
+				isRegistered   = true;
+				nextRegistered = registeredMultiwaiters;
+				registeredMultiwaiters = this;
+			}
+			return true;
+		}
+
+		/**
+		 * Returns the bitmap of registered events that have fired since the
+		 * last call and clears it.  This should be called at the end of a
+		 * wait.  Events that have fired no longer have a timeout.
+		 */
+		uint32_t take_ready()
+		{
+			remove_from_pending_wake_list();
+			uint32_t ready = readyMask;
+			readyMask      = 0;
+			for (size_t i = 0; i < usedLength; i++)
+			{
+				if (ready & (1U << i))
+				{
+					events[i].flags &= ~EventWaiter::FlagDeadline;
+				}
+			}
+			return ready;
+		}
+
+		/**
+		 * Give registered event `index` a timeout that expires `timeout`
+		 * ticks after tick `now`, or remove its timeout if `timeout` is
+		 * `UnlimitedTimeout`.  Deadlines are kept as 32-bit tick counts, so
+		 * longer timeouts are clamped to `INT32_MAX` ticks.  Returns false
+		 * if there is no such registered event.
+		 */
+		bool timeout_set(size_t index, uint64_t now, Ticks timeout)
+		{
+			if (!isRegistered || (index >= usedLength))
+			{
+				return false;
+			}
+			EventWaiter &event = events[index];
+			event.flags &= ~EventWaiter::FlagDeadline;
+			if (timeout != UnlimitedTimeout)
+			{
+				timeout = std::min<Ticks>(timeout, INT32_MAX);
+				event.flags |= EventWaiter::FlagDeadline;
+				event.eventValue = static_cast<uint32_t>(now + timeout);
+			}
+			return true;
+		}
+
+		/**
+		 * Returns the number of ticks after `now` until the earliest timeout
+		 * of a registered event expires (0 if one already has), or
+		 * `UnlimitedTimeout` if no registered event has a timeout.
+		 */
+		Ticks ticks_to_deadline(uint64_t now)
+		{
+			Ticks earliest = UnlimitedTimeout;
+			for (EventWaiter &event : *this)
+			{
+				if (event.flags & EventWaiter::FlagDeadline)
+				{
+					int32_t remaining =
+					  static_cast<int32_t>(event.eventValue - uint32_t(now));
+					earliest = std::min(
+					  earliest, static_cast<Ticks>(std::max(remaining, 0)));
+				}
+			}
+			return earliest;
+		}
+
+		/**
+		 * Returns the bitmap of registered events whose timeouts have expired
+		 * by tick `now` and removes their timeouts.  Events that have fired
+		 * are not included: `take_ready` should be called first.
+		 */
+		uint32_t take_timed_out(uint64_t now)
+		{
+			uint32_t timedOut = 0;
+			for (size_t i = 0; i < usedLength; i++)
+			{
+				if (events[i].deadline_passed(uint32_t(now)))
+				{
+					events[i].flags &= ~EventWaiter::FlagDeadline;
+					timedOut |= 1U << i;
+				}
+			}
+			return timedOut;
+		}
+
 		/**
 		 * Destructor, ensures that nothing is waiting on this.
 		 */
@@ -257,6 +467,12 @@ namespace
 		{
 			// Remove from the pending-wake list
 			remove_from_pending_wake_list();
+			// Stop receiving events for a registration.
+			if (isRegistered)
+			{
+				futex_waiter_summary_update(futex_waiter_summary_buckets(), -1);
+				unregister();
+			}
 			// If this is on any threads that it's waiting on.
 			Thread::walk_thread_list(threads, [&](Thread *thread) {
 				if (thread->multiWaiter == this)
@@ -283,6 +499,16 @@ namespace
 			bool found = false;
 			for (size_t i = 0; i < count; i++)
 			{
+				// An edge-triggered event has now been reported, so it next
+				// fires only for a change after this point.
+				auto *address =
+				  static_cast<uint32_t *>(newEvents[i].eventSource);
+				if ((events[i].flags & EventWaiter::FlagEdgeTriggered) &&
+				    (events[i].readyEvents != 0) &&
+				    check_pointer<PermissionSet{Permission::Load}>(address))
+				{
+					events[i].eventValue = *address;
+				}
 				newEvents[i].value = events[i].readyEvents;
 				found |= (events[i].readyEvents != 0);
 			}
@@ -324,9 +550,26 @@ namespace
 				  }
 			  },
 			  [&]() { return woken >= maxWakes; });
+			trigger_registered(source);
 			return woken;
 		}
 
+		/**
+		 * Record an event of type `T` in every registered multiwaiter,
+		 * whether or not a thread is waiting on it.  This is called by
+		 * `wake_waiters` and must also be called for events that are consumed
+		 * without calling `wake_waiters`.
+		 */
+		template<typename T>
+		static void trigger_registered(T source)
+		{
+			for (auto *mw = registeredMultiwaiters; mw != nullptr;
+			     mw       = mw->nextRegistered)
+			{
+				mw->trigger(source);
+			}
+		}
+
 		/**
 		 * Wait on this multi-waiter object until either the timeout expires or
 		 * one or more events have fired.
@@ -367,13 +610,43 @@ namespace
 		bool trigger(T source, uint32_t info = 0)
 		{
 			bool shouldWake = false;
-			for (auto &registeredSource : *this)
+			for (size_t i = 0; i < usedLength; i++)
 			{
-				shouldWake |= registeredSource.trigger(source);
+				if (events[i].trigger(source))
+				{
+					shouldWake = true;
+					readyMask |= uint32_t(isRegistered) << i;
+				}
 			}
 			return shouldWake;
 		}
 
+		/**
+		 * Remove this multiwaiter from the list of registered multiwaiters,
+		 * if it is there, and discard its events.  The caller is responsible
+		 * for updating the futex waiter summary.
+		 */
+		void unregister()
+		{
+			if (isRegistered)
+			{
+				for (MultiWaiterInternal **prev = &registeredMultiwaiters;
+				     *prev != nullptr;
+				     prev = &((*prev)->nextRegistered))
+				{
+					if (*prev == this)
+					{
+						*prev = nextRegistered;
+						break;
+					}
+				}
+			}
+			nextRegistered = nullptr;
+			isRegistered   = false;
+			readyMask      = 0;
+			usedLength     = 0;
+		}
+
 		/**
 		 * Private constructor, called only from the factory method (`create`).
 		 */
@@ -389,6 +662,11 @@ namespace
 		 * List of multiwaiters whose threads have been woken but not yet run.
 		 */
 		static inline MultiWaiterInternal *wokenMultiwaiters = nullptr;
+
+		/**
+		 * List of multiwaiters that hold a persistent registration.
+		 */
+		static inline MultiWaiterInternal *registeredMultiwaiters = nullptr;
 	};
 
 } // namespace
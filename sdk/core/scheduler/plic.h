@@ -30,6 +30,7 @@ namespace
 		{v.interrupt_disable(id)};
 		{v.interrupt_disable(id)};
 		{v.priority_set(id, p)};
+		{v.threshold_set(p)};
 		{
 			v.interrupt_claim()
 			} -> std::same_as<std::optional<SourceID>>;
@@ -72,6 +73,25 @@ namespace
 			 * triggered interrupts must be explicitly acknowledged.
 			 */
 			bool isEdgeTriggered;
+			/**
+			 * The number of times that this interrupt may fire before
+			 * waiters are woken, or 0 to wake them only when
+			 * `coalesceCycles` have elapsed.  Ignored if `coalesceCycles` is
+			 * 0.
+			 */
+			uint32_t coalesceCount;
+			/**
+			 * The longest time, in timer cycles, for which waking waiters
+			 * may be deferred after the interrupt fires, or 0 to wake them
+			 * every time.
+			 */
+			uint32_t coalesceCycles;
+
+			/// Returns true if wakes for this interrupt are coalesced.
+			[[nodiscard]] constexpr bool is_coalesced() const
+			{
+				return coalesceCycles > 0;
+			}
 		};
 
 		/**
@@ -100,6 +120,24 @@ namespace
 			return max;
 		}();
 
+		public:
+		/**
+		 * True if any interrupt coalesces wakes.  If none does, the
+		 * coalescing state and checks are compiled away.
+		 */
+		static constexpr bool AnyCoalesced = []() {
+			for (auto i : ConfiguredInterrupts)
+			{
+				if (i.is_coalesced())
+				{
+					return true;
+				}
+			}
+			return false;
+		}();
+
+		private:
+
 		using PlicType = Plic<LargestInterruptNumber, SourceID, Priority>;
 
 		static_assert(
@@ -118,6 +156,51 @@ namespace
 		 */
 		uint32_t futexWords[NumberOfInterrupts];
 
+		/**
+		 * The thread bound to each interrupt, or 0 if none is.  In
+		 * `InterruptHandlerThreads` mode, the last thread to wait directly on
+		 * an interrupt's futex word is bound to that interrupt: the trap
+		 * handler wakes it without searching the futex wait queues when it
+		 * is the only waiter, and interrupts of the same or lower priority
+		 * are masked while it runs.
+		 */
+		uint16_t handlerThreads[NumberOfInterrupts] = {};
+
+		/**
+		 * The PLIC threshold that is currently set.
+		 */
+		Priority currentThreshold = 0;
+
+		/**
+		 * Coalescing state for an interrupt: the number of times that it has
+		 * fired without waking waiters and the time by which they must be
+		 * woken.
+		 */
+		struct Coalesced
+		{
+			uint32_t pending  = 0;
+			uint64_t deadline = 0;
+		};
+
+		/**
+		 * The coalescing state for each interrupt, empty if no interrupts
+		 * coalesce wakes.
+		 */
+		Coalesced coalesced[AnyCoalesced ? NumberOfInterrupts : 0];
+
+		/**
+		 * Returns the index of the interrupt whose futex word is at `key`, or
+		 * `NumberOfInterrupts` if `key` is not an interrupt futex word.
+		 */
+		size_t index_for_futex_word(ptraddr_t key)
+		{
+			ptraddr_t base = CHERI::Capability{futexWords}.address();
+			size_t    index = (key - base) / sizeof(uint32_t);
+			return (key >= base) && (index < NumberOfInterrupts)
+			         ? index
+			         : NumberOfInterrupts;
+		}
+
 		public:
 		/**
 		 * Returns a reference that allows callers to directly poke the device.
@@ -203,11 +286,137 @@ namespace
 			  /*Complete edge triggered interrupt*/ true>(*src);
 		}
 
+		/**
+		 * Record that the interrupt whose futex word is `word` has fired at
+		 * time `now`.  Returns true if waiters should be woken now, false if
+		 * the wake is deferred until the interrupt's coalescing count or
+		 * deadline is reached.
+		 */
+		bool coalesce(uint32_t &word, uint64_t now)
+		{
+			if constexpr (AnyCoalesced)
+			{
+				size_t index =
+				  index_for_futex_word(CHERI::Capability{&word}.address());
+				if ((index == NumberOfInterrupts) ||
+				    !ConfiguredInterrupts[index].is_coalesced())
+				{
+					return true;
+				}
+				auto &config = ConfiguredInterrupts[index];
+				auto &state  = coalesced[index];
+				if (state.pending == 0)
+				{
+					state.deadline = now + config.coalesceCycles;
+				}
+				state.pending++;
+				if (((config.coalesceCount != 0) &&
+				     (state.pending >= config.coalesceCount)) ||
+				    (state.deadline <= now))
+				{
+					state.pending = 0;
+					return true;
+				}
+				return false;
+			}
+			return true;
+		}
+
+		/**
+		 * Returns the earliest time by which a deferred wake must happen, or
+		 * the maximum value if none is deferred.
+		 */
+		uint64_t coalesce_deadline()
+		{
+			uint64_t deadline = std::numeric_limits<uint64_t>::max();
+			if constexpr (AnyCoalesced)
+			{
+				for (auto &state : coalesced)
+				{
+					if (state.pending != 0)
+					{
+						deadline = std::min(deadline, state.deadline);
+					}
+				}
+			}
+			return deadline;
+		}
+
+		/**
+		 * Call `wake` with the futex word of each interrupt whose deferred
+		 * wake is due at time `now`.
+		 */
+		template<typename Fn>
+		void coalesce_expire(uint64_t now, Fn &&wake)
+		{
+			if constexpr (AnyCoalesced)
+			{
+				for (size_t i = 0; i < NumberOfInterrupts; i++)
+				{
+					auto &state = coalesced[i];
+					if ((state.pending != 0) && (state.deadline <= now))
+					{
+						state.pending = 0;
+						wake(futexWords[i]);
+					}
+				}
+			}
+		}
+
 		void interrupt_complete(SourceID id)
 		{
 			device.interrupt_complete(id);
 		}
 
+		/**
+		 * Record that the thread identified by `threadID` is about to wait on
+		 * the futex at `key`.  If that is an interrupt's futex word, bind the
+		 * thread to the interrupt.
+		 */
+		void handler_bind(ptraddr_t key, uint16_t threadID)
+		{
+			if (size_t index = index_for_futex_word(key);
+			    index < NumberOfInterrupts)
+			{
+				handlerThreads[index] = threadID;
+			}
+		}
+
+		/**
+		 * Returns the ID of the thread bound to the interrupt whose futex
+		 * word is `word`, or 0 if there is none.
+		 */
+		uint16_t handler_for(uint32_t &word)
+		{
+			size_t index =
+			  index_for_futex_word(CHERI::Capability{&word}.address());
+			return index < NumberOfInterrupts ? handlerThreads[index] : 0;
+		}
+
+		/**
+		 * Set the PLIC threshold for running the thread identified by
+		 * `threadID`: the highest priority of the interrupts bound to it, so
+		 * that only higher-priority interrupts preempt it, or 0 for threads
+		 * that handle no interrupts.
+		 */
+		void threshold_for_thread(uint16_t threadID)
+		{
+			Priority threshold = 0;
+			for (size_t i = 0; i < NumberOfInterrupts; i++)
+			{
+				if ((threadID != 0) && (handlerThreads[i] == threadID))
+				{
+					threshold =
+					  std::max(threshold, ConfiguredInterrupts[i].priority);
+				}
+			}
+			if (threshold != currentThreshold)
+			{
+				device.threshold_set(threshold);
+				currentThreshold = threshold;
+			}
+		}
+
 		private:
 		/**
 		 * The reserved space for the master PLIC. In theory there could be
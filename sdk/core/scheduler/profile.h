@@ -0,0 +1,36 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "common.h"
+#include <scheduler_profile.h>
+
+namespace
+{
+	static_assert((ProfileSamples & (ProfileSamples - 1)) == 0,
+	              "The scheduler profile size must be a power of two");
+
+#if defined(SCHEDULER_PROFILE_SAMPLES) && (SCHEDULER_PROFILE_SAMPLES > 0)
+	/**
+	 * Record a profiler sample.  As with `trace_record`, the scheduler is the
+	 * only writer and the count is advanced only once the sample is complete.
+	 */
+	void profile_sample(uint16_t thread, ptraddr_t compartment, ptraddr_t pc)
+	{
+		auto *profile = SHARED_OBJECT_WITH_PERMISSIONS(
+		  SchedulerProfile, scheduler_profile, true, true, false, false);
+		profile->samples[profile->written & (ProfileSamples - 1)] = {
+		  pc, compartment, thread, 0};
+		profile->capacity = ProfileSamples;
+		__c11_atomic_signal_fence(__ATOMIC_RELEASE);
+		profile->written++;
+	}
+#else
+	/**
+	 * Record a profiler sample.  Profiling is disabled in this build, so this
+	 * does nothing.
+	 */
+	void profile_sample(uint16_t, ptraddr_t, ptraddr_t) {}
+#endif
+} // namespace
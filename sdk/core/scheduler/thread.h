@@ -5,8 +5,10 @@
 
 #include "common.h"
 #include <cdefs.h>
+#include <ds/bits.h>
 #include <priv/riscv.h>
-#include <strings.h>
+#include <tick_macros.h>
+#include <utility>
 #include <utils.hh>
 
 namespace
@@ -18,7 +20,44 @@ namespace
 	// thread structures.
 	class MultiWaiterInternal;
 
-	uint64_t expiry_time_for_timeout(uint32_t timeout);
+	uint64_t expiry_time_for_timeout(const Timeout *timeout);
+	uint64_t ticks_since_boot();
+	uint64_t timer_now();
+	void     trace_priority_boost(uint16_t thread,
+	                              uint8_t  oldPriority,
+	                              uint8_t  newPriority);
+
+	/**
+	 * A CPU budget for one thread or shared by a group of threads.  The
+	 * threads that use a budget may run for a total of `Budget` ticks in each
+	 * period of `Period` ticks.  Once the budget is exhausted, they are not
+	 * scheduled again until the period ends, whatever their priority.
+	 */
+	struct CpuBudget
+	{
+		/// The replenishment period, in ticks.
+		const uint16_t Period;
+		/// The number of ticks of CPU time in each period.
+		const uint16_t Budget;
+		/// The timer cycles of budget left in the current period.
+		int64_t remaining = 0;
+		/// The timer value at which the current period ends.
+		uint64_t periodEnd = 0;
+
+		/**
+		 * Returns true if the budget is exhausted at `now`, after starting a
+		 * new period if the current one has ended.
+		 */
+		bool exhausted(uint64_t now)
+		{
+			if (now >= periodEnd)
+			{
+				remaining = int64_t(Budget) * TIMERCYCLES_PER_TICK;
+				periodEnd = now + uint64_t(Period) * TIMERCYCLES_PER_TICK;
+			}
+			return remaining <= 0;
+		}
+	};
 
 	template<size_t NPrios>
 	class ThreadImpl final : private utils::NoCopyNoMove
@@ -56,13 +95,11 @@ namespace
 		};
 
 		/**
-		 * The number of timer ticks elapsed since boot. We use uint64_t and
-		 * assume it never overflows. Note that uint64_t is not atomic on
-		 * 32-bit platforms, so this field is always modified with interrupts
-		 * disabled.
+		 * The root of the pairing heap of threads that are suspended with a
+		 * timeout, ordered by expiry time.  This is the thread whose timeout
+		 * expires first.  Threads suspended without a timeout (an expiry time
+		 * of -1) are not in the heap.
 		 */
-		static inline uint64_t ticksSinceBoot;
-		/// All threads that are suspended must be on this list.
 		static inline ThreadImpl *waitingList;
 
 		/// Returns the current running thread.
@@ -82,7 +119,11 @@ namespace
 
 			if (th != nullptr)
 			{
-				if (th->state == ThreadState::Ready)
+				// Round-robin among threads of the same priority.  Deadline
+				// scheduled threads are kept in deadline order instead.
+				if ((th->state == ThreadState::Ready) &&
+				    !th->is_deadline_scheduled() &&
+				    (priorityList[th->priority] == th))
 				{
 					priorityList[th->priority] = th->next;
 				}
@@ -94,6 +135,18 @@ namespace
 			}
 
 			current = priorityList[highestPriority];
+			if constexpr (CpuBudgets)
+			{
+				// A thread that shares a budget with the thread that exhausted
+				// it stays on its run queue until it is next picked.
+				uint64_t now = timer_now();
+				while ((current != nullptr) && current->is_budgeted() &&
+				       current->cpuBudget->exhausted(now))
+				{
+					current->throttle(current->cpuBudget->periodEnd);
+					current = priorityList[highestPriority];
+				}
+			}
 			if (current)
 			{
 				Debug::Assert(highestPriority == current->priority,
@@ -102,14 +155,18 @@ namespace
 				              current->threadId,
 				              highestPriority,
 				              current->priority,
-				              current->OriginalPriority);
-				if (current->priority != current->OriginalPriority)
+				              current->basePriority);
+				if (current->priority != current->basePriority)
 				{
 					Debug::log(
 					  "Running thread {} with boosted priority ({} from {})",
 					  current->id_get(),
 					  current->priority,
-					  current->OriginalPriority);
+					  current->basePriority);
+				}
+				if (current->is_deadline_scheduled() || current->is_budgeted())
+				{
+					current->runStart = timer_now();
 				}
 				return current->tStackPtr;
 			}
@@ -126,11 +183,11 @@ namespace
 
 		static uint32_t yield_timed()
 		{
-			uint64_t ticksAtStart = ticksSinceBoot;
+			uint64_t ticksAtStart = ticks_since_boot();
 
 			yield();
 
-			uint64_t elapsed = ticksSinceBoot - ticksAtStart;
+			uint64_t elapsed = ticks_since_boot() - ticksAtStart;
 			if (elapsed > std::numeric_limits<uint32_t>::max())
 			{
 				Debug::Assert(false, "Thread slept for too long, likely a bug");
@@ -154,7 +211,10 @@ namespace
 		{
 			if (t->remaining != 0)
 			{
-				suspend(t->remaining, newSleepQueue, yieldNotSleep);
+				suspend(expiry_time_for_timeout(t),
+				        newSleepQueue,
+				        yieldNotSleep,
+				        t->slack);
 			}
 			if ((t->remaining != 0) || yieldUnconditionally)
 			{
@@ -180,20 +240,37 @@ namespace
 		 */
 		static inline TrustedStack *schedTStack;
 
-		ThreadImpl(TrustedStack *tstack, uint16_t threadid, uint16_t priority)
+		ThreadImpl(TrustedStack *tstack,
+		           uint16_t      threadid,
+		           uint16_t      priority,
+		           uint16_t      period = 0,
+		           uint16_t      budget = 0)
 		  : threadId(threadid),
 		    priority(priority),
 		    OriginalPriority(priority),
+		    basePriority(priority),
+		    Period(period),
+		    Budget(budget),
 		    expiryTime(-1),
+		    timerSlack(0),
+		    deadline(0),
+		    budgetRemaining(0),
+		    runStart(0),
+		    cpuBudget(nullptr),
 		    state(ThreadState::Suspended),
 		    isYielding(false),
+		    isThrottled(false),
 		    sleepQueue(nullptr),
+		    notificationPending(false),
+		    notificationWaiting(false),
+		    notificationValue(0),
 		    tStackPtr(tstack)
 		{
 			static_assert(NPrios <
 			              std::numeric_limits<decltype(priority)>::max());
-			// All threads are created in blocked state.
-			timer_list_insert(&waitingList);
+			// All threads are created in blocked state, with no timeout and so
+			// not in the timer heap.
+			timerPrev = timerNext = timerChild = nullptr;
 		}
 
 		/**
@@ -222,6 +299,17 @@ namespace
 				sleepQueue = nullptr;
 			}
 			state = ThreadState::Ready;
+			if (is_deadline_scheduled())
+			{
+				// Start a new period if this thread has been waiting for one
+				// or if its deadline passed while it was blocked.
+				uint64_t now = timer_now();
+				if (isThrottled || (now >= deadline))
+				{
+					deadline_release(std::max(now, deadline));
+				}
+			}
+			isThrottled = false;
 			if (priorityList[priority] == nullptr)
 			{
 				// First thread at this priority ready.
@@ -242,7 +330,7 @@ namespace
 			{
 				multiWaiter = nullptr;
 			}
-			list_insert(&priorityList[priority]);
+			run_queue_insert(priority);
 			isYielding = false;
 
 			return schedule;
@@ -282,11 +370,15 @@ namespace
 		/**
 		 * Suspend this thread. Take it off the ready list. If it is suspended
 		 * waiting on a resource, add it to the list of that resource. No
-		 * matter what, it has to be added to the timer list.
+		 * matter what, it has to be added to the timer list, to expire at
+		 * the timer value `expiry` (-1 for never).  The timer may wake the
+		 * thread up to `slack` cycles later than that, to wake it together
+		 * with other threads.
 		 */
-		void suspend(uint32_t     waitTicks,
+		void suspend(uint64_t     expiry,
 		             ThreadImpl **newSleepQueue,
-		             bool         yieldNotSleep = false)
+		             bool         yieldNotSleep = false,
+		             uint32_t     slack         = 0)
 		{
 			isYielding = yieldNotSleep;
 			Debug::Assert(state == ThreadState::Ready,
@@ -300,18 +392,32 @@ namespace
 				list_insert(newSleepQueue);
 				sleepQueue = newSleepQueue;
 			}
-			expiryTime = expiry_time_for_timeout(waitTicks);
+			expiryTime = expiry;
+			timerSlack = slack;
 
 			timer_list_insert(&waitingList);
 		}
 
+		/**
+		 * Move this thread, which must be suspended on a sleep queue, to
+		 * `newSleepQueue` without waking it.
+		 */
+		void sleep_queue_move(ThreadImpl **newSleepQueue)
+		{
+			Debug::Assert(sleepQueue != nullptr,
+			              "Moving thread that is not on a sleep queue");
+			list_remove(sleepQueue);
+			list_insert(newSleepQueue);
+			sleepQueue = newSleepQueue;
+		}
+
 		/**
 		 * Boost the thread's thread to `newPriority` if that is larger than
-		 * the original priority or reset to the original priority if not.
+		 * the base priority or reset to the base priority if not.
 		 */
 		void priority_boost(uint8_t newPriority)
 		{
-			newPriority = std::max(newPriority, OriginalPriority);
+			newPriority = std::max(newPriority, basePriority);
 			if (newPriority == priority)
 			{
 				return;
@@ -321,7 +427,7 @@ namespace
 			if (state == ThreadState::Ready)
 			{
 				list_remove(&priorityList[priority]);
-				list_insert(&priorityList[newPriority]);
+				run_queue_insert(newPriority);
 				priorityMap |= 1U << newPriority;
 				priority_map_remove();
 			}
@@ -331,6 +437,7 @@ namespace
 			{
 				list_remove(sleepQueue);
 			}
+			trace_priority_boost(threadId, priority, newPriority);
 			priority = newPriority;
 			if (sleepQueue != nullptr)
 			{
@@ -338,6 +445,143 @@ namespace
 			}
 		}
 
+		/**
+		 * Returns true if this thread is scheduled earliest-deadline-first
+		 * among the threads at its priority level, rather than round robin.
+		 */
+		bool is_deadline_scheduled()
+		{
+			return Period != 0;
+		}
+
+		/**
+		 * Start a new period for a deadline-scheduled thread at `release`,
+		 * refilling its budget.
+		 */
+		void deadline_release(uint64_t release)
+		{
+			deadline        = release + uint64_t(Period) * TIMERCYCLES_PER_TICK;
+			budgetRemaining = int64_t(Budget) * TIMERCYCLES_PER_TICK;
+		}
+
+		/**
+		 * Limit this thread to `budget`, which may be shared with other
+		 * threads.
+		 */
+		void cpu_budget_set(CpuBudget *budget)
+		{
+			cpuBudget = budget;
+		}
+
+		/**
+		 * Returns true if this thread is limited to a CPU budget.
+		 */
+		bool is_budgeted()
+		{
+			return CpuBudgets && (cpuBudget != nullptr);
+		}
+
+		/**
+		 * Suspend this thread, which has used up its budget, until the timer
+		 * value `until`.  The caller is responsible for invoking the
+		 * scheduler.
+		 */
+		void throttle(uint64_t until)
+		{
+			Debug::Assert(state == ThreadState::Ready,
+			              "Throttling thread that is in state {}, not ready",
+			              static_cast<ThreadState>(state));
+			list_remove(&priorityList[priority]);
+			state = ThreadState::Suspended;
+			priority_map_remove();
+			isYielding  = false;
+			isThrottled = true;
+			expiryTime  = until;
+			timerSlack  = 0;
+			timer_list_insert(&waitingList);
+		}
+
+		/**
+		 * Suspend this deadline-scheduled thread until the start of its next
+		 * period, which is its current deadline.  The caller is responsible
+		 * for invoking the scheduler.
+		 */
+		void deadline_throttle()
+		{
+			throttle(deadline);
+		}
+
+		/**
+		 * Charge the time since it was last scheduled to the budget of the
+		 * current thread, if it is deadline scheduled or limited to a CPU
+		 * budget.  A thread that has exhausted its budget is throttled until
+		 * its next period and a deadline-scheduled thread that has missed its
+		 * deadline starts a new period immediately.
+		 *
+		 * Returns true if the run queues have changed and the scheduler must
+		 * pick a new thread.
+		 */
+		static bool deadline_charge()
+		{
+			ThreadImpl *th = current;
+			if ((th == nullptr) ||
+			    !(th->is_deadline_scheduled() || th->is_budgeted()))
+			{
+				return false;
+			}
+			uint64_t now = timer_now();
+			int64_t  ran = int64_t(now - th->runStart);
+			th->runStart = now;
+			if (th->is_budgeted())
+			{
+				th->cpuBudget->remaining -= ran;
+				if ((th->state == ThreadState::Ready) &&
+				    th->cpuBudget->exhausted(now))
+				{
+					th->throttle(th->cpuBudget->periodEnd);
+					return true;
+				}
+				return false;
+			}
+			th->budgetRemaining -= ran;
+			if (th->state != ThreadState::Ready)
+			{
+				return false;
+			}
+			if (now >= th->deadline)
+			{
+				Debug::log("Thread {} missed its deadline", th->threadId);
+				th->deadline_release(now);
+				th->list_remove(&priorityList[th->priority]);
+				th->run_queue_insert(th->priority);
+				return true;
+			}
+			if (th->budgetRemaining <= 0)
+			{
+				th->deadline_throttle();
+				return true;
+			}
+			return false;
+		}
+
+		/**
+		 * Returns the time at which this thread will exhaust its budget if it
+		 * runs without interruption, or the maximum time if it is neither
+		 * deadline scheduled nor limited to a CPU budget.
+		 */
+		uint64_t deadline_budget_end()
+		{
+			if (is_budgeted())
+			{
+				return runStart + std::max<int64_t>(cpuBudget->remaining, 0);
+			}
+			if (!is_deadline_scheduled())
+			{
+				return std::numeric_limits<uint64_t>::max();
+			}
+			return runStart + std::max<int64_t>(budgetRemaining, 0);
+		}
+
 		/**
 		 * Returns true if this thread is running with the highest priority of
 		 * any runnable threads.
@@ -407,44 +651,185 @@ namespace
 			}
 		}
 
-		/// Same as list_insert(), but sorted on ExpiryTime.
-		void timer_list_insert(ThreadImpl **headPtr)
+		/**
+		 * Insert self into the run queue for priority `level`.  Threads are
+		 * queued round robin, except that deadline-scheduled threads are
+		 * queued ahead of all other threads at the same level, ordered by
+		 * deadline.
+		 */
+		void run_queue_insert(uint8_t level)
 		{
-			ThreadImpl *head = *headPtr;
+			ThreadImpl **headPtr = &priorityList[level];
+			ThreadImpl  *head    = *headPtr;
+			if (!is_deadline_scheduled() || (head == nullptr))
+			{
+				list_insert(headPtr);
+				return;
+			}
+			auto runsAfterThis = [&](ThreadImpl *thread) {
+				return !thread->is_deadline_scheduled() ||
+				       (thread->deadline > deadline);
+			};
+			// Find the first thread that should run after this one.  If there
+			// is none, this wraps around to the head and this thread is
+			// inserted at the tail.
+			ThreadImpl *iter = head;
+			while (!runsAfterThis(iter))
+			{
+				iter = iter->next;
+				if (iter == head)
+				{
+					break;
+				}
+			}
+			ThreadImpl *before = iter->prev;
+			before->next = iter->prev = this;
+			next                      = iter;
+			prev                      = before;
+			if ((iter == head) && runsAfterThis(head))
+			{
+				*headPtr = this;
+			}
+		}
 
-			Debug::Assert(state == ThreadState::Suspended,
-			              "Inserting thread into timer list that is in state "
-			              "{}, not suspended",
-			              static_cast<ThreadState>(state));
-			if (head == nullptr)
+		/**
+		 * Merge two timer-heap roots, returning the new root.  Both arguments
+		 * must be roots (no parent or siblings) or null.
+		 */
+		static ThreadImpl *timer_heap_meld(ThreadImpl *a, ThreadImpl *b)
+		{
+			if (a == nullptr)
 			{
-				timerNext = timerPrev = *headPtr = this;
+				return b;
 			}
-			else
+			if (b == nullptr)
 			{
-				ThreadImpl *iter = head->timerPrev;
-				ThreadImpl *iterNext;
+				return a;
+			}
+			if (b->expiryTime < a->expiryTime)
+			{
+				std::swap(a, b);
+			}
+			// Make b the leftmost child of a.
+			b->timerPrev = a;
+			b->timerNext = a->timerChild;
+			if (a->timerChild != nullptr)
+			{
+				a->timerChild->timerPrev = b;
+			}
+			a->timerChild = b;
+			return a;
+		}
 
-				// Go back from tail, and stop at the first Thread whose expiry
-				// <= ours.
-				while (iter->expiryTime > expiryTime)
+		/**
+		 * Merge a list of sibling subheaps, starting at `first`, into a single
+		 * heap using the standard two-pass pairing, returning the new root.
+		 */
+		static ThreadImpl *timer_heap_merge_pairs(ThreadImpl *first)
+		{
+			// First pass: meld adjacent pairs left to right, collecting the
+			// results in reverse order.
+			ThreadImpl *pairs = nullptr;
+			while (first != nullptr)
+			{
+				ThreadImpl *a = first;
+				ThreadImpl *b = a->timerNext;
+				first         = (b == nullptr) ? nullptr : b->timerNext;
+				a->timerPrev = a->timerNext = nullptr;
+				if (b != nullptr)
 				{
-					iter = iter->timerPrev;
-					if (iter == head->timerPrev)
+					b->timerPrev = b->timerNext = nullptr;
+				}
+				ThreadImpl *melded = timer_heap_meld(a, b);
+				melded->timerNext  = pairs;
+				pairs              = melded;
+			}
+			// Second pass: meld the pairs right to left.
+			ThreadImpl *result = nullptr;
+			while (pairs != nullptr)
+			{
+				ThreadImpl *next = pairs->timerNext;
+				pairs->timerNext = nullptr;
+				result           = timer_heap_meld(result, pairs);
+				pairs            = next;
+			}
+			return result;
+		}
+
+		/**
+		 * Returns the parent of this thread in the timer heap.  This must not
+		 * be the root.
+		 */
+		ThreadImpl *timer_heap_parent()
+		{
+			ThreadImpl *thread = this;
+			while (thread->timerPrev->timerChild != thread)
+			{
+				thread = thread->timerPrev;
+			}
+			return thread->timerPrev;
+		}
+
+		/**
+		 * Returns the latest timer value at which the timer must fire to wake
+		 * every thread in the timer heap rooted at `root` within its slack:
+		 * the minimum of `expiryTime + timerSlack` over the heap.  Firing then
+		 * wakes every thread whose `expiryTime` has passed, so threads with
+		 * nearby expiry times share one timer interrupt.
+		 *
+		 * No thread in a subtree can expire before the root of the subtree,
+		 * so subtrees whose roots expire after the best time so far are
+		 * skipped.  If the root of the heap has no slack, this is constant
+		 * time.
+		 */
+		static uint64_t timer_heap_latest_wake(ThreadImpl *root)
+		{
+			uint64_t latest = root->expiryTime + root->timerSlack;
+			if (root->timerSlack == 0)
+			{
+				return latest;
+			}
+			ThreadImpl *thread = root->timerChild;
+			while (thread != nullptr)
+			{
+				if (thread->expiryTime < latest)
+				{
+					latest = std::min(latest,
+					                  thread->expiryTime + thread->timerSlack);
+					if (thread->timerChild != nullptr)
 					{
-						break;
+						thread = thread->timerChild;
+						continue;
 					}
 				}
-				iterNext        = iter->timerNext;
-				iter->timerNext = iterNext->timerPrev = this;
-				timerNext                             = iterNext;
-				timerPrev                             = iter;
-
-				if (expiryTime < head->expiryTime)
+				// Move to the next sibling of this thread or of its nearest
+				// ancestor that has one.
+				while ((thread != root) && (thread->timerNext == nullptr))
 				{
-					*headPtr = this;
+					thread = thread->timer_heap_parent();
 				}
+				thread = (thread == root) ? nullptr : thread->timerNext;
+			}
+			return latest;
+		}
+
+		/**
+		 * Insert this thread into the timer heap whose root `headPtr` points
+		 * to, ordered by `expiryTime`.  Threads with no timeout are not
+		 * inserted.  This is constant time.
+		 */
+		void timer_list_insert(ThreadImpl **headPtr)
+		{
+			Debug::Assert(state == ThreadState::Suspended,
+			              "Inserting thread into timer list that is in state "
+			              "{}, not suspended",
+			              static_cast<ThreadState>(state));
+			timerPrev = timerNext = timerChild = nullptr;
+			if (expiryTime == -1)
+			{
+				return;
 			}
+			*headPtr = timer_heap_meld(*headPtr, this);
 		}
 
 		/// Remove self from the list headPtr points to.
@@ -478,35 +863,35 @@ namespace
 			next = prev = nullptr;
 		}
 
-		/// Same as list_remove(), but for the timer list.
+		/**
+		 * Remove this thread from the timer heap whose root `headPtr` points
+		 * to, if it is present.  This takes amortised logarithmic time.
+		 */
 		void timer_list_remove(ThreadImpl **headPtr)
 		{
-			ThreadImpl *head = *headPtr;
-
-			if (timerNext == this)
+			if (*headPtr == this)
 			{
-				// We are the only one left on this list, clear the head.
-				Debug::Assert(timerPrev == this,
-				              "Invalid loop in thread list.  Next pointer "
-				              "points to this ({}) but previous pointer is {}",
-				              this,
-				              timerPrev);
-				*headPtr = nullptr;
+				*headPtr = timer_heap_merge_pairs(timerChild);
 			}
-			else
+			else if (timerPrev != nullptr)
 			{
-				ThreadImpl *prevThread = timerPrev;
-				ThreadImpl *nextThread = timerNext;
-
-				prevThread->timerNext = nextThread;
-				nextThread->timerPrev = prevThread;
-
-				if (head == this)
+				// Unlink this subheap from its parent or previous sibling.
+				if (timerPrev->timerChild == this)
+				{
+					timerPrev->timerChild = timerNext;
+				}
+				else
 				{
-					*headPtr = timerNext;
+					timerPrev->timerNext = timerNext;
 				}
+				if (timerNext != nullptr)
+				{
+					timerNext->timerPrev = timerPrev;
+				}
+				*headPtr =
+				  timer_heap_meld(*headPtr, timer_heap_merge_pairs(timerChild));
 			}
-			timerNext = timerPrev = nullptr;
+			timerPrev = timerNext = timerChild = nullptr;
 		}
 
 		uint16_t id_get()
@@ -519,6 +904,29 @@ namespace
 			return priority;
 		}
 
+		/**
+		 * Returns the priority that this thread was created with.  This is
+		 * the upper bound for `base_priority_set`.
+		 */
+		uint8_t priority_maximum()
+		{
+			return OriginalPriority;
+		}
+
+		/**
+		 * Set the priority that this thread runs at when it is not boosted by
+		 * priority inheritance and return the previous value.  The caller is
+		 * responsible for ensuring that `newPriority` is no higher than
+		 * `priority_maximum()` and for recomputing the effective priority
+		 * with `priority_boost`.
+		 */
+		uint8_t base_priority_set(uint8_t newPriority)
+		{
+			uint8_t previous = basePriority;
+			basePriority     = newPriority;
+			return previous;
+		}
+
 		bool is_ready()
 		{
 			return state == ThreadState::Ready;
@@ -555,17 +963,42 @@ namespace
 		ThreadImpl *prev;
 		ThreadImpl *next;
 		///@}
-		/// Linked list fields to the global timer list, when this thread is
-		/// blocked with a timeout.
+		/// Pairing-heap fields for the global timer heap, when this thread
+		/// is blocked with a timeout.  `timerPrev` is the parent for the
+		/// leftmost child and the previous sibling otherwise, and is null for
+		/// the root and for threads that are not in the heap.
 		///@{
 		ThreadImpl *timerPrev;
 		ThreadImpl *timerNext;
+		ThreadImpl *timerChild;
 		///@}
 		/// Pointer to the list of the resource this thread is blocked on.
 		ThreadImpl **sleepQueue;
 		/// If suspended, when will this thread expire. The maximum value is
 		/// special-cased to mean blocked indefinitely.
 		uint64_t expiryTime;
+		/// The number of cycles after `expiryTime` by which the timer may
+		/// delay waking this thread, so that it can be woken with others.
+		uint32_t timerSlack;
+
+		/**
+		 * For deadline-scheduled threads, the absolute deadline of the current
+		 * period (which is also the start of the next), in timer cycles.
+		 */
+		uint64_t deadline;
+		/**
+		 * For deadline-scheduled threads, the number of timer cycles of budget
+		 * left in the current period as of `runStart`.
+		 */
+		int64_t budgetRemaining;
+		/**
+		 * For deadline-scheduled threads, the time at which this thread was
+		 * last scheduled or charged for the time that it has run.
+		 */
+		uint64_t runStart;
+
+		/// The CPU budget that this thread is limited to, if any.
+		CpuBudget *cpuBudget;
 
 		/// The number of cycles that this thread has been scheduled for.
 		uint64_t cycles;
@@ -600,6 +1033,33 @@ namespace
 			 */
 			MultiWaiterInternal *multiWaiter;
 		};
+		/**
+		 * The futex waiter summary bucket in which this thread is counted
+		 * while it waits on a futex.  This is outside the union because a
+		 * thread that is woken by a timeout must find the bucket after
+		 * `futexWaitAddress` has been cleared, and `futex_requeue` may have
+		 * moved the thread to a futex in a different bucket.
+		 */
+		uint8_t futexSummaryBucket;
+		/**
+		 * The index of the futex wait queue that this thread is on while it
+		 * waits on a futex.  This is kept for the same reasons as
+		 * `futexSummaryBucket`.
+		 */
+		uint8_t futexWaitQueue;
+		/**
+		 * Is a notification pending?  Set by `thread_notify` and cleared when
+		 * the thread consumes the notification.
+		 */
+		bool notificationPending;
+		/**
+		 * Is this thread blocked waiting for a notification?  This is cleared
+		 * by `thread_notify` when it wakes the thread, so a thread that is
+		 * woken with this still set has timed out.
+		 */
+		bool notificationWaiting;
+		/// The notification value, updated by `thread_notify`.
+		uint32_t      notificationValue;
 		TrustedStack *tStackPtr;
 
 		private:
@@ -620,11 +1080,9 @@ namespace
 				}
 				else
 				{
-					// clz is only for 32-bit.
+					// The map is a single 32-bit word.
 					static_assert(NPrios <= 32);
-					uint_fast16_t topZeroes = clz(priorityMap);
-
-					highestPriority = NPrios - 1 - topZeroes;
+					highestPriority = ds::bits::highest_set(priorityMap);
 				}
 			}
 		}
@@ -647,6 +1105,19 @@ namespace
 		uint8_t priority;
 		/// The original priority level for this thread.  This never changes.
 		const uint8_t OriginalPriority;
+		/**
+		 * The priority level for this thread in the absence of priority
+		 * inheritance.  This starts as `OriginalPriority` and may be lowered
+		 * (and raised again, up to `OriginalPriority`) by the thread itself.
+		 */
+		uint8_t basePriority;
+		/**
+		 * The period, in ticks, of a deadline-scheduled thread, or zero for a
+		 * thread that is scheduled round robin with its priority peers.
+		 */
+		const uint16_t Period;
+		/// The number of ticks that this thread may run for in each period.
+		const uint16_t Budget;
 		ThreadState   state : 2;
 		/**
 		 * If the thread is yielding, it may be scheduled before its timeout
@@ -654,6 +1125,11 @@ namespace
 		 * shorter timeouts.
 		 */
 		bool isYielding : 1;
+		/**
+		 * If the thread is deadline scheduled or limited to a CPU budget and
+		 * is waiting for the start of its next period.
+		 */
+		bool isThrottled : 1;
 	};
 
 	using Thread = ThreadImpl<ThreadPrioNum>;
@@ -5,6 +5,7 @@
 
 #include "plic.h"
 #include "thread.h"
+#include <ds/divide.h>
 #include <platform-timer.hh>
 #include <stdint.h>
 #include <tick_macros.h>
@@ -32,9 +33,16 @@ namespace
 	 */
 	class Timer final : private TimerCore
 	{
-		inline static uint64_t lastTickTime         = 0;
-		inline static uint64_t zeroTickTime         = 0;
-		inline static uint32_t accumulatedTickError = 0;
+		/// The timer value at boot, from which ticks are counted.
+		inline static uint64_t zeroTickTime = 0;
+
+		/**
+		 * The thread whose round-robin time slice is currently armed, and the
+		 * time at which its slice ends.  Scheduler entries that do not change
+		 * the running thread leave the slice in place rather than extending it.
+		 */
+		inline static Thread  *sliceThread = nullptr;
+		inline static uint64_t sliceEnd    = 0;
 
 		public:
 		/**
@@ -54,6 +62,27 @@ namespace
 		 */
 		using TimerCore::time;
 
+		/**
+		 * Returns the timer value at boot.
+		 */
+		static uint64_t boot_time()
+		{
+			return zeroTickTime;
+		}
+
+		/**
+		 * Returns the number of ticks elapsed since boot.  This is computed
+		 * from the timer device on demand, rather than counted by a periodic
+		 * interrupt, so it remains correct while no timer interrupts fire.
+		 * The division by the (constant) tick length uses a precomputed
+		 * reciprocal rather than a call to the 64-bit division helper.
+		 */
+		static uint64_t ticks_since_boot()
+		{
+			return ds::divide::Reciprocal<TIMERCYCLES_PER_TICK>::divide(
+			  time() - zeroTickTime);
+		}
+
 		/**
 		 * Update the timer to fire the next timeout for the thread at the
 		 * front of the queue, or disable the timer if there are no threads
@@ -74,34 +103,110 @@ namespace
 		 * some care must be taken to ensure that dynamic priority propagation
 		 * via priority-inheriting futexes behaves correctly.
 		 *
+		 * The timer is not programmed at all when neither condition holds, so
+		 * an idle system or a single thread running alone takes no periodic
+		 * interrupts.  The tick count is derived from the timer device (see
+		 * `ticks_since_boot`) and so does not depend on interrupts firing.
+		 *
+		 * Threads blocked with timer slack (see `Timeout::slack`) may be
+		 * woken late, so the timer is armed for the latest time that wakes
+		 * every waiting thread within its slack, and all threads whose
+		 * timeouts have expired by then are woken by the same interrupt.
+		 *
+		 * The timer is also armed for the deadline of any interrupt whose
+		 * wake is being coalesced (see `InterruptController::coalesce`).
+		 *
 		 * This should be called after scheduling has changed the list of
 		 * waiting threads.
 		 */
 		static void update()
 		{
+			static constexpr uint64_t DistantFuture =
+			  std::numeric_limits<uint64_t>::max();
 			auto *thread             = Thread::current_get();
 			bool  waitingListIsEmpty = ((Thread::waitingList == nullptr) ||
                                        (Thread::waitingList->expiryTime == -1));
-			bool  threadHasNoPeers =
-			  (thread == nullptr) || (!thread->has_priority_peers());
-			if (waitingListIsEmpty && threadHasNoPeers)
+			// Deadline-scheduled threads are not time sliced, but are
+			// preempted when their budget runs out.
+			bool threadHasNoPeers = (thread == nullptr) ||
+			                        thread->is_deadline_scheduled() ||
+			                        (!thread->has_priority_peers());
+			uint64_t budgetEnd =
+			  (thread == nullptr) ? DistantFuture : thread->deadline_budget_end();
+			// With a profiling period, running threads are interrupted
+			// periodically to take samples.  The idle thread is not.
+			uint64_t profileEnd = ((ProfilePeriod == 0) || (thread == nullptr))
+			                        ? DistantFuture
+			                        : time() + ProfilePeriod;
+			// Coalesced interrupts whose waiters have not been woken must
+			// be woken by their deadline.
+			uint64_t coalesceEnd =
+			  InterruptController::master().coalesce_deadline();
+			if (threadHasNoPeers)
+			{
+				sliceThread = nullptr;
+			}
+			if (waitingListIsEmpty && threadHasNoPeers &&
+			    (budgetEnd == DistantFuture) && (profileEnd == DistantFuture) &&
+			    (coalesceEnd == DistantFuture))
 			{
 				clear();
 			}
 			else
 			{
-				static constexpr uint64_t DistantFuture =
-				  std::numeric_limits<uint64_t>::max();
-				uint64_t nextTick  = threadHasNoPeers
-				                       ? DistantFuture
-				                       : time() + TIMERCYCLES_PER_TICK;
-				uint64_t nextTimer = waitingListIsEmpty
-				                       ? DistantFuture
-				                       : Thread::waitingList->expiryTime;
+				uint64_t nextTick =
+				  std::min(budgetEnd, std::min(profileEnd, coalesceEnd));
+				if (!threadHasNoPeers)
+				{
+					uint64_t now = time();
+					if ((thread != sliceThread) || (sliceEnd <= now))
+					{
+						sliceThread = thread;
+						sliceEnd    = now + TIMERCYCLES_PER_TICK;
+					}
+					nextTick = std::min(nextTick, sliceEnd);
+				}
+				uint64_t nextTimer =
+				  waitingListIsEmpty
+				    ? DistantFuture
+				    : Thread::timer_heap_latest_wake(Thread::waitingList);
 				setnext(std::min(nextTick, nextTimer));
 			}
 		}
 
+		/**
+		 * Returns true if the timer interrupt that is being handled was armed
+		 * only to take a profiler sample: a thread is running, its time slice
+		 * has not ended, and no blocked thread's timeout has expired.  Such
+		 * interrupts must not rotate the run queue.
+		 */
+		static bool is_profile_only()
+		{
+			if constexpr (ProfilePeriod == 0)
+			{
+				return false;
+			}
+			uint64_t now = time();
+			return (Thread::current_get() != nullptr) &&
+			       ((sliceThread == nullptr) || (now < sliceEnd)) &&
+			       ((Thread::waitingList == nullptr) ||
+			        (Thread::waitingList->expiryTime > now));
+		}
+
+		/**
+		 * Returns the timer value by which the next thread blocked with a
+		 * timeout must be woken, or the maximum value if there is none.
+		 */
+		static uint64_t next_wake()
+		{
+			if ((Thread::waitingList == nullptr) ||
+			    (Thread::waitingList->expiryTime == -1))
+			{
+				return std::numeric_limits<uint64_t>::max();
+			}
+			return Thread::timer_heap_latest_wake(Thread::waitingList);
+		}
+
 		/**
 		 * Wake any threads that were sleeping until a timeout before the
 		 * current time.  This also wakes yielded threads if there are no
@@ -112,30 +217,12 @@ namespace
 		static void expiretimers()
 		{
 			uint64_t now = time();
-			Thread::ticksSinceBoot =
-			  (now - zeroTickTime) / TIMERCYCLES_PER_TICK;
-			if (Thread::waitingList == nullptr)
+			// The root of the timer heap is always the thread that expires
+			// first.  Waking it removes it from the heap.
+			while ((Thread::waitingList != nullptr) &&
+			       (Thread::waitingList->expiryTime <= now))
 			{
-				return;
-			}
-			for (Thread *iter = Thread::waitingList;;)
-			{
-				if (iter->expiryTime <= now)
-				{
-					Thread *iterNext = iter->timerNext;
-
-					iter->ready(Thread::WakeReason::Timer);
-					iter = iterNext;
-					if (Thread::waitingList == nullptr ||
-					    iter == Thread::waitingList)
-					{
-						break;
-					}
-				}
-				else
-				{
-					break;
-				}
+				Thread::waitingList->ready(Thread::WakeReason::Timer);
 			}
 			// If there are not runnable threads, try to wake a yielded thread
 			if (!Thread::any_ready())
@@ -164,12 +251,31 @@ namespace
 		}
 	};
 
-	uint64_t expiry_time_for_timeout(uint32_t timeout)
+	uint64_t expiry_time_for_timeout(const Timeout *timeout)
 	{
-		if (timeout == -1)
+		if (timeout->deadline != 0)
+		{
+			// Deadlines are cycle counter values, which advance at the same
+			// rate as the timer.
+			uint64_t now = rdcycle64();
+			uint64_t wait =
+			  (timeout->deadline > now) ? timeout->deadline - now : 0;
+			return Timer::time() + wait;
+		}
+		if (timeout->remaining == -1)
 		{
 			return -1;
 		}
-		return Timer::time() + (timeout * TIMERCYCLES_PER_TICK);
+		return Timer::time() + (timeout->remaining * TIMERCYCLES_PER_TICK);
+	}
+
+	uint64_t ticks_since_boot()
+	{
+		return Timer::ticks_since_boot();
+	}
+
+	uint64_t timer_now()
+	{
+		return Timer::time();
 	}
 } // namespace
@@ -0,0 +1,55 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "common.h"
+#include <riscvreg.h>
+#include <scheduler_trace.h>
+
+namespace
+{
+	static_assert((TraceEntries & (TraceEntries - 1)) == 0,
+	              "The scheduler trace size must be a power of two");
+
+#if defined(SCHEDULER_TRACE_ENTRIES) && (SCHEDULER_TRACE_ENTRIES > 0)
+	/**
+	 * Record an event in the scheduler trace.  The scheduler runs with
+	 * interrupts disabled, so it is the only writer.  The record is written
+	 * before the count is advanced so that readers never see a count that
+	 * covers an incomplete record from this writer.
+	 */
+	void trace_record(SchedulerTraceEvent event,
+	                  uint16_t            thread,
+	                  uint32_t            argument,
+	                  uint8_t             detail = 0)
+	{
+		auto *trace = SHARED_OBJECT_WITH_PERMISSIONS(
+		  SchedulerTrace, scheduler_trace, true, true, false, false);
+		trace->records[trace->written & (TraceEntries - 1)] = {
+		  rdcycle64(), thread, event, detail, argument};
+		trace->capacity = TraceEntries;
+		__c11_atomic_signal_fence(__ATOMIC_RELEASE);
+		trace->written++;
+	}
+#else
+	/**
+	 * Record an event in the scheduler trace.  Tracing is disabled in this
+	 * build, so this does nothing.
+	 */
+	void trace_record(SchedulerTraceEvent,
+	                  uint16_t,
+	                  uint32_t,
+	                  uint8_t = 0)
+	{
+	}
+#endif
+
+	void trace_priority_boost(uint16_t thread,
+	                          uint8_t  oldPriority,
+	                          uint8_t  newPriority)
+	{
+		trace_record(
+		  SchedulerTracePriorityBoost, thread, oldPriority, newPriority);
+	}
+} // namespace
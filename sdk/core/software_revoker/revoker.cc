@@ -5,6 +5,9 @@
 #include <array>
 #include <cheri.hh>
 #include <debug.hh>
+#include <futex.h>
+#include <limits>
+#include <riscvreg.h>
 #include <utility>
 
 using CHERI::Capability;
@@ -48,10 +51,20 @@ namespace
 	size_t length;
 	/**
 	 * The current revocation epoch.  If the low bit is 1, revocation is
-	 * running.
+	 * running.  This is also a futex word: every change is followed by a
+	 * `futex_wake`, so callers can sleep until revocation makes progress.
 	 */
 	uint32_t epoch;
 
+	/**
+	 * Advance the epoch and wake any threads waiting on it.
+	 */
+	void epoch_increment()
+	{
+		epoch++;
+		futex_wake(&epoch, std::numeric_limits<uint32_t>::max());
+	}
+
 	/**
 	 * The current state of the revoker's state machine.
 	 */
@@ -98,9 +111,51 @@ namespace
 	 * The number of capabilities to scan per tick.  This probably needs some
 	 * tuning.  Invoking the revoker costs around 400 cycles on Flute, so we're
 	 * likely to be spending about half of our total time on domain transitions
-	 * with a value <100.
+	 * with a value <100.  This bounds the time that a single tick runs with
+	 * interrupts disabled and can be set with the
+	 * `--software-revoker-tick-size` build option.
+	 */
+	static constexpr size_t TickSize =
+#ifdef CHERIOT_SOFTWARE_REVOKER_TICK_SIZE
+	  CHERIOT_SOFTWARE_REVOKER_TICK_SIZE
+#else
+	  4096
+#endif
+	  ;
+	static_assert(TickSize > 0, "The revoker must make progress on each tick");
+
+	/**
+	 * The number of cycles that a single tick may spend scanning, or zero if
+	 * ticks are bounded only by `TickSize`.  The budget is checked every
+	 * `BudgetCheckInterval` words, so a tick may overrun it by the time taken
+	 * to scan that many words.  Set with the `--software-revoker-cycle-budget`
+	 * build option.
+	 */
+	static constexpr uint64_t CycleBudget =
+#ifdef CHERIOT_SOFTWARE_REVOKER_CYCLE_BUDGET
+	  CHERIOT_SOFTWARE_REVOKER_CYCLE_BUDGET
+#else
+	  0
+#endif
+	  ;
+
+	/**
+	 * The number of words to scan between checks of the cycle budget.
 	 */
-	static constexpr size_t TickSize = 4096;
+	static constexpr size_t BudgetCheckInterval = std::min<size_t>(256, TickSize);
+
+	/**
+	 * True if a thread in this compartment (`revoker_background_run`) does
+	 * the scanning.  Calls to `revoker_tick` then only start a pass.  Set
+	 * with the `--software-revoker-background-thread` build option.
+	 */
+	static constexpr bool BackgroundThread =
+#ifdef CHERIOT_SOFTWARE_REVOKER_BACKGROUND_THREAD
+	  true
+#else
+	  false
+#endif
+	  ;
 
 	/**
 	 * Advance the state machine to the next state.
@@ -111,7 +166,7 @@ namespace
 		// should now be odd).
 		if (state == State::NotRunning)
 		{
-			epoch++;
+			epoch_increment();
 			assert((epoch & 1) == 1);
 		}
 		// Find the next state.
@@ -129,27 +184,54 @@ namespace
 		// be even).
 		if (state == State::NotRunning)
 		{
-			epoch++;
+			epoch_increment();
 			assert((epoch & 1) == 0);
 		}
 	}
 
 	/**
-	 * Scan a fixed-size range of the current memory region.
+	 * Scan the words in `[start, end)` of the current memory region.
 	 */
-	void scan_range()
+	void scan_words(size_t start, size_t end)
 	{
-		size_t end     = offset + std::min(length - offset, TickSize);
-		auto   current = get_globals(currentRange);
+		auto current = get_globals(currentRange);
 		// With interrupts disabled, loading and storing a capability will
 		// clear the tag on anything that has been revoked via the load
 		// barrier.
-		for (int i = offset; i < end; i++)
+		for (size_t i = start; i < end; i++)
 		{
 			current[i] = current[i];
 		}
-		// Record the amount that we've scanned.
-		offset = end;
+	}
+
+	/**
+	 * Scan a bounded range of the current memory region.  This scans at most
+	 * `TickSize` words and, if a cycle budget is configured, stops early once
+	 * the budget has been consumed.
+	 */
+	void scan_range()
+	{
+		size_t end = offset + std::min(length - offset, TickSize);
+		if constexpr (CycleBudget == 0)
+		{
+			scan_words(offset, end);
+			offset = end;
+		}
+		else
+		{
+			uint64_t start = rdcycle64();
+			while (offset < end)
+			{
+				size_t chunkEnd =
+				  offset + std::min(end - offset, BudgetCheckInterval);
+				scan_words(offset, chunkEnd);
+				offset = chunkEnd;
+				if ((rdcycle64() - start) >= CycleBudget)
+				{
+					break;
+				}
+			}
+		}
 		// Advance to the next state if we've finished scanning this range.
 		if (offset == length)
 		{
@@ -161,14 +243,44 @@ namespace
 
 void revoker_tick()
 {
-	// If we've been asked to run, make sure that we're running.
+	// If we've been asked to run, make sure that we're running.  Starting a
+	// pass advances the epoch, which wakes the background thread if there is
+	// one.
 	if (state == State::NotRunning)
 	{
 		advance();
 	}
-	// Do some work.
-	return scan_range();
+	// Do some work, unless the background thread is doing it.
+	if constexpr (!BackgroundThread)
+	{
+		scan_range();
+	}
+}
+
+#ifdef CHERIOT_SOFTWARE_REVOKER_BACKGROUND_THREAD
+void revoker_background_run()
+{
+	while (true)
+	{
+		// Sleep until a pass starts.  The epoch is odd while a pass is
+		// running, and every change to it wakes waiters.
+		uint32_t current = epoch;
+		if ((current & 1) == 0)
+		{
+			futex_wait(&epoch, current);
+			continue;
+		}
+		// Scan one tick's worth of memory.  Interrupts are enabled between
+		// ticks, so higher-priority threads can preempt this one.
+		CHERI::with_interrupts_disabled([]() {
+			if (state != State::NotRunning)
+			{
+				scan_range();
+			}
+		});
+	}
 }
+#endif
 
 const uint32_t *revoker_epoch_get()
 {
@@ -176,3 +288,32 @@ const uint32_t *revoker_epoch_get()
 	epochPtr.permissions() &= {Permission::Load, Permission::Global};
 	return epochPtr;
 }
+
+uint32_t revoker_progress_get()
+{
+	if (state == State::NotRunning)
+	{
+		return 0;
+	}
+	// Progress is measured in words scanned across all three regions, so the
+	// result reflects the (much larger) heap taking most of the time.
+	size_t total = 0;
+	size_t done  = 0;
+	for (int i = 0; i < 3; i++)
+	{
+		size_t rangeLength =
+		  __builtin_cheri_length_get(get_globals(i)) / sizeof(void *);
+		total += rangeLength;
+		if (i < currentRange)
+		{
+			done += rangeLength;
+		}
+	}
+	done += offset;
+	if (total == 0)
+	{
+		return 0;
+	}
+	// Never report a running pass as complete.
+	return std::min<uint32_t>((done * 100) / total, 99);
+}
@@ -15,3 +15,6 @@ EXPORT_ASSEMBLY_OFFSET(ExportTable, errorHandlerStackless, 18)
 EXPORT_ASSEMBLY_EXPRESSION(ExportEntryInterruptStatusSwitcherMask,
                            ExportEntry::InterruptStatusSwitcherMask,
                            0x10)
+EXPORT_ASSEMBLY_EXPRESSION(ExportEntryBoundedStack,
+                           ExportEntry::BoundedStack,
+                           0x40)
@@ -21,7 +21,9 @@ EXPORT_ASSEMBLY_EXPRESSION(COMPARTMENT_STACK_PERMISSIONS,
                            0x7e)
 
 /**
- * Space reserved at the top of a stack on entry to the compartment.
+ * Space reserved at the top of a stack on entry to the compartment.  This
+ * holds the head of the unwind list (`INVOCATION_LOCAL_UNWIND_LIST_OFFSET`)
+ * and the thread ID (`INVOCATION_LOCAL_THREAD_ID_OFFSET`).
  *
  * This *must* be a multiple of 16, which is the stack alignment.
  */
@@ -47,10 +47,14 @@ EXPORT_ASSEMBLY_OFFSET(TrustedStack,
                        TSTACK_REGFRAME_SZ + TSTACK_HEADER_SZ)
 EXPORT_ASSEMBLY_OFFSET(TrustedStack, frameoffset, TSTACK_REGFRAME_SZ)
 EXPORT_ASSEMBLY_OFFSET(TrustedStack, threadID, TSTACK_REGFRAME_SZ + 2)
+#ifdef CONFIG_MSHWM
+EXPORT_ASSEMBLY_OFFSET(TrustedStack, mshwmLowest, TSTACK_REGFRAME_SZ + 4)
+#endif
 
 EXPORT_ASSEMBLY_OFFSET(TrustedStackFrame, csp, 0)
 EXPORT_ASSEMBLY_OFFSET(TrustedStackFrame, calleeExportTable, 8)
 EXPORT_ASSEMBLY_OFFSET(TrustedStackFrame, errorHandlerCount, 16)
+EXPORT_ASSEMBLY_OFFSET(TrustedStackFrame, stackLowest, 20)
 // If you change this value, you must replace size_to_trusted_stack_frames in
 // entry.S with something that divides by the new size.
 EXPORT_ASSEMBLY_SIZE(TrustedStackFrame, (8 * 3))
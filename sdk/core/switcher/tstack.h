@@ -32,6 +32,13 @@ struct TrustedStackFrame
 	 * will forcibly unwind the stack.
 	 */
 	uint16_t errorHandlerCount;
+	/**
+	 * The lowest stack address that the callee has used, not counting the
+	 * stack used by calls that it makes, as of its most recent outgoing
+	 * cross-compartment call.  This is maintained only if the switcher is
+	 * built with stack peak recording.
+	 */
+	uint32_t stackLowest;
 };
 
 /**
@@ -72,10 +79,17 @@ struct TrustedStackGeneric
 	 * The ID of the current thread.  Never modified during execution.
 	 */
 	uint16_t threadID;
+#ifdef CONFIG_MSHWM
+	/**
+	 * The lowest address that this thread has stored to on its stack, as of
+	 * the last time that the switcher reset the stack high water mark.
+	 */
+	uint32_t mshwmLowest;
+#endif
 	// Padding up to multiple of 16-bytes.
 	uint8_t padding[
 #ifdef CONFIG_MSHWM
-	  12
+	  8
 #else
 	  4
 #endif
@@ -1,6 +1,14 @@
 #pragma once
+/**
+ * FreeRTOS event group compatibility layer.
+ *
+ * By default, event groups are allocated on the heap and wrap the event group
+ * library (`event.h`).  If `CHERIOT_FREERTOS_FUTEX_EVENT_GROUPS` is defined,
+ * event groups are instead a single futex word that may be statically
+ * allocated with `xEventGroupCreateStatic`.  All operations on these run
+ * inline, calling the scheduler only to block or to wake waiters.
+ */
 #include "FreeRTOS.h"
-#include <event.h>
 #include <stdint.h>
 #include <stdlib.h>
 
@@ -9,6 +17,180 @@
  */
 typedef uint32_t EventBits_t;
 
+#ifdef CHERIOT_FREERTOS_FUTEX_EVENT_GROUPS
+#	include <errno.h>
+#	include <futex.h>
+
+/**
+ * Storage for a futex-based event group.
+ */
+typedef struct
+{
+	/**
+	 * The event bits.  This is also the futex word that waiters block on.
+	 */
+	uint32_t bits;
+} StaticEventGroup_t;
+
+/**
+ * Type for event group handles.
+ */
+typedef StaticEventGroup_t *EventGroupHandle_t;
+
+/**
+ * Initialise a statically allocated event group with no bits set.
+ */
+__always_inline static inline EventGroupHandle_t
+xEventGroupCreateStatic(StaticEventGroup_t *pxEventGroupBuffer)
+{
+	pxEventGroupBuffer->bits = 0;
+	return pxEventGroupBuffer;
+}
+
+#	ifndef CHERIOT_NO_AMBIENT_MALLOC
+/**
+ * Create a new event group on the heap.  Returns NULL on allocation failure.
+ */
+static inline EventGroupHandle_t xEventGroupCreate(void)
+{
+	EventGroupHandle_t ret =
+	  (EventGroupHandle_t)malloc(sizeof(StaticEventGroup_t));
+	if (ret != NULL)
+	{
+		xEventGroupCreateStatic(ret);
+	}
+	return ret;
+}
+#	endif
+
+/**
+ * Update the bits of an event group to `(bits | set) & ~clear`.  This runs
+ * with interrupts disabled so that it is atomic without calling the atomics
+ * library.  Returns the new value.
+ */
+[[cheri::interrupt_state(disabled)]] static inline EventBits_t
+cheriot_freertos_event_group_update(EventGroupHandle_t xEventGroup,
+                                    EventBits_t        set,
+                                    EventBits_t        clear)
+{
+	xEventGroup->bits = (xEventGroup->bits | set) & ~clear;
+	return xEventGroup->bits;
+}
+
+/**
+ * Check whether the bits that a waiter wants are set, clearing them if
+ * `clearOnExit` is true and they are.  This runs with interrupts disabled.
+ * The bits before any clearing are returned via `observed`.  Returns non-zero
+ * if the wait condition holds.
+ */
+[[cheri::interrupt_state(disabled)]] static inline _Bool
+cheriot_freertos_event_group_check(EventGroupHandle_t xEventGroup,
+                                   EventBits_t        bitsWanted,
+                                   _Bool              clearOnExit,
+                                   _Bool              waitForAll,
+                                   EventBits_t       *observed)
+{
+	EventBits_t bits  = xEventGroup->bits;
+	EventBits_t found = bits & bitsWanted;
+	*observed         = bits;
+	if (waitForAll ? (found != bitsWanted) : (found == 0))
+	{
+		return 0;
+	}
+	if (clearOnExit)
+	{
+		xEventGroup->bits = bits & ~bitsWanted;
+	}
+	return 1;
+}
+
+/**
+ * Set bits in an event group and wake any threads that may be waiting on it.
+ * Returns the new value of the event group after this call.
+ */
+static inline EventBits_t xEventGroupSetBits(EventGroupHandle_t xEventGroup,
+                                             const EventBits_t  uxBitsToSet)
+{
+	EventBits_t ret =
+	  cheriot_freertos_event_group_update(xEventGroup, uxBitsToSet, 0);
+	if (futex_may_have_waiters(&xEventGroup->bits))
+	{
+		futex_wake(&xEventGroup->bits, UINT32_MAX);
+	}
+	return ret;
+}
+
+/**
+ * Clear bits in an event group.  This does not wake any threads.  Returns the
+ * value of the event group before the bits were cleared.
+ */
+static inline EventBits_t
+xEventGroupClearBits(EventGroupHandle_t xEventGroup,
+                     const EventBits_t  uxBitsToClear)
+{
+	EventBits_t ret = xEventGroup->bits;
+	cheriot_freertos_event_group_update(xEventGroup, 0, uxBitsToClear);
+	return ret;
+}
+
+/**
+ * Returns the bits that are currently set in an event group.
+ *
+ * Note: This API is inherently racy.
+ */
+__always_inline static inline EventBits_t
+xEventGroupGetBits(EventGroupHandle_t xEventGroup)
+{
+	return *(volatile uint32_t *)&xEventGroup->bits;
+}
+
+/**
+ * Wait for bits in an event group to be set.  Returns the value of the event
+ * group when the condition became true (before any bits were cleared), or
+ * when the timeout expired.  Blocks until either the timeout expires or some
+ * or all `uxBitsToWaitFor` are set, depending on the value of
+ * `xWaitForAllBits`.  If `xClearOnExit` is true, the bits that were waited for
+ * are cleared before returning if the condition became true.
+ *
+ * Note: As with the library event groups, a waiter may miss bits that are
+ * set and then cleared again before it is next scheduled.
+ */
+static inline EventBits_t xEventGroupWaitBits(EventGroupHandle_t xEventGroup,
+                                              const EventBits_t uxBitsToWaitFor,
+                                              const BaseType_t  xClearOnExit,
+                                              const BaseType_t  xWaitForAllBits,
+                                              TickType_t        xTicksToWait)
+{
+	EventBits_t    observed;
+	struct Timeout timeout = {0, xTicksToWait};
+	while (!cheriot_freertos_event_group_check(xEventGroup,
+	                                           uxBitsToWaitFor,
+	                                           xClearOnExit,
+	                                           xWaitForAllBits,
+	                                           &observed))
+	{
+		if (futex_timed_wait(
+		      &timeout, &xEventGroup->bits, observed, FutexNone) == -ETIMEDOUT)
+		{
+			return xEventGroupGetBits(xEventGroup);
+		}
+	}
+	return observed;
+}
+
+/**
+ * Delete an event group allocated with `xEventGroupCreate`.
+ *
+ * Note: As on FreeRTOS, if there are waiters blocked on this event group then
+ * they will remain blocked until their timeout (if ever).
+ */
+static inline void vEventGroupDelete(EventGroupHandle_t xEventGroup)
+{
+	free(xEventGroup);
+}
+#else
+#	include <event.h>
+
 /**
  * Type for event group handles.
  */
@@ -74,3 +256,4 @@ static inline void vEventGroupDelete(EventGroupHandle_t xEventGroup)
 {
 	eventgroup_destroy(MALLOC_CAPABILITY, xEventGroup);
 }
+#endif
@@ -68,6 +68,28 @@ xQueueSendToBackFromISR(QueueHandle_t queueHandle,
 	return xQueueSendToBack(queueHandle, buffer, 0);
 }
 
+/**
+ * Send a message to the queue.  This is the same as `xQueueSendToBack`.
+ */
+__always_inline static inline BaseType_t
+xQueueSend(QueueHandle_t queueHandle, const void *buffer, TickType_t waitTicks)
+{
+	return xQueueSendToBack(queueHandle, buffer, waitTicks);
+}
+
+/**
+ * Send a message to the queue from an ISR.  This is the same as
+ * `xQueueSendToBackFromISR`.
+ */
+__always_inline static inline BaseType_t
+xQueueSendFromISR(QueueHandle_t queueHandle,
+                  const void   *buffer,
+                  BaseType_t   *pxHigherPriorityTaskWoken)
+{
+	return xQueueSendToBackFromISR(
+	  queueHandle, buffer, pxHigherPriorityTaskWoken);
+}
+
 #ifndef CHERIOT_NO_AMBIENT_MALLOC
 /**
  * Create a queue that can store `uxQueueLength` messages of size `uxItemSize`.
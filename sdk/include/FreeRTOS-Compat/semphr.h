@@ -12,8 +12,14 @@
  * - `CHERIOT_EXPOSE_FREERTOS_MUTEX`: Enable non-recursive, priority-inheriting
  * mutexes.
  * - `CHERIOT_EXPOSE_FREERTOS_RECURSIVE_MUTEX`: Enable recursive mutexes.
+ *
+ * Counting and binary semaphores are taken and given inline when this does
+ * not need to block or to wake a waiter, without calling into the locks
+ * library.  Mutexes map directly onto priority-inheriting flag locks.
  */
 #include "FreeRTOS.h"
+#include <errno.h>
+#include <futex.h>
 #include <locks.h>
 #include <stdatomic.h>
 
@@ -131,6 +137,82 @@ typedef struct
 typedef StaticSemaphore_t *SemaphoreHandle_t;
 
 #ifdef CHERIOT_EXPOSE_FREERTOS_SEMAPHORE
+/**
+ * Bit in the count word of a `CountingSemaphoreState` that indicates that
+ * threads may be blocked in `semaphore_get`.  This must match `WaitersBit` in
+ * `lib/locks/semaphore.cc`.
+ */
+#	define CHERIOT_FREERTOS_SEMAPHORE_WAITERS (1U << 31)
+
+/**
+ * Decrement the count of a semaphore if it is not zero.  This runs with
+ * interrupts disabled and so is atomic without calling the atomics library.
+ * Returns non-zero if the count was decremented.
+ */
+[[cheri::interrupt_state(disabled)]] static inline _Bool
+cheriot_freertos_semaphore_try_get(struct CountingSemaphoreState *semaphore)
+{
+	uint32_t *word = (uint32_t *)&semaphore->count;
+	if ((*word & ~CHERIOT_FREERTOS_SEMAPHORE_WAITERS) == 0)
+	{
+		return 0;
+	}
+	*word -= 1;
+	return 1;
+}
+
+/**
+ * Increment the count of a semaphore, clearing the waiters bit.  This runs
+ * with interrupts disabled.  Returns `-EINVAL` if the count is already at the
+ * maximum, 1 if there may be waiters to wake, or 0 otherwise.
+ */
+[[cheri::interrupt_state(disabled)]] static inline int
+cheriot_freertos_semaphore_try_put(struct CountingSemaphoreState *semaphore)
+{
+	uint32_t *word  = (uint32_t *)&semaphore->count;
+	uint32_t  count = *word & ~CHERIOT_FREERTOS_SEMAPHORE_WAITERS;
+	if (count == semaphore->maxCount)
+	{
+		return -EINVAL;
+	}
+	int hasWaiters = (*word & CHERIOT_FREERTOS_SEMAPHORE_WAITERS) != 0;
+	*word          = count + 1;
+	return hasWaiters;
+}
+
+/**
+ * Semaphore get.  Takes the semaphore inline if its count is not zero and
+ * falls back to `semaphore_get` to block otherwise.  Returns 0 on success or
+ * the error from `semaphore_get`.
+ */
+__always_inline static inline int
+cheriot_freertos_semaphore_get(Timeout                       *timeout,
+                               struct CountingSemaphoreState *semaphore)
+{
+	if (cheriot_freertos_semaphore_try_get(semaphore))
+	{
+		return 0;
+	}
+	return semaphore_get(timeout, semaphore);
+}
+
+/**
+ * Semaphore put, compatible with `semaphore_get`.  The scheduler is called
+ * only if there may be threads to wake.  Returns 0 on success or `-EINVAL` if
+ * the count is already at the maximum.
+ */
+__always_inline static inline int
+cheriot_freertos_semaphore_put(struct CountingSemaphoreState *semaphore)
+{
+	int ret = cheriot_freertos_semaphore_try_put(semaphore);
+	if (ret > 0)
+	{
+		futex_wake((uint32_t *)&semaphore->count, UINT32_MAX);
+		ret = 0;
+	}
+	return ret;
+}
+
 /**
  * Initialise a statically allocated semaphore.  The initial value and maximum
  * are specified with `uxInitialCount` and `uxMaxCount` respectively.
@@ -178,7 +260,7 @@ xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
  * Create a heap-allocated binary semaphore.
  *
  * Binary semaphores are implemented as counting semaphores with a maximum count
- * of 1.
+ * of 1.  Uncontended takes and gives do not leave the calling compartment.
  */
 __always_inline static inline SemaphoreHandle_t xSemaphoreCreateBinary()
 {
@@ -189,7 +271,7 @@ __always_inline static inline SemaphoreHandle_t xSemaphoreCreateBinary()
  * Create a statically allocated binary semaphore.
  *
  * Binary semaphores are implemented as counting semaphores with a maximum count
- * of 1.
+ * of 1.  Uncontended takes and gives do not leave the calling compartment.
  */
 __always_inline static inline SemaphoreHandle_t
 xSemaphoreCreateBinaryStatic(StaticSemaphore_t *pxSemaphoreBuffer)
@@ -305,7 +387,9 @@ static inline UBaseType_t uxSemaphoreGetCount(SemaphoreHandle_t xSemaphore)
 {
 	CHERIOT_FREERTOS_SEMAPHORE_SWITCH(xSemaphore)
 	{
-		CHERIOT_FREERTOS_SEMAPHORE_CASE(return xSemaphore->semaphore.count;)
+		CHERIOT_FREERTOS_SEMAPHORE_CASE(
+		  return *(uint32_t *)&xSemaphore->semaphore.count &
+		         ~CHERIOT_FREERTOS_SEMAPHORE_WAITERS;)
 		CHERIOT_FREERTOS_RECURSIVE_MUTEX_CASE(
 		  return xSemaphore->recursiveMutex.lock.lockWord != 0;)
 		CHERIOT_FREERTOS_MUTEX_CASE(return xSemaphore->mutex.lockWord != 0;)
@@ -326,7 +410,7 @@ static inline _Bool xSemaphoreTake(SemaphoreHandle_t xSemaphore,
 	CHERIOT_FREERTOS_SEMAPHORE_SWITCH(xSemaphore)
 	{
 		CHERIOT_FREERTOS_SEMAPHORE_CASE(
-		  ret = semaphore_get(&t, &xSemaphore->semaphore);)
+		  ret = cheriot_freertos_semaphore_get(&t, &xSemaphore->semaphore);)
 		CHERIOT_FREERTOS_MUTEX_CASE(
 		  ret = flaglock_priority_inheriting_trylock(&t, &xSemaphore->mutex);)
 		// Recursive mutexes are not supposed to use this interface.
@@ -374,7 +458,7 @@ __always_inline static inline _Bool xSemaphoreGive(SemaphoreHandle_t xSemaphore)
 	CHERIOT_FREERTOS_SEMAPHORE_SWITCH(xSemaphore)
 	{
 		CHERIOT_FREERTOS_SEMAPHORE_CASE(
-		  ret = semaphore_put(&xSemaphore->semaphore);)
+		  ret = cheriot_freertos_semaphore_put(&xSemaphore->semaphore);)
 		CHERIOT_FREERTOS_MUTEX_CASE(flaglock_unlock(&xSemaphore->mutex);
 		                            ret = 0;)
 		// Recursive mutexes are not supposed to use this interface.
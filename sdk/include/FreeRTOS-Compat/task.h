@@ -75,6 +75,101 @@ static inline TaskHandle_t xTaskGetCurrentTaskHandle(void)
 	return thread_id_get();
 }
 
+/**
+ * Actions for `xTaskNotify`.  These map directly onto `ThreadNotifyAction`.
+ */
+typedef enum
+{
+	eNoAction                 = ThreadNotifyNoAction,
+	eSetBits                  = ThreadNotifySetBits,
+	eIncrement                = ThreadNotifyIncrement,
+	eSetValueWithOverwrite    = ThreadNotifySetValueWithOverwrite,
+	eSetValueWithoutOverwrite = ThreadNotifySetValueWithoutOverwrite,
+} eNotifyAction;
+
+/**
+ * Send a notification to a task.  Task notifications are held in the
+ * scheduler and so do not require any allocation.  Returns `pdPASS` on
+ * success, or `pdFAIL` if `eAction` is `eSetValueWithoutOverwrite` and the
+ * task already has a notification pending.
+ */
+static inline BaseType_t xTaskNotify(TaskHandle_t  xTaskToNotify,
+                                     uint32_t      ulValue,
+                                     eNotifyAction eAction)
+{
+	return thread_notify(xTaskToNotify, ulValue, eAction) == 0 ? pdPASS
+	                                                           : pdFAIL;
+}
+
+/**
+ * Send a notification to a task from an ISR.  CHERIoT RTOS does not permit
+ * code to run in ISRs and so this is the same as `xTaskNotify`.  A yield is
+ * never necessary and so `*pxHigherPriorityTaskWoken` is set to `pdFALSE`.
+ */
+static inline BaseType_t
+xTaskNotifyFromISR(TaskHandle_t  xTaskToNotify,
+                   uint32_t      ulValue,
+                   eNotifyAction eAction,
+                   BaseType_t   *pxHigherPriorityTaskWoken)
+{
+	*pxHigherPriorityTaskWoken = pdFALSE;
+	return xTaskNotify(xTaskToNotify, ulValue, eAction);
+}
+
+/**
+ * Increment a task's notification value, for use with `ulTaskNotifyTake`.
+ */
+static inline BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+	return xTaskNotify(xTaskToNotify, 0, eIncrement);
+}
+
+/**
+ * Increment a task's notification value from an ISR.  This is the same as
+ * `xTaskNotifyGive`.
+ */
+static inline void
+vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify,
+                       BaseType_t  *pxHigherPriorityTaskWoken)
+{
+	*pxHigherPriorityTaskWoken = pdFALSE;
+	xTaskNotifyGive(xTaskToNotify);
+}
+
+/**
+ * Wait for up to `xTicksToWait` ticks for the current task's notification
+ * value to be non-zero.  Returns the value before it is decremented (or
+ * cleared, if `xClearCountOnExit` is true), or zero on timeout.
+ */
+static inline uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit,
+                                        TickType_t xTicksToWait)
+{
+	Timeout  t     = {0, xTicksToWait};
+	uint32_t value = 0;
+	thread_notify_take(&t, xClearCountOnExit, &value);
+	return value;
+}
+
+/**
+ * Wait for up to `xTicksToWait` ticks for a notification to the current task.
+ * See `thread_notify_wait` for the meaning of the bit masks.  If
+ * `pulNotificationValue` is not null, the notification value is returned via
+ * it.  Returns `pdTRUE` if a notification was received, `pdFALSE` otherwise.
+ */
+static inline BaseType_t xTaskNotifyWait(uint32_t   ulBitsToClearOnEntry,
+                                         uint32_t   ulBitsToClearOnExit,
+                                         uint32_t  *pulNotificationValue,
+                                         TickType_t xTicksToWait)
+{
+	Timeout t = {0, xTicksToWait};
+	return thread_notify_wait(&t,
+	                          ulBitsToClearOnEntry,
+	                          ulBitsToClearOnExit,
+	                          pulNotificationValue) == 0
+	         ? pdTRUE
+	         : pdFALSE;
+}
+
 __BEGIN_DECLS
 
 /**
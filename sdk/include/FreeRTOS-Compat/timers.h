@@ -0,0 +1,152 @@
+#pragma once
+/**
+ * FreeRTOS software timer compatibility layer.
+ *
+ * Timers are provided by the `timer_service` compartment (`timer_service.h`),
+ * whose thread runs every timer's callback.  There is no timer command queue:
+ * each command takes effect before the call returns, so the `xTicksToWait`
+ * arguments are ignored.  Callbacks are CHERI callbacks and so must be
+ * declared with `__cheri_callback`.
+ */
+#include "FreeRTOS.h"
+#include <stdlib.h>
+#include <timer_service.h>
+#define INC_TIMERS_H
+
+/**
+ * Timer handle.  This is a sealed pointer to the timer service's state.
+ */
+typedef struct SObjStruct *TimerHandle_t;
+
+/**
+ * The type of a timer callback.  This is called with the handle of the timer
+ * that expired.
+ */
+typedef __cheri_callback void (*TimerCallbackFunction_t)(TimerHandle_t xTimer);
+
+#ifndef CHERIOT_NO_AMBIENT_MALLOC
+/**
+ * Create a timer that calls `pxCallbackFunction` every `xTimerPeriodInTicks`
+ * ticks if `xAutoReload` is true, or once otherwise, after it is started.
+ * The name is ignored.  `pvTimerID` must be global (or untagged) and can be
+ * retrieved with `pvTimerGetTimerID`.
+ *
+ * Returns NULL on failure.
+ */
+static inline TimerHandle_t
+xTimerCreate(const char             *pcTimerName,
+             TickType_t              xTimerPeriodInTicks,
+             BaseType_t              xAutoReload,
+             void                   *pvTimerID,
+             TimerCallbackFunction_t pxCallbackFunction)
+{
+	struct Timeout timeout = {0, UnlimitedTimeout};
+	TimerHandle_t  ret     = NULL;
+	uint32_t       flags   = TimerServicePassHandle;
+	if (xAutoReload)
+	{
+		flags |= TimerServicePeriodic;
+	}
+	(void)pcTimerName;
+	timer_service_create(&timeout,
+	                     MALLOC_CAPABILITY,
+	                     &ret,
+	                     (TimerServiceCallback)pxCallbackFunction,
+	                     pvTimerID,
+	                     xTimerPeriodInTicks,
+	                     flags);
+	return ret;
+}
+
+/**
+ * Stop and free a timer.  Returns `pdPASS` on success, `pdFAIL` otherwise.
+ */
+static inline BaseType_t xTimerDelete(TimerHandle_t xTimer,
+                                      TickType_t    xTicksToWait)
+{
+	(void)xTicksToWait;
+	return timer_service_destroy(MALLOC_CAPABILITY, xTimer) == 0 ? pdPASS
+	                                                             : pdFAIL;
+}
+#endif
+
+/**
+ * Start a timer, or restart it if it is already running, so that it expires
+ * one period from now.  Returns `pdPASS` on success, `pdFAIL` otherwise.
+ */
+static inline BaseType_t xTimerStart(TimerHandle_t xTimer,
+                                     TickType_t    xTicksToWait)
+{
+	(void)xTicksToWait;
+	return timer_service_start(xTimer) == 0 ? pdPASS : pdFAIL;
+}
+
+/**
+ * Restart a timer.  This is the same as `xTimerStart`.
+ */
+static inline BaseType_t xTimerReset(TimerHandle_t xTimer,
+                                     TickType_t    xTicksToWait)
+{
+	return xTimerStart(xTimer, xTicksToWait);
+}
+
+/**
+ * Stop a timer.  Returns `pdPASS` on success, `pdFAIL` otherwise.
+ */
+static inline BaseType_t xTimerStop(TimerHandle_t xTimer,
+                                    TickType_t    xTicksToWait)
+{
+	(void)xTicksToWait;
+	return timer_service_stop(xTimer) == 0 ? pdPASS : pdFAIL;
+}
+
+/**
+ * Change a timer's period and (re)start it.  Returns `pdPASS` on success,
+ * `pdFAIL` otherwise.
+ */
+static inline BaseType_t xTimerChangePeriod(TimerHandle_t xTimer,
+                                            TickType_t    xNewPeriod,
+                                            TickType_t    xTicksToWait)
+{
+	(void)xTicksToWait;
+	return timer_service_change_period(xTimer, xNewPeriod) == 0 ? pdPASS
+	                                                            : pdFAIL;
+}
+
+/**
+ * Start a timer from an ISR.  CHERIoT RTOS does not permit code to run in
+ * ISRs and so this is the same as `xTimerStart`.
+ */
+static inline BaseType_t
+xTimerStartFromISR(TimerHandle_t xTimer,
+                   BaseType_t   *pxHigherPriorityTaskWoken)
+{
+	*pxHigherPriorityTaskWoken = pdFALSE;
+	return xTimerStart(xTimer, 0);
+}
+
+/**
+ * Stop a timer from an ISR.  This is the same as `xTimerStop`.
+ */
+static inline BaseType_t
+xTimerStopFromISR(TimerHandle_t xTimer, BaseType_t *pxHigherPriorityTaskWoken)
+{
+	*pxHigherPriorityTaskWoken = pdFALSE;
+	return xTimerStop(xTimer, 0);
+}
+
+/**
+ * Returns `pdTRUE` if the timer is running, `pdFALSE` otherwise.
+ */
+static inline BaseType_t xTimerIsTimerActive(TimerHandle_t xTimer)
+{
+	return timer_service_is_active(xTimer) == 1 ? pdTRUE : pdFALSE;
+}
+
+/**
+ * Returns the identifier that the timer was created with.
+ */
+static inline void *pvTimerGetTimerID(TimerHandle_t xTimer)
+{
+	return timer_service_data(xTimer);
+}
@@ -31,6 +31,33 @@ enum DebugFormatArgumentKind : ptraddr_t
 	DebugFormatArgumentStringView,
 };
 
+/**
+ * Run-time log levels.  When the firmware is built with
+ * `--debug-runtime-levels=y`, each component that has debugging enabled reads
+ * a word in a shared object called `debug_level_` followed by its debug name
+ * before writing each log message, and writes the message only if the word is
+ * not `DebugLogLevelSilent`.  The words start as `DebugLogLevelSilent`.
+ */
+enum DebugLogLevel : uint32_t
+{
+	/// Log messages are not written.
+	DebugLogLevelSilent,
+	/// Log messages are written.
+	DebugLogLevelVerbose,
+};
+
+/**
+ * Returns a writeable pointer to the run-time log level of the component
+ * whose debug name is `name`, for example `DEBUG_LOG_LEVEL(allocator)`.  The
+ * shared object exists only in firmware that is built with
+ * `--debug-runtime-levels=y` and with debugging enabled for that component.
+ * Only compartments that use this macro can change the level, which an audit
+ * of the firmware can check.
+ */
+#define DEBUG_LOG_LEVEL(name)                                                  \
+	SHARED_OBJECT_WITH_PERMISSIONS(                                            \
+	  uint32_t, debug_level_##name, true, true, false, false)
+
 struct DebugFormatArgument
 {
 	/**
@@ -0,0 +1,88 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * Continuous ADC sampling.
+ *
+ * The `adc_sampler` compartment samples one ADC channel at a fixed rate from
+ * a driver thread that the firmware must provide, with the entry point
+ * `adc_sampler_run`.  Samples are written into two blocks in turn
+ * (ping-pong).  When a block is full, a descriptor for it is sent on a
+ * message queue and sampling continues into the other block.
+ *
+ * The descriptor carries a read-only capability to the block itself, so
+ * samples are never copied.  The consumer must call `adc_sampler_release`
+ * once it has finished with a block.  If the next block fills before the
+ * previous one has been released, the new block is dropped (and counted in
+ * `overruns`) and refilled, so a block is never written while the consumer
+ * may still be reading it.
+ *
+ * Sonata's XADC converts continuously but raises no interrupts, and the only
+ * timer belongs to the scheduler, so the driver paces itself on the cycle
+ * counter: it sleeps for whole ticks until the next sample is due and spins
+ * only for the remainder.  Rates above the tick rate therefore keep the
+ * driver thread busy, and it should run at a lower priority than threads
+ * that must not be delayed by it.
+ *
+ * The channel, sample rate and block size are set with the
+ * `--adc-sampler-channel`, `--adc-sampler-rate` and
+ * `--adc-sampler-block-size` build options.
+ */
+
+/**
+ * A completed block of samples, as received from the queue returned by
+ * `adc_sampler_queue`.
+ */
+struct AdcSampleBlock
+{
+	/**
+	 * The samples, in the order in which they were taken.  This is bounded
+	 * to `count` samples.
+	 */
+	const int16_t *samples;
+	/**
+	 * The number of samples in the block.
+	 */
+	uint32_t count;
+	/**
+	 * The sequence number of this block, counting from zero.  Gaps indicate
+	 * dropped blocks.  Pass this to `adc_sampler_release`.
+	 */
+	uint32_t sequence;
+	/**
+	 * The total number of blocks that have been dropped because the consumer
+	 * had not released the previous block.
+	 */
+	uint32_t overruns;
+};
+
+/**
+ * Returns, via `outQueue`, a receive-only handle for the queue on which
+ * completed blocks are sent, waiting for up to `timeout` for the driver
+ * thread to create it.  Messages are `struct AdcSampleBlock`s and should be
+ * received with `queue_receive_sealed`.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the queue was not created in time,
+ * or `-EINVAL` if either argument is not valid.
+ */
+int __cheri_compartment("adc_sampler")
+  adc_sampler_queue(Timeout *timeout, struct SObjStruct **outQueue);
+
+/**
+ * Return the block with the given sequence number to the driver, so that it
+ * can be filled again.
+ *
+ * Returns 0 on success or `-EINVAL` if `sequence` is not the block most
+ * recently sent.
+ */
+int __cheri_compartment("adc_sampler") adc_sampler_release(uint32_t sequence);
+
+/**
+ * Entry point for the ADC sampler thread.  This never returns.
+ */
+void __cheri_compartment("adc_sampler") adc_sampler_run(void);
@@ -0,0 +1,738 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <cdefs.h>
+#include <errno.h>
+#include <event.h>
+#include <multiwaiter.h>
+#include <queue.h>
+#include <riscvreg.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <timeout.h>
+#include <utility>
+
+#if __has_include(<coroutine>)
+#	include <coroutine>
+#else
+/**
+ * The freestanding C++ library does not provide `<coroutine>`, so provide the
+ * subset that the compiler needs to lower `co_await` and that this file
+ * uses, implemented with the clang builtins that `<coroutine>` wraps.
+ */
+namespace std
+{
+	template<typename Result, typename... Args>
+	struct coroutine_traits
+	{
+		using promise_type = typename Result::promise_type;
+	};
+
+	template<typename Promise = void>
+	struct coroutine_handle;
+
+	template<>
+	struct coroutine_handle<void>
+	{
+		constexpr coroutine_handle() noexcept = default;
+
+		static coroutine_handle from_address(void *address) noexcept
+		{
+			coroutine_handle handle;
+			handle.frame = address;
+			return handle;
+		}
+
+		void *address() const noexcept
+		{
+			return frame;
+		}
+
+		explicit operator bool() const noexcept
+		{
+			return frame != nullptr;
+		}
+
+		bool done() const
+		{
+			return __builtin_coro_done(frame);
+		}
+
+		void resume() const
+		{
+			__builtin_coro_resume(frame);
+		}
+
+		void operator()() const
+		{
+			resume();
+		}
+
+		void destroy() const
+		{
+			__builtin_coro_destroy(frame);
+		}
+
+		protected:
+		void *frame = nullptr;
+	};
+
+	template<typename Promise>
+	struct coroutine_handle : coroutine_handle<>
+	{
+		using coroutine_handle<>::coroutine_handle;
+
+		static coroutine_handle from_address(void *address) noexcept
+		{
+			coroutine_handle handle;
+			handle.frame = address;
+			return handle;
+		}
+
+		static coroutine_handle from_promise(Promise &promise) noexcept
+		{
+			return from_address(
+			  __builtin_coro_promise(&promise, alignof(Promise), true));
+		}
+
+		Promise &promise() const
+		{
+			return *static_cast<Promise *>(
+			  __builtin_coro_promise(frame, alignof(Promise), false));
+		}
+	};
+
+	struct suspend_always
+	{
+		constexpr bool await_ready() const noexcept
+		{
+			return false;
+		}
+		constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+		constexpr void await_resume() const noexcept {}
+	};
+
+	struct suspend_never
+	{
+		constexpr bool await_ready() const noexcept
+		{
+			return true;
+		}
+		constexpr void await_suspend(coroutine_handle<>) const noexcept {}
+		constexpr void await_resume() const noexcept {}
+	};
+} // namespace std
+#endif
+
+/**
+ * A single-threaded runtime for C++20 coroutines that wait for futexes,
+ * message queues, event groups, and time.
+ *
+ * A thread that services several independent event sources would otherwise
+ * need either one thread (and one stack) per source or a hand-written state
+ * machine around `multiwaiter_wait`.  With this runtime, each source is
+ * handled by a `Task`, a coroutine written as straight-line code that
+ * `co_await`s operations such as `queue_receive` or `sleep`.  An `EventLoop`
+ * runs the tasks on the calling thread: it resumes each task until it
+ * suspends on an operation and then waits for any of the operations' event
+ * sources with a single multiwaiter call.
+ *
+ * Tasks are stackless, so their state lives in a frame allocated from the
+ * compartment's default heap (`MALLOC_CAPABILITY`) when the task is created.
+ * Tasks are top-level only: a task cannot `co_await` another task, but
+ * operations can be wrapped in ordinary functions that return them.
+ *
+ * Every operation returns an `int` from `co_await`, with the same meaning as
+ * the return value of the corresponding blocking call, including
+ * `-ETIMEDOUT` if its timeout (in ticks) expires.  Queue operations use the
+ * library interface in `queue.h` and event-group waits use the
+ * `event_group` library, so firmware that uses them must link those
+ * libraries.
+ */
+namespace cheriot::async
+{
+	/**
+	 * The state of an operation on which a task is suspended.  The event
+	 * loop waits for `source` (if `hasSource` is set) and calls `poll` once
+	 * it fires or once the cycle counter reaches `retryAt`.
+	 */
+	struct Wait
+	{
+		/// The event that the operation is waiting for, if `hasSource`.
+		EventWaiterSource source;
+		/// Whether `source` is valid.
+		bool hasSource = false;
+		/// Whether `source` fired in the last wait.
+		bool fired = false;
+		/// Cycle count at which to poll even if no event has fired.
+		uint64_t retryAt = UINT64_MAX;
+		/// Cycle count at which the operation fails with `-ETIMEDOUT`.
+		uint64_t deadline = UINT64_MAX;
+		/// The value returned from `co_await`.
+		int result = 0;
+		/**
+		 * Attempt the operation again.  Returns true and sets `result` if
+		 * the operation is complete, otherwise updates `source` and
+		 * `retryAt` and returns false.
+		 */
+		bool (*poll)(Wait *) = nullptr;
+
+		/**
+		 * Wait for the futex at `address` to be woken or to differ from
+		 * `value`.
+		 */
+		void wait_for_futex(const void *address, uint32_t value)
+		{
+			source    = {const_cast<void *>(address), EventWaiterFutex, value};
+			hasSource = true;
+			retryAt   = UINT64_MAX;
+		}
+
+		/**
+		 * Poll again after one tick, without waiting for an event.  Used
+		 * when an operation failed without having an event to wait for, for
+		 * example because it could not acquire a lock without blocking.
+		 */
+		void retry_after_tick()
+		{
+			hasSource = false;
+			retryAt   = rdcycle64() + TIMERCYCLES_PER_TICK;
+		}
+	};
+
+	/**
+	 * A coroutine run by an `EventLoop`.  Functions that return `Task` and
+	 * use `co_await` or `co_return` are tasks.  A task does not run until it
+	 * is passed to `EventLoop::spawn`.
+	 *
+	 * If the frame cannot be allocated, the returned task is invalid and
+	 * `spawn` will reject it.
+	 */
+	class Task
+	{
+		public:
+		struct promise_type
+		{
+			/// The operation on which the task is suspended, if any.
+			Wait *wait = nullptr;
+
+			Task get_return_object() noexcept
+			{
+				return Task{Handle::from_promise(*this)};
+			}
+
+			static Task get_return_object_on_allocation_failure() noexcept
+			{
+				return Task{};
+			}
+
+			std::suspend_always initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			std::suspend_always final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void return_void() noexcept {}
+
+			void unhandled_exception() noexcept {}
+
+			static void *operator new(size_t size) noexcept
+			{
+				Timeout t{0, MALLOC_WAIT_TICKS};
+				void   *frame = heap_allocate(
+				  &t, MALLOC_CAPABILITY, size, AllocateWaitRevocationNeeded);
+				return __builtin_cheri_tag_get(frame) ? frame : nullptr;
+			}
+
+			static void operator delete(void *frame) noexcept
+			{
+				heap_free(MALLOC_CAPABILITY, frame);
+			}
+		};
+
+		/// The coroutine handle type for tasks.
+		using Handle = std::coroutine_handle<promise_type>;
+
+		Task() = default;
+
+		Task(Task &&other) : handle(std::exchange(other.handle, {})) {}
+
+		Task &operator=(Task &&other)
+		{
+			std::swap(handle, other.handle);
+			return *this;
+		}
+
+		~Task()
+		{
+			if (handle)
+			{
+				handle.destroy();
+			}
+		}
+
+		/**
+		 * Returns true if this task has a frame that has not yet been
+		 * passed to an event loop.
+		 */
+		explicit operator bool() const
+		{
+			return static_cast<bool>(handle);
+		}
+
+		/**
+		 * Release ownership of the coroutine.  Used by the event loop.
+		 */
+		Handle release()
+		{
+			return std::exchange(handle, {});
+		}
+
+		private:
+		explicit Task(Handle handle) : handle(handle) {}
+
+		Handle handle;
+	};
+
+	/**
+	 * Base for operations that a task can `co_await`.  `Derived` provides
+	 * `bool attempt()`, which has the same contract as `Wait::poll`.  The
+	 * operation completes without suspending if the first attempt succeeds.
+	 */
+	template<typename Derived>
+	class Operation : protected Wait
+	{
+		static bool poll_derived(Wait *wait)
+		{
+			return static_cast<Derived *>(wait)->attempt();
+		}
+
+		protected:
+		/**
+		 * Construct an operation that times out after `timeout` ticks.
+		 */
+		Operation(Ticks timeout)
+		{
+			poll = poll_derived;
+			if (timeout != UnlimitedTimeout)
+			{
+				deadline = rdcycle64() + static_cast<uint64_t>(timeout) *
+				                           TIMERCYCLES_PER_TICK;
+			}
+		}
+
+		public:
+		bool await_ready()
+		{
+			return static_cast<Derived *>(this)->attempt();
+		}
+
+		void await_suspend(Task::Handle task)
+		{
+			task.promise().wait = this;
+		}
+
+		int await_resume()
+		{
+			return result;
+		}
+	};
+
+	/**
+	 * Operation that completes after a number of ticks.  Returns 0.
+	 */
+	class Sleep : public Operation<Sleep>
+	{
+		friend Operation<Sleep>;
+
+		bool attempt()
+		{
+			if (rdcycle64() >= deadline)
+			{
+				result = 0;
+				return true;
+			}
+			hasSource = false;
+			retryAt   = deadline;
+			return false;
+		}
+
+		public:
+		Sleep(Ticks ticks) : Operation(ticks) {}
+	};
+
+	/**
+	 * Operation that waits for the futex at `address` to be woken, as
+	 * `futex_timed_wait`.  Returns 0 immediately if the futex does not
+	 * contain `expected`.
+	 */
+	class FutexWait : public Operation<FutexWait>
+	{
+		friend Operation<FutexWait>;
+
+		const uint32_t *address;
+		uint32_t        expected;
+
+		bool attempt()
+		{
+			// Once the source has been armed, this is called only when it
+			// fires.
+			if (hasSource || (*address != expected))
+			{
+				result = 0;
+				return true;
+			}
+			wait_for_futex(address, expected);
+			return false;
+		}
+
+		public:
+		FutexWait(const uint32_t *address, uint32_t expected, Ticks timeout)
+		  : Operation(timeout), address(address), expected(expected)
+		{
+		}
+	};
+
+	/**
+	 * Operation that sends one element to a queue, as `queue_send`.
+	 */
+	class QueueSend : public Operation<QueueSend>
+	{
+		friend Operation<QueueSend>;
+
+		MessageQueue *queue;
+		const void   *src;
+
+		bool attempt()
+		{
+			Timeout t{0};
+			result = ::queue_send(&t, queue, src);
+			if (result != -ETIMEDOUT)
+			{
+				return true;
+			}
+			multiwaiter_queue_send_init(&source, queue);
+			// The queue has space but the send failed: another thread
+			// holds the queue's lock.
+			if (source.value == static_cast<uint32_t>(-1))
+			{
+				retry_after_tick();
+			}
+			else
+			{
+				hasSource = true;
+			}
+			return false;
+		}
+
+		public:
+		QueueSend(MessageQueue *queue, const void *src, Ticks timeout)
+		  : Operation(timeout), queue(queue), src(src)
+		{
+		}
+	};
+
+	/**
+	 * Operation that receives one element from a queue, as
+	 * `queue_receive`.
+	 */
+	class QueueReceive : public Operation<QueueReceive>
+	{
+		friend Operation<QueueReceive>;
+
+		MessageQueue *queue;
+		void         *dst;
+
+		bool attempt()
+		{
+			Timeout t{0};
+			result = ::queue_receive(&t, queue, dst);
+			if (result != -ETIMEDOUT)
+			{
+				return true;
+			}
+			multiwaiter_queue_receive_init(&source, queue);
+			// The queue is not empty but the receive failed: another
+			// thread holds the queue's lock.
+			if (source.value == static_cast<uint32_t>(-1))
+			{
+				retry_after_tick();
+			}
+			else
+			{
+				hasSource = true;
+			}
+			return false;
+		}
+
+		public:
+		QueueReceive(MessageQueue *queue, void *dst, Ticks timeout)
+		  : Operation(timeout), queue(queue), dst(dst)
+		{
+		}
+	};
+
+	/**
+	 * Operation that waits for bits in an event group, as
+	 * `eventgroup_wait`.  The bits in the group are written to `outBits`
+	 * when the operation completes or times out.
+	 */
+	class EventGroupWait : public Operation<EventGroupWait>
+	{
+		friend Operation<EventGroupWait>;
+
+		EventGroup *group;
+		uint32_t   *outBits;
+		uint32_t    bitsWanted;
+		bool        waitForAll;
+		bool        clearOnExit;
+
+		bool attempt()
+		{
+			Timeout t{0};
+			result = eventgroup_poll(
+			  &t, group, outBits, bitsWanted, waitForAll, clearOnExit, &source);
+			if (result == -EWOULDBLOCK)
+			{
+				hasSource = true;
+				return false;
+			}
+			// Could not acquire the group's lock without blocking.
+			if (result == -ETIMEDOUT)
+			{
+				retry_after_tick();
+				return false;
+			}
+			return true;
+		}
+
+		public:
+		EventGroupWait(EventGroup *group,
+		               uint32_t   *outBits,
+		               uint32_t    bitsWanted,
+		               bool        waitForAll,
+		               bool        clearOnExit,
+		               Ticks       timeout)
+		  : Operation(timeout),
+		    group(group),
+		    outBits(outBits),
+		    bitsWanted(bitsWanted),
+		    waitForAll(waitForAll),
+		    clearOnExit(clearOnExit)
+		{
+		}
+	};
+
+	/**
+	 * Suspend the calling task for `ticks` ticks.
+	 */
+	inline Sleep sleep(Ticks ticks)
+	{
+		return {ticks};
+	}
+
+	/**
+	 * Wait for a futex, as `futex_timed_wait`.
+	 */
+	inline FutexWait futex_wait(const uint32_t *address,
+	                            uint32_t        expected,
+	                            Ticks           timeout = UnlimitedTimeout)
+	{
+		return {address, expected, timeout};
+	}
+
+	/**
+	 * Send to a queue, as `queue_send`.
+	 */
+	inline QueueSend queue_send(MessageQueue *queue,
+	                            const void   *src,
+	                            Ticks         timeout = UnlimitedTimeout)
+	{
+		return {queue, src, timeout};
+	}
+
+	/**
+	 * Receive from a queue, as `queue_receive`.
+	 */
+	inline QueueReceive queue_receive(MessageQueue *queue,
+	                                  void         *dst,
+	                                  Ticks         timeout = UnlimitedTimeout)
+	{
+		return {queue, dst, timeout};
+	}
+
+	/**
+	 * Wait for bits in an event group, as `eventgroup_wait`.
+	 */
+	inline EventGroupWait eventgroup_wait(EventGroup *group,
+	                                      uint32_t   *outBits,
+	                                      uint32_t    bitsWanted,
+	                                      bool        waitForAll,
+	                                      bool        clearOnExit,
+	                                      Ticks timeout = UnlimitedTimeout)
+	{
+		return {group, outBits, bitsWanted, waitForAll, clearOnExit, timeout};
+	}
+
+	/**
+	 * Runs up to `MaxTasks` tasks on the calling thread.
+	 *
+	 * Each iteration of `run` resumes the tasks whose operations have
+	 * completed and then makes one `multiwaiter_wait` call for the event
+	 * sources of all suspended tasks, with a timeout of the earliest
+	 * deadline or retry time.  The cost of an iteration is therefore linear
+	 * in the number of tasks, which is expected to be small.
+	 */
+	template<size_t MaxTasks>
+	class EventLoop
+	{
+		/// The multiwaiter, which has space for one source per task.
+		MultiWaiter *multiwaiter = nullptr;
+
+		/// The tasks, or null handles for unused slots.
+		Task::Handle tasks[MaxTasks] = {};
+
+		public:
+		/**
+		 * Allocate the event loop's multiwaiter from `heap`.  Returns 0 on
+		 * success or the error from `multiwaiter_create`.
+		 */
+		int init(Timeout *timeout, SObj heap)
+		{
+			return multiwaiter_create(timeout, heap, &multiwaiter, MaxTasks);
+		}
+
+		/**
+		 * Destroy any tasks that have not finished and free the
+		 * multiwaiter, which was allocated from `heap`.
+		 */
+		void destroy(SObj heap)
+		{
+			for (auto &task : tasks)
+			{
+				if (task)
+				{
+					task.destroy();
+					task = {};
+				}
+			}
+			multiwaiter_delete(heap, multiwaiter);
+			multiwaiter = nullptr;
+		}
+
+		/**
+		 * Add a task to the loop.  It first runs in the next call to `run`
+		 * (or the next iteration, if called from a running task).
+		 *
+		 * Returns 0 on success, `-ENOMEM` if the task's frame could not be
+		 * allocated, or `-ENOSPC` if the loop already has `MaxTasks` tasks.
+		 */
+		int spawn(Task &&task)
+		{
+			if (!task)
+			{
+				return -ENOMEM;
+			}
+			for (auto &slot : tasks)
+			{
+				if (!slot)
+				{
+					slot = task.release();
+					return 0;
+				}
+			}
+			return -ENOSPC;
+		}
+
+		/**
+		 * Run tasks until all of them have finished.
+		 */
+		void run()
+		{
+			while (true)
+			{
+				EventWaiterSource events[MaxTasks];
+				Wait             *sources[MaxTasks];
+				size_t            count = 0;
+				uint64_t          wake  = UINT64_MAX;
+				bool              live  = false;
+				// Resume runnable tasks.  Each runs until it suspends on an
+				// operation or finishes.
+				for (auto &task : tasks)
+				{
+					if (!task)
+					{
+						continue;
+					}
+					auto &promise = task.promise();
+					if (promise.wait == nullptr)
+					{
+						task.resume();
+						if (task.done())
+						{
+							task.destroy();
+							task = {};
+							continue;
+						}
+					}
+					live        = true;
+					Wait *wait  = promise.wait;
+					wait->fired = false;
+					if (wait->hasSource)
+					{
+						events[count]    = wait->source;
+						sources[count++] = wait;
+					}
+					wake = std::min({wake, wait->retryAt, wait->deadline});
+				}
+				if (!live)
+				{
+					return;
+				}
+				Timeout t = (wake == UINT64_MAX) ? Timeout{UnlimitedTimeout}
+				                                 : Timeout::until(wake);
+				if (count > 0)
+				{
+					multiwaiter_wait(&t, multiwaiter, events, count);
+					for (size_t i = 0; i < count; i++)
+					{
+						sources[i]->fired = (events[i].value == 1);
+					}
+				}
+				else
+				{
+					thread_sleep(&t, ThreadSleepNoEarlyWake);
+				}
+				// Complete the operations whose sources fired or whose retry
+				// time or deadline has passed.
+				uint64_t now = rdcycle64();
+				for (auto &task : tasks)
+				{
+					if (!task || (task.promise().wait == nullptr))
+					{
+						continue;
+					}
+					auto &promise = task.promise();
+					Wait *wait    = promise.wait;
+					if ((wait->fired || (now >= wait->retryAt)) &&
+					    wait->poll(wait))
+					{
+						promise.wait = nullptr;
+					}
+					else if (now >= wait->deadline)
+					{
+						wait->result = -ETIMEDOUT;
+						promise.wait = nullptr;
+					}
+				}
+			}
+		}
+	};
+} // namespace cheriot::async
@@ -0,0 +1,100 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+/**
+ * Zero-copy buffer lending.
+ *
+ * A compartment that passes a buffer to another compartment for the duration
+ * of one call can give the callee a view of the buffer that the callee can
+ * only read, and cannot capture (store anywhere other than its stack), rather
+ * than copying the buffer or requiring the callee to claim and copy it.
+ *
+ * A callee that must not see the buffer change while it runs (for example, a
+ * parser that checks a length field and then uses it) also needs the owner
+ * not to write to it during the call.  Freezing the buffer replaces the
+ * owner's shared pointer to it with a read-only one, so other threads in the
+ * owner that find the buffer through that pointer trap if they try to write,
+ * and claims it so that a concurrent free does not release it.
+ */
+
+__BEGIN_DECLS
+
+/**
+ * Returns a read-only view of the `length` bytes at `buffer`, which cannot be
+ * used to store or to load capabilities and does not have global permission,
+ * so the recipient cannot capture it beyond the current call.
+ *
+ * Returns null if `buffer` is not a valid, unsealed capability with load
+ * permission and at least `length` bytes after its address, or if those bytes
+ * cannot be given exact bounds.
+ */
+const void *__cheri_libcall buffer_lend_read_only(const void *buffer,
+                                                  size_t      length);
+
+/**
+ * Freeze the buffer of at least `length` bytes that `*owner` points to.  The
+ * writable pointer is returned in `*original` and `*owner` is replaced with a
+ * read-only (but still global) pointer to the same buffer.  If the buffer is
+ * on the heap, it is claimed with `heapCapability` so that it is not
+ * deallocated until thawed.
+ *
+ * The caller should keep `*original` only on its stack and lend the buffer
+ * with `buffer_lend_read_only`.  `buffer_thaw` must be called with the
+ * same arguments once the call that the buffer was lent to has returned.
+ *
+ * Returns 0 on success, `-EINVAL` if `*owner` is not a valid writable pointer
+ * to at least `length` bytes, or `-ENOMEM` if the buffer could not be claimed.
+ */
+int __cheri_libcall buffer_freeze(struct SObjStruct  *heapCapability,
+                                  void              **owner,
+                                  void              **original,
+                                  size_t              length);
+
+/**
+ * Undo `buffer_freeze`: restore `*owner` to `original` and drop the claim on
+ * the buffer, if it is on the heap.
+ *
+ * Returns 0 on success, or `-EINVAL` if `*owner` does not refer to the same
+ * buffer as `original`.
+ */
+int __cheri_libcall buffer_thaw(struct SObjStruct  *heapCapability,
+                                void              **owner,
+                                void               *original);
+
+__END_DECLS
+
+#ifdef __cplusplus
+/**
+ * Freeze the buffer of `length` bytes that `owner` points to and invoke `body`
+ * with a read-only, non-capturable view of it, thawing the buffer when `body`
+ * returns.  Returns the result of `body`, or the error from `buffer_freeze`
+ * (converted to `body`'s return type) if the buffer could not be frozen.
+ */
+template<typename T>
+auto with_frozen_buffer(struct SObjStruct  *heapCapability,
+                        T                 *&owner,
+                        size_t              length,
+                        auto              &&body)
+{
+	void *original;
+	void *shared = owner;
+	int   ret    = buffer_freeze(heapCapability, &shared, &original, length);
+	using Result = decltype(body(static_cast<const T *>(nullptr)));
+	if (ret != 0)
+	{
+		return Result(ret);
+	}
+	owner         = static_cast<T *>(shared);
+	Result result = body(static_cast<const T *>(
+	  buffer_lend_read_only(original, length)));
+	shared        = owner;
+	buffer_thaw(heapCapability, &shared, original);
+	owner = static_cast<T *>(shared);
+	return result;
+}
+#endif
@@ -3,7 +3,9 @@
 namespace cheriot
 {
 	// Compatibility definition of CHERIoT atomics now that we have a more
-	// complete standard definition.
+	// complete standard definition.  On cores without the A extension,
+	// `std::atomic` performs loads and stores inline and other operations
+	// with interrupts disabled, rather than calling the atomics library.
 	template<typename T>
 	using atomic = std::atomic<T>;
 } // namespace cheriot
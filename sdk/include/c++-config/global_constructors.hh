@@ -3,6 +3,7 @@
 
 #pragma once
 #include <cheri.hh>
+#include <lazy_static.hh>
 #include <riscvreg.h>
 #include <stddef.h>
 
@@ -43,8 +44,23 @@ namespace GlobalConstructors
 	 */
 	void run()
 	{
-		// This will emit a guard variable and code that checks the guard
-		// variable and calls the constructor if it has not been called.
-		static ConstructHelper helper;
+		// This checks the guard inline and calls into the C++ runtime to run
+		// the constructors only if they have not been run.
+		static cheriot::LazyStatic<ConstructHelper> helper;
+		helper.get([]() { return ConstructHelper{}; });
+	}
+
+	/**
+	 * Run `body` after ensuring that the global constructors in this
+	 * compartment have run.  Wrapping the body of each entry point of a
+	 * compartment in this gives on-first-call initialisation: the
+	 * constructors run when the compartment is first used, rather than
+	 * delaying boot, and later calls pay only for the guard check.
+	 */
+	template<typename Body>
+	__always_inline auto on_first_call(Body &&body)
+	{
+		run();
+		return body();
 	}
 }; // namespace GlobalConstructors
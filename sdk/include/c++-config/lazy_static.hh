@@ -0,0 +1,90 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <new>
+#include <stdint.h>
+
+/**
+ * The C++ runtime's guard functions (see `lib/cxxrt`).  These are the
+ * functions that the compiler calls to initialise function-local statics.
+ */
+[[cheri::interrupt_state(disabled)]] __cheri_libcall int
+__cxa_guard_acquire(uint64_t *) asm("__cxa_guard_acquire");
+[[cheri::interrupt_state(disabled)]] __cheri_libcall void
+__cxa_guard_release(uint64_t *) asm("__cxa_guard_release");
+
+namespace cheriot
+{
+	/**
+	 * A lazily initialised object, for use as a function-local static in
+	 * place of a static with a dynamic initialiser.
+	 *
+	 * The guard that the compiler emits for a function-local static is
+	 * checked with an atomic acquire load, which cores without the A
+	 * extension lower to a call to `__atomic_load_1` in the atomics library
+	 * on every access.  This checks the same guard word with an inline load
+	 * (sufficient with a single hart) and calls the C++ runtime only until
+	 * the object has been initialised.  It is constant-initialised, so
+	 * declaring one as a static does not itself need a guard.
+	 */
+	template<typename T>
+	class LazyStatic
+	{
+		/// Storage for the object, constructed on first use.
+		alignas(T) unsigned char storage[sizeof(T)] = {};
+		/// Guard word, in the layout that the C++ runtime expects.
+		uint64_t guard = 0;
+
+		/**
+		 * Returns true if the object has been initialised.  The C++ runtime
+		 * sets the low bit of the first byte of the guard once the
+		 * initialiser has returned.
+		 */
+		__always_inline bool is_initialised()
+		{
+#ifdef __riscv_atomic
+			return __atomic_load_n(reinterpret_cast<uint8_t *>(&guard),
+			                       __ATOMIC_ACQUIRE) &
+			       1;
+#else
+			bool initialised =
+			  *reinterpret_cast<volatile uint8_t *>(&guard) & 1;
+			__atomic_signal_fence(__ATOMIC_ACQUIRE);
+			return initialised;
+#endif
+		}
+
+		/**
+		 * Slow path: construct the object from the result of `init` unless
+		 * another thread has already done so.
+		 */
+		template<typename Init>
+		__noinline void initialise(Init &&init)
+		{
+			if (__cxa_guard_acquire(&guard))
+			{
+				new (storage) T(init());
+				__cxa_guard_release(&guard);
+			}
+		}
+
+		public:
+		constexpr LazyStatic() = default;
+
+		/**
+		 * Returns the object, constructing it from the result of `init` on
+		 * the first call.  Later calls ignore `init`.
+		 */
+		template<typename Init>
+		__always_inline T &get(Init &&init)
+		{
+			if (!is_initialised()) [[unlikely]]
+			{
+				initialise(init);
+			}
+			return *std::launder(reinterpret_cast<T *>(storage));
+		}
+	};
+} // namespace cheriot
@@ -0,0 +1,254 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cheriot-atomic.hh>
+#include <compartment-macros.h>
+#include <errno.h>
+#include <futex.h>
+#include <stdint.h>
+#include <timeout.h>
+#include <type_traits>
+#include <utils.hh>
+
+/**
+ * Statically provisioned single-producer, single-consumer channels between
+ * two compartments.
+ *
+ * A channel is a pair of pre-shared objects, allocated at link time, so
+ * neither side allocates or claims anything and sending or receiving a
+ * message makes no cross-compartment calls unless a thread must be woken:
+ *
+ *  - `<name>` holds the ring of messages and the count of messages sent.
+ *    The producer imports it writeable and the consumer read-only.
+ *  - `<name>_consumed` holds the count of messages received.  The consumer
+ *    imports it writeable and the producer read-only.
+ *
+ * Neither side can corrupt the other's state and, because neither import
+ * carries permission to store capabilities, messages cannot carry pointers.
+ * The linker does not restrict which compartments import the objects, so
+ * use `cheriot-audit` to check that exactly the two intended compartments
+ * do.
+ *
+ * A consumer waiting for an empty ring is woken (the doorbell) only when the
+ * ring goes from empty to non-empty, and a producer waiting for a full ring
+ * only when the ring goes from full to not full.
+ *
+ * To declare a channel, give the message type and capacity a name and add
+ * the two objects to the firmware's shared objects with the sizes from
+ * `Channel::RingSize` and `Channel::ConsumedSize`:
+ *
+ * ```c++
+ * using NetRx = cheriot::Channel<Packet, 16>;
+ * // In the producer:
+ * auto producer = CHANNEL_PRODUCER(NetRx, net_rx);
+ * producer.send(&timeout, packet);
+ * // In the consumer:
+ * auto consumer = CHANNEL_CONSUMER(NetRx, net_rx);
+ * consumer.receive(&timeout, packet);
+ * ```
+ *
+ * ```lua
+ * target:values_set("shared_objects",
+ *                   { net_rx = 8 + 16 * packetSize, net_rx_consumed = 4 },
+ *                   {expand = false})
+ * ```
+ */
+namespace cheriot
+{
+	/**
+	 * A channel carrying `Capacity` messages of type `Message`.  `Capacity`
+	 * must be a power of two.
+	 */
+	template<typename Message, size_t Capacity>
+	struct Channel
+	{
+		static_assert(std::is_trivially_copyable_v<Message>,
+		              "Channel messages are copied as bytes");
+		static_assert((1 << utils::log2<Capacity>()) == Capacity,
+		              "Channel capacity must be a power of two");
+
+		/// Returns the futex word for a counter.
+		static const uint32_t *word(const cheriot::atomic<uint32_t> *counter)
+		{
+			return reinterpret_cast<const uint32_t *>(counter);
+		}
+
+		/// Returns the futex word for a counter that this side updates.
+		static uint32_t *word(cheriot::atomic<uint32_t> *counter)
+		{
+			return reinterpret_cast<uint32_t *>(counter);
+		}
+
+		/// The layout of the `<name>` shared object.
+		struct Ring
+		{
+			/// Free-running count of messages sent, the consumer's doorbell.
+			cheriot::atomic<uint32_t> produced;
+			/// Padding so that messages are aligned.
+			uint32_t reserved;
+			/// The messages.
+			Message messages[Capacity];
+		};
+
+		/// The size of the `<name>` shared object.
+		static constexpr size_t RingSize = sizeof(Ring);
+
+		/// The size of the `<name>_consumed` shared object.
+		static constexpr size_t ConsumedSize = sizeof(uint32_t);
+
+		/// The sending end of a channel.
+		class Producer
+		{
+			/// The ring, writeable.
+			Ring *ring;
+			/// The consumer's count, read-only.
+			const cheriot::atomic<uint32_t> *consumed;
+
+			public:
+			/// Construct a producer from the two shared objects.
+			Producer(Ring *ring, const cheriot::atomic<uint32_t> *consumed)
+			  : ring(ring), consumed(consumed)
+			{
+			}
+
+			/**
+			 * Send `message`, waiting while the ring is full.  Returns 0 or
+			 * `-ETIMEDOUT`.
+			 */
+			int send(Timeout *timeout, const Message &message)
+			{
+				uint32_t produced = ring->produced.load();
+				while (true)
+				{
+					uint32_t seen = consumed->load();
+					if (produced - seen < Capacity)
+					{
+						ring->messages[produced & (Capacity - 1)] = message;
+						ring->produced.store(produced + 1);
+						// Ring the doorbell only if the consumer may be
+						// waiting for an empty ring.
+						if (consumed->load() == produced)
+						{
+							futex_wake(word(&ring->produced), 1);
+						}
+						return 0;
+					}
+					if (futex_timed_wait(timeout, word(consumed), seen) ==
+					    -ETIMEDOUT)
+					{
+						return -ETIMEDOUT;
+					}
+				}
+			}
+
+			/// Send `message` if the ring is not full.  Returns 0 or `-EAGAIN`.
+			int try_send(const Message &message)
+			{
+				Timeout timeout{0};
+				return send(&timeout, message) == 0 ? 0 : -EAGAIN;
+			}
+		};
+
+		/// The receiving end of a channel.
+		class Consumer
+		{
+			/// The ring, read-only.
+			const Ring *ring;
+			/// The consumer's count, writeable.
+			cheriot::atomic<uint32_t> *consumed;
+
+			public:
+			/// Construct a consumer from the two shared objects.
+			Consumer(const Ring *ring, cheriot::atomic<uint32_t> *consumed)
+			  : ring(ring), consumed(consumed)
+			{
+			}
+
+			/**
+			 * Receive the next message into `message`, waiting while the ring
+			 * is empty.  Returns 0 or `-ETIMEDOUT`.
+			 */
+			int receive(Timeout *timeout, Message &message)
+			{
+				uint32_t received = consumed->load();
+				while (true)
+				{
+					uint32_t produced = ring->produced.load();
+					if (produced != received)
+					{
+						message = ring->messages[received & (Capacity - 1)];
+						consumed->store(received + 1);
+						// Wake the producer only if it may be waiting for a
+						// full ring.
+						if (ring->produced.load() - received == Capacity)
+						{
+							futex_wake(word(consumed), 1);
+						}
+						return 0;
+					}
+					if (futex_timed_wait(
+					      timeout, word(&ring->produced), produced) ==
+					    -ETIMEDOUT)
+					{
+						return -ETIMEDOUT;
+					}
+				}
+			}
+
+			/**
+			 * Receive the next message if there is one.  Returns 0 or
+			 * `-EAGAIN`.
+			 */
+			int try_receive(Message &message)
+			{
+				Timeout timeout{0};
+				return receive(&timeout, message) == 0 ? 0 : -EAGAIN;
+			}
+
+			/// Returns the number of messages waiting.
+			uint32_t size() const
+			{
+				return ring->produced.load() - consumed->load();
+			}
+
+			/**
+			 * Returns the doorbell futex word, so that the consumer can wait
+			 * for messages in a multiwaiter.  The channel is non-empty when
+			 * the word differs from `consumed_count()`.
+			 */
+			const uint32_t *doorbell() const
+			{
+				return word(&ring->produced);
+			}
+
+			/// Returns the number of messages received since boot.
+			uint32_t consumed_count() const
+			{
+				return consumed->load();
+			}
+		};
+	};
+} // namespace cheriot
+
+/**
+ * Returns the producer end of the channel `name`, whose type (a
+ * `cheriot::Channel`) is `channelType`.
+ */
+#define CHANNEL_PRODUCER(channelType, name)                                    \
+	channelType::Producer(                                                     \
+	  SHARED_OBJECT_WITH_PERMISSIONS(                                          \
+	    channelType::Ring, name, true, true, false, false),                    \
+	  SHARED_OBJECT_WITH_PERMISSIONS(                                          \
+	    cheriot::atomic<uint32_t>, name##_consumed, true, false, false, false))
+
+/**
+ * Returns the consumer end of the channel `name`, whose type (a
+ * `cheriot::Channel`) is `channelType`.
+ */
+#define CHANNEL_CONSUMER(channelType, name)                                    \
+	channelType::Consumer(                                                     \
+	  SHARED_OBJECT_WITH_PERMISSIONS(                                          \
+	    channelType::Ring, name, true, false, false, false),                   \
+	  SHARED_OBJECT_WITH_PERMISSIONS(                                          \
+	    cheriot::atomic<uint32_t>, name##_consumed, true, true, false, false))
@@ -0,0 +1,79 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Checksums and cyclic redundancy checks, shared by network drivers, USB,
+ * and flash-integrity code.  These are provided by the `checksum` library.
+ *
+ * All functions work a word at a time where they can, with any alignment of
+ * the data, and none of them allocate or block.
+ */
+
+__BEGIN_DECLS
+
+/**
+ * Add the `length` bytes at `data` to the partial Internet checksum (RFC
+ * 1071) `sum` and return the new partial sum.  Start with a `sum` of zero
+ * and pass the result to `checksum_internet_finish`.
+ *
+ * A checksum may be computed over several discontiguous buffers, such as a
+ * pseudo-header and a payload, by chaining calls.  Each buffer other than the
+ * last must have an even length.
+ */
+uint32_t __cheri_libcall checksum_internet_partial(const void *data,
+                                                   size_t      length,
+                                                   uint32_t    sum);
+
+/**
+ * Fold a partial sum from `checksum_internet_partial` and return the
+ * checksum.  The checksum is in the same byte order as the data and so can be
+ * stored into a packet with a native 16-bit store.
+ */
+uint16_t __cheri_libcall checksum_internet_finish(uint32_t sum);
+
+/**
+ * Returns the Internet checksum of the `length` bytes at `data`.
+ */
+uint16_t __cheri_libcall checksum_internet(const void *data, size_t length);
+
+/**
+ * Update the Internet checksum `checksum` after the 16-bit field that it
+ * covers has changed from `oldValue` to `newValue` (RFC 1624), without
+ * summing the data again.  All three values are as stored in the packet.
+ * This is used, for example, when decrementing the TTL or rewriting an
+ * address.
+ */
+uint16_t __cheri_libcall checksum_internet_update(uint16_t checksum,
+                                                  uint16_t oldValue,
+                                                  uint16_t newValue);
+
+/**
+ * Add the `length` bytes at `data` to the CRC-32 `crc` and return the new
+ * CRC.  This is the CRC used by Ethernet, zlib and PNG (reflected polynomial
+ * 0xEDB88320, inverted before and after).  Start with a `crc` of zero; the
+ * result of one call may be passed as `crc` to the next to compute the CRC
+ * of discontiguous buffers.
+ *
+ * Uses carry-less multiplication if the core supports the Zbc extension and
+ * four 256-entry tables (slicing-by-4) otherwise.
+ */
+uint32_t __cheri_libcall checksum_crc32(uint32_t    crc,
+                                        const void *data,
+                                        size_t      length);
+
+/**
+ * Add the `length` bytes at `data` to the CRC-16-CCITT `crc` (polynomial
+ * 0x1021, not reflected, no final inversion) and return the new CRC.  Start
+ * with a `crc` of 0xffff for the common CCITT-FALSE variant or zero for
+ * XMODEM.
+ */
+uint16_t __cheri_libcall checksum_crc16_ccitt(uint16_t    crc,
+                                              const void *data,
+                                              size_t      length);
+
+__END_DECLS
@@ -3,10 +3,10 @@
 
 #pragma once
 #include <compartment-macros.h>
+#include <riscvreg.h>
 #include <stddef.h>
 #include <stdint.h>
-
-struct Timeout;
+#include <timeout.h>
 
 /**
  * The complete set of architectural permissions.
@@ -381,5 +381,27 @@ bool __cheri_libcall check_pointer(const void *ptr,
  * Check that the argument is a valid pointer to a `Timeout` structure.  This
  * must have read/write permissions, be unsealed, and must not be a heap
  * address.
+ *
+ * Every blocking API validates its timeout with this, so it is always
+ * inlined.  The heap bounds are link-time constants, and these checks compile
+ * to a handful of instructions, less than the cost of a library call.
  */
-bool __cheri_libcall check_timeout_pointer(const struct Timeout *timeout);
+__always_inline static inline bool
+check_timeout_pointer(const struct Timeout *timeout)
+{
+	const uint32_t RequiredPermissions =
+	  (1U << CheriPermissionLoad) | (1U << CheriPermissionStore);
+	ptraddr_t base   = __builtin_cheri_base_get(timeout);
+	size_t    offset = __builtin_cheri_address_get(timeout) - base;
+	size_t    length = __builtin_cheri_length_get(timeout);
+	// See `heap_address_is_valid`: a capability derived from the heap has its
+	// base in the heap, and every other capability has its base outside.
+	bool isHeap = (base >= LA_ABS(__export_mem_heap)) &&
+	              (base < LA_ABS(__export_mem_heap_end));
+	return __builtin_cheri_tag_get(timeout) &&
+	       !__builtin_cheri_sealed_get(timeout) && (offset <= length) &&
+	       ((length - offset) >= sizeof(struct Timeout)) &&
+	       ((__builtin_cheri_perms_get(timeout) & RequiredPermissions) ==
+	        RequiredPermissions) &&
+	       !isHeap;
+}
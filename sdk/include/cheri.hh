@@ -1212,6 +1212,104 @@ namespace CHERI
 		return isValid;
 	}
 
+	/**
+	 * One pointer argument to validate with `check_pointers`.  Construct
+	 * these with `pointer_check`, which takes the same template arguments
+	 * as `check_pointer` (except `EnforceStrictPermissions`).
+	 */
+	template<PermissionSet Permissions, bool CheckStack>
+	struct PointerCheck
+	{
+		/**
+		 * Is the stack check needed?  As in `check_pointer`, it is skipped
+		 * for global capabilities, which cannot be derived from the stack.
+		 */
+		static constexpr bool StackCheckNeeded =
+		  CheckStack && !Permissions.contains(Permission::Global);
+
+		/// The pointer to check.
+		const void *pointer;
+
+		/// The number of bytes that must be accessible from `pointer`.
+		size_t space;
+
+		/**
+		 * Returns true if `pointer` is valid, unsealed, has at least
+		 * `space` bytes and `Permissions`, and (if `StackCheckNeeded`) does
+		 * not overlap `stack`.  This performs the same checks as
+		 * `::check_pointer`, inline.
+		 */
+		__always_inline bool check(Capability<void> stack) const
+		{
+			Capability<const void> cap{pointer};
+			bool                   isValid = cap.is_valid() && !cap.is_sealed();
+			if constexpr (StackCheckNeeded)
+			{
+				isValid &=
+				  (cap.top() <= stack.base()) || (cap.base() >= stack.top());
+			}
+			isValid &= cap.bounds() >= space;
+			isValid &= Permissions.can_derive_from(cap.permissions());
+			return isValid;
+		}
+	};
+
+	/**
+	 * Describe a pointer argument for `check_pointers`.  `space` defaults to
+	 * the size of the pointee and must be given for `void` pointers.
+	 */
+	template<PermissionSet Permissions = PermissionSet{Permission::Load},
+	         bool          CheckStack  = true,
+	         typename T>
+	__always_inline inline PointerCheck<Permissions, CheckStack>
+	pointer_check(const T *ptr, size_t space = sizeof(T))
+	{
+		return {ptr, space};
+	}
+
+	/**
+	 * Describe a pointer argument for `check_pointers`, from a smart pointer
+	 * such as `Capability`.
+	 */
+	template<PermissionSet Permissions = PermissionSet{Permission::Load},
+	         bool          CheckStack  = true>
+	__always_inline inline PointerCheck<Permissions, CheckStack>
+	pointer_check(const IsSmartPointerLike auto &ptr, size_t space)
+	{
+		return {ptr.get(), space};
+	}
+
+	/**
+	 * Validate several pointer arguments at once, for example:
+	 *
+	 * ```c++
+	 * if (!check_pointers(
+	 *       pointer_check<PermissionSet{Permission::Store}>(out),
+	 *       pointer_check(in, length)))
+	 * {
+	 *     return -EINVAL;
+	 * }
+	 * ```
+	 *
+	 * This is equivalent to calling `check_pointer` for each argument, but
+	 * all of the checks are inlined, with constant permission sets, and the
+	 * stack capability is read once (and only if one of the checks needs
+	 * it).  All of the checks are evaluated, without branching between
+	 * them.
+	 */
+	template<PermissionSet... Permissions, bool... CheckStack>
+	__always_inline inline bool
+	check_pointers(const PointerCheck<Permissions, CheckStack> &...checks)
+	{
+		Capability<void> stack;
+		if constexpr ((PointerCheck<Permissions, CheckStack>::StackCheckNeeded ||
+		               ...))
+		{
+			stack = __builtin_cheri_stack_get();
+		}
+		return (true & ... & checks.check(stack));
+	}
+
 	/**
 	 * Invokes the passed callable object with interrupts disabled.
 	 */
@@ -189,6 +189,25 @@
  */
 #define COMPARTMENT_NAME_STRING __XSTRING(__CHERI_COMPARTMENT__)
 
+/**
+ * Mark a compartment entry point as using no more stack than the size given
+ * with `__cheriot_minimum_stack`.  The switcher then bounds the callee's stack
+ * to that size and zeroes only that part of the stack on call and return,
+ * which makes calls to small functions much cheaper on cores without a stack
+ * high water mark.  A function that uses more stack than it declares will
+ * fault when it runs out.
+ *
+ * This must be used at file scope in the compilation unit that defines the
+ * entry point.  The argument is the mangled name of the function as a string,
+ * for example `"_Z19noop_return_rdcyclev"`.  Compartment entry points are
+ * always mangled, even if they are declared in C.
+ */
+#define CHERIOT_BOUNDED_STACK_EXPORT(mangledName)                              \
+	__asm(".section .compartment_bounded_stack_exports,\"a\",@progbits\n"      \
+	      "  .p2align 2\n"                                                     \
+	      "  .word __export_" COMPARTMENT_NAME_STRING "_" mangledName "\n"     \
+	      ".previous\n")
+
 /**
  * Macro that evaluates to a static sealing type that is local to this
  * compartment.
@@ -283,3 +302,49 @@
 		      : "i"(sizeof(__typeof__(name))));                                \
 		ret;                                                                   \
 	})
+
+/**
+ * Flag in the size word of a static sealed object import that asks the loader
+ * for an unsealed capability to the object's body, instead of a sealed
+ * capability to the whole object.  This must match
+ * `ImportEntry::UnsealedPayload` in the loader.
+ */
+#define CHERIOT_STATIC_SEALED_PAYLOAD_IMPORT (1U << 24)
+
+/**
+ * Returns an unsealed pointer to the body of the named object created with
+ * `DECLARE_STATIC_SEALED_VALUE`.  This is equivalent to unsealing the result
+ * of `STATIC_SEALED_VALUE` with the object's sealing key, without the cost of
+ * a call to the token library on each use.
+ *
+ * The loader provides the body only to the compartment that both defines the
+ * object and exports its sealing type, and fails to boot otherwise.  Objects
+ * passed in by other compartments must still be unsealed, because unsealing
+ * is what checks that they are valid.
+ */
+#define STATIC_SEALED_VALUE_PAYLOAD(name)                                      \
+	({                                                                         \
+		__typeof__(name.body) *ret; /* NOLINT(bugprone-macro-parentheses) */   \
+		__asm(".ifndef __import.sealed_object_payload." #name "\n"             \
+		      "  .type     __import.sealed_object_payload." #name ",@object\n" \
+		      "  .section  .compartment_imports.payload." #name                \
+		      ",\"awG\",@progbits,__import.sealed_object_payload." #name      \
+		      ",comdat\n"                                                      \
+		      "  .globl    __import.sealed_object_payload." #name "\n"         \
+		      "  .p2align  3\n"                                                \
+		      "__import.sealed_object_payload." #name ":\n"                    \
+		      "  .word " #name "\n"                                            \
+		      "  .word %c1\n"                                                  \
+		      "  .size __import.sealed_object_payload." #name ", 8\n"          \
+		      " .previous\n"                                                   \
+		      ".endif\n"                                                       \
+		      "1:"                                                             \
+		      "  auipcc  %0,"                                                  \
+		      "      %%cheriot_compartment_hi("                                \
+		      "__import.sealed_object_payload." #name ")\n"                    \
+		      "  clc     %0, %%cheriot_compartment_lo_i(1b)(%0)\n"             \
+		      : "=C"(ret)                                                      \
+		      : "i"(sizeof(__typeof__(name)) |                                 \
+		            CHERIOT_STATIC_SEALED_PAYLOAD_IMPORT));                    \
+		ret;                                                                   \
+	})
@@ -0,0 +1,122 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Compartment micro-reboot.
+ *
+ * A compartment that has reached a bad state can return its globals to a
+ * snapshot taken when it first ran, and free everything that it allocated
+ * from its heap quota, without resetting the rest of the system.  The
+ * snapshot must be taken before the compartment modifies any globals,
+ * typically at the start of the first call to the compartment, and is kept
+ * in a heap object allocated from a quota other than the one that the reset
+ * frees.
+ *
+ * The loader does not run static constructors for compartments, so there
+ * are none to re-run.  Static sealed objects (including static message
+ * queues and allocator capabilities) are not part of a compartment's globals
+ * and are not reset.
+ *
+ * These functions must be called only while no other thread is running in,
+ * or blocked on a lock or futex in the globals of, the compartment.  A reset
+ * is normally done by a compartment's own error handler or by an export that
+ * a supervisor calls after stopping the compartment's other callers.
+ */
+
+#ifdef __cplusplus
+/**
+ * The snapshot of this compartment's globals.  This is itself a global, so it
+ * is included in the snapshot and survives a reset.
+ */
+inline void *compartmentGlobalsSnapshot;
+
+/**
+ * Returns a capability to all of this compartment's globals.
+ */
+__always_inline static inline void *compartment_globals()
+{
+	void *globals = __builtin_cheri_global_data_get();
+	return __builtin_cheri_address_set(globals,
+	                                   __builtin_cheri_base_get(globals));
+}
+
+/**
+ * Take a snapshot of this compartment's globals, allocating it from
+ * `heapCapability` with `timeout` for the allocation.
+ *
+ * Returns 0 on success, `-EEXIST` if a snapshot already exists, or `-ENOMEM`
+ * if the snapshot could not be allocated.
+ */
+static inline int
+compartment_globals_snapshot(Timeout           *timeout,
+                             struct SObjStruct *heapCapability)
+{
+	if (compartmentGlobalsSnapshot != nullptr)
+	{
+		return -EEXIST;
+	}
+	void  *globals = compartment_globals();
+	size_t length  = __builtin_cheri_length_get(globals);
+	void  *copy    = heap_allocate(timeout, heapCapability, length);
+	if (!__builtin_cheri_tag_get(copy))
+	{
+		return -ENOMEM;
+	}
+	// Record the snapshot before taking it, so that it survives a reset.
+	compartmentGlobalsSnapshot = copy;
+	memcpy(copy, globals, length);
+	return 0;
+}
+
+/**
+ * Reset this compartment: free every object allocated with `heapCapability`
+ * and then restore the globals from the snapshot.  Any pointers to globals or
+ * heap objects held in registers or on the stack by the caller refer to
+ * state from before the reset.
+ *
+ * Returns 0 on success, `-EINVAL` if there is no snapshot, or the error from
+ * `heap_free_all` if the objects could not be freed, in which case the
+ * globals are not restored.
+ */
+static inline int compartment_globals_reset(struct SObjStruct *heapCapability)
+{
+	void *snapshot = compartmentGlobalsSnapshot;
+	if (snapshot == nullptr)
+	{
+		return -EINVAL;
+	}
+	ssize_t freed = heap_free_all(heapCapability);
+	if (freed < 0)
+	{
+		return freed;
+	}
+	void *globals = compartment_globals();
+	memcpy(globals, snapshot, __builtin_cheri_length_get(globals));
+	// The compiler cannot see that the copy aliases named globals.
+	__asm__ volatile("" ::: "memory");
+	return 0;
+}
+
+/**
+ * Free the snapshot of this compartment's globals, which was allocated with
+ * `heapCapability`.  Returns the result of `heap_free`, or 0 if there is no
+ * snapshot.
+ */
+static inline int
+compartment_globals_snapshot_free(struct SObjStruct *heapCapability)
+{
+	void *snapshot = compartmentGlobalsSnapshot;
+	if (snapshot == nullptr)
+	{
+		return 0;
+	}
+	compartmentGlobalsSnapshot = nullptr;
+	return heap_free(heapCapability, snapshot);
+}
+#endif
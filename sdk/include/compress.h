@@ -0,0 +1,179 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <queue.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <timeout.h>
+
+/**
+ * LZ4 compression for telemetry and logs, provided by the `compress` library.
+ *
+ * Blocks use the standard LZ4 block format, so they can be decompressed with
+ * any LZ4 implementation.  Nothing here allocates: the compressor uses a
+ * caller-provided workspace of `COMPRESS_LZ4_WORKSPACE_SIZE` bytes and the
+ * decompressor needs no state beyond its output buffer.
+ *
+ * For streams, a `CompressStream` gathers data into blocks of a fixed size
+ * (the window: matches never refer to earlier blocks) and writes each block
+ * as a frame to a `StdioStreamWrite` sink.  `compress_stream_write` is itself
+ * a `StdioStreamWrite`, so a buffered stdio stream can be placed in front of
+ * a compressor and `compress_record_queue_write` can be used as the sink to
+ * send each frame as one record on a record queue.
+ */
+
+/// The size of the workspace that `compress_lz4` needs, in bytes.
+#define COMPRESS_LZ4_WORKSPACE_SIZE 4096
+
+/// The largest block that `compress_lz4` accepts, in bytes.
+#define COMPRESS_LZ4_MAX_BLOCK_SIZE 65535
+
+/// The size of the header at the start of each frame from a `CompressStream`.
+#define COMPRESS_FRAME_HEADER_SIZE 4
+
+/**
+ * Flag in a frame header marking a block that is stored uncompressed because
+ * it did not compress.  The rest of the header is the length of the payload
+ * that follows it.  Headers are little endian.
+ */
+#define COMPRESS_FRAME_STORED 0x80000000U
+
+__BEGIN_DECLS
+
+/**
+ * Compress the `length` bytes at `src`, which must be at most
+ * `COMPRESS_LZ4_MAX_BLOCK_SIZE`, into an LZ4 block at `dst`, which has space
+ * for `capacity` bytes.  `workspace` must be a 4-byte-aligned buffer of
+ * `COMPRESS_LZ4_WORKSPACE_SIZE` bytes, and its contents are not needed
+ * between calls.
+ *
+ * Returns the size of the compressed block, `-ENOSPC` if it does not fit in
+ * `capacity` bytes (data that does not compress grows slightly), or
+ * `-EINVAL` if `length` is too large.
+ */
+ssize_t __cheri_libcall compress_lz4(const void *src,
+                                     size_t      length,
+                                     void       *dst,
+                                     size_t      capacity,
+                                     void       *workspace);
+
+/**
+ * Decompress the LZ4 block of `length` bytes at `src` into `dst`, which has
+ * space for `capacity` bytes.  Malformed input never causes reads or writes
+ * outside the two buffers.
+ *
+ * Returns the size of the decompressed data, `-ENOSPC` if it does not fit in
+ * `capacity` bytes, or `-EINVAL` if the block is malformed.
+ */
+ssize_t __cheri_libcall decompress_lz4(const void *src,
+                                       size_t      length,
+                                       void       *dst,
+                                       size_t      capacity);
+
+/**
+ * A streaming compressor.  Initialise with `compress_stream_init` and treat
+ * the fields as private.  Streams are not safe to use from more than one
+ * thread at a time without external locking.
+ */
+struct CompressStream
+{
+	/// The sink that frames are written to.
+	StdioStreamWrite write;
+	/// The context passed to `write`.
+	void *context;
+	/// The buffer in which a block is gathered.
+	uint8_t *input;
+	/// The block size.
+	size_t inputSize;
+	/// The number of bytes in `input`.
+	size_t inputUsed;
+	/// The buffer holding a frame while it is written to the sink.
+	uint8_t *output;
+	/// The size of `output`.
+	size_t outputSize;
+	/// The length of the frame in `output`.
+	size_t outputUsed;
+	/// The number of bytes of the frame that the sink has accepted.
+	size_t outputSent;
+	/// The compressor's workspace.
+	void *workspace;
+};
+
+/**
+ * Initialise `stream` to compress blocks of `inputSize` bytes (at most
+ * `COMPRESS_LZ4_MAX_BLOCK_SIZE`), gathered in `input`, and write each as a
+ * frame to `write` (which is passed `context`).  Frames are built in
+ * `output`, which must have space for `inputSize +
+ * COMPRESS_FRAME_HEADER_SIZE` bytes.  `workspace` is as for `compress_lz4`.
+ * A block size of 1-4 KiB typically gives most of the compression ratio.
+ *
+ * Returns 0 on success or `-EINVAL` if a buffer is too small or `write` is
+ * null.
+ */
+int __cheri_libcall compress_stream_init(struct CompressStream *stream,
+                                         StdioStreamWrite       write,
+                                         void                  *context,
+                                         void                  *input,
+                                         size_t                 inputSize,
+                                         void                  *output,
+                                         size_t                 outputSize,
+                                         void                  *workspace);
+
+/**
+ * Add `length` bytes from `data` to the `CompressStream` passed as `stream`,
+ * compressing and writing out each block as it fills.  This has the
+ * signature of a `StdioStreamWrite` so that it can be the sink of a stdio
+ * stream.
+ *
+ * Returns the number of bytes accepted, which is less than `length` only if
+ * the sink has not accepted the previous frame and the next block is full.
+ */
+ssize_t __cheri_libcall compress_stream_write(void       *stream,
+                                              const char *data,
+                                              size_t      length);
+
+/**
+ * Compress any partial block in `stream` and write out the frame.  This must
+ * be called to send data that does not fill a block, for example before a
+ * device sleeps or at the end of a log.  Flushing a stdio stream in front of
+ * the compressor does not flush the compressor.
+ *
+ * Returns 0 if all data has been written to the sink or `-EAGAIN` if the
+ * sink did not accept all of it, in which case this can be called again.
+ */
+int __cheri_libcall compress_stream_flush(struct CompressStream *stream);
+
+/**
+ * Decompress the frame (written by a `CompressStream`) at the start of the
+ * `length` bytes at `src` into `dst`, which has space for `capacity` bytes.
+ * If `consumed` is not null, the size of the frame is stored there, so that
+ * a buffer of concatenated frames can be decoded in a loop.
+ *
+ * Returns the size of the decompressed block or an error as for
+ * `decompress_lz4` (`-EINVAL` if the frame is truncated).
+ */
+ssize_t __cheri_libcall decompress_frame(const void *src,
+                                         size_t      length,
+                                         void       *dst,
+                                         size_t      capacity,
+                                         size_t     *consumed);
+
+/**
+ * A `StdioStreamWrite` that sends the data as one record on the record queue
+ * passed as the context, without blocking.  As the sink of a
+ * `CompressStream`, this sends each frame as a record.
+ */
+static inline ssize_t
+compress_record_queue_write(void *queue, const char *data, size_t length)
+{
+	Timeout timeout = {0, 0};
+	return record_queue_send(
+	         &timeout, (struct MessageQueue *)queue, data, length) == 0
+	         ? (ssize_t)length
+	         : 0;
+}
+
+__END_DECLS
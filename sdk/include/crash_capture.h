@@ -0,0 +1,127 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <compartment.h>
+#include <scheduler_trace.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Post-mortem crash capture.
+ *
+ * The `crash_capture` compartment writes a compact binary record of a fault
+ * to a region of RAM that survives a reset and that nothing else uses.  The
+ * board description must declare this region as a device called
+ * `crash_record`, outside the heap and the firmware image, so that the loader
+ * does not zero it.  After the next boot, `crash_capture_retrieve` returns the
+ * record, for example to report it or to print it, so field failures can be
+ * diagnosed without a console and without slow logging on the hot path.
+ *
+ * Compartments opt in by calling `crash_capture_record` from their error
+ * handler before deciding how to recover, for example:
+ *
+ * ```c++
+ * extern "C" ErrorRecoveryBehaviour
+ * compartment_error_handler(ErrorState *frame, size_t mcause, size_t mtval)
+ * {
+ *     crash_capture_record(frame, mcause, mtval);
+ *     return ErrorRecoveryBehaviour::ForceUnwind;
+ * }
+ * ```
+ *
+ * Failed assertions and invariants trap after they are reported, and so are
+ * captured in the same way.
+ */
+
+/**
+ * The maximum number of compartment invocations recorded, innermost first.
+ */
+#define CRASH_CAPTURE_MAX_FRAMES 8
+
+/**
+ * The maximum number of scheduler trace records copied into a crash record.
+ * Trace records are copied only if the firmware is built with
+ * `--scheduler-trace-entries`.
+ */
+#define CRASH_CAPTURE_TRACE_RECORDS 8
+
+/**
+ * The value of `CrashRecord::magic` in a valid record.
+ */
+#define CRASH_CAPTURE_MAGIC 0x43525348
+
+/**
+ * The layout of a crash record.  Registers are recorded as addresses only:
+ * the record must not hold capabilities, and tags do not survive a reset.
+ */
+struct CrashRecord
+{
+	/// `CRASH_CAPTURE_MAGIC` if this record is valid.
+	uint32_t magic;
+	/**
+	 * A checksum over the rest of the record, so that the contents of RAM at
+	 * power-on are not mistaken for a record.
+	 */
+	uint32_t checksum;
+	/**
+	 * The number of faults that have been recorded since the record was last
+	 * cleared.  The record describes the most recent.
+	 */
+	uint32_t crashes;
+	/// The value of `mcause` for the fault.
+	uint32_t mcause;
+	/// The value of `mtval` for the fault.
+	uint32_t mtval;
+	/// The address of the faulting instruction.
+	ptraddr_t pcc;
+	/// The addresses in the general-purpose registers, `ra` to `a5`.
+	ptraddr_t registers[15];
+	/**
+	 * The base addresses of the export tables of the faulting compartment
+	 * and then of each of its callers, outermost last.  The export table of
+	 * a compartment called `foo` is labelled `.foo_export_table` in the
+	 * firmware image.
+	 */
+	ptraddr_t compartments[CRASH_CAPTURE_MAX_FRAMES];
+	/// The ID of the thread that faulted.
+	uint16_t thread;
+	/// The number of valid entries in `compartments`.
+	uint8_t frameCount;
+	/// The number of valid entries in `trace`.
+	uint8_t traceCount;
+	/// The value of the cycle counter when the fault was recorded.
+	uint64_t cycles;
+	/// The most recent scheduler trace records, oldest first.
+	struct SchedulerTraceRecord trace[CRASH_CAPTURE_TRACE_RECORDS];
+};
+
+__BEGIN_DECLS
+
+/**
+ * Record a fault in the calling compartment, described by the arguments to
+ * its error handler.  This replaces any existing record and increments the
+ * count of recorded faults.
+ *
+ * Returns 0 on success or `-EINVAL` if `frame` is not a valid error state.
+ */
+int __cheri_compartment("crash_capture")
+  crash_capture_record(struct ErrorState *frame, size_t mcause, size_t mtval);
+
+/**
+ * Copy the crash record into `*record`.  The record persists until
+ * `crash_capture_clear` is called, including across resets.
+ *
+ * Returns 0 on success, `-ENOENT` if there is no valid record, or `-EINVAL`
+ * if `record` is not a valid pointer.
+ */
+int __cheri_compartment("crash_capture")
+  crash_capture_retrieve(struct CrashRecord *record);
+
+/**
+ * Discard the crash record.
+ */
+int __cheri_compartment("crash_capture") crash_capture_clear(void);
+
+__END_DECLS
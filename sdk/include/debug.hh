@@ -434,6 +434,19 @@ __cheri_libcall void debug_log_message_write(const char          *context,
                                              DebugFormatArgument *messages,
                                              size_t               messageCount);
 
+/**
+ * Library function that writes a debug message whose format string has been
+ * split at compile time by `DebugFormatString`.  `segmentLengths` holds the
+ * lengths of the `messageCount + 1` literal segments of `format`, which are
+ * separated by `{}` placeholders.
+ */
+__cheri_libcall void
+debug_log_preparsed_message_write(const char          *context,
+                                  const char          *format,
+                                  const uint16_t      *segmentLengths,
+                                  DebugFormatArgument *messages,
+                                  size_t               messageCount);
+
 __cheri_libcall void debug_report_failure(const char          *kind,
                                           const char          *file,
                                           const char          *function,
@@ -475,6 +488,78 @@ namespace
 		char value[N];
 	};
 
+	/**
+	 * Not defined.  Calling this from `DebugFormatString`'s constructor turns
+	 * a format string whose placeholders do not match its arguments into a
+	 * compile failure that names the problem.
+	 */
+	void debug_format_string_placeholders_do_not_match_arguments();
+
+	/**
+	 * A format string for `Args`, parsed at compile time.  This checks that
+	 * the string has one `{}` placeholder for each argument and records the
+	 * lengths of the literal segments around them, so that the debug library
+	 * does not need to scan the string for placeholders.
+	 *
+	 * This is implicitly constructed from a string literal (or any other
+	 * constant expression) when passed as the format argument to
+	 * `ConditionalDebug` methods.  Wrappers that forward a format string
+	 * should take a
+	 * `DebugFormatString<std::type_identity_t<Args>...>` rather than a
+	 * `const char *`.
+	 */
+	template<typename... Args>
+	struct DebugFormatString
+	{
+		/// The format string.
+		const char *string;
+
+		/**
+		 * The lengths of the literal segments of `string`.  Segment `i` is
+		 * followed by the placeholder for argument `i`, except for the last
+		 * segment, which is followed by the end of the string.
+		 */
+		std::array<uint16_t, sizeof...(Args) + 1> segmentLengths{};
+
+		/**
+		 * Parse `fmt`.  Fails to compile if the number of placeholders does
+		 * not match the number of arguments.
+		 */
+		consteval DebugFormatString(const char *fmt) : string(fmt)
+		{
+			size_t   segment = 0;
+			uint16_t length  = 0;
+			for (const char *s = fmt; *s != 0; ++s)
+			{
+				if (s[0] == '{' && s[1] == '}')
+				{
+					if (segment == sizeof...(Args))
+					{
+						debug_format_string_placeholders_do_not_match_arguments();
+					}
+					segmentLengths[segment++] = length;
+					length                    = 0;
+					s++;
+					continue;
+				}
+				length++;
+			}
+			if (segment != sizeof...(Args))
+			{
+				debug_format_string_placeholders_do_not_match_arguments();
+			}
+			segmentLengths[segment] = length;
+		}
+
+		/**
+		 * Implicit conversion to a C string.
+		 */
+		constexpr operator const char *() const
+		{
+			return string;
+		}
+	};
+
 	/**
 	 * Our libc++ does not currently provide source_location, but our clang
 	 * provides the necessary builtins for one.
@@ -541,6 +626,25 @@ namespace
 		const char *functionName;
 	};
 
+#ifdef CHERIOT_DEBUG_LEVEL_OBJECT
+	/**
+	 * Helper for `debug_log_level`, which expands the name of the shared
+	 * object before `SHARED_OBJECT_WITH_PERMISSIONS` turns it into a string.
+	 */
+#	define CHERIOT_DEBUG_LEVEL_IMPORT(name)                                   \
+		SHARED_OBJECT_WITH_PERMISSIONS(                                        \
+		  uint32_t, name, true, false, false, false)
+
+	/**
+	 * Returns this component's run-time log level.  This is a load through
+	 * a read-only import of the component's log-level word.
+	 */
+	__always_inline inline uint32_t debug_log_level()
+	{
+		return *CHERIOT_DEBUG_LEVEL_IMPORT(CHERIOT_DEBUG_LEVEL_OBJECT);
+	}
+#endif
+
 	/**
 	 * Conditional debug class.  Used to control conditional output and
 	 * assertion checking.  Enables debug log messages and assertions if
@@ -562,19 +666,33 @@ namespace
 		/**
 		 * Log a message.
 		 *
-		 * This function does nothing if the `Enabled` condition is false.
+		 * This function does nothing if the `Enabled` condition is false.  In
+		 * firmware built with `--debug-runtime-levels=y`, it also does nothing
+		 * while the component's run-time log level is `DebugLogLevelSilent`.
+		 * The level is checked before any arguments are prepared, so a
+		 * disabled message costs a load and a branch.
 		 */
 		template<typename... Args>
-		static void log(const char *fmt, Args... args)
+		static void log(DebugFormatString<std::type_identity_t<Args>...> fmt,
+		                Args... args)
 		{
 			if constexpr (Enabled)
 			{
+#ifdef CHERIOT_DEBUG_LEVEL_OBJECT
+				if (__predict_true(debug_log_level() == DebugLogLevelSilent))
+				{
+					return;
+				}
+#endif
 				asm volatile("" ::: "memory");
 				DebugFormatArgument arguments[sizeof...(Args)];
 				make_debug_arguments_list(arguments, args...);
 				const char *context = Context;
-				debug_log_message_write(
-				  context, fmt, arguments, sizeof...(Args));
+				debug_log_preparsed_message_write(context,
+				                                  fmt.string,
+				                                  fmt.segmentLengths.data(),
+				                                  arguments,
+				                                  sizeof...(Args));
 				asm volatile("" ::: "memory");
 			}
 		}
@@ -619,8 +737,8 @@ namespace
 			 * Constructor, performs the invariant check.
 			 */
 			__always_inline
-			Invariant(bool        condition,
-			          const char *fmt,
+			Invariant(bool                      condition,
+			          DebugFormatString<Args...> fmt,
 			          Args... args,
 			          SourceLocation loc = SourceLocation::current())
 			{
@@ -655,8 +773,8 @@ namespace
 			 */
 			template<typename T>
 			requires DebugConcepts::IsBool<T> __always_inline
-			Assert(T           condition,
-			       const char *fmt,
+			Assert(T                          condition,
+			       DebugFormatString<Args...> fmt,
 			       Args... args,
 			       SourceLocation loc = SourceLocation::current())
 			{
@@ -686,8 +804,8 @@ namespace
 			 */
 			template<typename T>
 			requires DebugConcepts::LazyAssertion<T> __always_inline
-			Assert(T         &&condition,
-			       const char *fmt,
+			Assert(T                        &&condition,
+			       DebugFormatString<Args...> fmt,
 			       Args... args,
 			       SourceLocation loc = SourceLocation::current())
 			{
@@ -0,0 +1,58 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment-macros.h>
+#include <stdint.h>
+
+/**
+ * Buffered debug output.
+ *
+ * By default, the debug library writes each message synchronously to the
+ * UART with interrupts disabled, which at 115200 baud keeps interrupts off
+ * for around 90 µs per character.  When the firmware is built with
+ * `--debug-log-buffer=N` (for a non-zero power of two `N`), the debug library
+ * instead formats messages into an `N`-byte ring buffer in a shared object
+ * called `debug_log_buffer`, which takes interrupts off only for as long as
+ * formatting takes.  The `debug_log_drain` compartment copies the buffer to
+ * the UART from a thread that the firmware must provide, with entry point
+ * `debug_log_drain_run`.  This thread should have the lowest priority in the
+ * system, so that logging never delays other work.
+ *
+ * Messages are added to the ring whole.  A message that does not fit in the
+ * free space is dropped and counted, and the drain thread reports the number
+ * of dropped messages when it next runs.
+ */
+
+/**
+ * The layout of the `debug_log_buffer` shared object.
+ */
+struct DebugLogBuffer
+{
+	/**
+	 * The total number of bytes written since boot.  This is updated once a
+	 * message is complete and the drain thread waits on it as a futex.
+	 */
+	uint32_t produced;
+	/// The total number of bytes that the drain thread has written out.
+	uint32_t consumed;
+	/// The number of messages dropped because the ring was full.
+	uint32_t dropped;
+	/// The ring of characters, `CHERIOT_DEBUG_LOG_BUFFER` bytes long.
+	char data[];
+};
+
+/**
+ * Returns a writeable pointer to the debug log buffer.  This may be used only
+ * in firmware built with a debug log buffer.
+ */
+#define DEBUG_LOG_BUFFER()                                                     \
+	SHARED_OBJECT_WITH_PERMISSIONS(                                            \
+	  struct DebugLogBuffer, debug_log_buffer, true, true, false, false)
+
+/**
+ * Entry point for the thread that drains the debug log buffer to the UART.
+ * This never returns.
+ */
+void __cheri_compartment("debug_log_drain") debug_log_drain_run(void);
@@ -8,6 +8,7 @@
 #pragma once
 
 #include <concepts>
+#include <stdint.h>
 
 namespace ds::bits
 {
@@ -40,4 +41,38 @@ namespace ds::bits
 		return above_or_least(v << 1);
 	}
 
+	/**
+	 * Count the leading zero bits of a 32-bit value, which must not be zero.
+	 *
+	 * With the Zbb extension this is a single `clz` instruction.  Without it,
+	 * the compiler would lower `__builtin_clz` to a call to `__clzsi2`, so
+	 * this instead does a branch-light binary search inline.
+	 */
+	__always_inline uint32_t leading_zeroes(uint32_t v)
+	{
+#ifdef __riscv_zbb
+		return __builtin_clz(v);
+#else
+		uint32_t n = 0;
+		for (uint32_t shift = 16; shift != 0; shift >>= 1)
+		{
+			if ((v >> (32 - shift)) == 0)
+			{
+				n += shift;
+				v <<= shift;
+			}
+		}
+		return n;
+#endif
+	}
+
+	/**
+	 * Returns the index of the most significant set bit of a 32-bit value,
+	 * which must not be zero.
+	 */
+	__always_inline uint32_t highest_set(uint32_t v)
+	{
+		return 31 - leading_zeroes(v);
+	}
+
 } // namespace ds::bits
@@ -0,0 +1,108 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file Multiplication and constant-divisor division helpers for 64-bit values
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+namespace ds::divide
+{
+	/**
+	 * Returns the high 64 bits of the 128-bit product of `a` and `b`.
+	 *
+	 * This is built from four 32x32-bit multiplies, each of which is a `mul` /
+	 * `mulhu` pair on RV32, and does not call any runtime helpers.
+	 */
+	__always_inline uint64_t multiply_high(uint64_t a, uint64_t b)
+	{
+		uint64_t a0  = static_cast<uint32_t>(a);
+		uint64_t a1  = a >> 32;
+		uint64_t b0  = static_cast<uint32_t>(b);
+		uint64_t b1  = b >> 32;
+		uint64_t p00 = a0 * b0;
+		uint64_t p01 = a0 * b1;
+		uint64_t p10 = a1 * b0;
+		uint64_t p11 = a1 * b1;
+		uint64_t middle =
+		  (p00 >> 32) + static_cast<uint32_t>(p01) + static_cast<uint32_t>(p10);
+		return p11 + (p01 >> 32) + (p10 >> 32) + (middle >> 32);
+	}
+
+	/**
+	 * A precomputed reciprocal of the 32-bit constant `Divisor`, for dividing
+	 * 64-bit values without calling `__udivdi3`.
+	 *
+	 * This uses the round-up method of Granlund and Montgomery ("Division by
+	 * Invariant Integers using Multiplication", figure 4.1), which gives the
+	 * exact quotient for every 64-bit dividend.  Powers of two become a
+	 * shift.
+	 */
+	template<uint32_t Divisor>
+	class Reciprocal
+	{
+		static_assert(Divisor != 0, "Division by zero");
+
+		/// True if the divisor is a power of two.
+		static constexpr bool IsPowerOfTwo = (Divisor & (Divisor - 1)) == 0;
+
+		/// The number of bits needed to represent `Divisor - 1`.
+		static constexpr uint32_t Log2 = []() {
+			uint32_t bits = 0;
+			while ((uint64_t(1) << bits) < Divisor)
+			{
+				bits++;
+			}
+			return bits;
+		}();
+
+		/**
+		 * The multiplier, `floor(2^64 * (2^Log2 - Divisor) / Divisor) + 1`.
+		 * The numerator does not fit in 64 bits, so this does long division
+		 * one bit at a time (at compile time).
+		 */
+		static constexpr uint64_t Multiplier = []() {
+			uint64_t remainder = (uint64_t(1) << Log2) - Divisor;
+			uint64_t quotient  = 0;
+			for (int i = 0; i < 64; i++)
+			{
+				remainder <<= 1;
+				quotient <<= 1;
+				if (remainder >= Divisor)
+				{
+					remainder -= Divisor;
+					quotient |= 1;
+				}
+			}
+			return quotient + 1;
+		}();
+
+		public:
+		/**
+		 * Returns `dividend / Divisor`.
+		 */
+		__always_inline static uint64_t divide(uint64_t dividend)
+		{
+			if constexpr (IsPowerOfTwo)
+			{
+				return dividend >> Log2;
+			}
+			else
+			{
+				uint64_t high = multiply_high(Multiplier, dividend);
+				return (high + ((dividend - high) >> 1)) >> (Log2 - 1);
+			}
+		}
+
+		/**
+		 * Returns `dividend % Divisor`.
+		 */
+		__always_inline static uint32_t remainder(uint64_t dividend)
+		{
+			return static_cast<uint32_t>(dividend - divide(dividend) * Divisor);
+		}
+	};
+} // namespace ds::divide
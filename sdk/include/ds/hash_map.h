@@ -0,0 +1,409 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file Open-addressing hash maps with Robin Hood probing.
+ */
+
+#pragma once
+
+#include <cdefs.h>
+#include <cheri.hh>
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+
+namespace ds::hash_map
+{
+	/**
+	 * How keys of type `Key` are stored, hashed, and compared.  `Stored` is
+	 * the type held in the table, `store` converts a key to it, `hash`
+	 * returns a 32-bit hash of a stored key (which the map mixes further, so
+	 * this need not be well distributed), and `equal` compares a stored key
+	 * with a key.
+	 *
+	 * This version handles integer and enumeration keys.  Specialise this
+	 * for other key types.
+	 */
+	template<typename Key>
+	struct KeyTraits
+	{
+		static_assert(std::is_integral_v<Key> || std::is_enum_v<Key>,
+		              "Specialise ds::hash_map::KeyTraits for this key type");
+
+		/// Keys are stored as they are.
+		using Stored = Key;
+
+		/// Returns the stored form of `key`.
+		static Stored store(const Key &key)
+		{
+			return key;
+		}
+
+		/// Returns the hash of `key`, folding 64-bit keys to 32 bits.
+		static uint32_t hash(const Stored &key)
+		{
+			auto value = static_cast<uint64_t>(key);
+			return static_cast<uint32_t>(value ^ (value >> 32));
+		}
+
+		/// Returns true if `stored` holds `key`.
+		static bool equal(const Stored &stored, const Key &key)
+		{
+			return stored == key;
+		}
+	};
+
+	/**
+	 * Keys that are capabilities are stored as their address.  Two
+	 * capabilities with the same address are the same key, whatever their
+	 * bounds and permissions.  This halves the size of the key and means
+	 * that the map does not hold tagged capabilities to its keys, so it
+	 * neither keeps them reachable nor needs to be scanned by revocation.
+	 */
+	template<typename T>
+	struct KeyTraits<CHERI::Capability<T>>
+	{
+		/// Keys are stored as addresses.
+		using Stored = ptraddr_t;
+
+		/// Returns the address of `key`.
+		static Stored store(const CHERI::Capability<T> &key)
+		{
+			return key.address();
+		}
+
+		/// Returns the address, which the map will mix.
+		static uint32_t hash(const Stored &key)
+		{
+			return key;
+		}
+
+		/// Returns true if `key` has the address in `stored`.
+		static bool equal(const Stored &stored, const CHERI::Capability<T> &key)
+		{
+			return stored == key.address();
+		}
+	};
+
+	/**
+	 * Keys that are pointers are stored as their address, as for
+	 * `CHERI::Capability`.
+	 */
+	template<typename T>
+	struct KeyTraits<T *>
+	{
+		/// Keys are stored as addresses.
+		using Stored = ptraddr_t;
+
+		/// Returns the address of `key`.
+		static Stored store(T *key)
+		{
+			return __builtin_cheri_address_get(key);
+		}
+
+		/// Returns the address, which the map will mix.
+		static uint32_t hash(const Stored &key)
+		{
+			return key;
+		}
+
+		/// Returns true if `key` has the address in `stored`.
+		static bool equal(const Stored &stored, T *key)
+		{
+			return stored == __builtin_cheri_address_get(key);
+		}
+	};
+
+	/**
+	 * A hash map from `Key` to `Value` in a caller-provided table of slots.
+	 *
+	 * The map uses open addressing with Robin Hood probing: each entry
+	 * records how far it is from its home slot and an insertion displaces
+	 * any entry that is closer to home than the one being inserted.  This
+	 * keeps probe sequences short even at high load, and lets a lookup for a
+	 * missing key stop as soon as it reaches an entry that is closer to home
+	 * than the key would be.  Deletion shifts the following entries back, so
+	 * there are no tombstones.
+	 *
+	 * The map never allocates.  The table is `capacity` slots, where
+	 * `capacity` is a power of two of at least 2 and at most 32768, and must
+	 * be zeroed before use, so memory from `heap_allocate` can be used
+	 * directly (see `storage_size`).  `FixedHashMap` provides a table that is
+	 * part of the map.  Insertion fails once every slot is full; keeping the
+	 * load below about 90% keeps lookups fast.
+	 *
+	 * `Value` must be default constructible and movable.  Empty slots hold a
+	 * default-constructed value.
+	 *
+	 * This is not thread safe.  Callers that share a map between threads
+	 * must provide their own locking.
+	 */
+	template<typename Key, typename Value, typename Traits = KeyTraits<Key>>
+	class HashMap
+	{
+		/// The type of keys in the table.
+		using Stored = typename Traits::Stored;
+
+		public:
+		/**
+		 * A slot in the table.
+		 */
+		struct Slot
+		{
+			/// The key, if this slot is occupied.
+			Stored key;
+			/// The value, if this slot is occupied.
+			Value value;
+			/**
+			 * Zero if the slot is empty, otherwise one more than the number
+			 * of slots between the entry's home slot and this slot.
+			 */
+			uint16_t distance;
+		};
+
+		/// The largest supported capacity.
+		static constexpr size_t MaxCapacity = 32768;
+
+		/**
+		 * Returns the number of bytes needed for a table of `capacity`
+		 * slots.
+		 */
+		static constexpr size_t storage_size(size_t capacity)
+		{
+			return capacity * sizeof(Slot);
+		}
+
+		private:
+		/// The table.
+		Slot *slots;
+
+		/// The number of slots minus one.
+		uint32_t mask;
+
+		/// The shift that turns a mixed hash into a slot index.
+		uint8_t shift;
+
+		/// The number of occupied slots.
+		uint32_t count = 0;
+
+		/**
+		 * Returns the home slot for `key`.  This uses Fibonacci hashing: the
+		 * hash is multiplied by 2^32 divided by the golden ratio and the top
+		 * bits are used, so keys that differ only in their low bits (such as
+		 * aligned addresses) are spread across the table.
+		 */
+		uint32_t home(const Stored &key) const
+		{
+			return (Traits::hash(key) * 0x9e3779b9U) >> shift;
+		}
+
+		/**
+		 * Returns the slot that holds `key`, or null if it is not present.
+		 */
+		Slot *find_slot(const Key &key) const
+		{
+			Stored   stored = Traits::store(key);
+			uint32_t index  = home(stored);
+			for (uint32_t distance = 1;; distance++)
+			{
+				Slot &slot = slots[index];
+				if (slot.distance < distance)
+				{
+					return nullptr;
+				}
+				if ((slot.distance == distance) &&
+				    Traits::equal(slot.key, key))
+				{
+					return &slot;
+				}
+				index = (index + 1) & mask;
+			}
+		}
+
+		public:
+		/**
+		 * Construct a map in `table`, which must hold `capacity` zeroed slots.
+		 * `capacity` must be a power of two between 2 and `MaxCapacity`.
+		 */
+		HashMap(Slot *table, size_t capacity)
+		  : slots(table),
+		    mask(capacity - 1),
+		    shift(32 - __builtin_ctz(capacity))
+		{
+		}
+
+		HashMap(const HashMap &) = delete;
+		HashMap &operator=(const HashMap &) = delete;
+
+		/**
+		 * Returns a pointer to the value for `key`, or null if it is not
+		 * present.  The pointer is valid until the map is next modified.
+		 */
+		Value *find(const Key &key)
+		{
+			Slot *slot = find_slot(key);
+			return slot == nullptr ? nullptr : &slot->value;
+		}
+
+		/// Returns true if `key` is present.
+		bool contains(const Key &key) const
+		{
+			return find_slot(key) != nullptr;
+		}
+
+		/**
+		 * Set the value for `key` to `value`, adding it if it is not already
+		 * present.  Returns a pointer, valid until the map is next modified,
+		 * to the value in the map, or null if the key is not present and the
+		 * map is full.
+		 */
+		Value *insert(const Key &key, Value value)
+		{
+			if (Slot *slot = find_slot(key))
+			{
+				slot->value = std::move(value);
+				return &slot->value;
+			}
+			if (count > mask)
+			{
+				return nullptr;
+			}
+			count++;
+			Stored   stored   = Traits::store(key);
+			uint16_t distance = 1;
+			uint32_t index    = home(stored);
+			Value   *result   = nullptr;
+			for (;; distance++, index = (index + 1) & mask)
+			{
+				Slot &slot = slots[index];
+				if (slot.distance == 0)
+				{
+					slot.key      = stored;
+					slot.value    = std::move(value);
+					slot.distance = distance;
+					return result == nullptr ? &slot.value : result;
+				}
+				// Take the slot from an entry that is closer to home and
+				// carry on inserting that entry instead.
+				if (slot.distance < distance)
+				{
+					std::swap(slot.key, stored);
+					std::swap(slot.value, value);
+					std::swap(slot.distance, distance);
+					if (result == nullptr)
+					{
+						result = &slot.value;
+					}
+				}
+			}
+		}
+
+		/**
+		 * Remove `key`.  Returns true if it was present.
+		 */
+		bool erase(const Key &key)
+		{
+			Slot *slot = find_slot(key);
+			if (slot == nullptr)
+			{
+				return false;
+			}
+			count--;
+			// Shift back the following entries that are not in their home
+			// slot, so that no probe sequence passes through an empty slot.
+			uint32_t index = slot - slots;
+			for (;;)
+			{
+				uint32_t next     = (index + 1) & mask;
+				Slot    &current  = slots[index];
+				Slot    &neighbor = slots[next];
+				if (neighbor.distance <= 1)
+				{
+					current.key      = Stored{};
+					current.value    = Value{};
+					current.distance = 0;
+					return true;
+				}
+				current.key      = neighbor.key;
+				current.value    = std::move(neighbor.value);
+				current.distance = neighbor.distance - 1;
+				index            = next;
+			}
+		}
+
+		/**
+		 * Remove every entry.
+		 */
+		void clear()
+		{
+			for (uint32_t i = 0; i <= mask; i++)
+			{
+				slots[i] = Slot{};
+			}
+			count = 0;
+		}
+
+		/**
+		 * Call `fn` with the stored key and a reference to the value of each
+		 * entry, in table order.  `fn` must not modify the map.
+		 */
+		template<typename Fn>
+		void for_each(Fn &&fn)
+		{
+			for (uint32_t i = 0; i <= mask; i++)
+			{
+				if (slots[i].distance != 0)
+				{
+					fn(slots[i].key, slots[i].value);
+				}
+			}
+		}
+
+		/// Returns the number of entries.
+		[[nodiscard]] size_t size() const
+		{
+			return count;
+		}
+
+		/// Returns true if there are no entries.
+		[[nodiscard]] bool empty() const
+		{
+			return count == 0;
+		}
+
+		/// Returns the number of slots.
+		[[nodiscard]] size_t capacity() const
+		{
+			return size_t(mask) + 1;
+		}
+	};
+
+	/**
+	 * A `HashMap` with a table of `Capacity` slots that is part of the map, so
+	 * a map that is a global is statically allocated and one that is on the
+	 * stack or in the heap is backed by that memory.
+	 */
+	template<typename Key,
+	         typename Value,
+	         size_t Capacity,
+	         typename Traits = KeyTraits<Key>>
+	class FixedHashMap : public HashMap<Key, Value, Traits>
+	{
+		/// The map that this provides a table for.
+		using Base = HashMap<Key, Value, Traits>;
+
+		static_assert((Capacity >= 2) && (Capacity <= Base::MaxCapacity) &&
+		                ((Capacity & (Capacity - 1)) == 0),
+		              "Hash map capacity must be a power of two from 2 to "
+		              "MaxCapacity");
+
+		/// The table.
+		typename Base::Slot table[Capacity] = {};
+
+		public:
+		/// Construct an empty map.
+		FixedHashMap() : Base(table, Capacity) {}
+	};
+} // namespace ds::hash_map
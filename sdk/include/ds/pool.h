@@ -0,0 +1,173 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+/**
+ * @file Fixed-size object pools.
+ */
+
+#pragma once
+
+#include <cdefs.h>
+#include <cheri.hh>
+#include <ds/pointer.h>
+#include <new>
+#include <string.h>
+#include <utility>
+
+namespace ds::pool
+{
+	/**
+	 * A pool of `Count` objects of type `T`, for hot paths that must not call
+	 * the allocator.  The storage is part of the pool, so a pool that is a
+	 * global is statically allocated and one that is allocated on the heap is
+	 * backed by that allocation.
+	 *
+	 * Free objects are kept on an intrusive free list.  Each free slot holds
+	 * only the address of the next one, which is turned back into a pointer
+	 * with the bounds of the pool's storage.  The initial state is all
+	 * zeroes, so pools in globals are constant-initialised: slots that have
+	 * never been used are handed out in order once the free list is empty.
+	 *
+	 * Objects are returned with bounds that cover only the object, so one
+	 * object cannot be used to reach its neighbours.  Freed objects are zeroed
+	 * but, unlike heap objects, are not revoked: a pointer kept after an
+	 * object is freed will alias whichever object next uses the slot.  Code
+	 * that hands pool objects to other compartments should therefore hand out
+	 * sealed or otherwise indirect references to them.
+	 *
+	 * This is not thread safe.  Callers that share a pool between threads
+	 * must provide their own locking.
+	 */
+	template<typename T, size_t Count>
+	class Pool
+	{
+		static_assert(Count > 0, "Pools must contain at least one object");
+
+		/**
+		 * Storage for one object.  While the object is free, the start of the
+		 * slot holds the address of the next free slot, or zero.
+		 */
+		union Slot
+		{
+			/// The address of the next free slot.
+			ptraddr_t next;
+			/// The object.
+			alignas(T) unsigned char object[sizeof(T)];
+		};
+
+		/// The slots.
+		Slot slots[Count] = {};
+
+		/// The address of the first free slot, or zero.
+		ptraddr_t freeList = 0;
+
+		/// The number of slots that have ever been handed out.
+		size_t used = 0;
+
+		/// Returns a proxy for a free-list link in `slot`.
+		__always_inline auto link(ptraddr_t &slot)
+		{
+			return ds::pointer::proxy::PtrAddr<Slot>{slots, slot};
+		}
+
+		/**
+		 * Returns the slot that `object` points to, or null if `object` is not
+		 * a pointer to the start of an object in this pool.
+		 */
+		Slot *slot_for(void *object)
+		{
+			CHERI::Capability<void> cap{object};
+			ptraddr_t               address = cap.address();
+			ptraddr_t               base = __builtin_cheri_address_get(slots);
+			if (!cap.is_valid() || (address < base) ||
+			    (address >= base + sizeof(slots)) ||
+			    (((address - base) % sizeof(Slot)) != 0))
+			{
+				return nullptr;
+			}
+			return &slots[(address - base) / sizeof(Slot)];
+		}
+
+		public:
+		/**
+		 * Allocate an object.  Returns a pointer to zeroed, uninitialised
+		 * storage for a `T`, bounded to the object, or null if the pool is
+		 * empty.
+		 */
+		void *allocate()
+		{
+			Slot *slot;
+			if (freeList != 0)
+			{
+				slot       = link(freeList);
+				freeList   = slot->next;
+				slot->next = 0;
+			}
+			else if (used < Count)
+			{
+				slot = &slots[used++];
+			}
+			else
+			{
+				return nullptr;
+			}
+			CHERI::Capability<void> object{slot->object};
+			object.bounds() = sizeof(T);
+			return object.is_valid() ? object.get() : nullptr;
+		}
+
+		/**
+		 * Return `object`, which must have been returned by `allocate`, to the
+		 * pool.  This zeroes it but does not run its destructor.  Returns
+		 * false if `object` is not an object in this pool.
+		 */
+		bool deallocate(void *object)
+		{
+			Slot *slot = slot_for(object);
+			if (slot == nullptr)
+			{
+				return false;
+			}
+			memset(slot, 0, sizeof(Slot));
+			slot->next     = freeList;
+			link(freeList) = slot;
+			return true;
+		}
+
+		/**
+		 * Allocate an object and construct it with `args`.  Returns null if
+		 * the pool is empty.
+		 */
+		template<typename... Args>
+		T *create(Args &&...args)
+		{
+			void *storage = allocate();
+			if (storage == nullptr)
+			{
+				return nullptr;
+			}
+			return new (storage) T(std::forward<Args>(args)...);
+		}
+
+		/**
+		 * Destroy an object returned by `create` and return it to the pool.
+		 * Returns false, without running the destructor, if `object` is not an
+		 * object in this pool.
+		 */
+		bool destroy(T *object)
+		{
+			if (slot_for(object) == nullptr)
+			{
+				return false;
+			}
+			object->~T();
+			return deallocate(object);
+		}
+
+		/// Returns true if `object` is the start of an object in this pool.
+		bool contains(void *object)
+		{
+			return slot_for(object) != nullptr;
+		}
+	};
+} // namespace ds::pool
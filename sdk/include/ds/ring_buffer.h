@@ -33,6 +33,12 @@ namespace ds::ring_buffer
 	 *   - populate the element in the (external!) storage at that index
 	 *   - call tail_advance() to make that element available to the
 	 *     consumer
+	 *
+	 * Consumers and producers that handle several elements at once can use
+	 * size() to find how many are available (or, subtracted from Capacity,
+	 * how many are free) and advance the head or tail past all of them with
+	 * a single call.  Cursors move towards lower indices, wrapping from zero
+	 * to Capacity - 1.
 	 */
 	template<typename Debug, std::size_t Capacity, typename IxTy = std::size_t>
 	class Cursors
@@ -91,6 +97,18 @@ namespace ds::ring_buffer
 			return empty;
 		}
 
+		/**
+		 * Returns the number of elements in the ring.
+		 */
+		Ix size()
+		{
+			if (is_empty())
+			{
+				return 0;
+			}
+			return static_cast<Ix>((head + Capacity - tail) % Capacity) + 1;
+		}
+
 		/**
 		 * Try to retrieve the head index; returns true if available and
 		 * false otherwise.
@@ -131,6 +149,23 @@ namespace ds::ring_buffer
 			head = advance(head);
 		}
 
+		/**
+		 * Discard the `count` elements starting at the head.
+		 *
+		 * Do not call this with a `count` greater than size().
+		 */
+		void head_advance(Ix count)
+		{
+			Ix available = size();
+			Assert<>(count <= available,
+			         "Cannot advance head past the tail of ring buffer!");
+			if ((count != 0) && (count == available))
+			{
+				empty = true;
+			}
+			head = static_cast<Ix>((head + Capacity - count) % Capacity);
+		}
+
 		/**
 		 * Try to retrieve the index of the tail, if nonempty.
 		 */
@@ -176,5 +211,22 @@ namespace ds::ring_buffer
 			tail  = advance(tail);
 			empty = false;
 		}
+
+		/**
+		 * Make the next `count` elements available.
+		 *
+		 * Do not call this with a `count` greater than Capacity - size().
+		 */
+		void tail_advance(Ix count)
+		{
+			Assert<>(count <= Capacity - size(),
+			         "Cannot advance tail of ring buffer past the head!");
+			if (count == 0)
+			{
+				return;
+			}
+			tail  = static_cast<Ix>((tail + Capacity - count) % Capacity);
+			empty = false;
+		}
 	};
 } // namespace ds::ring_buffer
@@ -20,6 +20,7 @@
 #include <timeout.h>
 
 struct EventGroup;
+struct EventWaiterSource;
 struct SObjStruct;
 
 /**
@@ -62,6 +63,31 @@ int __cheri_libcall eventgroup_wait(Timeout           *timeout,
                                     _Bool              waitForAll,
                                     _Bool              clearOnExit);
 
+/**
+ * Check for events in an event group without blocking, for callers that wait
+ * with a multiwaiter rather than `eventgroup_wait`.  The arguments other than
+ * `source` have the same meaning as for `eventgroup_wait` and `timeout`
+ * bounds only the time taken to acquire the group's lock.
+ *
+ * If the condition holds, this returns zero (clearing the bits if
+ * `clearOnExit` is set).  Otherwise it returns `-EWOULDBLOCK` and initialises
+ * `source` as a futex event that fires when one of the bits in `bitsWanted`
+ * may have been set, after which the caller should call this again.  Unlike
+ * `eventgroup_wait`, this does not use the calling thread's waiter slot, so
+ * any number of callers on one thread can wait on the same group.
+ *
+ * Returns `-ETIMEDOUT` if the lock could not be acquired or `-ERANGE` if
+ * `bitsWanted` has bits set outside the low 24.  In all cases, `outBits`
+ * contains the bits that were set when this returned.
+ */
+int __cheri_libcall eventgroup_poll(Timeout                  *timeout,
+                                    struct EventGroup        *group,
+                                    uint32_t                 *outBits,
+                                    uint32_t                  bitsWanted,
+                                    _Bool                     waitForAll,
+                                    _Bool                     clearOnExit,
+                                    struct EventWaiterSource *source);
+
 /**
  * Set one or more bits in an event group.  The `bitsToSet` argument contains
  * the bits to set.  Any thread waiting with `eventgroup_wait` will be woken if
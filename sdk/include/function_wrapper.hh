@@ -1,6 +1,10 @@
 #include <cdefs.h>
 #include <functional>
+#include <new>
+#include <stddef.h>
 #include <tuple>
+#include <type_traits>
+#include <utility>
 
 /**
  * Base template for `FunctionWrapper`, never used.
@@ -107,3 +111,174 @@ class FunctionWrapper<R(Args...)>
 		return stored_function()(std::forward<Args>(args)...);
 	}
 };
+
+/**
+ * Base template for `InlineFunction`, never used.
+ */
+template<typename FnType, size_t Capacity = 2 * sizeof(void *)>
+class InlineFunction;
+
+/**
+ * An owning type-erased callable object that stores the callable inline, in
+ * `Capacity` bytes.  This is for callables that must outlive the call that
+ * creates them (for example, callbacks that are registered and invoked
+ * later), where `FunctionWrapper` cannot be used.
+ *
+ * Unlike `std::function`, this never allocates memory: constructing one from
+ * a callable that does not fit in `Capacity` bytes is a compile-time error.
+ * Use `can_store` to check whether a callable fits.
+ *
+ * Instances can be moved but not copied.  A default-constructed or moved-from
+ * instance is empty and must not be invoked.
+ */
+template<class R, class... Args, size_t Capacity>
+class InlineFunction<R(Args...), Capacity>
+{
+	/**
+	 * Storage for the callable object.
+	 */
+	alignas(void *) char storage[Capacity];
+
+	/**
+	 * Function that invokes the stored callable, or null if this is empty.
+	 */
+	R (*invoke)(void *, Args...) = nullptr;
+
+	/**
+	 * Function that destroys the stored callable in `from`, after moving it
+	 * to `to` if `to` is not null.
+	 */
+	void (*manage)(void *from, void *to) = nullptr;
+
+	/**
+	 * Invoke the callable of type `T` in `stored`.
+	 */
+	template<typename T>
+	static R invoke_stored(void *stored, Args... args)
+	{
+		return (*static_cast<T *>(stored))(std::forward<Args>(args)...);
+	}
+
+	/**
+	 * Move (if `to` is not null) and destroy the callable of type `T` in
+	 * `from`.
+	 */
+	template<typename T>
+	static void manage_stored(void *from, void *to)
+	{
+		T *fn = static_cast<T *>(from);
+		if (to != nullptr)
+		{
+			new (to) T(std::move(*fn));
+		}
+		fn->~T();
+	}
+
+	/**
+	 * Take the callable from `other`, leaving it empty.  This must be empty.
+	 */
+	void take(InlineFunction &other)
+	{
+		if (other.manage != nullptr)
+		{
+			other.manage(other.storage, storage);
+		}
+		invoke       = other.invoke;
+		manage       = other.manage;
+		other.invoke = nullptr;
+		other.manage = nullptr;
+	}
+
+	public:
+	/**
+	 * True if a callable of type `T` fits in this.
+	 */
+	template<typename T>
+	static constexpr bool can_store =
+	  (sizeof(std::remove_cvref_t<T>) <= Capacity) &&
+	  (alignof(std::remove_cvref_t<T>) <= alignof(void *));
+
+	/**
+	 * Construct an empty function.
+	 */
+	InlineFunction() = default;
+
+	/**
+	 * Construct a function that holds a copy of (or, if it is an rvalue,
+	 * takes) `fn`.
+	 */
+	template<typename T>
+	requires(!std::is_same_v<std::remove_cvref_t<T>, InlineFunction> &&
+	         std::is_invocable_r_v<R, std::remove_cvref_t<T> &, Args...>)
+	InlineFunction(T &&fn)
+	{
+		using Stored = std::remove_cvref_t<T>;
+		static_assert(can_store<Stored>,
+		              "Callable object does not fit in this InlineFunction");
+		new (storage) Stored(std::forward<T>(fn));
+		invoke = &invoke_stored<Stored>;
+		manage = &manage_stored<Stored>;
+	}
+
+	InlineFunction(const InlineFunction &)            = delete;
+	InlineFunction &operator=(const InlineFunction &) = delete;
+
+	/**
+	 * Move constructor, leaves `other` empty.
+	 */
+	InlineFunction(InlineFunction &&other)
+	{
+		take(other);
+	}
+
+	/**
+	 * Move assignment, destroys the current callable and leaves `other`
+	 * empty.
+	 */
+	InlineFunction &operator=(InlineFunction &&other)
+	{
+		if (this != &other)
+		{
+			reset();
+			take(other);
+		}
+		return *this;
+	}
+
+	/**
+	 * Destroy the stored callable.
+	 */
+	~InlineFunction()
+	{
+		reset();
+	}
+
+	/**
+	 * Destroy the stored callable, leaving this empty.
+	 */
+	void reset()
+	{
+		if (manage != nullptr)
+		{
+			manage(storage, nullptr);
+		}
+		invoke = nullptr;
+		manage = nullptr;
+	}
+
+	/**
+	 * Returns true if this holds a callable.
+	 */
+	explicit operator bool() const
+	{
+		return invoke != nullptr;
+	}
+
+	/**
+	 * Invoke the stored callable.
+	 */
+	__always_inline R operator()(Args... args)
+	{
+		return invoke(storage, std::forward<Args>(args)...);
+	}
+};
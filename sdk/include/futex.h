@@ -3,6 +3,8 @@
 
 #pragma once
 #include <cdefs.h>
+#include <compartment-macros.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <timeout.h>
 
@@ -72,3 +74,74 @@ __always_inline static int futex_wait(const uint32_t *address,
  */
 [[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
   futex_wake(uint32_t *address, uint32_t count);
+
+/**
+ * Wake up to `wakeCount` threads that are sleeping with `futex[_timed]_wait`
+ * on `address` and move up to `requeueCount` of the remaining ones so that
+ * they are instead waiting on `target`, without waking them, if `target`
+ * contains `expected`.  Requeued threads keep their timeouts and are woken by
+ * a later `futex_wake` on `target`, at which point their wait call returns as
+ * if woken on `address`.
+ *
+ * This is intended for condition variables, barriers, and similar primitives
+ * that hand their waiters over to a lock: a thread that will reacquire a lock
+ * as soon as it is woken can wait on the lock instead, so that a broadcast
+ * does not wake every waiter only for all but one of them to block on the
+ * lock again.  The comparison with `expected` happens atomically with the
+ * wake and requeue, so the caller can check that the lock is still held (and
+ * will wake its waiters when released).
+ *
+ * Threads waiting with priority inheritance remain priority inheriting when
+ * requeued.  They stop boosting the owner of `address` and instead boost the
+ * thread whose ID is in the low 16 bits of `expected`, as if they had called
+ * `futex_timed_wait` on `target` with the `FutexPriorityInheritance` flag.
+ * Threads waiting on `address` with a multiwaiter may be woken but are not
+ * requeued.
+ *
+ * Both addresses must permit storing four bytes of data after the address.
+ *
+ * Returns the total number of threads that were woken or requeued, `-EAGAIN`
+ * if `target` does not contain `expected`, or `-EINVAL` for invalid
+ * arguments.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  futex_requeue(uint32_t *address,
+                uint32_t *target,
+                uint32_t  expected,
+                uint32_t  wakeCount,
+                uint32_t  requeueCount);
+
+/**
+ * The number of buckets in the scheduler's summary of futex waiters.
+ */
+#define FUTEX_WAITER_SUMMARY_BUCKETS 64
+
+/**
+ * Returns the index in the scheduler's futex waiter summary of the bucket for
+ * the futex at `address`.  Futex words are 4-byte aligned, so the low bits
+ * carry no information.
+ */
+__always_inline static size_t futex_waiter_summary_bucket(ptraddr_t address)
+{
+	return (((uint32_t)address >> 2) * 0x9e3779b1U) >> (32 - 6);
+}
+
+/**
+ * Returns false if no thread can be waiting for a `futex_wake` on `address`
+ * and so a wake call can be skipped.  Returns true if a thread may be waiting.
+ *
+ * The scheduler counts the threads waiting on futexes (including through a
+ * multiwaiter) in a small table indexed by
+ * `futex_waiter_summary_bucket`, which it shares read-only with every
+ * compartment.  A thread is counted from the moment it checks the futex word
+ * until it resumes after waking, so a false result is reliable if the caller
+ * modified the futex word before the call.  Unrelated futexes may share a
+ * bucket, so a true result may be a false positive.
+ */
+__always_inline static _Bool futex_may_have_waiters(const uint32_t *address)
+{
+	const volatile uint8_t *summary = SHARED_OBJECT_WITH_PERMISSIONS(
+	  volatile uint8_t, scheduler_futex_waiters, true, false, false, false);
+	return summary[futex_waiter_summary_bucket(
+	         __builtin_cheri_address_get(address))] != 0;
+}
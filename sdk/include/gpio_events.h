@@ -0,0 +1,78 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <multiwaiter.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * Debounced GPIO input events.
+ *
+ * The `gpio_events` compartment owns the GPIO input register and turns
+ * changes on input pins into per-pin edge counts, from a driver thread that
+ * the firmware must provide, with the entry point `gpio_events_run`.  Each
+ * edge count is a futex word, so any number of threads can wait for edges on
+ * any pins (directly or with a multiwaiter) without polling the GPIO
+ * themselves.
+ *
+ * A pin's level is accepted as changed only once the raw input has differed
+ * from the accepted level for `--gpio-events-debounce-samples` consecutive
+ * samples.  Every accepted change (rising or falling) increments the pin's
+ * edge count; `gpio_events_state` gives the levels.
+ *
+ * If the board raises an interrupt on GPIO edges, define
+ * `CHERIOT_GPIO_EVENTS_INTERRUPT` to its name and the driver sleeps until
+ * the interrupt fires, sampling once per tick only while a change is being
+ * debounced.  Otherwise (as on the Sonata and Arty A7 boards, whose GPIO
+ * blocks have no interrupts), the driver samples once per tick.  This is a
+ * single thread in place of one polling thread per consumer.
+ *
+ * The pins that are monitored are those in `CHERIOT_GPIO_EVENTS_PIN_MASK`,
+ * which defaults to the joystick and switches on Sonata and the buttons and
+ * switches on Arty A7.
+ */
+
+/**
+ * The number of GPIO input pins that can be monitored.
+ */
+#define GPIO_EVENTS_PIN_COUNT 32
+
+/**
+ * Returns the debounced level of every monitored pin, as a bitmap.
+ */
+uint32_t __cheri_compartment("gpio_events") gpio_events_state(void);
+
+/**
+ * Returns the number of debounced edges that have been seen on `pin`, or 0
+ * if `pin` is not monitored.  The count wraps.
+ */
+uint32_t __cheri_compartment("gpio_events") gpio_events_edges(uint32_t pin);
+
+/**
+ * Wait until the edge count for `pin` is not `edges` (the value returned by
+ * an earlier call to `gpio_events_edges`), or until `timeout` expires.
+ *
+ * Returns 0 if the count has changed, `-ETIMEDOUT` if the timeout expired,
+ * or `-EINVAL` if `pin` is not monitored or `timeout` is not valid.
+ */
+int __cheri_compartment("gpio_events")
+  gpio_events_wait(Timeout *timeout, uint32_t pin, uint32_t edges);
+
+/**
+ * Initialise an event waiter source so that it fires when the edge count for
+ * `pin` is not `edges`.
+ *
+ * Returns 0 on success or `-EINVAL` if `source` is not writable or `pin` is
+ * not monitored.
+ */
+int __cheri_compartment("gpio_events")
+  multiwaiter_gpio_events_init(struct EventWaiterSource *source,
+                               uint32_t                  pin,
+                               uint32_t                  edges);
+
+/**
+ * Entry point for the GPIO event driver thread.  This never returns.
+ */
+void __cheri_compartment("gpio_events") gpio_events_run(void);
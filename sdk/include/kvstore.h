@@ -0,0 +1,75 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * Log-structured key-value store on SPI flash.
+ *
+ * The `kvstore` compartment keeps its records in `--kvstore-sectors` flash
+ * sectors (by default the last sectors of the flash, or from the offset
+ * `CHERIOT_KVSTORE_FLASH_BASE` if it is defined), accessed through the
+ * `spi_flash` compartment.  Setting or deleting a key appends a record to
+ * the log, so no update erases or rewrites existing data.  Each record
+ * carries a CRC-32, so a record torn by a reset is ignored.
+ *
+ * An in-RAM hash index maps each of up to `--kvstore-max-keys` keys to its
+ * newest record.  It is built by a single scan of the log on first use, after
+ * which a lookup reads only the record that it finds.
+ *
+ * When few erased sectors remain, the oldest sector is compacted on the
+ * thread pool: its records that are still current are appended to the log
+ * and the sector is erased.  The firmware must therefore run thread pool
+ * workers.  If a write finds no room before the background compaction has
+ * run, it compacts the oldest sector itself.
+ *
+ * Keys are arbitrary byte strings of 1 to `KVSTORE_MAX_KEY_LENGTH` bytes.
+ */
+
+/// The maximum length of a key, in bytes.
+#define KVSTORE_MAX_KEY_LENGTH 32
+
+/// The maximum length of a value, in bytes.
+#define KVSTORE_MAX_VALUE_LENGTH 1024
+
+/**
+ * Copy up to `length` bytes of the value for `key` into `value`.
+ *
+ * Returns the length of the value (which may be more than `length`, in which
+ * case the value was truncated), `-ENOENT` if the key is not in the store,
+ * `-EINVAL` if an argument is not valid, `-ENODEV` if the flash is missing or
+ * too small, or `-ETIMEDOUT` if `timeout` expires.
+ */
+ssize_t __cheri_compartment("kvstore") kvstore_get(Timeout    *timeout,
+                                                   const void *key,
+                                                   size_t      keyLength,
+                                                   void       *value,
+                                                   size_t      length);
+
+/**
+ * Set the value for `key` to the `length` bytes at `value`.  The record has
+ * been programmed into the flash when this returns successfully.
+ *
+ * Returns 0 on success, `-ENOSPC` if the store already holds the maximum
+ * number of keys or its sectors are full of current records, or one of the
+ * errors from `kvstore_get`.  If this fails after starting to write, the new
+ * value may or may not be present after the next reset.
+ */
+int __cheri_compartment("kvstore") kvstore_set(Timeout    *timeout,
+                                               const void *key,
+                                               size_t      keyLength,
+                                               const void *value,
+                                               size_t      length);
+
+/**
+ * Remove `key` from the store.
+ *
+ * Returns 0 on success, `-ENOENT` if the key is not in the store, or one of
+ * the errors from `kvstore_set`.
+ */
+int __cheri_compartment("kvstore")
+  kvstore_delete(Timeout *timeout, const void *key, size_t keyLength);
@@ -0,0 +1,74 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * Batched updates of Sonata's PWM outputs and RGB LEDs.
+ *
+ * The `led_frame` compartment owns the PWM and RGB LED controllers.  Callers
+ * describe the state of every output in a `struct LedFrame` and submit it
+ * with a single compartment call.  A driver thread, which the firmware must
+ * provide with the entry point `led_frame_run`, applies the most recently
+ * submitted frame at the start of the next scheduler tick, writing all of
+ * the registers back to back.
+ *
+ * Submitted frames are double buffered: `led_frame_submit` copies the frame
+ * into a pending buffer and the driver copies that out before touching the
+ * hardware, so a frame is never applied half-written.  If several frames are
+ * submitted in one tick, only the last is applied.
+ */
+
+/**
+ * The number of general-purpose PWM outputs in a frame.
+ */
+#define LED_FRAME_PWM_COUNT 6
+
+/**
+ * The number of RGB LEDs in a frame.
+ */
+#define LED_FRAME_RGB_COUNT 2
+
+/**
+ * The state of every output.  PWM periods and duty cycles are in the units
+ * used by `SonataPulseWidthModulation::Output::output_set`.
+ */
+struct LedFrame
+{
+	/// The period of each general-purpose PWM output.
+	uint8_t pwmPeriod[LED_FRAME_PWM_COUNT];
+	/// The duty cycle of each general-purpose PWM output.
+	uint8_t pwmDutyCycle[LED_FRAME_PWM_COUNT];
+	/// The period of the LCD backlight PWM output.
+	uint8_t backlightPeriod;
+	/// The duty cycle of the LCD backlight PWM output.
+	uint8_t backlightDutyCycle;
+	/// The red, green, and blue values of each RGB LED.
+	uint8_t rgb[LED_FRAME_RGB_COUNT][3];
+};
+
+/**
+ * Submit a frame to be applied at the next tick, replacing any frame that
+ * has been submitted but not yet applied.
+ *
+ * Returns 0 on success, `-EINVAL` if either argument is not valid, or
+ * `-ETIMEDOUT` if the pending buffer could not be locked before `timeout`
+ * expired.
+ */
+int __cheri_compartment("led_frame")
+  led_frame_submit(Timeout *timeout, const struct LedFrame *frame);
+
+/**
+ * Returns the number of frames that have been applied.  This can be used to
+ * pace an animation to the rate at which frames are applied.
+ */
+uint32_t __cheri_compartment("led_frame") led_frame_applied(void);
+
+/**
+ * Entry point for the driver thread that applies frames.  This never
+ * returns.
+ */
+void __cheri_compartment("led_frame") led_frame_run(void);
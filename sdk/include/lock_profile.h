@@ -0,0 +1,113 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment-macros.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Lock contention profiling.
+ *
+ * When the firmware is built with `--lock-profiling-entries=N` (for non-zero
+ * `N`), the locks library records statistics for up to `N` locks in a shared
+ * object called `lock_profile`.  Every lock built on a flag lock is covered:
+ * flag locks (priority-inheriting or not), recursive mutexes, and the writer
+ * side of reader-writer locks.  A lock is registered by its address the first
+ * time that it is acquired.  Once the table is full, further locks are not
+ * recorded.
+ *
+ * Each entry is updated by the thread that has just acquired its lock, so the
+ * lock itself serialises updates.  Readers may see an entry partially updated.
+ */
+
+/**
+ * Statistics for one lock.
+ */
+struct LockProfileEntry
+{
+	/// The total number of cycles that threads have waited for the lock.
+	uint64_t totalWaitCycles;
+	/// The address of the lock's futex word, or 0 if this entry is unused.
+	uint32_t lock;
+	/// The number of times that the lock has been acquired.
+	uint32_t acquisitions;
+	/// The number of acquisitions that found the lock held.
+	uint32_t contendedAcquisitions;
+	/// The longest time, in cycles, that a thread has waited for the lock.
+	uint32_t maxWaitCycles;
+	/**
+	 * The ID of the thread that held the lock at the start of the longest
+	 * wait.
+	 */
+	uint16_t maxWaitHolder;
+	/// Padding.
+	uint16_t reserved;
+};
+
+_Static_assert(sizeof(struct LockProfileEntry) == 32,
+               "The lock_profile shared object size in sdk/xmake.lua assumes "
+               "32-byte entries");
+
+/**
+ * Returns a pointer to the lock profile entries.  This may be used only in
+ * firmware built with lock profiling enabled.  The number of entries is the
+ * length of the returned capability divided by the size of an entry.
+ */
+#define LOCK_PROFILE()                                                         \
+	((const struct LockProfileEntry *)SHARED_OBJECT_WITH_PERMISSIONS(          \
+	  struct LockProfileEntry, lock_profile, true, false, false, false))
+
+#ifdef __cplusplus
+/**
+ * Print the statistics of the `count` locks with the longest total wait time
+ * (the worst offenders for lock convoys), worst first, with the `log` method
+ * of `Debug` (an instantiation of `ConditionalDebug`).
+ */
+template<typename Debug>
+void lock_profile_dump(size_t count = 8)
+{
+	const LockProfileEntry *entries = LOCK_PROFILE();
+	size_t entryCount = __builtin_cheri_length_get(entries) / sizeof(*entries);
+	// Select the entries in decreasing order of total wait time without
+	// sorting (which would need a copy): each pass finds the largest entry
+	// that sorts after the previous one.
+	uint64_t lastWait  = UINT64_MAX;
+	size_t   lastIndex = 0;
+	for (size_t printed = 0; printed < count; printed++)
+	{
+		size_t best = entryCount;
+		for (size_t i = 0; i < entryCount; i++)
+		{
+			uint64_t wait = entries[i].totalWaitCycles;
+			if ((entries[i].lock == 0) ||
+			    (printed > 0 &&
+			     ((wait > lastWait) || ((wait == lastWait) && (i <= lastIndex)))))
+			{
+				continue;
+			}
+			if ((best == entryCount) ||
+			    (wait > entries[best].totalWaitCycles))
+			{
+				best = i;
+			}
+		}
+		if (best == entryCount)
+		{
+			break;
+		}
+		const LockProfileEntry &entry = entries[best];
+		Debug::log("lock {}: {} acquisitions, {} contended, {} cycles waiting, "
+		           "longest wait {} cycles while held by thread {}",
+		           entry.lock,
+		           entry.acquisitions,
+		           entry.contendedAcquisitions,
+		           entry.totalWaitCycles,
+		           entry.maxWaitCycles,
+		           static_cast<uint32_t>(entry.maxWaitHolder));
+		lastWait  = entry.totalWaitCycles;
+		lastIndex = best;
+	}
+}
+#endif
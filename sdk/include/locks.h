@@ -52,6 +52,39 @@ struct RecursiveMutexState
 	uint16_t depth __if_cxx(= 0);
 };
 
+/**
+ * State for a reader-writer lock.  Any number of readers may hold the lock at
+ * the same time, or a single writer.
+ */
+struct ReaderWriterLockState
+{
+	/**
+	 * Flag lock held by a writer for the whole time that it is waiting for,
+	 * or holds, the lock.  Readers that find a writer active or waiting block
+	 * on this lock, so a priority-inheriting reader-writer lock lends their
+	 * priority to the writer.
+	 */
+	struct FlagLockState writer;
+	/**
+	 * The number of readers that hold the lock in the low 31 bits.  The high
+	 * bit is set while a writer holds this lock or is waiting for readers to
+	 * release it.
+	 */
+	_Atomic(uint32_t) readers __if_cxx(= 0);
+};
+
+/**
+ * State for a condition variable.
+ */
+struct ConditionVariableState
+{
+	/**
+	 * Sequence number, incremented by each notify.  Waiters sleep on this
+	 * futex word until it changes.
+	 */
+	_Atomic(uint32_t) sequence __if_cxx(= 0);
+};
+
 /**
  * State for a counting semaphore.
  */
@@ -68,6 +101,38 @@ struct CountingSemaphoreState
 	uint32_t maxCount;
 };
 
+/**
+ * State for a countdown latch.  A latch is initialised with a count and
+ * releases all of its waiters, once, when the count reaches zero.
+ */
+struct LatchState
+{
+	/**
+	 * The number of count-down operations still needed.  Waiters sleep on
+	 * this futex word until it reaches zero.
+	 */
+	_Atomic(uint32_t) count;
+};
+
+/**
+ * State for a reusable barrier.  Each generation completes when `parties`
+ * threads have arrived, which releases all of them and starts the next
+ * generation.
+ */
+struct BarrierState
+{
+	/**
+	 * The generation in the high 16 bits and the number of threads that have
+	 * arrived in this generation in the low 16 bits.  Waiters sleep on this
+	 * futex word until the generation changes.
+	 */
+	_Atomic(uint32_t) state __if_cxx(= 0);
+	/**
+	 * The number of threads that must arrive to complete a generation.
+	 */
+	uint16_t parties;
+};
+
 __BEGIN_DECLS
 
 /**
@@ -80,6 +145,31 @@ __BEGIN_DECLS
 int __cheri_libcall flaglock_trylock(Timeout              *timeout,
                                      struct FlagLockState *lock);
 
+/**
+ * Default number of cycles for which `FlagLockAdaptive` spins on a contended
+ * lock before sleeping.
+ */
+#define FlagLockDefaultSpinCycles 200
+
+/**
+ * Try to lock a flag lock, as with `flaglock_trylock`, but if the lock is
+ * held, first poll it for up to `spinCycles` cycles (measured with the cycle
+ * counter, without yielding) before sleeping on the futex.  This avoids the
+ * cost of sleeping and being woken when the critical section is short and
+ * the owner may release the lock while this thread spins.
+ *
+ * On a single-core system, the owner can run only if the spinning thread is
+ * preempted, so the spin budget should be small relative to the cost of
+ * sleeping and being woken.  A lock may be acquired with both this function
+ * and `flaglock_trylock`.
+ *
+ * Returns 0 on success, -ETIMEDOUT if the timeout expired, -EINVAL if the
+ * arguments are invalid, or -ENOENT if the lock is set in destruction mode.
+ */
+int __cheri_libcall flaglock_adaptive_trylock(Timeout              *timeout,
+                                              struct FlagLockState *lock,
+                                              uint32_t spinCycles);
+
 /**
  * Try to lock a flag lock.  This is the priority-inheriting version.  Some
  * other platforms refer to this as a priority-inheriting mutex or simply a
@@ -196,6 +286,132 @@ int __cheri_libcall recursivemutex_trylock(Timeout                    *timeout,
  */
 int __cheri_libcall recursivemutex_unlock(struct RecursiveMutexState *mutex);
 
+/**
+ * Try to acquire a reader-writer lock for reading.  Multiple readers may hold
+ * the lock at once.  Writers are preferred: if a writer holds the lock or is
+ * waiting to acquire it, this blocks until that writer has released it, even
+ * if other readers hold the lock.
+ *
+ * Returns 0 on success, -ETIMEDOUT if the timeout expired, -EOVERFLOW if the
+ * number of readers would overflow the reader count, or -ENOENT if the lock
+ * is set in destruction mode.
+ */
+int __cheri_libcall rwlock_read_trylock(Timeout                      *timeout,
+                                        struct ReaderWriterLockState *lock);
+
+/**
+ * Try to acquire a reader-writer lock for reading, as with
+ * `rwlock_read_trylock`.  A reader that blocks because a writer holds the
+ * lock lends its priority to that writer until the writer releases the lock.
+ * A lock must be acquired with either the priority-inheriting or the
+ * non-priority-inheriting functions, not a mixture.
+ */
+int __cheri_libcall
+rwlock_priority_inheriting_read_trylock(Timeout                      *timeout,
+                                        struct ReaderWriterLockState *lock);
+
+/**
+ * Release a reader-writer lock held for reading.
+ */
+void __cheri_libcall rwlock_read_unlock(struct ReaderWriterLockState *lock);
+
+/**
+ * Try to acquire a reader-writer lock for writing.  This first excludes other
+ * writers and new readers and then waits for existing readers to release the
+ * lock.  If the timeout expires while waiting for readers, blocked readers
+ * are allowed to proceed again.
+ *
+ * Returns 0 on success, -ETIMEDOUT if the timeout expired, or -ENOENT if the
+ * lock is set in destruction mode.
+ */
+int __cheri_libcall rwlock_write_trylock(Timeout                      *timeout,
+                                         struct ReaderWriterLockState *lock);
+
+/**
+ * Try to acquire a reader-writer lock for writing, as with
+ * `rwlock_write_trylock`.  Readers and writers that block on the lock while
+ * it is held by a writer lend their priority to the writer.  A writer
+ * waiting for existing readers to release the lock does not lend its
+ * priority to them.
+ */
+int __cheri_libcall
+rwlock_priority_inheriting_write_trylock(Timeout                      *timeout,
+                                         struct ReaderWriterLockState *lock);
+
+/**
+ * Release a reader-writer lock held for writing.  This can be called with
+ * either form of reader-writer lock.
+ */
+void __cheri_libcall rwlock_write_unlock(struct ReaderWriterLockState *lock);
+
+/**
+ * Set a reader-writer lock in destruction mode.  Threads blocked on the lock,
+ * and any that later try to acquire it, fail with -ENOENT, unless they are
+ * readers that do not have to wait for a writer.  See
+ * `flaglock_upgrade_for_destruction`.
+ */
+void __cheri_libcall
+rwlock_upgrade_for_destruction(struct ReaderWriterLockState *lock);
+
+/**
+ * Wait on a condition variable.  The caller must hold `lock`, a
+ * non-priority-inheriting flag lock, which is released while waiting and
+ * reacquired before this returns, whether or not the wait succeeded.  The
+ * lock is reacquired without a time limit, because the caller expects to hold
+ * it on return.
+ *
+ * As with other condition variables, wakes may be spurious and callers should
+ * recheck their condition after this returns.
+ *
+ * Returns 0 if woken, -ETIMEDOUT if the timeout expired, -EINVAL if the
+ * arguments are invalid, or -ENOENT if the lock was set in destruction mode
+ * while waiting (in which case it is not held on return).
+ */
+int __cheri_libcall condvar_wait(Timeout                       *timeout,
+                                 struct ConditionVariableState *condition,
+                                 struct FlagLockState          *lock);
+
+/**
+ * Wait on a condition variable, as with `condvar_wait`, releasing and
+ * reacquiring a priority-inheriting flag lock.
+ */
+int __cheri_libcall
+condvar_priority_inheriting_wait(Timeout                       *timeout,
+                                 struct ConditionVariableState *condition,
+                                 struct FlagLockState          *lock);
+
+/**
+ * Wait on a condition variable, as with `condvar_wait`, releasing and
+ * reacquiring a recursive mutex.  The mutex is released completely while
+ * waiting, however many times the caller has acquired it, and is reacquired
+ * to the same depth.
+ */
+int __cheri_libcall
+condvar_recursivemutex_wait(Timeout                       *timeout,
+                            struct ConditionVariableState *condition,
+                            struct RecursiveMutexState    *mutex);
+
+/**
+ * Wake one thread waiting on a condition variable.
+ *
+ * `lock` is the lock that waiters release while waiting (for a recursive
+ * mutex, its `lock` field) or null.  If it is not null and is held, the
+ * waiter is moved to wait on the lock rather than woken, so that it is woken
+ * only when the lock is released.  Notifying with the lock held therefore
+ * avoids waking a thread that would immediately block on the lock.
+ */
+void __cheri_libcall condvar_notify_one(struct ConditionVariableState *condition,
+                                        struct FlagLockState          *lock);
+
+/**
+ * Wake all threads waiting on a condition variable.  See `condvar_notify_one`
+ * for the meaning of `lock`.  If the lock is held, all waiters are moved to
+ * wait on it and are woken when it is released, rather than all being woken
+ * at once to contend for it.
+ */
+void __cheri_libcall condvar_notify_all(struct ConditionVariableState *condition,
+                                        struct FlagLockState          *lock);
+
 /**
  * Acquire a ticket lock.  Ticket locks, by design, cannot support a try-lock
  * operation and so will block forever until the lock is acquired.
@@ -220,4 +436,31 @@ int __cheri_libcall semaphore_get(Timeout                       *timeout,
  */
 int __cheri_libcall semaphore_put(struct CountingSemaphoreState *semaphore);
 
+/**
+ * Decrement a latch's count by `count`.  If this makes the count zero, all
+ * waiters are woken with a single futex wake.  Returns 0 on success or
+ * -EINVAL if `count` is larger than the remaining count.
+ */
+int __cheri_libcall latch_count_down(struct LatchState *latch, uint32_t count);
+
+/**
+ * Wait for a latch's count to reach zero.  Returns 0 once it has, or
+ * -ETIMEDOUT if the timeout expired first.  Can also return -EINVAL if the
+ * arguments are invalid.
+ */
+int __cheri_libcall latch_wait(Timeout *timeout, struct LatchState *latch);
+
+/**
+ * Arrive at a barrier and wait for the other parties in this generation.
+ * The last thread to arrive wakes all of the others with a single futex wake
+ * and returns without blocking.
+ *
+ * Returns 1 in the thread that completed the generation, 0 in the others,
+ * -ETIMEDOUT if the timeout expired first (in which case this thread's
+ * arrival is withdrawn), or -EINVAL if the arguments are invalid or more
+ * threads have arrived than the barrier has parties.
+ */
+int __cheri_libcall barrier_arrive_and_wait(Timeout             *timeout,
+                                            struct BarrierState *barrier);
+
 __END_DECLS
@@ -6,7 +6,9 @@
 #include <errno.h>
 #include <futex.h>
 #include <locks.h>
+#include <string.h>
 #include <thread.h>
+#include <type_traits>
 
 static constexpr bool DebugLocks =
 #ifdef DEBUG_LOCKS
@@ -35,11 +37,16 @@ __clang_ignored_warning_push("-Watomic-alignment");
  * consider an using a lock manager compartment with an API that returns a
  * single-use capability to unlock on any lock call.
  */
+class ConditionVariable;
+
 template<bool IsPriorityInherited>
 class FlagLockGeneric
 {
 	FlagLockState state;
 
+	/// Condition variables need access to the lock state.
+	friend class ConditionVariable;
+
 	public:
 	/**
 	 * Attempt to acquire the lock, blocking until a timeout specified by the
@@ -108,6 +115,194 @@ class FlagLockGeneric
 	}
 };
 
+/**
+ * A flag lock that spins for up to `SpinCycles` cycles on contention before
+ * sleeping.  See `flaglock_adaptive_trylock` for when this is useful.  This
+ * is not priority inheriting.
+ */
+template<uint32_t SpinCycles = FlagLockDefaultSpinCycles>
+class FlagLockAdaptiveGeneric
+{
+	FlagLockState state;
+
+	public:
+	/**
+	 * Attempt to acquire the lock, blocking until a timeout specified by the
+	 * `timeout` parameter has expired.
+	 */
+	__always_inline bool try_lock(Timeout *timeout)
+	{
+		return flaglock_adaptive_trylock(timeout, &state, SpinCycles) == 0;
+	}
+
+	/**
+	 * Try to acquire the lock, do not block.  This does not spin.
+	 */
+	__always_inline bool try_lock()
+	{
+		Timeout t{0};
+		return try_lock(&t);
+	}
+
+	/**
+	 * Acquire the lock, potentially blocking forever.
+	 */
+	__always_inline void lock()
+	{
+		Timeout t{UnlimitedTimeout};
+		try_lock(&t);
+	}
+
+	/**
+	 * Release the lock.
+	 *
+	 * Note: This does not check that the lock is owned by the calling thread.
+	 */
+	__always_inline void unlock()
+	{
+		flaglock_unlock(&state);
+	}
+
+	/**
+	 * Set the lock in destruction mode. See the documentation of
+	 * `flaglock_upgrade_for_destruction` for more information.
+	 */
+	__always_inline void upgrade_for_destruction()
+	{
+		flaglock_upgrade_for_destruction(&state);
+	}
+};
+
+/**
+ * A flag lock using the immediate priority ceiling protocol.  The lock is
+ * constructed with a ceiling priority, which must be at least the priority of
+ * any thread that acquires it.  Acquiring the lock raises the caller's base
+ * priority to the ceiling before taking the lock and releasing it restores
+ * the previous base priority, so a holder cannot be preempted by any other
+ * thread that uses the lock.  A thread that wants the lock therefore waits
+ * for at most one critical section of a lower-priority thread, with no
+ * chained blocking and no priority inheritance on contention.
+ *
+ * Each acquire and release costs one scheduler call to change priority.  By
+ * default this is `thread_priority_set`, which cannot raise a thread above
+ * the priority in its thread description, so acquiring fails for threads
+ * whose configured priority is below the ceiling.  Construct the lock with a
+ * thread priority capability (see `DEFINE_THREAD_PRIORITY_CAPABILITY`) to
+ * use `thread_priority_set_for` instead.
+ *
+ * A holder must not block waiting for anything other than the lock itself
+ * while holding it, and nested ceiling locks must be released in the reverse
+ * order of acquisition.
+ */
+class FlagLockPriorityCeiling
+{
+	/// The underlying lock, taken once the priority has been raised.
+	FlagLockGeneric<false> flagLock;
+
+	/// The priority that holders run at.
+	const uint8_t ceiling;
+
+	/// The holder's base priority before it acquired the lock.
+	uint8_t savedPriority = 0;
+
+	/// Optional capability that authorises raising the priority.
+	struct SObjStruct *const priorityCapability;
+
+	/**
+	 * Set the calling thread's base priority.  Returns the previous base
+	 * priority or a negative error code.
+	 */
+	int priority_set(uint8_t priority)
+	{
+		if (priorityCapability != nullptr)
+		{
+			return thread_priority_set_for(
+			  priorityCapability, thread_id_get(), priority);
+		}
+		return thread_priority_set(priority);
+	}
+
+	public:
+	/**
+	 * Construct a lock with the ceiling priority `ceiling`.  If
+	 * `capability` is not null, it is used to raise priorities.
+	 */
+	FlagLockPriorityCeiling(uint8_t            ceiling,
+	                        struct SObjStruct *capability = nullptr)
+	  : ceiling(ceiling), priorityCapability(capability)
+	{
+	}
+
+	/**
+	 * Attempt to acquire the lock, blocking until a timeout specified by the
+	 * `timeout` parameter has expired.  Fails without waiting if the caller's
+	 * priority cannot be raised to the ceiling.
+	 */
+	bool try_lock(Timeout *timeout)
+	{
+		int previous = priority_set(ceiling);
+		if (previous < 0)
+		{
+			LockDebug::log("Failed to raise priority to ceiling {}: {}",
+			               ceiling,
+			               previous);
+			return false;
+		}
+		LockDebug::Assert(previous <= ceiling,
+		                  "Thread with priority {} above ceiling {} acquired a "
+		                  "priority-ceiling lock",
+		                  previous,
+		                  ceiling);
+		if (!flagLock.try_lock(timeout))
+		{
+			priority_set(previous);
+			return false;
+		}
+		savedPriority = previous;
+		return true;
+	}
+
+	/**
+	 * Try to acquire the lock, do not block.
+	 */
+	__always_inline bool try_lock()
+	{
+		Timeout t{0};
+		return try_lock(&t);
+	}
+
+	/**
+	 * Acquire the lock, potentially blocking forever.
+	 */
+	__always_inline void lock()
+	{
+		Timeout t{UnlimitedTimeout};
+		try_lock(&t);
+	}
+
+	/**
+	 * Release the lock and restore the priority that the caller had before
+	 * acquiring it.
+	 *
+	 * Note: This does not check that the lock is owned by the calling thread.
+	 */
+	void unlock()
+	{
+		uint8_t previous = savedPriority;
+		flagLock.unlock();
+		priority_set(previous);
+	}
+
+	/**
+	 * Set the lock in destruction mode. See the documentation of
+	 * `flaglock_upgrade_for_destruction` for more information.
+	 */
+	__always_inline void upgrade_for_destruction()
+	{
+		flagLock.upgrade_for_destruction();
+	}
+};
+
 /**
  * Priority-inheriting recursive mutex.  This can be acquired multiple times
  * from the same thread.
@@ -117,6 +312,9 @@ class RecursiveMutex
 	/// State for the underling recursive mutex.
 	RecursiveMutexState state;
 
+	/// Condition variables need access to the lock state.
+	friend class ConditionVariable;
+
 	public:
 	/**
 	 * Attempt to acquire the lock, blocking until a timeout specified by the
@@ -165,6 +363,126 @@ class RecursiveMutex
 	}
 };
 
+/**
+ * A condition variable, for use with `FlagLock`, `FlagLockPriorityInherited`
+ * or `RecursiveMutex`.
+ *
+ * Notifications made while holding the lock move waiters onto the lock's
+ * futex instead of waking them, so they are woken when the notifier releases
+ * the lock rather than waking only to block on it again.
+ */
+class ConditionVariable
+{
+	ConditionVariableState state;
+
+	/**
+	 * Returns the flag lock state that waiters release for `lock`.
+	 */
+	template<bool IsPriorityInherited>
+	static FlagLockState *flag_lock(FlagLockGeneric<IsPriorityInherited> &lock)
+	{
+		return &lock.state;
+	}
+
+	/**
+	 * Returns the flag lock state that waiters release for `mutex`.
+	 */
+	static FlagLockState *flag_lock(RecursiveMutex &mutex)
+	{
+		return &mutex.state.lock;
+	}
+
+	public:
+	/**
+	 * Release `lock`, which must be held, wait until notified or until the
+	 * timeout expires, and reacquire `lock`.  See `condvar_wait` for details.
+	 *
+	 * Returns 0 if woken, -ETIMEDOUT if the timeout expired, or -ENOENT if
+	 * the lock was set in destruction mode while waiting (in which case it is
+	 * not held on return).
+	 */
+	__always_inline int wait(Timeout *timeout, FlagLockGeneric<false> &lock)
+	{
+		return condvar_wait(timeout, &state, flag_lock(lock));
+	}
+
+	/**
+	 * Wait, releasing and reacquiring a priority-inheriting flag lock.
+	 */
+	__always_inline int wait(Timeout *timeout, FlagLockGeneric<true> &lock)
+	{
+		return condvar_priority_inheriting_wait(
+		  timeout, &state, flag_lock(lock));
+	}
+
+	/**
+	 * Wait, releasing and reacquiring a recursive mutex.
+	 */
+	__always_inline int wait(Timeout *timeout, RecursiveMutex &mutex)
+	{
+		return condvar_recursivemutex_wait(timeout, &state, &mutex.state);
+	}
+
+	/**
+	 * Wait until `predicate` returns true, or the timeout expires.
+	 * `predicate` is called with the lock held.  Returns the last value of
+	 * `predicate`.
+	 */
+	template<typename Lock>
+	bool wait(Timeout *timeout, Lock &lock, auto &&predicate)
+	{
+		while (!predicate())
+		{
+			int ret = wait(timeout, lock);
+			if (ret == -ETIMEDOUT)
+			{
+				return predicate();
+			}
+			if (ret != 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/**
+	 * Wake one waiter.  If `lock` (the lock that waiters use) is held by the
+	 * caller then the waiter will be woken when it is released.
+	 */
+	template<typename Lock>
+	__always_inline void notify_one(Lock &lock)
+	{
+		condvar_notify_one(&state, flag_lock(lock));
+	}
+
+	/**
+	 * Wake one waiter, without requeueing it onto a lock.
+	 */
+	__always_inline void notify_one()
+	{
+		condvar_notify_one(&state, nullptr);
+	}
+
+	/**
+	 * Wake all waiters.  If `lock` (the lock that waiters use) is held by the
+	 * caller then the waiters will be woken when it is released.
+	 */
+	template<typename Lock>
+	__always_inline void notify_all(Lock &lock)
+	{
+		condvar_notify_all(&state, flag_lock(lock));
+	}
+
+	/**
+	 * Wake all waiters, without requeueing them onto a lock.
+	 */
+	__always_inline void notify_all()
+	{
+		condvar_notify_all(&state, nullptr);
+	}
+};
+
 /**
  * A simple ticket lock.
  *
@@ -196,6 +514,361 @@ class TicketLock
 	}
 };
 
+/**
+ * A reader-writer lock.  Any number of threads may hold the lock for reading
+ * (shared), or a single thread for writing (exclusive).  Writers are
+ * preferred: once a writer is waiting, new readers block until it has
+ * acquired and released the lock.  If `IsPriorityInherited` is set, readers
+ * and writers that block on a writer lend it their priority.
+ *
+ * The exclusive operations follow the same naming as other locks, so this can
+ * be used with `LockGuard` for writers.  The shared operations follow the
+ * naming of `std::shared_mutex` and can be used with `SharedLockGuard` for
+ * readers.
+ */
+template<bool IsPriorityInherited>
+class ReaderWriterLockGeneric
+{
+	ReaderWriterLockState state;
+
+	public:
+	/**
+	 * Attempt to acquire the lock for writing, blocking until a timeout
+	 * specified by the `timeout` parameter has expired.
+	 */
+	__always_inline bool try_lock(Timeout *timeout)
+	{
+		if constexpr (IsPriorityInherited)
+		{
+			return rwlock_priority_inheriting_write_trylock(timeout, &state) ==
+			       0;
+		}
+		else
+		{
+			return rwlock_write_trylock(timeout, &state) == 0;
+		}
+	}
+
+	/**
+	 * Try to acquire the lock for writing, do not block.
+	 */
+	__always_inline bool try_lock()
+	{
+		Timeout t{0};
+		return try_lock(&t);
+	}
+
+	/**
+	 * Acquire the lock for writing, potentially blocking forever.
+	 */
+	__always_inline void lock()
+	{
+		Timeout t{UnlimitedTimeout};
+		try_lock(&t);
+	}
+
+	/**
+	 * Release the lock held for writing.
+	 *
+	 * Note: This does not check that the lock is owned by the calling thread.
+	 */
+	__always_inline void unlock()
+	{
+		rwlock_write_unlock(&state);
+	}
+
+	/**
+	 * Attempt to acquire the lock for reading, blocking until a timeout
+	 * specified by the `timeout` parameter has expired.
+	 */
+	__always_inline bool try_lock_shared(Timeout *timeout)
+	{
+		if constexpr (IsPriorityInherited)
+		{
+			return rwlock_priority_inheriting_read_trylock(timeout, &state) ==
+			       0;
+		}
+		else
+		{
+			return rwlock_read_trylock(timeout, &state) == 0;
+		}
+	}
+
+	/**
+	 * Try to acquire the lock for reading, do not block.
+	 */
+	__always_inline bool try_lock_shared()
+	{
+		Timeout t{0};
+		return try_lock_shared(&t);
+	}
+
+	/**
+	 * Acquire the lock for reading, potentially blocking forever.
+	 */
+	__always_inline void lock_shared()
+	{
+		Timeout t{UnlimitedTimeout};
+		try_lock_shared(&t);
+	}
+
+	/**
+	 * Release the lock held for reading.
+	 */
+	__always_inline void unlock_shared()
+	{
+		rwlock_read_unlock(&state);
+	}
+
+	/**
+	 * Set the lock in destruction mode. See the documentation of
+	 * `rwlock_upgrade_for_destruction` for more information.
+	 */
+	__always_inline void upgrade_for_destruction()
+	{
+		rwlock_upgrade_for_destruction(&state);
+	}
+};
+
+/**
+ * A countdown latch.  Threads wait until the count, set on construction,
+ * has been counted down to zero.  All waiters are woken together.
+ *
+ * Unlike a barrier, a latch cannot be reused.  It is useful for fork-join
+ * code, where the joining thread creates a latch with one count per task and
+ * each task counts it down.
+ */
+class Latch
+{
+	LatchState state;
+
+	public:
+	/// Construct a latch that is released after `count` count-downs.
+	Latch(uint32_t count) : state{count} {}
+
+	/**
+	 * Decrement the count by `count`, releasing waiters if it reaches zero.
+	 * Returns false if that is more than the remaining count.
+	 */
+	__always_inline bool count_down(uint32_t count = 1)
+	{
+		return latch_count_down(&state, count) == 0;
+	}
+
+	/// Returns true if the count has reached zero.
+	__always_inline bool try_wait()
+	{
+		return state.count.load() == 0;
+	}
+
+	/**
+	 * Wait for the count to reach zero, or for the timeout to expire.
+	 * Returns true if the count reached zero.
+	 */
+	__always_inline bool wait(Timeout *timeout)
+	{
+		return latch_wait(timeout, &state) == 0;
+	}
+
+	/// Wait, potentially forever, for the count to reach zero.
+	__always_inline void wait()
+	{
+		Timeout t{UnlimitedTimeout};
+		wait(&t);
+	}
+
+	/**
+	 * Count down by one and wait for the count to reach zero, or for the
+	 * timeout to expire.  Returns true if the count reached zero.
+	 */
+	__always_inline bool arrive_and_wait(Timeout *timeout)
+	{
+		return count_down() && wait(timeout);
+	}
+};
+
+/**
+ * A reusable barrier for a fixed number of threads.  Each thread that calls
+ * `arrive_and_wait` blocks until all of the parties have arrived, at which
+ * point they are all woken together and the barrier is ready for the next
+ * phase.
+ */
+class Barrier
+{
+	BarrierState state;
+
+	public:
+	/// Construct a barrier for `parties` threads.
+	Barrier(uint16_t parties) : state{0, parties} {}
+
+	/**
+	 * Arrive and wait for the other parties, or for the timeout to expire.
+	 * Returns 1 in the thread that completed the phase, 0 in the others, or
+	 * a negative error code (see `barrier_arrive_and_wait`).
+	 */
+	__always_inline int arrive_and_wait(Timeout *timeout)
+	{
+		return barrier_arrive_and_wait(timeout, &state);
+	}
+
+	/// Arrive and wait, potentially forever, for the other parties.
+	__always_inline int arrive_and_wait()
+	{
+		Timeout t{UnlimitedTimeout};
+		return arrive_and_wait(&t);
+	}
+};
+
+/**
+ * A sequence lock, for publishing a value of type `T` from a single writer to
+ * any number of readers without locking on the read path.
+ *
+ * The writer makes the sequence number odd, updates the value, and then
+ * makes the sequence number even again.  A reader copies the value between
+ * two reads of the sequence number and retries if the number was odd or
+ * changed.  Readers never store to the lock, so they can use a read-only
+ * capability, for example to a shared object that only the writer imports
+ * with store permission:
+ *
+ * ```c++
+ * using Snapshot = SeqLock<SensorReadings>;
+ * // Writer:
+ * SHARED_OBJECT_WITH_PERMISSIONS(Snapshot, sensors, true, true, false, false)
+ *   ->write(readings);
+ * // Reader:
+ * const Snapshot *snapshot = SHARED_OBJECT_WITH_PERMISSIONS(
+ *   Snapshot, sensors, true, false, false, false);
+ * SensorReadings readings = snapshot->read();
+ * ```
+ *
+ * The shared object must be `sizeof(SeqLock<T>)` bytes.  `T` must be
+ * trivially copyable.  The value is copied a word at a time (or a byte at a
+ * time, if `T` is not a whole number of aligned words) with atomic loads and
+ * stores, so torn copies are detected rather than undefined.
+ *
+ * Only one thread may write at a time.  Firmware with more than one writer
+ * must serialise them with another lock.  A malicious reader cannot disrupt
+ * the writer or other readers, but a malicious writer can starve readers.
+ */
+template<typename T>
+class SeqLock
+{
+	static_assert(std::is_trivially_copyable_v<T>,
+	              "Sequence locks copy their value and so require trivially "
+	              "copyable types");
+
+	/// True if the value can be copied a word at a time.
+	static constexpr bool CopyWords =
+	  ((sizeof(T) % sizeof(uint32_t)) == 0) && (alignof(T) >= sizeof(uint32_t));
+
+	/// The word or byte type used to copy the value.
+	using Unit = std::conditional_t<CopyWords, uint32_t, uint8_t>;
+
+	/// The number of units in the value.
+	static constexpr size_t Units = sizeof(T) / sizeof(Unit);
+
+	/// The sequence number, odd while the writer is updating the value.
+	std::atomic<uint32_t> sequence = 0;
+
+	/// The value.
+	union
+	{
+		T    value;
+		Unit units[Units];
+	};
+
+	public:
+	/// Construct a lock holding a value-initialised `T`.
+	SeqLock() : value{} {}
+
+	/**
+	 * Try once to read the value into `out`.  Returns false, leaving `out`
+	 * holding a possibly torn copy, if the writer was updating the value.
+	 */
+	bool try_read(T &out) const
+	{
+		uint32_t before = sequence.load(std::memory_order_acquire);
+		if ((before & 1) != 0)
+		{
+			return false;
+		}
+		Unit copy[Units];
+		for (size_t i = 0; i < Units; i++)
+		{
+			copy[i] = __atomic_load_n(&units[i], __ATOMIC_RELAXED);
+		}
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (sequence.load(std::memory_order_relaxed) != before)
+		{
+			return false;
+		}
+		memcpy(&out, copy, sizeof(T));
+		return true;
+	}
+
+	/**
+	 * Returns a consistent copy of the value, retrying until the writer is
+	 * not updating it.  The writer may be preempted mid-update by a
+	 * higher-priority reader, so a reader that sees an update in progress
+	 * sleeps for a tick to let the writer finish, rather than spinning.
+	 */
+	T read() const
+	{
+		T out;
+		while (!try_read(out))
+		{
+			if ((sequence.load(std::memory_order_relaxed) & 1) != 0)
+			{
+				Timeout t{1};
+				thread_sleep(&t);
+			}
+		}
+		return out;
+	}
+
+	/**
+	 * Returns the sequence number.  This changes by two on each completed
+	 * write, so readers can compare it with a previous value to see whether
+	 * there is new data without copying the value.
+	 */
+	uint32_t version() const
+	{
+		return sequence.load(std::memory_order_acquire) & ~uint32_t(1);
+	}
+
+	/**
+	 * Update the value in place with `fn`, which is passed a copy of the
+	 * current value to modify.
+	 */
+	template<typename Fn>
+	void update(Fn &&fn)
+	{
+		T newValue;
+		memcpy(&newValue, &value, sizeof(T));
+		fn(newValue);
+		write(newValue);
+	}
+
+	/**
+	 * Replace the value.  Only one thread may call this at a time.
+	 */
+	void write(const T &newValue)
+	{
+		Unit source[Units];
+		memcpy(source, &newValue, sizeof(T));
+		// There is only one writer, so the sequence number does not need an
+		// atomic read-modify-write.
+		uint32_t before = sequence.load(std::memory_order_relaxed);
+		sequence.store(before + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t i = 0; i < Units; i++)
+		{
+			__atomic_store_n(&units[i], source[i], __ATOMIC_RELAXED);
+		}
+		sequence.store(before + 2, std::memory_order_release);
+	}
+};
+
 /**
  * Class that implements the locking concept but does not perform locking.
  * This is intended to be used with templated data structures that support
@@ -231,8 +904,11 @@ class NoLock
 	void unlock() {}
 };
 
-using FlagLock                  = FlagLockGeneric<false>;
-using FlagLockPriorityInherited = FlagLockGeneric<true>;
+using FlagLock                          = FlagLockGeneric<false>;
+using FlagLockPriorityInherited         = FlagLockGeneric<true>;
+using FlagLockAdaptive                  = FlagLockAdaptiveGeneric<>;
+using ReaderWriterLock                  = ReaderWriterLockGeneric<false>;
+using ReaderWriterLockPriorityInherited = ReaderWriterLockGeneric<true>;
 
 template<typename T>
 concept Lockable = requires(T l)
@@ -252,7 +928,29 @@ concept TryLockable = Lockable<T> && requires(T l, Timeout *t)
 static_assert(TryLockable<NoLock>);
 static_assert(TryLockable<FlagLock>);
 static_assert(TryLockable<FlagLockPriorityInherited>);
+static_assert(TryLockable<FlagLockAdaptive>);
+static_assert(TryLockable<FlagLockPriorityCeiling>);
 static_assert(Lockable<TicketLock>);
+static_assert(TryLockable<ReaderWriterLock>);
+static_assert(TryLockable<ReaderWriterLockPriorityInherited>);
+
+template<typename T>
+concept SharedLockable = requires(T l)
+{
+	{l.lock_shared()};
+	{l.unlock_shared()};
+};
+
+template<typename T>
+concept SharedTryLockable = SharedLockable<T> && requires(T l, Timeout *t)
+{
+	{
+		l.try_lock_shared(t)
+		} -> std::same_as<bool>;
+};
+
+static_assert(SharedTryLockable<ReaderWriterLock>);
+static_assert(SharedTryLockable<ReaderWriterLockPriorityInherited>);
 
 /**
  * A simple RAII type that owns a lock.
@@ -365,4 +1063,96 @@ class LockGuard
 	}
 };
 
+/**
+ * A simple RAII type that holds a lock for reading.  This is the shared
+ * analogue of `LockGuard`.
+ */
+template<typename Lock>
+requires SharedLockable<Lock>
+class SharedLockGuard
+{
+	/// A reference to the managed lock
+	Lock *wrappedLock;
+
+	/// Flag indicating whether the lock is owned.
+	bool isOwned;
+
+	public:
+	/// Constructor, acquires the lock.
+	[[nodiscard]] explicit SharedLockGuard(Lock &lock)
+	  : wrappedLock(&lock), isOwned(true)
+	{
+		wrappedLock->lock_shared();
+	}
+
+	/// Constructor, attempts to acquire the lock with a timeout.
+	[[nodiscard]] explicit SharedLockGuard(Lock    &lock,
+	                                       Timeout *timeout) requires(
+	  SharedTryLockable<Lock>)
+	  : wrappedLock(&lock), isOwned(false)
+	{
+		try_lock(timeout);
+	}
+
+	/// Move constructor, transfers ownership of the lock.
+	[[nodiscard]] explicit SharedLockGuard(SharedLockGuard &&guard)
+	  : wrappedLock(guard.wrappedLock), isOwned(guard.isOwned)
+	{
+		guard.wrappedLock = nullptr;
+		guard.isOwned     = false;
+	}
+
+	/**
+	 * Explicitly lock the wrapped lock for reading. Must be called with the
+	 * lock not held by this wrapper.
+	 */
+	void lock()
+	{
+		LockDebug::Assert(!isOwned, "Trying to lock an already-locked lock");
+		wrappedLock->lock_shared();
+		isOwned = true;
+	}
+
+	/**
+	 * Explicitly unlock the wrapped lock. Must be called with the lock held
+	 * by this wrapper.
+	 */
+	void unlock()
+	{
+		LockDebug::Assert(isOwned, "Trying to unlock an unlocked lock");
+		wrappedLock->unlock_shared();
+		isOwned = false;
+	}
+
+	/**
+	 * Try to lock the wrapped lock for reading with the specified timeout.
+	 * This must be called with the lock not held by this wrapper.  Returns
+	 * true if the lock has been acquired, false otherwise.
+	 */
+	bool try_lock(Timeout *timeout) requires(SharedTryLockable<Lock>)
+	{
+		LockDebug::Assert(!isOwned, "Trying to lock an already-locked lock");
+		isOwned = wrappedLock->try_lock_shared(timeout);
+		return isOwned;
+	}
+
+	/// Destructor, releases the lock.
+	~SharedLockGuard()
+	{
+		if (isOwned)
+		{
+			wrappedLock->unlock_shared();
+		}
+	}
+
+	/**
+	 * Conversion to bool.  Returns true if this guard holds the lock, false
+	 * otherwise.  See `LockGuard`.
+	 */
+	operator bool()
+	{
+		return isOwned;
+	}
+};
+
 __clang_ignored_warning_pop();
@@ -0,0 +1,92 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <microvium/microvium.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Dedicated memory arenas for Microvium VMs.
+ *
+ * By default, a VM allocates its heap from the system heap, using the
+ * allocator capability passed as the context argument to `mvm_restore`.  A VM
+ * can instead be given an arena: a fixed buffer owned by the calling
+ * compartment, which bounds the VM's memory use and keeps its allocations out
+ * of the shared heap, so restarting a VM does not fragment the shared heap.
+ * To use an arena, create it with `microvium_arena_create` and pass the result
+ * as the context argument to `mvm_restore`.
+ *
+ * An arena must be used by only one VM at a time, and like the VM it is not
+ * safe to use from more than one thread at a time.
+ */
+
+/**
+ * Statistics for an arena and for the garbage collections of the VM that
+ * uses it.  All sizes are in bytes.
+ */
+struct MicroviumArenaStatistics
+{
+	/// The number of bytes available for allocations, including headers.
+	size_t capacity;
+	/// The number of bytes currently allocated, including headers.
+	size_t used;
+	/// The largest value of `used` since the arena was created or reset.
+	size_t peakUsed;
+	/// The number of successful allocations.
+	uint32_t allocations;
+	/// The number of allocations that failed for lack of space.
+	uint32_t failedAllocations;
+	/// The number of frees.
+	uint32_t frees;
+	/// The number of garbage collections run with `microvium_collect`.
+	uint32_t collections;
+	/// The total virtual heap space reclaimed by those collections.
+	size_t bytesReclaimed;
+	/// The virtual heap in use after the most recent collection.
+	size_t liveAfterLastCollection;
+};
+
+/**
+ * Opaque arena state, stored at the start of the arena's buffer.
+ */
+struct MicroviumArena;
+
+__BEGIN_DECLS
+
+/**
+ * Create an arena in the `size` bytes at `buffer`.  The arena's state is
+ * stored at the start of the buffer and the rest is used for allocations.
+ *
+ * Returns null if `buffer` is not a valid, writable capability to at least
+ * `size` bytes, or if `size` is too small to hold any allocation.
+ */
+struct MicroviumArena *__cheri_libcall microvium_arena_create(void  *buffer,
+                                                              size_t size);
+
+/**
+ * Discard every allocation in `arena` and reset its statistics.  This must
+ * be called only after the VM that used the arena has been freed with
+ * `mvm_free`, and is cheaper than freeing each allocation, so a VM can be
+ * restarted in the same arena without fragmentation.
+ */
+void __cheri_libcall microvium_arena_reset(struct MicroviumArena *arena);
+
+/**
+ * Copy the statistics for the arena used by `vm` into `*statistics`.
+ *
+ * Returns 0 on success, or `-EINVAL` if `vm` does not use an arena.
+ */
+int __cheri_libcall
+microvium_statistics(mvm_VM *vm, struct MicroviumArenaStatistics *statistics);
+
+/**
+ * Run the garbage collector for `vm` (see `mvm_runGC`) and, if it uses an
+ * arena, record the collection in the arena's statistics.
+ *
+ * Returns the number of bytes of virtual heap reclaimed.
+ */
+size_t __cheri_libcall microvium_collect(mvm_VM *vm, bool squeeze);
+
+__END_DECLS
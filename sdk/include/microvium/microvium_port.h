@@ -16,9 +16,11 @@ fixes and improvement from the original github or npm repository.
 #pragma once
 
 #include <assert.h>
+#include <cdefs.h>
 #include <cheri-builtins.h>
 #include <compartment.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -144,6 +146,12 @@ fixes and improvement from the original github or npm repository.
  *
  * Microvium doesn't access data through pointers of this type directly -- it
  * does so through macro operations in this port file.
+ *
+ * On CHERIoT, long pointers are capabilities.  The snapshot passed to
+ * `mvm_restore` is read in place through them and only its initial heap and
+ * globals are copied, so the snapshot may be in read-only memory (for example,
+ * a `const` array, which is stored with the compartment's code rather than its
+ * globals) and must remain valid for as long as the VM exists.
  */
 #define MVM_LONG_PTR_TYPE void *
 
@@ -294,23 +302,31 @@ static uint16_t crc16(MVM_LONG_PTR_TYPE lp, uint16_t size)
  * must always be within 64kB of MVM_RAM_PAGE_ADDR.
  *
  * The `context` passed to these macros is whatever value that the host passes
- * to `mvm_restore`. It can be any value that fits in a pointer.
+ * to `mvm_restore`.  This is either an allocator capability, in which case
+ * memory comes from the shared heap (with the allocator capability's quota),
+ * or an arena created with `microvium_arena_create` (see
+ * `microvium_arena.h`), in which case memory comes from that arena.
  *
- * Similarly to `malloc` and `calloc`, this will only ever
- * block to wait for the quarantine to be processed.
+ * Similarly to `malloc` and `calloc`, allocation from the shared heap will
+ * only ever block to wait for the quarantine to be processed.
  */
 #define MVM_CONTEXTUAL_MALLOC(size, context)                                   \
-	({                                                                         \
-		Timeout t = {0, MALLOC_WAIT_TICKS};                                    \
-		void   *ret =                                                          \
-		  heap_allocate(&t, context, size, AllocateWaitRevocationNeeded);      \
-		if (!__builtin_cheri_tag_get(ret))                                     \
-		{                                                                      \
-			ret = NULL;                                                        \
-		}                                                                      \
-		ret;                                                                   \
-	})
-#define MVM_CONTEXTUAL_FREE(ptr, context) heap_free(context, ptr)
+	microvium_context_allocate(size, context)
+#define MVM_CONTEXTUAL_FREE(ptr, context) microvium_context_free(ptr, context)
+
+__BEGIN_DECLS
+/**
+ * Allocate `size` bytes for the VM whose context is `context`.  Returns null
+ * on failure.  Implemented in the Microvium library.
+ */
+void *microvium_context_allocate(size_t size, void *context);
+
+/**
+ * Free memory allocated with `microvium_context_allocate`.  Implemented in
+ * the Microvium library.
+ */
+void microvium_context_free(void *ptr, void *context);
+__END_DECLS
 
 /**
  * Expose the timeout APIs.
@@ -28,6 +28,27 @@
  * size have been the key optimisation goals for this design.  Unlike systems
  * such as `kqueue`, scalability has not been a priority in this design because
  * expected number of waited objects is small and so is the number of threads.
+ *
+ * For a thread that repeatedly waits on the same set of events, passing the
+ * set to every `multiwaiter_wait` call costs a copy and a check of every event
+ * per wait.  Such threads can instead register the set once with
+ * `multiwaiter_register` and then call `multiwaiter_wait_registered`, which
+ * returns a bitmap of the events that fired without rescanning the set.
+ * Registered events are recorded even when no thread is waiting, so each
+ * registration adds a small cost to every wake until it is removed.
+ *
+ * Futex events are level-triggered by default: each wait fires immediately if
+ * the futex word differs from the value passed with the event, so a loop that
+ * passes the same value while the word stays changed wakes on every wait.
+ * Edge-triggered futex events (`EventWaiterFutexEdgeTriggered`) instead fire
+ * once for each change: after an event has been reported, later waits that
+ * pass the same futex in the same position fire only if the word changes
+ * again or the futex is woken.  Registered events are always edge-triggered.
+ *
+ * Registered events can also be given their own timeouts, with
+ * `multiwaiter_registered_timeout_set`, so that an event loop can time out a
+ * single request without tracking the time itself while the other events
+ * stay armed.
  */
 #include <compartment.h>
 #include <stdlib.h>
@@ -41,7 +62,15 @@ enum EventWaiterKind
 	/// Event source is an event channel.
 	EventWaiterEventChannel,
 	/// Event source is a futex.
-	EventWaiterFutex
+	EventWaiterFutex,
+	/**
+	 * Event source is a futex and the event is edge-triggered.  The first
+	 * wait behaves as for `EventWaiterFutex`.  In later waits in which the
+	 * same futex is at the same index, `value` is ignored and the event fires
+	 * only if the futex word has changed since the event was last armed or
+	 * reported, or if the futex is woken during the wait.
+	 */
+	EventWaiterFutexEdgeTriggered
 };
 
 enum [[clang::flag_enum]] EventWaiterEventChannelFlags{
@@ -123,3 +152,70 @@ struct MultiWaiter;
                    struct MultiWaiter       *waiter,
                    struct EventWaiterSource *events,
                    size_t                    newEventsCount);
+
+/**
+ * Register a persistent set of `eventsCount` events with a multiwaiter,
+ * replacing any existing registration.  Registering zero events removes the
+ * registration.
+ *
+ * A registered event fires if its futex word does not match the value at the
+ * time of registration, or whenever the futex is subsequently woken.  Events
+ * that fire are remembered until they are collected by
+ * `multiwaiter_wait_registered`, so none are lost between waits.  The
+ * `events` array is not retained and may be reused once this returns.
+ *
+ * A multiwaiter with a registration may not be used with `multiwaiter_wait`.
+ *
+ * Return values:
+ *
+ *  - On success, this function returns 0.
+ *  - If the arguments are invalid, or there are more events than the
+ *    multiwaiter has space for, this function returns -EINVAL.  Any previous
+ *    registration has been removed in this case.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  multiwaiter_register(struct MultiWaiter       *waiter,
+                       struct EventWaiterSource *events,
+                       size_t                    eventsCount);
+
+/**
+ * Wait for any of the events registered with `multiwaiter_register` to fire,
+ * or for any of their own timeouts to expire.  On return, `ready` holds a
+ * bitmap with bit *i* set if the event at index *i* in the registration has
+ * fired since the previous call.  If `timedOut` is not null, it holds a
+ * bitmap of the events whose timeouts (see
+ * `multiwaiter_registered_timeout_set`) have expired without them firing.
+ *
+ * Return values:
+ *
+ *  - On success, this function returns 0.
+ *  - If the arguments are invalid or the multiwaiter has no registration,
+ *    this function returns -EINVAL.
+ *  - If the timeout is reached without any events being triggered or timing
+ *    out then this returns -ETIMEDOUT.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  multiwaiter_wait_registered(Timeout            *timeout,
+                              struct MultiWaiter *waiter,
+                              uint32_t           *ready,
+                              uint32_t           *timedOut);
+
+/**
+ * Give the event at `index` in a multiwaiter's registration a timeout of
+ * `timeout` ticks from now, replacing any previous timeout for that event.
+ * If the event has not fired when the timeout expires,
+ * `multiwaiter_wait_registered` reports it as timed out, once, and the
+ * timeout is removed.  An event that fires also loses its timeout.  Passing
+ * `UnlimitedTimeout` removes the event's timeout.  Registering events removes
+ * all timeouts.
+ *
+ * Return values:
+ *
+ *  - On success, this function returns 0.
+ *  - If the multiwaiter has no registration or `index` is out of range, this
+ *    function returns -EINVAL.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  multiwaiter_registered_timeout_set(struct MultiWaiter *waiter,
+                                     size_t              index,
+                                     Ticks               timeout);
@@ -0,0 +1,162 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cdefs.h>
+#include <riscvreg.h>
+#include <stdint.h>
+
+/**
+ * Hardware performance counters.
+ *
+ * Every core provides the cycle and retired-instruction counters.
+ * CHERIoT-Ibex also provides a fixed set of event counters in
+ * `mhpmcounter3` to `mhpmcounter12`, which are read as zero on other targets
+ * (and on Ibex configurations that do not implement them).  Ibex does not
+ * predict branches, so the nearest thing to a misprediction count is the
+ * number of taken branches, each of which flushes the fetch stage.
+ *
+ * All counters are 64 bits and count from boot.  Measure an interval by
+ * subtracting two reads of the same counter.  `perf.hh` provides a harness
+ * for running measurements and printing the results.
+ */
+
+/**
+ * The counters that `perf_counter_read` can read.
+ */
+enum PerfCounter
+#ifdef __cplusplus
+  : uint8_t
+#endif
+{
+	/**
+	 * Cycles.  On Sail, the cycle count is meaningless and this is the
+	 * number of instructions retired, so that results are still comparable
+	 * between runs.
+	 */
+	PerfCounterCycles,
+	/// Instructions retired.
+	PerfCounterInstructions,
+	/// Cycles waiting for a load or store to complete.
+	PerfCounterLoadStoreWait,
+	/// Cycles waiting for an instruction fetch.
+	PerfCounterInstructionFetchWait,
+	/// Loads retired.
+	PerfCounterLoads,
+	/// Stores retired.
+	PerfCounterStores,
+	/// Unconditional jumps retired.
+	PerfCounterJumps,
+	/// Conditional branches retired.
+	PerfCounterBranches,
+	/// Conditional branches that were taken.
+	PerfCounterBranchesTaken,
+	/// Compressed instructions retired.
+	PerfCounterCompressedInstructions,
+	/// Cycles waiting for a multiply to complete.
+	PerfCounterMultiplyWait,
+	/// Cycles waiting for a divide to complete.
+	PerfCounterDivideWait,
+	/// The number of counters.  Not a valid counter.
+	PerfCounterCount
+};
+
+/**
+ * True if this target has the event counters (every counter after
+ * `PerfCounterInstructions`).
+ */
+#ifdef IBEX
+#	define PERF_HAS_EVENT_COUNTERS 1
+#else
+#	define PERF_HAS_EVENT_COUNTERS 0
+#endif
+
+/**
+ * Read the cycle counter (see `PerfCounterCycles`).
+ */
+__always_inline static inline uint64_t perf_cycles(void)
+{
+#ifdef SAIL
+	return CSR_READ64(minstret);
+#else
+	return CSR_READ64(mcycle);
+#endif
+}
+
+/**
+ * Read the retired-instruction counter.
+ */
+__always_inline static inline uint64_t perf_instructions(void)
+{
+	return CSR_READ64(minstret);
+}
+
+/**
+ * Read `counter`.  Returns zero for counters that this target does not
+ * provide, or for an invalid counter.
+ *
+ * This is always inlined so that, for a constant `counter`, it compiles to
+ * the reads of a single CSR.
+ */
+__always_inline static inline uint64_t
+perf_counter_read(enum PerfCounter counter)
+{
+	switch (counter)
+	{
+		case PerfCounterCycles:
+			return perf_cycles();
+		case PerfCounterInstructions:
+			return perf_instructions();
+#if PERF_HAS_EVENT_COUNTERS
+		case PerfCounterLoadStoreWait:
+			return CSR_READ64(mhpmcounter3);
+		case PerfCounterInstructionFetchWait:
+			return CSR_READ64(mhpmcounter4);
+		case PerfCounterLoads:
+			return CSR_READ64(mhpmcounter5);
+		case PerfCounterStores:
+			return CSR_READ64(mhpmcounter6);
+		case PerfCounterJumps:
+			return CSR_READ64(mhpmcounter7);
+		case PerfCounterBranches:
+			return CSR_READ64(mhpmcounter8);
+		case PerfCounterBranchesTaken:
+			return CSR_READ64(mhpmcounter9);
+		case PerfCounterCompressedInstructions:
+			return CSR_READ64(mhpmcounter10);
+		case PerfCounterMultiplyWait:
+			return CSR_READ64(mhpmcounter11);
+		case PerfCounterDivideWait:
+			return CSR_READ64(mhpmcounter12);
+#endif
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Returns the name of `counter`, for reports.
+ */
+static inline const char *perf_counter_name(enum PerfCounter counter)
+{
+	static const char *const Names[] = {
+	  "cycles",
+	  "instructions",
+	  "load_store_wait",
+	  "fetch_wait",
+	  "loads",
+	  "stores",
+	  "jumps",
+	  "branches",
+	  "branches_taken",
+	  "compressed_instructions",
+	  "multiply_wait",
+	  "divide_wait",
+	};
+	if (counter >= PerfCounterCount)
+	{
+		return "invalid";
+	}
+	return Names[counter];
+}
@@ -0,0 +1,200 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <algorithm>
+#include <cdefs.h>
+#include <perf.h>
+#include <stdio.h>
+#include <type_traits>
+
+/**
+ * A minimal benchmark harness over the counters in `perf.h`.
+ *
+ * Results are printed as tab-separated tables.  Each table starts with a
+ * header line starting with `#`, and the first column of every row is the
+ * board (the `BOARD` macro, which benchmarks define from the `board` build
+ * option), so the output of runs on different boards and configurations can
+ * be concatenated and compared.
+ */
+namespace cheriot::perf
+{
+	/**
+	 * Stop the compiler from moving memory operations across this point, so
+	 * that the work being measured stays between the counter reads.
+	 */
+	__always_inline inline void barrier()
+	{
+		asm volatile("" ::: "memory");
+	}
+
+	/**
+	 * Returns the change in `counter` over one call to `fn`.
+	 */
+	template<typename Fn>
+	__always_inline inline int64_t
+	elapsed(Fn &&fn, PerfCounter counter = PerfCounterCycles)
+	{
+		uint64_t start = perf_counter_read(counter);
+		barrier();
+		fn();
+		barrier();
+		return perf_counter_read(counter) - start;
+	}
+
+	/**
+	 * Call `fn` `iterations` times back to back and return the mean change
+	 * in `counter` per call.  The counter is read only before and after the
+	 * loop, so this amortises the cost of reading it but includes the loop
+	 * overhead.
+	 */
+	template<typename Fn>
+	int64_t
+	mean(size_t iterations, Fn &&fn, PerfCounter counter = PerfCounterCycles)
+	{
+		int64_t total = elapsed(
+		  [&]() {
+			  for (size_t i = 0; i < iterations; i++)
+			  {
+				  fn();
+				  barrier();
+			  }
+		  },
+		  counter);
+		return total / static_cast<int64_t>(iterations);
+	}
+
+	/**
+	 * Summary statistics for a set of samples.
+	 */
+	struct Statistics
+	{
+		/// The number of samples.
+		uint32_t samples;
+		/// The smallest sample.
+		int64_t minimum;
+		/// The median (lower median for an even number of samples).
+		int64_t median;
+		/// The arithmetic mean, rounded towards zero.
+		int64_t mean;
+		/// The 99th percentile (nearest rank).
+		int64_t p99;
+		/// The largest sample.
+		int64_t maximum;
+	};
+
+	/**
+	 * Compute the statistics of `count` samples.  This sorts `samples`.
+	 */
+	inline Statistics statistics(int64_t *samples, size_t count)
+	{
+		if (count == 0)
+		{
+			return {};
+		}
+		std::sort(samples, samples + count);
+		int64_t total = 0;
+		for (size_t i = 0; i < count; i++)
+		{
+			total += samples[i];
+		}
+		return {static_cast<uint32_t>(count),
+		        samples[0],
+		        samples[(count - 1) / 2],
+		        total / static_cast<int64_t>(count),
+		        samples[(count * 99 + 99) / 100 - 1],
+		        samples[count - 1]};
+	}
+
+	/**
+	 * Call `fn` once to warm the caches and branch state, then `Samples`
+	 * more times, and return the statistics of the change in `counter` over
+	 * each call.  The samples are kept in a static buffer (one for each
+	 * instantiation) rather than on the stack.
+	 */
+	template<size_t Samples, typename Fn>
+	Statistics measure(Fn &&fn, PerfCounter counter = PerfCounterCycles)
+	{
+		static int64_t samples[Samples];
+		fn();
+		for (auto &sample : samples)
+		{
+			sample = elapsed(fn, counter);
+		}
+		return statistics(samples, Samples);
+	}
+
+	namespace detail
+	{
+		inline void print_field(const char *value)
+		{
+			printf("\t%s", value);
+		}
+
+		inline void print_field(int64_t value)
+		{
+			printf("\t%lld", static_cast<long long>(value));
+		}
+
+		template<typename T>
+		inline void print_field(T value)
+		    requires(std::is_integral_v<T>)
+		{
+			print_field(static_cast<int64_t>(value));
+		}
+	} // namespace detail
+
+	/**
+	 * Print the header line of a table with the given column names, after
+	 * the board column.
+	 */
+	template<typename... Columns>
+	void print_header(Columns... columns)
+	{
+		printf("#board");
+		(detail::print_field(columns), ...);
+		printf("\n");
+	}
+
+	/**
+	 * Print a row of a table.  Each value must be a string or an integer.
+	 */
+	template<typename... Values>
+	void print_row(Values... values)
+	{
+#ifdef BOARD
+		printf("%s", __XSTRING(BOARD));
+#else
+		printf("unknown");
+#endif
+		(detail::print_field(values), ...);
+		printf("\n");
+	}
+
+	/**
+	 * Print the header for rows printed by `print_statistics`, with `columns`
+	 * naming the leading (identifying) values of each row.
+	 */
+	template<typename... Columns>
+	void print_statistics_header(Columns... columns)
+	{
+		print_header(
+		  columns..., "samples", "min", "median", "mean", "p99", "max");
+	}
+
+	/**
+	 * Print `stats` as a row after the identifying `values`.
+	 */
+	template<typename... Values>
+	void print_statistics(Statistics stats, Values... values)
+	{
+		print_row(values...,
+		          stats.samples,
+		          stats.minimum,
+		          stats.median,
+		          stats.mean,
+		          stats.p99,
+		          stats.maximum);
+	}
+} // namespace cheriot::perf
@@ -0,0 +1,54 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <cdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Profile-guided optimisation.
+ *
+ * When the firmware is built with `--pgo=generate`, each compartment is
+ * compiled with `-fprofile-instr-generate`.  The compiler adds a 64-bit
+ * counter for each function entry and each branch, which the compartment's
+ * linker script collects into its globals between `__pgo_counters_start` and
+ * `__pgo_counters_end`.  There is no profiling run time: the counters are
+ * never written out automatically, so each compartment that is being profiled
+ * must print its own with `pgo_counters_dump`, for example at the end of a
+ * benchmark.  The allocator prints its counters with `heap_pgo_dump`.
+ *
+ * `scripts/pgo_profraw.py` combines the printed counters with the function
+ * descriptions in the firmware image to write a `.profraw` file, which
+ * `llvm-profdata merge` turns into the profile used by `--pgo=use`.
+ */
+
+#if defined(__cplusplus) && defined(CHERIOT_PGO_GENERATE)
+extern "C" uint64_t __pgo_counters_start[];
+extern "C" uint64_t __pgo_counters_end[];
+
+/**
+ * Print the non-zero profile counters of the calling compartment with the
+ * `log` method of `Debug` (an instantiation of `ConditionalDebug`).  Each
+ * counter is printed on one line as its address and its value, in the format
+ * that `scripts/pgo_profraw.py` reads.
+ *
+ * This may be used only in compartments built with `--pgo=generate`.
+ */
+template<typename Debug>
+void pgo_counters_dump()
+{
+	size_t count = __pgo_counters_end - __pgo_counters_start;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (uint64_t value = __pgo_counters_start[i]; value != 0)
+		{
+			Debug::log("pgo-count {} {}",
+			           static_cast<ptraddr_t>(
+			             __builtin_cheri_address_get(&__pgo_counters_start[i])),
+			           value);
+		}
+	}
+}
+#endif
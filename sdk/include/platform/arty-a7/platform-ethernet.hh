@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <debug.hh>
+#include <errno.h>
 #include <futex.h>
 #include <interrupt.h>
 #include <optional>
@@ -19,7 +20,8 @@ DECLARE_AND_DEFINE_INTERRUPT_CAPABILITY(EthernetReceive,
 /**
  * The driver for Kunyan Liu's custom Ethernet MAC for the Arty A7.  This is
  * intended to run at 10Mb/s.  It provides two send and two receive buffers in
- * shared SRAM.
+ * shared SRAM.  Frames are sent from the two send buffers alternately, so
+ * that the next frame can be written while the previous one is sent.
  *
  * WARNING: This is currently evolving and is not yet stable.
  */
@@ -310,11 +312,25 @@ class KunyanEthernet
 		Pong = 1,
 	};
 
+	/**
+	 * The size of each of the receive buffers.
+	 */
+	static constexpr uint16_t ReceiveBufferSize = 0x800;
+
+	/**
+	 * The size of each of the transmit buffers.
+	 */
+	static constexpr uint16_t TransmitBufferSize = 0x800;
+
 	bool receiveBufferInUse[2] = {false, false};
-	bool sendBufferInUse[2]    = {false, false};
 
 	BufferID nextReceiveBuffer = BufferID::Ping;
 
+	/**
+	 * The transmit buffer that the next frame will be written to.
+	 */
+	BufferID nextTransmitBuffer = BufferID::Ping;
+
 	constexpr static BufferID next_buffer_id(BufferID current)
 	{
 		return current == BufferID::Ping ? BufferID::Pong : BufferID::Ping;
@@ -394,25 +410,96 @@ class KunyanEthernet
 		auto buffer = mmio_region();
 		buffer.address() +=
 		  static_cast<size_t>(index == BufferID::Ping ? 0x2000 : 0x2800);
-		buffer.bounds() = 0x800;
+		buffer.bounds() = ReceiveBufferSize;
 		return const_cast<uint8_t *>(
 		  reinterpret_cast<volatile uint8_t *>((buffer.get())));
 	}
 
 	/**
-	 * Returns a pointer to one of the receive buffers, identified by the buffer
-	 * identifier (ping or pong).
+	 * Returns a pointer to one of the transmit buffers, identified by the
+	 * buffer identifier (ping or pong).
 	 */
 	uint8_t *transmit_buffer_pointer(BufferID index = BufferID::Ping)
 	{
 		auto buffer = mmio_region();
 		buffer.address() +=
 		  static_cast<size_t>(index == BufferID::Ping ? 0x1000 : 0x1800);
-		buffer.bounds() = 0x800;
+		buffer.bounds() = TransmitBufferSize;
 		return const_cast<uint8_t *>(
 		  reinterpret_cast<volatile uint8_t *>((buffer.get())));
 	}
 
+	/**
+	 * Returns the transmit control register for one of the transmit buffers.
+	 */
+	volatile uint32_t &transmit_control(BufferID index)
+	{
+		return index == BufferID::Ping
+		         ? mmio_register<RegisterOffset::TransmitControlPing>()
+		         : mmio_register<RegisterOffset::TransmitControlPong>();
+	}
+
+	/**
+	 * Returns the transmit frame length register for one of the transmit
+	 * buffers.
+	 */
+	volatile uint32_t &transmit_frame_length(BufferID index)
+	{
+		return index == BufferID::Ping
+		         ? mmio_register<RegisterOffset::TransmitFrameLengthPing>()
+		         : mmio_register<RegisterOffset::TransmitFrameLengthPong>();
+	}
+
+	/**
+	 * Write a frame to the next transmit buffer and start sending it.
+	 *
+	 * `fill` is called with the transmit buffer once the frame previously
+	 * sent from it has gone.  It writes the frame and returns its length, or
+	 * a negative value if the frame is invalid.  `check` is the egress hook
+	 * passed to `send_frame`.
+	 *
+	 * Returns true if the frame was queued for sending.  This does not wait
+	 * for the frame to be sent.  A failure to send is logged when the buffer
+	 * is next used.
+	 */
+	bool transmit(auto &&fill, auto &&check)
+	{
+		BufferID index           = nextTransmitBuffer;
+		auto    &transmitControl = transmit_control(index);
+		// Spin waiting for the transmit buffer to be free.
+		while (transmitControl & 1) {}
+		if ((transmitControl & 2) != 0)
+		{
+			Debug::log("Error sending frame from buffer {}", index);
+		}
+		auto transmitBuffer = transmit_buffer_pointer(index);
+		int  filled         = fill(transmitBuffer);
+		if (filled < 0)
+		{
+			return false;
+		}
+		uint16_t length = filled;
+		if (!check(transmitBuffer, length))
+		{
+			return false;
+		}
+		// The Ethernet standard requires frames to be at least 60 bytes long.
+		// If we're asked to send anything shorter, pad it with zeroes.
+		// (It would be nice if the MAC did this automatically).
+		if (length < 60)
+		{
+			memset(transmitBuffer + length, 0, 60 - length);
+			length = 60;
+		}
+		// Write the length of the frame to the transmit length register.
+		transmit_frame_length(index) = length;
+		// Start the transmit.
+		transmitControl = 1;
+		Debug::log("Queued frame in buffer {}", index);
+		nextTransmitBuffer = next_buffer_id(index);
+		return true;
+	}
+
 	/**
 	 * Write a value to a PHY register via MDIO.
 	 */
@@ -675,7 +762,13 @@ class KunyanEthernet
 		}
 	};
 
-	std::optional<BufferedFrame> receive_frame()
+	private:
+	/**
+	 * Find the next received frame.  On success, `nextReceiveBuffer` is the
+	 * buffer that holds it and the return value is its length, excluding the
+	 * FCS.
+	 */
+	std::optional<uint16_t> next_frame()
 	{
 		// To avoid processing the same packet twice, we must not use
 		// the current receive buffer if it is already in use. In that
@@ -719,9 +812,19 @@ class KunyanEthernet
 			}
 		}
 
-		auto length = *maybeLength;
 		// Strip the FCS from the length.
-		length -= 4;
+		return uint16_t(*maybeLength - 4);
+	}
+
+	public:
+	std::optional<BufferedFrame> receive_frame()
+	{
+		auto maybeLength = next_frame();
+		if (!maybeLength)
+		{
+			return std::nullopt;
+		}
+		auto                length = *maybeLength;
 		auto                buffer = receive_buffer_pointer(nextReceiveBuffer);
 		Capability<uint8_t> boundedBuffer{buffer};
 		boundedBuffer.bounds() = length;
@@ -734,59 +837,169 @@ class KunyanEthernet
 	}
 
 	/**
-	 * Send a packet.  This is synchronous and will block until the packet has
-	 * been sent.  A better version would use the next available ping or pong
-	 * buffer and return as soon as the send operation had been enqueued.
-	 *
-	 * The third argument is a callback that allows the caller to check the
-	 * frame before it's sent but after it's copied into memory that isn't
-	 * shared with other compartments.
+	 * Frames are received into buffers of this size in shared SRAM, so a
+	 * buffer this large can hold any frame.
 	 */
-	bool send_frame(const uint8_t *buffer, uint16_t length, auto &&check)
+	static constexpr uint16_t receive_buffer_size()
 	{
-		auto &transmitControl =
-		  mmio_register<RegisterOffset::TransmitControlPing>();
-		// Spin waiting for the transmit buffer to be free.
-		while (transmitControl & 1) {}
-		// Write the frame to the transmit buffer.
-		auto transmitBuffer = transmit_buffer_pointer();
-		// We must check the frame pointer and its length. Although it
-		// is supplied by the firewall which is trusted, the firewall
-		// does not check the pointer which is coming from external
-		// untrusted components.
-		Timeout t{10};
-		if ((heap_claim_fast(&t, buffer) < 0) ||
-		    (!CHERI::check_pointer<CHERI::PermissionSet{
-		       CHERI::Permission::Load}>(buffer, length)))
+		return ReceiveBufferSize;
+	}
+
+	/**
+	 * Copy the next frame into a buffer supplied by the caller and return the
+	 * device's buffer to the MAC immediately, rather than leaving it in use
+	 * until a `BufferedFrame` is destroyed.  Callers that would otherwise copy
+	 * the frame out of the `BufferedFrame` save that copy.
+	 */
+	int receive_frame_into(uint8_t *buffer, uint16_t length)
+	{
+		if (!CHERI::check_pointer<CHERI::PermissionSet{
+		      CHERI::Permission::Store}>(buffer, length))
 		{
-			return false;
+			return -EINVAL;
 		}
-		memcpy(transmitBuffer, buffer, length);
-		if (!check(transmitBuffer, length))
+		auto maybeLength = next_frame();
+		if (!maybeLength)
 		{
-			return false;
+			return 0;
 		}
-		// The Ethernet standard requires frames to be at least 60 bytes long.
-		// If we're asked to send anything shorter, pad it with zeroes.
-		// (It would be nice if the MAC did this automatically).
-		if (length < 60)
+		if (*maybeLength > length)
 		{
-			memset(transmitBuffer + length, 0, 60 - length);
-			length = 60;
+			return -ENOSPC;
 		}
-		// Write the length of the frame to the transmit length register.
-		mmio_register<RegisterOffset::TransmitFrameLengthPing>() = length;
-		// Start the transmit.
-		transmitControl = 1;
-		Debug::log("Sent frame, waiting for completion");
-		while (transmitControl & 1) {}
-		// Return if the frame was sent successfully.
-		Debug::log("Transmit control register: {}", transmitControl);
-		if ((transmitControl & 2) != 0)
+		BufferID index = nextReceiveBuffer;
+		memcpy(buffer, receive_buffer_pointer(index), *maybeLength);
+		complete_receive(index);
+		// Move on to the other buffer, as constructing a `BufferedFrame`
+		// would.
+		if (!receiveBufferInUse[next_buffer_id(index)])
+		{
+			nextReceiveBuffer = next_buffer_id(index);
+		}
+		Debug::log("Received frame from buffer {}", index);
+		return *maybeLength;
+	}
+
+	/**
+	 * Pass each frame that is ready to `handler`, oldest first, until no
+	 * frames are ready, `maxFrames` frames have been handled, or `handler`
+	 * returns false.  This drains both receive buffers after an interrupt.
+	 * Each buffer is returned to the MAC as soon as `handler` returns, so the
+	 * MAC can receive into it while later frames are handled.
+	 *
+	 * `handler` is called with a read-only, non-global capability to the
+	 * frame and its length, excluding the FCS, and must not retain the
+	 * pointer.  If it returns false then the frame stays queued and is
+	 * passed to the next call.
+	 *
+	 * Returns the number of frames handled.
+	 */
+	size_t receive_frames(auto &&handler, size_t maxFrames = SIZE_MAX)
+	{
+		size_t count = 0;
+		while (count < maxFrames)
 		{
-			Debug::log("Error sending frame");
+			auto maybeLength = next_frame();
+			if (!maybeLength)
+			{
+				break;
+			}
+			BufferID            index = nextReceiveBuffer;
+			Capability<uint8_t> buffer{receive_buffer_pointer(index)};
+			buffer.bounds() = *maybeLength;
+			buffer.permissions() &=
+			  CHERI::PermissionSet{CHERI::Permission::Load};
+			if (!handler(static_cast<const uint8_t *>(buffer.get()),
+			             *maybeLength))
+			{
+				break;
+			}
+			complete_receive(index);
+			// Move on to the other buffer, as `receive_frame_into` does.
+			if (!receiveBufferInUse[next_buffer_id(index)])
+			{
+				nextReceiveBuffer = next_buffer_id(index);
+			}
+			count++;
 		}
-		return (transmitControl & 2) == 0;
+		Debug::log("Handled {} frames", count);
+		return count;
+	}
+
+	/**
+	 * Send a packet.  This returns once the frame has been copied to a
+	 * transmit buffer and the send has started, blocking only if both
+	 * buffers are still sending earlier frames.
+	 *
+	 * The third argument is a callback that allows the caller to check the
+	 * frame before it's sent but after it's copied into memory that isn't
+	 * shared with other compartments.
+	 */
+	bool send_frame(const uint8_t *buffer, uint16_t length, auto &&check)
+	{
+		return transmit(
+		  [&](uint8_t *transmitBuffer) {
+			  // We must check the frame pointer and its length. Although it
+			  // is supplied by the firewall which is trusted, the firewall
+			  // does not check the pointer which is coming from external
+			  // untrusted components.
+			  Timeout t{10};
+			  if ((length > TransmitBufferSize) ||
+			      (heap_claim_fast(&t, buffer) < 0) ||
+			      (!CHERI::check_pointer<CHERI::PermissionSet{
+			         CHERI::Permission::Load}>(buffer, length)))
+			  {
+				  return -EINVAL;
+			  }
+			  memcpy(transmitBuffer, buffer, length);
+			  return int(length);
+		  },
+		  check);
+	}
+
+	/**
+	 * Send a frame gathered from `count` segments, for example separate
+	 * headers and payload, without the caller first copying them into one
+	 * buffer.  The segments are copied directly into a transmit buffer and
+	 * `check` is called on the complete frame, as for `send_frame`.
+	 */
+	bool send_frame_gather(const EthernetFrameSegment *segments,
+	                       size_t                      count,
+	                       auto                      &&check)
+	{
+		return transmit(
+		  [&](uint8_t *transmitBuffer) {
+			  Timeout t{10};
+			  if (!CHERI::check_pointer<CHERI::PermissionSet{
+			        CHERI::Permission::Load}>(
+			        segments, count * sizeof(EthernetFrameSegment)))
+			  {
+				  return -EINVAL;
+			  }
+			  size_t offset = 0;
+			  for (size_t i = 0; i < count; i++)
+			  {
+				  // Read each segment once, so that the caller cannot change
+				  // it between the checks and the copy.
+				  EthernetFrameSegment segment = segments[i];
+				  // Each claim replaces the previous one, which is no longer
+				  // needed once its segment has been copied.
+				  if ((segment.length > TransmitBufferSize - offset) ||
+				      (heap_claim_fast(&t, segment.buffer) < 0) ||
+				      (!CHERI::check_pointer<CHERI::PermissionSet{
+				         CHERI::Permission::Load}>(segment.buffer,
+				                                   segment.length)))
+				  {
+					  return -EINVAL;
+				  }
+				  memcpy(transmitBuffer + offset,
+				         segment.buffer,
+				         segment.length);
+				  offset += segment.length;
+			  }
+			  return int(offset);
+		  },
+		  check);
 	}
 
 	/**
@@ -817,4 +1030,6 @@ class KunyanEthernet
 
 using EthernetDevice = KunyanEthernet;
 
-static_assert(EthernetAdaptor<EthernetDevice>);
+static_assert(EthernetAdaptorReceiveInto<EthernetDevice>);
+static_assert(EthernetAdaptorSendGather<EthernetDevice>);
+static_assert(EthernetAdaptorReceiveBatch<EthernetDevice>);
@@ -0,0 +1,199 @@
+#pragma once
+#include <cheri.hh>
+#include <concepts>
+#include <cstdint>
+#include <errno.h>
+#include <span>
+#include <timeout.h>
+
+/**
+ * How a DMA transfer steps through one side of a copy.
+ */
+enum class DmaAddressing : uint8_t
+{
+	/// Advance by the element size after each element (memory buffers).
+	Increment,
+	/// Use the same address for every element (FIFO registers).
+	Fixed,
+};
+
+/**
+ * The peripheral request line value for a transfer that is not paced by a
+ * peripheral and runs as fast as the controller allows.
+ */
+static constexpr uint8_t DmaNoRequest = 0xff;
+
+/**
+ * One descriptor in a DMA chain.  The engine copies `length` bytes, in
+ * elements of `elementSize` bytes, from `source` to `destination`.  If
+ * `request` is not `DmaNoRequest`, each element waits for the peripheral
+ * request line with that (board-specific) number, so that a transfer to or
+ * from a FIFO does not overrun it.
+ */
+struct DmaTransfer
+{
+	/// The address that the first element is written to.
+	volatile void *destination;
+	/// The address that the first element is read from.
+	const volatile void *source;
+	/// The number of bytes to copy.  Must be a multiple of `elementSize`.
+	uint32_t length;
+	/// The size of each element: 1, 2, or 4 bytes.
+	uint8_t elementSize = 1;
+	/// How `destination` advances.
+	DmaAddressing destinationAddressing = DmaAddressing::Increment;
+	/// How `source` advances.
+	DmaAddressing sourceAddressing = DmaAddressing::Increment;
+	/// The request line that paces this transfer.
+	uint8_t request = DmaNoRequest;
+};
+
+/**
+ * Concept for a DMA controller.
+ *
+ * DMA controllers access memory by physical address and do not check
+ * capabilities, so the engine's `start` must check every descriptor (for
+ * example, with `dma_chain_valid`) before handing it to the hardware.  A
+ * capability check proves only that the caller could access the buffers at
+ * the time of the call: callers must also keep heap buffers alive (with
+ * `heap_claim`, not `heap_claim_fast`) until the transfer completes.
+ */
+template<typename T>
+concept DmaEngine =
+  requires(T engine, std::span<const DmaTransfer> chain, Timeout *timeout)
+{
+	/**
+	 * The maximum number of descriptors in one chain.
+	 */
+	{
+		T::MaxChainLength
+		} -> std::convertible_to<size_t>;
+
+	/**
+	 * Start the descriptors in `chain`, in order, as one operation.  Returns
+	 * 0 on success, `-EINVAL` if any descriptor is not valid or the chain is
+	 * too long (in which case nothing is started), or `-EBUSY` if the engine
+	 * is still running a previous chain.
+	 */
+	{
+		engine.start(chain)
+		} -> std::same_as<int>;
+
+	/**
+	 * Returns true while a chain that was started has not yet completed.
+	 */
+	{
+		engine.busy()
+		} -> std::convertible_to<bool>;
+
+	/**
+	 * Read the current value of the completion interrupt counter.  This is
+	 * used only with `completion_wait`, in the same way as the receive
+	 * interrupt counter of an `EthernetAdaptor`.
+	 */
+	{
+		engine.completion_value()
+		} -> std::same_as<uint32_t>;
+
+	/**
+	 * Acknowledge the completion interrupt and block until the completion
+	 * interrupt counter is no longer the value returned by an earlier call
+	 * to `completion_value`.  Returns 0 on wake or `-ETIMEDOUT`.  An engine
+	 * without a completion interrupt may instead yield and return 0.
+	 */
+	{
+		engine.completion_wait(timeout, uint32_t{})
+		} -> std::same_as<int>;
+};
+
+/**
+ * Returns true if the caller may copy `transfer.length` bytes from its
+ * source to its destination.  Incrementing sides must grant `Load` (source)
+ * or `Store` (destination) over the whole buffer.  Fixed sides must grant
+ * the same permissions over one element.
+ */
+inline bool dma_transfer_valid(const DmaTransfer &transfer)
+{
+	using namespace CHERI;
+	uint8_t size = transfer.elementSize;
+	if (((size != 1) && (size != 2) && (size != 4)) ||
+	    (transfer.length % size) != 0)
+	{
+		return false;
+	}
+	auto span = [&](DmaAddressing addressing) -> size_t {
+		return addressing == DmaAddressing::Fixed ? size : transfer.length;
+	};
+	// The checks do not access memory, so the volatile qualifiers (which
+	// are there for the MMIO sides of transfers) can be dropped.
+	auto *source      = const_cast<const void *>(transfer.source);
+	auto *destination = const_cast<void *>(transfer.destination);
+	return check_pointer<PermissionSet{Permission::Load}, false>(
+	         source, span(transfer.sourceAddressing)) &&
+	       check_pointer<PermissionSet{Permission::Store}, false>(
+	         destination, span(transfer.destinationAddressing));
+}
+
+/**
+ * Returns true if every descriptor in `chain` is valid and the chain fits in
+ * `Engine`.
+ */
+template<DmaEngine Engine>
+bool dma_chain_valid(std::span<const DmaTransfer> chain)
+{
+	if (chain.empty() || (chain.size() > Engine::MaxChainLength))
+	{
+		return false;
+	}
+	for (const auto &transfer : chain)
+	{
+		if (!dma_transfer_valid(transfer))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * Wait for the chain running on `engine` to complete, or for `timeout` to
+ * expire.  Returns 0 on completion or `-ETIMEDOUT`, in which case the chain
+ * is still running and its buffers must not yet be reused.
+ *
+ * The completion counter is read before the busy flag so that a completion
+ * between the two is not missed.
+ */
+template<DmaEngine Engine>
+int dma_wait(Engine &engine, Timeout *timeout)
+{
+	while (true)
+	{
+		uint32_t value = engine.completion_value();
+		if (!engine.busy())
+		{
+			return 0;
+		}
+		if (!timeout->may_block() ||
+		    (engine.completion_wait(timeout, value) == -ETIMEDOUT))
+		{
+			return -ETIMEDOUT;
+		}
+	}
+}
+
+/**
+ * Start `chain` on `engine` and wait for it to complete.  Returns 0 on
+ * success, or the error from `start` or `dma_wait`.
+ */
+template<DmaEngine Engine>
+int dma_run(Engine                      &engine,
+            std::span<const DmaTransfer> chain,
+            Timeout                     *timeout)
+{
+	int ret = engine.start(chain);
+	if (ret != 0)
+	{
+		return ret;
+	}
+	return dma_wait(engine, timeout);
+}
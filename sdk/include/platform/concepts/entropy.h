@@ -2,6 +2,7 @@
 #include <array>
 #include <concepts>
 #include <cstdint>
+#include <cstring>
 
 /**
  * Concept for an Ethernet adaptor.
@@ -34,3 +35,29 @@ concept IsEntropySource = requires(T source)
 	 */
 	{source.reseed()};
 };
+
+/**
+ * Fill the `length` bytes at `buffer` with random data from `source`, drawing
+ * one `ValueType` for each `sizeof(ValueType)` bytes (and one more for any
+ * trailing partial value).  The result is only as secure as `source`: check
+ * `T::IsSecure` before using it for key material.
+ */
+template<IsEntropySource T>
+void entropy_fill(T &source, void *buffer, size_t length)
+{
+	using ValueType = typename T::ValueType;
+
+	auto *bytes = static_cast<uint8_t *>(buffer);
+	while (length >= sizeof(ValueType))
+	{
+		ValueType value = source();
+		memcpy(bytes, &value, sizeof(value));
+		bytes += sizeof(value);
+		length -= sizeof(value);
+	}
+	if (length > 0)
+	{
+		ValueType value = source();
+		memcpy(bytes, &value, length);
+	}
+}
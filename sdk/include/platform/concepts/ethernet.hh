@@ -1,6 +1,7 @@
 #pragma once
 #include <array>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
 
 /**
@@ -107,3 +108,98 @@ concept EthernetAdaptor = requires(T                      adaptor,
 		adaptor.receive_interrupt_complete(nullptr, 0)
 		} -> std::same_as<int>;
 };
+
+/**
+ * Concept for an Ethernet adaptor that can also receive frames directly into
+ * buffers supplied by the caller.  A network stack that keeps a pool of
+ * pre-allocated frame buffers can use this to avoid copying each frame out of
+ * the driver's own receive buffer.  The caller keeps ownership of the buffer
+ * throughout: the driver writes the frame and returns without retaining a
+ * pointer to it.
+ */
+template<typename T>
+concept EthernetAdaptorReceiveInto =
+  EthernetAdaptor<T> && requires(T adaptor, uint8_t *buffer, uint16_t length)
+{
+	/**
+	 * The buffer size that is large enough for any frame that the adaptor
+	 * can receive.  Smaller buffers may be passed to `receive_frame_into`,
+	 * but larger frames will not fit in them.
+	 */
+	{
+		T::receive_buffer_size()
+		} -> std::convertible_to<uint16_t>;
+
+	/**
+	 * Receive the next frame into the `length` bytes at `buffer`, which must
+	 * be writeable.  Returns the length of the frame, 0 if no frame is ready
+	 * (in which case the caller should use `receive_interrupt_complete` to
+	 * wait, as after `receive_frame`), `-EINVAL` if the buffer is not valid,
+	 * or `-ENOSPC` if the next frame does not fit, in which case the frame
+	 * remains queued for a call with a larger buffer.  The driver may write
+	 * beyond the end of the frame, up to the end of the buffer.
+	 */
+	{
+		adaptor.receive_frame_into(buffer, length)
+		} -> std::same_as<int>;
+};
+
+/**
+ * A contiguous part of a frame passed to `send_frame_gather`.
+ */
+struct EthernetFrameSegment
+{
+	/// The start of the segment.
+	const uint8_t *buffer;
+	/// The length of the segment in bytes.
+	uint16_t length;
+};
+
+/**
+ * Concept for an Ethernet adaptor that can also send a frame gathered from
+ * several buffers.  A network stack that builds headers separately from the
+ * payload can use this to avoid first copying them into one buffer.
+ */
+template<typename T>
+concept EthernetAdaptorSendGather =
+  EthernetAdaptor<T> &&
+  requires(T adaptor, const EthernetFrameSegment *segments, size_t count)
+{
+	/**
+	 * Send the frame made of the `count` segments in `segments`, in order.
+	 * Returns true if the frame was sent, or queued for sending, and false
+	 * if the segments are invalid or the frame is too long.  The third
+	 * argument is the same egress hook as for `send_frame` and is called on
+	 * the complete frame.
+	 */
+	{
+		adaptor.send_frame_gather(
+		  segments, count, [](const uint8_t *buffer, uint16_t length) {
+			  return true;
+		  })
+		} -> std::same_as<bool>;
+};
+
+/**
+ * Concept for an Ethernet adaptor that can pass all of the frames that are
+ * ready to a handler in one call.  A network stack can use this to drain the
+ * adaptor's receive buffers after each interrupt, returning each buffer to
+ * the device as soon as its frame has been handled, which reduces drops when
+ * frames arrive in bursts.
+ */
+template<typename T>
+concept EthernetAdaptorReceiveBatch = EthernetAdaptor<T> && requires(T adaptor)
+{
+	/**
+	 * Call the handler with the buffer and length of each frame that is
+	 * ready, oldest first, until none are ready or the handler returns
+	 * false.  A frame for which the handler returns false stays queued.
+	 * Returns the number of frames handled.  If this handles no frames then
+	 * the caller should use `receive_interrupt_complete` to wait, as after
+	 * `receive_frame`.
+	 */
+	{
+		adaptor.receive_frames(
+		  [](const uint8_t *buffer, uint16_t length) { return true; })
+		} -> std::convertible_to<size_t>;
+};
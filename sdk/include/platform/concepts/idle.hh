@@ -0,0 +1,62 @@
+#pragma once
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A low-power state that the idle thread may enter while waiting for an
+ * interrupt.  All times are in timer cycles.
+ */
+struct IdleState
+{
+	/**
+	 * The total time taken to enter and leave this state.  The scheduler
+	 * enters a state only if the time until the next timer expiry is longer
+	 * than this, so that a state is never entered only to be left before it
+	 * saves anything.
+	 */
+	uint32_t transitionCycles;
+	/**
+	 * The time between an interrupt and the core resuming execution in this
+	 * state.  The scheduler does not enter a state whose wake latency is
+	 * longer than any thread has declared that it can tolerate with
+	 * `thread_wake_latency_limit_set`.
+	 */
+	uint32_t wakeLatencyCycles;
+};
+
+/**
+ * Concept for a platform's idle controller, which provides the low-power
+ * states that the idle thread can wait for interrupts in.
+ *
+ * State 0 must be the state that a plain `wfi` enters, with no transition
+ * cost or wake latency, and is used when no deeper state is suitable.  The
+ * remaining states must be ordered from shallowest to deepest.  The scheduler
+ * calls `enter` with interrupts disabled, after deciding to run the idle
+ * thread, to configure the hardware so that the idle thread's next `wfi`
+ * enters the chosen state.  It calls `exit` with the same state on the next
+ * entry to the scheduler, before doing anything else.
+ */
+template<typename T>
+concept IsIdleController = requires(size_t state)
+{
+	/**
+	 * The available states, as an array of `IdleState`s.
+	 */
+	{
+		T::States.size()
+		} -> std::convertible_to<size_t>;
+	{
+		T::States[state]
+		} -> std::convertible_to<const IdleState &>;
+
+	/**
+	 * Prepare to enter `state` at the idle thread's next `wfi`.
+	 */
+	{T::enter(state)};
+
+	/**
+	 * Undo anything done by `enter` for `state`, after `wfi` has returned.
+	 */
+	{T::exit(state)};
+};
@@ -67,6 +67,16 @@ namespace Flute
 #endif
 		}
 
+		/**
+		 * Set the range that subsequent sweeps scan.  This must not be called
+		 * while a sweep is running.
+		 */
+		void system_bg_revoker_range_set(ptraddr_t base, ptraddr_t top)
+		{
+			shadowCtrl->base = base;
+			shadowCtrl->top  = top;
+		}
+
 		/**
 		 * Returns the revocation epoch.  This is the number of revocations
 		 * that have started.
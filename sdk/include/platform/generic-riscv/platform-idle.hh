@@ -0,0 +1,34 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <array>
+#include <platform/concepts/idle.hh>
+
+/**
+ * Idle controller for platforms without low-power states beyond `wfi`.
+ * Boards that have deeper states should provide their own
+ * `platform-idle.hh`, earlier in their driver includes.
+ */
+class IdleController
+{
+	public:
+	/**
+	 * The only state is a plain `wfi`.
+	 */
+	static constexpr std::array<IdleState, 1> States{{{0, 0}}};
+
+	/**
+	 * Nothing to configure for a plain `wfi`.
+	 */
+	static void enter(size_t) {}
+
+	/**
+	 * Nothing to restore after a plain `wfi`.
+	 */
+	static void exit(size_t) {}
+};
+
+static_assert(IsIdleController<IdleController>,
+              "IdleController must be an idle controller");
@@ -50,8 +50,9 @@ class StandardPlic : private utils::NoCopyNoMove
 		{
 			plicPrios[i] = 0U;
 		}
-		// We don't make use of threshold control. Leave it at 0 so all
-		// configured interrupts can fire.
+		// Start with a threshold of 0 so all configured interrupts can fire.
+		// The scheduler raises it only while running an interrupt's handler
+		// thread, if built with `--interrupt-handler-threads=y`.
 		*plicThres = 0U;
 	}
 
@@ -87,6 +88,15 @@ class StandardPlic : private utils::NoCopyNoMove
 		plicPrios[src] = prio;
 	}
 
+	/**
+	 * Set the priority threshold.  Only interrupts with a priority greater
+	 * than the threshold are delivered.
+	 */
+	void threshold_set(Priority threshold)
+	{
+		*plicThres = threshold;
+	}
+
 	/**
 	 * Fetch the interrupt number that fired and prevent it from firing.  If
 	 * two or more interrupts have fired then this will return the
@@ -142,6 +152,8 @@ class NoPlic : private utils::NoCopyNoMove
 
 	void priority_set(SourceID, Priority) {}
 
+	void threshold_set(Priority) {}
+
 	std::optional<SourceID> interrupt_claim()
 	{
 		return std::nullopt;
@@ -111,6 +111,17 @@ namespace Ibex
 			  STATIC_SEALED_VALUE(revokerInterruptCapability));
 		}
 
+		/**
+		 * Set the range that subsequent sweeps scan.  This must not be called
+		 * while a sweep is running.
+		 */
+		void system_bg_revoker_range_set(ptraddr_t base, ptraddr_t top)
+		{
+			auto &device = revoker_device();
+			device.base  = base;
+			device.top   = top;
+		}
+
 		/**
 		 * Returns the revocation epoch.  This is the number of revocations
 		 * that have started.
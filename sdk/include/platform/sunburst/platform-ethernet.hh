@@ -4,6 +4,7 @@
 #include <cstddef>
 #include <cstdint>
 #include <debug.hh>
+#include <errno.h>
 #include <futex.h>
 #include <interrupt.h>
 #include <locks.hh>
@@ -14,6 +15,38 @@
 #include <thread.h>
 #include <type_traits>
 
+/**
+ * Number of received frames that the KSZ8851 queues before it raises a
+ * receive interrupt.  Frames that arrive below this watermark are reported
+ * once `KSZ8851_RECEIVE_COALESCE_MICROSECONDS` have passed since the first of
+ * them arrived, so this trades a bounded increase in latency for fewer
+ * interrupts at high packet rates.  A value of 1 interrupts on every frame.
+ */
+#ifndef KSZ8851_RECEIVE_FRAME_WATERMARK
+#	define KSZ8851_RECEIVE_FRAME_WATERMARK 4
+#endif
+
+/**
+ * Maximum time, in microseconds, that a received frame waits in the KSZ8851
+ * receive queue before the device raises a receive interrupt when fewer than
+ * `KSZ8851_RECEIVE_FRAME_WATERMARK` frames are pending.
+ */
+#ifndef KSZ8851_RECEIVE_COALESCE_MICROSECONDS
+#	define KSZ8851_RECEIVE_COALESCE_MICROSECONDS 250
+#endif
+
+/**
+ * On boards with a DMA controller, define `KSZ8851_DMA_ENGINE` to a type
+ * that satisfies `DmaEngine`, `KSZ8851_DMA_HEADER` to the header that
+ * declares it, and `KSZ8851_DMA_TRANSMIT_REQUEST` and
+ * `KSZ8851_DMA_RECEIVE_REQUEST` to its SPI request lines.  The driver then
+ * moves frame payloads to and from the SPI FIFOs with DMA instead of with
+ * CPU loops, falling back to the CPU if the engine rejects a transfer.
+ */
+#ifdef KSZ8851_DMA_ENGINE
+#	include KSZ8851_DMA_HEADER
+#endif
+
 DECLARE_AND_DEFINE_INTERRUPT_CAPABILITY(EthernetInterruptCapability,
                                         InterruptName::EthernetInterrupt,
                                         true,
@@ -39,6 +72,22 @@ class Ksz8851Ethernet
 	 */
 	static constexpr uint16_t MaxFrameSize = 1500;
 
+	/**
+	 * Frame-count watermark for receive interrupts.
+	 */
+	static constexpr uint16_t ReceiveFrameWatermark =
+	  KSZ8851_RECEIVE_FRAME_WATERMARK;
+
+	static_assert((ReceiveFrameWatermark > 0) &&
+	                (ReceiveFrameWatermark <= 0xff),
+	              "KSZ8851_RECEIVE_FRAME_WATERMARK must be in [1, 255]");
+
+	/**
+	 * Receive interrupt coalescing timeout, in microseconds.
+	 */
+	static constexpr uint16_t ReceiveCoalesceMicroseconds =
+	  KSZ8851_RECEIVE_COALESCE_MICROSECONDS;
+
 	/**
 	 * Helper for conditional debug logs and assertions.
 	 */
@@ -345,17 +394,43 @@ class Ksz8851Ethernet
 		// address.
 		uint8_t addr       = static_cast<uint8_t>(reg);
 		uint8_t byteEnable = (addr & 0x2) == 0 ? 0b0011 : 0b1100;
-		uint8_t bytes[2];
+		// Send the command and clock in the value in one full-duplex
+		// transfer.  The bytes received while the command is sent are
+		// ignored.
+		uint8_t bytes[4] = {};
 		bytes[0] = (static_cast<uint8_t>(SpiCommand::ReadRegister) << 6) |
 		           (byteEnable << 2) | (addr >> 6);
 		bytes[1] = (addr << 2) & 0b11110000;
 
 		set_gpio_output_bit(GpioPin::EthernetChipSelect, false);
-		spi()->blocking_write(bytes, sizeof(bytes));
-		uint16_t val;
-		spi()->blocking_read(reinterpret_cast<uint8_t *>(&val), sizeof(val));
+		spi()->transfer(bytes, bytes, sizeof(bytes));
+		set_gpio_output_bit(GpioPin::EthernetChipSelect, true);
+		return bytes[2] | (bytes[3] << 8);
+	}
+
+	/**
+	 * Read the pair of registers that share the 32-bit word at `reg` from the
+	 * KSZ8851 in a single SPI transaction.  `reg` must be 4-byte aligned.  The
+	 * register at `reg` is returned in the low half and the one after it in
+	 * the high half.
+	 */
+	[[nodiscard]] uint32_t register_read_pair(RegisterOffset reg) const
+	{
+		// See register_read for command format.
+		uint8_t addr = static_cast<uint8_t>(reg);
+		Debug::Assert((addr & 0x3) == 0,
+		              "Register pair {} is not 4-byte aligned",
+		              addr);
+		uint8_t bytes[6] = {};
+		bytes[0] = (static_cast<uint8_t>(SpiCommand::ReadRegister) << 6) |
+		           (0b1111 << 2) | (addr >> 6);
+		bytes[1] = (addr << 2) & 0b11110000;
+
+		set_gpio_output_bit(GpioPin::EthernetChipSelect, false);
+		spi()->transfer(bytes, bytes, sizeof(bytes));
 		set_gpio_output_bit(GpioPin::EthernetChipSelect, true);
-		return val;
+		return bytes[2] | (bytes[3] << 8) | (bytes[4] << 16) |
+		       (uint32_t(bytes[5]) << 24);
 	}
 
 	/**
@@ -396,6 +471,23 @@ class Ksz8851Ethernet
 		register_write(reg, old & ~mask);
 	}
 
+	/**
+	 * Set or clear the start-DMA-access bit of the ReceiveQueueCommand
+	 * register, which brackets every frame transfer in either direction.  The
+	 * rest of the register does not change after initialisation, so this
+	 * writes the cached value rather than reading the register back first,
+	 * halving the SPI transactions around each frame.
+	 */
+	void dma_access(bool start)
+	{
+		uint16_t command = receiveQueueCommand;
+		if (start)
+		{
+			command |= StartDmaAccess;
+		}
+		register_write(RegisterOffset::ReceiveQueueCommand, command);
+	}
+
 	/**
 	 * Helper.  Returns a pointer to the SPI device.
 	 */
@@ -418,6 +510,12 @@ class Ksz8851Ethernet
 	 */
 	uint16_t framesToProcess = 0;
 
+	/**
+	 * The value written to the ReceiveQueueCommand register at
+	 * initialisation, without the start-DMA-access bit.
+	 */
+	uint16_t receiveQueueCommand = 0;
+
 	/**
 	 * Mutex protecting transmitBuffer if send_frame is reentered.
 	 */
@@ -445,6 +543,48 @@ class Ksz8851Ethernet
 	 */
 	std::unique_ptr<uint8_t[]> receiveBuffer;
 
+#ifdef KSZ8851_DMA_ENGINE
+	/**
+	 * The DMA engine used for frame payloads.  Accesses are serialised by
+	 * `gpioLock`, which is held for every SPI transaction.
+	 */
+	KSZ8851_DMA_ENGINE dma;
+#endif
+
+	/**
+	 * Send the `length` bytes at `buffer` as part of the current SPI
+	 * transaction, with DMA if it is available.
+	 */
+	void spi_write_payload(const uint8_t *buffer, uint16_t length)
+	{
+#ifdef KSZ8851_DMA_ENGINE
+		Timeout t{UnlimitedTimeout};
+		if (spi()->blocking_write(
+		      dma, KSZ8851_DMA_TRANSMIT_REQUEST, buffer, length, &t) == 0)
+		{
+			return;
+		}
+#endif
+		spi()->blocking_write(buffer, length);
+	}
+
+	/**
+	 * Receive `length` bytes into `buffer` as part of the current SPI
+	 * transaction, with DMA if it is available.
+	 */
+	void spi_read_payload(uint8_t *buffer, uint16_t length)
+	{
+#ifdef KSZ8851_DMA_ENGINE
+		Timeout t{UnlimitedTimeout};
+		if (spi()->blocking_read(
+		      dma, KSZ8851_DMA_RECEIVE_REQUEST, buffer, length, &t) == 0)
+		{
+			return;
+		}
+#endif
+		spi()->blocking_read(buffer, length);
+	}
+
 	public:
 	/**
 	 * Initialise a reference to the Ethernet device.
@@ -478,8 +618,20 @@ class Ksz8851Ethernet
 		                 TransmitControl::TransmitChecksumGenerationIcmp);
 		register_write(RegisterOffset::ReceiveFrameDataPointer,
 		               FrameDataPointer::FrameDataPointerAutoIncrement);
-		// Configure Receive Frame Threshold for one frame.
-		register_write(RegisterOffset::ReceiveFrameCountThreshold, 0x0001);
+		// Raise the receive interrupt once enough frames are queued or, if
+		// coalescing, once the oldest pending frame has waited long enough.
+		register_write(RegisterOffset::ReceiveFrameCountThreshold,
+		               ReceiveFrameWatermark);
+		receiveQueueCommand =
+		  ReceiveQueueCommand::ReceiveFrameCountThresholdEnable |
+		  ReceiveQueueCommand::AutoDequeueReceiveQueueFrameEnable;
+		if constexpr (ReceiveFrameWatermark > 1)
+		{
+			register_write(RegisterOffset::ReceiveDurationTimerThreshold,
+			               ReceiveCoalesceMicroseconds);
+			receiveQueueCommand |=
+			  ReceiveQueueCommand::ReceiveDurationTimerThresholdEnable;
+		}
 		register_write(RegisterOffset::ReceiveControl1,
 		               ReceiveControl1::ReceiveUnicastEnable |
 		                 ReceiveControl1::ReceiveMulticastEnable |
@@ -501,10 +653,8 @@ class Ksz8851Ethernet
 		    ReceiveControl2::ReceiveIpv4Ipv6UdpFrameChecksumEqualZero |
 		    ReceiveControl2::ReceiveIpv4Ipv6FragmentFramePass |
 		    ReceiveControl2::DataBurstSingleFrame);
-		register_write(
-		  RegisterOffset::ReceiveQueueCommand,
-		  ReceiveQueueCommand::ReceiveFrameCountThresholdEnable |
-		    ReceiveQueueCommand::AutoDequeueReceiveQueueFrameEnable);
+		register_write(RegisterOffset::ReceiveQueueCommand,
+		               receiveQueueCommand);
 
 		// Programmer's guide have a step to set the chip in half-duplex when
 		// negotiation failed, but we omit the step since non-switching hubs and
@@ -627,105 +777,47 @@ class Ksz8851Ethernet
 	std::optional<Frame> receive_frame()
 	{
 		LockGuard g{gpioLock};
-		if (framesToProcess == 0)
+		LockGuard guard{receiveBufferMutex};
+		int length = receive_frame_locked(receiveBuffer.get(), MaxFrameSize);
+		if (length <= 0)
 		{
-			uint16_t isr = register_read(RegisterOffset::InterruptStatus);
-			if (!(isr & ReceiveInterrupt))
-			{
-				return std::nullopt;
-			}
-
-			// Acknowledge the interrupt
-			register_write(RegisterOffset::InterruptStatus, ReceiveInterrupt);
-
-			// Read number of frames pending.
-			// Note that this is only updated when we acknowledge the interrupt.
-			framesToProcess =
-			  register_read(RegisterOffset::ReceiveFrameCountThreshold) >> 8;
+			return std::nullopt;
 		}
 
-		// Get number of frames pending
-		for (; framesToProcess; framesToProcess--)
-		{
-			uint16_t status =
-			  register_read(RegisterOffset::ReceiveFrameHeaderStatus);
-			uint16_t length =
-			  register_read(RegisterOffset::ReceiveFrameHeaderByteCount) &
-			  0xFFF;
-			bool valid =
-			  (status & ReceiveFrameValid) &&
-			  !(status &
-			    (ReceiveCrcError | ReceiveRuntFrame | ReceiveFrameTooLong |
-			     ReceiveMiiError | ReceiveUdpFrameChecksumStatus |
-			     ReceiveTcpFrameChecksumStatus | ReceiveIpFrameChecksumStatus |
-			     ReceiveIcmpFrameChecksumStatus));
-
-			if (!valid)
-			{
-				DebugFrameDrops::log("Dropping frame with status: {}", status);
-
-				drop_error_frame();
-				continue;
-			}
-
-			if (length == 0)
-			{
-				DebugFrameDrops::log("Dropping frame with zero length");
+		Capability<uint8_t> boundedBuffer{receiveBuffer.get()};
+		boundedBuffer.bounds().set_inexact(length);
+		// Remove all permissions except load.  This also removes global, so
+		// that this cannot be captured.
+		boundedBuffer.permissions() &=
+		  CHERI::PermissionSet{CHERI::Permission::Load};
 
-				drop_error_frame();
-				continue;
-			}
-
-			// The DMA transfer to the Ethernet MAC must be a multiple of 4
-			// bytes.
-			uint16_t paddedLength = (length + 3) & ~0x3;
-			if (paddedLength > MaxFrameSize)
-			{
-				DebugFrameDrops::log("Dropping frame that is too large: {}",
-				                     length);
-
-				drop_error_frame();
-				continue;
-			}
-
-			Debug::log("Receiving frame of length {}", length);
-
-			LockGuard guard{receiveBufferMutex};
-
-			// Reset receive frame pointer to zero and start DMA transfer
-			// operation.
-			register_write(RegisterOffset::ReceiveFrameDataPointer,
-			               FrameDataPointer::FrameDataPointerAutoIncrement);
-			register_set(RegisterOffset::ReceiveQueueCommand, StartDmaAccess);
-
-			// Start receiving via SPI.
-			uint8_t cmd = static_cast<uint8_t>(SpiCommand::ReadDma) << 6;
-			set_gpio_output_bit(GpioPin::EthernetChipSelect, false);
-			spi()->blocking_write(&cmd, 1);
-
-			// Initial words are ReceiveFrameHeaderStatus and
-			// ReceiveFrameHeaderByteCount which we have already know the value.
-			uint8_t dummy[8];
-			spi()->blocking_read(dummy, sizeof(dummy));
-
-			spi()->blocking_read(receiveBuffer.get(), paddedLength);
-
-			set_gpio_output_bit(GpioPin::EthernetChipSelect, true);
-
-			register_clear(RegisterOffset::ReceiveQueueCommand, StartDmaAccess);
-			framesToProcess -= 1;
+		return Frame{std::move(guard), boundedBuffer, uint16_t(length)};
+	}
 
-			Capability<uint8_t> boundedBuffer{receiveBuffer.get()};
-			boundedBuffer.bounds().set_inexact(length);
-			// Remove all permissions except load.  This also removes global, so
-			// that this cannot be captured.
-			boundedBuffer.permissions() &=
-			  CHERI::PermissionSet{CHERI::Permission::Load};
+	/**
+	 * Buffers of this size can hold any frame that `receive_frame_into`
+	 * accepts, including the padding of the SPI transfer.
+	 */
+	static constexpr uint16_t receive_buffer_size()
+	{
+		return MaxFrameSize;
+	}
 
-			return Frame{std::move(guard), boundedBuffer, length};
+	/**
+	 * Receive the next frame directly from the SPI receive FIFO into a buffer
+	 * supplied by the caller, avoiding the copy out of `receiveBuffer`.  The
+	 * transfer is padded to a multiple of 4 bytes, so up to 3 bytes after the
+	 * frame may be overwritten.
+	 */
+	int receive_frame_into(uint8_t *buffer, uint16_t length)
+	{
+		if (!CHERI::check_pointer<CHERI::PermissionSet{
+		      CHERI::Permission::Store}>(buffer, length))
+		{
+			return -EINVAL;
 		}
-
-		return std::nullopt;
+		LockGuard g{gpioLock};
+		return receive_frame_locked(buffer, length);
 	}
 
 	/**
@@ -778,7 +870,7 @@ class Ksz8851Ethernet
 		Debug::log("Sending frame of length {}", length);
 
 		// Start DMA transfer operation.
-		register_set(RegisterOffset::ReceiveQueueCommand, StartDmaAccess);
+		dma_access(true);
 
 		// Start sending via SPI.
 		uint8_t cmd = static_cast<uint8_t>(SpiCommand::WriteDma) << 6;
@@ -789,13 +881,13 @@ class Ksz8851Ethernet
 		spi()->blocking_write(reinterpret_cast<uint8_t *>(&header),
 		                      sizeof(header));
 
-		spi()->blocking_write(transmitBuffer.get(), paddedLength);
+		spi_write_payload(transmitBuffer.get(), paddedLength);
 
 		spi()->wait_idle();
 		set_gpio_output_bit(GpioPin::EthernetChipSelect, true);
 
 		// Stop QMU DMA transfer operation.
-		register_clear(RegisterOffset::ReceiveQueueCommand, StartDmaAccess);
+		dma_access(false);
 
 		// Enqueue the frame for transmission.
 		register_set(
@@ -806,10 +898,118 @@ class Ksz8851Ethernet
 	}
 
 	private:
+	/**
+	 * Receive the next valid frame into the `capacity` bytes at `buffer`,
+	 * dropping any invalid frames in front of it.  Returns the frame length,
+	 * 0 if no frame is pending, or `-ENOSPC` if the next frame (padded to a
+	 * multiple of 4 bytes) does not fit, leaving it queued.  The caller must
+	 * hold `gpioLock`.
+	 */
+	int receive_frame_locked(uint8_t *buffer, uint16_t capacity)
+	{
+		if (framesToProcess == 0)
+		{
+			uint16_t isr = register_read(RegisterOffset::InterruptStatus);
+			if (!(isr & ReceiveInterrupt))
+			{
+				return 0;
+			}
+
+			// Acknowledge the interrupt
+			register_write(RegisterOffset::InterruptStatus, ReceiveInterrupt);
+
+			// Read number of frames pending.
+			// Note that this is only updated when we acknowledge the interrupt.
+			framesToProcess =
+			  register_read(RegisterOffset::ReceiveFrameCountThreshold) >> 8;
+		}
+
+		// Drain the frames counted at the last acknowledgement before looking
+		// at the interrupt status again.
+		for (; framesToProcess; framesToProcess--)
+		{
+			// The status and byte count share a 32-bit word, so fetch both
+			// with one command.
+			uint32_t header =
+			  register_read_pair(RegisterOffset::ReceiveFrameHeaderStatus);
+			uint16_t status = header;
+			uint16_t length = (header >> 16) & 0xFFF;
+			bool valid =
+			  (status & ReceiveFrameValid) &&
+			  !(status &
+			    (ReceiveCrcError | ReceiveRuntFrame | ReceiveFrameTooLong |
+			     ReceiveMiiError | ReceiveUdpFrameChecksumStatus |
+			     ReceiveTcpFrameChecksumStatus | ReceiveIpFrameChecksumStatus |
+			     ReceiveIcmpFrameChecksumStatus));
+
+			if (!valid)
+			{
+				DebugFrameDrops::log("Dropping frame with status: {}", status);
+
+				drop_error_frame();
+				continue;
+			}
+
+			if (length == 0)
+			{
+				DebugFrameDrops::log("Dropping frame with zero length");
+
+				drop_error_frame();
+				continue;
+			}
+
+			// The DMA transfer to the Ethernet MAC must be a multiple of 4
+			// bytes.
+			uint16_t paddedLength = (length + 3) & ~0x3;
+			if (paddedLength > MaxFrameSize)
+			{
+				DebugFrameDrops::log("Dropping frame that is too large: {}",
+				                     length);
+
+				drop_error_frame();
+				continue;
+			}
+
+			if (paddedLength > capacity)
+			{
+				return -ENOSPC;
+			}
+
+			Debug::log("Receiving frame of length {}", length);
+
+			// Reset receive frame pointer to zero and start DMA transfer
+			// operation.
+			register_write(RegisterOffset::ReceiveFrameDataPointer,
+			               FrameDataPointer::FrameDataPointerAutoIncrement);
+			dma_access(true);
+
+			// Start receiving via SPI.
+			uint8_t cmd = static_cast<uint8_t>(SpiCommand::ReadDma) << 6;
+			set_gpio_output_bit(GpioPin::EthernetChipSelect, false);
+			spi()->blocking_write(&cmd, 1);
+
+			// Initial words are ReceiveFrameHeaderStatus and
+			// ReceiveFrameHeaderByteCount which we have already know the value.
+			uint8_t dummy[8];
+			spi()->blocking_read(dummy, sizeof(dummy));
+
+			spi_read_payload(buffer, paddedLength);
+
+			set_gpio_output_bit(GpioPin::EthernetChipSelect, true);
+
+			dma_access(false);
+			framesToProcess -= 1;
+
+			return length;
+		}
+
+		return 0;
+	}
+
 	void drop_error_frame()
 	{
-		register_set(RegisterOffset::ReceiveQueueCommand,
-		             ReleaseReceiveErrorFrame);
+		register_write(RegisterOffset::ReceiveQueueCommand,
+		               receiveQueueCommand | ReleaseReceiveErrorFrame);
 		// Wait for confirmation of frame release before attempting to process
 		// next frame.
 		while (register_read(RegisterOffset::ReceiveQueueCommand) &
@@ -821,4 +1021,4 @@ class Ksz8851Ethernet
 
 using EthernetDevice = Ksz8851Ethernet;
 
-static_assert(EthernetAdaptor<EthernetDevice>);
+static_assert(EthernetAdaptorReceiveInto<EthernetDevice>);
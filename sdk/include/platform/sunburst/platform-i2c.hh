@@ -1,7 +1,44 @@
 #pragma once
+#include <algorithm>
 #include <cdefs.h>
 #include <debug.hh>
+#include <errno.h>
+#include <futex.h>
+#include <interrupt.h>
 #include <stdint.h>
+#include <timeout.h>
+
+/**
+ * One segment of an I2C transaction list for `OpenTitanI2c::transaction`:
+ * a read from or a write to a 7-bit target address.
+ */
+struct OpenTitanI2cSegment
+{
+	/// The 7-bit address of the target.
+	uint8_t address;
+	/// True if this segment reads from the target.
+	bool isRead;
+	/// The number of bytes to transfer.
+	uint16_t length;
+	/// The bytes to write, for write segments.
+	const uint8_t *writeData;
+	/// The buffer to read into, for read segments.
+	uint8_t *readData;
+
+	/// Returns a segment that writes `length` bytes from `data` to `address`.
+	static constexpr OpenTitanI2cSegment
+	write(uint8_t address, const uint8_t *data, uint16_t length)
+	{
+		return {address, false, length, data, nullptr};
+	}
+
+	/// Returns a segment that reads `length` bytes from `address` to `data`.
+	static constexpr OpenTitanI2cSegment
+	read(uint8_t address, uint8_t *data, uint16_t length)
+	{
+		return {address, true, length, nullptr, data};
+	}
+};
 
 /**
  * Driver for the OpenTitan's I2C block.
@@ -466,6 +503,133 @@ struct OpenTitanI2c
 		return true;
 	}
 
+	/**
+	 * Number of bytes in the format FIFO at which the driver stops waiting
+	 * for space in it, in `transaction`.
+	 */
+	static constexpr uint16_t FormatRefillThreshold = 4;
+
+	/// Returns the number of bytes in the host-mode receive FIFO.
+	[[nodiscard]] uint32_t receive_fifo_level() volatile
+	{
+		return (hostFifoStatus >> 16) & 0xfff;
+	}
+
+	/**
+	 * Run a list of segments as a single batch, in order.  Consecutive
+	 * segments with the same target address and direction are gathered into
+	 * one transfer, a change of direction for the same target issues a
+	 * repeated START (for example, writing a register address and then
+	 * reading the register), and a change of target ends the preceding
+	 * transfer with a STOP.  The last segment always ends with a STOP.
+	 *
+	 * Whenever the driver must wait for space in the format FIFO, for data in
+	 * the receive FIFO, or for the transaction to complete, it enables the
+	 * corresponding FIFO-threshold or completion interrupt and calls
+	 * `wait(timeout)`.  Use an `OpenTitanI2cInterruptWaiter` to sleep on the
+	 * block's interrupt futex, or a callable that returns 0 to poll.
+	 *
+	 * Returns 0 on success, `-EIO` if the controller halted (for example,
+	 * because a target did not acknowledge), or `-ETIMEDOUT` if `timeout`
+	 * expired.  On failure the FIFOs are reset and the remaining segments
+	 * are not run.
+	 */
+	int transaction(Timeout                   *timeout,
+	                const OpenTitanI2cSegment *segments,
+	                size_t                     count,
+	                auto                     &&wait) volatile
+	{
+		interrupt_clear(Interrupt::CommandComplete);
+		int ret = 0;
+		for (size_t i = 0; (i < count) && (ret == 0); i++)
+		{
+			const OpenTitanI2cSegment &segment = segments[i];
+			const OpenTitanI2cSegment *previous =
+			  (i > 0) ? &segments[i - 1] : nullptr;
+			const OpenTitanI2cSegment *next =
+			  (i + 1 < count) ? &segments[i + 1] : nullptr;
+			bool start = (previous == nullptr) ||
+			             (previous->address != segment.address) ||
+			             (previous->isRead != segment.isRead);
+			bool stop =
+			  (next == nullptr) || (next->address != segment.address);
+			bool continues =
+			  !stop && (next->isRead == segment.isRead) && segment.isRead;
+			if (start)
+			{
+				ret = format_push(
+				  timeout,
+				  FormatDataStart | (segment.address << 1) | segment.isRead,
+				  wait);
+			}
+			if (segment.isRead)
+			{
+				for (uint32_t offset = 0;
+				     (offset < segment.length) && (ret == 0);
+				     offset += ReceiveFifoDepth)
+				{
+					uint32_t chunk = std::min<uint32_t>(
+					  segment.length - offset, ReceiveFifoDepth);
+					bool     last  = (offset + chunk) == segment.length;
+					uint32_t flags = FormatDataReadBytes;
+					if (!last || continues)
+					{
+						// Acknowledge the last byte so the read continues
+						// into the next chunk.
+						flags |= FormatDataReadCount;
+					}
+					else if (stop)
+					{
+						flags |= FormatDataStop;
+					}
+					ret = format_push(timeout, flags | chunk, wait);
+					if (ret == 0)
+					{
+						host_thresholds_set(FormatRefillThreshold, chunk - 1);
+						ret = wait_for(
+						  timeout,
+						  Interrupt::ReceiveThreshold,
+						  [&]() { return receive_fifo_level() >= chunk; },
+						  wait);
+					}
+					for (uint32_t j = 0; (j < chunk) && (ret == 0); j++)
+					{
+						segment.readData[offset + j] = readData;
+					}
+				}
+			}
+			else
+			{
+				for (uint32_t j = 0; (j < segment.length) && (ret == 0); j++)
+				{
+					bool     last   = (j + 1) == segment.length;
+					uint32_t format = segment.writeData[j];
+					if (last && stop)
+					{
+						format |= FormatDataStop;
+					}
+					ret = format_push(timeout, format, wait);
+				}
+			}
+		}
+		if (ret == 0)
+		{
+			ret = wait_for(
+			  timeout,
+			  Interrupt::CommandComplete,
+			  [&]() { return format_is_empty() && (status & StatusHostIdle); },
+			  wait);
+		}
+		if (ret != 0)
+		{
+			reset_controller_events();
+			reset_fifos();
+		}
+		interrupt_clear(Interrupt::CommandComplete);
+		interrupt_clear(Interrupt::ControllerHalt);
+		return ret;
+	}
+
 	/// Returns true if the given interrupt is asserted.
 	[[nodiscard]] bool interrupt_is_asserted(Interrupt interrupt) volatile
 	{
@@ -499,4 +663,105 @@ struct OpenTitanI2c
 		hostFifoConfiguration =
 		  (formatThreshold & 0xfff) << 16 | (receiveThreshold & 0xfff);
 	}
+
+	private:
+	/**
+	 * Wait until `condition` returns true, enabling `interrupt` (and the
+	 * controller-halt interrupt) while calling `wait`.  Returns 0, or `-EIO`
+	 * or `-ETIMEDOUT` as described for `transaction`.
+	 */
+	int wait_for(Timeout  *timeout,
+	             Interrupt interrupt,
+	             auto    &&condition,
+	             auto    &&wait) volatile
+	{
+		while (!condition())
+		{
+			if (interrupt_is_asserted(Interrupt::ControllerHalt))
+			{
+				return -EIO;
+			}
+			if (!timeout->may_block())
+			{
+				return -ETIMEDOUT;
+			}
+			uint32_t enabled = interruptEnable;
+			interruptEnable  = enabled | interrupt_bit(interrupt) |
+			                  interrupt_bit(Interrupt::ControllerHalt);
+			int ret         = condition() ? 0 : wait(timeout);
+			interruptEnable = enabled;
+			// Completion is an event rather than a level, so clear it to
+			// allow it to be raised again.
+			interrupt_clear(Interrupt::CommandComplete);
+			if (ret == -ETIMEDOUT)
+			{
+				return ret;
+			}
+		}
+		return interrupt_is_asserted(Interrupt::ControllerHalt) ? -EIO : 0;
+	}
+
+	/**
+	 * Push one entry into the format FIFO, waiting for the FIFO to drain to
+	 * `FormatRefillThreshold` entries if it is full.
+	 */
+	int format_push(Timeout *timeout, uint32_t format, auto &&wait) volatile
+	{
+		if (StatusFormatFull & status)
+		{
+			host_thresholds_set(FormatRefillThreshold, ReceiveFifoDepth - 1);
+			int ret = wait_for(
+			  timeout,
+			  Interrupt::FormatThreshold,
+			  [&]() { return 0 == (StatusFormatFull & status); },
+			  wait);
+			if (ret != 0)
+			{
+				return ret;
+			}
+		}
+		formatData = format;
+		return 0;
+	}
+};
+
+/**
+ * Waits for an OpenTitan I2C block's interrupt, for use as the `wait`
+ * argument to `OpenTitanI2c::transaction`.  Construct this with the
+ * interrupt capability for the block, declared with
+ * `DECLARE_AND_DEFINE_INTERRUPT_CAPABILITY` (allowing both
+ * `interrupt_futex_get` and `interrupt_complete`).
+ */
+class OpenTitanI2cInterruptWaiter
+{
+	/// The capability used to acknowledge the interrupt.
+	struct SObjStruct *interruptCapability;
+	/// The futex that counts interrupts.
+	const uint32_t *futex;
+	/// The value of `futex` when this last waited.
+	uint32_t lastValue;
+
+	public:
+	OpenTitanI2cInterruptWaiter(struct SObjStruct *interruptCapability)
+	  : interruptCapability(interruptCapability),
+	    futex(interrupt_futex_get(interruptCapability)),
+	    lastValue(*futex)
+	{
+	}
+
+	/**
+	 * Acknowledge the interrupt and wait until it fires again.  Returns
+	 * immediately if it has fired since the last wait.
+	 */
+	int operator()(Timeout *timeout)
+	{
+		interrupt_complete(interruptCapability);
+		int ret = 0;
+		if (*futex == lastValue)
+		{
+			ret = futex_timed_wait(timeout, futex, lastValue);
+		}
+		lastValue = *futex;
+		return ret;
+	}
 };
@@ -61,6 +61,21 @@ namespace SonataPulseWidthModulation
 			static_assert(Index < NumberOfPwms, "PWM index out of bounds");
 			return output + Index;
 		}
+
+		/**
+		 * Set the period and duty cycle of every output.  The hardware has
+		 * no shadow registers, so each output changes when its registers are
+		 * written.  This writes them back to back, with no other work in
+		 * between, so that the outputs change as close together as possible.
+		 */
+		void outputs_set(const uint8_t (&periods)[NumberOfPwms],
+		                 const uint8_t (&dutyCycles)[NumberOfPwms]) volatile
+		{
+			for (size_t i = 0; i < NumberOfPwms; i++)
+			{
+				output[i].output_set(periods[i], dutyCycles[i]);
+			}
+		}
 	};
 
 	/**
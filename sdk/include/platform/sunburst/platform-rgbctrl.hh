@@ -63,6 +63,17 @@ struct SonataRgbLedController
 		while ((status & StatusIdle) == 0) {}
 	}
 
+	/**
+	 * Returns the value of a colour register for the given Red, Green, and
+	 * Blue values.
+	 */
+	static constexpr uint32_t colour(uint8_t red, uint8_t green, uint8_t blue)
+	{
+		return (static_cast<uint32_t>(blue) << 16) |
+		       (static_cast<uint32_t>(green) << 8) |
+		       static_cast<uint32_t>(red);
+	}
+
 	/**
 	 * Set the desired Red, Green, and Blue value of an LED. To apply these
 	 * changes, one needs to run `SonataRgbLedController::update()`.
@@ -71,9 +82,20 @@ struct SonataRgbLedController
 	rgb(SonataRgbLed led, uint8_t red, uint8_t green, uint8_t blue) volatile
 	{
 		wait_for_idle();
-		ledColors[static_cast<uint32_t>(led)] =
-		  (static_cast<uint32_t>(blue) << 16) |
-		  (static_cast<uint32_t>(green) << 8) | static_cast<uint32_t>(red);
+		ledColors[static_cast<uint32_t>(led)] = colour(red, green, blue);
+	}
+
+	/**
+	 * Set the colours (as returned by `colour`) of both LEDs and apply them
+	 * together.  This waits for the controller to be idle once, rather than
+	 * once for each of the three writes as `rgb` and `update` do.
+	 */
+	void rgb_all(const uint32_t (&colours)[2]) volatile
+	{
+		wait_for_idle();
+		ledColors[0] = colours[0];
+		ledColors[1] = colours[1];
+		control      = ControlSet;
 	}
 
 	/// Update the colours of the LEDs.
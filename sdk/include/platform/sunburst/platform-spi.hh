@@ -1,7 +1,11 @@
 #pragma once
+#include <algorithm>
 #include <cdefs.h>
 #include <debug.hh>
+#include <errno.h>
+#include <platform/concepts/dma.hh>
 #include <stdint.h>
+#include <thread.h>
 
 /**
  * A Simple Driver for the Sonata's SPI.
@@ -140,6 +144,9 @@ struct SonataSpi
 		StartByteCountMask = 0x7ffu,
 	};
 
+	/// Depth of each of the transmit and receive FIFOs, in bytes.
+	static constexpr uint32_t FifoDepth = 64;
+
 	/// Flag set when we're debugging this driver.
 	static constexpr bool DebugSonataSpi = false;
 
@@ -178,9 +185,39 @@ struct SonataSpi
 		while ((status & StatusIdle) == 0) {}
 	}
 
+	/**
+	 * Waits for the SPI device to become idle without spinning, for callers
+	 * that have started a long transfer and have other threads that could
+	 * use the CPU.  The SPI block has no interrupts to wait for, so this
+	 * yields to other threads (sleeping for a tick at a time) between checks
+	 * of the status register.
+	 *
+	 * Returns 0 once the device is idle or `-ETIMEDOUT` if `timeout` expires
+	 * first.
+	 */
+	int wait_idle(Timeout *timeout) volatile
+	{
+		while ((status & StatusIdle) == 0)
+		{
+			if (!timeout->may_block())
+			{
+				return -ETIMEDOUT;
+			}
+			Timeout tick{1};
+			thread_sleep(&tick);
+			timeout->elapse(tick.elapsed);
+		}
+		return 0;
+	}
+
 	/**
 	 * Sends `len` bytes from the given `data` buffer,
 	 * where `len` is at most `0x7ff`.
+	 *
+	 * The transmit FIFO is refilled as soon as it has space, rather than
+	 * after it drains, so the SPI clock does not stall between FIFO loads.
+	 * This returns once the last byte has been queued: call `wait_idle`
+	 * before deasserting chip select.
 	 */
 	void blocking_write(const uint8_t data[], uint16_t len) volatile
 	{
@@ -192,23 +229,61 @@ struct SonataSpi
 		control = ControlTransmitEnable;
 		start   = len;
 
-		uint32_t transmitAvailable = 0;
-		for (uint32_t i = 0; i < len; ++i)
+		for (uint32_t i = 0; i < len;)
 		{
-			if (transmitAvailable == 0)
+			// Read number of bytes in TX FIFO to calculate space available
+			// for more bytes, then fill that space without polling again.
+			uint32_t transmitAvailable =
+			  FifoDepth - (status & StatusTxFifoLevel);
+			for (uint32_t end = std::min<uint32_t>(len, i + transmitAvailable);
+			     i < end;
+			     ++i)
 			{
-				while (transmitAvailable < 64)
-				{
-					// Read number of bytes in TX FIFO to calculate space
-					// available for more bytes
-					transmitAvailable = 64 - (status & StatusTxFifoLevel);
-				}
+				transmitFifo = data[i];
 			}
-			transmitFifo = data[i];
-			transmitAvailable--;
 		}
 	}
 
+	/**
+	 * Sends `len` bytes from `data`, where `len` is at most `0x7ff`, by
+	 * having `dma` copy them into the transmit FIFO.  The copy is paced by
+	 * the board's SPI transmit `request` line, so that it does not overrun
+	 * the FIFO.
+	 *
+	 * Returns 0 once the DMA engine has queued the last byte (call
+	 * `wait_idle` before deasserting chip select), or the error from the
+	 * engine's `start` (in which case the SPI block has not been started)
+	 * or from `dma_wait`.
+	 */
+	template<DmaEngine Dma>
+	int blocking_write(Dma          &dma,
+	                   uint8_t       request,
+	                   const uint8_t data[],
+	                   uint16_t      len,
+	                   Timeout      *timeout) volatile
+	{
+		if (len > 0x7ff)
+		{
+			return -EINVAL;
+		}
+		wait_idle();
+		DmaTransfer transfer{.destination           = &transmitFifo,
+		                     .source                = data,
+		                     .length                = len,
+		                     .destinationAddressing = DmaAddressing::Fixed,
+		                     .request               = request};
+		// Start the engine before the SPI block, so that nothing has been
+		// started if the engine rejects the transfer.  The engine then waits
+		// for the request line.
+		control = ControlTransmitEnable;
+		if (int ret = dma.start({&transfer, 1}); ret != 0)
+		{
+			return ret;
+		}
+		start = len;
+		return dma_wait(dma, timeout);
+	}
+
 	/*
 	 * Receives `len` bytes and puts them in the `data` buffer,
 	 * where `len` is at most `0x7ff`.
@@ -225,11 +300,106 @@ struct SonataSpi
 		control = ControlReceiveEnable;
 		start   = len;
 
-		for (uint32_t i = 0; i < len; ++i)
+		for (uint32_t i = 0; i < len;)
+		{
+			// Drain every byte currently in the RX FIFO before polling the
+			// status register again.
+			uint32_t receiveAvailable = (status & StatusRxFifoLevel) >> 8;
+			for (uint32_t end = std::min<uint32_t>(len, i + receiveAvailable);
+			     i < end;
+			     ++i)
+			{
+				data[i] = static_cast<uint8_t>(receiveFifo);
+			}
+		}
+	}
+
+	/**
+	 * Receives `len` bytes into `data`, where `len` is at most `0x7ff`, by
+	 * having `dma` copy them out of the receive FIFO.  The copy is paced by
+	 * the board's SPI receive `request` line.
+	 *
+	 * Returns 0 once every byte has been received, or the error from the
+	 * engine's `start` (in which case the SPI block has not been started)
+	 * or from `dma_wait`.
+	 */
+	template<DmaEngine Dma>
+	int blocking_read(Dma     &dma,
+	                  uint8_t  request,
+	                  uint8_t  data[],
+	                  uint16_t len,
+	                  Timeout *timeout) volatile
+	{
+		if (len > 0x7ff)
+		{
+			return -EINVAL;
+		}
+		wait_idle();
+		DmaTransfer transfer{.destination      = data,
+		                     .source           = &receiveFifo,
+		                     .length           = len,
+		                     .sourceAddressing = DmaAddressing::Fixed,
+		                     .request          = request};
+		// Start the engine before the SPI block, so that nothing has been
+		// started if the engine rejects the transfer.  The engine then waits
+		// for the request line.
+		control = ControlReceiveEnable;
+		if (int ret = dma.start({&transfer, 1}); ret != 0)
+		{
+			return ret;
+		}
+		start = len;
+		return dma_wait(dma, timeout);
+	}
+
+	/**
+	 * Sends `len` bytes from `transmitData` while receiving `len` bytes into
+	 * `receiveData`, where `len` is at most `0x7ff`.  This is a single
+	 * full-duplex SPI operation: byte `i` of `receiveData` is the byte that
+	 * the device sent while byte `i` of `transmitData` was being sent.
+	 * The two buffers may be the same, because each byte is sent before the
+	 * byte that replaces it is received.
+	 *
+	 * The transmit FIFO is kept full while the receive FIFO is drained, with
+	 * at most `FifoDepth` bytes in flight so that the receive FIFO cannot
+	 * overflow.  This returns once every byte has been received, at which
+	 * point the device is idle.
+	 */
+	void transfer(const uint8_t transmitData[],
+	              uint8_t       receiveData[],
+	              uint16_t      len) volatile
+	{
+		Debug::Assert(len <= 0x7ff,
+		              "You can't transfer more than 0x7ff bytes at a time.");
+		len &= StartByteCountMask;
+		wait_idle();
+		control = ControlTransmitEnable | ControlReceiveEnable;
+		start   = len;
+
+		uint32_t sent     = 0;
+		uint32_t received = 0;
+		while (received < len)
 		{
-			// Wait for at least one byte to be available in the RX FIFO
-			while ((status & StatusRxFifoLevel) == 0) {}
-			data[i] = static_cast<uint8_t>(receiveFifo);
+			uint32_t currentStatus    = status;
+			uint32_t receiveAvailable =
+			  (currentStatus & StatusRxFifoLevel) >> 8;
+			for (uint32_t end = received + receiveAvailable; received < end;
+			     ++received)
+			{
+				receiveData[received] = static_cast<uint8_t>(receiveFifo);
+			}
+			// Bytes that have been queued but not yet received are in one of
+			// the FIFOs or the shift register, so bound them by the depth of
+			// the receive FIFO.
+			uint32_t space =
+			  std::min(FifoDepth - (currentStatus & StatusTxFifoLevel),
+			           FifoDepth - (sent - received));
+			for (uint32_t end = std::min<uint32_t>(len, sent + space);
+			     sent < end;
+			     ++sent)
+			{
+				transmitFifo = transmitData[sent];
+			}
 		}
 	}
 };
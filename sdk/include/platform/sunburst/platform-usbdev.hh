@@ -2,9 +2,11 @@
 // SPDX-License-Identifier: Apache-2.0
 
 #pragma once
+#include <algorithm>
 #include <cdefs.h>
 #include <optional>
 #include <stdint.h>
+#include <string.h>
 #include <utils.hh>
 
 /**
@@ -497,13 +499,40 @@ class OpenTitanUsbdev : private utils::NoCopyNoMove
 	                 uint8_t         endpointId,
 	                 const uint32_t *data,
 	                 uint8_t         size) volatile
+	{
+		packet_fill(bufferId, data, size);
+		packet_present(bufferId, endpointId, size);
+	}
+
+	/**
+	 * Copy a packet into a buffer without presenting it, so that it can be
+	 * queued and presented later with `packet_present`.
+	 *
+	 * @param bufferId The buffer to use to store the packet.
+	 * @param data The packet to be transmitted.
+	 * @param size The size of the packet.
+	 */
+	void
+	packet_fill(uint8_t bufferId, const uint32_t *data, uint8_t size) volatile
 	{
 		// Transmission of zero length packets is common over USB
 		if (size > 0)
 		{
 			usbdev_transfer(buffer(bufferId), data, size, true);
 		}
+	}
 
+	/**
+	 * Present a buffer that already holds a packet on the specified IN
+	 * endpoint for collection by the USB host controller.
+	 *
+	 * @param bufferId The buffer that stores the packet.
+	 * @param endpointId The IN endpoint used to send the packet.
+	 * @param size The size of the packet.
+	 */
+	void
+	packet_present(uint8_t bufferId, uint8_t endpointId, uint8_t size) volatile
+	{
 		constexpr uint32_t ReadyBit = uint32_t(ConfigInField::Ready);
 		configIn[endpointId]        = bufferId | (size << 8);
 		configIn[endpointId]        = configIn[endpointId] | ReadyBit;
@@ -679,3 +708,318 @@ class OpenTitanUsbdev : private utils::NoCopyNoMove
 		}
 	}
 };
+
+/**
+ * A byte-stream layer over a pair of bulk IN and OUT endpoints of an
+ * `OpenTitanUsbdev`, for example the data interface of a CDC-ACM device.
+ *
+ * The device presents a single buffer per IN endpoint at a time, so this
+ * keeps up to `QueueDepth` filled packet buffers queued in software and
+ * presents the next one as soon as the previous one has been collected.
+ * Received OUT packets are copied into a `QueueDepth`-packet queue and their
+ * buffers are returned to the device immediately.  The OUT endpoint is set to
+ * NAK after each packet and re-enabled only while the queue has space, so
+ * the host is held off rather than packets being dropped.
+ *
+ * The owner of the device remains responsible for the control endpoint and
+ * for fielding interrupts.  On a `PacketSent` interrupt it should call
+ * `packet_sent` before `retrieve_collected_packet`, and it should pass each
+ * packet from `packet_take` to `packet_received`, which returns false for
+ * packets on other endpoints.  This class is not thread-safe: use it from the
+ * thread that handles the device's interrupts or serialise access to it.
+ */
+template<uint8_t QueueDepth = 4>
+class OpenTitanUsbdevBulkStream : private utils::NoCopyNoMove
+{
+	static_assert(QueueDepth > 0, "The queues must hold at least one packet");
+
+	/// The size of a packet, in words.
+	static constexpr size_t PacketWords =
+	  OpenTitanUsbdev::MaxPacketLength / sizeof(uint32_t);
+
+	/// The device.
+	volatile OpenTitanUsbdev *usbdev;
+
+	/// The owner's bitmap of free buffers (1 corresponds to not in use).
+	uint64_t &bufferBitmap;
+
+	/// The IN endpoint that `write` sends on.
+	uint8_t inEndpoint;
+
+	/// The OUT endpoint that `read` receives from.
+	uint8_t outEndpoint;
+
+	/// The packet that is being assembled by `write`.
+	uint32_t inStaging[PacketWords];
+
+	/// The number of bytes in `inStaging`.
+	uint8_t inStagingSize = 0;
+
+	/// Filled buffers waiting to be presented, and their sizes.
+	uint8_t inBuffers[QueueDepth];
+	uint8_t inSizes[QueueDepth];
+
+	/// Index of the next buffer to present and number of queued buffers.
+	uint8_t inHead  = 0;
+	uint8_t inCount = 0;
+
+	/// The buffer presented on the IN endpoint, if `inBusy`.
+	uint8_t inPresented;
+	bool    inBusy = false;
+
+	/// True if the last packet queued was full-sized.
+	bool inLastFull = false;
+
+	/// Received packets, their sizes, and the read offset into the first.
+	uint32_t outPackets[QueueDepth][PacketWords];
+	uint8_t  outSizes[QueueDepth];
+	uint8_t  outHead   = 0;
+	uint8_t  outCount  = 0;
+	uint8_t  outOffset = 0;
+
+	/// Returns the bit for the OUT endpoint in the per-endpoint registers.
+	uint32_t out_bit()
+	{
+		return 1u << outEndpoint;
+	}
+
+	/// Return a buffer to the pool and resupply the device's buffer FIFOs.
+	void buffer_release(uint8_t bufferId)
+	{
+		bufferBitmap |= uint64_t(1) << bufferId;
+		bufferBitmap = usbdev->supply_buffers(bufferBitmap);
+	}
+
+	/// Accept OUT packets again if the receive queue has space.
+	void out_enable_if_space()
+	{
+		if (outCount < QueueDepth)
+		{
+			usbdev->receiveEnableOut = usbdev->receiveEnableOut | out_bit();
+		}
+	}
+
+	/// Present the next queued IN buffer if the endpoint is idle.
+	void in_present_next()
+	{
+		if (inBusy || (inCount == 0))
+		{
+			return;
+		}
+		inPresented = inBuffers[inHead];
+		usbdev->packet_present(inPresented, inEndpoint, inSizes[inHead]);
+		inHead = (inHead + 1) % QueueDepth;
+		inCount--;
+		inBusy = true;
+	}
+
+	/**
+	 * Queue the staged packet.  Returns false if the queue is full or there
+	 * is no free buffer.
+	 */
+	bool in_commit()
+	{
+		if ((inCount == QueueDepth) ||
+		    ((bufferBitmap & ((uint64_t(1) << OpenTitanUsbdev::BufferCount) -
+		                      1)) == 0))
+		{
+			return false;
+		}
+		uint8_t bufferId = __builtin_ctzll(bufferBitmap);
+		bufferBitmap &= ~(uint64_t(1) << bufferId);
+		usbdev->packet_fill(bufferId, inStaging, inStagingSize);
+		uint8_t tail    = (inHead + inCount) % QueueDepth;
+		inBuffers[tail] = bufferId;
+		inSizes[tail]   = inStagingSize;
+		inLastFull      = inStagingSize == OpenTitanUsbdev::MaxPacketLength;
+		inStagingSize   = 0;
+		inCount++;
+		in_present_next();
+		return true;
+	}
+
+	public:
+	/**
+	 * Create a stream over the given endpoints, sharing the device's buffer
+	 * pool through `bufferBitmap` (as initialised by `OpenTitanUsbdev::init`).
+	 * Call `configure` before connecting the device.
+	 */
+	OpenTitanUsbdevBulkStream(volatile OpenTitanUsbdev *usbdev,
+	                          uint64_t                 &bufferBitmap,
+	                          uint8_t                   inEndpoint,
+	                          uint8_t                   outEndpoint)
+	  : usbdev(usbdev),
+	    bufferBitmap(bufferBitmap),
+	    inEndpoint(inEndpoint),
+	    outEndpoint(outEndpoint)
+	{
+	}
+
+	/**
+	 * Enable the IN and OUT endpoints as non-isochronous bulk endpoints, with
+	 * the OUT endpoint set to NAK after each packet.
+	 *
+	 * @returns 0 if configuration is successful, and non-zero otherwise.
+	 */
+	[[nodiscard]] int configure()
+	{
+		if ((usbdev->out_endpoint_configure(outEndpoint, true, false, false) !=
+		     0) ||
+		    (usbdev->in_endpoint_configure(inEndpoint, true, false) != 0))
+		{
+			return -1;
+		}
+		usbdev->setNotAcknowledgeOut = usbdev->setNotAcknowledgeOut | out_bit();
+		return 0;
+	}
+
+	/**
+	 * Queue up to `length` bytes for sending, packing them into full-sized
+	 * packets.  A partial packet is held back until more bytes arrive or
+	 * `flush` is called.
+	 *
+	 * @returns The number of bytes accepted, which is less than `length` if
+	 * the queue is full.  This is the backpressure signal: retry after the
+	 * next `PacketSent` interrupt.
+	 */
+	size_t write(const uint8_t *data, size_t length)
+	{
+		auto  *staging  = reinterpret_cast<uint8_t *>(inStaging);
+		size_t accepted = 0;
+		while (accepted < length)
+		{
+			if ((inStagingSize == OpenTitanUsbdev::MaxPacketLength) &&
+			    !in_commit())
+			{
+				break;
+			}
+			size_t chunk = std::min<size_t>(
+			  length - accepted,
+			  OpenTitanUsbdev::MaxPacketLength - inStagingSize);
+			memcpy(staging + inStagingSize, data + accepted, chunk);
+			inStagingSize += chunk;
+			accepted += chunk;
+		}
+		if (inStagingSize == OpenTitanUsbdev::MaxPacketLength)
+		{
+			in_commit();
+		}
+		return accepted;
+	}
+
+	/**
+	 * Send any partial packet.  If the last packet was full-sized and nothing
+	 * has been written since, send a zero-length packet so that the host
+	 * sees the end of the transfer.
+	 *
+	 * @returns 0 if successful, or -1 if the queue is full, in which case
+	 * the caller should retry after the next `PacketSent` interrupt.
+	 */
+	int flush()
+	{
+		if ((inStagingSize == 0) && !inLastFull)
+		{
+			return 0;
+		}
+		return in_commit() ? 0 : -1;
+	}
+
+	/**
+	 * Returns true if `write` can accept at least one more byte.
+	 */
+	[[nodiscard]] bool writable()
+	{
+		return (inStagingSize < OpenTitanUsbdev::MaxPacketLength) ||
+		       (inCount < QueueDepth);
+	}
+
+	/**
+	 * Copy up to `length` received bytes into `data`.
+	 *
+	 * @returns The number of bytes copied, which is 0 if nothing has been
+	 * received.
+	 */
+	size_t read(uint8_t *data, size_t length)
+	{
+		size_t copied = 0;
+		while ((copied < length) && (outCount > 0))
+		{
+			auto  *packet = reinterpret_cast<uint8_t *>(outPackets[outHead]);
+			size_t chunk =
+			  std::min<size_t>(length - copied, outSizes[outHead] - outOffset);
+			memcpy(data + copied, packet + outOffset, chunk);
+			copied += chunk;
+			outOffset += chunk;
+			if (outOffset == outSizes[outHead])
+			{
+				outHead   = (outHead + 1) % QueueDepth;
+				outOffset = 0;
+				outCount--;
+			}
+		}
+		out_enable_if_space();
+		return copied;
+	}
+
+	/**
+	 * Returns the number of received bytes that `read` can return.
+	 */
+	[[nodiscard]] size_t readable()
+	{
+		size_t bytes = 0;
+		for (uint8_t i = 0; i < outCount; i++)
+		{
+			bytes += outSizes[(outHead + i) % QueueDepth];
+		}
+		return bytes - outOffset;
+	}
+
+	/**
+	 * Handle a packet taken from the device's receive FIFO.  If it is for
+	 * this stream's OUT endpoint, queue its data and return the buffer to
+	 * the device.
+	 *
+	 * @returns True if the packet was for this stream, false otherwise.
+	 */
+	bool packet_received(OpenTitanUsbdev::ReceiveBufferInfo info)
+	{
+		if ((info.endpoint_id() != outEndpoint) || info.is_setup())
+		{
+			return false;
+		}
+		// The endpoint NAKs after each packet and is re-enabled only while
+		// there is space, so the queue cannot be full here.
+		uint8_t tail = (outHead + outCount) % QueueDepth;
+		usbdev->packet_data_get(info, outPackets[tail]);
+		outSizes[tail] = info.size();
+		// Zero-length packets carry nothing for a byte stream.
+		if (outSizes[tail] != 0)
+		{
+			outCount++;
+		}
+		buffer_release(info.buffer_id());
+		out_enable_if_space();
+		return true;
+	}
+
+	/**
+	 * Handle a `PacketSent` interrupt.  If the host has collected the packet
+	 * presented on this stream's IN endpoint, release its buffer and present
+	 * the next queued packet.
+	 *
+	 * @returns True if this stream's packet was collected, false otherwise.
+	 */
+	bool packet_sent()
+	{
+		const uint32_t Bit = 1u << inEndpoint;
+		if (!inBusy || !(usbdev->inSent & Bit))
+		{
+			return false;
+		}
+		usbdev->inSent = Bit;
+		inBusy         = false;
+		buffer_release(inPresented);
+		in_present_next();
+		return true;
+	}
+};
@@ -0,0 +1,184 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <locks.h>
+#include <queue.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <timeout.h>
+
+/**
+ * Publish-subscribe message bus with zero-copy fan-out.
+ *
+ * Each published message is allocated once.  Every subscriber receives, over
+ * its own message queue, a read-only capability to the same allocation,
+ * which the bus claims against the subscriber's quota before delivering it.
+ * The publisher's reference is dropped once the message has been delivered,
+ * so the message is freed when the last subscriber releases it with
+ * `pubsub_release`.  A subscriber that never releases its messages exhausts
+ * its own quota rather than the publisher's.  Publishers and subscribers may
+ * share a quota.
+ *
+ * Subscribers give the bus the allocator capability for the quota that their
+ * messages are charged to, and publishers use it to claim messages, so this
+ * is for compartments that trust each other not to misuse that quota.  A
+ * subscriber should therefore pass a capability for a quota that is used only
+ * for its subscription.
+ *
+ * The bus is a library: publishing and subscribing do not require
+ * cross-compartment calls, except into the allocator and when a queue
+ * operation blocks.
+ */
+
+/**
+ * A subscription to a bus.
+ */
+struct PubSubSubscription
+{
+	/**
+	 * The queue of messages for this subscriber.  Each element is a
+	 * read-only pointer to a message.  This may be passed to
+	 * `multiwaiter_queue_receive_init` to wait for messages.
+	 */
+	struct MessageQueue *queue;
+	/**
+	 * The allocator capability for the quota that this subscriber's claims
+	 * on messages are charged to.
+	 */
+	struct SObjStruct *heap;
+	/**
+	 * The number of messages that could not be delivered to this subscriber
+	 * because its queue was full or its quota was exhausted.
+	 */
+	uint32_t dropped;
+};
+
+/**
+ * A message bus.  The subscriptions are stored after this header.
+ */
+struct PubSubBus
+{
+	/// Lock protecting the list of subscriptions.
+	struct FlagLockState lock;
+	/// The maximum number of subscriptions.
+	uint16_t capacity;
+	/// The number of slots in `subscriptions` that are in use.
+	uint16_t count;
+	/// The subscriptions.  The first `count` entries are valid.
+	struct PubSubSubscription *subscriptions[];
+};
+
+__BEGIN_DECLS
+
+/**
+ * Allocate a bus for at most `maxSubscribers` subscriptions from
+ * `heapCapability` and store it in `*outBus`.
+ *
+ * Returns 0 on success, `-ENOMEM` on allocation failure, or `-EINVAL` if
+ * `maxSubscribers` is zero or too large.
+ */
+int __cheri_libcall pubsub_create(Timeout            *timeout,
+                                  struct SObjStruct  *heapCapability,
+                                  struct PubSubBus  **outBus,
+                                  size_t              maxSubscribers);
+
+/**
+ * Free a bus.  The bus must have no subscriptions.
+ *
+ * Returns 0 on success, `-EBUSY` if there are subscriptions, or the error
+ * from `heap_free`.
+ */
+int __cheri_libcall pubsub_destroy(struct SObjStruct *heapCapability,
+                                   struct PubSubBus  *bus);
+
+/**
+ * Subscribe to `bus`.  The subscription and its queue of `queueLength`
+ * messages are allocated from `heapCapability`, which is also the quota that
+ * delivered messages are claimed against.  The subscription is stored in
+ * `*outSubscription`.
+ *
+ * Returns 0 on success, `-ENOMEM` on allocation failure, `-ENOSPC` if the
+ * bus has no free subscription slots, `-ETIMEDOUT` if the bus lock could not
+ * be acquired in time, or `-EINVAL` if the arguments are invalid.
+ */
+int __cheri_libcall
+pubsub_subscribe(Timeout                    *timeout,
+                 struct SObjStruct          *heapCapability,
+                 struct PubSubBus           *bus,
+                 struct PubSubSubscription **outSubscription,
+                 size_t                      queueLength);
+
+/**
+ * Remove `subscription` from `bus`, release any messages still in its
+ * queue, and free it.  `heapCapability` must be the one passed to
+ * `pubsub_subscribe`.
+ *
+ * Returns 0 on success, `-ENOENT` if the subscription is not on this bus, or
+ * `-ETIMEDOUT` if the bus lock could not be acquired in time.
+ */
+int __cheri_libcall
+pubsub_unsubscribe(Timeout                   *timeout,
+                   struct SObjStruct         *heapCapability,
+                   struct PubSubBus          *bus,
+                   struct PubSubSubscription *subscription);
+
+/**
+ * Publish `message`, which must be an allocation from `heapCapability`.  The
+ * bus takes ownership of the message: the caller must not use `message`
+ * after this returns, whether or not it succeeds.
+ *
+ * The timeout covers acquiring the bus lock and sending to every subscriber.
+ * A subscriber whose queue is still full when the timeout expires, or whose
+ * quota cannot hold another claim, does not receive the message and has its
+ * `dropped` count incremented.  With a zero timeout, publishing never blocks
+ * on slow subscribers.
+ *
+ * Returns the number of subscribers that the message was delivered to,
+ * `-ETIMEDOUT` if the bus lock could not be acquired in time, or `-EINVAL` if
+ * the arguments are invalid.
+ */
+int __cheri_libcall
+pubsub_publish_allocated(Timeout           *timeout,
+                         struct SObjStruct *heapCapability,
+                         struct PubSubBus  *bus,
+                         void              *message);
+
+/**
+ * Copy `length` bytes from `data` into a new message allocated from
+ * `heapCapability` and publish it as with `pubsub_publish_allocated`.  This
+ * is the only copy of the data, however many subscribers there are.
+ *
+ * Returns the number of subscribers that the message was delivered to,
+ * `-ENOMEM` if the message could not be allocated, or an error from
+ * `pubsub_publish_allocated`.
+ */
+int __cheri_libcall pubsub_publish(Timeout           *timeout,
+                                   struct SObjStruct *heapCapability,
+                                   struct PubSubBus  *bus,
+                                   const void        *data,
+                                   size_t             length);
+
+/**
+ * Receive the next message for `subscription`, storing a read-only pointer to
+ * it in `*message`.  The message remains valid until it is passed to
+ * `pubsub_release`.  Its length is the length of the capability.
+ *
+ * Returns 0 on success, or an error from `queue_receive`.
+ */
+int __cheri_libcall pubsub_receive(Timeout                   *timeout,
+                                   struct PubSubSubscription *subscription,
+                                   const void               **message);
+
+/**
+ * Release a message received from `subscription`.  The message is freed once
+ * every subscriber that received it has released it.
+ *
+ * Returns 0 on success or the error from `heap_free`.
+ */
+int __cheri_libcall pubsub_release(struct PubSubSubscription *subscription,
+                                   const void                *message);
+
+__END_DECLS
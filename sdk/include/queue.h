@@ -64,10 +64,66 @@ struct MessageQueue
 #endif
 };
 
+/**
+ * The number of buckets in the time-in-queue histogram reported by
+ * `queue_statistics`.
+ */
+#define QUEUE_STATISTICS_HISTOGRAM_BUCKETS 12
+
+/**
+ * Statistics for a queue that was created with
+ * `queue_create_with_statistics` (or initialised with
+ * `queue_statistics_init`).  All counters are cumulative since the queue was
+ * created and may wrap.  Times are in cycles.
+ */
+struct MessageQueueStatistics
+{
+	/// The number of elements sent.
+	uint32_t sends;
+	/// The number of elements received.
+	uint32_t receives;
+	/// The number of sends that waited for the queue to become non-full.
+	uint32_t blockedSends;
+	/// The number of receives that waited for the queue to become non-empty.
+	uint32_t blockedReceives;
+	/// The largest number of elements that the queue has held.
+	uint32_t maxOccupancy;
+	/// The longest time that an element has spent in the queue.
+	uint32_t maxTimeInQueue;
+	/**
+	 * Histogram of the time that elements spent in the queue.  Bucket 0
+	 * counts elements received less than 256 cycles after they were sent,
+	 * bucket `n` counts elements received between `2^(n+7)` and `2^(n+8)`
+	 * cycles after they were sent, and the last bucket counts all slower
+	 * elements.
+	 */
+	uint32_t timeInQueueHistogram[QUEUE_STATISTICS_HISTOGRAM_BUCKETS];
+};
+
 _Static_assert(sizeof(struct MessageQueue) % sizeof(void *) == 0,
                "MessageQueue structure must end correctly aligned for storing "
                "capabilities.");
 
+/**
+ * A view of a queue that can be used only for sending or only for receiving,
+ * with the library functions `queue_send_view` and `queue_receive_view`.
+ * Views are created from sealed endpoints with
+ * `queue_send_view_create_sealed` and `queue_receive_view_create_sealed`.
+ */
+struct MessageQueueView
+{
+	/**
+	 * The queue metadata.  This capability covers only the `MessageQueue`
+	 * structure and not the elements.
+	 */
+	struct MessageQueue *queue;
+	/**
+	 * The elements of the queue.  For a send view, this cannot be used to
+	 * load and, for a receive view, this cannot be used to store.
+	 */
+	void *buffer;
+};
+
 __BEGIN_DECLS
 
 /**
@@ -97,6 +153,104 @@ int __cheri_libcall queue_create(Timeout              *timeout,
                                  size_t                elementSize,
                                  size_t                elementCount);
 
+/**
+ * Allocates a queue in the same way as `queue_create`, for use by exactly one
+ * sending thread and one receiving thread.
+ *
+ * The send and receive functions on this queue do not acquire any locks.  Each
+ * end updates only its own counter, with release semantics, and waits on (or
+ * wakes) the futex only when the queue is full or empty.  The queue has the
+ * same layout as any other and works with the multiwaiter.
+ *
+ * The caller is responsible for ensuring that no more than one thread sends
+ * and one thread receives at a time.  Concurrent senders or concurrent
+ * receivers may corrupt the queue's contents (but not the memory around it).
+ */
+int __cheri_libcall
+queue_create_single_producer_consumer(Timeout              *timeout,
+                                      struct SObjStruct    *heapCapability,
+                                      struct MessageQueue **outQueue,
+                                      size_t                elementSize,
+                                      size_t                elementCount);
+
+/**
+ * Allocates a queue in the same way as `queue_create`, with a wake-one policy
+ * for its locks.
+ *
+ * Each end of a queue has a lock that serialises senders or receivers.  By
+ * default, releasing a lock wakes every thread waiting for it, so when several
+ * threads are blocked receiving from one queue, each message wakes all of them
+ * and all but one go back to sleep.  With the wake-one policy, releasing a
+ * lock wakes only the highest-priority waiter.  Use this for queues that feed
+ * a pool of worker threads.
+ *
+ * Wake-ups for a queue becoming non-empty or non-full are unchanged and still
+ * wake all waiters, including multiwaiters.
+ */
+int __cheri_libcall queue_create_wake_one(Timeout              *timeout,
+                                          struct SObjStruct    *heapCapability,
+                                          struct MessageQueue **outQueue,
+                                          size_t                elementSize,
+                                          size_t                elementCount);
+
+/**
+ * Set the wake-one policy (see `queue_create_wake_one`) on a queue that has
+ * just been constructed and is not yet in use.  This is intended for code that
+ * places queues in its own memory, using `queue_allocation_size`.
+ */
+void __cheri_libcall queue_wake_one_init(struct MessageQueue *handle);
+
+/**
+ * Returns the allocation size needed for a queue with the specified number and
+ * size of elements that collects statistics (see
+ * `queue_create_with_statistics`).
+ *
+ * Returns the allocation size on success, or `-EINVAL` if the arguments would
+ * cause an overflow.
+ */
+ssize_t __cheri_libcall queue_statistics_allocation_size(size_t elementSize,
+                                                         size_t elementCount);
+
+/**
+ * Allocates a queue in the same way as `queue_create`, which also records
+ * when each element is sent and collects the statistics in
+ * `MessageQueueStatistics`.  These can be read with `queue_statistics`.
+ *
+ * Collecting statistics adds a cycle-counter read and a few stores to each
+ * operation, and needs four bytes per element and the size of
+ * `MessageQueueStatistics` in addition to the queue.  Operations through a
+ * `MessageQueueView` are not counted.
+ */
+int __cheri_libcall
+queue_create_with_statistics(Timeout              *timeout,
+                             struct SObjStruct    *heapCapability,
+                             struct MessageQueue **outQueue,
+                             size_t                elementSize,
+                             size_t                elementCount);
+
+/**
+ * Enable statistics on a queue that has just been constructed and is not yet
+ * in use, in memory of at least the size returned by
+ * `queue_statistics_allocation_size`.  This is intended for code that places
+ * queues in its own memory.  Record and priority queues do not support
+ * statistics.
+ */
+void __cheri_libcall queue_statistics_init(struct MessageQueue *handle);
+
+/**
+ * Copy the statistics for the queue specified by `handle` to `statistics`.
+ *
+ * Returns 0 on success, `-ENOTSUP` if the queue does not collect statistics,
+ * or `-EPERM` if `statistics` is not writeable.
+ *
+ * Note: As with `queue_items_remaining`, the queue may be in use while the
+ * statistics are copied, so the counters may not be consistent with each
+ * other.
+ */
+int __cheri_libcall
+queue_statistics(struct MessageQueue           *handle,
+                 struct MessageQueueStatistics *statistics);
+
 /**
  * Destroys a queue. This wakes up all threads waiting to produce or consume,
  * and makes them fail to acquire the lock, before deallocating the underlying
@@ -139,6 +293,121 @@ int __cheri_libcall queue_receive(Timeout             *timeout,
                                   struct MessageQueue *handle,
                                   void                *dst);
 
+/**
+ * Send a message via a view returned from `queue_send_view_create_sealed`.
+ * This behaves in the same way as `queue_send`, but runs in the caller's
+ * compartment.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the timeout was exhausted, or
+ * `-EPERM` if `src` or the view is not valid (for example, because it is a
+ * receive view or the queue has been destroyed).
+ */
+int __cheri_libcall queue_send_view(Timeout                       *timeout,
+                                    const struct MessageQueueView *view,
+                                    const void                    *src);
+
+/**
+ * Receive a message via a view returned from
+ * `queue_receive_view_create_sealed`.  This behaves in the same way as
+ * `queue_receive`, but runs in the caller's compartment.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the timeout was exhausted, or
+ * `-EPERM` if `dst` or the view is not valid (for example, because it is a
+ * send view or the queue has been destroyed).
+ */
+int __cheri_libcall queue_receive_view(Timeout                       *timeout,
+                                       const struct MessageQueueView *view,
+                                       void                          *dst);
+
+/**
+ * Send up to `count` messages to the queue specified by `handle`, copying them
+ * from the contiguous array at `src`.  This blocks only until there is space
+ * for at least one message and then sends as many as fit, in a single
+ * acquisition of the send lock.
+ *
+ * Returns the number of messages sent (0 if `count` is zero) on success.  On
+ * failure, returns `-ETIMEDOUT` if the timeout was exhausted before any
+ * message could be sent, or `-EPERM` if `src` is not valid for the number of
+ * messages that the queue had space for.  Nothing is sent on failure.
+ */
+ssize_t __cheri_libcall queue_send_multiple(Timeout             *timeout,
+                                            struct MessageQueue *handle,
+                                            const void          *src,
+                                            size_t               count);
+
+/**
+ * Receive up to `count` messages from the queue specified by `handle` into the
+ * contiguous array at `dst`.  This blocks only until there is at least one
+ * message in the queue and then receives as many as are available, in a
+ * single acquisition of the receive lock.
+ *
+ * Returns the number of messages received (0 if `count` is zero) on success.
+ * On failure, returns `-ETIMEDOUT` if the timeout was exhausted before any
+ * message arrived, or `-EPERM` if `dst` is not valid for the number of
+ * messages that were available.  Nothing is received on failure.
+ */
+ssize_t __cheri_libcall queue_receive_multiple(Timeout             *timeout,
+                                               struct MessageQueue *handle,
+                                               void                *dst,
+                                               size_t               count);
+
+/**
+ * Reserve the next free slot in the queue specified by `handle` so that the
+ * caller can construct a message in place, without copying.  Waits until the
+ * queue has space for a message and then stores via `slot` a capability to
+ * exactly one element.  The slot capability does not have global permission
+ * and so cannot be captured.  The message becomes visible to receivers only
+ * when the caller passes the slot to `queue_send_commit`.
+ *
+ * For queues with multiple producers, this holds the send lock until
+ * `queue_send_commit` is called.  Other senders block in the meantime, so a
+ * compartment that may fault while filling the slot should commit from its
+ * error handler.  A faulting producer cannot corrupt the queue: the slot
+ * covers only one element and the counters are not exposed.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the timeout expired, `-EINVAL` if the
+ * queue's elements are too large to be given exact bounds, and `-EPERM` if
+ * `slot` is not writeable.
+ */
+int __cheri_libcall queue_send_reserve(Timeout             *timeout,
+                                       struct MessageQueue *handle,
+                                       void               **slot);
+
+/**
+ * Publish the message in `slot`, which must have been returned by
+ * `queue_send_reserve` on `handle`.
+ *
+ * Returns 0 on success or `-EINVAL` if `slot` is not the reserved slot.
+ */
+int __cheri_libcall queue_send_commit(struct MessageQueue *handle, void *slot);
+
+/**
+ * Wait for a message in the queue specified by `handle` and store via `slot`
+ * a read-only, non-capturable capability to it, in place in the queue.  The
+ * message remains in the queue until the caller passes the slot to
+ * `queue_receive_release`.
+ *
+ * For queues with multiple consumers, this holds the receive lock until
+ * `queue_receive_release` is called.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the timeout expired, `-EINVAL` if the
+ * queue's elements are too large to be given exact bounds, and `-EPERM` if
+ * `slot` is not writeable.
+ */
+int __cheri_libcall queue_receive_peek(Timeout             *timeout,
+                                       struct MessageQueue *handle,
+                                       const void         **slot);
+
+/**
+ * Remove the message in `slot`, which must have been returned by
+ * `queue_receive_peek` on `handle`, from the queue.  The caller must not use
+ * `slot` after this call.
+ *
+ * Returns 0 on success or `-EINVAL` if `slot` is not the peeked slot.
+ */
+int __cheri_libcall queue_receive_release(struct MessageQueue *handle,
+                                          const void          *slot);
+
 /**
  * Returns the number of items in the queue specified by `handle` via `items`.
  *
@@ -153,6 +422,127 @@ int __cheri_libcall queue_receive(Timeout             *timeout,
 int __cheri_libcall queue_items_remaining(struct MessageQueue *handle,
                                           size_t              *items);
 
+/**
+ * Allocates a record queue, which holds variable-length records in a ring of
+ * `capacity` bytes (rounded up to a multiple of four).  Each record occupies
+ * its length plus a four-byte header, rounded up to a multiple of four.  A
+ * record is never split across the end of the ring, so a record queue can
+ * hold any single record that fits in `capacity` bytes but the remaining
+ * space before the end of the ring is lost when the next record does not fit
+ * there.
+ *
+ * Record queues are `MessageQueue`s with one-byte elements and must be used
+ * only with the `record_queue_*` functions (and `queue_destroy`,
+ * `queue_items_remaining`, which reports the number of bytes in use, and
+ * `multiwaiter_queue_receive_init`).
+ *
+ * Returns 0 on success, or the same errors as `queue_create`.
+ */
+int __cheri_libcall record_queue_create(Timeout              *timeout,
+                                        struct SObjStruct    *heapCapability,
+                                        struct MessageQueue **outQueue,
+                                        size_t                capacity);
+
+/**
+ * Append a copy of the `length` bytes at `src` to the record queue `handle`
+ * as a single record, waiting until there is space for it.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the timeout was exhausted,
+ * `-EMSGSIZE` if the record can never fit in the queue, or `-EPERM` if `src`
+ * is not valid for `length` bytes.
+ */
+int __cheri_libcall record_queue_send(Timeout             *timeout,
+                                      struct MessageQueue *handle,
+                                      const void          *src,
+                                      size_t               length);
+
+/**
+ * Remove the next record from the record queue `handle` and copy it to `dst`,
+ * which has space for `dstLength` bytes, waiting until there is a record.
+ *
+ * Returns the length of the record on success, `-ETIMEDOUT` if the timeout was
+ * exhausted, `-ENOBUFS` if the record is larger than `dstLength` (the record
+ * is left in the queue), or `-EPERM` if `dst` is not valid.
+ */
+ssize_t __cheri_libcall record_queue_receive(Timeout             *timeout,
+                                             struct MessageQueue *handle,
+                                             void                *dst,
+                                             size_t               dstLength);
+
+/**
+ * Wait for a record in the record queue `handle` and store via `record` a
+ * read-only, non-capturable capability to its payload, in place in the
+ * queue.  This holds the receive lock until the record is passed to
+ * `record_queue_release`.
+ *
+ * Returns the length of the record on success, `-ETIMEDOUT` if the timeout was
+ * exhausted, `-EINVAL` if the queue is corrupt, or `-EPERM` if `record` is not
+ * writeable.
+ */
+ssize_t __cheri_libcall record_queue_peek(Timeout             *timeout,
+                                          struct MessageQueue *handle,
+                                          const void         **record);
+
+/**
+ * Remove the record returned by `record_queue_peek` from the record queue
+ * `handle`.  The caller must not use `record` after this call.
+ *
+ * Returns 0 on success or `-EINVAL` if `record` is not the peeked record.
+ */
+int __cheri_libcall record_queue_release(struct MessageQueue *handle,
+                                         const void          *record);
+
+/**
+ * Allocates a priority queue, which holds up to `elementCount` elements of
+ * `elementSize` bytes, each sent with one of `levels` priority levels (at
+ * most 8).  `priority_queue_receive` always returns the oldest element with
+ * the highest priority, so urgent messages are not delayed behind bulk
+ * traffic that shares the queue.
+ *
+ * Each level has its own ring with space for `elementCount` elements, so a
+ * priority queue uses `levels` times as much memory for elements as a queue
+ * from `queue_create`.
+ *
+ * Priority queues must be used only with the `priority_queue_*` functions
+ * (and `queue_destroy`, `queue_items_remaining`, which reports the number of
+ * elements at all levels, and the multiwaiter initialisation functions, which
+ * cover all levels).
+ *
+ * Returns 0 on success, or the same errors as `queue_create`.  Returns
+ * `-EINVAL` if `levels` is zero or too large.
+ */
+int __cheri_libcall priority_queue_create(Timeout              *timeout,
+                                          struct SObjStruct    *heapCapability,
+                                          struct MessageQueue **outQueue,
+                                          size_t                elementSize,
+                                          size_t                elementCount,
+                                          size_t                levels);
+
+/**
+ * Send a message to the priority queue `handle` with priority `priority`,
+ * which must be less than the number of levels.  Higher values are received
+ * first.  Waits until there is space in the queue.
+ *
+ * Returns 0 on success, `-ETIMEDOUT` if the timeout was exhausted, `-EINVAL`
+ * if `priority` is out of range, or `-EPERM` if `src` is not valid.
+ */
+int __cheri_libcall priority_queue_send(Timeout             *timeout,
+                                        struct MessageQueue *handle,
+                                        const void          *src,
+                                        uint32_t             priority);
+
+/**
+ * Receive the oldest message with the highest priority from the priority
+ * queue `handle` into `dst`, waiting until there is a message.
+ *
+ * Returns the priority of the message on success, `-ETIMEDOUT` if the
+ * timeout was exhausted, `-EINVAL` if the queue is corrupt, or `-EPERM` if
+ * `dst` is not valid.
+ */
+int __cheri_libcall priority_queue_receive(Timeout             *timeout,
+                                           struct MessageQueue *handle,
+                                           void                *dst);
+
 /**
  * Allocate a new message queue that is managed by the message queue
  * compartment.  The resulting queue handle (returned in `outQueue`) is a
@@ -166,6 +556,18 @@ int __cheri_compartment("message_queue")
                       size_t              elementSize,
                       size_t              elementCount);
 
+/**
+ * Allocate a new message queue that is managed by the message queue
+ * compartment, as with `queue_create_sealed`, with the wake-one policy
+ * described for `queue_create_wake_one`.
+ */
+int __cheri_compartment("message_queue")
+  queue_create_sealed_wake_one(Timeout            *timeout,
+                               struct SObjStruct  *heapCapability,
+                               struct SObjStruct **outQueue,
+                               size_t              elementSize,
+                               size_t              elementCount);
+
 /**
  * Destroy a queue handle.  If this is called on a restricted endpoint
  * (returned from `queue_receive_handle_create_sealed` or
@@ -198,6 +600,30 @@ int __cheri_compartment("message_queue")
 int __cheri_compartment("message_queue")
   queue_receive_sealed(Timeout *timeout, struct SObjStruct *handle, void *dst);
 
+/**
+ * Send up to `count` messages via a sealed queue endpoint.  This behaves in
+ * the same way as `queue_send_multiple`, except that it will return `-EINVAL`
+ * if the endpoint is not a valid sending endpoint and may return
+ * `-ECOMPARTMENTFAIL` if the queue is destroyed during the call.
+ */
+ssize_t __cheri_compartment("message_queue")
+  queue_send_multiple_sealed(Timeout           *timeout,
+                             struct SObjStruct *handle,
+                             const void        *src,
+                             size_t             count);
+
+/**
+ * Receive up to `count` messages via a sealed queue endpoint.  This behaves in
+ * the same way as `queue_receive_multiple`, except that it will return
+ * `-EINVAL` if the endpoint is not a valid receiving endpoint and may return
+ * `-ECOMPARTMENTFAIL` if the queue is destroyed during the call.
+ */
+ssize_t __cheri_compartment("message_queue")
+  queue_receive_multiple_sealed(Timeout           *timeout,
+                                struct SObjStruct *handle,
+                                void              *dst,
+                                size_t             count);
+
 /**
  * Returns, via `items`, the number of items in the queue specified by `handle`.
  * Returns 0 on success.
@@ -209,6 +635,29 @@ int __cheri_compartment("message_queue")
 int __cheri_compartment("message_queue")
   queue_items_remaining_sealed(struct SObjStruct *handle, size_t *items);
 
+/**
+ * Allocate a new message queue that is managed by the message queue
+ * compartment, as with `queue_create_sealed`, that collects statistics as
+ * described for `queue_create_with_statistics`.
+ */
+int __cheri_compartment("message_queue")
+  queue_create_sealed_with_statistics(Timeout            *timeout,
+                                      struct SObjStruct  *heapCapability,
+                                      struct SObjStruct **outQueue,
+                                      size_t              elementSize,
+                                      size_t              elementCount);
+
+/**
+ * Copy the statistics for the queue specified by `handle`, which may be
+ * either endpoint or the queue handle, to `statistics`.
+ *
+ * Returns 0 on success, `-EINVAL` if the handle or `statistics` is not valid,
+ * or `-ENOTSUP` if the queue does not collect statistics.
+ */
+int __cheri_compartment("message_queue")
+  queue_statistics_sealed(struct SObjStruct             *handle,
+                          struct MessageQueueStatistics *statistics);
+
 /**
  * Initialise an event waiter source so that it will wait for the queue to be
  * ready to receive.  Note that this is inherently racy because another consumer
@@ -279,4 +728,34 @@ int __cheri_compartment("message_queue")
                                   struct SObjStruct  *handle,
                                   struct SObjStruct **outHandle);
 
+/**
+ * Create a send view (see `MessageQueueView`) from a send endpoint or a queue
+ * handle, so that later messages can be sent with `queue_send_view` without
+ * calling into the message queue compartment.  The view can store messages
+ * into the queue but cannot read them.
+ *
+ * The view exposes the queue's metadata, including its counters, to the
+ * caller.  A caller that corrupts them can stop the queue from working but
+ * cannot read or write memory outside the queue, or read messages.  Use the
+ * sealed interfaces between compartments that must be protected from each
+ * other's bugs.
+ *
+ * Returns 0 on success and writes the view via `outView`.  Returns `-EINVAL`
+ * if the handle is not valid, `outView` is not writeable, or the queue's
+ * elements cannot be given exact bounds.
+ */
+int __cheri_compartment("message_queue")
+  queue_send_view_create_sealed(struct SObjStruct       *handle,
+                                struct MessageQueueView *outView);
+
+/**
+ * Create a receive view from a receive endpoint or a queue handle, as for
+ * `queue_send_view_create_sealed`.  Messages can then be received with
+ * `queue_receive_view`.  The view can load messages from the queue but cannot
+ * store into it.
+ */
+int __cheri_compartment("message_queue")
+  queue_receive_view_create_sealed(struct SObjStruct       *handle,
+                                   struct MessageQueueView *outView);
+
 __END_DECLS
@@ -0,0 +1,133 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <atomic>
+#include <cdefs.h>
+#include <errno.h>
+#include <new>
+#include <stdlib.h>
+#include <timeout.h>
+#include <type_traits>
+#include <utility>
+
+/**
+ * A read-copy-update pointer to a heap-allocated, read-mostly value of type
+ * `T`, such as a routing or access-control table.
+ *
+ * Readers load the published pointer and claim it with the fast claims
+ * (hazard pointer) mechanism, without taking a lock or making a
+ * cross-compartment call.  Writers build a new version and publish it, which
+ * frees the old one.  The allocator does not reclaim an object while any
+ * thread has it in a hazard slot, and a thread's slots are cleared by its
+ * next cross-compartment call or fast claim, so that call is the reader's
+ * quiescent point: the old version is reclaimed once every reader that might
+ * be using it has passed one.
+ *
+ * The pointer returned by `read` must not be used after the reader makes a
+ * cross-compartment call or another fast claim.  Using it afterwards traps
+ * (rather than reading reclaimed memory) if a writer has replaced it.
+ *
+ * Writers are not serialised against each other: concurrent calls to
+ * `publish` are safe, but concurrent calls to `update` may lose one of the
+ * updates, so firmware with more than one writer should serialise them with
+ * a lock.
+ *
+ * Old versions are freed without running their destructor, because readers
+ * may still be using them, so `T` must be trivially destructible.  This
+ * requires the `compartment_helpers` library, which provides the fast claims
+ * mechanism.
+ */
+template<typename T>
+class RcuPointer
+{
+	static_assert(std::is_trivially_destructible_v<T>,
+	              "RCU versions are freed without being destroyed");
+
+	/// The current version, or null if none has been published.
+	std::atomic<T *> current = nullptr;
+
+	public:
+	/**
+	 * Returns the current version, claimed for the calling thread until its
+	 * next cross-compartment call or fast claim, or null if no version has
+	 * been published or the claim timed out.
+	 */
+	const T *read(Timeout *timeout) const
+	{
+		for (;;)
+		{
+			T *version = current.load(std::memory_order_acquire);
+			if (version == nullptr)
+			{
+				return nullptr;
+			}
+			int claimed = heap_claim_fast(timeout, version);
+			if (claimed == -ETIMEDOUT)
+			{
+				return nullptr;
+			}
+			// If the claim failed because the version was freed, or a writer
+			// replaced it before the claim was visible, try the new one.
+			if ((claimed == 0) &&
+			    (current.load(std::memory_order_acquire) == version))
+			{
+				return version;
+			}
+		}
+	}
+
+	/**
+	 * Returns the current version, as `read`, waiting as long as necessary
+	 * for the claim.
+	 */
+	const T *read() const
+	{
+		Timeout t{UnlimitedTimeout};
+		return read(&t);
+	}
+
+	/**
+	 * Publish `version`, which must have been allocated from `heap`, and free
+	 * the previous version.  Readers that have already claimed the previous
+	 * version can continue to use it until their next quiescent point.
+	 *
+	 * Returns 0 on success or the error from `heap_free` if the previous
+	 * version could not be freed.
+	 */
+	int publish(struct SObjStruct *heap, T *version)
+	{
+		T *old = current.exchange(version, std::memory_order_acq_rel);
+		if (old == nullptr)
+		{
+			return 0;
+		}
+		return heap_free(heap, old);
+	}
+
+	/**
+	 * Allocate a copy of the current version (or a value-initialised `T` if
+	 * none has been published) from `heap`, call `fn` with a reference to it
+	 * to modify it, and publish the copy.
+	 *
+	 * Returns 0 on success, `-ENOMEM` if the copy could not be allocated
+	 * before `timeout` expired, or an error from `publish`.
+	 */
+	template<typename Fn>
+	int update(Timeout *timeout, struct SObjStruct *heap, Fn &&fn)
+	{
+		void *storage = heap_allocate(timeout, heap, sizeof(T));
+		if (!__builtin_cheri_tag_get(storage))
+		{
+			return -ENOMEM;
+		}
+		// This thread is the writer, so the current version cannot be freed
+		// while it is copied.
+		T *old     = current.load(std::memory_order_acquire);
+		T *version = (old == nullptr) ? new (storage) T{}
+		                              : new (storage) T{std::as_const(*old)};
+		std::forward<Fn>(fn)(*version);
+		return publish(heap, version);
+	}
+};
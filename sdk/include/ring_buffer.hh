@@ -1,5 +1,7 @@
 
 #pragma once
+#include <algorithm>
+#include <array>
 #include <limits>
 #include <locks.hh>
 #include <thread.h>
@@ -20,12 +22,23 @@
  * issue a `futex_wake` cross-compartment call. If locks are used, they may
  * introduce additional cross-compartment calls.
  *
+ * The last two template arguments are watermarks that control when blocked
+ * threads are woken.  Consumers are woken when the number of messages in the
+ * ring rises to `HighWatermark` and producers are woken when it falls to
+ * `LowWatermark`.  The defaults wake on the transitions to non-empty and
+ * non-full.  Raising the high watermark (or lowering the low watermark)
+ * batches wakeups, but a consumer blocked on an empty ring is not woken until
+ * the high watermark is reached, so producers must be able to fill the ring
+ * to that level.
+ *
  * Note: The size must be a power of two.
  */
 template<typename Message,
          size_t BufferSize,
-         typename PushLock = NoLock,
-         typename PopLock  = NoLock>
+         typename PushLock    = NoLock,
+         typename PopLock     = NoLock,
+         size_t HighWatermark = 1,
+         size_t LowWatermark  = BufferSize - 1>
 class RingBuffer
 {
 	/// The ring buffer.
@@ -44,6 +57,10 @@ class RingBuffer
 	              "counter types or overflow will give incorrect values");
 	static_assert((1 << utils::log2<BufferSize>()) == BufferSize,
 	              "Buffer size must be a power of two");
+	static_assert((HighWatermark > 0) && (HighWatermark <= BufferSize),
+	              "The high watermark must be reachable from an empty ring");
+	static_assert(LowWatermark < BufferSize,
+	              "The low watermark must be reachable from a full ring");
 
 	/**
 	 * Helper to check if the ring is full.  The counters are free running and
@@ -74,6 +91,47 @@ class RingBuffer
 		return counter % BufferSize;
 	}
 
+	/**
+	 * Publish `count` messages that have been written after the producer
+	 * counter, waking consumers if this takes the ring to the high watermark.
+	 * Must be called with the push lock held.  Returns true if consumers
+	 * should be woken once the lock is released.
+	 */
+	bool produced(size_t count)
+	{
+		size_t before = producer - consumer;
+		producer += count;
+		return (before < HighWatermark) && (before + count >= HighWatermark);
+	}
+
+	/**
+	 * Release `count` messages from the consumer counter, waking producers if
+	 * this takes the ring to the low watermark.  Must be called with the pop
+	 * lock held.  Returns true if producers should be woken once the lock is
+	 * released.
+	 */
+	bool consumed(size_t count)
+	{
+		size_t before = producer - consumer;
+		consumer += count;
+		return (before > LowWatermark) && (before - count <= LowWatermark);
+	}
+
+	/**
+	 * Invoke `visit` with the (up to two) contiguous runs of `count` elements
+	 * of the ring, starting at the element for `counter`.
+	 */
+	void for_each_segment(size_t counter, size_t count, auto &&visit)
+	{
+		size_t start = counter_to_index(counter);
+		size_t first = std::min(count, BufferSize - start);
+		visit(&ring[start], first);
+		if (first < count)
+		{
+			visit(&ring[0], count - first);
+		}
+	}
+
 	public:
 	/**
 	 * Push an element into the ring.  The caller is responsible for ensuring
@@ -82,7 +140,7 @@ class RingBuffer
 	 */
 	void push(Message &&message)
 	{
-		bool wasEmpty;
+		bool wake;
 		{
 			LockGuard g{pushLock};
 			// Wait for the queue to not be full
@@ -90,15 +148,41 @@ class RingBuffer
 			{
 				consumer.wait(producer - BufferSize);
 			}
-			auto i   = counter_to_index(producer);
-			ring[i]  = std::move(message);
-			wasEmpty = is_empty();
-			producer++;
+			auto i  = counter_to_index(producer);
+			ring[i] = std::move(message);
+			wake    = produced(1);
+		}
+		if (wake)
+		{
+			producer.notify_all();
+		}
+	}
+
+	/**
+	 * Push up to `count` messages into the ring under a single acquisition of
+	 * the push lock, blocking until there is room for at least one.  `fill`
+	 * is called with a pointer to, and the number of, each contiguous run of
+	 * free elements (at most two, if the free space wraps) and must populate
+	 * all of them.  Returns the number of messages pushed.
+	 */
+	size_t push_bulk(size_t count, auto &&fill)
+	{
+		bool wake;
+		{
+			LockGuard g{pushLock};
+			while (is_full())
+			{
+				consumer.wait(producer - BufferSize);
+			}
+			count = std::min(count, BufferSize - (producer - consumer));
+			for_each_segment(producer, count, fill);
+			wake = produced(count);
 		}
-		if (wasEmpty)
+		if (wake)
 		{
 			producer.notify_all();
 		}
+		return count;
 	}
 
 	/**
@@ -107,7 +191,7 @@ class RingBuffer
 	Message pop()
 	{
 		Message result;
-		bool    wasFull;
+		bool    wake;
 		{
 			LockGuard g{popLock};
 			// Wait for the queue to not be empty
@@ -117,15 +201,41 @@ class RingBuffer
 			}
 			auto i  = counter_to_index(consumer);
 			result  = std::move(ring[i]);
-			wasFull = is_full();
-			consumer++;
+			wake    = consumed(1);
 		}
-		if (wasFull)
+		if (wake)
 		{
 			consumer.notify_all();
 		}
 		return result;
 	}
+
+	/**
+	 * Pop up to `count` messages from the ring under a single acquisition of
+	 * the pop lock, blocking until there is at least one.  `drain` is called
+	 * with a pointer to, and the number of, each contiguous run of messages
+	 * (at most two, if the messages wrap) and must move out any that it
+	 * keeps.  Returns the number of messages popped.
+	 */
+	size_t pop_bulk(size_t count, auto &&drain)
+	{
+		bool wake;
+		{
+			LockGuard g{popLock};
+			while (is_empty())
+			{
+				producer.wait(consumer);
+			}
+			count = std::min(count, size_t(producer - consumer));
+			for_each_segment(consumer, count, drain);
+			wake = consumed(count);
+		}
+		if (wake)
+		{
+			consumer.notify_all();
+		}
+		return count;
+	}
 };
 
 // Make sure that locks consume no space if not used.
@@ -0,0 +1,103 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment-macros.h>
+#include <stdint.h>
+
+/**
+ * Statistical sampling profiler.
+ *
+ * When the firmware is built with `--scheduler-profile-samples=N` (for a
+ * non-zero power of two `N`), the scheduler records a sample on each timer
+ * interrupt in a ring buffer of `N` samples in a shared object called
+ * `scheduler_profile`.  Each sample identifies the interrupted thread, the
+ * compartment that it was running in, and the program counter.  With
+ * `--scheduler-profile-period=C`, the scheduler also arms the timer to take
+ * a sample at least every `C` cycles while a thread is running.
+ *
+ * The scheduler is the only writer.  Other compartments may import the shared
+ * object read-only with `SCHEDULER_PROFILE()` and copy samples out, or print
+ * them with `scheduler_profile_dump` for `scripts/sample_profile.py` to
+ * symbolise.
+ */
+
+/**
+ * A single sample.
+ */
+struct SchedulerProfileSample
+{
+	/**
+	 * The address of the interrupted instruction.  This is an address in the
+	 * scheduler's idle loop if `thread` is 0.
+	 */
+	uint32_t pc;
+	/**
+	 * The base of the export table of the compartment at the top of the
+	 * interrupted thread's trusted stack, or 0 for the idle thread.
+	 */
+	uint32_t compartment;
+	/// The interrupted thread, or 0 for the idle thread.
+	uint16_t thread;
+	/// Reserved, currently always zero.
+	uint16_t reserved;
+};
+
+/**
+ * The layout of the `scheduler_profile` shared object.
+ */
+struct SchedulerProfile
+{
+	/**
+	 * The total number of samples written since boot.  The most recent sample
+	 * is at index `(written - 1) % capacity`.  This is updated after each
+	 * sample is complete, as with `SchedulerTrace::written`.
+	 */
+	uint32_t written;
+	/// The number of entries in `samples`.
+	uint32_t capacity;
+	/// The ring of samples.
+	struct SchedulerProfileSample samples[];
+};
+
+/**
+ * Returns a read-only pointer to the profiler's samples.  This may be used
+ * only in firmware built with the sampling profiler enabled.
+ */
+#define SCHEDULER_PROFILE()                                                    \
+	((const struct SchedulerProfile *)SHARED_OBJECT_WITH_PERMISSIONS(          \
+	  struct SchedulerProfile, scheduler_profile, true, false, false, false))
+
+#ifdef __cplusplus
+/**
+ * Print the samples in the profiler's ring buffer, oldest first, with the
+ * `log` method of `Debug` (an instantiation of `ConditionalDebug`).  Each
+ * sample is printed on one line in the format that
+ * `scripts/sample_profile.py` reads.
+ *
+ * Samples taken while this runs may overwrite ones that have not yet been
+ * printed, so callers that dump periodically should do so before the buffer
+ * fills.
+ */
+template<typename Debug>
+void scheduler_profile_dump()
+{
+	const SchedulerProfile *profile  = SCHEDULER_PROFILE();
+	uint32_t                capacity = profile->capacity;
+	if (capacity == 0)
+	{
+		return;
+	}
+	uint32_t written = profile->written;
+	uint32_t count   = (written < capacity) ? written : capacity;
+	for (uint32_t i = written - count; i != written; i++)
+	{
+		SchedulerProfileSample sample = profile->samples[i % capacity];
+		Debug::log("sched-profile {} {} {}",
+		           static_cast<uint32_t>(sample.thread),
+		           sample.compartment,
+		           sample.pc);
+	}
+}
+#endif
@@ -0,0 +1,131 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment-macros.h>
+#include <stdint.h>
+
+/**
+ * Scheduler event tracing.
+ *
+ * When the firmware is built with `--scheduler-trace-entries=N` (for a
+ * non-zero power of two `N`), the scheduler records scheduling events in a
+ * ring buffer of `N` records in a shared object called `scheduler_trace`.
+ * The scheduler is the only writer.  Other compartments may import the shared
+ * object read-only with `SCHEDULER_TRACE()` and copy records out.
+ */
+
+/**
+ * The kinds of event recorded in the scheduler trace.
+ */
+enum SchedulerTraceEvent
+#ifdef __cplusplus
+  : uint8_t
+#endif
+{
+	/// No event.  Records that have never been written have this kind.
+	SchedulerTraceNone = 0,
+	/**
+	 * The scheduler switched threads.  `thread` is the new thread (0 for the
+	 * idle thread) and `argument` is the previous one.
+	 */
+	SchedulerTraceContextSwitch,
+	/**
+	 * `thread` started waiting on a futex.  `argument` is the futex address
+	 * and `detail` is non-zero if the futex is priority inheriting.
+	 */
+	SchedulerTraceFutexWait,
+	/// `thread` was woken from the futex at address `argument`.
+	SchedulerTraceFutexWake,
+	/**
+	 * The scheduler was entered for an interrupt.  `thread` is the
+	 * interrupted thread and `argument` is the value of `mcause`.
+	 */
+	SchedulerTraceInterruptEntry,
+	/**
+	 * The scheduler finished handling an interrupt.  `thread` is the thread
+	 * that will run next and `argument` is the value of `mcause`.
+	 */
+	SchedulerTraceInterruptExit,
+	/**
+	 * The priority of `thread` changed because of priority inheritance.
+	 * `detail` is the new priority and `argument` is the previous one.
+	 */
+	SchedulerTracePriorityBoost,
+};
+
+/**
+ * A single record in the scheduler trace.
+ */
+struct SchedulerTraceRecord
+{
+	/// The cycle counter when the event was recorded.
+	uint64_t cycles;
+	/// The thread that the event concerns.  See `SchedulerTraceEvent`.
+	uint16_t thread;
+	/// The kind of event, a `SchedulerTraceEvent` value.
+	uint8_t event;
+	/// Event-specific detail.  See `SchedulerTraceEvent`.
+	uint8_t detail;
+	/// Event-specific argument.  See `SchedulerTraceEvent`.
+	uint32_t argument;
+};
+
+/**
+ * The layout of the `scheduler_trace` shared object.
+ */
+struct SchedulerTrace
+{
+	/**
+	 * The total number of records written since boot.  The most recent record
+	 * is at index `(written - 1) % capacity`.  This is updated after each
+	 * record is complete, so a reader that sees the same value before and
+	 * after copying a record has a consistent copy unless the writer has
+	 * lapped it.
+	 */
+	uint32_t written;
+	/// The number of entries in `records`.
+	uint32_t capacity;
+	/// The ring of trace records.
+	struct SchedulerTraceRecord records[];
+};
+
+/**
+ * Returns a read-only pointer to the scheduler trace.  This may be used only
+ * in firmware built with scheduler tracing enabled.
+ */
+#define SCHEDULER_TRACE()                                                      \
+	((const struct SchedulerTrace *)SHARED_OBJECT_WITH_PERMISSIONS(            \
+	  struct SchedulerTrace, scheduler_trace, true, false, false, false))
+
+#ifdef __cplusplus
+/**
+ * Print the records in the scheduler trace, oldest first, with the `log`
+ * method of `Debug` (an instantiation of `ConditionalDebug`).  Each record is
+ * printed on one line in the format that `scripts/annotate_trace.py
+ * --scheduler` renders.
+ */
+template<typename Debug>
+void scheduler_trace_dump()
+{
+	const SchedulerTrace *trace    = SCHEDULER_TRACE();
+	uint32_t              capacity = trace->capacity;
+	if (capacity == 0)
+	{
+		return;
+	}
+	uint32_t written = trace->written;
+	uint32_t count   = (written < capacity) ? written : capacity;
+	for (uint32_t i = written - count; i != written; i++)
+	{
+		SchedulerTraceRecord record = trace->records[i % capacity];
+		Debug::log("sched-trace {} {} {} {} {}",
+		           record.cycles,
+		           static_cast<uint32_t>(record.event),
+		           static_cast<uint32_t>(record.thread),
+		           static_cast<uint32_t>(record.detail),
+		           record.argument);
+	}
+}
+#endif
@@ -0,0 +1,88 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <timeout.h>
+
+/**
+ * Scratch arenas.
+ *
+ * A scratch arena takes one heap allocation and carves it into many small
+ * objects that all die together, such as the temporaries of a single request
+ * handler.  Each object is returned as a capability with exact bounds, so
+ * objects cannot reach each other, but only the arena itself is allocated and
+ * freed by the allocator.
+ *
+ * Objects cannot be freed individually.  Destroying the arena frees the
+ * backing allocation and so revocation invalidates every object allocated
+ * from it.  An arena must not be used concurrently from more than one thread.
+ */
+
+/**
+ * The state of a scratch arena.  This is usually kept on the stack of the
+ * code that owns the arena and should be treated as opaque.
+ */
+struct ScratchArena
+{
+	/// The backing allocation.
+	void *memory;
+	/// The number of bytes of `memory` that have been handed out.
+	size_t used;
+};
+
+__BEGIN_DECLS
+
+/**
+ * Create a scratch arena of `size` bytes, allocated with `heapCapability`.
+ * This may block for up to `timeout` for the backing allocation.
+ *
+ * Returns 0 on success, `-EINVAL` if `arena` is not a valid writable pointer,
+ * or `-ENOMEM` if the backing allocation failed.
+ */
+int __cheri_libcall scratch_arena_create(struct ScratchArena *arena,
+                                         Timeout             *timeout,
+                                         struct SObjStruct   *heapCapability,
+                                         size_t               size);
+
+/**
+ * Allocate `size` bytes from `arena`.  The result is zeroed, aligned for any
+ * type, and has exact bounds, rounded up to a representable length for large
+ * objects.  This never blocks.
+ *
+ * Returns null if the arena does not have enough space left.
+ */
+void *__cheri_libcall scratch_arena_allocate(struct ScratchArena *arena,
+                                             size_t               size);
+
+/**
+ * Returns the number of bytes that are left in `arena`.  Alignment and
+ * rounding mean that an allocation of this size may still fail.
+ */
+size_t __cheri_libcall scratch_arena_remaining(struct ScratchArena *arena);
+
+/**
+ * Destroy `arena`, freeing the backing allocation with `heapCapability`,
+ * which must be the capability used to create it.  Every object allocated
+ * from the arena becomes invalid once it has been revoked.
+ *
+ * Returns 0 on success or the error from `heap_free`.
+ */
+int __cheri_libcall scratch_arena_destroy(struct ScratchArena *arena,
+                                          struct SObjStruct   *heapCapability);
+
+__END_DECLS
+
+#ifdef __cplusplus
+/**
+ * Allocate space for a zero-initialised `T` from `arena`.  Returns null if the
+ * arena does not have enough space left.
+ */
+template<typename T>
+T *scratch_arena_allocate(struct ScratchArena *arena)
+{
+	return static_cast<T *>(scratch_arena_allocate(arena, sizeof(T)));
+}
+#endif
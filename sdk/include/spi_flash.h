@@ -0,0 +1,107 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * SPI NOR flash driver.
+ *
+ * The `spi_flash` compartment owns the SPI controller and chip select that
+ * the board's flash is attached to and serialises all access to it.  Reads
+ * use the fast-read command and stream any number of bytes under a single
+ * command.  Small reads are served from an LRU cache of
+ * `--spi-flash-cache-pages` flash pages, so that callers that read a field
+ * at a time (such as configuration parsers) do not issue a command per
+ * field.  Writes are collected into a page-sized buffer and programmed one
+ * flash page at a time, when a write moves to another page or the buffer is
+ * flushed by a read, an erase, or `spi_flash_sync`.
+ *
+ * This is NOR flash: a write can only clear bits, so a range must be erased
+ * (set to all ones) before it is written with arbitrary data.  Writing a
+ * byte twice without an erase stores the bitwise AND of the two values.
+ *
+ * On Sonata, the flash is on `spi0` with its chip select on GPIO output 12.
+ * Define `CHERIOT_SPI_FLASH_DEVICE` and `CHERIOT_SPI_FLASH_CHIP_SELECT` to
+ * the name of the SPI device and the GPIO output to use another flash.  The
+ * Sonata SPI controller has a single data line, so quad-mode reads are not
+ * available.
+ */
+
+/// The size of a flash page, the unit in which the flash is programmed.
+#define SPI_FLASH_PAGE_SIZE 256
+
+/// The size of a flash sector, the smallest unit that can be erased.
+#define SPI_FLASH_SECTOR_SIZE 4096
+
+/**
+ * Returns the size of the flash in bytes, as reported by the device's JEDEC
+ * identifier, or `-ENODEV` if no flash responds.
+ */
+ssize_t __cheri_compartment("spi_flash") spi_flash_size(void);
+
+/**
+ * Read `length` bytes starting at flash offset `address` into `buffer`.
+ *
+ * Returns 0 on success, `-EINVAL` if `buffer` is not writable for `length`
+ * bytes or the range is not in the flash, `-ENODEV` if no flash responds, or
+ * `-ETIMEDOUT` if `timeout` expires while waiting for the driver or for an
+ * earlier write or erase to finish.
+ */
+int __cheri_compartment("spi_flash") spi_flash_read(Timeout *timeout,
+                                                    uint32_t address,
+                                                    void    *buffer,
+                                                    size_t   length);
+
+/**
+ * Write `length` bytes from `buffer` starting at flash offset `address`.
+ * Data that does not fill a page may be held in the driver until a later
+ * write moves to another page, or until `spi_flash_sync` is called.  Any
+ * read or erase through this driver sees the written data.
+ *
+ * Returns 0 on success or the same errors as `spi_flash_read` (with
+ * `buffer` required to be readable).
+ */
+int __cheri_compartment("spi_flash") spi_flash_write(Timeout    *timeout,
+                                                     uint32_t    address,
+                                                     const void *buffer,
+                                                     size_t      length);
+
+/**
+ * Erase `length` bytes starting at flash offset `address`, setting every bit
+ * to one.  Both must be multiples of `SPI_FLASH_SECTOR_SIZE`.  Aligned 64 KiB
+ * blocks are erased with a single command.
+ *
+ * Erasing takes tens of milliseconds per sector, during which the calling
+ * thread sleeps.  If `timeout` expires, this returns `-ETIMEDOUT` and the
+ * sectors from the one being erased onwards may not have been erased.
+ *
+ * Returns 0 on success or the same errors as `spi_flash_read`.
+ */
+int __cheri_compartment("spi_flash")
+  spi_flash_erase(Timeout *timeout, uint32_t address, size_t length);
+
+/**
+ * Program any data that `spi_flash_write` is holding and wait for the flash
+ * to finish.  Call this before depending on data surviving a reset.
+ *
+ * Returns 0 on success, `-ENODEV` if no flash responds, or `-ETIMEDOUT` if
+ * `timeout` expires first.
+ */
+int __cheri_compartment("spi_flash") spi_flash_sync(Timeout *timeout);
+
+/**
+ * Returns a read-only capability to `length` bytes of the flash starting at
+ * `address`, through the board's execute-in-place window, so that data (such
+ * as lookup tables) can be used in place without being copied.  Any data that
+ * `spi_flash_write` is holding is programmed first.
+ *
+ * Returns null if the range is not in the flash or if the board has no
+ * execute-in-place window (the `spi_flash_xip` device), as is the case for
+ * the current Sonata boards.
+ */
+const void *__cheri_compartment("spi_flash")
+  spi_flash_map(uint32_t address, size_t length);
@@ -8,6 +8,7 @@
 #include <compartment-macros.h>
 #include <stdarg.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #define PRT_MAX_SIZE (0x80)
 #define EOF (-1)
@@ -15,13 +16,130 @@
 __BEGIN_DECLS
 
 /**
- * This is a very simple implementation of a subset of stdio and supports only
- * UARTs.  The Uart type is often a C++ template type and so we can't forward
- * declare it in a C header and so we use a volatile void* instead, which can
- * be cast to the correct type inside the library.
+ * This is a very simple implementation of a subset of stdio.  A `FILE` is
+ * either a UART or a `struct StdioStream`.  The Uart type is often a C++
+ * template type and so we can't forward declare it in a C header and so we use
+ * a volatile void* instead, which can be cast to the correct type inside the
+ * library.
+ *
+ * The library tells the two apart by their permissions: memory-mapped UART
+ * capabilities (as provided by `MMIO_CAPABILITY`) do not have permission to
+ * load and store capabilities, whereas pointers to streams in globals, on the
+ * stack, or in the heap do.
  */
 typedef volatile void FILE;
 
+/// Buffering modes for `stdio_stream_init` and `setvbuf`: full buffering.
+#define _IOFBF 0
+/// Line buffering: flush after each write that contains a newline.
+#define _IOLBF 1
+/// No buffering: flush at the end of each call.
+#define _IONBF 2
+
+/**
+ * The function that a stream uses to write out its buffer.  This is passed
+ * the stream's context and should write up to `length` bytes from `data`,
+ * returning the number written.  Returning zero or a negative value means
+ * that the sink cannot accept any data now and the stream keeps the data
+ * buffered.
+ *
+ * This is called in the compartment that writes to the stream, so sinks that
+ * are other compartments (for example, `uart_driver` or a network logger)
+ * are called through a small function in the writing compartment.
+ */
+typedef ssize_t (*StdioStreamWrite)(void       *context,
+                                    const char *data,
+                                    size_t      length);
+
+/**
+ * A buffered output stream.  A pointer to one of these can be used anywhere
+ * that a `FILE *` is expected.  Streams are not safe to use from more than
+ * one thread at a time without external locking.
+ *
+ * Formatting and buffering happen with interrupts enabled.  The stream calls
+ * its `write` function only when the buffer is full, when a newline is
+ * written to a line-buffered stream, at the end of each call for an
+ * unbuffered stream, and on `fflush`.
+ *
+ * If the buffer is full and `write` makes no progress, the bytes that do not
+ * fit are dropped and counted in `dropped`, so writing to a stream whose
+ * sink does not block never blocks.
+ */
+struct StdioStream
+{
+	/// The function that writes out buffered data.
+	StdioStreamWrite write;
+	/// The context passed to `write`.
+	void *context;
+	/// The buffer, `size` bytes long.
+	char *buffer;
+	/// The size of `buffer`.  This may be zero for unbuffered streams.
+	size_t size;
+	/// The number of bytes currently buffered.
+	size_t used;
+	/// The buffering mode, one of `_IOFBF`, `_IOLBF`, or `_IONBF`.
+	int mode;
+	/// The number of bytes dropped because the sink made no progress.
+	uint32_t dropped;
+};
+
+/**
+ * Initialise `stream` to write to `write` (which is passed `context`) through
+ * `buffer`, which must be `size` bytes long, with the buffering mode `mode`.
+ *
+ * Returns 0 on success or -EINVAL if the mode is invalid or `write` is null.
+ */
+int __cheri_libcall stdio_stream_init(struct StdioStream *stream,
+                                      StdioStreamWrite    write,
+                                      void               *context,
+                                      char               *buffer,
+                                      size_t              size,
+                                      int                 mode);
+
+/**
+ * A stream write function that writes to the memory-mapped UART passed as
+ * the context, polling for space.  Interrupts are disabled while this runs,
+ * so it should be used with a buffered stream, which disables interrupts
+ * only while it flushes rather than during formatting.
+ */
+ssize_t __cheri_libcall stdio_stream_uart_write(void       *uart,
+                                                const char *data,
+                                                size_t      length);
+
+/**
+ * Change the buffer and buffering mode of a stream, after flushing it.  This
+ * does nothing for UARTs.  Returns 0 on success or a non-zero value if
+ * `mode` is invalid.
+ */
+int __cheri_libcall setvbuf(FILE *stream, char *buffer, int mode, size_t size);
+
+/**
+ * Write out any data buffered in `stream`.  Returns 0 if all of the data
+ * was written, or `EOF` if some remains buffered.
+ */
+int __cheri_libcall fflush(FILE *stream);
+
+/**
+ * Write `count` objects of `size` bytes from `data` to `stream`.  Returns
+ * `count` (dropped bytes are not reported as errors, see `StdioStream`).
+ */
+size_t __cheri_libcall fwrite(const void *data,
+                              size_t      size,
+                              size_t      count,
+                              FILE       *stream);
+
+/**
+ * Write the string `str`, without its terminator, to `stream`.  Returns a
+ * non-negative value.
+ */
+int __cheri_libcall fputs(const char *str, FILE *stream);
+
+/**
+ * Write the character `c` to `stream`.  Returns `c`, converted to an
+ * `unsigned char`.
+ */
+int __cheri_libcall fputc(int c, FILE *stream);
+
 #if DEVICE_EXISTS(uart0)
 #	define stdout MMIO_CAPABILITY(void, uart0)
 #	define stdin MMIO_CAPABILITY(void, uart0)
@@ -35,13 +35,99 @@ struct AllocatorCapabilityState
 	/// The number of bytes that the capability will permit to be allocated.
 	size_t quota;
 	/// Reserved space for internal use.
-	size_t unused;
+	uint16_t unused;
+	/// The heap region that allocations prefer, one of `HeapRegion`.
+	uint16_t region;
 	/// Reserved space for internal use.
 	uintptr_t reserved[2];
 };
 
+/**
+ * Heap regions that an allocator capability may prefer.
+ *
+ * Boards with fast memory that is contiguous with the rest of the heap can
+ * set `fast_end` in their `heap` description.  The heap below that address
+ * is then managed separately and is used only by allocator capabilities that
+ * prefer it, such as those for DMA rings or the stacks of latency-critical
+ * threads.  Allocations with these capabilities fall back to the default
+ * region if there is no space in fast memory.  On other boards, all regions
+ * are the default region.
+ */
+enum HeapRegion
+{
+	/// Memory that is not reserved for any purpose.
+	HeapRegionDefault = 0,
+	/// Fast memory, if the board provides it.
+	HeapRegionFast = 1,
+};
+
 struct SObjStruct;
 
+/**
+ * The number of buckets in the allocation-size histogram reported by
+ * `heap_statistics`.
+ */
+#define HEAP_STATISTICS_HISTOGRAM_BUCKETS 12
+
+/**
+ * Allocator statistics, returned by `heap_statistics` when the allocator is
+ * built with `--allocator-statistics=y`.  All counters are cumulative since
+ * boot and may wrap.  On boards with a fast heap region (see `HeapRegion`),
+ * these describe only the default region.
+ */
+struct HeapStatistics
+{
+	/**
+	 * Histogram of requested allocation sizes.  Bucket 0 counts requests of
+	 * up to 16 bytes, bucket `n` counts requests larger than `2^(n+3)` and no
+	 * larger than `2^(n+4)` bytes, and the last bucket counts all larger
+	 * requests.
+	 */
+	uint32_t allocationSizeHistogram[HEAP_STATISTICS_HISTOGRAM_BUCKETS];
+	/// Allocations satisfied from the size-class cache.
+	uint32_t sizeClassCacheHits;
+	/// Allocations satisfied from the small (exact-size) bins.
+	uint32_t smallBinHits;
+	/// Allocations satisfied from the tree bins.
+	uint32_t treeBinHits;
+	/// Allocations that could not be satisfied from any free bin.
+	uint32_t binMisses;
+	/// The number of times that the allocator lock has been acquired.
+	uint32_t lockAcquisitions;
+	/// The total number of cycles for which the allocator lock was held.
+	uint64_t lockHeldCycles;
+	/**
+	 * The largest number of cycles for which the allocator lock was held in
+	 * one critical section.  This bounds how long an allocation can wait
+	 * behind another thread's allocator call.
+	 */
+	uint32_t lockMaxHeldCycles;
+	/**
+	 * The number of revocation passes that have started since boot.  This is
+	 * derived from the revocation epoch and is zero if the revoker does not
+	 * expose an epoch.
+	 */
+	uint32_t revocationPasses;
+	/**
+	 * The revocation epochs of the pending quarantine rings, oldest first.
+	 * Only the first `quarantinePendingRings` entries are valid.
+	 */
+	uint32_t quarantinePendingEpoch[2];
+	/// The number of bytes in each pending quarantine ring, oldest first.
+	size_t quarantinePendingBytes[2];
+	/// The number of valid entries in the pending quarantine arrays.
+	uint32_t quarantinePendingRings;
+	/// Bytes that have left quarantine but not yet been returned to bins.
+	size_t quarantineFinishedBytes;
+	/// Bytes currently free, including memory held in the size-class cache.
+	size_t freeBytes;
+	/**
+	 * The size of the largest free chunk, including its header.  Comparing
+	 * this with `freeBytes` gives a measure of fragmentation.
+	 */
+	size_t largestFreeChunk;
+};
+
 /**
  * Helper macro to forward declare an allocator capability.
  */
@@ -51,17 +137,26 @@ struct SObjStruct;
 
 /**
  * Helper macro to define an allocator capability authorising the specified
- * quota.
+ * quota, with allocations preferring the heap region `region` (one of
+ * `HeapRegion`).
  */
-#define DEFINE_ALLOCATOR_CAPABILITY(name, quota)                               \
+#define DEFINE_ALLOCATOR_CAPABILITY_IN_REGION(name, quota, region)             \
 	DEFINE_STATIC_SEALED_VALUE(struct AllocatorCapabilityState,                \
 	                           alloc,                                          \
 	                           MallocKey,                                      \
 	                           name,                                           \
 	                           (quota),                                        \
 	                           0,                                              \
+	                           (region),                                       \
 	                           {0, 0});
 
+/**
+ * Helper macro to define an allocator capability authorising the specified
+ * quota.
+ */
+#define DEFINE_ALLOCATOR_CAPABILITY(name, quota)                               \
+	DEFINE_ALLOCATOR_CAPABILITY_IN_REGION(name, quota, HeapRegionDefault)
+
 /**
  * Helper macro to define an allocator capability without a separate
  * declaration.
@@ -141,6 +236,37 @@ enum [[clang::flag_enum]] AllocateWaitFlags{
                      AllocateWaitHeapFull),
 };
 
+/**
+ * The allocation flags may carry a 16-bit allocation-site identifier in their
+ * upper bits.  When the allocator is built with profiling support
+ * (`--allocator-profiling=y`), this identifier is recorded for each live
+ * allocation and reported by `heap_profile_dump`.  Otherwise it is ignored.
+ * An identifier of zero means that the site is unknown.
+ */
+#define HEAP_ALLOCATION_SITE_SHIFT 16
+
+/**
+ * Encode `site` as an allocation-site identifier for the flags argument of the
+ * allocation functions.
+ */
+#define HEAP_ALLOCATION_SITE(site)                                             \
+	((uint32_t)(uint16_t)(site) << HEAP_ALLOCATION_SITE_SHIFT)
+
+#ifdef CHERIOT_ALLOCATOR_PROFILING
+/**
+ * The allocation-site identifier used by the `malloc` family of wrappers: the
+ * low 16 bits of the return address of the wrapper.  The wrappers are not
+ * inlined in profiling builds, so this identifies the calling instruction.
+ */
+#	define HEAP_ALLOCATION_SITE_CALLER()                                      \
+		HEAP_ALLOCATION_SITE(                                                  \
+		  __builtin_cheri_address_get(__builtin_return_address(0)))
+#	define __HEAP_ALLOCATION_WRAPPER __attribute__((noinline))
+#else
+#	define HEAP_ALLOCATION_SITE_CALLER() 0
+#	define __HEAP_ALLOCATION_WRAPPER
+#endif
+
 /**
  * Non-standard allocation API.  Allocates `size` bytes.
  *
@@ -181,6 +307,61 @@ void *__cheri_compartment("alloc")
                 size_t             size,
                 uint32_t flags     __if_cxx(= AllocateWaitAny));
 
+/**
+ * Non-standard allocation API.  Allocates `size` bytes of memory, with a base
+ * that is aligned to at least `alignment` bytes, which must be a power of
+ * two.  This is intended for buffers with hardware alignment requirements,
+ * such as DMA descriptors.  Free the result with `heap_free`.
+ *
+ * The allocator already aligns large allocations so that their bounds are
+ * representable.  Stronger alignment is achieved by splitting off the leading
+ * slack of an oversized free chunk and returning it to the heap, so the
+ * allocation costs the same quota as one from `heap_allocate` and callers do
+ * not need to over-allocate and align within the buffer themselves.
+ *
+ * The `timeout` and `flags` parameters have the same meaning as for
+ * `heap_allocate`.  Returns `nullptr` if `alignment` is not a power of two,
+ * or in the same cases as `heap_allocate`.  Memory returned from this
+ * interface is guaranteed to be zeroed.
+ */
+void *__cheri_compartment("alloc")
+  heap_allocate_aligned(Timeout           *timeout,
+                        struct SObjStruct *heapCapability,
+                        size_t             size,
+                        size_t             alignment,
+                        uint32_t flags     __if_cxx(= AllocateWaitAny));
+
+/**
+ * Non-standard reallocation API.  Resizes the object at `ptr`, which must be
+ * a pointer to an entire allocation made with `heapCapability`, to hold
+ * `size` bytes.
+ *
+ * If the object is growing and the memory immediately after it is free, the
+ * object is extended in place and a capability to the larger object (with the
+ * same base as `ptr`) is returned.  The new space is zeroed.  Otherwise, a new
+ * object is allocated, the contents are copied, and the old object is freed.
+ * Objects are never shrunk in place, because existing capabilities to them
+ * would then retain access to the released memory.  Requests that would
+ * shrink the object by less than `CHERIOTHeapMinChunkSize` bytes return
+ * `ptr` unmodified.
+ *
+ * Objects that have been claimed by other quotas are always moved.  Sealed
+ * objects cannot be reallocated.
+ *
+ * The `timeout` and `flags` parameters have the same meaning as for
+ * `heap_allocate` and apply to any allocation that is required.
+ *
+ * Returns `nullptr` on failure, in which case the original object is
+ * unmodified.  As with `heap_allocate`, the return value should be checked
+ * for the validity of the tag bit, not for nullptr.
+ */
+void *__cheri_compartment("alloc")
+  heap_reallocate(Timeout           *timeout,
+                  struct SObjStruct *heapCapability,
+                  void              *ptr,
+                  size_t             size,
+                  uint32_t flags     __if_cxx(= AllocateWaitAny));
+
 /**
  * Non-standard allocation API.  Allocates `size` * `nmemb` bytes of memory,
  * checking for arithmetic overflow. Similarly to `heap_allocate`, blocking
@@ -204,6 +385,36 @@ void *__cheri_compartment("alloc")
                       size_t             size,
                       uint32_t flags     __if_cxx(= AllocateWaitAny));
 
+/**
+ * Non-standard allocation API.  Allocates `count` objects of `size` bytes
+ * each, storing the resulting pointers in `objects`, which must have space
+ * for `count` pointers.  This is equivalent to calling `heap_allocate`
+ * `count` times but performs a single cross-compartment call.
+ *
+ * Each object is a separate allocation, with its own bounds, and is charged
+ * to the quota of `heapCapability` individually.  Objects may be freed
+ * individually with `heap_free` or together with `heap_free_batch`.
+ *
+ * Blocking behaviour is controlled by `flags` and `timeout` as for
+ * `heap_allocate`, with the timeout covering the whole batch.
+ *
+ * Returns the number of objects allocated, which may be less than `count` if
+ * the timeout expired or the allocation cannot be satisfied.  Only the first
+ * returned-value entries of `objects` are written.  Returns `-EPERM` if
+ * `heapCapability` is not valid, `-EINVAL` if `timeout` or `objects` is not
+ * valid, or `-ENOTENOUGHSTACK` if the stack is insufficiently large to run
+ * the function.
+ *
+ * Memory returned from this interface is guaranteed to be zeroed.
+ */
+ssize_t __cheri_compartment("alloc")
+  heap_allocate_batch(Timeout           *timeout,
+                      struct SObjStruct *heapCapability,
+                      void             **objects,
+                      size_t             count,
+                      size_t             size,
+                      uint32_t flags     __if_cxx(= AllocateWaitAny));
+
 /**
  * Add a claim to an allocation.  The object will be counted against the quota
  * provided by the first argument until a corresponding call to `heap_free`.
@@ -218,6 +429,37 @@ void *__cheri_compartment("alloc")
 ssize_t __cheri_compartment("alloc")
   heap_claim(struct SObjStruct *heapCapability, void *pointer);
 
+/**
+ * Add a claim, as if by calling `heap_claim`, to each of the `count` pointers
+ * in the `pointers` array, with a single cross-compartment call and a single
+ * acquisition of the allocator lock.
+ *
+ * Each pointer is claimed independently: a failure does not undo earlier
+ * claims or prevent later ones.  The result for `pointers[i]` is stored in
+ * `results[i]`: the size of the allocation claimed, `-EINVAL` if the pointer
+ * is not a valid heap pointer, or `-ENOMEM` if the quota is insufficient.
+ * Claims that succeeded can be dropped with `heap_release_many`.
+ *
+ * Returns the number of pointers claimed, `-EPERM` if `heapCapability` is not
+ * valid, `-EINVAL` if either array is not valid (in which case nothing is
+ * claimed), or `-ENOTENOUGHSTACK` if the stack is insufficiently large to run
+ * the function.
+ */
+ssize_t __cheri_compartment("alloc")
+  heap_claim_many(struct SObjStruct *heapCapability,
+                  void             **pointers,
+                  ssize_t           *results,
+                  size_t             count);
+
+/**
+ * The number of hazard-pointer slots available to each thread for the fast
+ * claims mechanism.  This is set by the `--hazard-pointers-per-thread` build
+ * option and must be at least 2.
+ */
+#ifndef CHERIOT_HAZARD_POINTERS_PER_THREAD
+#	define CHERIOT_HAZARD_POINTERS_PER_THREAD 2
+#endif
+
 /**
  * Interface to the fast claims mechanism.  This claims two pointers using the
  * hazard-pointer-inspired lightweight claims mechanism.  If this function
@@ -240,6 +482,27 @@ int __cheri_libcall heap_claim_fast(Timeout         *timeout,
                                     const void      *ptr,
                                     const void *ptr2 __if_cxx(= nullptr));
 
+/**
+ * Interface to the fast claims mechanism for more than two pointers.  This
+ * behaves like `heap_claim_fast`, but claims the `count` pointers in the
+ * `pointers` array.  `count` may be at most
+ * `CHERIOT_HAZARD_POINTERS_PER_THREAD`; larger values return `-EINVAL`
+ * without claiming anything.
+ *
+ * Any hazard slots not used by this call are cleared, so a call to this (or to
+ * `heap_claim_fast`) replaces all earlier fast claims made by this thread.
+ *
+ * Each slot adds a small cost to every `heap_free` and to every
+ * cross-compartment call, so builds should not configure many more slots than
+ * they need.
+ *
+ * This function is provided by the compartment_helpers library, which must be
+ * linked for it to be available.
+ */
+int __cheri_libcall heap_claim_fast_array(Timeout           *timeout,
+                                          const void *const *pointers,
+                                          size_t             count);
+
 /**
  * Free a heap allocation.
  *
@@ -250,6 +513,43 @@ int __cheri_libcall heap_claim_fast(Timeout         *timeout,
 int __cheri_compartment("alloc")
   heap_free(struct SObjStruct *heapCapability, void *ptr);
 
+/**
+ * Free (or drop claims on) each of the `count` objects in the `objects`
+ * array, as if by calling `heap_free` on each in turn, with a single
+ * cross-compartment call.  Null entries are ignored.  The `objects` array
+ * itself must not be one of the objects being freed.
+ *
+ * Returns the number of objects successfully freed, `-EPERM` if
+ * `heapCapability` is not valid, `-EINVAL` if `objects` is not valid, or
+ * `-ENOTENOUGHSTACK` if the stack size is insufficiently large to safely run
+ * the function.  Objects that could not be freed are skipped; use
+ * `heap_can_free` to determine why.
+ */
+ssize_t __cheri_compartment("alloc")
+  heap_free_batch(struct SObjStruct *heapCapability,
+                  void             **objects,
+                  size_t             count);
+
+/**
+ * Free (or drop claims on) each of the `count` pointers in the `pointers`
+ * array, as if by calling `heap_free` on each in turn, with a single
+ * cross-compartment call and a single acquisition of the allocator lock.
+ * This is the counterpart to `heap_claim_many`.
+ *
+ * The result of freeing `pointers[i]`, as returned by `heap_free`, is stored
+ * in `results[i]`.  Neither array may be one of the objects being freed.
+ *
+ * Returns the number of pointers freed, `-EPERM` if `heapCapability` is not
+ * valid, `-EINVAL` if either array is not valid (in which case nothing is
+ * freed), or `-ENOTENOUGHSTACK` if the stack is insufficiently large to run
+ * the function.
+ */
+ssize_t __cheri_compartment("alloc")
+  heap_release_many(struct SObjStruct *heapCapability,
+                    void             **pointers,
+                    int               *results,
+                    size_t             count);
+
 /**
  * Free all allocations owned by this capability.
  *
@@ -275,6 +575,19 @@ int __cheri_compartment("alloc")
 ssize_t __cheri_compartment("alloc")
   heap_quota_remaining(struct SObjStruct *heapCapability);
 
+/**
+ * Returns a read-only pointer to the remaining quota of `heapCapability`, or
+ * null if `heapCapability` is not valid.
+ *
+ * The allocator updates the quota while holding its lock, and loading
+ * through this pointer gives the same value as `heap_quota_remaining`
+ * without a compartment call or waiting for the lock.  This is intended for
+ * code that polls its quota.  Allocator capabilities are statically
+ * allocated, so the pointer remains valid for the lifetime of the system.
+ */
+const volatile size_t *__cheri_compartment("alloc")
+  heap_quota_remaining_pointer(struct SObjStruct *heapCapability);
+
 /**
  * Block until the quarantine is empty.
  *
@@ -284,6 +597,49 @@ ssize_t __cheri_compartment("alloc")
  */
 void __cheri_compartment("alloc") heap_quarantine_empty(void);
 
+/**
+ * Copy a snapshot of the allocator's statistics into `stats`.  This acquires
+ * the allocator lock, so the snapshot is consistent, but is intended for
+ * periodic sampling rather than for use on hot paths.
+ *
+ * Returns 0 on success, `-EINVAL` if `stats` is not a valid writeable pointer,
+ * `-ENOTSUP` if the allocator was built without statistics support, or
+ * `-ENOTENOUGHSTACK` if the stack is insufficient to run the function.
+ */
+int __cheri_compartment("alloc") heap_statistics(struct HeapStatistics *stats);
+
+/**
+ * Returns an estimate of how far through the current revocation pass the
+ * revoker is, as a percentage.  Returns 0 if revocation is not running and a
+ * value less than 100 while a pass is in progress.  Callers that see
+ * allocation fail with quarantined memory pending can use this to decide
+ * whether to wait or to give up.
+ *
+ * Returns `-ENOTSUP` if the revoker cannot report progress, or
+ * `-ENOTENOUGHSTACK` if the stack is insufficient to run the function.
+ */
+int __cheri_compartment("alloc") heap_revocation_progress(void);
+
+/**
+ * Write a description of every live heap allocation to the debug console,
+ * one line per allocation giving its allocation-site identifier (see
+ * `HEAP_ALLOCATION_SITE`), owning quota, size, and whether it is claimed.
+ * `scripts/heap_profile.py` groups this output by site and by owner.
+ *
+ * Returns 0 on success or `-ENOTSUP` if the allocator was not built with
+ * `--allocator-profiling=y`.
+ */
+int __cheri_compartment("alloc") heap_profile_dump(void);
+
+/**
+ * Write the allocator's profile counters to the debug console, in the format
+ * that `scripts/pgo_profraw.py` reads (see `pgo.h`).
+ *
+ * Returns 0 on success or `-ENOTSUP` if the firmware was not built with
+ * `--pgo=generate`.
+ */
+int __cheri_compartment("alloc") heap_pgo_dump(void);
+
 /**
  * Returns true if `object` points to a valid heap address, false otherwise.
  * Note that this does *not* check that this is a valid pointer.  This should
@@ -313,22 +669,30 @@ static inline void __dead2 abort()
 }
 
 #ifndef CHERIOT_NO_AMBIENT_MALLOC
-static inline void *malloc(size_t size)
+static inline __HEAP_ALLOCATION_WRAPPER void *malloc(size_t size)
 {
-	Timeout t = {0, MALLOC_WAIT_TICKS};
-	void   *ptr =
-	  heap_allocate(&t, MALLOC_CAPABILITY, size, AllocateWaitRevocationNeeded);
+	Timeout t   = {0, MALLOC_WAIT_TICKS};
+	void   *ptr = heap_allocate(&t,
+	                            MALLOC_CAPABILITY,
+	                            size,
+	                            AllocateWaitRevocationNeeded |
+	                              HEAP_ALLOCATION_SITE_CALLER());
 	if (!__builtin_cheri_tag_get(ptr))
 	{
 		ptr = NULL;
 	}
 	return ptr;
 }
-static inline void *calloc(size_t nmemb, size_t size)
+static inline __HEAP_ALLOCATION_WRAPPER void *calloc(size_t nmemb,
+                                                     size_t size)
 {
 	Timeout t   = {0, MALLOC_WAIT_TICKS};
-	void   *ptr = heap_allocate_array(
-	    &t, MALLOC_CAPABILITY, nmemb, size, AllocateWaitRevocationNeeded);
+	void   *ptr = heap_allocate_array(&t,
+	                                  MALLOC_CAPABILITY,
+	                                  nmemb,
+	                                  size,
+	                                  AllocateWaitRevocationNeeded |
+	                                    HEAP_ALLOCATION_SITE_CALLER());
 	if (!__builtin_cheri_tag_get(ptr))
 	{
 		ptr = NULL;
@@ -343,6 +707,21 @@ static inline int free(void *ptr)
 
 size_t __cheri_compartment("alloc") heap_available(void);
 
+/**
+ * Returns the number of free bytes in the heap, as `heap_available` does,
+ * with a single load and no compartment call.
+ *
+ * The allocator publishes the free size in the read-only shared object
+ * `allocator_free_bytes` each time that it releases its lock, so the value
+ * may be stale by the time that the caller uses it, as with
+ * `heap_available`.
+ */
+static inline size_t heap_available_fast(void)
+{
+	return *SHARED_OBJECT_WITH_PERMISSIONS(
+	  const volatile size_t, allocator_free_bytes, true, false, false, false);
+}
+
 static inline void yield(void)
 {
 	__asm volatile("ecall" ::: "memory");
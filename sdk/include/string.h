@@ -18,6 +18,10 @@ void *__cheri_libcall  memmove(void       *dest,
                                size_t      n) __asm__("memmove");
 void *__cheri_libcall  memchr(const void *, int, size_t);
 void *__cheri_libcall  memrchr(const void *, int, size_t);
+void *__cheri_libcall  memmem(const void *haystack,
+                              size_t      haystackLength,
+                              const void *needle,
+                              size_t      needleLength);
 size_t __cheri_libcall strlen(const char *str);
 int __cheri_libcall    strncmp(const char *s1, const char *s2, size_t n);
 char *__cheri_libcall  strncpy(char *dest, const char *src, size_t n);
@@ -35,6 +39,21 @@ size_t __cheri_libcall strlcpy(char *dest, const char *src, size_t n);
  */
 void __cheri_libcall explicit_bzero(void *s, size_t n);
 
+/**
+ * Constant-time comparisons, for comparing secrets such as message
+ * authentication codes.  These read all `n` bytes of both buffers and their
+ * running time depends only on `n`, not on the contents or on where the
+ * buffers first differ.
+ *
+ * `timingsafe_bcmp` returns zero if the buffers are equal and non-zero
+ * otherwise.  `timingsafe_memcmp` returns a negative, zero, or positive value
+ * with the same sign as `memcmp` would return.
+ */
+int __cheri_libcall timingsafe_bcmp(const void *b1, const void *b2, size_t n);
+int __cheri_libcall timingsafe_memcmp(const void *b1,
+                                      const void *b2,
+                                      size_t      n);
+
 __always_inline static inline char *strcpy(char *dst, const char *src)
 {
 	return dst + strlcpy(dst, src, SIZE_MAX);
@@ -46,8 +46,27 @@ __cheri_libcall void *switcher_current_thread(void);
 __cheri_libcall _Bool switcher_interrupt_thread(void *);
 
 /**
- * Returns a store-only capability to two hazard pointer slots for the current
- * thread.  Objects stored here will not be deallocated until (at least) the
+ * Returns the base address of the export table of the compartment that the
+ * thread identified by the sealed trusted stack pointer (as returned by
+ * `switcher_current_thread`) is currently executing in, or 0 if the argument
+ * is not a valid sealed trusted stack.  The export table of a compartment
+ * called `foo` is labelled `.foo_export_table` in the firmware image.
+ */
+__cheri_libcall ptraddr_t switcher_thread_compartment(void *);
+
+/**
+ * Returns the base address of the export table of the compartment that the
+ * current thread's trusted-stack frame `depth` frames below the topmost one
+ * invoked, or 0 if there are not that many frames.  Depth 0 is the caller's
+ * own compartment invocation and depth 1 is the compartment that called it.
+ * As with `switcher_thread_compartment`, this reveals only addresses, which
+ * identify compartments in the firmware image.
+ */
+__cheri_libcall ptraddr_t switcher_frame_compartment(size_t depth);
+
+/**
+ * Returns a store-only capability to the hazard pointer slots for the current
+ * thread.  There are `CHERIOT_HAZARD_POINTERS_PER_THREAD` slots.  Objects stored here will not be deallocated until (at least) the
  * next cross-compartment call or until they are explicitly overwritten.
  */
 __cheri_libcall void **switcher_thread_hazard_slots(void);
@@ -58,6 +77,15 @@ __cheri_libcall void **switcher_thread_hazard_slots(void);
  */
 __cheri_libcall ptraddr_t stack_lowest_used_address(void);
 
+/**
+ * Returns the number of bytes below the top of its stack that the thread
+ * identified by the sealed trusted stack pointer (as returned by
+ * `switcher_current_thread`) has ever stored to, or 0 if the argument is not
+ * a valid sealed trusted stack or the core does not have a stack high water
+ * mark.
+ */
+__cheri_libcall size_t switcher_thread_stack_high_water_mark(void *);
+
 /**
  * Resets the switcher's count of invocations.
  *
@@ -80,3 +108,77 @@ __cheri_libcall ptraddr_t stack_lowest_used_address(void);
  */
 __cheri_libcall uint16_t switcher_handler_invocation_count_reset(void);
 
+
+/**
+ * Replace the current compartment invocation with a call to `callee`, a
+ * sealed export table entry such as a `__cheri_callback` function pointer,
+ * passing `arg0` to `arg4` as its first five arguments.  The callee returns
+ * directly to the caller of the current invocation, as if that caller had
+ * called it, so a proxy compartment that checks its arguments and then
+ * forwards the call costs one trusted-stack frame and one return, not two.
+ *
+ * The current invocation's stack is zeroed and its callee-save registers are
+ * not preserved.  The callee must take at most five arguments, all passed in
+ * registers.
+ *
+ * This returns only on failure, in which case it returns `-EINVAL` because
+ * `callee` is not a sealed export table entry or because the current
+ * invocation is a thread's entry point and so has no caller to return to.
+ *
+ * C++ callers should prefer the `switcher_tail_call` template, which takes
+ * arguments of any integer or pointer type.
+ */
+__cheri_libcall int switcher_tail_call(void *callee,
+                                       void *arg0,
+                                       void *arg1,
+                                       void *arg2,
+                                       void *arg3,
+                                       void *arg4);
+
+#ifdef __cplusplus
+#	include <type_traits>
+
+namespace cheriot::detail
+{
+	/**
+	 * Convert `value` to the capability-register representation used by
+	 * `switcher_tail_call`.  Integers are passed in the address field.
+	 */
+	template<typename T>
+	__always_inline inline void *tail_call_argument(T value)
+	{
+		if constexpr (std::is_pointer_v<T>)
+		{
+			return const_cast<void *>(static_cast<const volatile void *>(value));
+		}
+		else
+		{
+			static_assert(std::is_integral_v<T> || std::is_enum_v<T>,
+			              "Tail-call arguments must be integers or pointers");
+			static_assert(sizeof(T) <= sizeof(ptraddr_t),
+			              "Tail-call arguments must fit in one register");
+			return reinterpret_cast<void *>(static_cast<ptraddr_t>(value));
+		}
+	}
+} // namespace cheriot::detail
+
+/**
+ * Tail call `callee` with `args`.  See the C function of the same name.
+ */
+template<typename Callee, typename... Args>
+__always_inline inline int switcher_tail_call(Callee callee, Args... args)
+{
+	static_assert(std::is_pointer_v<Callee> &&
+	                std::is_function_v<std::remove_pointer_t<Callee>>,
+	              "Tail calls must be to a callback function pointer");
+	static_assert(sizeof...(Args) <= 5,
+	              "Tail calls can pass at most five arguments");
+	void *arguments[5] = {cheriot::detail::tail_call_argument(args)...};
+	return switcher_tail_call(reinterpret_cast<void *>(callee),
+	                          arguments[0],
+	                          arguments[1],
+	                          arguments[2],
+	                          arguments[3],
+	                          arguments[4]);
+}
+#endif
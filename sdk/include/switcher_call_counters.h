@@ -0,0 +1,56 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment-macros.h>
+#include <stdint.h>
+
+/**
+ * Switcher call counters.
+ *
+ * When the firmware is built with `--switcher-call-counters=y`, the switcher
+ * increments a 32-bit counter each time that it enters a compartment through
+ * one of its export entries.  The counters are in a shared object called
+ * `switcher_call_counters`, with one counter for each 32-bit word of the
+ * compartment export tables, so the counter for an export entry is at the
+ * same offset from the start of the counters as the export entry is from the
+ * start of the export tables.  Counters for words that are not export entries
+ * (export table headers and padding) are always zero.
+ *
+ * The switcher is the only writer.  Other compartments may import the shared
+ * object read-only with `SWITCHER_CALL_COUNTERS()`.  Counters wrap on
+ * overflow.
+ */
+
+/**
+ * Returns a read-only pointer to the switcher call counters.  This may be used
+ * only in firmware built with switcher call counters enabled.
+ */
+#define SWITCHER_CALL_COUNTERS()                                               \
+	((const uint32_t *)SHARED_OBJECT_WITH_PERMISSIONS(                         \
+	  uint32_t, switcher_call_counters, true, false, false, false))
+
+#ifdef __cplusplus
+/**
+ * Print the non-zero switcher call counters with the `log` method of `Debug`
+ * (an instantiation of `ConditionalDebug`).  Each counter is printed on one
+ * line as its offset into the export tables and its value, in the format that
+ * `scripts/call_counters.py` maps back to export names.
+ */
+template<typename Debug>
+void switcher_call_counters_dump()
+{
+	const uint32_t *counters = SWITCHER_CALL_COUNTERS();
+	size_t count = __builtin_cheri_length_get(counters) / sizeof(uint32_t);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (uint32_t calls = counters[i]; calls != 0)
+		{
+			Debug::log("call-count {} {}",
+			           static_cast<uint32_t>(i * sizeof(uint32_t)),
+			           calls);
+		}
+	}
+}
+#endif
@@ -0,0 +1,62 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <compartment-macros.h>
+#include <stdint.h>
+
+/**
+ * Switcher stack peaks.
+ *
+ * When the firmware is built with `--switcher-stack-peaks=y`, the switcher
+ * records the largest number of bytes of stack that each compartment export
+ * entry has used, as measured by the stack high water mark when calls to it
+ * return.  The measurement starts at the caller's stack pointer, so includes
+ * the space that the switcher reserves on entry, and excludes the stack used
+ * by any cross-compartment calls that the export makes.  It is therefore
+ * comparable with the sum of the export's `__cheriot_minimum_stack` and the
+ * reserved space.  Library calls run on the caller's stack and are counted
+ * as the caller's use.
+ *
+ * The records are in a shared object called `switcher_stack_peaks`, with one
+ * 32-bit record for each 32-bit word of the compartment export tables, laid
+ * out in the same way as the switcher call counters.  Records for exports
+ * that have never returned are zero.
+ *
+ * The switcher is the only writer.  Other compartments may import the shared
+ * object read-only with `SWITCHER_STACK_PEAKS()`.
+ */
+
+/**
+ * Returns a read-only pointer to the switcher stack peaks.  This may be used
+ * only in firmware built with switcher stack peaks enabled.
+ */
+#define SWITCHER_STACK_PEAKS()                                                 \
+	((const uint32_t *)SHARED_OBJECT_WITH_PERMISSIONS(                         \
+	  uint32_t, switcher_stack_peaks, true, false, false, false))
+
+#ifdef __cplusplus
+/**
+ * Print the non-zero switcher stack peaks with the `log` method of `Debug`
+ * (an instantiation of `ConditionalDebug`).  Each record is printed on one
+ * line as its offset into the export tables and its value, in the format that
+ * `scripts/stack_sizes.py --peaks` compares with the exports' declared
+ * minimum stack sizes.
+ */
+template<typename Debug>
+void switcher_stack_peaks_dump()
+{
+	const uint32_t *peaks = SWITCHER_STACK_PEAKS();
+	size_t count = __builtin_cheri_length_get(peaks) / sizeof(uint32_t);
+	for (size_t i = 0; i < count; i++)
+	{
+		if (uint32_t peak = peaks[i]; peak != 0)
+		{
+			Debug::log("stack-peak {} {}",
+			           static_cast<uint32_t>(i * sizeof(uint32_t)),
+			           peak);
+		}
+	}
+}
+#endif
@@ -0,0 +1,51 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+/**
+ * Offset from the top of the stack of the current invocation at which the
+ * switcher (or, for a thread's first invocation, the loader) stores the ID of
+ * the current thread, as a 16-bit value.  This is in the space that the
+ * switcher reserves at the top of the stack on entry to a compartment.
+ */
+#define INVOCATION_LOCAL_THREAD_ID_OFFSET 16
+
+#ifndef __ASSEMBLER__
+#	include <cdefs.h>
+#	include <stdint.h>
+
+/**
+ * Returns the ID of the current thread.  This returns the same value as
+ * `thread_id_get` but is a single load from the top of the stack, rather than
+ * a library call.  It works in compartments and in libraries (which run on
+ * the caller's stack).
+ */
+__always_inline static inline uint16_t thread_id_get_fast(void)
+{
+	void     *csp = __builtin_cheri_stack_get();
+	ptraddr_t top = __builtin_cheri_top_get(csp);
+	csp           = __builtin_cheri_address_set(
+	            csp, top - INVOCATION_LOCAL_THREAD_ID_OFFSET);
+	return *(uint16_t *)csp;
+}
+
+/**
+ * Define `name` as compartment-local, per-thread storage for a `type`: one
+ * object for each thread in the firmware, in the compartment's globals.
+ * Access the current thread's object with `COMPARTMENT_THREAD_LOCAL_GET`.
+ *
+ * Each thread uses only its own object, so no locking is needed.  The object
+ * is shared between nested invocations of the compartment on the same thread
+ * (for example, through a callback), and keeps its value between calls.
+ */
+#	define COMPARTMENT_THREAD_LOCAL(type, name)                               \
+		type name[CHERIOT_THREAD_COUNT] /* NOLINT(bugprone-macro-parentheses) */
+
+/**
+ * Returns (as an lvalue) the current thread's object in the storage defined
+ * with `COMPARTMENT_THREAD_LOCAL`.
+ */
+#	define COMPARTMENT_THREAD_LOCAL_GET(name)                                 \
+		((name)[thread_id_get_fast() - 1])
+#endif
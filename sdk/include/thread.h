@@ -23,6 +23,14 @@ typedef struct
 [[cheri::interrupt_state(disabled)]] SystickReturn __cheri_compartment("sched")
   thread_systemtick_get(void);
 
+/**
+ * Returns the number of timer cycles (at `CPU_TIMER_HZ`) since boot, read
+ * from the scheduler's timer.  This is monotonic and is not rounded to ticks.
+ * `clock_gettime` in `time.h` converts it to seconds and nanoseconds.
+ */
+[[cheri::interrupt_state(disabled)]] uint64_t __cheri_compartment("sched")
+  thread_time_cycles_get(void);
+
 enum ThreadSleepFlags : uint32_t
 {
 	/**
@@ -63,6 +71,240 @@ enum ThreadSleepFlags : uint32_t
 [[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
   thread_sleep(struct Timeout *timeout, uint32_t flags __if_cxx(= 0));
 
+/**
+ * Sleep for at least `microseconds` microseconds.  Unlike `thread_sleep`, this
+ * programs the timer for the end of the sleep rather than for a tick boundary,
+ * so short sleeps are neither rounded up to a whole tick nor need a spin loop
+ * such as `thread_microsecond_spin`.  The thread is not woken early if no
+ * other thread is runnable, but a higher-priority thread may delay it after
+ * the sleep ends.
+ *
+ * Returns 0.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_microsecond_sleep(uint32_t microseconds);
+
+/**
+ * Wait until the start of the next period.  This may be used only by
+ * deadline-scheduled threads (those with a `period` and `budget` in the
+ * firmware's thread description), which should call it when they have
+ * finished the work for the current period.  The thread sleeps until its
+ * current deadline and then runs with a full budget and a deadline one period
+ * later.
+ *
+ * Returns 0 on success, or `-EPERM` if the calling thread is not deadline
+ * scheduled.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_period_wait(void);
+
+/**
+ * Set the base priority of the calling thread, the priority that it runs at
+ * when it is not boosted by priority inheritance.  A thread may lower its
+ * priority and raise it again, but never above the priority in the firmware's
+ * thread description.  If another runnable thread now has a higher priority
+ * then the caller yields to it.
+ *
+ * Returns the previous base priority on success, or `-EPERM` if `priority` is
+ * higher than the thread's configured priority.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_priority_set(uint8_t priority);
+
+/**
+ * Returns the current priority of the calling thread, including any boost
+ * from priority inheritance.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_priority_get(void);
+
+/**
+ * Structure for authorising changes to other threads' priorities with
+ * `thread_priority_set_for`.
+ */
+struct ThreadPriorityCapabilityState
+{
+	/**
+	 * The thread whose priority this authorises changing, or zero for any
+	 * thread.
+	 */
+	uint16_t threadID;
+	/**
+	 * The highest base priority that this authorises setting.
+	 */
+	uint8_t maximumPriority;
+};
+
+/**
+ * Helper macro to forward declare a thread priority capability.
+ */
+#define DECLARE_THREAD_PRIORITY_CAPABILITY(name)                               \
+	DECLARE_STATIC_SEALED_VALUE(                                               \
+	  struct ThreadPriorityCapabilityState, sched, ThreadPriorityKey, name);
+
+/**
+ * Helper macro to define a thread priority capability.  The arguments after
+ * the name are the thread ID (zero for any thread) and the highest base
+ * priority that the capability authorises setting.
+ */
+#define DEFINE_THREAD_PRIORITY_CAPABILITY(name, threadID, maximumPriority)    \
+	DEFINE_STATIC_SEALED_VALUE(struct ThreadPriorityCapabilityState,           \
+	                           sched,                                          \
+	                           ThreadPriorityKey,                              \
+	                           name,                                           \
+	                           threadID,                                       \
+	                           maximumPriority);
+
+/**
+ * Helper macro to define a thread priority capability without a separate
+ * declaration.  The arguments are the same as those for
+ * `DEFINE_THREAD_PRIORITY_CAPABILITY`.
+ */
+#define DECLARE_AND_DEFINE_THREAD_PRIORITY_CAPABILITY(                         \
+  name, threadID, maximumPriority)                                             \
+	DECLARE_THREAD_PRIORITY_CAPABILITY(name);                                  \
+	DEFINE_THREAD_PRIORITY_CAPABILITY(name, threadID, maximumPriority)
+
+/**
+ * Set the base priority of the thread `threadID`, as `thread_priority_set`
+ * does for the calling thread.  The `capability` argument is a sealed
+ * capability to a `ThreadPriorityCapabilityState` (see
+ * `DEFINE_THREAD_PRIORITY_CAPABILITY`) that names this thread, or any
+ * thread, and whose `maximumPriority` is no lower than `priority`.  This may
+ * raise a thread above the priority in its thread description.
+ *
+ * The thread's effective priority remains boosted if it holds a
+ * priority-inheriting lock that a higher-priority thread is waiting for.  If
+ * the change leaves another runnable thread with a higher priority than the
+ * caller then the caller yields to it.
+ *
+ * Returns the previous base priority on success, `-EINVAL` if `threadID` is
+ * not a valid thread or `priority` is not a valid priority, or `-EPERM` if
+ * `capability` does not authorise the change.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_priority_set_for(struct SObjStruct *capability,
+                          uint16_t           threadID,
+                          uint8_t            priority);
+
+/**
+ * Value for `thread_wake_latency_limit_set` indicating that the calling thread
+ * tolerates any wake latency.
+ */
+static __if_cxx(constexpr) const uint32_t ThreadWakeLatencyUnlimited =
+  UINT32_MAX;
+
+/**
+ * Declare that the calling thread tolerates at most `cycles` timer cycles
+ * between an interrupt and the core resuming execution.  While the system is
+ * idle, the scheduler does not enter a low-power state with a longer wake
+ * latency than any thread tolerates.  Latency-critical threads should call
+ * this once when they start.  Pass `ThreadWakeLatencyUnlimited` to remove the
+ * limit.
+ *
+ * Returns 0.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_wake_latency_limit_set(uint32_t cycles);
+
+/**
+ * Statistics for one of the platform's idle states.
+ */
+struct IdleStateStatistics
+{
+	/**
+	 * The number of timer cycles spent in this state, including the time
+	 * taken to enter and leave it.  This is recorded only on platforms that
+	 * have states deeper than a plain `wfi`.
+	 */
+	uint64_t cycles;
+	/// The number of times that the idle thread has entered this state.
+	uint32_t entries;
+	/// The time taken to enter and leave this state once, in timer cycles.
+	uint32_t transitionCycles;
+};
+
+/**
+ * Copy the statistics for idle state `state` into `statistics`.  State 0 is a
+ * plain `wfi` and deeper states have higher numbers.
+ *
+ * Returns 0 on success or `-EINVAL` if `state` is not one of the platform's
+ * idle states or `statistics` is not a valid pointer.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_idle_state_statistics(uint32_t                    state,
+                               struct IdleStateStatistics *statistics);
+
+/**
+ * Actions that `thread_notify` may apply to the target thread's notification
+ * value.
+ */
+enum ThreadNotifyAction : uint32_t
+{
+	/// Mark a notification as pending without changing the value.
+	ThreadNotifyNoAction,
+	/// Set the bits in `value` in the notification value.
+	ThreadNotifySetBits,
+	/// Increment the notification value.  `value` is ignored.
+	ThreadNotifyIncrement,
+	/// Replace the notification value with `value`.
+	ThreadNotifySetValueWithOverwrite,
+	/**
+	 * Replace the notification value with `value`, unless a notification is
+	 * already pending.
+	 */
+	ThreadNotifySetValueWithoutOverwrite,
+};
+
+/**
+ * Send a notification to the thread with ID `threadID`.  Each thread has a
+ * 32-bit notification value, held in the scheduler, that is updated as
+ * specified by `action` (one of `ThreadNotifyAction`), and a flag that records
+ * whether a notification is pending.  If the target is blocked in
+ * `thread_notify_wait` or `thread_notify_take` then it is woken directly,
+ * without searching any wait queues.
+ *
+ * Thread IDs are not capabilities, so any compartment may notify any thread.
+ * Waiters should treat notifications as hints that they should check some
+ * state that only authorised compartments can modify.
+ *
+ * Returns 0 on success, `-EINVAL` if `threadID` or `action` is not valid, or
+ * `-EAGAIN` if `action` is `ThreadNotifySetValueWithoutOverwrite` and a
+ * notification is already pending.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_notify(uint16_t threadID, uint32_t value, uint32_t action);
+
+/**
+ * Wait for a notification to the current thread for up to the time in
+ * `timeout`.  If no notification is pending, the bits in `clearOnEntry` are
+ * first cleared in the notification value.  On return, `*value` (if `value`
+ * is not null) holds the notification value.  If a notification was
+ * received, the bits in `clearOnExit` are then cleared in the notification
+ * value and the notification is no longer pending.
+ *
+ * Returns 0 if a notification was received, `-ETIMEDOUT` if the timeout
+ * expired first, or `-EINVAL` if the arguments are invalid.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_notify_wait(Timeout  *timeout,
+                     uint32_t  clearOnEntry,
+                     uint32_t  clearOnExit,
+                     uint32_t *value);
+
+/**
+ * Wait for up to the time in `timeout` for the current thread's notification
+ * value to be non-zero, using it as a counting semaphore.  `*value` is set to
+ * the notification value before it is decremented, or cleared if
+ * `clearOnExit` is true.  Any pending notification is consumed.
+ *
+ * Returns 0 if the notification value was non-zero, `-ETIMEDOUT` if the
+ * timeout expired first (in which case `*value` is 0), or `-EINVAL` if the
+ * arguments are invalid.
+ */
+[[cheri::interrupt_state(disabled)]] int __cheri_compartment("sched")
+  thread_notify_take(Timeout *timeout, _Bool clearOnExit, uint32_t *value);
+
 /**
  * Return the thread ID of the current running thread.
  * This is mostly useful where one compartment can run under different threads
@@ -88,6 +330,39 @@ __cheri_compartment("sched") uint64_t thread_elapsed_cycles_idle(void);
  */
 __cheri_compartment("sched") uint64_t thread_elapsed_cycles_current(void);
 
+/**
+ * The number of cycles accounted to a compartment, as reported by
+ * `thread_elapsed_cycles_compartments`.
+ */
+struct CompartmentCycles
+{
+	/**
+	 * The base address of the compartment's export table.  The export table
+	 * for a compartment called `foo` is labelled `.foo_export_table` in the
+	 * firmware image.
+	 */
+	ptraddr_t compartment;
+	/// The number of cycles accounted to the compartment.
+	uint64_t cycles;
+};
+
+/**
+ * Copies the number of cycles accounted to each compartment into `buffer`,
+ * which has space for `count` entries.  At each scheduling event, the cycles
+ * since the previous event are accounted to the compartment that the outgoing
+ * thread was executing in (the one on the top of its trusted stack).  Idle
+ * time is not accounted to any compartment.
+ *
+ * Returns the number of compartments that have been accounted (which may be
+ * more than `count`), or `-EINVAL` if `buffer` is not a valid pointer.
+ *
+ * This API is available only if the scheduler is built with accounting
+ * support enabled.
+ */
+__cheri_compartment("sched") int thread_elapsed_cycles_compartments(
+  struct CompartmentCycles *buffer,
+  size_t                    count);
+
 /**
  * Returns the number of threads, including threads that have exited.
  *
@@ -99,6 +374,19 @@ __cheri_compartment("sched") uint64_t thread_elapsed_cycles_current(void);
  */
 __cheri_compartment("sched") uint16_t thread_count();
 
+/**
+ * Returns the number of bytes of stack that the thread with ID `threadID` has
+ * used since it started, measured from the top of its stack to the lowest
+ * address that it has stored to, in any compartment.  This can be compared
+ * against the thread's configured stack size to find over-provisioned stacks.
+ *
+ * Returns `-EINVAL` if `threadID` is not a valid thread ID, or `-ENOTSUP` if
+ * the core does not have a stack high water mark (the board description
+ * does not set `stack_high_water_mark`).
+ */
+__cheri_compartment("sched") int thread_stack_high_water_mark(
+  uint16_t threadID);
+
 /**
  * Wait for the specified number of microseconds.  This is a busy-wait loop,
  * not a yield.  If the thread is preempted then the wait will be longer than
@@ -3,6 +3,7 @@
 
 #pragma once
 #include <cdefs.h>
+#include <stdint.h>
 
 /**
  * The type of a thread-pool callback.  This is a CHERI callback so that it can
@@ -25,8 +26,24 @@ struct ThreadPoolMessage
 	 * The data associated with the asynchronous invocation.
 	 */
 	void *data;
+	/**
+	 * The priority that the callback runs at, or
+	 * `ThreadPoolDefaultPriority` to run at the worker thread's priority.
+	 */
+	int priority;
+	/**
+	 * A futex word that is incremented, and woken, when the callback
+	 * returns, or null if the caller does not need to know.
+	 */
+	uint32_t *completion;
 };
 
+/**
+ * Priority value for `thread_pool_async_priority` that runs the callback at
+ * the priority of the worker thread that picks it up.
+ */
+#define ThreadPoolDefaultPriority (-1)
+
 __BEGIN_DECLS
 
 /**
@@ -35,15 +52,64 @@ __BEGIN_DECLS
  * must be sealed.
  *
  * This can block indefinitely until the thread pool is able to process a
- * message.
- *
- * FIXME: We should add a non-blocking variant of this.
+ * message.  Use `thread_pool_try_async` to fail instead if the pool's queues
+ * are full.
  *
  * Returns 0 on success, -EINVAL if either of the arguments are invalid.
  */
 int __cheri_compartment("thread_pool")
   thread_pool_async(ThreadPoolCallback fn, void *data);
 
+/**
+ * Invoke a function in another thread, as with `thread_pool_async`, at
+ * `priority`.  The worker thread that picks up the message lowers its
+ * priority to `priority` while the callback runs and returns to its own
+ * priority afterwards, so worker threads should be declared with the highest
+ * priority at which callbacks may run.  Passing `ThreadPoolDefaultPriority`
+ * runs the callback at the worker's priority.
+ *
+ * Returns 0 on success, -EINVAL if any of the arguments are invalid.  If
+ * `priority` is higher than that of the worker thread that picks up the
+ * callback then the callback runs at the worker's priority.
+ */
+int __cheri_compartment("thread_pool")
+  thread_pool_async_priority(ThreadPoolCallback fn, void *data, int priority);
+
+/**
+ * Invoke a function in another thread, as with `thread_pool_async_priority`,
+ * and signal completion.  When the callback returns, the worker thread
+ * atomically increments the word at `completion` and wakes any threads
+ * waiting on it with `futex_wake`.  The caller can wait for completion by
+ * waiting on the futex word, either directly or as a futex event in a
+ * multiwaiter with the value that the word held before this call.
+ *
+ * The `completion` pointer must be a global (not stack) capability that
+ * permits loading and storing the word, because the worker thread writes to
+ * it after this call has returned.  It may be null, in which case this
+ * behaves like `thread_pool_async_priority`.
+ *
+ * Returns 0 on success, -EINVAL if any of the arguments are invalid.
+ */
+int __cheri_compartment("thread_pool")
+  thread_pool_async_completion(ThreadPoolCallback fn,
+                               void              *data,
+                               int                priority,
+                               uint32_t          *completion);
+
+/**
+ * Non-blocking variant of `thread_pool_async_completion`.  The arguments are
+ * the same, but if every worker's queue is full then this returns `-EAGAIN`
+ * instead of waiting for space.
+ *
+ * Returns 0 on success, -EINVAL if any of the arguments are invalid, or
+ * -EAGAIN if the message could not be queued without blocking.
+ */
+int __cheri_compartment("thread_pool")
+  thread_pool_try_async(ThreadPoolCallback fn,
+                        void              *data,
+                        int                priority,
+                        uint32_t          *completion);
+
 /**
  * Run a thread pool.  This does not return and can be used as a thread entry
  * point.
@@ -52,11 +118,15 @@ void __cheri_compartment("thread_pool") thread_pool_run(void);
 __END_DECLS
 
 #ifdef __cplusplus
+#	include <errno.h>
+#	include <futex.h>
 #	include <memory>
+#	include <multiwaiter.h>
 #	include <stdlib.h>
 #	include <token.h>
 #	include <type_traits>
 #	include <cheri.hh>
+#	include <function_wrapper.hh>
 /**
  * For C++ programmers, we provide some more user-friendly wrappers.
  */
@@ -125,22 +195,140 @@ namespace thread_pool
 			Fn{}();
 		}
 
+		/**
+		 * The type of the sealed, reusable objects that hold small lambdas.
+		 */
+		using InlineLambda = InlineFunction<void(), 4 * sizeof(void *)>;
+
+		/**
+		 * The number of `InlineLambda` objects that each compartment keeps
+		 * for reuse, rather than freeing them after their lambda has run.
+		 */
+		constexpr size_t InlineLambdaCacheSize = 4;
+
+		/**
+		 * Sealed `InlineLambda` objects that are not in use.
+		 */
+		struct InlineLambdaCache
+		{
+			/// The cached objects.  The first `count` are valid.
+			void *objects[InlineLambdaCacheSize];
+			/// The number of cached objects.
+			size_t count;
+		};
+
+		/**
+		 * Returns the calling compartment's cache of sealed `Slot` objects.
+		 */
+		template<typename Slot>
+		inline InlineLambdaCache &inline_lambda_cache()
+		{
+			static InlineLambdaCache cache;
+			return cache;
+		}
+
+		/**
+		 * Helper that provides a callback function for invoking a lambda in a
+		 * sealed `Slot` (an `InlineLambda`), and then returning the object to
+		 * the cache, or freeing it if the cache is full.
+		 */
+		template<typename Slot>
+		__cheri_callback void wrap_callback_inline(void *rawSlot)
+		{
+			auto key  = sealing_key_for_type<Slot>();
+			auto slot = token_unseal(key, Sealed(static_cast<Slot *>(rawSlot)));
+			if (slot == nullptr)
+			{
+				return;
+			}
+			(*slot)();
+			std::destroy_at(slot);
+			bool cached = CHERI::with_interrupts_disabled([&]() {
+				auto &cache = inline_lambda_cache<Slot>();
+				if (cache.count == InlineLambdaCacheSize)
+				{
+					return false;
+				}
+				cache.objects[cache.count++] = rawSlot;
+				return true;
+			});
+			if (!cached)
+			{
+				token_obj_destroy(
+				  MALLOC_CAPABILITY, key, static_cast<SObj>(rawSlot));
+			}
+		}
+
+		/**
+		 * Move `lambda` into a sealed `InlineLambda`, reusing one from the
+		 * cache if possible, and dispatch it.  Returns the result of
+		 * `thread_pool_async_completion`.
+		 */
+		template<typename T>
+		int async_inline(T &&lambda, int priority, uint32_t *completion)
+		{
+			void *sealed = CHERI::with_interrupts_disabled([]() -> void * {
+				auto &cache = inline_lambda_cache<InlineLambda>();
+				return (cache.count == 0) ? nullptr
+				                          : cache.objects[--cache.count];
+			});
+			auto  key    = sealing_key_for_type<InlineLambda>();
+			void *buffer = nullptr;
+			if (sealed != nullptr)
+			{
+				auto *slot = static_cast<InlineLambda *>(sealed);
+				buffer     = token_unseal(key, Sealed(slot));
+			}
+			else
+			{
+				Timeout t{UnlimitedTimeout};
+				sealed = token_sealed_unsealed_alloc(
+				  &t, MALLOC_CAPABILITY, key, sizeof(InlineLambda), &buffer);
+			}
+			new (buffer) InlineLambda(
+			  std::move(lambda)); // NOLINT(bugprone-move-forwarding-reference)
+			return thread_pool_async_completion(
+			  &wrap_callback_inline<InlineLambda>,
+			  sealed,
+			  priority,
+			  completion);
+		}
+
 	} // namespace detail
 
 	/**
 	 * Asynchronously invoke a lambda.  This moves the lambda to the heap and
 	 * passes it to the thread pool's queue.  If the lambda copies any stack
-	 * objects by reference then the copy will fail.
+	 * objects by reference then the copy will fail.  Lambdas whose captures
+	 * fit in four pointers are moved into objects that are reused once the
+	 * lambda has run, so repeated calls do not allocate.  The lambda is run at
+	 * `priority` (see `thread_pool_async_priority`).  If `completion` is not
+	 * null then it is incremented and woken when the lambda returns (see
+	 * `thread_pool_async_completion`).  Returns the result of
+	 * `thread_pool_async_completion`.
 	 */
 	template<typename T>
-	void async(T &&lambda)
+	int async(T        &&lambda,
+	           int        priority   = ThreadPoolDefaultPriority,
+	           uint32_t *completion = nullptr)
 	{
 		// If this is a stateless function, just send a callback function
 		// pointer, don't copy zero bytes of state to the heap.
 		if constexpr (std::is_convertible_v<T, void (*)(void)>)
 		{
-			thread_pool_async(
-			  &detail::wrap_callback_function<std::remove_cvref_t<T>>, nullptr);
+			return thread_pool_async_completion(
+			  &detail::wrap_callback_function<std::remove_cvref_t<T>>,
+			  nullptr,
+			  priority,
+			  completion);
+		}
+		else if constexpr (detail::InlineLambda::can_store<T>)
+		{
+			// Small lambdas go in a reusable, type-erased object.
+			return detail::async_inline(
+			  std::move(lambda), // NOLINT(bugprone-move-forwarding-reference)
+			  priority,
+			  completion);
 		}
 		else
 		{
@@ -167,8 +355,269 @@ namespace thread_pool
 			ThreadPoolCallback invoke =
 			  &detail::wrap_callback_lambda<LambdaType>;
 			// Dispatch it.
-			thread_pool_async(invoke, sealed);
+			return thread_pool_async_completion(
+			  invoke, sealed, priority, completion);
+		}
+	}
+
+	/**
+	 * Asynchronously call `fn` (typically a cross-compartment entry point)
+	 * with copies of `args` in a thread-pool thread, and then increment and
+	 * wake the futex word at `completion`.  This is intended for
+	 * fire-and-forget work, such as logging, that should not add the
+	 * latency of the call to the calling thread.  The arguments are copied
+	 * to the heap, so must not be pointers to the caller's stack.
+	 */
+	template<typename Fn, typename... Args>
+	void async_call(uint32_t *completion, Fn fn, Args... args)
+	{
+		async([=]() { fn(args...); }, ThreadPoolDefaultPriority, completion);
+	}
+
+	/**
+	 * The part of a `Future` that does not depend on the type of the result,
+	 * so that futures with different result types can be waited for
+	 * together.
+	 */
+	class FutureBase
+	{
+		protected:
+		/**
+		 * The completion word, which the worker thread increments from zero
+		 * when the task has run.  This is the first word of the heap object
+		 * that also holds the result.  Null if the future is not valid.
+		 */
+		uint32_t *completion = nullptr;
+
+		FutureBase() = default;
+
+		explicit FutureBase(uint32_t *completion) : completion(completion) {}
+
+		public:
+		/// Returns true if this future refers to a task.
+		bool valid() const
+		{
+			return completion != nullptr;
+		}
+
+		/// Returns true if the task has finished, or if this is not valid.
+		bool ready() const
+		{
+			return !valid() ||
+			       (__atomic_load_n(completion, __ATOMIC_ACQUIRE) != 0);
+		}
+
+		/**
+		 * Wait until the task has finished.  Returns 0 once it has or an
+		 * error from `futex_timed_wait` (`-ETIMEDOUT` if the timeout
+		 * expires first).
+		 */
+		int wait(Timeout *timeout)
+		{
+			while (!ready())
+			{
+				int ret = futex_timed_wait(timeout, completion, 0);
+				if ((ret != 0) && !ready())
+				{
+					return ret;
+				}
+			}
+			return 0;
+		}
+
+		/**
+		 * Returns the completion word, for use as a futex event (with the
+		 * value zero) in a multiwaiter.
+		 */
+		uint32_t *completion_word() const
+		{
+			return completion;
+		}
+	};
+
+	/**
+	 * The result of a task run with `async_future`.  The result is held in
+	 * the same heap object as the completion word, so a task costs one
+	 * allocation (and none for the callback if its captures are small) and
+	 * a waiter is woken once, when the task finishes.
+	 *
+	 * Destroying a future waits for the task to finish, because the task
+	 * writes its result into memory that the future owns.
+	 */
+	template<typename T>
+	class Future : public FutureBase
+	{
+		/// The type of the result slot.  Tasks returning `void` have none.
+		using Storage = std::conditional_t<std::is_void_v<T>, char, T>;
+
+		public:
+		/// The heap object shared between the future and the task.
+		struct State
+		{
+			/// The completion word, which must be the first field.
+			uint32_t completion;
+			/// Space for the result, constructed by the task.
+			alignas(Storage) unsigned char result[sizeof(Storage)];
+		};
+
+		private:
+		/// Returns the shared state.
+		State *state() const
+		{
+			return reinterpret_cast<State *>(completion);
+		}
+
+		/// Wait for the task and then free the shared state.
+		void release()
+		{
+			if (!valid())
+			{
+				return;
+			}
+			Timeout t{UnlimitedTimeout};
+			wait(&t);
+			if constexpr (!std::is_void_v<T>)
+			{
+				std::destroy_at(reinterpret_cast<T *>(state()->result));
+			}
+			heap_free(MALLOC_CAPABILITY, state());
+			completion = nullptr;
+		}
+
+		public:
+		/// Construct an invalid future.
+		Future() = default;
+
+		/// Construct a future for a task that will complete `state`.
+		explicit Future(State *state) : FutureBase(&state->completion) {}
+
+		Future(const Future &) = delete;
+		Future &operator=(const Future &) = delete;
+
+		Future(Future &&other) : FutureBase(other.completion)
+		{
+			other.completion = nullptr;
+		}
+
+		Future &operator=(Future &&other)
+		{
+			if (this != &other)
+			{
+				release();
+				completion       = other.completion;
+				other.completion = nullptr;
+			}
+			return *this;
+		}
+
+		~Future()
+		{
+			release();
+		}
+
+		/**
+		 * Wait for the task to finish and return a pointer to its result, or
+		 * null if this future is not valid or the timeout expires first.
+		 * The result lives as long as the future.
+		 */
+		T *get(Timeout *timeout) requires(!std::is_void_v<T>)
+		{
+			if (!valid() || (wait(timeout) != 0))
+			{
+				return nullptr;
+			}
+			return reinterpret_cast<T *>(state()->result);
+		}
+	};
+
+	/**
+	 * Run `fn` in a thread-pool thread at `priority` and return a future for
+	 * its result.  As with `async`, `fn` is moved to the heap, so it must not
+	 * capture references to the caller's stack.  Returns an invalid future
+	 * if the shared state cannot be allocated or the task cannot be queued.
+	 */
+	template<typename Fn>
+	auto async_future(Fn &&fn, int priority = ThreadPoolDefaultPriority)
+	  -> Future<std::invoke_result_t<Fn>>
+	{
+		using Result = std::invoke_result_t<Fn>;
+		using State  = typename Future<Result>::State;
+		Timeout t{UnlimitedTimeout};
+		auto   *state = static_cast<State *>(
+		    heap_allocate(&t, MALLOC_CAPABILITY, sizeof(State)));
+		if (state == nullptr)
+		{
+			return {};
+		}
+		int ret = async(
+		  [state, fn = std::forward<Fn>(fn)]() mutable {
+			  if constexpr (std::is_void_v<Result>)
+			  {
+				  fn();
+			  }
+			  else
+			  {
+				  new (state->result) Result(fn());
+			  }
+		  },
+		  priority,
+		  &state->completion);
+		if (ret != 0)
+		{
+			heap_free(MALLOC_CAPABILITY, state);
+			return {};
+		}
+		return Future<Result>{state};
+	}
+
+	/**
+	 * Wait until any of `futures` has finished, using `waiter`, which must
+	 * have space for `N` events.  Returns the index of a finished (or
+	 * invalid) future, or an error from `multiwaiter_wait` (`-ETIMEDOUT` if
+	 * the timeout expires first).
+	 */
+	template<size_t N>
+	ssize_t wait_any(Timeout           *timeout,
+	                 MultiWaiter       *waiter,
+	                 FutureBase *const (&futures)[N])
+	{
+		EventWaiterSource events[N];
+		while (true)
+		{
+			for (size_t i = 0; i < N; i++)
+			{
+				if (futures[i]->ready())
+				{
+					return i;
+				}
+				events[i] = {
+				  futures[i]->completion_word(), EventWaiterFutex, 0};
+			}
+			int ret = multiwaiter_wait(timeout, waiter, events, N);
+			if (ret != 0)
+			{
+				return ret;
+			}
+		}
+	}
+
+	/**
+	 * Wait until all of `futures` have finished.  Each wait blocks at most
+	 * once per unfinished future and returns immediately for finished ones,
+	 * so this does not need a multiwaiter.  Returns 0 or an error from
+	 * `FutureBase::wait`.
+	 */
+	template<size_t N>
+	int wait_all(Timeout *timeout, FutureBase *const (&futures)[N])
+	{
+		for (auto *future : futures)
+		{
+			if (int ret = future->wait(timeout); ret != 0)
+			{
+				return ret;
+			}
 		}
+		return 0;
 	}
 } // namespace thread_pool
 
@@ -1,5 +1,54 @@
 // Copyright Microsoft and CHERIoT Contributors.
 // SPDX-License-Identifier: MIT
 
-// libc++ headers expect this file to exist, but don't require any definitions
-// from it and so we can provide an empty version.
+#pragma once
+#include <cdefs.h>
+#include <errno.h>
+#include <stdint.h>
+#include <thread.h>
+
+/**
+ * @file time.h
+ *
+ * A subset of the C/POSIX time interfaces.  The only clock is a monotonic
+ * clock that counts from boot, derived from the scheduler's timer.  There is
+ * no wall-clock time.
+ */
+
+/// Time in seconds.
+typedef int64_t time_t;
+
+/// Identifier for a clock.
+typedef int clockid_t;
+
+/// The monotonic clock, which counts from boot.
+#define CLOCK_MONOTONIC 1
+
+/// Seconds and nanoseconds.
+struct timespec
+{
+	/// Whole seconds.
+	time_t tv_sec;
+	/// Nanoseconds, less than one second.
+	long tv_nsec;
+};
+
+/**
+ * Read the clock `clock` into `*time`.  Only `CLOCK_MONOTONIC` is supported.
+ * The resolution is one timer cycle (`CPU_TIMER_HZ`), not one tick.
+ *
+ * Returns 0 on success or `-EINVAL` if the clock is not supported.  Unlike
+ * POSIX, this does not set `errno`.
+ */
+static inline int clock_gettime(clockid_t clock, struct timespec *time)
+{
+	if (clock != CLOCK_MONOTONIC)
+	{
+		return -EINVAL;
+	}
+	uint64_t cycles   = thread_time_cycles_get();
+	uint64_t fraction = cycles % CPU_TIMER_HZ;
+	time->tv_sec      = cycles / CPU_TIMER_HZ;
+	time->tv_nsec     = (long)((fraction * 1000000000ULL) / CPU_TIMER_HZ);
+	return 0;
+}
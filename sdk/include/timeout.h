@@ -9,7 +9,9 @@
  */
 
 #include <cdefs.h>
+#include <riscvreg.h>
 #include <stdint.h>
+#include <tick_macros.h>
 
 /**
  * Quantity used for measuring time for timeouts.  The unit is scheduler ticks.
@@ -19,6 +21,23 @@ typedef uint32_t Ticks;
 /// Value indicating an unbounded timeout.
 static __if_cxx(constexpr) const Ticks UnlimitedTimeout = UINT32_MAX;
 
+/**
+ * Returns the number of ticks until `deadline`, a value of the cycle counter
+ * (see `rdcycle64`), rounded up so that a timeout of this many ticks does not
+ * expire before the deadline.  Returns 0 if the deadline has passed.
+ */
+static inline Ticks timeout_ticks_until(uint64_t deadline)
+{
+	uint64_t now = rdcycle64();
+	if (now >= deadline)
+	{
+		return 0;
+	}
+	uint64_t ticks =
+	  (deadline - now + TIMERCYCLES_PER_TICK - 1) / TIMERCYCLES_PER_TICK;
+	return ticks < UnlimitedTimeout ? (Ticks)ticks : UnlimitedTimeout - 1;
+}
+
 /**
  * Structure representing a timeout.  This is intended to allow a single
  * instance to be chained across blocking calls.
@@ -43,6 +62,25 @@ typedef struct Timeout
 	 * timeout.
 	 */
 	Ticks remaining;
+	/**
+	 * An absolute deadline, as a value of the cycle counter, or 0 if this
+	 * timeout is measured only in ticks.  If this is non-zero, `remaining` is
+	 * recomputed from the deadline whenever time elapses rather than having
+	 * the elapsed time subtracted from it, so rounding errors do not
+	 * accumulate across retries, and the scheduler wakes threads blocked with
+	 * this timeout at the deadline rather than on a tick boundary.
+	 */
+	uint64_t deadline __if_cxx(= 0);
+	/**
+	 * Timer slack: the number of cycles after the timeout expires by which
+	 * the scheduler may delay waking a thread blocked with this timeout.  The
+	 * scheduler uses this to wake threads whose timeouts expire at nearby
+	 * times with a single timer interrupt.  Waits that can tolerate waking a
+	 * little late (polling loops, lock retries, periodic tasks) should set
+	 * this to reduce interrupt and context-switch counts.  The default of 0
+	 * wakes the thread as close to the expiry time as the timer permits.
+	 */
+	uint32_t slack __if_cxx(= 0);
 #ifdef __cplusplus
 	/**
 	 * Constructor, initialises this structure to allow `time` ticks to
@@ -60,6 +98,28 @@ typedef struct Timeout
 	{
 	}
 
+	/**
+	 * Returns a timeout that expires when the cycle counter reaches
+	 * `deadline`.
+	 */
+	static Timeout until(uint64_t deadline)
+	{
+		Timeout t{timeout_ticks_until(deadline)};
+		t.deadline = deadline;
+		return t;
+	}
+
+	/**
+	 * Returns a timeout that allows `time` ticks to elapse and may wake up
+	 * to `slack` cycles late.
+	 */
+	static Timeout with_slack(Ticks time, uint32_t slack)
+	{
+		Timeout t{time};
+		t.slack = slack;
+		return t;
+	}
+
 	/**
 	 * Update this timeout if `time` ticks have elapsed.  This function
 	 * saturates the values on overflow.
@@ -70,7 +130,11 @@ typedef struct Timeout
 		{
 			elapsed = UnlimitedTimeout;
 		}
-		if (remaining != UnlimitedTimeout &&
+		if (deadline != 0)
+		{
+			remaining = timeout_ticks_until(deadline);
+		}
+		else if (remaining != UnlimitedTimeout &&
 		    __builtin_sub_overflow(remaining, time, &remaining))
 		{
 			remaining = 0;
@@ -0,0 +1,132 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * Software timers.
+ *
+ * The `timer_service` compartment runs any number of one-shot and periodic
+ * timers on a single thread, which the firmware must provide, with the entry
+ * point `timer_service_run`.  This replaces a thread (and a stack) for each
+ * periodic activity.  When a timer expires, the service calls its callback,
+ * which runs in the compartment that created the timer, on the service's
+ * thread and at its priority, as `thread_pool_async` callbacks do.  Callbacks
+ * run one at a time, so a callback that blocks delays every other timer:
+ * callbacks should be short and should hand longer work to another thread.
+ *
+ * Timers are allocated from the caller's quota and are referred to by sealed
+ * handles.  At most `--timer-service-max-timers` timers can be running at a
+ * time; any number may exist.
+ */
+
+/**
+ * The type of a timer callback.  This is a CHERI callback, so it runs in the
+ * compartment that created the timer.  The argument is the `data` passed to
+ * `timer_service_create` or, if the timer was created with
+ * `TimerServicePassHandle`, the timer's handle.
+ */
+typedef __cheri_callback void (*TimerServiceCallback)(void *);
+
+/**
+ * Flags for `timer_service_create`.
+ */
+enum TimerServiceFlags
+{
+	/**
+	 * Restart the timer each time it expires, rather than stopping it.
+	 */
+	TimerServicePeriodic = (1 << 0),
+	/**
+	 * Pass the timer's handle to the callback instead of the data, which can
+	 * be retrieved with `timer_service_data`.
+	 */
+	TimerServicePassHandle = (1 << 1),
+};
+
+__BEGIN_DECLS
+
+/**
+ * Create a stopped timer that calls `fn` when it expires, `period` ticks after
+ * it is started, and store its handle in `*outTimer`.  The timer is allocated
+ * from `heapCapability`.
+ *
+ * `fn` must be a callback.  `data` must be global and, unless `flags`
+ * contains `TimerServicePassHandle`, must be sealed or untagged, because it
+ * is passed to the callback from the service's compartment.
+ *
+ * Returns 0 on success, `-ENOMEM` on allocation failure, or `-EINVAL` if any
+ * of the arguments are invalid.
+ */
+int __cheri_compartment("timer_service")
+  timer_service_create(Timeout              *timeout,
+                       struct SObjStruct    *heapCapability,
+                       struct SObjStruct   **outTimer,
+                       TimerServiceCallback  fn,
+                       void                 *data,
+                       Ticks                 period,
+                       uint32_t              flags);
+
+/**
+ * Start `timer`, so that it expires after its period.  If the timer is
+ * already running, this restarts it.
+ *
+ * Returns 0 on success, `-ENOSPC` if the maximum number of timers are already
+ * running, or `-EINVAL` if `timer` is not a valid timer.
+ */
+int __cheri_compartment("timer_service")
+  timer_service_start(struct SObjStruct *timer);
+
+/**
+ * Stop `timer`.  This has no effect if the timer is not running.  A callback
+ * that the service has already begun to call still runs.
+ *
+ * Returns 0 on success or `-EINVAL` if `timer` is not a valid timer.
+ */
+int __cheri_compartment("timer_service")
+  timer_service_stop(struct SObjStruct *timer);
+
+/**
+ * Set the period of `timer` to `period` ticks and (re)start it.
+ *
+ * Returns 0 on success, `-ENOSPC` if the maximum number of timers are already
+ * running, or `-EINVAL` if the arguments are invalid.
+ */
+int __cheri_compartment("timer_service")
+  timer_service_change_period(struct SObjStruct *timer, Ticks period);
+
+/**
+ * Returns 1 if `timer` is running, 0 if it is stopped, or `-EINVAL` if it is
+ * not a valid timer.
+ */
+int __cheri_compartment("timer_service")
+  timer_service_is_active(struct SObjStruct *timer);
+
+/**
+ * Returns the data that `timer` was created with, or null if it is not a
+ * valid timer.
+ */
+void *__cheri_compartment("timer_service")
+  timer_service_data(struct SObjStruct *timer);
+
+/**
+ * Stop `timer` and free it.  `heapCapability` must be the capability that it
+ * was allocated with.
+ *
+ * Returns 0 on success, `-EINVAL` if `timer` is not a valid timer, or the
+ * error from freeing it.
+ */
+int __cheri_compartment("timer_service")
+  timer_service_destroy(struct SObjStruct *heapCapability,
+                        struct SObjStruct *timer);
+
+/**
+ * Run the timer service.  This does not return and should be used as the
+ * entry point of exactly one thread.
+ */
+void __cheri_compartment("timer_service") timer_service_run(void);
+
+__END_DECLS
@@ -38,6 +38,28 @@ __BEGIN_DECLS
  */
 SKey __cheri_compartment("alloc") token_key_new(void);
 
+/**
+ * Destroy a sealing key returned by `token_key_new` so that its sealing type
+ * can be returned by a later call to `token_key_new`.  The key must have both
+ * the permit-seal and permit-unseal permissions.
+ *
+ * This fails if any object sealed with the key, or any token pool for the key,
+ * is still allocated.  Objects that have been freed but whose handles have
+ * not yet been revoked do not prevent this, but the type is not reused until
+ * the revoker has invalidated them.
+ *
+ * The allocator cannot find copies of the key itself, so the caller must
+ * ensure that no other copies remain: anything holding one could seal and
+ * unseal objects created with the key's next owner.  A compartment that is
+ * granted access to this entry point is trusted to do so.
+ *
+ * Returns 0 on success, `-EINVAL` if the key was not returned by
+ * `token_key_new` (or has already been destroyed), or `-EBUSY` if objects
+ * sealed with the key are still allocated.  This API is guaranteed never to
+ * block.
+ */
+int __cheri_compartment("alloc") token_key_destroy(SKey key);
+
 /**
  * Allocate a new object with size `sz`.
  *
@@ -124,6 +146,23 @@ SObj __cheri_compartment("alloc")
 int __cheri_compartment("alloc")
   token_obj_destroy(struct SObjStruct *heapCapability, SKey, SObj);
 
+/**
+ * Destroy each of the `count` sealed objects in the `objects` array, as if by
+ * calling `token_obj_destroy` with `key` on each in turn, with a single
+ * cross-compartment call and a single acquisition of the allocator lock.
+ * This is intended for tearing down tables of objects, such as connections,
+ * that share a sealing key.  Null entries are ignored.
+ *
+ * Returns the number of objects destroyed, `-EPERM` if `heapCapability` is
+ * not valid, or `-EINVAL` if `objects` is not valid.  Objects that could not
+ * be destroyed are skipped; use `token_obj_can_destroy` to determine why.
+ */
+ssize_t __cheri_compartment("alloc")
+  token_obj_destroy_batch(struct SObjStruct  *heapCapability,
+                          SKey                key,
+                          struct SObjStruct **objects,
+                          size_t              count);
+
 /**
  * Check whether the pair of a sealing key and a heap capability can unseal a
  * sealed object.
@@ -134,9 +173,76 @@ int __cheri_compartment("alloc")
 int __cheri_compartment("alloc")
   token_obj_can_destroy(SObj heapCapability, SKey key, SObj object);
 
+/**
+ * Create a pool of `count` sealed objects of `size` bytes each, allocated with
+ * `heapCapability`, for the sealing key `key`, which must have the permit-seal
+ * and permit-unseal permissions.
+ *
+ * Objects are taken from the pool with `token_pool_alloc` and returned with
+ * `token_pool_free`, which do not allocate from or free to the heap.  Objects
+ * from a pool are unsealed with `token_obj_unseal` (or
+ * `token_obj_unseal_dynamic`) as with other dynamically allocated sealed
+ * objects, but cannot be destroyed with `token_obj_destroy`.
+ *
+ * Each time that an object is returned to the pool, handles (sealed pointers)
+ * to it are invalidated and its contents are zeroed.  An object can be
+ * recycled like this a small number of times after which, when it is next
+ * returned, its memory is freed to the heap (so that the revoker invalidates
+ * any unsealed pointers to it) and replaced with a new allocation when the
+ * pool is next empty.  Unsealed pointers that the key holder keeps are
+ * therefore not invalidated immediately on recycling.
+ *
+ * Returns a sealed handle to the pool, or `INVALID_SOBJ` on error.  The
+ * memory for each object is slightly larger than `size`, and must be
+ * representable for each generation of handles, which may fail for large
+ * objects.
+ */
+SObj __cheri_compartment("alloc")
+  token_pool_create(Timeout           *timeout,
+                    struct SObjStruct *heapCapability,
+                    SKey               key,
+                    size_t             size,
+                    size_t             count);
+
+/**
+ * Take an object from a pool created with `token_pool_create` and return a
+ * sealed handle to it.  `key` must be the pool's key, with the permit-seal
+ * permission.  If `unsealed` is not null, the unsealed pointer to the object
+ * is returned via it.  The object is zeroed.
+ *
+ * This never blocks.  Returns `INVALID_SOBJ` if the pool is empty or if the
+ * arguments are not valid.
+ */
+SObj __cheri_compartment("alloc")
+  token_pool_alloc(struct SObjStruct *pool, SKey key, void **unsealed);
+
+/**
+ * Return an object to the pool that it was taken from.  `key` must be the
+ * pool's key, with the permit-unseal permission.  After this call, `object`
+ * and any other copies of it can no longer be unsealed.
+ *
+ * Returns 0 on success or `-EINVAL` if the arguments are not valid, or if
+ * `object` is not a current handle to an object from this pool.
+ */
+int __cheri_compartment("alloc")
+  token_pool_free(struct SObjStruct *pool, SKey key, SObj object);
+
+/**
+ * Destroy a pool and free its memory.  `heapCapability` must be the heap
+ * capability that was used to create the pool.  All handles to objects in the
+ * pool, including those that are still allocated, are invalidated.
+ *
+ * Returns 0 on success, `-EINVAL` if `pool` is not a valid pool, or one of the
+ * errors from `heap_free` if the pool cannot be freed with `heapCapability`.
+ */
+int __cheri_compartment("alloc")
+  token_pool_destroy(struct SObjStruct *heapCapability,
+                     struct SObjStruct *pool);
+
 __END_DECLS
 
 #ifdef __cplusplus
+#	include <cheri-builtins.h>
 #	include <utility>
 
 /**
@@ -191,9 +297,81 @@ token_allocate(Timeout *timeout, struct SObjStruct *heapCapability, SKey key)
 	return {static_cast<T *>(unsealed), Sealed<T>{sealed}};
 }
 
+/**
+ * Type-safe helper to unseal a `Sealed<T>`.  Handles that are untagged or not
+ * sealed (including null) are rejected inline, without calling the token
+ * library.
+ */
 template<typename T>
 __always_inline T *token_unseal(SKey key, Sealed<T> sealed)
 {
-	return static_cast<T *>(token_obj_unseal(key, sealed));
+	SObj raw = sealed;
+	if (!__builtin_cheri_tag_get(raw) || !__builtin_cheri_sealed_get(raw))
+	{
+		return nullptr;
+	}
+	return static_cast<T *>(token_obj_unseal(key, raw));
 }
+
+/**
+ * A sealing key for objects of type `T`, checked once when it is constructed.
+ *
+ * The unsealing authority for token objects is held only by the token
+ * library, so the unseal and the header check cannot be done in the caller.
+ * This instead keeps everything that the caller can check out of the library
+ * call: a key that could never unseal anything (untagged, without
+ * permit-unseal, or not a sealing key) is replaced with null on construction
+ * and every unseal with it then fails without a call, as does any unseal of a
+ * handle that is not a valid sealed capability.  Compartments that unseal
+ * the same type frequently can keep an instance in a global or static local.
+ */
+template<typename T>
+class TokenKey
+{
+	/// The key, or null if it failed the checks in the constructor.
+	SKey key;
+
+	public:
+	/// Check and wrap `rawKey`.
+	__always_inline TokenKey(SKey rawKey) : key(nullptr)
+	{
+		if (__builtin_cheri_tag_get(rawKey) &&
+		    !__builtin_cheri_sealed_get(rawKey) &&
+		    (__builtin_cheri_address_get(rawKey) ==
+		     __builtin_cheri_base_get(rawKey)) &&
+		    (__builtin_cheri_length_get(rawKey) > 0) &&
+		    (__builtin_cheri_perms_get(rawKey) & CHERI_PERM_UNSEAL))
+		{
+			key = rawKey;
+		}
+	}
+
+	/// Returns true if this key may be able to unseal objects.
+	[[nodiscard]] bool is_valid() const
+	{
+		return key != nullptr;
+	}
+
+	/// Returns the wrapped key, or null if it is not valid.
+	SKey get() const
+	{
+		return key;
+	}
+
+	/// Unseal `sealed`, returning null if it is not a `T` sealed with this key.
+	__always_inline T *unseal(Sealed<T> sealed) const
+	{
+		if (key == nullptr)
+		{
+			return nullptr;
+		}
+		return token_unseal<T>(key, sealed);
+	}
+
+	/// Unseal a raw sealed object pointer.
+	__always_inline T *unseal(SObj sealed) const
+	{
+		return unseal(Sealed<T>{sealed});
+	}
+};
 #endif // __cplusplus
@@ -0,0 +1,99 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <cdefs.h>
+#include <multiwaiter.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <timeout.h>
+
+/**
+ * Interrupt-driven UART driver.
+ *
+ * The `uart_driver` compartment owns the UART and moves data between it and
+ * a pair of ring buffers (of `--uart-driver-buffer-size` bytes each) from a
+ * driver thread, which the firmware must provide, with the entry point
+ * `uart_driver_run`.  The driver thread sleeps until the UART's receive
+ * watermark interrupt fires or a writer queues data, so neither readers nor
+ * writers spin on the UART.
+ *
+ * This driver supports the OpenTitan UART used by the Sonata boards.  The
+ * interrupt that it uses is named by `CHERIOT_UART_DRIVER_INTERRUPT` (by
+ * default `UartRxWatermark`).  If that interrupt also carries the transmit
+ * watermark (as the combined per-UART interrupts on some boards do), define
+ * `CHERIOT_UART_DRIVER_TRANSMIT_INTERRUPT` to 1 and the driver will sleep
+ * while waiting for space in the transmit FIFO.  Otherwise, it polls the
+ * transmit FIFO once per tick while there is data to send.
+ */
+
+/**
+ * Queue up to `length` bytes from `buffer` for transmission.  If there is not
+ * enough space, this waits until there is, or until `timeout` expires.  A
+ * zero timeout makes this non-blocking.
+ *
+ * Returns the number of bytes queued, which may be fewer than `length` if the
+ * timeout expired.  Returns `-ETIMEDOUT` if no bytes could be queued before
+ * the timeout, or `-EINVAL` if `buffer` is not readable for `length` bytes.
+ */
+ssize_t __cheri_compartment("uart_driver")
+  uart_write(Timeout *timeout, const void *buffer, size_t length);
+
+/**
+ * A `StdioStreamWrite` function (see `stdio.h`) that queues data for the
+ * driver without blocking.  This lets `printf` to a buffered stream return
+ * without waiting for the UART: data that the driver cannot accept yet stays
+ * in the stream's buffer until the next flush.  The context is unused.
+ */
+static inline ssize_t
+uart_driver_stream_write(void *context, const char *data, size_t length)
+{
+	(void)context;
+	Timeout timeout = {0, 0};
+	ssize_t written = uart_write(&timeout, data, length);
+	return written < 0 ? 0 : written;
+}
+
+/**
+ * Read up to `length` received bytes into `buffer`.  If no bytes have been
+ * received, this waits until some are, or until `timeout` expires.  A zero
+ * timeout makes this non-blocking.
+ *
+ * Returns the number of bytes read, `-ETIMEDOUT` if no bytes were received
+ * before the timeout, or `-EINVAL` if `buffer` is not writable for `length`
+ * bytes.
+ */
+ssize_t __cheri_compartment("uart_driver")
+  uart_read(Timeout *timeout, void *buffer, size_t length);
+
+/**
+ * Initialise an event waiter source so that it fires when there are received
+ * bytes to read.  As with other multiwaiter sources, another reader may take
+ * the bytes before this reader wakes up, so `uart_read` should be called with
+ * a zero timeout after the event fires.
+ *
+ * Returns 0 on success or `-EINVAL` if `source` is not writable.
+ */
+int __cheri_compartment("uart_driver")
+  multiwaiter_uart_read_init(struct EventWaiterSource *source);
+
+/**
+ * Initialise an event waiter source so that it fires when there is space in
+ * the transmit buffer.  The same caveat applies as for
+ * `multiwaiter_uart_read_init`.
+ *
+ * Returns 0 on success or `-EINVAL` if `source` is not writable.
+ */
+int __cheri_compartment("uart_driver")
+  multiwaiter_uart_write_init(struct EventWaiterSource *source);
+
+/**
+ * Returns the number of received bytes that have been discarded because the
+ * receive buffer was full.
+ */
+uint32_t __cheri_compartment("uart_driver") uart_receive_overflows(void);
+
+/**
+ * Entry point for the UART driver thread.  This never returns.
+ */
+void __cheri_compartment("uart_driver") uart_driver_run(void);
@@ -53,6 +53,14 @@ __always_inline static inline void cleanup_unwind(void)
  *
  * Any automatic-storage values accessed in both blocks must be declared
  * `volatile`.
+ *
+ * Entering a `CHERIOT_DURING` block costs a call to `setjmp`, which saves
+ * `cs0`, `cs1`, `csp`, and `cra`, and two stores to link the block into the
+ * cleanup list.  No cross-compartment calls are made unless the block is
+ * unwound.  The stackless error handler in `unwind_error_handler` receives
+ * only the trap cause and value, not the faulting PC, so it cannot look up
+ * handlers by code address and instead finds the innermost block through the
+ * cleanup list.
  */
 #define CHERIOT_DURING                                                         \
 	{                                                                          \
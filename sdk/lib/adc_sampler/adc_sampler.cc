@@ -0,0 +1,211 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <adc_sampler.h>
+#include <array>
+#include <cheri.hh>
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <debug.hh>
+#include <errno.h>
+#include <platform-adc.hh>
+#include <queue.h>
+#include <riscvreg.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <tick_macros.h>
+#include <timeout.h>
+
+using namespace CHERI;
+
+using Debug = ConditionalDebug<false, "ADC sampler">;
+
+#if !DEVICE_EXISTS(adc)
+#	error The ADC sampler requires a board with an ADC
+#endif
+
+#ifndef CHERIOT_ADC_SAMPLER_CHANNEL
+#	define CHERIOT_ADC_SAMPLER_CHANNEL ArduinoA0
+#endif
+
+#ifndef CHERIOT_ADC_SAMPLER_RATE
+#	define CHERIOT_ADC_SAMPLER_RATE 1000
+#endif
+
+#ifndef CHERIOT_ADC_SAMPLER_BLOCK_SIZE
+#	define CHERIOT_ADC_SAMPLER_BLOCK_SIZE 256
+#endif
+
+namespace
+{
+	/**
+	 * The channel that is sampled.
+	 */
+	constexpr auto Channel = SonataAnalogueDigitalConverter::
+	  MeasurementRegister::CHERIOT_ADC_SAMPLER_CHANNEL;
+
+	/**
+	 * The number of samples in each block.
+	 */
+	constexpr size_t BlockSize = CHERIOT_ADC_SAMPLER_BLOCK_SIZE;
+	static_assert(BlockSize > 0, "ADC sample blocks must not be empty");
+
+	/**
+	 * The number of cycles between samples.
+	 */
+	constexpr uint64_t SamplePeriod = CPU_TIMER_HZ / CHERIOT_ADC_SAMPLER_RATE;
+	static_assert(SamplePeriod > 0, "The ADC sample rate is too high");
+	static_assert(CHERIOT_ADC_SAMPLER_RATE <=
+	                SonataAnalogueDigitalConverter::MaxSamples,
+	              "The ADC sample rate is higher than the XADC can convert");
+
+	/**
+	 * The number of cycles in a scheduler tick.
+	 */
+	constexpr uint64_t CyclesPerTick = TIMERCYCLES_PER_TICK;
+
+	/**
+	 * The two sample blocks, filled in turn.
+	 */
+	std::array<std::array<int16_t, BlockSize>, 2> blocks;
+
+	/**
+	 * True while the block most recently sent (with the sequence number
+	 * `heldSequence`) has not been released by the consumer.
+	 */
+	cheriot::atomic<bool> held;
+
+	/**
+	 * The sequence number of the block most recently sent.
+	 */
+	uint32_t heldSequence;
+
+	/**
+	 * The queue (send and receive) on which completed blocks are sent.
+	 */
+	SObjStruct *queue;
+
+	/**
+	 * The receive-only handle for `queue` that is given to consumers.
+	 */
+	SObjStruct *receiveHandle;
+
+	/**
+	 * Set to 1 once `receiveHandle` is valid.  This is a futex word.
+	 */
+	cheriot::atomic<uint32_t> ready;
+
+	/**
+	 * Wait until the cycle counter reaches `deadline`.  This sleeps for as
+	 * many whole ticks as possible and spins for the remainder.
+	 */
+	void wait_until(uint64_t deadline)
+	{
+		uint64_t now = rdcycle64();
+		while ((deadline > now) && (deadline - now > CyclesPerTick))
+		{
+			Timeout t{static_cast<Ticks>((deadline - now) / CyclesPerTick)};
+			thread_sleep(&t, ThreadSleepNoEarlyWake);
+			now = rdcycle64();
+		}
+		while (rdcycle64() < deadline) {}
+	}
+
+	/**
+	 * Create the queue and the consumers' handle for it, and wake any
+	 * threads waiting in `adc_sampler_queue`.
+	 */
+	void create_queue()
+	{
+		Timeout unlimited{UnlimitedTimeout};
+		int     ret = queue_create_sealed(
+		  &unlimited, MALLOC_CAPABILITY, &queue, sizeof(AdcSampleBlock), 1);
+		Debug::Invariant(ret == 0, "Failed to create ADC queue: {}", ret);
+		ret = queue_receive_handle_create_sealed(
+		  &unlimited, MALLOC_CAPABILITY, queue, &receiveHandle);
+		Debug::Invariant(
+		  ret == 0, "Failed to create ADC receive handle: {}", ret);
+		ready = 1;
+		ready.notify_all();
+	}
+} // namespace
+
+int adc_sampler_queue(Timeout *timeout, SObjStruct **outQueue)
+{
+	if (!check_timeout_pointer(timeout) ||
+	    !check_pointer<PermissionSet{Permission::Store}, false>(outQueue))
+	{
+		return -EINVAL;
+	}
+	while (ready.load() == 0)
+	{
+		if (ready.wait(timeout, 0) == -ETIMEDOUT)
+		{
+			return -ETIMEDOUT;
+		}
+	}
+	*outQueue = receiveHandle;
+	return 0;
+}
+
+int adc_sampler_release(uint32_t sequence)
+{
+	if (!held.load() || (sequence != heldSequence))
+	{
+		return -EINVAL;
+	}
+	held = false;
+	return 0;
+}
+
+void adc_sampler_run()
+{
+	SonataAnalogueDigitalConverter adc{
+	  SonataAnalogueDigitalConverter::PowerDownMode::None};
+	create_queue();
+	uint32_t sequence = 0;
+	uint32_t overruns = 0;
+	size_t   fill     = 0;
+	uint64_t deadline = rdcycle64();
+	while (true)
+	{
+		for (auto &sample : blocks[fill])
+		{
+			wait_until(deadline);
+			sample = adc.read_last_measurement(Channel);
+			// If the thread has fallen more than a sample behind (for
+			// example, because it was preempted), restart the schedule from
+			// now rather than taking a burst of samples to catch up.
+			deadline += SamplePeriod;
+			if (uint64_t now = rdcycle64(); now > deadline)
+			{
+				deadline = now;
+			}
+		}
+		if (held.load())
+		{
+			// The consumer still has the other block, so drop this one and
+			// fill it again.
+			overruns++;
+			sequence++;
+			continue;
+		}
+		Capability<const int16_t> samples{blocks[fill].data()};
+		samples.bounds() = sizeof(blocks[fill]);
+		samples.permissions() &=
+		  PermissionSet{Permission::Load, Permission::Global};
+		AdcSampleBlock block{samples, BlockSize, sequence, overruns};
+		heldSequence = sequence;
+		held         = true;
+		Timeout noWait{0};
+		if (queue_send_sealed(&noWait, queue, &block) != 0)
+		{
+			held = false;
+			overruns++;
+			sequence++;
+			continue;
+		}
+		sequence++;
+		fill ^= 1;
+	}
+}
@@ -0,0 +1,14 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../compartment_helpers", "../queue")
+
+compartment("adc_sampler")
+  set_default(false)
+  add_deps("compartment_helpers", "message_queue")
+  add_files("adc_sampler.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_ADC_SAMPLER_CHANNEL=" .. get_config("adc-sampler-channel"))
+	target:add('defines', "CHERIOT_ADC_SAMPLER_RATE=" .. math.floor(tonumber(get_config("adc-sampler-rate"))))
+	target:add('defines', "CHERIOT_ADC_SAMPLER_BLOCK_SIZE=" .. math.floor(tonumber(get_config("adc-sampler-block-size"))))
+  end)
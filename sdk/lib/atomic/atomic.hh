@@ -2,8 +2,25 @@
 // SPDX-License-Identifier: MIT
 
 #include <compartment.h>
+#include <stddef.h>
 #include <stdint.h>
 
+/**
+ * With the A extension (boards with `"atomics": "amo"`), the compiler emits
+ * atomic instructions for operations of up to four bytes and so does not call
+ * these functions for them.  The library versions of those sizes use the same
+ * builtins, so that code compiled without the A extension still gets native
+ * atomics if it calls them.  Larger atomics always run with interrupts
+ * disabled.
+ */
+template<size_t Size>
+constexpr bool NativeAtomics =
+#ifdef __riscv_atomic
+  Size <= 4;
+#else
+  false;
+#endif
+
 /**
  * The helper functions need to expose an unmangled name because the compiler
  * inserts calls to them.  Declare them using the asm label extension.
@@ -18,13 +35,18 @@
  *
  * Ideally the compiler should know that a system with a single core can do a
  * single load for most cases of this, rather than needing a cross-library
- * call, so eventually this will go away.
+ * call.  C++ code using `std::atomic` already does this inline (see
+ * `c++-config/atomic`), so only C and direct uses of the builtins need this.
  */
 #define DEFINE_ATOMIC_LOAD(size, type)                                         \
 	DECLARE_ATOMIC_LIBCALL(__atomic_load_##size, type, const type *, int);     \
 	type __atomic_load_##size(const type *ptr, int)                            \
 	{                                                                          \
 		static_assert(sizeof(type) == size, "Invalid type for size");          \
+		if constexpr (NativeAtomics<size>)                                     \
+		{                                                                      \
+			return __atomic_load_n(ptr, __ATOMIC_SEQ_CST);                     \
+		}                                                                      \
 		return *ptr;                                                           \
 	}
 
@@ -34,13 +56,17 @@
  *
  * Ideally the compiler should know that a system with a single core can do a
  * single store for most cases of this, rather than needing a cross-library
- * call, so eventually this will go away.
+ * call.  As with loads, `std::atomic` already does this inline.
  */
 #define DEFINE_ATOMIC_STORE(size, type)                                        \
 	DECLARE_ATOMIC_LIBCALL(__atomic_store_##size, void, type *, type, int);    \
 	void __atomic_store_##size(type *ptr, type value, int)                     \
 	{                                                                          \
 		static_assert(sizeof(type) == size, "Invalid type for size");          \
+		if constexpr (NativeAtomics<size>)                                     \
+		{                                                                      \
+			return __atomic_store_n(ptr, value, __ATOMIC_SEQ_CST);             \
+		}                                                                      \
 		*ptr = value;                                                          \
 	}
 
@@ -56,6 +82,10 @@
 	type __atomic_fetch_##name##_##size(type *ptr, type value, int)            \
 	{                                                                          \
 		static_assert(sizeof(type) == size, "Invalid type for size");          \
+		if constexpr (NativeAtomics<size>)                                     \
+		{                                                                      \
+			return __atomic_fetch_##name(ptr, value, __ATOMIC_SEQ_CST);        \
+		}                                                                      \
 		type          tmp = *ptr;                                              \
 		*ptr              = tmp op value;                                      \
 		return tmp;                                                            \
@@ -80,6 +110,10 @@
 	type __atomic_exchange_##size(type *ptr, type value, int)                  \
 	{                                                                          \
 		static_assert(sizeof(type) == size, "Invalid type for size");          \
+		if constexpr (NativeAtomics<size>)                                     \
+		{                                                                      \
+			return __atomic_exchange_n(ptr, value, __ATOMIC_SEQ_CST);          \
+		}                                                                      \
 		type tmp = *ptr;                                                       \
 		*ptr     = value;                                                      \
 		return tmp;                                                            \
@@ -96,6 +130,15 @@
 	  type *ptr, type *expected, type desired, int, int)                       \
 	{                                                                          \
 		static_assert(sizeof(type) == size, "Invalid type for size");          \
+		if constexpr (NativeAtomics<size>)                                     \
+		{                                                                      \
+			return __atomic_compare_exchange_n(ptr,                            \
+			                                   expected,                       \
+			                                   desired,                        \
+			                                   false,                          \
+			                                   __ATOMIC_SEQ_CST,               \
+			                                   __ATOMIC_SEQ_CST);              \
+		}                                                                      \
 		if (*ptr == *expected)                                                 \
 		{                                                                      \
 			*ptr = desired;                                                    \
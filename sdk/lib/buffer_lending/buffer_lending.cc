@@ -0,0 +1,100 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <buffer_lending.h>
+#include <cheri.hh>
+#include <errno.h>
+
+using namespace CHERI;
+
+namespace
+{
+	/**
+	 * The permissions of a lent view: load data only.  Without `Global`, the
+	 * view can be stored only on the stack, and so the callee cannot keep it
+	 * after it returns.
+	 */
+	constexpr PermissionSet LentPermissions{Permission::Load};
+
+	/**
+	 * The permissions that the owner keeps while a buffer is frozen:
+	 * everything except the ability to store through it, or through any
+	 * capability loaded from it.
+	 */
+	constexpr PermissionSet FrozenPermissions{Permission::Global,
+	                                          Permission::Load,
+	                                          Permission::LoadStoreCapability,
+	                                          Permission::LoadGlobal};
+
+	/**
+	 * Returns `buffer` restricted to the `length` bytes at its address, with
+	 * at most `permissions`, or an untagged capability if `buffer` does not
+	 * cover those bytes or they cannot be represented exactly.
+	 */
+	Capability<void>
+	restricted_view(void *buffer, size_t length, PermissionSet permissions)
+	{
+		Capability cap{buffer};
+		if (!cap.is_valid() || cap.is_sealed() || !(cap.bounds() >= length) ||
+		    !cap.permissions().contains(Permission::Load))
+		{
+			return nullptr;
+		}
+		cap.permissions() &= permissions;
+		cap.bounds() = length;
+		return cap;
+	}
+} // namespace
+
+const void *buffer_lend_read_only(const void *buffer, size_t length)
+{
+	Capability cap =
+	  restricted_view(const_cast<void *>(buffer), length, LentPermissions);
+	return cap.is_valid() ? cap.get() : nullptr;
+}
+
+int buffer_freeze(struct SObjStruct  *heapCapability,
+                  void              **owner,
+                  void              **original,
+                  size_t              length)
+{
+	void *buffer = *owner;
+	if (!Capability{buffer}.permissions().contains(Permission::Store))
+	{
+		return -EINVAL;
+	}
+	Capability frozen = restricted_view(buffer, length, FrozenPermissions);
+	// The lent view has the same bounds, so checking that these are exact
+	// also ensures that the buffer can be lent.
+	if (!frozen.is_valid())
+	{
+		return -EINVAL;
+	}
+	if (heap_address_is_valid(buffer) &&
+	    (heap_claim(heapCapability, buffer) <= 0))
+	{
+		return -ENOMEM;
+	}
+	*original = buffer;
+	*owner    = frozen;
+	return 0;
+}
+
+int buffer_thaw(struct SObjStruct  *heapCapability,
+                void              **owner,
+                void               *original)
+{
+	Capability frozen{*owner};
+	Capability writable{original};
+	if (!frozen.is_valid() || !writable.is_valid() ||
+	    (frozen.address() != writable.address()))
+	{
+		return -EINVAL;
+	}
+	*owner = original;
+	if (heap_address_is_valid(original))
+	{
+		heap_free(heapCapability, original);
+	}
+	return 0;
+}
@@ -0,0 +1,3 @@
+library("buffer_lending")
+  set_default(false)
+  add_files("buffer_lending.cc")
@@ -0,0 +1,232 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <array>
+#include <checksum.h>
+
+namespace
+{
+	/// A word that may alias the bytes being checksummed.
+	using Word = uint32_t __attribute__((may_alias));
+
+	/// A half word that may alias the bytes being checksummed.
+	using HalfWord = uint16_t __attribute__((may_alias));
+
+	/**
+	 * Returns true if the address of `p` is a multiple of `alignment`.
+	 */
+	bool is_aligned(const uint8_t *p, size_t alignment)
+	{
+		return (__builtin_cheri_address_get(p) & (alignment - 1)) == 0;
+	}
+
+	/**
+	 * Fold a 32-bit one's complement sum to 16 bits.
+	 */
+	uint32_t fold(uint32_t sum)
+	{
+		sum = (sum & 0xffff) + (sum >> 16);
+		return (sum & 0xffff) + (sum >> 16);
+	}
+
+	/**
+	 * Add `value` to the 32-bit one's complement sum `sum`.
+	 */
+	uint32_t add_carry(uint32_t sum, uint32_t value)
+	{
+		sum += value;
+		return sum + (sum < value);
+	}
+
+	/// The reflected CRC-32 polynomial.
+	constexpr uint32_t Crc32Polynomial = 0xedb88320;
+
+	/// The CRC-16-CCITT polynomial.
+	constexpr uint16_t Crc16Polynomial = 0x1021;
+
+	/**
+	 * The slicing-by-4 tables for CRC-32.  Table 0 is the usual byte-at-a-time
+	 * table and table n gives the contribution of a byte followed by n zero
+	 * bytes.
+	 */
+	constexpr auto Crc32Tables = []() {
+		std::array<std::array<uint32_t, 256>, 4> tables{};
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc >> 1) ^ ((crc & 1) ? Crc32Polynomial : 0);
+			}
+			tables[0][i] = crc;
+		}
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			for (size_t table = 1; table < 4; table++)
+			{
+				uint32_t previous = tables[table - 1][i];
+				tables[table][i] =
+				  (previous >> 8) ^ tables[0][previous & 0xff];
+			}
+		}
+		return tables;
+	}();
+
+	/// The byte-at-a-time table for CRC-16-CCITT.
+	constexpr auto Crc16Table = []() {
+		std::array<uint16_t, 256> table{};
+		for (uint32_t i = 0; i < 256; i++)
+		{
+			uint16_t crc = i << 8;
+			for (int bit = 0; bit < 8; bit++)
+			{
+				crc = (crc << 1) ^ ((crc & 0x8000) ? Crc16Polynomial : 0);
+			}
+			table[i] = crc;
+		}
+		return table;
+	}();
+
+	/**
+	 * Add one byte to a (pre-inverted) CRC-32.
+	 */
+	uint32_t crc32_byte(uint32_t crc, uint8_t byte)
+	{
+		return (crc >> 8) ^ Crc32Tables[0][(crc ^ byte) & 0xff];
+	}
+
+	/**
+	 * Add one little-endian word to a (pre-inverted) CRC-32.
+	 */
+	uint32_t crc32_word(uint32_t crc, uint32_t word)
+	{
+		crc ^= word;
+#ifdef __riscv_zbc
+		// Barrett reduction in the reflected domain: the quotient is the low
+		// half of the product with the reflected floor(x^64 / P) and the
+		// remainder is the reflected high half of its product with P.
+		uint32_t quotient;
+		__asm__("clmul %0, %1, %2"
+		        : "=r"(quotient)
+		        : "r"(crc), "r"(0xf7011641));
+		__asm__("clmulr %0, %1, %2"
+		        : "=r"(crc)
+		        : "r"(quotient), "r"(Crc32Polynomial));
+		return crc;
+#else
+		return Crc32Tables[3][crc & 0xff] ^ Crc32Tables[2][(crc >> 8) & 0xff] ^
+		       Crc32Tables[1][(crc >> 16) & 0xff] ^ Crc32Tables[0][crc >> 24];
+#endif
+	}
+} // namespace
+
+uint32_t
+checksum_internet_partial(const void *data, size_t length, uint32_t sum)
+{
+	auto    *p     = static_cast<const uint8_t *>(data);
+	uint32_t words = 0;
+	// Sum the words of the data as if it started one byte earlier if it is at
+	// an odd address, so that word loads are aligned.  This sums the bytes in
+	// the opposite lanes, which swaps the bytes of the folded result.
+	bool oddStart = !is_aligned(p, 2) && (length > 0);
+	if (oddStart)
+	{
+		words = uint32_t(*p++) << 8;
+		length--;
+	}
+	if ((length >= 2) && !is_aligned(p, 4))
+	{
+		words += *reinterpret_cast<const HalfWord *>(p);
+		p += 2;
+		length -= 2;
+	}
+	// Sum four words per iteration, keeping the carries in a second
+	// accumulator.
+	uint32_t carries = 0;
+	while (length >= 16)
+	{
+		auto *w = reinterpret_cast<const Word *>(p);
+		for (int i = 0; i < 4; i++)
+		{
+			words += w[i];
+			carries += (words < w[i]);
+		}
+		p += 16;
+		length -= 16;
+	}
+	while (length >= 4)
+	{
+		words = add_carry(words, *reinterpret_cast<const Word *>(p));
+		p += 4;
+		length -= 4;
+	}
+	if (length >= 2)
+	{
+		words = add_carry(words, *reinterpret_cast<const HalfWord *>(p));
+		p += 2;
+		length -= 2;
+	}
+	if (length > 0)
+	{
+		// The last byte is the first byte of a half word padded with zero.
+		words = add_carry(words, *p);
+	}
+	uint32_t result = fold(add_carry(words, carries));
+	if (oddStart)
+	{
+		result = ((result & 0xff) << 8) | (result >> 8);
+	}
+	return fold(add_carry(fold(sum), result));
+}
+
+uint16_t checksum_internet_finish(uint32_t sum)
+{
+	return ~fold(sum);
+}
+
+uint16_t checksum_internet(const void *data, size_t length)
+{
+	return checksum_internet_finish(checksum_internet_partial(data, length, 0));
+}
+
+uint16_t checksum_internet_update(uint16_t checksum,
+                                  uint16_t oldValue,
+                                  uint16_t newValue)
+{
+	// Equation 3 of RFC 1624: HC' = ~(~HC + ~m + m')
+	uint32_t sum = uint16_t(~checksum) + uint16_t(~oldValue) + newValue;
+	return ~fold(sum);
+}
+
+uint32_t checksum_crc32(uint32_t crc, const void *data, size_t length)
+{
+	auto *p = static_cast<const uint8_t *>(data);
+	crc     = ~crc;
+	while ((length > 0) && !is_aligned(p, 4))
+	{
+		crc = crc32_byte(crc, *p++);
+		length--;
+	}
+	while (length >= 4)
+	{
+		crc = crc32_word(crc, *reinterpret_cast<const Word *>(p));
+		p += 4;
+		length -= 4;
+	}
+	while (length > 0)
+	{
+		crc = crc32_byte(crc, *p++);
+		length--;
+	}
+	return ~crc;
+}
+
+uint16_t checksum_crc16_ccitt(uint16_t crc, const void *data, size_t length)
+{
+	auto *p = static_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < length; i++)
+	{
+		crc = (crc << 8) ^ Crc16Table[(crc >> 8) ^ p[i]];
+	}
+	return crc;
+}
@@ -0,0 +1,6 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+library("checksum")
+  set_default(false)
+  add_files("checksum.cc")
@@ -33,13 +33,3 @@ bool check_pointer(const void *ptr,
 	isValid &= permissions.can_derive_from(cap.permissions());
 	return isValid;
 }
-
-bool __cheri_libcall check_timeout_pointer(const struct Timeout *timeout)
-{
-	return !heap_address_is_valid(timeout) &&
-	       check_pointer(
-	         timeout,
-	         sizeof(struct Timeout),
-	         PermissionSet{Permission::Load, Permission::Store}.as_raw(),
-	         false);
-}
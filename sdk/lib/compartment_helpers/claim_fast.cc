@@ -7,67 +7,114 @@
 #include <stdlib.h>
 #include <switcher.h>
 
-int heap_claim_fast(Timeout *timeout, const void *ptr, const void *ptr2)
+namespace
 {
-	void   **hazards = switcher_thread_hazard_slots();
-	auto    *epochCounter{const_cast<
-      cheriot::atomic<uint32_t> *>(SHARED_OBJECT_WITH_PERMISSIONS(
-	     cheriot::atomic<uint32_t>, allocator_epoch, true, false, false, false))};
-	uint32_t epoch  = epochCounter->load();
-	int      values = 2;
-	// Skip processing pointers that don't refer to heap memory.
-	if (!heap_address_is_valid(ptr))
-	{
-		ptr = nullptr;
-		values--;
-	}
-	if (!heap_address_is_valid(ptr2))
-	{
-		ptr2 = nullptr;
-		values--;
-	}
-	// If neither pointer refers to heap memory, set without synchronizing.  It
-	// doesn't matter if the revoker sees these or not, they cannot extend the
-	// lifetime of a heap object.
-	if (values == 0)
+	/**
+	 * Clear all of this thread's hazard slots.
+	 */
+	void hazards_clear(void **hazards)
 	{
-		hazards[0] = nullptr;
-		hazards[1] = nullptr;
-		return 0;
+		for (size_t i = 0; i < CHERIOT_HAZARD_POINTERS_PER_THREAD; i++)
+		{
+			hazards[i] = nullptr;
+		}
 	}
-	uint32_t oldEpoch;
-	do
+
+	/**
+	 * Shared implementation of `heap_claim_fast` and `heap_claim_fast_array`.
+	 * Claims the first `count` entries of `pointers` and clears the remaining
+	 * slots.  `count` must be no larger than the number of hazard slots.
+	 */
+	int claim_fast(Timeout *timeout, const void **pointers, size_t count)
 	{
-		while (epoch & 1)
+		void **hazards      = switcher_thread_hazard_slots();
+		auto  *epochCounter = const_cast<cheriot::atomic<uint32_t> *>(
+		  SHARED_OBJECT_WITH_PERMISSIONS(
+		    cheriot::atomic<uint32_t>, allocator_epoch, true, false, false, false));
+		uint32_t epoch  = epochCounter->load();
+		size_t   values = count;
+		// Skip processing pointers that don't refer to heap memory.
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!heap_address_is_valid(pointers[i]))
+			{
+				pointers[i] = nullptr;
+				values--;
+			}
+		}
+		// If no pointer refers to heap memory, set without synchronizing.  It
+		// doesn't matter if the revoker sees these or not, they cannot extend
+		// the lifetime of a heap object.
+		if (values == 0)
+		{
+			hazards_clear(hazards);
+			return 0;
+		}
+		uint32_t oldEpoch;
+		do
 		{
-			if (timeout->may_block())
+			while (epoch & 1)
 			{
-				Timeout t{1};
-				futex_timed_wait(&t,
-				                 reinterpret_cast<uint32_t *>(epochCounter),
-				                 epoch,
-				                 FutexPriorityInheritance);
-				timeout->elapse(t.elapsed);
+				if (timeout->may_block())
+				{
+					Timeout t{1};
+					futex_timed_wait(&t,
+					                 reinterpret_cast<uint32_t *>(epochCounter),
+					                 epoch,
+					                 FutexPriorityInheritance);
+					timeout->elapse(t.elapsed);
+				}
+				else
+				{
+					return -ETIMEDOUT;
+				}
+				epoch = epochCounter->load();
 			}
-			else
+			for (size_t i = 0; i < CHERIOT_HAZARD_POINTERS_PER_THREAD; i++)
 			{
-				return -ETIMEDOUT;
+				hazards[i] =
+				  (i < count) ? const_cast<void *>(pointers[i]) : nullptr;
+			}
+			oldEpoch = epoch;
+			epoch    = epochCounter->load();
+		} while (epoch != oldEpoch);
+		auto isValidOrNull = [](CHERI::Capability<const void> pointer) {
+			return pointer.is_valid() || (pointer == nullptr);
+		};
+		for (size_t i = 0; i < count; i++)
+		{
+			if (!isValidOrNull(pointers[i]))
+			{
+				hazards_clear(hazards);
+				return -EINVAL;
 			}
-			epoch = epochCounter->load();
 		}
-		hazards[0] = const_cast<void *>(ptr);
-		hazards[1] = const_cast<void *>(ptr2);
-		oldEpoch   = epoch;
-		epoch      = epochCounter->load();
-	} while (epoch != oldEpoch);
-	auto isValidOrNull = [](CHERI::Capability<const void> pointer) {
-		return pointer.is_valid() || (pointer == nullptr);
-	};
-	if (isValidOrNull(ptr) && isValidOrNull(ptr2))
-	{
 		return 0;
 	}
-	hazards[0] = nullptr;
-	hazards[1] = nullptr;
-	return -EINVAL;
+} // namespace
+
+int heap_claim_fast(Timeout *timeout, const void *ptr, const void *ptr2)
+{
+	static_assert(CHERIOT_HAZARD_POINTERS_PER_THREAD >= 2,
+	              "heap_claim_fast requires at least two hazard slots");
+	const void *pointers[] = {ptr, ptr2};
+	return claim_fast(timeout, pointers, 2);
+}
+
+int heap_claim_fast_array(Timeout           *timeout,
+                          const void *const *pointers,
+                          size_t             count)
+{
+	if (count > CHERIOT_HAZARD_POINTERS_PER_THREAD)
+	{
+		return -EINVAL;
+	}
+	// Take a copy, the implementation overwrites entries that do not refer to
+	// heap memory.
+	const void *copy[CHERIOT_HAZARD_POINTERS_PER_THREAD];
+	for (size_t i = 0; i < count; i++)
+	{
+		copy[i] = pointers[i];
+	}
+	return claim_fast(timeout, copy, count);
 }
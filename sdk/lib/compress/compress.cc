@@ -0,0 +1,432 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compress.h>
+#include <errno.h>
+#include <string.h>
+
+namespace
+{
+	/// The shortest match that LZ4 encodes.
+	constexpr size_t MinMatch = 4;
+
+	/// The last bytes of a block are always literals.
+	constexpr size_t LastLiterals = 5;
+
+	/// A match must start at least this far before the end of a block.
+	constexpr size_t MatchFindLimit = 12;
+
+	/// The largest distance back to a match.
+	constexpr size_t MaxOffset = 65535;
+
+	/// The number of entries in the hash table in the workspace.
+	constexpr size_t HashEntries = COMPRESS_LZ4_WORKSPACE_SIZE / 2;
+	static_assert((HashEntries & (HashEntries - 1)) == 0,
+	              "The LZ4 workspace must hold a power-of-two hash table");
+
+	/// The number of bits in a hash.
+	constexpr uint32_t HashBits = __builtin_ctz(HashEntries);
+
+	/// Returns the four bytes at `p`, which need not be aligned.
+	uint32_t read32(const uint8_t *p)
+	{
+		return uint32_t(p[0]) | (uint32_t(p[1]) << 8) |
+		       (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+	}
+
+	/// Store `value` at `p` as four little-endian bytes.
+	void write32(uint8_t *p, uint32_t value)
+	{
+		p[0] = value;
+		p[1] = value >> 8;
+		p[2] = value >> 16;
+		p[3] = value >> 24;
+	}
+
+	/// Returns the hash table index for the four bytes `sequence`.
+	uint32_t hash(uint32_t sequence)
+	{
+		return (sequence * 2654435761U) >> (32 - HashBits);
+	}
+
+	/**
+	 * Writes LZ4 sequences to an output buffer, failing once the buffer is
+	 * full.
+	 */
+	class Writer
+	{
+		uint8_t *out;
+		uint8_t *end;
+
+		public:
+		Writer(uint8_t *out, size_t capacity) : out(out), end(out + capacity)
+		{
+		}
+
+		/// Returns the number of bytes written since `start`.
+		size_t written(const uint8_t *start)
+		{
+			return out - start;
+		}
+
+		/**
+		 * Write a sequence of `literalLength` bytes from `literals`,
+		 * followed by a match of `matchLength` bytes at `offset` if
+		 * `matchLength` is not zero.  Returns false if it does not fit.
+		 */
+		bool sequence(const uint8_t *literals,
+		              size_t         literalLength,
+		              size_t         offset,
+		              size_t         matchLength)
+		{
+			// Token, literal-length extension bytes, literals, offset, and
+			// match-length extension bytes.
+			size_t needed = 1 + (literalLength / 255) + 1 + literalLength + 2 +
+			                (matchLength / 255) + 1;
+			if (needed > size_t(end - out))
+			{
+				return false;
+			}
+			uint8_t *token  = out++;
+			size_t   length = literalLength;
+			*token          = (length >= 15 ? 15 : length) << 4;
+			if (length >= 15)
+			{
+				for (length -= 15; length >= 255; length -= 255)
+				{
+					*out++ = 255;
+				}
+				*out++ = length;
+			}
+			memcpy(out, literals, literalLength);
+			out += literalLength;
+			if (matchLength == 0)
+			{
+				return true;
+			}
+			*out++ = offset;
+			*out++ = offset >> 8;
+			length = matchLength - MinMatch;
+			*token |= (length >= 15 ? 15 : length);
+			if (length >= 15)
+			{
+				for (length -= 15; length >= 255; length -= 255)
+				{
+					*out++ = 255;
+				}
+				*out++ = length;
+			}
+			return true;
+		}
+	};
+
+	/**
+	 * Read an LZ4 length extension, adding each byte to `length` until one
+	 * is not 255.  Returns false if the input ends first.
+	 */
+	bool read_length(const uint8_t *&in, const uint8_t *end, size_t &length)
+	{
+		uint8_t byte;
+		do
+		{
+			if (in == end)
+			{
+				return false;
+			}
+			byte = *in++;
+			length += byte;
+		} while (byte == 255);
+		return true;
+	}
+
+	/**
+	 * Write out as much of the frame in `stream` as the sink accepts.
+	 * Returns true if all of it has been written.
+	 */
+	bool drain(CompressStream *stream)
+	{
+		while (stream->outputSent < stream->outputUsed)
+		{
+			ssize_t written = stream->write(
+			  stream->context,
+			  reinterpret_cast<const char *>(stream->output) +
+			    stream->outputSent,
+			  stream->outputUsed - stream->outputSent);
+			if (written <= 0)
+			{
+				return false;
+			}
+			stream->outputSent += written;
+		}
+		return true;
+	}
+
+	/**
+	 * Compress the block in `stream` into a frame in its output buffer.  The
+	 * previous frame must have been written out.
+	 */
+	void compress_block(CompressStream *stream)
+	{
+		uint8_t *payload = stream->output + COMPRESS_FRAME_HEADER_SIZE;
+		// Anything that does not shrink is stored instead.
+		ssize_t compressed = compress_lz4(stream->input,
+		                                  stream->inputUsed,
+		                                  payload,
+		                                  stream->inputUsed - 1,
+		                                  stream->workspace);
+		uint32_t header;
+		if (compressed > 0)
+		{
+			header = compressed;
+		}
+		else
+		{
+			memcpy(payload, stream->input, stream->inputUsed);
+			header = stream->inputUsed | COMPRESS_FRAME_STORED;
+		}
+		write32(stream->output, header);
+		stream->outputUsed =
+		  COMPRESS_FRAME_HEADER_SIZE + (header & ~COMPRESS_FRAME_STORED);
+		stream->outputSent = 0;
+		stream->inputUsed  = 0;
+	}
+} // namespace
+
+ssize_t compress_lz4(const void *src,
+                     size_t      length,
+                     void       *dst,
+                     size_t      capacity,
+                     void       *workspace)
+{
+	if (length > COMPRESS_LZ4_MAX_BLOCK_SIZE)
+	{
+		return -EINVAL;
+	}
+	auto  *in     = static_cast<const uint8_t *>(src);
+	auto  *table  = static_cast<uint16_t *>(workspace);
+	auto  *start  = static_cast<uint8_t *>(dst);
+	Writer out{start, capacity};
+	size_t anchor = 0;
+	if (length > MatchFindLimit)
+	{
+		memset(table, 0, COMPRESS_LZ4_WORKSPACE_SIZE);
+		size_t matchLimit = length - LastLiterals;
+		size_t findLimit  = length - MatchFindLimit;
+		size_t position   = 1;
+		// Skip ahead faster the longer it has been since the last match, so
+		// that data that does not compress is not slow to compress.
+		size_t misses = 0;
+		while (position <= findLimit)
+		{
+			uint32_t sequence  = read32(in + position);
+			uint32_t slot      = hash(sequence);
+			size_t   candidate = table[slot];
+			table[slot]        = position;
+			if ((read32(in + candidate) != sequence) ||
+			    (position - candidate > MaxOffset))
+			{
+				position += 1 + (misses++ >> 5);
+				continue;
+			}
+			misses = 0;
+			// Extend the match backwards over literals and then forwards.
+			while ((position > anchor) && (candidate > 0) &&
+			       (in[position - 1] == in[candidate - 1]))
+			{
+				position--;
+				candidate--;
+			}
+			size_t matchLength = MinMatch;
+			while ((position + matchLength < matchLimit) &&
+			       (in[position + matchLength] == in[candidate + matchLength]))
+			{
+				matchLength++;
+			}
+			if (!out.sequence(in + anchor,
+			                  position - anchor,
+			                  position - candidate,
+			                  matchLength))
+			{
+				return -ENOSPC;
+			}
+			position += matchLength;
+			anchor = position;
+			// Index a position inside the match so that repeats of the data
+			// just after it are found.
+			if (position - 2 <= findLimit)
+			{
+				table[hash(read32(in + position - 2))] = position - 2;
+			}
+		}
+	}
+	if (!out.sequence(in + anchor, length - anchor, 0, 0))
+	{
+		return -ENOSPC;
+	}
+	return out.written(start);
+}
+
+ssize_t
+decompress_lz4(const void *src, size_t length, void *dst, size_t capacity)
+{
+	auto *in     = static_cast<const uint8_t *>(src);
+	auto *inEnd  = in + length;
+	auto *start  = static_cast<uint8_t *>(dst);
+	auto *out    = start;
+	auto *outEnd = start + capacity;
+	while (in < inEnd)
+	{
+		uint8_t token         = *in++;
+		size_t  literalLength = token >> 4;
+		if ((literalLength == 15) && !read_length(in, inEnd, literalLength))
+		{
+			return -EINVAL;
+		}
+		if (literalLength > size_t(inEnd - in))
+		{
+			return -EINVAL;
+		}
+		if (literalLength > size_t(outEnd - out))
+		{
+			return -ENOSPC;
+		}
+		memcpy(out, in, literalLength);
+		in += literalLength;
+		out += literalLength;
+		// The last sequence has no match.
+		if (in == inEnd)
+		{
+			break;
+		}
+		if (inEnd - in < 2)
+		{
+			return -EINVAL;
+		}
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		size_t matchLength = token & 15;
+		if ((matchLength == 15) && !read_length(in, inEnd, matchLength))
+		{
+			return -EINVAL;
+		}
+		matchLength += MinMatch;
+		if ((offset == 0) || (offset > size_t(out - start)))
+		{
+			return -EINVAL;
+		}
+		if (matchLength > size_t(outEnd - out))
+		{
+			return -ENOSPC;
+		}
+		// Matches may overlap their output, so copy a byte at a time.
+		const uint8_t *match = out - offset;
+		for (size_t i = 0; i < matchLength; i++)
+		{
+			out[i] = match[i];
+		}
+		out += matchLength;
+	}
+	return out - start;
+}
+
+int compress_stream_init(CompressStream  *stream,
+                         StdioStreamWrite write,
+                         void            *context,
+                         void            *input,
+                         size_t           inputSize,
+                         void            *output,
+                         size_t           outputSize,
+                         void            *workspace)
+{
+	if ((write == nullptr) || (inputSize == 0) ||
+	    (inputSize > COMPRESS_LZ4_MAX_BLOCK_SIZE) ||
+	    (outputSize < inputSize + COMPRESS_FRAME_HEADER_SIZE))
+	{
+		return -EINVAL;
+	}
+	*stream = {write,
+	           context,
+	           static_cast<uint8_t *>(input),
+	           inputSize,
+	           0,
+	           static_cast<uint8_t *>(output),
+	           outputSize,
+	           0,
+	           0,
+	           workspace};
+	return 0;
+}
+
+ssize_t compress_stream_write(void *rawStream, const char *data, size_t length)
+{
+	auto  *stream   = static_cast<CompressStream *>(rawStream);
+	size_t accepted = 0;
+	while (true)
+	{
+		bool   drained = drain(stream);
+		size_t space   = stream->inputSize - stream->inputUsed;
+		size_t copy    = space < length - accepted ? space : length - accepted;
+		memcpy(stream->input + stream->inputUsed, data + accepted, copy);
+		stream->inputUsed += copy;
+		accepted += copy;
+		// Compress the block once it is full and the sink has taken the
+		// previous frame.
+		if ((stream->inputUsed < stream->inputSize) || !drained)
+		{
+			return accepted;
+		}
+		compress_block(stream);
+	}
+}
+
+int compress_stream_flush(CompressStream *stream)
+{
+	if (!drain(stream))
+	{
+		return -EAGAIN;
+	}
+	if (stream->inputUsed > 0)
+	{
+		compress_block(stream);
+	}
+	return drain(stream) ? 0 : -EAGAIN;
+}
+
+ssize_t decompress_frame(const void *src,
+                         size_t      length,
+                         void       *dst,
+                         size_t      capacity,
+                         size_t     *consumed)
+{
+	auto *in = static_cast<const uint8_t *>(src);
+	if (length < COMPRESS_FRAME_HEADER_SIZE)
+	{
+		return -EINVAL;
+	}
+	uint32_t header  = read32(in);
+	size_t   payload = header & ~COMPRESS_FRAME_STORED;
+	if (payload > length - COMPRESS_FRAME_HEADER_SIZE)
+	{
+		return -EINVAL;
+	}
+	in += COMPRESS_FRAME_HEADER_SIZE;
+	ssize_t result;
+	if (header & COMPRESS_FRAME_STORED)
+	{
+		if (payload > capacity)
+		{
+			return -ENOSPC;
+		}
+		memcpy(dst, in, payload);
+		result = payload;
+	}
+	else
+	{
+		result = decompress_lz4(in, payload, dst, capacity);
+	}
+	if ((result >= 0) && (consumed != nullptr))
+	{
+		*consumed = COMPRESS_FRAME_HEADER_SIZE + payload;
+	}
+	return result;
+}
@@ -0,0 +1,6 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+library("compress")
+  set_default(false)
+  add_files("compress.cc")
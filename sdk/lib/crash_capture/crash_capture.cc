@@ -0,0 +1,182 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <cheri.hh>
+#include <compartment.h>
+#include <crash_capture.h>
+#include <errno.h>
+#include <locks.hh>
+#include <riscvreg.h>
+#include <scheduler_trace.h>
+#include <switcher.h>
+#include <thread.h>
+
+using namespace CHERI;
+
+#if !DEVICE_EXISTS(crash_record)
+#	error The crash capture compartment requires a crash_record region
+#endif
+
+namespace
+{
+	/**
+	 * The number of 32-bit words in a crash record.  The record is copied to
+	 * and from RAM a word at a time.
+	 */
+	constexpr size_t RecordWords = sizeof(CrashRecord) / sizeof(uint32_t);
+	static_assert(sizeof(CrashRecord) % sizeof(uint32_t) == 0,
+	              "Crash records must be a whole number of words");
+
+	/**
+	 * Lock serialising access to the record, in case more than one thread
+	 * faults at once.
+	 */
+	FlagLock lock;
+
+	/**
+	 * Returns the crash record region, as words.
+	 */
+	volatile uint32_t *record_words()
+	{
+		return reinterpret_cast<volatile uint32_t *>(
+		  MMIO_CAPABILITY(CrashRecord, crash_record));
+	}
+
+	/**
+	 * Returns the checksum of `record`, over every word after the checksum
+	 * field.  Each word is rotated in, so reordered words change the result.
+	 */
+	uint32_t checksum(const CrashRecord &record)
+	{
+		auto    *words = reinterpret_cast<const uint32_t *>(&record);
+		uint32_t sum   = 0;
+		for (size_t i = 2; i < RecordWords; i++)
+		{
+			sum = ((sum << 5) | (sum >> 27)) ^ words[i];
+		}
+		return ~sum;
+	}
+
+	/**
+	 * Returns true if `record` has the magic number and a correct checksum.
+	 */
+	bool is_valid(const CrashRecord &record)
+	{
+		return (record.magic == CRASH_CAPTURE_MAGIC) &&
+		       (record.checksum == checksum(record));
+	}
+
+	/**
+	 * Copy the record out of RAM into `record`.  Must be called with the lock
+	 * held.
+	 */
+	void read_locked(CrashRecord &record)
+	{
+		auto              *words  = reinterpret_cast<uint32_t *>(&record);
+		volatile uint32_t *region = record_words();
+		for (size_t i = 0; i < RecordWords; i++)
+		{
+			words[i] = region[i];
+		}
+	}
+
+	/**
+	 * Copy `record` into RAM.  Must be called with the lock held.
+	 */
+	void write_locked(const CrashRecord &record)
+	{
+		auto              *words  = reinterpret_cast<const uint32_t *>(&record);
+		volatile uint32_t *region = record_words();
+		for (size_t i = 0; i < RecordWords; i++)
+		{
+			region[i] = words[i];
+		}
+	}
+
+	/**
+	 * Copy the most recent scheduler trace records into `record`, if the
+	 * firmware records a scheduler trace.
+	 */
+	void copy_trace(CrashRecord &record)
+	{
+#if SCHEDULER_TRACE_ENTRIES > 0
+		const SchedulerTrace *trace    = SCHEDULER_TRACE();
+		uint32_t              written  = trace->written;
+		uint32_t              capacity = trace->capacity;
+		uint32_t count = std::min<uint32_t>(
+		  {written, capacity, CRASH_CAPTURE_TRACE_RECORDS});
+		for (uint32_t i = 0; i < count; i++)
+		{
+			record.trace[i] = trace->records[(written - count + i) % capacity];
+		}
+		record.traceCount = count;
+#endif
+	}
+} // namespace
+
+int crash_capture_record(ErrorState *frame, size_t mcause, size_t mtval)
+{
+	if (!check_pointer(frame, sizeof(ErrorState)))
+	{
+		return -EINVAL;
+	}
+	CrashRecord record{};
+	LockGuard   g{lock};
+	read_locked(record);
+	uint32_t crashes = is_valid(record) ? record.crashes : 0;
+	record           = CrashRecord{};
+	record.magic     = CRASH_CAPTURE_MAGIC;
+	record.crashes   = crashes + 1;
+	record.thread    = thread_id_get();
+	record.mcause    = mcause;
+	record.mtval     = mtval;
+	record.pcc       = Capability{frame->pcc}.address();
+	for (size_t i = 0; i < 15; i++)
+	{
+		record.registers[i] = Capability{frame->registers[i]}.address();
+	}
+	// Depth 0 is this compartment, so the faulting compartment is at depth 1.
+	while (record.frameCount < CRASH_CAPTURE_MAX_FRAMES)
+	{
+		ptraddr_t compartment =
+		  switcher_frame_compartment(record.frameCount + 1);
+		if (compartment == 0)
+		{
+			break;
+		}
+		record.compartments[record.frameCount++] = compartment;
+	}
+	record.cycles = rdcycle64();
+	copy_trace(record);
+	record.checksum = checksum(record);
+	write_locked(record);
+	return 0;
+}
+
+int crash_capture_retrieve(CrashRecord *record)
+{
+	if (!check_pointer<PermissionSet{Permission::Store}>(record,
+	                                                     sizeof(CrashRecord)))
+	{
+		return -EINVAL;
+	}
+	CrashRecord copy;
+	{
+		LockGuard g{lock};
+		read_locked(copy);
+	}
+	if (!is_valid(copy))
+	{
+		return -ENOENT;
+	}
+	*record = copy;
+	return 0;
+}
+
+int crash_capture_clear()
+{
+	LockGuard g{lock};
+	record_words()[0] = 0;
+	return 0;
+}
@@ -0,0 +1,12 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../compartment_helpers")
+
+compartment("crash_capture")
+  set_default(false)
+  add_deps("locks", "compartment_helpers")
+  add_files("crash_capture.cc")
+  on_load(function (target)
+	target:add('defines', "SCHEDULER_TRACE_ENTRIES=" .. math.floor(tonumber(get_config("scheduler-trace-entries"))))
+  end)
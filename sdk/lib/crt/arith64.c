@@ -26,6 +26,9 @@
 // - Use standard integer types.
 // - Add SPDX tags for license from the upstream repository (commit 426b7578ecfb5ce7c841e738613cff2a261214eb)
 // - Add the implementation of __multi3() 
+// - Replace the shift-subtract loop in __divmoddi4() with normalised long
+//   division that uses the 32-bit hardware divider (Hacker's Delight, 2nd
+//   edition, sections 9-4 and 9-5).
 //
 // This file is *not* formatted, to make it easier to track changes from upstream (if there are any).
 
@@ -178,6 +181,43 @@ typedef union
     return n + !(a & 0x0000000000000001ULL);
 }
 
+// Divide the 64-bit value u1:u0 by v, where u1 < v so that the quotient fits
+// in 32 bits. Returns the quotient and, if r is not NULL, stores the remainder
+// in *r. The divisor is normalised so that its top bit is set, and the
+// quotient is then found one 16-bit digit at a time with the 32-bit hardware
+// divider, correcting each estimated digit at most twice.
+static arith64_u32 arith64_divlu(arith64_u32 u1, arith64_u32 u0, arith64_u32 v, arith64_u32 *r)
+{
+    const arith64_u32 b = 65536;                // number base (16 bits)
+    int s = __clzsi2(v);                        // 0 <= s <= 31 (v is non-zero)
+    v <<= s;                                    // normalise the divisor
+    arith64_u32 vn1 = v >> 16;                  // break the divisor into two 16-bit digits
+    arith64_u32 vn0 = v & 0xffff;
+    arith64_u32 un32 = s ? (u1 << s) | (u0 >> (32 - s)) : u1;
+    arith64_u32 un10 = u0 << s;                 // shift the dividend left
+    arith64_u32 un1 = un10 >> 16;               // break the right half of the dividend into two digits
+    arith64_u32 un0 = un10 & 0xffff;
+    arith64_u32 q1 = un32 / vn1;                // compute the first quotient digit
+    arith64_u32 rhat = un32 - q1 * vn1;
+    while (q1 >= b || q1 * vn0 > b * rhat + un1)
+    {
+        q1--;
+        rhat += vn1;
+        if (rhat >= b) break;
+    }
+    arith64_u32 un21 = un32 * b + un1 - q1 * v; // multiply and subtract
+    arith64_u32 q0 = un21 / vn1;                // compute the second quotient digit
+    rhat = un21 - q0 * vn1;
+    while (q0 >= b || q0 * vn0 > b * rhat + un0)
+    {
+        q0--;
+        rhat += vn1;
+        if (rhat >= b) break;
+    }
+    if (r) *r = (un21 * b + un0 - q0 * v) >> s;
+    return q1 * b + q0;
+}
+
 // Calculate both the quotient and remainder of the unsigned division of a and
 // b. The return value is the quotient, and the remainder is placed in variable
 // pointed to by c (if it's not NULL).
@@ -205,22 +245,33 @@ typedef union
                 *c = arith64_lo(a) % arith64_lo(b);
             return arith64_lo(a) / arith64_lo(b);
         }
+        // Divide the high word directly, then divide the remainder and the
+        // low word, whose quotient fits in 32 bits.
+        arith64_u32 hi = arith64_hi(a);
+        arith64_u32 q1 = hi / arith64_lo(b);
+        arith64_u32 r;
+        arith64_u32 q0 = arith64_divlu(hi - q1 * arith64_lo(b), arith64_lo(a), arith64_lo(b), &r);
+        if (c) *c = r;
+        return ((arith64_u64)q1 << 32) | q0;
     }
 
-    // let's do long division
-    char bits = __clzdi2(b) - __clzdi2(a) + 1;  // number of bits to iterate (a and b are non-zero)
-    arith64_u64 rem = a >> bits;                   // init remainder
-    a <<= 64 - bits;                            // shift numerator to the high bit
-    arith64_u64 wrap = 0;                          // start with wrap = 0
-    while (bits-- > 0)                          // for each bit
+    // The divisor has more than 32 bits, so the quotient fits in 32 bits.
+    // Estimate it from the top 32 bits of the normalised divisor, which gives
+    // a value that is at most one too large, and then correct it.
+    int n = __clzsi2(arith64_hi(b));            // 0 <= n <= 31
+    arith64_u64 v1 = (b << n) >> 32;            // normalise the divisor and take its top word
+    arith64_u64 u1 = a >> 1;                    // ensure the quotient does not overflow
+    arith64_u64 q = arith64_divlu(arith64_hi(u1), arith64_lo(u1), arith64_lo(v1), (void *)0);
+    q = (q << n) >> 31;                         // undo the normalisation and the halving
+    if (q != 0) q--;                            // make the estimate too small, not too large
+    arith64_u64 rem = a - q * b;
+    if (rem >= b)                               // one too small?
     {
-        rem = (rem << 1) | (a >> 63);           // shift numerator MSB to remainder LSB
-        a = (a << 1) | (wrap & 1);              // shift out the numerator, shift in wrap
-        wrap = ((arith64_s64)(b - rem - 1) >> 63);  // wrap = (b > rem) ? 0 : 0xffffffffffffffff (via sign extension)
-        rem -= b & wrap;                        // if (wrap) rem -= b
+        q++;
+        rem -= b;
     }
     if (c) *c = rem;                            // maybe set remainder
-    return (a << 1) | (wrap & 1);               // return the quotient
+    return q;
 }
 
 // Return the quotient of the signed division of a and b.
@@ -2,12 +2,50 @@
 // SPDX-License-Identifier: MIT
 
 #include <debug.hh>
+#include <debug_log_buffer.h>
+#include <ds/divide.h>
+#include <futex.h>
 #include <thread.h>
 
 using namespace CHERI;
 
+#ifndef CHERIOT_DEBUG_LOG_BUFFER
+#	define CHERIOT_DEBUG_LOG_BUFFER 0
+#endif
+
+#ifndef CHERIOT_DEBUG_LOG_BINARY
+#	define CHERIOT_DEBUG_LOG_BINARY false
+#endif
+
 namespace
 {
+	/**
+	 * The size of the debug log ring buffer, or zero to write directly to the
+	 * UART.
+	 */
+	constexpr uint32_t LogBufferSize = CHERIOT_DEBUG_LOG_BUFFER;
+	static_assert((LogBufferSize & (LogBufferSize - 1)) == 0,
+	              "The debug log buffer size must be a power of two");
+
+	/**
+	 * Write log messages as binary records, to be formatted on the host by
+	 * `scripts/decode_binary_log.py`, rather than as text.
+	 */
+	constexpr bool BinaryLog = CHERIOT_DEBUG_LOG_BINARY;
+
+	/**
+	 * The byte that starts each binary log record (ASCII record separator).
+	 * Must match `record_marker` in `scripts/decode_binary_log.py`.
+	 */
+	constexpr char BinaryRecordMarker = 0x1e;
+
+	/**
+	 * The kind byte used in binary log records for the output of callbacks,
+	 * which is written as a null-terminated string.  Must match
+	 * `callback_kind` in `scripts/decode_binary_log.py`.
+	 */
+	constexpr char BinaryCallbackKind = 0x7f;
+
 	/**
 	 * Printer for debug messages.  This implements the `DebugWriter` interface
 	 * so that it can be used with custom callbacks.
@@ -18,11 +56,84 @@ namespace
 	struct DebugPrinter final : DebugWriter
 	{
 		/**
-		 * Write a character, delegating to `Output`.
+		 * The ring buffer that messages are written to, if logging is
+		 * buffered.
+		 */
+		DebugLogBuffer *log = nullptr;
+
+		/**
+		 * The position in the ring buffer for the next character.  This is
+		 * published to the drain thread when the message is complete.
+		 */
+		uint32_t cursor = 0;
+
+		/**
+		 * The oldest position in the ring that the drain thread has not yet
+		 * written out.
+		 */
+		uint32_t limit = 0;
+
+		/**
+		 * Set if this message did not fit in the ring buffer.
+		 */
+		bool overflowed = false;
+
+		/**
+		 * Start a message.  With buffered logging, this reserves nothing: the
+		 * message is added to the ring only when the printer is destroyed.
+		 * This relies on interrupts being disabled while the printer is live,
+		 * so no other producer can run in the meantime.
+		 */
+		DebugPrinter()
+		{
+			if constexpr (LogBufferSize > 0)
+			{
+				log    = DEBUG_LOG_BUFFER();
+				cursor = log->produced;
+				limit  = __atomic_load_n(&log->consumed, __ATOMIC_ACQUIRE) +
+				        LogBufferSize;
+			}
+		}
+
+		/**
+		 * Finish a message.  With buffered logging, publish it to the drain
+		 * thread or, if it did not fit, count it as dropped.
+		 */
+		~DebugPrinter()
+		{
+			if constexpr (LogBufferSize > 0)
+			{
+				if (overflowed)
+				{
+					log->dropped++;
+					return;
+				}
+				__atomic_store_n(&log->produced, cursor, __ATOMIC_RELEASE);
+				if (futex_may_have_waiters(&log->produced))
+				{
+					futex_wake(&log->produced, 1);
+				}
+			}
+		}
+
+		/**
+		 * Write a character, either to the UART or to the ring buffer.
 		 */
 		void write(char c) override
 		{
-			MMIO_CAPABILITY(Uart, uart)->blocking_write(c);
+			if constexpr (LogBufferSize > 0)
+			{
+				if (cursor == limit)
+				{
+					overflowed = true;
+					return;
+				}
+				log->data[cursor++ & (LogBufferSize - 1)] = c;
+			}
+			else
+			{
+				MMIO_CAPABILITY(Uart, uart)->blocking_write(c);
+			}
 		}
 
 		/**
@@ -139,17 +250,22 @@ namespace
 		 */
 		void write(int64_t s) override
 		{
+			uint64_t magnitude = s;
 			if (s < 0)
 			{
 				write('-');
-				s = 0 - s;
+				magnitude = 0 - magnitude;
 			}
+			// Divide by a constant reciprocal to avoid twenty calls each to
+			// the 64-bit division and modulus helpers.
+			using Decimal = ds::divide::Reciprocal<10>;
 			std::array<char, 20> buf;
 			const char           Digits[] = "0123456789";
 			for (int i = int(buf.size() - 1); i >= 0; i--)
 			{
-				buf[static_cast<size_t>(i)] = Digits[s % 10];
-				s /= 10;
+				uint64_t quotient           = Decimal::divide(magnitude);
+				buf[static_cast<size_t>(i)] = Digits[magnitude - quotient * 10];
+				magnitude                   = quotient;
 			}
 			bool skipZero = true;
 			for (auto c : buf)
@@ -223,6 +339,162 @@ namespace
 			append_hex_word(lo);
 		}
 
+		/**
+		 * Write a 32-bit value as four little-endian bytes.
+		 */
+		void write_binary(uint32_t word)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				write(static_cast<char>(word >> (i * 8)));
+			}
+		}
+
+		/**
+		 * Write a message as a binary record, leaving the formatting to the
+		 * host.  The record is the marker byte, the addresses of the context
+		 * and format strings (which the host finds in the firmware image),
+		 * the number of arguments, and then each argument as its kind byte
+		 * followed by its value.  Strings are written inline with a null
+		 * terminator, because they may not be in the firmware image.
+		 */
+		void write_binary(const char          *context,
+		                  const char          *fmt,
+		                  DebugFormatArgument *arguments,
+		                  size_t               argumentsCount)
+		{
+			write(BinaryRecordMarker);
+			write_binary(static_cast<uint32_t>(Capability{context}.address()));
+			write_binary(static_cast<uint32_t>(Capability{fmt}.address()));
+			write(static_cast<char>(argumentsCount));
+			for (size_t i = 0; i < argumentsCount; i++)
+			{
+				auto            &argument = arguments[i];
+				Capability<void> kind{reinterpret_cast<void *>(argument.kind)};
+				if (kind.is_valid())
+				{
+					write(BinaryCallbackKind);
+					reinterpret_cast<DebugCallback>(kind.get())(argument.value,
+					                                            *this);
+					write('\0');
+					continue;
+				}
+				write(static_cast<char>(argument.kind));
+				switch (static_cast<DebugFormatArgumentKind>(argument.kind))
+				{
+					case DebugFormatArgumentKind::DebugFormatArgumentBool:
+					case DebugFormatArgumentKind::DebugFormatArgumentCharacter:
+						write(static_cast<char>(argument.value));
+						break;
+					case DebugFormatArgumentKind::
+					  DebugFormatArgumentSignedNumber32:
+					case DebugFormatArgumentKind::
+					  DebugFormatArgumentUnsignedNumber32:
+					case DebugFormatArgumentKind::
+					  DebugFormatArgumentPermissionSet:
+						write_binary(static_cast<uint32_t>(argument.value));
+						break;
+					case DebugFormatArgumentKind::
+					  DebugFormatArgumentSignedNumber64:
+					case DebugFormatArgumentKind::
+					  DebugFormatArgumentUnsignedNumber64:
+					{
+						uint64_t value;
+						memcpy(&value, &argument.value, sizeof(value));
+						write_binary(static_cast<uint32_t>(value));
+						write_binary(static_cast<uint32_t>(value >> 32));
+						break;
+					}
+					case DebugFormatArgumentKind::DebugFormatArgumentPointer:
+					{
+						// Address, base, length, and then the permissions,
+						// object type, and tag packed into one word.
+						const Capability C{
+						  reinterpret_cast<void *>(argument.value)};
+						write_binary(C.address());
+						write_binary(C.base());
+						write_binary(C.length());
+						write_binary(C.permissions().as_raw() |
+						             (C.type() << 16) |
+						             (C.is_valid() ? (1U << 31) : 0));
+						break;
+					}
+					case DebugFormatArgumentKind::DebugFormatArgumentCString:
+						write(reinterpret_cast<const char *>(argument.value));
+						write('\0');
+						break;
+					case DebugFormatArgumentKind::DebugFormatArgumentStringView:
+						write(
+						  *reinterpret_cast<std::string_view *>(argument.value));
+						write('\0');
+						break;
+					default:
+						// The host reports the invalid kind.
+						break;
+				}
+			}
+		}
+
+		/**
+		 * Write a single format argument.
+		 */
+		void write_argument(DebugFormatArgument &argument)
+		{
+			Capability<void> kind{reinterpret_cast<void *>(argument.kind)};
+			if (kind.is_valid())
+			{
+				reinterpret_cast<DebugCallback>(kind.get())(argument.value,
+				                                            *this);
+				return;
+			}
+			switch (static_cast<DebugFormatArgumentKind>(argument.kind))
+			{
+				case DebugFormatArgumentKind::DebugFormatArgumentBool:
+					write(static_cast<bool>(argument.value) ? "true" : "false");
+					break;
+				case DebugFormatArgumentKind::DebugFormatArgumentCharacter:
+					write(static_cast<char>(argument.value));
+					break;
+				case DebugFormatArgumentKind::DebugFormatArgumentPointer:
+					write(reinterpret_cast<void *>(argument.value));
+					break;
+				case DebugFormatArgumentKind::DebugFormatArgumentSignedNumber32:
+					write(static_cast<int32_t>(argument.value));
+					break;
+				case DebugFormatArgumentKind::
+				  DebugFormatArgumentUnsignedNumber32:
+					write(static_cast<uint32_t>(argument.value));
+					break;
+				case DebugFormatArgumentKind::DebugFormatArgumentSignedNumber64:
+				{
+					int64_t value;
+					memcpy(&value, &argument.value, sizeof(value));
+					write(value);
+					break;
+				}
+				case DebugFormatArgumentKind::
+				  DebugFormatArgumentUnsignedNumber64:
+				{
+					uint64_t value;
+					memcpy(&value, &argument.value, sizeof(value));
+					write(value);
+					break;
+				}
+				case DebugFormatArgumentKind::DebugFormatArgumentCString:
+					write(reinterpret_cast<const char *>(argument.value));
+					break;
+				case DebugFormatArgumentKind::DebugFormatArgumentStringView:
+					write(*reinterpret_cast<std::string_view *>(argument.value));
+					break;
+				case DebugFormatArgumentKind::DebugFormatArgumentPermissionSet:
+					write(CHERI::PermissionSet::from_raw(argument.value));
+					break;
+				default:
+					write("<invalid argument kind>");
+					break;
+			}
+		}
+
 		/**
 		 * Format a message, using the provided arguments.
 		 */
@@ -247,82 +519,34 @@ namespace
 						write("<missing argument>");
 						continue;
 					}
-					auto            &argument = arguments[argumentIndex++];
-					Capability<void> kind{
-					  reinterpret_cast<void *>(argument.kind)};
-					if (kind.is_valid())
-					{
-						reinterpret_cast<DebugCallback>(kind.get())(
-						  argument.value, *this);
-					}
-					else
-					{
-						switch (
-						  static_cast<DebugFormatArgumentKind>(argument.kind))
-						{
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentBool:
-								write(static_cast<bool>(argument.value)
-								        ? "true"
-								        : "false");
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentCharacter:
-								write(static_cast<char>(argument.value));
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentPointer:
-								write(reinterpret_cast<void *>(argument.value));
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentSignedNumber32:
-								write(static_cast<int32_t>(argument.value));
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentUnsignedNumber32:
-								write(static_cast<uint32_t>(argument.value));
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentSignedNumber64:
-							{
-								int64_t value;
-								memcpy(&value, &argument.value, sizeof(value));
-								write(value);
-								break;
-							}
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentUnsignedNumber64:
-							{
-								uint64_t value;
-								memcpy(&value, &argument.value, sizeof(value));
-								write(value);
-								break;
-							}
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentCString:
-								write(reinterpret_cast<const char *>(
-								  argument.value));
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentStringView:
-								write(*reinterpret_cast<std::string_view *>(
-								  argument.value));
-								break;
-							case DebugFormatArgumentKind::
-							  DebugFormatArgumentPermissionSet:
-								write(CHERI::PermissionSet::from_raw(
-								  argument.value));
-								break;
-							default:
-								write("<invalid argument kind>");
-								break;
-						}
-					};
+					write_argument(arguments[argumentIndex++]);
 					continue;
 				}
 				write(*s);
 			}
 		}
+
+		/**
+		 * Format a message that has been split at compile time into
+		 * `argumentsCount + 1` literal segments, whose lengths are given in
+		 * `segmentLengths`, separated by two-character placeholders.
+		 */
+		void format(const char          *fmt,
+		            const uint16_t      *segmentLengths,
+		            DebugFormatArgument *arguments,
+		            size_t               argumentsCount)
+		{
+			for (size_t i = 0;; i++)
+			{
+				write(std::string_view{fmt, segmentLengths[i]});
+				if (i == argumentsCount)
+				{
+					break;
+				}
+				fmt += segmentLengths[i] + 2;
+				write_argument(arguments[i]);
+			}
+		}
 	};
 
 } // namespace
@@ -334,6 +558,11 @@ debug_log_message_write(const char          *context,
                         size_t               messageCount)
 {
 	DebugPrinter printer;
+	if constexpr (BinaryLog)
+	{
+		printer.write_binary(context, format, messages, messageCount);
+		return;
+	}
 	printer.write("\x1b[35m");
 	printer.write(context);
 #if 0
@@ -347,6 +576,26 @@ debug_log_message_write(const char          *context,
 	printer.write("\n");
 }
 
+[[cheri::interrupt_state(disabled)]] void
+debug_log_preparsed_message_write(const char          *context,
+                                  const char          *format,
+                                  const uint16_t      *segmentLengths,
+                                  DebugFormatArgument *messages,
+                                  size_t               messageCount)
+{
+	DebugPrinter printer;
+	if constexpr (BinaryLog)
+	{
+		printer.write_binary(context, format, messages, messageCount);
+		return;
+	}
+	printer.write("\x1b[35m");
+	printer.write(context);
+	printer.write("\033[0m: ");
+	printer.format(format, segmentLengths, messages, messageCount);
+	printer.write("\n");
+}
+
 [[cheri::interrupt_state(disabled)]] void
 debug_report_failure(const char          *kind,
                      const char          *file,
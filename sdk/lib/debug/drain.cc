@@ -0,0 +1,76 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <compartment.h>
+#include <debug_log_buffer.h>
+#include <futex.h>
+#include <platform-uart.hh>
+
+static_assert(CHERIOT_DEBUG_LOG_BUFFER > 0,
+              "The debug_log_drain compartment requires --debug-log-buffer");
+static_assert((CHERIOT_DEBUG_LOG_BUFFER & (CHERIOT_DEBUG_LOG_BUFFER - 1)) == 0,
+              "The debug log buffer size must be a power of two");
+
+namespace
+{
+	/**
+	 * Write a string directly to the UART.
+	 */
+	void uart_write(const char *str)
+	{
+		for (; *str; ++str)
+		{
+			MMIO_CAPABILITY(Uart, uart)->blocking_write(*str);
+		}
+	}
+
+	/**
+	 * Write an unsigned integer directly to the UART, as a decimal string.
+	 */
+	void uart_write(uint32_t value)
+	{
+		char  buffer[11];
+		char *digit = &buffer[sizeof(buffer) - 1];
+		*digit      = '\0';
+		do
+		{
+			*--digit = static_cast<char>('0' + (value % 10));
+			value /= 10;
+		} while (value != 0);
+		uart_write(digit);
+	}
+} // namespace
+
+void __cheri_compartment("debug_log_drain") debug_log_drain_run()
+{
+	DebugLogBuffer *log           = DEBUG_LOG_BUFFER();
+	uint32_t        reportedDrops = 0;
+	while (true)
+	{
+		uint32_t consumed = log->consumed;
+		uint32_t produced = __atomic_load_n(&log->produced, __ATOMIC_ACQUIRE);
+		if (produced == consumed)
+		{
+			futex_wait(&log->produced, consumed);
+			continue;
+		}
+		// Write out everything that is complete.  The consumer counter is
+		// updated after each character so that producers can reuse the
+		// space as soon as possible.
+		for (; consumed != produced; consumed++)
+		{
+			MMIO_CAPABILITY(Uart, uart)
+			  ->blocking_write(
+			    log->data[consumed & (CHERIOT_DEBUG_LOG_BUFFER - 1)]);
+			__atomic_store_n(&log->consumed, consumed + 1, __ATOMIC_RELEASE);
+		}
+		if (uint32_t dropped = __atomic_load_n(&log->dropped, __ATOMIC_RELAXED);
+		    dropped != reportedDrops)
+		{
+			uart_write("\x1b[31m<");
+			uart_write(dropped - reportedDrops);
+			uart_write(" debug messages dropped>\x1b[0m\n");
+			reportedDrops = dropped;
+		}
+	}
+}
@@ -1,3 +1,15 @@
 library("debug")
   set_default(false)
   add_files("debug.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_DEBUG_LOG_BUFFER=" .. math.floor(tonumber(get_config("debug-log-buffer"))))
+	target:add('defines', "CHERIOT_DEBUG_LOG_BINARY=" .. tostring(get_config("debug-log-binary")))
+  end)
+
+-- Drains the debug log buffer to the UART when built with --debug-log-buffer.
+compartment("debug_log_drain")
+  set_default(false)
+  add_files("drain.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_DEBUG_LOG_BUFFER=" .. math.floor(tonumber(get_config("debug-log-buffer"))))
+  end)
@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <event.h>
 #include <locks.hh>
+#include <multiwaiter.h>
 #include <stdint.h>
 #include <thread.h>
 
@@ -27,9 +28,28 @@ struct EventWaiter
 
 struct EventGroup
 {
-	FlagLock    lock;
-	uint32_t    bits;
-	size_t      waiterCount;
+	FlagLock lock;
+	uint32_t bits;
+	/**
+	 * A superset of the bits that registered waiters want.  This is updated
+	 * when a waiter registers and recomputed by each `eventgroup_set` that
+	 * scans the waiters, so that setting bits that no waiter is waiting for
+	 * does not need to scan the waiters at all.
+	 */
+	uint32_t wantedBits;
+	/**
+	 * The bits that callers of `eventgroup_poll` are waiting for.  Setting
+	 * any of these increments `generation` and wakes all futex waiters on
+	 * it, then clears this set.  Pollers that are still waiting register
+	 * again.
+	 */
+	uint32_t polledBits;
+	/**
+	 * Futex word for waiters that cannot use a per-thread slot in
+	 * `waiters`, such as several coroutines on one thread.
+	 */
+	std::atomic<uint32_t> generation;
+	size_t                waiterCount;
 	EventWaiter waiters[];
 };
 
@@ -91,6 +111,7 @@ int eventgroup_wait(Timeout    *timeout,
 		waiter.clearOnExit = clearOnExit;
 		waiter.waitForAll  = waitForAll;
 		waiter.bitsSeen    = bitsSeen;
+		group->wantedBits |= bitsWanted;
 	}
 	else
 	{
@@ -107,8 +128,57 @@ int eventgroup_wait(Timeout    *timeout,
 			return 0;
 		}
 	};
-	waiter.bitsWanted = 0;
-	*outBits          = group->bits;
+	// Deregister with the lock held.  An `eventgroup_set` may have triggered
+	// us (and cleared our bits, if `clearOnExit` is set) after the wait timed
+	// out, in which case report success rather than losing the event.  The
+	// lock is held only briefly, so wait for it even though our timeout has
+	// expired.  Acquiring it fails only if the group is being destroyed.
+	Timeout deregisterTimeout{UnlimitedTimeout};
+	if (LockGuard g{group->lock, &deregisterTimeout})
+	{
+		if (waiter.bitsWanted == 0)
+		{
+			*outBits = waiter.bitsSeen.load();
+			return 0;
+		}
+		waiter.bitsWanted = 0;
+		*outBits          = group->bits;
+	}
+	return -ETIMEDOUT;
+}
+
+int eventgroup_poll(Timeout           *timeout,
+                    EventGroup        *group,
+                    uint32_t          *outBits,
+                    uint32_t           bitsWanted,
+                    bool               waitForAll,
+                    bool               clearOnExit,
+                    EventWaiterSource *source)
+{
+	if (bitsWanted & 0xff000000)
+	{
+		return -ERANGE;
+	}
+	if (LockGuard g{group->lock, timeout})
+	{
+		uint32_t bits = group->bits;
+		*outBits      = bits;
+		if (waitForAll ? ((bitsWanted & bits) == bitsWanted)
+		               : ((bitsWanted & bits) != 0))
+		{
+			if (clearOnExit)
+			{
+				group->bits &= ~bitsWanted;
+			}
+			return 0;
+		}
+		group->polledBits |= bitsWanted;
+		source->eventSource = &group->generation;
+		source->kind        = EventWaiterFutex;
+		source->value       = group->generation.load();
+		return -EWOULDBLOCK;
+	}
+	*outBits = group->bits;
 	return -ETIMEDOUT;
 }
 
@@ -141,6 +211,23 @@ int eventgroup_set(Timeout    *timeout,
 		uint32_t bits        = group->bits;
 		uint32_t bitsToClear = 0;
 		Debug::log("Bits {} are set", bits);
+		// Pollers re-check their own conditions, so wake all of them if
+		// any wants one of the bits.
+		if ((bitsToSet & group->polledBits) != 0)
+		{
+			group->polledBits = 0;
+			group->generation++;
+			group->generation.notify_all();
+		}
+		// A waiter's condition can become true only if we set one of the
+		// bits that it wants, so skip the scan if no waiter wants any of
+		// them.
+		if ((bitsToSet & group->wantedBits) == 0)
+		{
+			*outBits = bits;
+			return 0;
+		}
+		uint32_t stillWanted = 0;
 		for (size_t i = 0; i < group->waiterCount; ++i)
 		{
 			auto &waiter = group->waiters[i];
@@ -149,8 +236,11 @@ int eventgroup_set(Timeout    *timeout,
 			{
 				continue;
 			}
-			Debug::log("Triggered? {}", waiter.is_triggered(bitsToSet));
-			if (waiter.is_triggered(bits))
+			if (!waiter.is_triggered(bits))
+			{
+				stillWanted |= waiter.bitsWanted;
+			}
+			else
 			{
 				if (waiter.clearOnExit)
 				{
@@ -162,6 +252,7 @@ int eventgroup_set(Timeout    *timeout,
 				waiter.bitsSeen.notify_one();
 			}
 		}
+		group->wantedBits = stillWanted;
 		Debug::log("Clearing bits {}", bitsToClear);
 		group->bits &= ~bitsToClear;
 		*outBits = group->bits;
@@ -191,6 +282,8 @@ int eventgroup_destroy_force(SObjStruct *heapCapability, EventGroup *group)
 		waiter.bitsSeen   = bits;
 		waiter.bitsSeen.notify_one();
 	}
+	group->generation++;
+	group->generation.notify_all();
 	heap_free(heapCapability, group);
 	return 0;
 }
@@ -36,19 +36,44 @@
 #include <stddef.h>
 #include <string.h>
 
+#define wsize sizeof(unsigned int)
+#define wmask (wsize - 1)
+
 /*
  * Compare memory regions.
+ *
+ * If both regions have the same alignment, compare a word at a time once they
+ * are word aligned and use bytes only to find the first difference in the
+ * first word that differs.  Word loads never go past `n` bytes, so they stay
+ * within the bounds that the byte loads would need.
  */
 int
 memcmp(const void *s1, const void *s2, size_t n)
 {
-	if (n != 0) {
-		const unsigned char *p1 = s1, *p2 = s2;
+	const unsigned char *p1 = s1, *p2 = s2;
 
-		do {
-			if (*p1++ != *p2++)
-				return (*--p1 - *--p2);
-		} while (--n != 0);
+	if ((((__cheri_addr size_t)p1 ^ (__cheri_addr size_t)p2) & wmask) == 0) {
+		/* Compare bytes until both are aligned. */
+		for (; n != 0 && ((__cheri_addr size_t)p1 & wmask) != 0; n--) {
+			if (*p1 != *p2)
+				return (*p1 - *p2);
+			p1++;
+			p2++;
+		}
+		/* Skip the words that are equal. */
+		for (; n >= wsize; n -= wsize) {
+			if (*(const unsigned int *)(const void *)p1 !=
+			    *(const unsigned int *)(const void *)p2)
+				break;
+			p1 += wsize;
+			p2 += wsize;
+		}
+	}
+	for (; n != 0; n--) {
+		if (*p1 != *p2)
+			return (*p1 - *p2);
+		p1++;
+		p2++;
 	}
 	return (0);
 }
@@ -0,0 +1,43 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cdefs.h>
+#include <stddef.h>
+#include <string.h>
+
+/*
+ * Constant-time comparisons.  Both functions read every byte and contain no
+ * branches that depend on the contents of the buffers, so the time that they
+ * take depends only on `n`.
+ */
+
+int __cheri_libcall timingsafe_bcmp(const void *b1, const void *b2, size_t n)
+{
+	const unsigned char *p1         = b1, *p2 = b2;
+	unsigned int         difference = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		difference |= p1[i] ^ p2[i];
+	}
+	return (difference != 0);
+}
+
+int __cheri_libcall timingsafe_memcmp(const void *b1, const void *b2, size_t n)
+{
+	const unsigned char *p1     = b1, *p2 = b2;
+	int                  result = 0;
+	int                  done   = 0;
+
+	for (size_t i = 0; i < n; i++)
+	{
+		/* -1 if p1[i] < p2[i], otherwise 0. */
+		int less = ((int)p1[i] - (int)p2[i]) >> 8;
+		/* -1 if p1[i] > p2[i], otherwise 0. */
+		int greater = ((int)p2[i] - (int)p1[i]) >> 8;
+		/* Record the sign of the first difference only. */
+		result |= (less - greater) & ~done;
+		done |= less | greater;
+	}
+	return result;
+}
@@ -0,0 +1,198 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <array>
+#include <cheri.hh>
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <errno.h>
+#include <futex.h>
+#include <gpio_events.h>
+#include <interrupt.h>
+#include <platform-gpio.hh>
+#include <thread.h>
+#include <timeout.h>
+
+using namespace CHERI;
+
+#ifndef CHERIOT_GPIO_EVENTS_DEBOUNCE_SAMPLES
+#	define CHERIOT_GPIO_EVENTS_DEBOUNCE_SAMPLES 3
+#endif
+
+#if DEVICE_EXISTS(gpio)
+// Sonata: the joystick is in bits 0-4 and the switches in bits 5-13.
+#	ifndef CHERIOT_GPIO_EVENTS_PIN_MASK
+#		define CHERIOT_GPIO_EVENTS_PIN_MASK 0x3fff
+#	endif
+#elif DEVICE_EXISTS(gpio_led0)
+// Arty A7: the switches are in bits 0-3 and the buttons in bits 4-7.
+#	ifndef CHERIOT_GPIO_EVENTS_PIN_MASK
+#		define CHERIOT_GPIO_EVENTS_PIN_MASK 0xff
+#	endif
+#else
+#	error The GPIO event driver does not support this board
+#endif
+
+#ifdef CHERIOT_GPIO_EVENTS_INTERRUPT
+DECLARE_AND_DEFINE_INTERRUPT_CAPABILITY(gpioInterrupt,
+                                        InterruptName::
+                                          CHERIOT_GPIO_EVENTS_INTERRUPT,
+                                        true,
+                                        true);
+#endif
+
+namespace
+{
+	/**
+	 * The number of consecutive samples for which a pin must differ from its
+	 * accepted level before the change is accepted.
+	 */
+	constexpr uint32_t DebounceSamples = CHERIOT_GPIO_EVENTS_DEBOUNCE_SAMPLES;
+	static_assert(DebounceSamples > 0 && DebounceSamples < 256,
+	              "GPIO debounce samples must be between 1 and 255");
+
+	/**
+	 * The pins that are monitored.
+	 */
+	constexpr uint32_t PinMask = CHERIOT_GPIO_EVENTS_PIN_MASK;
+
+	/**
+	 * Read the raw level of every input pin.
+	 */
+	uint32_t raw_inputs()
+	{
+#if DEVICE_EXISTS(gpio)
+		return MMIO_CAPABILITY(SonataGPIO, gpio)->input & PinMask;
+#else
+		return MMIO_CAPABILITY(GPIO, gpio_led0)->read & PinMask;
+#endif
+	}
+
+	/**
+	 * The accepted (debounced) level of every monitored pin.
+	 */
+	uint32_t state;
+
+	/**
+	 * For each pin, the number of consecutive samples in which the raw level
+	 * has differed from `state`.
+	 */
+	std::array<uint8_t, GPIO_EVENTS_PIN_COUNT> pendingSamples;
+
+	/**
+	 * The number of accepted edges on each pin.  Each is a futex word, woken
+	 * when it changes.
+	 */
+	std::array<cheriot::atomic<uint32_t>, GPIO_EVENTS_PIN_COUNT> edges;
+
+	/**
+	 * Returns true if `pin` is monitored.
+	 */
+	bool is_monitored(uint32_t pin)
+	{
+		return (pin < GPIO_EVENTS_PIN_COUNT) && ((PinMask >> pin) & 1);
+	}
+
+	/**
+	 * Take one sample of the inputs and accept any changes that have now
+	 * been stable for `DebounceSamples` samples.  Returns true if any pin is
+	 * still being debounced.
+	 */
+	bool sample()
+	{
+		uint32_t changed  = raw_inputs() ^ state;
+		bool     debounce = false;
+		for (uint32_t pin = 0; pin < GPIO_EVENTS_PIN_COUNT; pin++)
+		{
+			if (((changed >> pin) & 1) == 0)
+			{
+				// A glitch that reverted before it was accepted.
+				pendingSamples[pin] = 0;
+				continue;
+			}
+			if (++pendingSamples[pin] < DebounceSamples)
+			{
+				debounce = true;
+				continue;
+			}
+			pendingSamples[pin] = 0;
+			state ^= 1U << pin;
+			edges[pin]++;
+			edges[pin].notify_all();
+		}
+		return debounce;
+	}
+} // namespace
+
+uint32_t gpio_events_state()
+{
+	return state;
+}
+
+uint32_t gpio_events_edges(uint32_t pin)
+{
+	return is_monitored(pin) ? edges[pin].load() : 0;
+}
+
+int gpio_events_wait(Timeout *timeout, uint32_t pin, uint32_t seen)
+{
+	if (!is_monitored(pin) || !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	while (edges[pin].load() == seen)
+	{
+		if (edges[pin].wait(timeout, seen) == -ETIMEDOUT)
+		{
+			return -ETIMEDOUT;
+		}
+	}
+	return 0;
+}
+
+int multiwaiter_gpio_events_init(EventWaiterSource *source,
+                                 uint32_t           pin,
+                                 uint32_t           seen)
+{
+	if (!check_pointer<PermissionSet{Permission::Store}, false>(source) ||
+	    !is_monitored(pin))
+	{
+		return -EINVAL;
+	}
+	Capability<uint32_t> word{reinterpret_cast<uint32_t *>(&edges[pin])};
+	word.bounds() = sizeof(uint32_t);
+	word.permissions() &= PermissionSet{Permission::Load, Permission::Global};
+	source->eventSource = word;
+	source->kind        = EventWaiterFutex;
+	source->value       = seen;
+	return 0;
+}
+
+void gpio_events_run()
+{
+	state = raw_inputs();
+#ifdef CHERIOT_GPIO_EVENTS_INTERRUPT
+	const uint32_t *interruptFutex =
+	  interrupt_futex_get(STATIC_SEALED_VALUE(gpioInterrupt));
+#endif
+	while (true)
+	{
+#ifdef CHERIOT_GPIO_EVENTS_INTERRUPT
+		// Read the interrupt count before sampling, so that an edge after
+		// the sample makes the wait below return immediately.
+		uint32_t interrupts = *interruptFutex;
+		if (!sample())
+		{
+			// Nothing is being debounced: sleep until the next edge.
+			interrupt_complete(STATIC_SEALED_VALUE(gpioInterrupt));
+			Timeout unlimited{UnlimitedTimeout};
+			futex_timed_wait(&unlimited, interruptFutex, interrupts);
+			continue;
+		}
+#else
+		sample();
+#endif
+		Timeout tick{1};
+		thread_sleep(&tick, ThreadSleepNoEarlyWake);
+	}
+}
@@ -0,0 +1,12 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../compartment_helpers")
+
+compartment("gpio_events")
+  set_default(false)
+  add_deps("compartment_helpers")
+  add_files("gpio_events.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_GPIO_EVENTS_DEBOUNCE_SAMPLES=" .. math.floor(tonumber(get_config("gpio-events-debounce-samples"))))
+  end)
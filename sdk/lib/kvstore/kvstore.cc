@@ -0,0 +1,817 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cheri.hh>
+#include <checksum.h>
+#include <compartment.h>
+#include <errno.h>
+#include <kvstore.h>
+#include <locks.hh>
+#include <spi_flash.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread_pool.h>
+
+using namespace CHERI;
+
+#ifndef CHERIOT_KVSTORE_SECTORS
+#	define CHERIOT_KVSTORE_SECTORS 8
+#endif
+
+#ifndef CHERIOT_KVSTORE_MAX_KEYS
+#	define CHERIOT_KVSTORE_MAX_KEYS 64
+#endif
+
+namespace
+{
+	/// The number of flash sectors that hold the log.
+	constexpr uint32_t Sectors = CHERIOT_KVSTORE_SECTORS;
+	static_assert(Sectors >= 4, "The key-value store needs four sectors");
+
+	/// The maximum number of keys.
+	constexpr uint32_t MaxKeys = CHERIOT_KVSTORE_MAX_KEYS;
+
+	/// The number of slots in the index, at most half full.
+	constexpr uint32_t IndexSlots = std::bit_ceil(MaxKeys * 2);
+
+	/// The size of a sector.
+	constexpr uint32_t SectorSize = SPI_FLASH_SECTOR_SIZE;
+
+	/**
+	 * The number of erased sectors below which compaction is scheduled.
+	 * Writes other than compaction leave one erased sector, so that
+	 * compaction always has somewhere to move records to.
+	 */
+	constexpr uint32_t CompactionThreshold = 3;
+
+	/// Magic number at the start of each sector in use ("KVS1").
+	constexpr uint32_t SectorMagic = 0x3153564b;
+
+	/// The header at the start of each sector in use.
+	struct SectorHeader
+	{
+		/// `SectorMagic`.
+		uint32_t magic;
+		/// The order in which the sector was started.
+		uint32_t sequence;
+	};
+
+	/// Record flag marking a deletion.
+	constexpr uint8_t RecordDeleted = 1 << 0;
+
+	/**
+	 * The header of each record.  The key and then the value follow it and
+	 * the next record starts at the next word boundary.  Unwritten space
+	 * reads as a header with a key length of 0xff.
+	 */
+	struct RecordHeader
+	{
+		/// The length of the key.
+		uint8_t keyLength;
+		/// Flags (`RecordDeleted`).
+		uint8_t flags;
+		/// The length of the value.
+		uint16_t valueLength;
+		/// CRC-32 of the first word of the header, the key and the value.
+		uint32_t crc;
+	};
+
+	/// A copy of a key.
+	using Key = std::array<uint8_t, KVSTORE_MAX_KEY_LENGTH>;
+
+	/// An index slot that has never been used.
+	constexpr uint32_t EmptySlot = UINT32_MAX;
+
+	/// An index slot whose key has been removed.
+	constexpr uint32_t RemovedSlot = UINT32_MAX - 1;
+
+	/// A slot in the index.
+	struct IndexSlot
+	{
+		/// The hash of the key.
+		uint32_t hash;
+		/// The flash address of the key's newest record, or a marker.
+		uint32_t address = EmptySlot;
+	};
+
+	/// Lock serialising all access to the log and the index.
+	FlagLock lock;
+
+	/// 0 before the log has been scanned, then 1 or an error.
+	int state;
+
+	/// The flash address of the first sector.
+	uint32_t regionBase;
+
+	/// The sequence number of each sector in use.
+	std::array<uint32_t, Sectors> sequences;
+
+	/// Whether each sector is known to be erased.
+	std::array<bool, Sectors> erased;
+
+	/// The oldest sector in use.
+	uint32_t tail;
+
+	/// The sector that records are appended to.
+	uint32_t head;
+
+	/// The number of sectors in use.
+	uint32_t usedSectors;
+
+	/// The offset in `head` at which the next record is written.
+	uint32_t writeOffset;
+
+	/// The sequence number of the next sector to be started.
+	uint32_t nextSequence;
+
+	/// The index.
+	std::array<IndexSlot, IndexSlots> slots;
+
+	/// The number of keys in the index.
+	uint32_t keyCount;
+
+	/// Set while a compaction is queued on the thread pool.
+	bool compactionQueued;
+
+	/// Buffer for moving values during compaction.
+	std::array<uint8_t, KVSTORE_MAX_VALUE_LENGTH> moveBuffer;
+
+	/// Returns the flash address of `sector`.
+	uint32_t sector_address(uint32_t sector)
+	{
+		return regionBase + (sector * SectorSize);
+	}
+
+	/// Returns the space used by a record, including padding.
+	uint32_t record_size(const RecordHeader &header)
+	{
+		return (sizeof(RecordHeader) + header.keyLength + header.valueLength +
+		        3) &
+		       ~3U;
+	}
+
+	/// Returns the FNV-1a hash of a key.
+	uint32_t hash_key(const uint8_t *key, size_t length)
+	{
+		uint32_t hash = 2166136261U;
+		for (size_t i = 0; i < length; i++)
+		{
+			hash = (hash ^ key[i]) * 16777619U;
+		}
+		return hash;
+	}
+
+	/// Returns the CRC of a record header's first word and `key`.
+	uint32_t record_crc(const RecordHeader &header, const uint8_t *key)
+	{
+		uint32_t crc = checksum_crc32(0, &header, offsetof(RecordHeader, crc));
+		return checksum_crc32(crc, key, header.keyLength);
+	}
+
+	/**
+	 * Look up a key in the index.  Returns the slot holding it, or -1.  If
+	 * `freeSlot` is not null, it is set to the first slot that the key could
+	 * be inserted in.
+	 */
+	int find(Timeout       *timeout,
+	         uint32_t       hash,
+	         const uint8_t *key,
+	         size_t         keyLength,
+	         int           *freeSlot = nullptr)
+	{
+		if (freeSlot != nullptr)
+		{
+			*freeSlot = -1;
+		}
+		for (uint32_t i = 0; i < IndexSlots; i++)
+		{
+			uint32_t   index = (hash + i) & (IndexSlots - 1);
+			IndexSlot &slot  = slots[index];
+			if (slot.address >= RemovedSlot)
+			{
+				if ((freeSlot != nullptr) && (*freeSlot < 0))
+				{
+					*freeSlot = index;
+				}
+				if (slot.address == EmptySlot)
+				{
+					return -1;
+				}
+				continue;
+			}
+			if (slot.hash != hash)
+			{
+				continue;
+			}
+			// Compare the key with the one in the record.
+			RecordHeader header;
+			Key          storedKey;
+			if ((spi_flash_read(
+			       timeout, slot.address, &header, sizeof(header)) == 0) &&
+			    (header.keyLength == keyLength) &&
+			    (spi_flash_read(timeout,
+			                    slot.address + sizeof(header),
+			                    storedKey.data(),
+			                    keyLength) == 0) &&
+			    (memcmp(storedKey.data(), key, keyLength) == 0))
+			{
+				return index;
+			}
+		}
+		return -1;
+	}
+
+	/**
+	 * Record that the newest record for a key is at `address`, or remove
+	 * the key if `deleted` is true.  Returns false if the index is full.
+	 */
+	bool index_update(Timeout       *timeout,
+	                  const uint8_t *key,
+	                  size_t         keyLength,
+	                  uint32_t       address,
+	                  bool           deleted)
+	{
+		uint32_t hash = hash_key(key, keyLength);
+		int      freeSlot;
+		int      found = find(timeout, hash, key, keyLength, &freeSlot);
+		if (deleted)
+		{
+			if (found >= 0)
+			{
+				slots[found].address = RemovedSlot;
+				keyCount--;
+			}
+			return true;
+		}
+		if (found >= 0)
+		{
+			slots[found].address = address;
+			return true;
+		}
+		if ((keyCount == MaxKeys) || (freeSlot < 0))
+		{
+			return false;
+		}
+		slots[freeSlot] = {hash, address};
+		keyCount++;
+		return true;
+	}
+
+	/**
+	 * Read and check the record at `address`.  Fills in `header` and `key`
+	 * and returns true if the record is complete.  Returns false at the end
+	 * of the records in a sector.
+	 */
+	bool read_record(Timeout      *timeout,
+	                 uint32_t      address,
+	                 RecordHeader &header,
+	                 Key          &key)
+	{
+		uint32_t sectorEnd = (address & ~(SectorSize - 1)) + SectorSize;
+		if ((address + sizeof(header) > sectorEnd) ||
+		    (spi_flash_read(timeout, address, &header, sizeof(header)) != 0) ||
+		    (header.keyLength == 0) ||
+		    (header.keyLength > KVSTORE_MAX_KEY_LENGTH) ||
+		    (header.valueLength > KVSTORE_MAX_VALUE_LENGTH) ||
+		    (address + record_size(header) > sectorEnd) ||
+		    (spi_flash_read(timeout,
+		                    address + sizeof(header),
+		                    key.data(),
+		                    header.keyLength) != 0))
+		{
+			return false;
+		}
+		uint32_t crc   = record_crc(header, key.data());
+		uint32_t value = address + sizeof(header) + header.keyLength;
+		for (uint32_t done = 0; done < header.valueLength;)
+		{
+			uint8_t  chunk[64];
+			uint32_t length =
+			  std::min<uint32_t>(sizeof(chunk), header.valueLength - done);
+			if (spi_flash_read(timeout, value + done, chunk, length) != 0)
+			{
+				return false;
+			}
+			crc = checksum_crc32(crc, chunk, length);
+			done += length;
+		}
+		return crc == header.crc;
+	}
+
+	/**
+	 * Returns true if the `SectorSize` bytes of `sector` are all ones.
+	 */
+	bool sector_is_erased(Timeout *timeout, uint32_t sector)
+	{
+		for (uint32_t offset = 0; offset < SectorSize;)
+		{
+			uint32_t chunk[16];
+			if (spi_flash_read(timeout,
+			                   sector_address(sector) + offset,
+			                   chunk,
+			                   sizeof(chunk)) != 0)
+			{
+				return false;
+			}
+			for (uint32_t word : chunk)
+			{
+				if (word != UINT32_MAX)
+				{
+					return false;
+				}
+			}
+			offset += sizeof(chunk);
+		}
+		return true;
+	}
+
+	/**
+	 * Find the flash region, scan the log, and build the index.  Returns 1
+	 * or an error.
+	 */
+	int scan(Timeout *timeout)
+	{
+		ssize_t size = spi_flash_size();
+		if (size < 0)
+		{
+			return size;
+		}
+		uint32_t flashSize = size;
+#ifdef CHERIOT_KVSTORE_FLASH_BASE
+		regionBase = CHERIOT_KVSTORE_FLASH_BASE;
+#else
+		regionBase = flashSize - (Sectors * SectorSize);
+#endif
+		if ((flashSize < Sectors * SectorSize) ||
+		    (regionBase > flashSize - (Sectors * SectorSize)) ||
+		    ((regionBase % SectorSize) != 0))
+		{
+			return -ENODEV;
+		}
+		// Find the sectors in use and replay them from oldest to newest.
+		std::array<uint8_t, Sectors> order;
+		usedSectors = 0;
+		for (uint32_t sector = 0; sector < Sectors; sector++)
+		{
+			SectorHeader header;
+			if (int ret = spi_flash_read(
+			      timeout, sector_address(sector), &header, sizeof(header));
+			    ret != 0)
+			{
+				return ret;
+			}
+			erased[sector] = false;
+			if (header.magic == SectorMagic)
+			{
+				sequences[sector]    = header.sequence;
+				order[usedSectors++] = sector;
+			}
+		}
+		std::sort(order.begin(),
+		          order.begin() + usedSectors,
+		          [](uint8_t a, uint8_t b) {
+			          return int32_t(sequences[a] - sequences[b]) < 0;
+		          });
+		for (uint32_t i = 0; i < usedSectors; i++)
+		{
+			uint32_t     base   = sector_address(order[i]);
+			uint32_t     offset = sizeof(SectorHeader);
+			RecordHeader header{};
+			Key          key;
+			while (read_record(timeout, base + offset, header, key))
+			{
+				index_update(timeout,
+				             key.data(),
+				             header.keyLength,
+				             base + offset,
+				             header.flags & RecordDeleted);
+				offset += record_size(header);
+			}
+			writeOffset = offset;
+			// Anything other than erased space after the last record is a
+			// torn write, so do not append after it.
+			if ((offset + sizeof(header) <= SectorSize) &&
+			    (header.keyLength != 0xff))
+			{
+				writeOffset = SectorSize;
+			}
+		}
+		if (usedSectors == 0)
+		{
+			tail         = 0;
+			head         = Sectors - 1;
+			writeOffset  = SectorSize;
+			nextSequence = 0;
+		}
+		else
+		{
+			tail         = order[0];
+			head         = order[usedSectors - 1];
+			nextSequence = sequences[head] + 1;
+		}
+		return 1;
+	}
+
+	/**
+	 * Erase `tail` and stop using it.  Returns 0 or an error.
+	 */
+	int release_tail(Timeout *timeout)
+	{
+		if (int ret =
+		      spi_flash_erase(timeout, sector_address(tail), SectorSize);
+		    ret != 0)
+		{
+			return ret;
+		}
+		erased[tail] = true;
+		tail         = (tail + 1) % Sectors;
+		usedSectors--;
+		return 0;
+	}
+
+	/**
+	 * Start appending to the sector after `head`, leaving at least `reserve`
+	 * erased sectors.  Returns 0, `-ENOSPC`, or an error from the flash.
+	 */
+	int open_sector(Timeout *timeout, uint32_t reserve)
+	{
+		if (Sectors - usedSectors <= reserve)
+		{
+			return -ENOSPC;
+		}
+		uint32_t next = (head + 1) % Sectors;
+		if (!erased[next] && !sector_is_erased(timeout, next))
+		{
+			if (int ret =
+			      spi_flash_erase(timeout, sector_address(next), SectorSize);
+			    ret != 0)
+			{
+				return ret;
+			}
+		}
+		SectorHeader header{SectorMagic, nextSequence};
+		if (int ret = spi_flash_write(
+		      timeout, sector_address(next), &header, sizeof(header));
+		    ret != 0)
+		{
+			return ret;
+		}
+		erased[next]    = false;
+		sequences[next] = nextSequence++;
+		if (usedSectors++ == 0)
+		{
+			tail = next;
+		}
+		head        = next;
+		writeOffset = sizeof(SectorHeader);
+		return 0;
+	}
+
+	int compact_one(Timeout *timeout);
+
+	/**
+	 * Append a record, leaving at least `reserve` erased sectors unless
+	 * compaction frees space.  Returns the record's address or an error.
+	 */
+	int64_t append(Timeout       *timeout,
+	               uint8_t        flags,
+	               const uint8_t *key,
+	               size_t         keyLength,
+	               const void    *value,
+	               size_t         valueLength,
+	               uint32_t       reserve)
+	{
+		RecordHeader header{uint8_t(keyLength), flags, uint16_t(valueLength)};
+		header.crc = checksum_crc32(
+		  record_crc(header, key), value, valueLength);
+		uint32_t size = record_size(header);
+		while (writeOffset + size > SectorSize)
+		{
+			int ret = open_sector(timeout, reserve);
+			// Make space by compacting if the background compaction has not
+			// kept up.  Give up if that frees nothing.
+			if ((ret == -ENOSPC) && (reserve > 0))
+			{
+				uint32_t used = usedSectors;
+				ret           = compact_one(timeout);
+				if ((ret == 0) && (usedSectors >= used) &&
+				    (writeOffset + size > SectorSize))
+				{
+					ret = -ENOSPC;
+				}
+			}
+			if (ret != 0)
+			{
+				return ret;
+			}
+		}
+		uint32_t address = sector_address(head) + writeOffset;
+		// If any write fails, a partial record may follow, so append nothing
+		// more to this sector.
+		writeOffset = SectorSize;
+		int ret = spi_flash_write(timeout, address, &header, sizeof(header));
+		if (ret == 0)
+		{
+			ret = spi_flash_write(
+			  timeout, address + sizeof(header), key, keyLength);
+		}
+		if ((ret == 0) && (valueLength > 0))
+		{
+			ret = spi_flash_write(timeout,
+			                      address + sizeof(header) + keyLength,
+			                      value,
+			                      valueLength);
+		}
+		if (ret == 0)
+		{
+			ret = spi_flash_sync(timeout);
+		}
+		if (ret != 0)
+		{
+			return ret;
+		}
+		writeOffset = address + size - sector_address(head);
+		return address;
+	}
+
+	/**
+	 * Move the current records in the oldest sector to the head of the log
+	 * and erase it.  Returns 0, `-ENOSPC` if the oldest sector is the head
+	 * or there is no room to move its records, or an error from the flash.
+	 */
+	int compact_one(Timeout *timeout)
+	{
+		if (usedSectors < 2)
+		{
+			return -ENOSPC;
+		}
+		uint32_t base   = sector_address(tail);
+		uint32_t offset = sizeof(SectorHeader);
+		RecordHeader header;
+		Key          key;
+		while ((offset + sizeof(header) <= SectorSize) &&
+		       (spi_flash_read(
+		          timeout, base + offset, &header, sizeof(header)) == 0) &&
+		       (header.keyLength != 0) &&
+		       (header.keyLength <= KVSTORE_MAX_KEY_LENGTH) &&
+		       (header.valueLength <= KVSTORE_MAX_VALUE_LENGTH) &&
+		       (offset + record_size(header) <= SectorSize))
+		{
+			uint32_t address = base + offset;
+			offset += record_size(header);
+			if (int ret = spi_flash_read(timeout,
+			                             address + sizeof(header),
+			                             key.data(),
+			                             header.keyLength);
+			    ret != 0)
+			{
+				return ret;
+			}
+			// Deletions and replaced values are dropped.  Only the records
+			// that the index refers to are current.
+			int slot = find(timeout,
+			                hash_key(key.data(), header.keyLength),
+			                key.data(),
+			                header.keyLength);
+			if ((slot < 0) || (slots[slot].address != address))
+			{
+				continue;
+			}
+			if (int ret = spi_flash_read(timeout,
+			                             address + sizeof(header) +
+			                               header.keyLength,
+			                             moveBuffer.data(),
+			                             header.valueLength);
+			    ret != 0)
+			{
+				return ret;
+			}
+			int64_t moved = append(timeout,
+			                       header.flags,
+			                       key.data(),
+			                       header.keyLength,
+			                       moveBuffer.data(),
+			                       header.valueLength,
+			                       0);
+			if (moved < 0)
+			{
+				return moved;
+			}
+			slots[slot].address = moved;
+		}
+		return release_tail(timeout);
+	}
+
+	/**
+	 * Compact from the thread pool until enough sectors are erased or
+	 * compaction stops freeing space.
+	 */
+	__cheri_callback void compact_in_background(void *)
+	{
+		while (true)
+		{
+			// Release the lock between sectors so that reads and writes are
+			// not delayed by more than one sector's compaction.
+			LockGuard g{lock};
+			uint32_t  used   = usedSectors;
+			compactionQueued = false;
+			Timeout t{UnlimitedTimeout};
+			if ((Sectors - used >= CompactionThreshold) ||
+			    (compact_one(&t) != 0) || (usedSectors >= used))
+			{
+				return;
+			}
+		}
+	}
+
+	/// Queue a compaction if few sectors are erased.
+	void maybe_compact()
+	{
+		if (!compactionQueued && (Sectors - usedSectors < CompactionThreshold))
+		{
+			compactionQueued = thread_pool_try_async(&compact_in_background,
+			                                         nullptr,
+			                                         ThreadPoolDefaultPriority,
+			                                         nullptr) == 0;
+		}
+	}
+
+	/**
+	 * Scan the log if it has not been scanned.  Called with the lock held.
+	 * Returns 0 or an error.
+	 */
+	int ensure_scanned(Timeout *timeout)
+	{
+		if (state == 0)
+		{
+			state = scan(timeout);
+		}
+		if (state < 0)
+		{
+			int ret = state;
+			// Scan again next time if the error may be transient.
+			if (ret == -ETIMEDOUT)
+			{
+				state = 0;
+			}
+			return ret;
+		}
+		return 0;
+	}
+
+	/**
+	 * Check the arguments common to all operations.  Returns true if they
+	 * are valid.
+	 */
+	bool check_key(Timeout *timeout, const void *key, size_t keyLength)
+	{
+		return check_timeout_pointer(timeout) && (keyLength > 0) &&
+		       (keyLength <= KVSTORE_MAX_KEY_LENGTH) &&
+		       check_pointer<PermissionSet{Permission::Load}, false>(
+		         key, keyLength);
+	}
+} // namespace
+
+ssize_t kvstore_get(Timeout    *timeout,
+                    const void *key,
+                    size_t      keyLength,
+                    void       *value,
+                    size_t      length)
+{
+	if (!check_key(timeout, key, keyLength) ||
+	    ((length > 0) &&
+	     !check_pointer<PermissionSet{Permission::Store}, false>(value,
+	                                                             length)))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, key, value) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = ensure_scanned(timeout); ret != 0)
+	{
+		return ret;
+	}
+	auto *bytes = static_cast<const uint8_t *>(key);
+	int   slot  = find(timeout, hash_key(bytes, keyLength), bytes, keyLength);
+	if (slot < 0)
+	{
+		return -ENOENT;
+	}
+	uint32_t     address = slots[slot].address;
+	RecordHeader header;
+	if (int ret = spi_flash_read(timeout, address, &header, sizeof(header));
+	    ret != 0)
+	{
+		return ret;
+	}
+	if (size_t copy = std::min<size_t>(length, header.valueLength); copy > 0)
+	{
+		if (int ret = spi_flash_read(
+		      timeout, address + sizeof(header) + keyLength, value, copy);
+		    ret != 0)
+		{
+			return ret;
+		}
+	}
+	return header.valueLength;
+}
+
+int kvstore_set(Timeout    *timeout,
+                const void *key,
+                size_t      keyLength,
+                const void *value,
+                size_t      length)
+{
+	if (!check_key(timeout, key, keyLength) ||
+	    (length > KVSTORE_MAX_VALUE_LENGTH) ||
+	    ((length > 0) &&
+	     !check_pointer<PermissionSet{Permission::Load}, false>(value,
+	                                                            length)))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, key, value) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = ensure_scanned(timeout); ret != 0)
+	{
+		return ret;
+	}
+	// Copy the key so that the caller cannot change it between hashing it
+	// and writing it.
+	Key keyCopy;
+	memcpy(keyCopy.data(), key, keyLength);
+	uint32_t hash = hash_key(keyCopy.data(), keyLength);
+	int      freeSlot;
+	if ((find(timeout, hash, keyCopy.data(), keyLength, &freeSlot) < 0) &&
+	    ((keyCount == MaxKeys) || (freeSlot < 0)))
+	{
+		return -ENOSPC;
+	}
+	int64_t address =
+	  append(timeout, 0, keyCopy.data(), keyLength, value, length, 1);
+	if (address < 0)
+	{
+		return address;
+	}
+	index_update(timeout, keyCopy.data(), keyLength, address, false);
+	maybe_compact();
+	return 0;
+}
+
+int kvstore_delete(Timeout *timeout, const void *key, size_t keyLength)
+{
+	if (!check_key(timeout, key, keyLength))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, key) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = ensure_scanned(timeout); ret != 0)
+	{
+		return ret;
+	}
+	Key keyCopy;
+	memcpy(keyCopy.data(), key, keyLength);
+	int slot = find(timeout,
+	                hash_key(keyCopy.data(), keyLength),
+	                keyCopy.data(),
+	                keyLength);
+	if (slot < 0)
+	{
+		return -ENOENT;
+	}
+	int64_t address =
+	  append(timeout, RecordDeleted, keyCopy.data(), keyLength, nullptr, 0, 1);
+	if (address < 0)
+	{
+		return address;
+	}
+	slots[slot].address = RemovedSlot;
+	keyCount--;
+	maybe_compact();
+	return 0;
+}
@@ -0,0 +1,13 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../compartment_helpers", "../checksum", "../spi_flash", "../thread_pool")
+
+compartment("kvstore")
+  set_default(false)
+  add_deps("locks", "compartment_helpers", "checksum", "spi_flash", "thread_pool")
+  add_files("kvstore.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_KVSTORE_SECTORS=" .. math.floor(tonumber(get_config("kvstore-sectors"))))
+	target:add('defines', "CHERIOT_KVSTORE_MAX_KEYS=" .. math.floor(tonumber(get_config("kvstore-max-keys"))))
+  end)
@@ -0,0 +1,120 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheri.hh>
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <errno.h>
+#include <led_frame.h>
+#include <locks.hh>
+#include <platform-pwm.hh>
+#include <platform-rgbctrl.hh>
+#include <stdlib.h>
+#include <string.h>
+#include <thread.h>
+#include <timeout.h>
+
+using namespace CHERI;
+
+#if !DEVICE_EXISTS(pwm) || !DEVICE_EXISTS(pwm_lcd) || !DEVICE_EXISTS(rgbled)
+#	error The LED frame driver requires the Sonata PWM and RGB LED controllers
+#endif
+
+static_assert(LED_FRAME_PWM_COUNT ==
+                sizeof(SonataPulseWidthModulation::General) /
+                  sizeof(SonataPulseWidthModulation::Output),
+              "LED_FRAME_PWM_COUNT does not match the hardware");
+static_assert(LED_FRAME_RGB_COUNT == 2,
+              "LED_FRAME_RGB_COUNT does not match the hardware");
+
+namespace
+{
+	/**
+	 * Protects `pending`.
+	 */
+	FlagLockPriorityInherited pendingLock;
+
+	/**
+	 * The most recently submitted frame.
+	 */
+	LedFrame pending;
+
+	/**
+	 * The number of frames that have been submitted.  This is a futex word
+	 * that the driver thread waits on while there is nothing to apply.
+	 */
+	cheriot::atomic<uint32_t> submitted;
+
+	/**
+	 * The number of frames that have been applied.
+	 */
+	cheriot::atomic<uint32_t> applied;
+
+	/**
+	 * Write every register for `frame`.
+	 */
+	void apply(const LedFrame &frame)
+	{
+		uint32_t colours[LED_FRAME_RGB_COUNT];
+		for (size_t i = 0; i < LED_FRAME_RGB_COUNT; i++)
+		{
+			colours[i] = SonataRgbLedController::colour(
+			  frame.rgb[i][0], frame.rgb[i][1], frame.rgb[i][2]);
+		}
+		MMIO_CAPABILITY(SonataPulseWidthModulation::General, pwm)
+		  ->outputs_set(frame.pwmPeriod, frame.pwmDutyCycle);
+		MMIO_CAPABILITY(SonataPulseWidthModulation::LcdBacklight, pwm_lcd)
+		  ->output_set(frame.backlightPeriod, frame.backlightDutyCycle);
+		MMIO_CAPABILITY(SonataRgbLedController, rgbled)->rgb_all(colours);
+	}
+} // namespace
+
+int led_frame_submit(Timeout *timeout, const LedFrame *frame)
+{
+	if (!check_timeout_pointer(timeout) ||
+	    !check_pointer<PermissionSet{Permission::Load}, false>(frame))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, frame) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{pendingLock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	memcpy(&pending, frame, sizeof(pending));
+	submitted++;
+	submitted.notify_all();
+	return 0;
+}
+
+uint32_t led_frame_applied()
+{
+	return applied.load();
+}
+
+void led_frame_run()
+{
+	uint32_t seen = 0;
+	LedFrame frame;
+	while (true)
+	{
+		// Sleep until there is a new frame.
+		submitted.wait(seen);
+		// Then wait for the next tick, so that frames are applied on tick
+		// boundaries and any further frames submitted in this tick replace
+		// this one.
+		Timeout tick{1};
+		thread_sleep(&tick, ThreadSleepNoEarlyWake);
+		{
+			LockGuard g{pendingLock};
+			memcpy(&frame, &pending, sizeof(frame));
+			seen = submitted.load();
+		}
+		apply(frame);
+		applied++;
+	}
+}
@@ -0,0 +1,9 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../compartment_helpers")
+
+compartment("led_frame")
+  set_default(false)
+  add_deps("locks", "compartment_helpers")
+  add_files("led_frame.cc")
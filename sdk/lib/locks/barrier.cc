@@ -0,0 +1,99 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <errno.h>
+#include <locks.h>
+
+namespace
+{
+	/// Mask for the number of threads that have arrived at a barrier.
+	constexpr uint32_t ArrivedMask = 0xffff;
+	/// Amount added to a barrier's state word to advance its generation.
+	constexpr uint32_t NextGeneration = ArrivedMask + 1;
+} // namespace
+
+int latch_count_down(LatchState *latch, uint32_t count)
+{
+	uint32_t value = latch->count.load();
+	do
+	{
+		if (count > value)
+		{
+			return -EINVAL;
+		}
+	} while (!latch->count.compare_exchange_strong(value, value - count));
+	// Wake every waiter with a single call when the count reaches zero.
+	if ((count != 0) && (value == count))
+	{
+		latch->count.notify_all();
+	}
+	return 0;
+}
+
+int latch_wait(Timeout *timeout, LatchState *latch)
+{
+	do
+	{
+		uint32_t value = latch->count.load();
+		if (value == 0)
+		{
+			return 0;
+		}
+		if (int ret = latch->count.wait(timeout, value); ret != 0)
+		{
+			return ret;
+		}
+	} while (true);
+}
+
+int barrier_arrive_and_wait(Timeout *timeout, BarrierState *barrier)
+{
+	uint32_t value = barrier->state.load();
+	uint32_t arrived;
+	do
+	{
+		arrived = (value & ArrivedMask) + 1;
+		if (arrived > barrier->parties)
+		{
+			return -EINVAL;
+		}
+		// The last thread to arrive starts the next generation, with no
+		// threads arrived, which changes the word that the others wait on.
+		uint32_t next = (arrived == barrier->parties)
+		                  ? (value & ~ArrivedMask) + NextGeneration
+		                  : value + 1;
+		if (barrier->state.compare_exchange_strong(value, next))
+		{
+			value = next;
+			break;
+		}
+	} while (true);
+	if (arrived == barrier->parties)
+	{
+		barrier->state.notify_all();
+		return 1;
+	}
+	uint32_t generation = value & ~ArrivedMask;
+	do
+	{
+		if ((value & ~ArrivedMask) != generation)
+		{
+			return 0;
+		}
+		if (int ret = barrier->state.wait(timeout, value); ret != 0)
+		{
+			// Withdraw from this generation, unless it completed while we
+			// were giving up, in which case the wait succeeded.
+			value = barrier->state.load();
+			while ((value & ~ArrivedMask) == generation)
+			{
+				if (barrier->state.compare_exchange_strong(value, value - 1))
+				{
+					return ret;
+				}
+			}
+			return 0;
+		}
+		value = barrier->state.load();
+	} while (true);
+}
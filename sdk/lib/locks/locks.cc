@@ -1,8 +1,12 @@
+#include <algorithm>
 #include <atomic>
 #include <debug.hh>
 #include <errno.h>
+#include <futex.h>
 #include <limits>
+#include <lock_profile.h>
 #include <locks.h>
+#include <riscvreg.h>
 #include <thread.h>
 
 namespace
@@ -15,6 +19,125 @@ namespace
 #endif
 	  ;
 	using Debug = ConditionalDebug<DebugLocks, "Locking">;
+
+#ifndef CHERIOT_LOCK_PROFILING_ENTRIES
+#	define CHERIOT_LOCK_PROFILING_ENTRIES 0
+#endif
+	/**
+	 * The number of locks for which contention statistics are recorded in
+	 * the `lock_profile` shared object.  Zero disables profiling.
+	 */
+	constexpr size_t LockProfilingEntries = CHERIOT_LOCK_PROFILING_ENTRIES;
+
+	/**
+	 * Should non-priority-inheriting locks store their owner's thread ID in
+	 * the lock word?  This is needed for the debug assertions and for lock
+	 * profiling to report the holder.  Priority-inheriting locks always store
+	 * it.
+	 */
+	constexpr bool RecordOwner = DebugLocks || (LockProfilingEntries > 0);
+
+#if CHERIOT_LOCK_PROFILING_ENTRIES > 0
+	/**
+	 * Returns the profile entry for the lock whose futex word is at `lock`,
+	 * registering the lock if this is the first time that it has been seen,
+	 * or null if the table is full.
+	 */
+	LockProfileEntry *lock_profile_entry(const void *lock)
+	{
+		auto *entries = SHARED_OBJECT_WITH_PERMISSIONS(
+		  LockProfileEntry, lock_profile, true, true, false, false);
+		uint32_t address = __builtin_cheri_address_get(lock);
+		size_t   start   = ((address >> 2) * 0x9e3779b1U) % LockProfilingEntries;
+		for (size_t i = 0; i < LockProfilingEntries; i++)
+		{
+			auto    &entry   = entries[(start + i) % LockProfilingEntries];
+			uint32_t current = __atomic_load_n(&entry.lock, __ATOMIC_RELAXED);
+			if (current == 0)
+			{
+				// Claim the entry.  If another thread claims it first,
+				// `current` is updated to the lock that it claimed it for.
+				__atomic_compare_exchange_n(&entry.lock,
+				                            &current,
+				                            address,
+				                            false,
+				                            __ATOMIC_SEQ_CST,
+				                            __ATOMIC_SEQ_CST);
+				if (current == 0)
+				{
+					return &entry;
+				}
+			}
+			if (current == address)
+			{
+				return &entry;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Records the statistics for one acquisition of a lock.
+	 */
+	class LockProfiler
+	{
+		/// The cycle at which the acquisition first found the lock held.
+		uint64_t waitStart = 0;
+		/// The owner of the lock when it was first found held.
+		uint16_t holder = 0;
+
+		public:
+		/**
+		 * Note that the lock was found held, with `lockWord` as its value.
+		 */
+		void contended(uint32_t lockWord)
+		{
+			if (waitStart == 0)
+			{
+				waitStart = rdcycle64();
+				holder    = lockWord & 0xffff;
+			}
+		}
+
+		/**
+		 * Record the acquisition of the lock at `lock`.  This must be called
+		 * with the lock held.
+		 */
+		void acquired(const void *lock)
+		{
+			LockProfileEntry *entry = lock_profile_entry(lock);
+			if (entry == nullptr)
+			{
+				return;
+			}
+			entry->acquisitions++;
+			if (waitStart == 0)
+			{
+				return;
+			}
+			uint64_t wait = rdcycle64() - waitStart;
+			entry->contendedAcquisitions++;
+			entry->totalWaitCycles += wait;
+			uint32_t clampedWait = static_cast<uint32_t>(
+			  std::min<uint64_t>(wait, std::numeric_limits<uint32_t>::max()));
+			if (clampedWait > entry->maxWaitCycles)
+			{
+				entry->maxWaitCycles = clampedWait;
+				entry->maxWaitHolder = holder;
+			}
+		}
+	};
+#else
+	/**
+	 * Lock profiler that does nothing, used when profiling is disabled.
+	 */
+	struct LockProfiler
+	{
+		void contended(uint32_t) {}
+		void acquired(const void *) {}
+	};
+#endif
+
 	/**
 	 * Internal implementation of a simple flag lock. See comments in
 	 * locks.hh and locks.h for more details.
@@ -39,17 +162,23 @@ namespace
 		public:
 		/**
 		 * Attempt to acquire the lock, blocking until a timeout specified by
-		 * the `timeout` parameter has expired.
+		 * the `timeout` parameter has expired.  If `spinCycles` is non-zero,
+		 * a contended acquire first polls the lock word for up to that many
+		 * cycles before sleeping.
 		 */
-		int
-		try_lock(Timeout *timeout, uint32_t threadID, bool isPriorityInherited)
+		int try_lock(Timeout *timeout,
+		             uint32_t threadID,
+		             bool     isPriorityInherited,
+		             uint32_t spinCycles = 0)
 		{
+			LockProfiler profiler;
 			while (true)
 			{
 				uint32_t old     = Flag::Unlocked;
 				uint32_t desired = Flag::Locked | threadID;
 				if (lockWord.compare_exchange_strong(old, desired))
 				{
+					profiler.acquired(&lockWord);
 					return 0;
 				}
 
@@ -64,11 +193,24 @@ namespace
 				{
 					return -ENOENT;
 				}
+				profiler.contended(old);
 
 				if (!timeout->may_block())
 				{
 					return -ETIMEDOUT;
 				}
+				// Spin (once) in the hope that the owner is about to release
+				// the lock, so that we can avoid two trips through the
+				// scheduler.
+				if (spinCycles != 0)
+				{
+					if (spin(spinCycles))
+					{
+						spinCycles = 0;
+						continue;
+					}
+					spinCycles = 0;
+				}
 				Debug::log("Hitting slow path wait for {}", &lockWord);
 				// If there are not already waiters, set the waiters flag.
 				if ((old & Flag::LockedWithWaiters) == 0)
@@ -111,6 +253,28 @@ namespace
 			}
 		}
 
+		/**
+		 * Poll the lock word for up to `cycles` cycles.  Returns true if the
+		 * lock was seen unlocked (or in destruction mode, which the caller
+		 * will report), false if the cycle budget was exhausted.  This does
+		 * not yield, so it is useful only if the owner can run while we spin:
+		 * on a single core, if this thread is preempted mid-spin.
+		 */
+		bool spin(uint32_t cycles)
+		{
+			uint64_t start = rdcycle64();
+			do
+			{
+				uint32_t value = lockWord.load(std::memory_order_relaxed);
+				if ((value == Flag::Unlocked) ||
+				    ((value & Flag::LockedInDestructMode) != 0))
+				{
+					return true;
+				}
+			} while ((rdcycle64() - start) < cycles);
+			return false;
+		}
+
 		/**
 		 * Return the owner.  If the lock is not held, this value should not be
 		 * assumed to be stable.  This does an unordered load.
@@ -234,8 +398,219 @@ namespace
 		}
 	};
 
+	/**
+	 * Internal implementation of a reader-writer lock.  See comments in
+	 * locks.hh and locks.h for more details.
+	 */
+	struct InternalReaderWriterLock : public ReaderWriterLockState
+	{
+		/**
+		 * Bit in the `readers` word that is set while a writer holds the
+		 * lock or is waiting for readers to drain.
+		 */
+		static constexpr uint32_t WriterBit = 1U << 31;
+
+		/**
+		 * Mask of the reader count in the `readers` word.
+		 */
+		static constexpr uint32_t ReaderMask = WriterBit - 1;
+
+		/**
+		 * The writer flag lock.
+		 */
+		InternalFlagLock &writer_lock()
+		{
+			return *static_cast<InternalFlagLock *>(&writer);
+		}
+
+		/**
+		 * Acquire the lock for reading.
+		 */
+		int read_lock(Timeout *timeout, bool isPriorityInherited)
+		{
+			uint32_t old = readers.load();
+			while (true)
+			{
+				if ((old & WriterBit) != 0)
+				{
+					// Wait for the writer by acquiring and releasing the
+					// writer lock, so that we are woken, in priority order,
+					// when the writer releases it, and so that priority
+					// inheritance (if enabled) boosts the writer.
+					uint32_t threadID = 0;
+					if (isPriorityInherited || RecordOwner)
+					{
+						threadID = thread_id_get();
+					}
+					if (int ret = writer_lock().try_lock(
+					      timeout, threadID, isPriorityInherited);
+					    ret != 0)
+					{
+						return ret;
+					}
+					writer_lock().unlock();
+					old = readers.load();
+					continue;
+				}
+				if ((old & ReaderMask) == ReaderMask)
+				{
+					return -EOVERFLOW;
+				}
+				if (readers.compare_exchange_strong(old, old + 1))
+				{
+					return 0;
+				}
+			}
+		}
+
+		/**
+		 * Release the lock held for reading.
+		 */
+		void read_unlock()
+		{
+			uint32_t old = readers.fetch_sub(1);
+			Debug::Assert((old & ReaderMask) != 0,
+			              "Releasing read lock {} that is not held",
+			              &readers);
+			// If we were the last reader and a writer is waiting for the
+			// readers to drain, wake it.
+			if (old == (WriterBit | 1))
+			{
+				readers.notify_all();
+			}
+		}
+
+		/**
+		 * Acquire the lock for writing.
+		 */
+		int write_lock(Timeout *timeout, bool isPriorityInherited)
+		{
+			uint32_t threadID = 0;
+			if (isPriorityInherited || RecordOwner)
+			{
+				threadID = thread_id_get();
+			}
+			if (int ret =
+			      writer_lock().try_lock(timeout, threadID, isPriorityInherited);
+			    ret != 0)
+			{
+				return ret;
+			}
+			// Stop new readers from acquiring the lock and wait for the
+			// existing ones to release it.
+			uint32_t old = readers.fetch_or(WriterBit) | WriterBit;
+			while (old != WriterBit)
+			{
+				if (int ret = readers.wait(timeout, old); ret != 0)
+				{
+					write_unlock();
+					return ret;
+				}
+				old = readers.load();
+			}
+			return 0;
+		}
+
+		/**
+		 * Release the lock held for writing.
+		 */
+		void write_unlock()
+		{
+			readers.fetch_and(ReaderMask);
+			writer_lock().unlock();
+		}
+	};
+
+	/**
+	 * Internal implementation of a condition variable.  See comments in
+	 * locks.hh and locks.h for more details.
+	 */
+	struct InternalConditionVariable : public ConditionVariableState
+	{
+		/**
+		 * Release `lock`, wait for a notification, and reacquire `lock`.
+		 */
+		int wait(Timeout          *timeout,
+		         InternalFlagLock *lock,
+		         bool              isPriorityInherited)
+		{
+			// Read the sequence number before releasing the lock, so that a
+			// notify after the release changes it and we do not sleep.
+			uint32_t snapshot = sequence.load();
+			lock->unlock();
+			int ret = sequence.wait(timeout, snapshot);
+			uint32_t threadID = 0;
+			if (isPriorityInherited || RecordOwner)
+			{
+				threadID = thread_id_get();
+			}
+			Timeout relock{UnlimitedTimeout};
+			if (int lockRet =
+			      lock->try_lock(&relock, threadID, isPriorityInherited);
+			    lockRet != 0)
+			{
+				return lockRet;
+			}
+			return ret;
+		}
+
+		/**
+		 * Wake up to `count` waiters, requeueing them onto `lock` if it is
+		 * held.
+		 */
+		void notify(InternalFlagLock *lock, uint32_t count)
+		{
+			++sequence;
+			auto *word = reinterpret_cast<uint32_t *>(&sequence);
+			if (lock != nullptr)
+			{
+				using Flag   = InternalFlagLock::Flag;
+				uint32_t old = lock->lockWord.load();
+				// While the lock is held, make sure that its waiters bit is
+				// set, so that its owner will wake the requeued threads when
+				// it unlocks, and then requeue.  The requeue checks that the
+				// lock word still has the value that we set.
+				while (((old & (Flag::Locked | Flag::LockedWithWaiters)) !=
+				        0) &&
+				       ((old & Flag::LockedInDestructMode) == 0))
+				{
+					uint32_t withWaiters =
+					  Flag::LockedWithWaiters | (old & 0xffff);
+					if ((old != withWaiters) &&
+					    !lock->lockWord.compare_exchange_strong(old,
+					                                            withWaiters))
+					{
+						continue;
+					}
+					int moved = futex_requeue(
+					  word,
+					  reinterpret_cast<uint32_t *>(&lock->lockWord),
+					  withWaiters,
+					  0,
+					  count);
+					if (moved >= 0)
+					{
+						count -= std::min<uint32_t>(moved, count);
+						break;
+					}
+					old = lock->lockWord.load();
+				}
+			}
+			// Wake anything that we could not requeue: all waiters if the
+			// lock was not held, or waiters that cannot be requeued.
+			if ((count > 0) && futex_may_have_waiters(word))
+			{
+				futex_wake(word, count);
+			}
+		}
+	};
+
 	static_assert(sizeof(InternalFlagLock) == sizeof(FlagLockState));
 	static_assert(sizeof(InternalTicketLock) == sizeof(TicketLockState));
+	static_assert(sizeof(InternalConditionVariable) ==
+	              sizeof(ConditionVariableState));
+	static_assert(sizeof(InternalReaderWriterLock) ==
+	              sizeof(ReaderWriterLockState));
 
 	__clang_ignored_warning_pop()
 
@@ -247,13 +622,26 @@ int __cheri_libcall flaglock_trylock(Timeout *t, FlagLockState *lock)
 	// (which is not relevant here). To avoid a useless call to
 	// thread_id_get(), pass 0 when debugging is disabled.
 	uint32_t threadID = 0;
-	if constexpr (DebugLocks)
+	if constexpr (RecordOwner)
 	{
 		threadID = thread_id_get();
 	}
 
 	return static_cast<InternalFlagLock *>(lock)->try_lock(t, threadID, false);
 }
+int __cheri_libcall flaglock_adaptive_trylock(Timeout       *t,
+                                              FlagLockState *lock,
+                                              uint32_t       spinCycles)
+{
+	uint32_t threadID = 0;
+	if constexpr (RecordOwner)
+	{
+		threadID = thread_id_get();
+	}
+
+	return static_cast<InternalFlagLock *>(lock)->try_lock(
+	  t, threadID, false, spinCycles);
+}
 int __cheri_libcall flaglock_priority_inheriting_trylock(Timeout       *t,
                                                          FlagLockState *lock)
 {
@@ -280,6 +668,52 @@ void __cheri_libcall ticketlock_unlock(TicketLockState *lock)
 	static_cast<InternalTicketLock *>(lock)->unlock();
 }
 
+int __cheri_libcall rwlock_read_trylock(Timeout               *timeout,
+                                        ReaderWriterLockState *lock)
+{
+	return static_cast<InternalReaderWriterLock *>(lock)->read_lock(timeout,
+	                                                                false);
+}
+
+int __cheri_libcall
+rwlock_priority_inheriting_read_trylock(Timeout               *timeout,
+                                        ReaderWriterLockState *lock)
+{
+	return static_cast<InternalReaderWriterLock *>(lock)->read_lock(timeout,
+	                                                                true);
+}
+
+void __cheri_libcall rwlock_read_unlock(ReaderWriterLockState *lock)
+{
+	static_cast<InternalReaderWriterLock *>(lock)->read_unlock();
+}
+
+int __cheri_libcall rwlock_write_trylock(Timeout               *timeout,
+                                         ReaderWriterLockState *lock)
+{
+	return static_cast<InternalReaderWriterLock *>(lock)->write_lock(timeout,
+	                                                                 false);
+}
+
+int __cheri_libcall
+rwlock_priority_inheriting_write_trylock(Timeout               *timeout,
+                                         ReaderWriterLockState *lock)
+{
+	return static_cast<InternalReaderWriterLock *>(lock)->write_lock(timeout,
+	                                                                 true);
+}
+
+void __cheri_libcall rwlock_write_unlock(ReaderWriterLockState *lock)
+{
+	static_cast<InternalReaderWriterLock *>(lock)->write_unlock();
+}
+
+void __cheri_libcall
+rwlock_upgrade_for_destruction(ReaderWriterLockState *lock)
+{
+	static_cast<InternalFlagLock *>(&lock->writer)->upgrade_for_destruction();
+}
+
 int recursivemutex_trylock(Timeout *timeout, RecursiveMutexState *mutex)
 {
 	auto              threadID = thread_id_get();
@@ -313,3 +747,53 @@ int __cheri_libcall recursivemutex_unlock(RecursiveMutexState *mutex)
 	static_cast<InternalFlagLock *>(&mutex->lock)->unlock();
 	return 0;
 }
+
+int __cheri_libcall condvar_wait(Timeout                *timeout,
+                                 ConditionVariableState *condition,
+                                 FlagLockState          *lock)
+{
+	return static_cast<InternalConditionVariable *>(condition)->wait(
+	  timeout, static_cast<InternalFlagLock *>(lock), false);
+}
+
+int __cheri_libcall
+condvar_priority_inheriting_wait(Timeout                *timeout,
+                                 ConditionVariableState *condition,
+                                 FlagLockState          *lock)
+{
+	return static_cast<InternalConditionVariable *>(condition)->wait(
+	  timeout, static_cast<InternalFlagLock *>(lock), true);
+}
+
+int __cheri_libcall
+condvar_recursivemutex_wait(Timeout                *timeout,
+                            ConditionVariableState *condition,
+                            RecursiveMutexState    *mutex)
+{
+	// Release the mutex completely and restore its depth once we have
+	// reacquired it.
+	auto depth   = mutex->depth;
+	mutex->depth = 0;
+	int ret      = static_cast<InternalConditionVariable *>(condition)->wait(
+	  timeout, static_cast<InternalFlagLock *>(&mutex->lock), true);
+	if (ret != -ENOENT)
+	{
+		mutex->depth = depth;
+	}
+	return ret;
+}
+
+void __cheri_libcall condvar_notify_one(ConditionVariableState *condition,
+                                        FlagLockState          *lock)
+{
+	static_cast<InternalConditionVariable *>(condition)->notify(
+	  static_cast<InternalFlagLock *>(lock), 1);
+}
+
+void __cheri_libcall condvar_notify_all(ConditionVariableState *condition,
+                                        FlagLockState          *lock)
+{
+	static_cast<InternalConditionVariable *>(condition)->notify(
+	  static_cast<InternalFlagLock *>(lock),
+	  std::numeric_limits<uint32_t>::max());
+}
@@ -5,7 +5,8 @@ debugOption("locks")
 library("locks")
   add_rules("cheriot.component-debug")
   add_deps("atomic4")
-  add_files("locks.cc", "semaphore.cc")
+  add_files("locks.cc", "semaphore.cc", "barrier.cc")
   on_load(function (target)
 	target:set('cheriot.debug-name', "locks")
+	target:add('defines', "CHERIOT_LOCK_PROFILING_ENTRIES=" .. math.floor(tonumber(get_config("lock-profiling-entries"))))
   end)
@@ -0,0 +1,255 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheri.hh>
+#include <errno.h>
+#include <microvium/microvium_arena.h>
+#include <stdlib.h>
+
+using namespace CHERI;
+
+/**
+ * Arena state.  The allocatable memory follows this structure and is a
+ * sequence of chunks, each starting with a `Chunk` header.
+ */
+struct MicroviumArena
+{
+	/// Bounded capability to the chunks.
+	uint8_t *memory;
+	/// Statistics, including the size of `memory`.
+	MicroviumArenaStatistics statistics;
+};
+
+namespace
+{
+	/**
+	 * Header of each chunk in an arena.  Adjacent free chunks are merged
+	 * lazily, when an allocation walks over them.
+	 */
+	struct Chunk
+	{
+		/// The size of the chunk, including this header.
+		uint32_t size;
+		/// Non-zero if the chunk is allocated.
+		uint32_t inUse;
+	};
+
+	/**
+	 * Allocations are aligned to capabilities, which is also the size of the
+	 * header.
+	 */
+	constexpr size_t Alignment = sizeof(void *);
+	static_assert(sizeof(Chunk) == Alignment);
+
+	/**
+	 * Round `value` up to a multiple of `Alignment`.
+	 */
+	constexpr size_t align_up(size_t value)
+	{
+		return (value + Alignment - 1) & ~(Alignment - 1);
+	}
+
+	/**
+	 * Returns the arena that `context` refers to, or null if it is not an
+	 * arena (for example, if it is a sealed allocator capability).
+	 */
+	MicroviumArena *arena_for_context(void *context)
+	{
+		Capability arena{static_cast<MicroviumArena *>(context)};
+		if (!arena.is_valid() || arena.is_sealed() ||
+		    (arena.bounds() < sizeof(MicroviumArena)))
+		{
+			return nullptr;
+		}
+		return arena.get();
+	}
+
+	/**
+	 * Returns the chunk at `offset` bytes into the arena's memory.
+	 */
+	Chunk *chunk_at(MicroviumArena *arena, size_t offset)
+	{
+		return reinterpret_cast<Chunk *>(arena->memory + offset);
+	}
+
+	/**
+	 * Allocate `size` bytes from `arena`.  The result has exact bounds.
+	 * Allocations whose bounds would need more than `Alignment` alignment to
+	 * be exact are not supported; Microvium's blocks are far smaller.
+	 */
+	void *arena_allocate(MicroviumArena *arena, size_t size)
+	{
+		auto  &statistics = arena->statistics;
+		size_t length     = representable_length(size);
+		size_t needed     = sizeof(Chunk) + align_up(length);
+		if ((~representable_alignment_mask(length) >= Alignment) ||
+		    (needed > statistics.capacity))
+		{
+			statistics.failedAllocations++;
+			return nullptr;
+		}
+		for (size_t offset = 0; offset < statistics.capacity;)
+		{
+			Chunk *chunk = chunk_at(arena, offset);
+			if (chunk->inUse)
+			{
+				offset += chunk->size;
+				continue;
+			}
+			// Merge any free chunks that follow this one.
+			for (size_t next = offset + chunk->size;
+			     (next < statistics.capacity) && !chunk_at(arena, next)->inUse;
+			     next = offset + chunk->size)
+			{
+				chunk->size += chunk_at(arena, next)->size;
+			}
+			if (chunk->size < needed)
+			{
+				offset += chunk->size;
+				continue;
+			}
+			// Split the chunk if the remainder can hold an allocation.
+			if (chunk->size - needed >= 2 * sizeof(Chunk))
+			{
+				Chunk *rest = chunk_at(arena, offset + needed);
+				rest->size  = chunk->size - needed;
+				rest->inUse = 0;
+				chunk->size = needed;
+			}
+			chunk->inUse = 1;
+			statistics.allocations++;
+			statistics.used += chunk->size;
+			if (statistics.used > statistics.peakUsed)
+			{
+				statistics.peakUsed = statistics.used;
+			}
+			Capability<void> allocation{chunk + 1};
+			allocation.bounds() = length;
+			return allocation.get();
+		}
+		statistics.failedAllocations++;
+		return nullptr;
+	}
+
+	/**
+	 * Free an allocation returned by `arena_allocate`.  Anything else is
+	 * ignored.
+	 */
+	void arena_free(MicroviumArena *arena, void *pointer)
+	{
+		Capability<void> allocation{pointer};
+		ptraddr_t        start   = Capability{arena->memory}.address();
+		ptraddr_t        address = allocation.address();
+		if (!allocation.is_valid() || (allocation.base() != address) ||
+		    (address < start + sizeof(Chunk)) ||
+		    (address >= start + arena->statistics.capacity))
+		{
+			return;
+		}
+		Chunk *chunk = chunk_at(arena, address - start - sizeof(Chunk));
+		if (!chunk->inUse)
+		{
+			return;
+		}
+		chunk->inUse = 0;
+		arena->statistics.frees++;
+		arena->statistics.used -= chunk->size;
+	}
+} // namespace
+
+void *microvium_context_allocate(size_t size, void *context)
+{
+	if (MicroviumArena *arena = arena_for_context(context))
+	{
+		return arena_allocate(arena, size);
+	}
+	Timeout t   = {0, MALLOC_WAIT_TICKS};
+	void   *ret = heap_allocate(&t,
+	                            static_cast<AllocatorCapability>(context),
+	                            size,
+	                            AllocateWaitRevocationNeeded);
+	return Capability{ret}.is_valid() ? ret : nullptr;
+}
+
+void microvium_context_free(void *pointer, void *context)
+{
+	if (pointer == nullptr)
+	{
+		return;
+	}
+	if (MicroviumArena *arena = arena_for_context(context))
+	{
+		arena_free(arena, pointer);
+		return;
+	}
+	heap_free(static_cast<AllocatorCapability>(context), pointer);
+}
+
+MicroviumArena *microvium_arena_create(void *buffer, size_t size)
+{
+	Capability<void> cap{buffer};
+	if (!cap.is_valid() || cap.is_sealed() || !(cap.bounds() >= size) ||
+	    !cap.permissions().contains(Permission::Store,
+	                                Permission::LoadStoreCapability))
+	{
+		return nullptr;
+	}
+	// Align the arena state and the chunks after it.
+	size_t skip   = align_up(cap.address()) - cap.address();
+	size_t header = skip + align_up(sizeof(MicroviumArena));
+	if (size < header + 2 * sizeof(Chunk))
+	{
+		return nullptr;
+	}
+	size_t capacity = (size - header) & ~(Alignment - 1);
+	auto  *bytes    = static_cast<uint8_t *>(buffer);
+	Capability<MicroviumArena> arena{
+	  reinterpret_cast<MicroviumArena *>(bytes + skip)};
+	arena.bounds() = sizeof(MicroviumArena);
+	Capability<uint8_t> memory{bytes + header};
+	memory.bounds()            = capacity;
+	arena->memory              = memory.get();
+	arena->statistics.capacity = capacity;
+	microvium_arena_reset(arena.get());
+	return arena.get();
+}
+
+void microvium_arena_reset(MicroviumArena *arena)
+{
+	size_t capacity            = arena->statistics.capacity;
+	arena->statistics          = {};
+	arena->statistics.capacity = capacity;
+	Chunk *first               = chunk_at(arena, 0);
+	first->size                = capacity;
+	first->inUse               = 0;
+}
+
+int microvium_statistics(mvm_VM *vm, MicroviumArenaStatistics *statistics)
+{
+	MicroviumArena *arena = arena_for_context(mvm_getContext(vm));
+	if (arena == nullptr)
+	{
+		return -EINVAL;
+	}
+	*statistics = arena->statistics;
+	return 0;
+}
+
+size_t microvium_collect(mvm_VM *vm, bool squeeze)
+{
+	mvm_TsMemoryStats before;
+	mvm_TsMemoryStats after;
+	mvm_getMemoryStats(vm, &before);
+	mvm_runGC(vm, squeeze);
+	mvm_getMemoryStats(vm, &after);
+	size_t reclaimed = (before.virtualHeapUsed > after.virtualHeapUsed)
+	                     ? before.virtualHeapUsed - after.virtualHeapUsed
+	                     : 0;
+	if (MicroviumArena *arena = arena_for_context(mvm_getContext(vm)))
+	{
+		arena->statistics.collections++;
+		arena->statistics.bytesReclaimed += reclaimed;
+		arena->statistics.liveAfterLastCollection = after.virtualHeapUsed;
+	}
+	return reclaimed;
+}
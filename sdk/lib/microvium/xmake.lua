@@ -6,6 +6,6 @@ includes("../freestanding", "../string")
 library("microvium")
   set_default(false)
   add_deps("freestanding", "string")
-  add_files("../../third_party/microvium/dist-c/microvium.c")
+  add_files("../../third_party/microvium/dist-c/microvium.c", "arena.cc")
   add_includedirs("../../include/microvium", ".")
   add_defines("CHERIOT_NO_AMBIENT_MALLOC")
@@ -0,0 +1,256 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheri.hh>
+#include <debug.hh>
+#include <errno.h>
+#include <limits>
+#include <locks.h>
+#include <pubsub.h>
+#include <queue.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <timeout.h>
+
+using namespace CHERI;
+
+using Debug = ConditionalDebug<false, "Publish-subscribe library">;
+
+namespace
+{
+	/**
+	 * RAII helper that holds the lock on a bus.
+	 */
+	class BusLock
+	{
+		/// The locked bus, or null if the lock was not acquired.
+		PubSubBus *bus;
+
+		public:
+		/// Try to lock `lockedBus` before `timeout` expires.
+		BusLock(Timeout *timeout, PubSubBus *lockedBus)
+		  : bus(flaglock_trylock(timeout, &lockedBus->lock) == 0 ? lockedBus
+		                                                         : nullptr)
+		{
+		}
+
+		/// Release the lock if it was acquired.
+		~BusLock()
+		{
+			if (bus != nullptr)
+			{
+				flaglock_unlock(&bus->lock);
+			}
+		}
+
+		/// Returns true if the lock was acquired.
+		explicit operator bool() const
+		{
+			return bus != nullptr;
+		}
+	};
+
+	/**
+	 * Release every message still waiting in `subscription`'s queue.
+	 */
+	void drain(PubSubSubscription *subscription)
+	{
+		Timeout     noWait{0};
+		const void *message;
+		while (queue_receive(&noWait, subscription->queue, &message) == 0)
+		{
+			heap_free(subscription->heap, const_cast<void *>(message));
+		}
+	}
+} // namespace
+
+int pubsub_create(Timeout    *timeout,
+                  SObjStruct *heapCapability,
+                  PubSubBus **outBus,
+                  size_t      maxSubscribers)
+{
+	if ((maxSubscribers == 0) ||
+	    (maxSubscribers > std::numeric_limits<uint16_t>::max()))
+	{
+		return -EINVAL;
+	}
+	size_t size =
+	  sizeof(PubSubBus) + maxSubscribers * sizeof(PubSubSubscription *);
+	// The allocator zeroes memory, so the lock is unlocked and the bus has no
+	// subscribers.
+	auto *bus =
+	  static_cast<PubSubBus *>(heap_allocate(timeout, heapCapability, size));
+	if (!Capability{bus}.is_valid())
+	{
+		return -ENOMEM;
+	}
+	bus->capacity = maxSubscribers;
+	*outBus       = bus;
+	return 0;
+}
+
+int pubsub_destroy(SObjStruct *heapCapability, PubSubBus *bus)
+{
+	if (bus->count != 0)
+	{
+		return -EBUSY;
+	}
+	return heap_free(heapCapability, bus);
+}
+
+int pubsub_subscribe(Timeout             *timeout,
+                     SObjStruct          *heapCapability,
+                     PubSubBus           *bus,
+                     PubSubSubscription **outSubscription,
+                     size_t               queueLength)
+{
+	if (queueLength == 0)
+	{
+		return -EINVAL;
+	}
+	auto *subscription = static_cast<PubSubSubscription *>(
+	  heap_allocate(timeout, heapCapability, sizeof(PubSubSubscription)));
+	if (!Capability{subscription}.is_valid())
+	{
+		return -ENOMEM;
+	}
+	int ret = queue_create(timeout,
+	                       heapCapability,
+	                       &subscription->queue,
+	                       sizeof(void *),
+	                       queueLength);
+	if (ret != 0)
+	{
+		heap_free(heapCapability, subscription);
+		return ret;
+	}
+	subscription->heap = heapCapability;
+	{
+		BusLock g{timeout, bus};
+		if (!g)
+		{
+			ret = -ETIMEDOUT;
+		}
+		else if (bus->count == bus->capacity)
+		{
+			ret = -ENOSPC;
+		}
+		else
+		{
+			bus->subscriptions[bus->count++] = subscription;
+			*outSubscription                 = subscription;
+			return 0;
+		}
+	}
+	queue_destroy(heapCapability, subscription->queue);
+	heap_free(heapCapability, subscription);
+	return ret;
+}
+
+int pubsub_unsubscribe(Timeout            *timeout,
+                       SObjStruct         *heapCapability,
+                       PubSubBus          *bus,
+                       PubSubSubscription *subscription)
+{
+	{
+		BusLock g{timeout, bus};
+		if (!g)
+		{
+			return -ETIMEDOUT;
+		}
+		uint16_t i = 0;
+		while ((i < bus->count) && (bus->subscriptions[i] != subscription))
+		{
+			i++;
+		}
+		if (i == bus->count)
+		{
+			return -ENOENT;
+		}
+		// Order does not matter, so move the last subscription into the gap.
+		bus->subscriptions[i]          = bus->subscriptions[--bus->count];
+		bus->subscriptions[bus->count] = nullptr;
+	}
+	// Publishers no longer see this subscription, so nothing else can be
+	// added to its queue.
+	drain(subscription);
+	queue_destroy(heapCapability, subscription->queue);
+	return heap_free(heapCapability, subscription);
+}
+
+int pubsub_publish_allocated(Timeout    *timeout,
+                             SObjStruct *heapCapability,
+                             PubSubBus  *bus,
+                             void       *message)
+{
+	Capability<void> writable{message};
+	if (!writable.is_valid())
+	{
+		return -EINVAL;
+	}
+	// Subscribers get a view that they can neither modify nor capture.
+	Capability<const void> view{message};
+	view.permissions() &= PermissionSet{Permission::Load, Permission::Global};
+	int delivered = 0;
+	{
+		BusLock g{timeout, bus};
+		if (!g)
+		{
+			heap_free(heapCapability, message);
+			return -ETIMEDOUT;
+		}
+		for (uint16_t i = 0; i < bus->count; i++)
+		{
+			PubSubSubscription *subscription = bus->subscriptions[i];
+			// Charge this subscriber's quota for its reference before it can
+			// see the message, so that the publisher's free below does not
+			// release it.
+			if (heap_claim(subscription->heap, message) <= 0)
+			{
+				Debug::log("Failed to claim message for {}", subscription);
+				subscription->dropped++;
+				continue;
+			}
+			const void *pointer = view;
+			if (queue_send(timeout, subscription->queue, &pointer) != 0)
+			{
+				heap_free(subscription->heap, message);
+				subscription->dropped++;
+				continue;
+			}
+			delivered++;
+		}
+	}
+	// Drop the publisher's reference.  If no subscriber received the message,
+	// this frees it.
+	heap_free(heapCapability, message);
+	return delivered;
+}
+
+int pubsub_publish(Timeout    *timeout,
+                   SObjStruct *heapCapability,
+                   PubSubBus  *bus,
+                   const void *data,
+                   size_t      length)
+{
+	void *message = heap_allocate(timeout, heapCapability, length);
+	if (!Capability{message}.is_valid())
+	{
+		return -ENOMEM;
+	}
+	memcpy(message, data, length);
+	return pubsub_publish_allocated(timeout, heapCapability, bus, message);
+}
+
+int pubsub_receive(Timeout            *timeout,
+                   PubSubSubscription *subscription,
+                   const void        **message)
+{
+	return queue_receive(timeout, subscription->queue, message);
+}
+
+int pubsub_release(PubSubSubscription *subscription, const void *message)
+{
+	return heap_free(subscription->heap, const_cast<void *>(message));
+}
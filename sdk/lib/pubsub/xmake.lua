@@ -0,0 +1,9 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../queue")
+
+library("pubsub")
+  set_default(false)
+  add_deps("locks", "message_queue_library")
+  add_files("pubsub.cc")
@@ -1,8 +1,11 @@
+#include <algorithm>
+#include <bit>
 #include <cheri.hh>
 #include <cstdlib>
 #include <errno.h>
 #include <locks.hh>
 #include <queue.h>
+#include <riscvreg.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <timeout.h>
@@ -208,19 +211,94 @@ namespace
 
 	/**
 	 * Returns a pointer to the element in the queue indicated by `counter`.
+	 *
+	 * The elements are found in `ring` if it is not null, or after the queue
+	 * header otherwise.  Views (see `MessageQueueView`) pass a separate
+	 * capability to the elements, because the header capability in a view
+	 * does not cover them.
 	 */
 	Capability<void> buffer_at_counter(struct MessageQueue &handle,
-	                                   uint32_t             counter)
+	                                   uint32_t             counter,
+	                                   Capability<void>     ring = nullptr)
 	{
 		// Handle wrap for the second run around the counter.
 		size_t index =
 		  counter >= handle.queueSize ? counter - handle.queueSize : counter;
-		auto             offset = index * handle.elementSize;
+		auto offset = index * handle.elementSize;
+		if (ring != nullptr)
+		{
+			ring.address() += offset;
+			return ring;
+		}
 		Capability<void> pointer{&handle};
 		pointer.address() += sizeof(MessageQueue) + offset;
 		return pointer;
 	}
 
+	/**
+	 * Helper for advancing a counter by `count` elements, wrapping at double
+	 * `size`.  `count` must not be larger than `size`.
+	 */
+	constexpr uint32_t
+	add_and_wrap(uint32_t size, uint32_t counter, uint32_t count)
+	{
+		counter += count;
+		if (counter >= 2 * size)
+		{
+			return counter - (2 * size);
+		}
+		return counter;
+	}
+
+	static_assert(add_and_wrap(4, 6, 2) == 0, "add-and-wrap is incorrect");
+	static_assert(add_and_wrap(4, 7, 3) == 2, "add-and-wrap is incorrect");
+	static_assert(add_and_wrap(4, 3, 4) == 7, "add-and-wrap is incorrect");
+
+	/**
+	 * Copy `count` elements between the queue, starting at the element
+	 * indicated by `counter`, and the contiguous buffer `elements`.  Copies
+	 * into the queue if `toQueue` is true, out of it otherwise.  The copy is
+	 * split into at most two `memcpy` calls, one on either side of the point
+	 * where the ring buffer wraps.  `ring` is passed to `buffer_at_counter`.
+	 */
+	void copy_elements(struct MessageQueue &handle,
+	                   uint32_t             counter,
+	                   uint32_t             count,
+	                   Capability<void>     elements,
+	                   bool                 toQueue,
+	                   Capability<void>     ring = nullptr)
+	{
+		size_t index =
+		  counter >= handle.queueSize ? counter - handle.queueSize : counter;
+		size_t beforeWrap =
+		  std::min<size_t>(count, handle.queueSize - index);
+		size_t sizes[] = {beforeWrap * handle.elementSize,
+		                  (count - beforeWrap) * handle.elementSize};
+		Capability<void> entries[] = {
+		  buffer_at_counter(handle, counter, ring),
+		  buffer_at_counter(handle, 0, ring)};
+		for (int i = 0; i < 2; i++)
+		{
+			if (sizes[i] == 0)
+			{
+				continue;
+			}
+			Debug::log("Copying {} bytes {} {}",
+			           sizes[i],
+			           toQueue ? "into" : "out of",
+			           entries[i]);
+			if (toQueue)
+			{
+				memcpy(entries[i], elements, sizes[i]);
+			}
+			else
+			{
+				memcpy(elements, entries[i], sizes[i]);
+			}
+			elements.address() += sizes[i];
+		}
+	}
+
 	/**
 	 * Flag lock that uses the two high bits of a word for the lock.
 	 *
@@ -241,6 +319,14 @@ namespace
 		static constexpr uint32_t WaitersBit              = 1U << 30;
 		static constexpr uint32_t LockedInDestructModeBit = 1U << 29;
 
+		/**
+		 * Bit set in both counters of a queue created with
+		 * `queue_create_wake_one` or `queue_create_sealed_wake_one`.  It is
+		 * never cleared.  Releasing a lock with this bit set wakes only one
+		 * waiter instead of all of them.
+		 */
+		static constexpr uint32_t WakeOneBit = 1U << 27;
+
 		// Function required to conform to the Lock concept.
 		void lock()
 		{
@@ -249,7 +335,7 @@ namespace
 
 		static constexpr uint32_t reserved_bits()
 		{
-			return LockBit | WaitersBit | LockedInDestructModeBit;
+			return LockBit | WaitersBit | LockedInDestructModeBit | WakeOneBit;
 		}
 
 		/**
@@ -296,10 +382,27 @@ namespace
 			uint32_t value;
 			// Clear the lock bit.
 			value = lockWord.load();
-			// If we're releasing the lock with waiters, wake them up.
-			if (lockWord.exchange(value & ~LockBit) & WaitersBit)
+			// If we're releasing the lock with waiters, wake them up.  The
+			// waiters bit is not cleared, so with the wake-one policy the
+			// next release wakes the next waiter.
+			//
+			// Threads that wait on this word for the counter to change, rather
+			// than for the lock, may take the single wake.  That loses
+			// nothing: they wait only while the queue is full (for the consumer
+			// counter) or empty (for the producer counter), and the operation
+			// that changes that state wakes all waiters after releasing the
+			// lock.
+			uint32_t old = lockWord.exchange(value & ~LockBit);
+			if (old & WaitersBit)
 			{
-				lockWord.notify_all();
+				if (old & WakeOneBit)
+				{
+					lockWord.notify_one();
+				}
+				else
+				{
+					lockWord.notify_all();
+				}
 			}
 		}
 
@@ -318,9 +421,37 @@ namespace
 		}
 	};
 
+	/**
+	 * Bit set in both counters of a queue created with
+	 * `queue_create_single_producer_consumer`.  These queues do not use the
+	 * locks: the producer is the only writer of the producer counter and the
+	 * consumer the only writer of the consumer counter.
+	 */
+	constexpr uint32_t SingleProducerConsumerBit = 1U << 28;
+
+	/**
+	 * Bit set in both counters of a queue that collects statistics (see
+	 * `queue_statistics_init`).
+	 */
+	constexpr uint32_t StatisticsBit = 1U << 26;
+
+	/**
+	 * The bits of a counter word that do not hold the counter value.
+	 */
+	constexpr uint32_t CounterReservedBits = HighBitFlagLock::reserved_bits() |
+	                                         SingleProducerConsumerBit |
+	                                         StatisticsBit;
+
+	/**
+	 * The bits of a counter word that record how the queue was created.
+	 * These are never cleared.
+	 */
+	constexpr uint32_t CounterModeBits =
+	  SingleProducerConsumerBit | HighBitFlagLock::WakeOneBit | StatisticsBit;
+
 	uint32_t counter_load(std::atomic<uint32_t> *counter)
 	{
-		return counter->load() & ~(HighBitFlagLock::reserved_bits());
+		return counter->load() & ~CounterReservedBits;
 	}
 
 	void counter_store(std::atomic<uint32_t> *counter, uint32_t value)
@@ -330,7 +461,277 @@ namespace
 		{
 			old = counter->load();
 		} while (!counter->compare_exchange_strong(
-		  old, (old & HighBitFlagLock::reserved_bits()) | value));
+		  old, (old & CounterReservedBits) | value));
+	}
+
+	/**
+	 * Returns true if `handle` was created for a single producer and a single
+	 * consumer.  The mode bit is never cleared, so this needs no ordering.
+	 */
+	bool is_single_producer_consumer(struct MessageQueue &handle)
+	{
+		return handle.producer.load(std::memory_order_relaxed) &
+		       SingleProducerConsumerBit;
+	}
+
+	/**
+	 * Statistics are kept after the elements, followed by the time at which
+	 * each slot was filled.  Each field is written by only one end of the
+	 * queue: the producer updates the send counts, the maximum occupancy and
+	 * the timestamps, the consumer everything else.  Both ends already
+	 * serialise on their own lock (or are a single thread), so the
+	 * statistics need no synchronisation of their own.  Operations through a
+	 * `MessageQueueView` are not counted, because a view cannot reach the
+	 * statistics.
+	 */
+
+	/**
+	 * Returns the offset of the statistics from the start of a queue with
+	 * `elementCount` elements of `elementSize` bytes.
+	 */
+	constexpr size_t statistics_offset(size_t elementSize, size_t elementCount)
+	{
+		return __builtin_align_up(sizeof(MessageQueue) +
+		                            (elementSize * elementCount),
+		                          sizeof(void *));
+	}
+
+	/**
+	 * Returns the statistics for `handle`, or null if it does not collect
+	 * them.  The mode bit is never cleared, so this needs no ordering.
+	 */
+	MessageQueueStatistics *statistics_get(struct MessageQueue &handle)
+	{
+		if (!(handle.producer.load(std::memory_order_relaxed) & StatisticsBit))
+		{
+			return nullptr;
+		}
+		Capability<void> pointer{&handle};
+		pointer.address() +=
+		  statistics_offset(handle.elementSize, handle.queueSize);
+		return static_cast<MessageQueueStatistics *>(
+		  static_cast<void *>(pointer));
+	}
+
+	/**
+	 * Returns the timestamp for the element indicated by `counter`.
+	 */
+	uint32_t *statistics_timestamp(struct MessageQueue    &handle,
+	                               MessageQueueStatistics *statistics,
+	                               uint32_t                counter)
+	{
+		size_t index =
+		  counter >= handle.queueSize ? counter - handle.queueSize : counter;
+		return reinterpret_cast<uint32_t *>(statistics + 1) + index;
+	}
+
+	/**
+	 * Record that a send (if `Send` is true) or receive had to wait for the
+	 * queue to become non-full or non-empty.
+	 */
+	template<bool Send>
+	void statistics_blocked(struct MessageQueue &handle)
+	{
+		if (auto *statistics = statistics_get(handle))
+		{
+			(Send ? statistics->blockedSends : statistics->blockedReceives)++;
+		}
+	}
+
+	/**
+	 * Record that the producer has filled `count` elements, starting at
+	 * `producerCounter`, when the consumer counter was `consumerCounter`.
+	 */
+	void statistics_enqueued(struct MessageQueue &handle,
+	                         uint32_t             producerCounter,
+	                         uint32_t             count,
+	                         uint32_t             consumerCounter)
+	{
+		auto *statistics = statistics_get(handle);
+		if (statistics == nullptr)
+		{
+			return;
+		}
+		auto now = static_cast<uint32_t>(rdcycle64());
+		for (uint32_t i = 0; i < count; i++)
+		{
+			*statistics_timestamp(handle, statistics, producerCounter) = now;
+			producerCounter =
+			  increment_and_wrap(handle.queueSize, producerCounter);
+		}
+		statistics->sends += count;
+		statistics->maxOccupancy = std::max(
+		  statistics->maxOccupancy,
+		  items_remaining(handle.queueSize, producerCounter, consumerCounter));
+	}
+
+	/**
+	 * Record that the consumer has emptied `count` elements, starting at
+	 * `consumerCounter`.
+	 */
+	void statistics_dequeued(struct MessageQueue &handle,
+	                         uint32_t             consumerCounter,
+	                         uint32_t             count)
+	{
+		auto *statistics = statistics_get(handle);
+		if (statistics == nullptr)
+		{
+			return;
+		}
+		auto now = static_cast<uint32_t>(rdcycle64());
+		for (uint32_t i = 0; i < count; i++)
+		{
+			uint32_t latency =
+			  now - *statistics_timestamp(handle, statistics, consumerCounter);
+			size_t bucket = latency < 256 ? 0 : std::bit_width(latency) - 8;
+			bucket =
+			  std::min<size_t>(bucket, QUEUE_STATISTICS_HISTOGRAM_BUCKETS - 1);
+			statistics->timeInQueueHistogram[bucket]++;
+			statistics->maxTimeInQueue =
+			  std::max(statistics->maxTimeInQueue, latency);
+			consumerCounter =
+			  increment_and_wrap(handle.queueSize, consumerCounter);
+		}
+		statistics->receives += count;
+	}
+
+	/**
+	 * Send (if `Send` is true) or receive up to `count` elements on a queue
+	 * with a single producer and a single consumer, copying them from or to
+	 * `buffer`.  The calling thread is the only writer of its own counter, so
+	 * this needs no lock: it reads the other end's counter with acquire
+	 * semantics, copies, and then publishes its own counter with release
+	 * semantics.  It waits on the futex only if the queue is full (for send)
+	 * or empty (for receive) and wakes the other end only if the queue was
+	 * empty (for send) or full (for receive) before this call.
+	 *
+	 * Returns the number of elements moved, or a negative error code.
+	 * `ring` is passed to `buffer_at_counter`.
+	 */
+	template<bool Send>
+	ssize_t single_producer_consumer_transfer(Timeout             *timeout,
+	                                          struct MessageQueue *handle,
+	                                          Capability<void>     buffer,
+	                                          size_t               count,
+	                                          Capability<void> ring = nullptr)
+	{
+		auto *own   = Send ? &handle->producer : &handle->consumer;
+		auto *other = Send ? &handle->consumer : &handle->producer;
+		volatile ssize_t ret        = 0;
+		bool             shouldWake = false;
+		on_error(
+		  [&] {
+			  uint32_t ownValue   = own->load(std::memory_order_relaxed);
+			  uint32_t ownCounter = ownValue & ~CounterReservedBits;
+			  uint32_t size       = handle->queueSize;
+			  // Free space for the producer, items for the consumer.
+			  auto available = [&](uint32_t otherCounter) {
+				  return Send ? size - items_remaining(
+				                         size, ownCounter, otherCounter)
+				              : items_remaining(size, otherCounter, ownCounter);
+			  };
+			  uint32_t otherValue = other->load(std::memory_order_acquire);
+			  if (available(otherValue & ~CounterReservedBits) == 0)
+			  {
+				  statistics_blocked<Send>(*handle);
+			  }
+			  while (available(otherValue & ~CounterReservedBits) == 0)
+			  {
+				  if ((otherValue & HighBitFlagLock::LockedInDestructModeBit) ||
+				      (other->wait(timeout, otherValue) == -ETIMEDOUT))
+				  {
+					  ret = -ETIMEDOUT;
+					  return;
+				  }
+				  otherValue = other->load(std::memory_order_acquire);
+			  }
+			  uint32_t moved = std::min<size_t>(
+			    count, available(otherValue & ~CounterReservedBits));
+			  copy_elements(
+			    *handle, ownCounter, moved, buffer, Send, ring);
+			  if (ring == nullptr)
+			  {
+				  if constexpr (Send)
+				  {
+					  statistics_enqueued(*handle,
+					                      ownCounter,
+					                      moved,
+					                      otherValue & ~CounterReservedBits);
+				  }
+				  else
+				  {
+					  statistics_dequeued(*handle, ownCounter, moved);
+				  }
+			  }
+			  own->store((ownValue & CounterReservedBits) |
+			               add_and_wrap(size, ownCounter, moved),
+			             std::memory_order_release);
+			  // The other end may have seen the old counter and be about to
+			  // wait.  Order the reload after the store so that we either see
+			  // it move or it sees our update.
+			  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+			  uint32_t otherCounter = counter_load(other);
+			  shouldWake = Send ? is_empty(ownCounter, otherCounter)
+			                    : is_full(size, otherCounter, ownCounter);
+			  ret        = moved;
+		  },
+		  [&]() {
+			  ret = -EPERM;
+			  Debug::log("Error in single-producer, single-consumer transfer");
+		  });
+		if (shouldWake)
+		{
+			own->notify_all();
+		}
+		return ret;
+	}
+
+	/**
+	 * Permissions for a slot returned by `queue_send_reserve`.  There is no
+	 * global permission, so the caller cannot capture the slot.
+	 */
+	constexpr PermissionSet ReservedSlotPermissions{
+	  Permission::Load,
+	  Permission::Store,
+	  Permission::LoadStoreCapability,
+	  Permission::LoadMutable,
+	  Permission::LoadGlobal};
+
+	/**
+	 * Permissions for a slot returned by `queue_receive_peek`: as for a
+	 * reserved slot, without store.
+	 */
+	constexpr PermissionSet PeekedSlotPermissions =
+	  ReservedSlotPermissions.without(Permission::Store);
+
+	/**
+	 * Returns a capability to just the element indicated by `counter`, with
+	 * `permissions`, or null if the element cannot be given exact bounds.
+	 */
+	Capability<void> slot_at_counter(struct MessageQueue &handle,
+	                                 uint32_t             counter,
+	                                 PermissionSet        permissions)
+	{
+		auto slot = buffer_at_counter(handle, counter);
+		slot.bounds() = handle.elementSize;
+		slot.permissions() &= permissions;
+		if (slot.length() != handle.elementSize)
+		{
+			return nullptr;
+		}
+		return slot;
+	}
+
+	/**
+	 * Returns true if `slot` refers to the start of the element indicated by
+	 * `counter`.
+	 */
+	bool is_slot_at_counter(struct MessageQueue &handle,
+	                        const void          *slot,
+	                        uint32_t             counter)
+	{
+		return Capability{slot}.address() ==
+		       buffer_at_counter(handle, counter).address();
 	}
 
 } // namespace
@@ -354,6 +755,14 @@ int queue_destroy(struct SObjStruct   *heapCapability,
 	HighBitFlagLock consumerLock{handle->consumer};
 	consumerLock.upgrade_for_destruction();
 
+	// Threads waiting on a single-producer, single-consumer queue do not set
+	// the waiters bit, so wake them explicitly.
+	if (is_single_producer_consumer(*handle))
+	{
+		handle->producer.notify_all();
+		handle->consumer.notify_all();
+	}
+
 	// This should not fail because of the `heap_can_free` check, unless we
 	// run out of stack.
 	if (ret = heap_free(heapCapability, handle); ret != 0)
@@ -381,10 +790,9 @@ ssize_t queue_allocation_size(size_t elementSize, size_t elementCount)
 	// We need the counters to be able to run to double the queue size without
 	// hitting the high bits.  Error if this is the case.
 	//
-	// This should never be reached: a queue needs to be at least 256 MiB
+	// This should never be reached: a queue needs to be at least 32 MiB
 	// (assuming one-byte elements) to hit this limit.
-	if (((elementCount | (elementCount * 2)) &
-	     HighBitFlagLock::reserved_bits()) != 0)
+	if (((elementCount | (elementCount * 2)) & CounterReservedBits) != 0)
 	{
 		return -EINVAL;
 	}
@@ -415,193 +823,764 @@ int queue_create(Timeout              *timeout,
 	return 0;
 }
 
-int queue_send(Timeout *timeout, struct MessageQueue *handle, const void *src)
+int queue_create_single_producer_consumer(Timeout              *timeout,
+                                          struct SObjStruct    *heapCapability,
+                                          struct MessageQueue **outQueue,
+                                          size_t                elementSize,
+                                          size_t                elementCount)
 {
-	Debug::log("Send called on: {}", handle);
-	auto *producer   = &handle->producer;
-	auto *consumer   = &handle->consumer;
-	bool  shouldWake = false;
+	int ret = queue_create(
+	  timeout, heapCapability, outQueue, elementSize, elementCount);
+	if (ret == 0)
 	{
-		Debug::log("Lock word: {}", producer->load());
-		HighBitFlagLock l{*producer};
-		if (LockGuard g{l, timeout})
-		{
-			volatile int ret = 0;
-			// In an error-handling context, try to add the element to the
-			// queue.  If the permissions on src are invalid, or either `handle`
-			// or `src` is freed concurrently, we will hit the path that returns
-			// -EPERM.  The counter update happens last, so any failure will
-			// simply leave the queue in the old state.
-			on_error(
-			  [&] {
-				  uint32_t producerCounter = counter_load(producer);
-				  uint32_t consumerValue   = consumer->load();
-				  uint32_t consumerCounter =
-				    consumerValue & ~(HighBitFlagLock::reserved_bits());
-				  Debug::log(
-				    "Producer counter: {}, consumer counter: {}, Size: {}",
-				    producerCounter,
-				    consumerCounter,
-				    handle->queueSize);
-				  while (is_full(
-				    handle->queueSize, producerCounter, consumerCounter))
-				  {
-					  // Wait on the value to change.  If we hit this path while
-					  // the consumer lock is held, then the high bits will be
-					  // set.  Make sure that we yield.
-					  if (consumer->wait(timeout, consumerValue) == -ETIMEDOUT)
-					  {
-						  Debug::log("Timed out on futex");
-						  ret = -ETIMEDOUT;
-						  return;
-					  }
-					  consumerValue = consumer->load();
-					  consumerCounter =
-					    consumerValue & ~(HighBitFlagLock::reserved_bits());
-				  }
-				  auto entry = buffer_at_counter(*handle, producerCounter);
-				  Debug::log("Send copying {} bytes from {} to {}",
-				             handle->elementSize,
-				             src,
-				             entry);
-				  memcpy(entry, src, handle->elementSize);
-				  counter_store(
-				    &handle->producer,
-				    increment_and_wrap(handle->queueSize, producerCounter));
-				  // Check if the queue was empty before we updated the producer
-				  // counter.  By the time that we reach this point, anything on
-				  // the consumer side will be on the path to a futex_wait with
-				  // the old version of the producer counter and so will bounce
-				  // out again.
-				  shouldWake =
-				    is_empty(producerCounter, counter_load(consumer));
-			  },
-			  [&]() {
-				  ret = -EPERM;
-				  Debug::log("Error in send");
-			  });
-			if (ret != 0)
-			{
-				return ret;
-			}
-		}
-		else
-		{
-			Debug::log("Timed out on lock");
-			return -ETIMEDOUT;
-		}
+		(*outQueue)->producer = SingleProducerConsumerBit;
+		(*outQueue)->consumer = SingleProducerConsumerBit;
 	}
-	if (shouldWake)
+	return ret;
+}
+
+int queue_create_wake_one(Timeout              *timeout,
+                          struct SObjStruct    *heapCapability,
+                          struct MessageQueue **outQueue,
+                          size_t                elementSize,
+                          size_t                elementCount)
+{
+	int ret = queue_create(
+	  timeout, heapCapability, outQueue, elementSize, elementCount);
+	if (ret == 0)
 	{
-		handle->producer.notify_all();
+		queue_wake_one_init(*outQueue);
 	}
-	return 0;
+	return ret;
 }
 
-int queue_receive(Timeout *timeout, struct MessageQueue *handle, void *dst)
+void queue_wake_one_init(struct MessageQueue *handle)
 {
-	Debug::log("Receive called on: {}", handle);
-	auto *producer   = &handle->producer;
-	auto *consumer   = &handle->consumer;
-	bool  shouldWake = false;
+	handle->producer |= HighBitFlagLock::WakeOneBit;
+	handle->consumer |= HighBitFlagLock::WakeOneBit;
+}
+
+ssize_t queue_statistics_allocation_size(size_t elementSize,
+                                         size_t elementCount)
+{
+	size_t  timestamps;
+	size_t  allocSize;
+	ssize_t queueSize = queue_allocation_size(elementSize, elementCount);
+	if (queueSize < 0)
 	{
-		HighBitFlagLock l{*consumer};
-		if (LockGuard g{l, timeout})
-		{
-			volatile int ret = 0;
-			// In an error-handling context, try to add the element to the
-			// queue.  If the permissions on `dst` are invalid, or either
-			// `handle` or `dst` is freed concurrently, we will hit the path
-			// that returns `-EPERM`.  The counter update happens last, so any
-			// failure will simply leave the queue in the old state.
-			on_error(
-			  [&] {
-				  uint32_t producerValue = producer->load();
-				  uint32_t producerCounter =
-				    producerValue & ~(HighBitFlagLock::reserved_bits());
-				  uint32_t consumerCounter = counter_load(consumer);
-				  Debug::log(
-				    "Producer counter: {}, consumer counter: {}, Size: {}",
-				    producerCounter,
-				    consumerCounter,
-				    handle->queueSize);
-				  while (is_empty(producerCounter, consumerCounter))
-				  {
-					  // Wait on the value to change.  If we hit this path while
-					  // the producer lock is held, then the high bits will be
-					  // set.  Make sure that we yield.
-					  if (producer->wait(timeout, producerValue) == -ETIMEDOUT)
-					  {
-						  ret = -ETIMEDOUT;
-						  return;
-					  }
-					  producerValue = producer->load();
-					  producerCounter =
-					    producerValue & ~(HighBitFlagLock::reserved_bits());
-				  }
-				  auto entry = buffer_at_counter(*handle, consumerCounter);
-				  Debug::log("Receive copying {} bytes from {} to {}",
-				             handle->elementSize,
-				             entry,
-				             dst);
-				  memcpy(dst, entry, handle->elementSize);
-				  counter_store(
-				    consumer,
-				    increment_and_wrap(handle->queueSize, consumerCounter));
-				  // Check if the queue was full before we updated the consumer
-				  // counter.  By the time that we reach this point, anything on
-				  // the producer side will be on the path to a futex_wait with
-				  // the old version of the consumer counter and so will bounce
-				  // out again.
-				  shouldWake = is_full(
-				    handle->queueSize, counter_load(producer), consumerCounter);
-			  },
-			  [&]() {
-				  ret = -EPERM;
-				  Debug::log("Error in receive");
-			  });
-			if (ret != 0)
-			{
-				return ret;
-			}
-		}
-		else
-		{
-			Debug::log("Timed out on lock");
-			return -ETIMEDOUT;
-		}
+		return queueSize;
 	}
-	// If the queue is concurrently freed, this can trap, but we won't leak any
-	// locks.
-	if (shouldWake)
+	// `queue_allocation_size` has checked that the elements fit, so this
+	// cannot overflow until the statistics are added.
+	bool overflow = __builtin_mul_overflow(
+	  elementCount, sizeof(uint32_t), &timestamps);
+	overflow |= __builtin_add_overflow(
+	  statistics_offset(elementSize, elementCount),
+	  sizeof(MessageQueueStatistics),
+	  &allocSize);
+	overflow |= __builtin_add_overflow(allocSize, timestamps, &allocSize);
+	if (overflow)
 	{
-		handle->consumer.notify_all();
+		return -EINVAL;
 	}
-	return 0;
+	return allocSize;
 }
 
-int queue_items_remaining(struct MessageQueue *handle, size_t *items)
+void queue_statistics_init(struct MessageQueue *handle)
 {
-	auto producerCounter = counter_load(&handle->producer);
-	auto consumerCounter = counter_load(&handle->consumer);
-	*items =
-	  items_remaining(handle->queueSize, producerCounter, consumerCounter);
-	Debug::log("Producer counter: {}, consumer counter: {}, items: {}",
-	           producerCounter,
-	           consumerCounter,
-	           *items);
-	return 0;
+	handle->producer |= StatisticsBit;
+	handle->consumer |= StatisticsBit;
+	*statistics_get(*handle) = {};
 }
 
-void multiwaiter_queue_send_init(struct EventWaiterSource *source,
-                                 struct MessageQueue      *handle)
+int queue_create_with_statistics(Timeout              *timeout,
+                                 struct SObjStruct    *heapCapability,
+                                 struct MessageQueue **outQueue,
+                                 size_t                elementSize,
+                                 size_t                elementCount)
 {
-	uint32_t producer   = counter_load(&handle->producer);
-	uint32_t consumer   = counter_load(&handle->consumer);
-	source->eventSource = &handle->consumer;
-	source->value =
-	  is_full(handle->queueSize, producer, consumer) ? consumer : -1;
-}
+	ssize_t allocSize =
+	  queue_statistics_allocation_size(elementSize, elementCount);
+	if (allocSize < 0)
+	{
+		return allocSize;
+	}
+
+	Capability buffer{heap_allocate(timeout, heapCapability, allocSize)};
+	if (!buffer.is_valid())
+	{
+		return -ENOMEM;
+	}
+
+	*outQueue = new (buffer.get()) MessageQueue(elementSize, elementCount);
+	queue_statistics_init(*outQueue);
+	return 0;
+}
+
+int queue_statistics(struct MessageQueue           *handle,
+                     struct MessageQueueStatistics *statistics)
+{
+	volatile int ret = 0;
+	on_error(
+	  [&] {
+		  auto *collected = statistics_get(*handle);
+		  if (collected == nullptr)
+		  {
+			  ret = -ENOTSUP;
+			  return;
+		  }
+		  *statistics = *collected;
+	  },
+	  [&]() { ret = -EPERM; });
+	return ret;
+}
+
+namespace
+{
+	/**
+	 * Send one element.  `ring` is passed to `buffer_at_counter`.
+	 */
+	int send(Timeout             *timeout,
+	         struct MessageQueue *handle,
+	         const void          *src,
+	         Capability<void>     ring = nullptr)
+	{
+		Debug::log("Send called on: {}", handle);
+		if (is_single_producer_consumer(*handle))
+		{
+			ssize_t ret = single_producer_consumer_transfer<true>(
+			  timeout, handle, Capability{const_cast<void *>(src)}, 1, ring);
+			return ret < 0 ? ret : 0;
+		}
+		auto *producer   = &handle->producer;
+		auto *consumer   = &handle->consumer;
+		bool  shouldWake = false;
+		{
+			Debug::log("Lock word: {}", producer->load());
+			HighBitFlagLock l{*producer};
+			if (LockGuard g{l, timeout})
+			{
+				volatile int ret = 0;
+				// In an error-handling context, try to add the element to the
+				// queue.  If the permissions on src are invalid, or either
+				// `handle` or `src` is freed concurrently, we will hit the path
+				// that returns -EPERM.  The counter update happens last, so any
+				// failure will simply leave the queue in the old state.
+				on_error(
+				  [&] {
+					  uint32_t producerCounter = counter_load(producer);
+					  uint32_t consumerValue   = consumer->load();
+					  uint32_t consumerCounter =
+					    consumerValue & ~CounterReservedBits;
+					  Debug::log(
+					    "Producer counter: {}, consumer counter: {}, Size: {}",
+					    producerCounter,
+					    consumerCounter,
+					    handle->queueSize);
+					  if (is_full(handle->queueSize,
+					              producerCounter,
+					              consumerCounter))
+					  {
+						  statistics_blocked<true>(*handle);
+					  }
+					  while (is_full(
+					    handle->queueSize, producerCounter, consumerCounter))
+					  {
+						  // Wait on the value to change.  If we hit this path
+						  // while the consumer lock is held, then the high bits
+						  // will be set.  Make sure that we yield.
+						  if (consumer->wait(timeout, consumerValue) ==
+						      -ETIMEDOUT)
+						  {
+							  Debug::log("Timed out on futex");
+							  ret = -ETIMEDOUT;
+							  return;
+						  }
+						  consumerValue = consumer->load();
+						  consumerCounter =
+						    consumerValue & ~CounterReservedBits;
+					  }
+					  auto entry =
+					    buffer_at_counter(*handle, producerCounter, ring);
+					  Debug::log("Send copying {} bytes from {} to {}",
+					             handle->elementSize,
+					             src,
+					             entry);
+					  memcpy(entry, src, handle->elementSize);
+					  if (ring == nullptr)
+					  {
+						  statistics_enqueued(
+						    *handle, producerCounter, 1, consumerCounter);
+					  }
+					  counter_store(
+					    &handle->producer,
+					    increment_and_wrap(handle->queueSize, producerCounter));
+					  // Check if the queue was empty before we updated the
+					  // producer counter.  By the time that we reach this
+					  // point, anything on the consumer side will be on the
+					  // path to a futex_wait with the old version of the
+					  // producer counter and so will bounce out again.
+					  shouldWake =
+					    is_empty(producerCounter, counter_load(consumer));
+				  },
+				  [&]() {
+					  ret = -EPERM;
+					  Debug::log("Error in send");
+				  });
+				if (ret != 0)
+				{
+					return ret;
+				}
+			}
+			else
+			{
+				Debug::log("Timed out on lock");
+				return -ETIMEDOUT;
+			}
+		}
+		if (shouldWake)
+		{
+			handle->producer.notify_all();
+		}
+		return 0;
+	}
+
+	/**
+	 * Receive one element.  `ring` is passed to `buffer_at_counter`.
+	 */
+	int receive(Timeout             *timeout,
+	            struct MessageQueue *handle,
+	            void                *dst,
+	            Capability<void>     ring = nullptr)
+	{
+		Debug::log("Receive called on: {}", handle);
+		if (is_single_producer_consumer(*handle))
+		{
+			ssize_t ret = single_producer_consumer_transfer<false>(
+			  timeout, handle, Capability{dst}, 1, ring);
+			return ret < 0 ? ret : 0;
+		}
+		auto *producer   = &handle->producer;
+		auto *consumer   = &handle->consumer;
+		bool  shouldWake = false;
+		{
+			HighBitFlagLock l{*consumer};
+			if (LockGuard g{l, timeout})
+			{
+				volatile int ret = 0;
+				// In an error-handling context, try to add the element to the
+				// queue.  If the permissions on `dst` are invalid, or either
+				// `handle` or `dst` is freed concurrently, we will hit the path
+				// that returns `-EPERM`.  The counter update happens last, so
+				// any failure will simply leave the queue in the old state.
+				on_error(
+				  [&] {
+					  uint32_t producerValue = producer->load();
+					  uint32_t producerCounter =
+					    producerValue & ~CounterReservedBits;
+					  uint32_t consumerCounter = counter_load(consumer);
+					  Debug::log(
+					    "Producer counter: {}, consumer counter: {}, Size: {}",
+					    producerCounter,
+					    consumerCounter,
+					    handle->queueSize);
+					  if (is_empty(producerCounter, consumerCounter))
+					  {
+						  statistics_blocked<false>(*handle);
+					  }
+					  while (is_empty(producerCounter, consumerCounter))
+					  {
+						  // Wait on the value to change.  If we hit this path
+						  // while the producer lock is held, then the high bits
+						  // will be set.  Make sure that we yield.
+						  if (producer->wait(timeout, producerValue) ==
+						      -ETIMEDOUT)
+						  {
+							  ret = -ETIMEDOUT;
+							  return;
+						  }
+						  producerValue = producer->load();
+						  producerCounter =
+						    producerValue & ~CounterReservedBits;
+					  }
+					  auto entry =
+					    buffer_at_counter(*handle, consumerCounter, ring);
+					  Debug::log("Receive copying {} bytes from {} to {}",
+					             handle->elementSize,
+					             entry,
+					             dst);
+					  memcpy(dst, entry, handle->elementSize);
+					  if (ring == nullptr)
+					  {
+						  statistics_dequeued(*handle, consumerCounter, 1);
+					  }
+					  counter_store(
+					    consumer,
+					    increment_and_wrap(handle->queueSize, consumerCounter));
+					  // Check if the queue was full before we updated the
+					  // consumer counter.  By the time that we reach this
+					  // point, anything on the producer side will be on the
+					  // path to a futex_wait with the old version of the
+					  // consumer counter and so will bounce out again.
+					  shouldWake = is_full(handle->queueSize,
+					                       counter_load(producer),
+					                       consumerCounter);
+				  },
+				  [&]() {
+					  ret = -EPERM;
+					  Debug::log("Error in receive");
+				  });
+				if (ret != 0)
+				{
+					return ret;
+				}
+			}
+			else
+			{
+				Debug::log("Timed out on lock");
+				return -ETIMEDOUT;
+			}
+		}
+		// If the queue is concurrently freed, this can trap, but we won't leak
+		// any locks.
+		if (shouldWake)
+		{
+			handle->consumer.notify_all();
+		}
+		return 0;
+	}
+} // namespace
+
+int queue_send(Timeout *timeout, struct MessageQueue *handle, const void *src)
+{
+	return send(timeout, handle, src);
+}
+
+int queue_receive(Timeout *timeout, struct MessageQueue *handle, void *dst)
+{
+	return receive(timeout, handle, dst);
+}
+
+int queue_send_view(Timeout                       *timeout,
+                    const struct MessageQueueView *view,
+                    const void                    *src)
+{
+	return send(timeout, view->queue, src, view->buffer);
+}
+
+int queue_receive_view(Timeout                       *timeout,
+                       const struct MessageQueueView *view,
+                       void                          *dst)
+{
+	return receive(timeout, view->queue, dst, view->buffer);
+}
+
+ssize_t queue_send_multiple(Timeout             *timeout,
+                            struct MessageQueue *handle,
+                            const void          *src,
+                            size_t               count)
+{
+	Debug::log("Send multiple called on: {}", handle);
+	if (count == 0)
+	{
+		return 0;
+	}
+	if (is_single_producer_consumer(*handle))
+	{
+		return single_producer_consumer_transfer<true>(
+		  timeout, handle, Capability{const_cast<void *>(src)}, count);
+	}
+	auto        *producer   = &handle->producer;
+	auto        *consumer   = &handle->consumer;
+	bool         shouldWake = false;
+	volatile int ret        = 0;
+	{
+		HighBitFlagLock l{*producer};
+		if (LockGuard g{l, timeout})
+		{
+			// As with `queue_send`, any failure in the copy leaves the queue
+			// in the old state because the counter update happens last.
+			on_error(
+			  [&] {
+				  uint32_t producerCounter = counter_load(producer);
+				  uint32_t consumerValue   = consumer->load();
+				  uint32_t consumerCounter =
+				    consumerValue & ~CounterReservedBits;
+				  if (is_full(
+				        handle->queueSize, producerCounter, consumerCounter))
+				  {
+					  statistics_blocked<true>(*handle);
+				  }
+				  while (is_full(
+				    handle->queueSize, producerCounter, consumerCounter))
+				  {
+					  if (consumer->wait(timeout, consumerValue) == -ETIMEDOUT)
+					  {
+						  Debug::log("Timed out on futex");
+						  ret = -ETIMEDOUT;
+						  return;
+					  }
+					  consumerValue = consumer->load();
+					  consumerCounter =
+					    consumerValue & ~CounterReservedBits;
+				  }
+				  uint32_t space =
+				    handle->queueSize - items_remaining(handle->queueSize,
+				                                        producerCounter,
+				                                        consumerCounter);
+				  uint32_t sent = std::min<size_t>(count, space);
+				  copy_elements(*handle,
+				                producerCounter,
+				                sent,
+				                Capability{const_cast<void *>(src)},
+				                true);
+				  statistics_enqueued(
+				    *handle, producerCounter, sent, consumerCounter);
+				  counter_store(
+				    producer,
+				    add_and_wrap(handle->queueSize, producerCounter, sent));
+				  shouldWake =
+				    is_empty(producerCounter, counter_load(consumer));
+				  ret = sent;
+			  },
+			  [&]() {
+				  ret = -EPERM;
+				  Debug::log("Error in send multiple");
+			  });
+			if (ret < 0)
+			{
+				return ret;
+			}
+		}
+		else
+		{
+			Debug::log("Timed out on lock");
+			return -ETIMEDOUT;
+		}
+	}
+	if (shouldWake)
+	{
+		handle->producer.notify_all();
+	}
+	return ret;
+}
+
+ssize_t queue_receive_multiple(Timeout             *timeout,
+                               struct MessageQueue *handle,
+                               void                *dst,
+                               size_t               count)
+{
+	Debug::log("Receive multiple called on: {}", handle);
+	if (count == 0)
+	{
+		return 0;
+	}
+	if (is_single_producer_consumer(*handle))
+	{
+		return single_producer_consumer_transfer<false>(
+		  timeout, handle, Capability{dst}, count);
+	}
+	auto        *producer   = &handle->producer;
+	auto        *consumer   = &handle->consumer;
+	bool         shouldWake = false;
+	volatile int ret        = 0;
+	{
+		HighBitFlagLock l{*consumer};
+		if (LockGuard g{l, timeout})
+		{
+			// As with `queue_receive`, any failure in the copy leaves the
+			// queue in the old state because the counter update happens last.
+			on_error(
+			  [&] {
+				  uint32_t producerValue = producer->load();
+				  uint32_t producerCounter =
+				    producerValue & ~CounterReservedBits;
+				  uint32_t consumerCounter = counter_load(consumer);
+				  if (is_empty(producerCounter, consumerCounter))
+				  {
+					  statistics_blocked<false>(*handle);
+				  }
+				  while (is_empty(producerCounter, consumerCounter))
+				  {
+					  if (producer->wait(timeout, producerValue) == -ETIMEDOUT)
+					  {
+						  ret = -ETIMEDOUT;
+						  return;
+					  }
+					  producerValue = producer->load();
+					  producerCounter =
+					    producerValue & ~CounterReservedBits;
+				  }
+				  uint32_t received = std::min<size_t>(
+				    count,
+				    items_remaining(
+				      handle->queueSize, producerCounter, consumerCounter));
+				  copy_elements(
+				    *handle, consumerCounter, received, Capability{dst}, false);
+				  statistics_dequeued(*handle, consumerCounter, received);
+				  counter_store(
+				    consumer,
+				    add_and_wrap(handle->queueSize, consumerCounter, received));
+				  shouldWake = is_full(
+				    handle->queueSize, counter_load(producer), consumerCounter);
+				  ret = received;
+			  },
+			  [&]() {
+				  ret = -EPERM;
+				  Debug::log("Error in receive multiple");
+			  });
+			if (ret < 0)
+			{
+				return ret;
+			}
+		}
+		else
+		{
+			Debug::log("Timed out on lock");
+			return -ETIMEDOUT;
+		}
+	}
+	if (shouldWake)
+	{
+		handle->consumer.notify_all();
+	}
+	return ret;
+}
+
+int queue_send_reserve(Timeout             *timeout,
+                       struct MessageQueue *handle,
+                       void               **slot)
+{
+	Debug::log("Send reserve called on: {}", handle);
+	auto           *producer = &handle->producer;
+	auto           *consumer = &handle->consumer;
+	HighBitFlagLock l{*producer};
+	volatile int    ret    = 0;
+	volatile bool   locked = false;
+	// If `handle` is not a valid queue or `slot` is not writeable, this
+	// returns without holding the lock.
+	on_error(
+	  [&] {
+		  if (!is_single_producer_consumer(*handle))
+		  {
+			  if (!l.try_lock(timeout))
+			  {
+				  ret = -ETIMEDOUT;
+				  return;
+			  }
+			  locked = true;
+		  }
+		  uint32_t producerCounter = counter_load(producer);
+		  uint32_t consumerValue   = consumer->load(std::memory_order_acquire);
+		  if (is_full(handle->queueSize,
+		              producerCounter,
+		              consumerValue & ~CounterReservedBits))
+		  {
+			  statistics_blocked<true>(*handle);
+		  }
+		  while (is_full(handle->queueSize,
+		                 producerCounter,
+		                 consumerValue & ~CounterReservedBits))
+		  {
+			  if (consumer->wait(timeout, consumerValue) == -ETIMEDOUT)
+			  {
+				  ret = -ETIMEDOUT;
+				  return;
+			  }
+			  consumerValue = consumer->load(std::memory_order_acquire);
+		  }
+		  auto reserved =
+		    slot_at_counter(*handle, producerCounter, ReservedSlotPermissions);
+		  if (!reserved.is_valid())
+		  {
+			  ret = -EINVAL;
+			  return;
+		  }
+		  *slot = reserved;
+	  },
+	  [&]() { ret = -EPERM; });
+	if ((ret != 0) && locked)
+	{
+		l.unlock();
+	}
+	return ret;
+}
+
+int queue_send_commit(struct MessageQueue *handle, void *slot)
+{
+	Debug::log("Send commit called on: {}", handle);
+	auto        *producer   = &handle->producer;
+	auto        *consumer   = &handle->consumer;
+	volatile int ret        = 0;
+	bool         shouldWake = false;
+	on_error(
+	  [&] {
+		  uint32_t producerValue   = producer->load();
+		  uint32_t producerCounter = producerValue & ~CounterReservedBits;
+		  bool     singleProducerConsumer =
+		    producerValue & SingleProducerConsumerBit;
+		  // A multi-producer queue must still be locked by the reservation.
+		  if ((!singleProducerConsumer &&
+		       !(producerValue & HighBitFlagLock::LockBit)) ||
+		      !is_slot_at_counter(*handle, slot, producerCounter))
+		  {
+			  ret = -EINVAL;
+			  return;
+		  }
+		  statistics_enqueued(
+		    *handle, producerCounter, 1, counter_load(consumer));
+		  uint32_t next = increment_and_wrap(handle->queueSize, producerCounter);
+		  if (singleProducerConsumer)
+		  {
+			  producer->store((producerValue & CounterReservedBits) | next,
+			                  std::memory_order_release);
+			  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+		  }
+		  else
+		  {
+			  counter_store(producer, next);
+		  }
+		  shouldWake = is_empty(producerCounter, counter_load(consumer));
+		  if (!singleProducerConsumer)
+		  {
+			  HighBitFlagLock{*producer}.unlock();
+		  }
+	  },
+	  [&]() { ret = -EPERM; });
+	if (shouldWake)
+	{
+		producer->notify_all();
+	}
+	return ret;
+}
+
+int queue_receive_peek(Timeout             *timeout,
+                       struct MessageQueue *handle,
+                       const void         **slot)
+{
+	Debug::log("Receive peek called on: {}", handle);
+	auto           *producer = &handle->producer;
+	auto           *consumer = &handle->consumer;
+	HighBitFlagLock l{*consumer};
+	volatile int    ret    = 0;
+	volatile bool   locked = false;
+	// If `handle` is not a valid queue or `slot` is not writeable, this
+	// returns without holding the lock.
+	on_error(
+	  [&] {
+		  if (!is_single_producer_consumer(*handle))
+		  {
+			  if (!l.try_lock(timeout))
+			  {
+				  ret = -ETIMEDOUT;
+				  return;
+			  }
+			  locked = true;
+		  }
+		  uint32_t consumerCounter = counter_load(consumer);
+		  uint32_t producerValue   = producer->load(std::memory_order_acquire);
+		  if (is_empty(producerValue & ~CounterReservedBits, consumerCounter))
+		  {
+			  statistics_blocked<false>(*handle);
+		  }
+		  while (is_empty(producerValue & ~CounterReservedBits, consumerCounter))
+		  {
+			  if (producer->wait(timeout, producerValue) == -ETIMEDOUT)
+			  {
+				  ret = -ETIMEDOUT;
+				  return;
+			  }
+			  producerValue = producer->load(std::memory_order_acquire);
+		  }
+		  auto peeked =
+		    slot_at_counter(*handle, consumerCounter, PeekedSlotPermissions);
+		  if (!peeked.is_valid())
+		  {
+			  ret = -EINVAL;
+			  return;
+		  }
+		  *slot = peeked;
+	  },
+	  [&]() { ret = -EPERM; });
+	if ((ret != 0) && locked)
+	{
+		l.unlock();
+	}
+	return ret;
+}
+
+int queue_receive_release(struct MessageQueue *handle, const void *slot)
+{
+	Debug::log("Receive release called on: {}", handle);
+	auto        *producer   = &handle->producer;
+	auto        *consumer   = &handle->consumer;
+	volatile int ret        = 0;
+	bool         shouldWake = false;
+	on_error(
+	  [&] {
+		  uint32_t consumerValue   = consumer->load();
+		  uint32_t consumerCounter = consumerValue & ~CounterReservedBits;
+		  bool     singleProducerConsumer =
+		    consumerValue & SingleProducerConsumerBit;
+		  // A multi-consumer queue must still be locked by the peek.
+		  if ((!singleProducerConsumer &&
+		       !(consumerValue & HighBitFlagLock::LockBit)) ||
+		      !is_slot_at_counter(*handle, slot, consumerCounter))
+		  {
+			  ret = -EINVAL;
+			  return;
+		  }
+		  statistics_dequeued(*handle, consumerCounter, 1);
+		  uint32_t next = increment_and_wrap(handle->queueSize, consumerCounter);
+		  if (singleProducerConsumer)
+		  {
+			  consumer->store((consumerValue & CounterReservedBits) | next,
+			                  std::memory_order_release);
+			  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+		  }
+		  else
+		  {
+			  counter_store(consumer, next);
+		  }
+		  shouldWake = is_full(
+		    handle->queueSize, counter_load(producer), consumerCounter);
+		  if (!singleProducerConsumer)
+		  {
+			  HighBitFlagLock{*consumer}.unlock();
+		  }
+	  },
+	  [&]() { ret = -EPERM; });
+	if (shouldWake)
+	{
+		consumer->notify_all();
+	}
+	return ret;
+}
+
+int queue_items_remaining(struct MessageQueue *handle, size_t *items)
+{
+	auto producerCounter = counter_load(&handle->producer);
+	auto consumerCounter = counter_load(&handle->consumer);
+	*items =
+	  items_remaining(handle->queueSize, producerCounter, consumerCounter);
+	Debug::log("Producer counter: {}, consumer counter: {}, items: {}",
+	           producerCounter,
+	           consumerCounter,
+	           *items);
+	return 0;
+}
+
+void multiwaiter_queue_send_init(struct EventWaiterSource *source,
+                                 struct MessageQueue      *handle)
+{
+	uint32_t producer   = counter_load(&handle->producer);
+	uint32_t consumer   = counter_load(&handle->consumer);
+	source->eventSource = &handle->consumer;
+	// Wait for the whole word to change, including the mode bit.
+	source->value = is_full(handle->queueSize, producer, consumer)
+	                  ? consumer | (handle->consumer & CounterModeBits)
+	                  : -1;
+}
 
 void multiwaiter_queue_receive_init(struct EventWaiterSource *source,
                                     struct MessageQueue      *handle)
@@ -609,5 +1588,558 @@ void multiwaiter_queue_receive_init(struct EventWaiterSource *source,
 	uint32_t producer   = counter_load(&handle->producer);
 	uint32_t consumer   = counter_load(&handle->consumer);
 	source->eventSource = &handle->producer;
-	source->value       = is_empty(producer, consumer) ? producer : -1;
+	source->value       = is_empty(producer, consumer)
+	                        ? producer | (handle->producer & CounterModeBits)
+	                        : -1;
+}
+
+namespace
+{
+	/**
+	 * Record queues are byte queues (`elementSize` is 1) in which each record
+	 * is a 32-bit length followed by the payload, padded to a multiple of the
+	 * header size.  Records are never split across the end of the ring: if a
+	 * record does not fit before the end, the producer writes
+	 * `RecordPadding` in place of a length and the record starts at the
+	 * beginning of the ring.
+	 */
+	constexpr uint32_t RecordHeaderSize = sizeof(uint32_t);
+
+	/**
+	 * Header value that marks the rest of the ring, up to the end, as
+	 * padding.
+	 */
+	constexpr uint32_t RecordPadding = UINT32_MAX;
+
+	/**
+	 * Returns the space that a record with a `length`-byte payload occupies in
+	 * a record queue.
+	 */
+	constexpr size_t record_space(size_t length)
+	{
+		return __builtin_align_up(RecordHeaderSize + length, RecordHeaderSize);
+	}
+
+	/**
+	 * Returns a pointer to the record header at `counter`.
+	 */
+	uint32_t *record_header_at(struct MessageQueue &handle, uint32_t counter)
+	{
+		return static_cast<uint32_t *>(
+		  static_cast<void *>(buffer_at_counter(handle, counter)));
+	}
+
+	/**
+	 * Returns the number of bytes from `counter` to the end of the ring.
+	 */
+	uint32_t bytes_to_end(struct MessageQueue &handle, uint32_t counter)
+	{
+		size_t index =
+		  counter >= handle.queueSize ? counter - handle.queueSize : counter;
+		return handle.queueSize - index;
+	}
+} // namespace
+
+int record_queue_create(Timeout              *timeout,
+                        struct SObjStruct    *heapCapability,
+                        struct MessageQueue **outQueue,
+                        size_t                capacity)
+{
+	if (capacity > SIZE_MAX - RecordHeaderSize)
+	{
+		return -EINVAL;
+	}
+	return queue_create(timeout,
+	                    heapCapability,
+	                    outQueue,
+	                    1,
+	                    __builtin_align_up(capacity, RecordHeaderSize));
+}
+
+int record_queue_send(Timeout             *timeout,
+                      struct MessageQueue *handle,
+                      const void          *src,
+                      size_t               length)
+{
+	Debug::log("Record send called on: {}", handle);
+	if ((length > handle->queueSize) ||
+	    (record_space(length) > handle->queueSize))
+	{
+		return -EMSGSIZE;
+	}
+	auto *producer   = &handle->producer;
+	auto *consumer   = &handle->consumer;
+	bool  shouldWake = false;
+	{
+		HighBitFlagLock l{*producer};
+		if (LockGuard g{l, timeout})
+		{
+			volatile int ret = 0;
+			// As with `queue_send`, the counter update happens last, so any
+			// failure leaves the queue in the old state.
+			on_error(
+			  [&] {
+				  uint32_t size            = handle->queueSize;
+				  uint32_t producerCounter = counter_load(producer);
+				  uint32_t space           = record_space(length);
+				  uint32_t padding = bytes_to_end(*handle, producerCounter);
+				  if (padding >= space)
+				  {
+					  padding = 0;
+				  }
+				  uint32_t consumerValue = consumer->load();
+				  while (size - items_remaining(
+				                  size,
+				                  producerCounter,
+				                  consumerValue & ~CounterReservedBits) <
+				         padding + space)
+				  {
+					  // Waiting for space is waiting for the consumer to make
+					  // progress, which it always does under its lock.  Set
+					  // the waiters bit on the consumer's lock word so that
+					  // releasing the lock wakes us.
+					  if (!(consumerValue & HighBitFlagLock::WaitersBit))
+					  {
+						  if (!consumer->compare_exchange_strong(
+						        consumerValue,
+						        consumerValue | HighBitFlagLock::WaitersBit))
+						  {
+							  continue;
+						  }
+						  consumerValue |= HighBitFlagLock::WaitersBit;
+					  }
+					  if (consumer->wait(timeout, consumerValue) == -ETIMEDOUT)
+					  {
+						  ret = -ETIMEDOUT;
+						  return;
+					  }
+					  consumerValue = consumer->load();
+				  }
+				  uint32_t recordCounter = producerCounter;
+				  if (padding != 0)
+				  {
+					  *record_header_at(*handle, recordCounter) = RecordPadding;
+					  recordCounter =
+					    add_and_wrap(size, recordCounter, padding);
+				  }
+				  auto *header = record_header_at(*handle, recordCounter);
+				  memcpy(header + 1, src, length);
+				  *header = length;
+				  counter_store(producer,
+				                add_and_wrap(size, recordCounter, space));
+				  shouldWake =
+				    is_empty(producerCounter, counter_load(consumer));
+			  },
+			  [&]() {
+				  ret = -EPERM;
+				  Debug::log("Error in record send");
+			  });
+			if (ret != 0)
+			{
+				return ret;
+			}
+		}
+		else
+		{
+			return -ETIMEDOUT;
+		}
+	}
+	if (shouldWake)
+	{
+		handle->producer.notify_all();
+	}
+	return 0;
+}
+
+ssize_t record_queue_peek(Timeout             *timeout,
+                          struct MessageQueue *handle,
+                          const void         **record)
+{
+	Debug::log("Record peek called on: {}", handle);
+	auto           *producer = &handle->producer;
+	auto           *consumer = &handle->consumer;
+	HighBitFlagLock l{*consumer};
+	if (!l.try_lock(timeout))
+	{
+		return -ETIMEDOUT;
+	}
+	volatile ssize_t ret = 0;
+	on_error(
+	  [&] {
+		  uint32_t size            = handle->queueSize;
+		  uint32_t consumerCounter = counter_load(consumer);
+		  uint32_t producerValue   = producer->load();
+		  while (is_empty(producerValue & ~CounterReservedBits, consumerCounter))
+		  {
+			  if (producer->wait(timeout, producerValue) == -ETIMEDOUT)
+			  {
+				  ret = -ETIMEDOUT;
+				  return;
+			  }
+			  producerValue = producer->load();
+		  }
+		  uint32_t length = *record_header_at(*handle, consumerCounter);
+		  if (length == RecordPadding)
+		  {
+			  // The producer publishes padding together with the record
+			  // after it, so there is a record at the start of the ring.
+			  // Consume the padding now.
+			  consumerCounter = add_and_wrap(
+			    size, consumerCounter, bytes_to_end(*handle, consumerCounter));
+			  counter_store(consumer, consumerCounter);
+			  length = *record_header_at(*handle, consumerCounter);
+		  }
+		  if (record_space(length) > bytes_to_end(*handle, consumerCounter))
+		  {
+			  ret = -EINVAL;
+			  return;
+		  }
+		  Capability<void> payload{record_header_at(*handle, consumerCounter) +
+		                           1};
+		  payload.bounds() = length;
+		  payload.permissions() &= PeekedSlotPermissions;
+		  *record = payload;
+		  ret     = length;
+	  },
+	  [&]() { ret = -EPERM; });
+	if (ret < 0)
+	{
+		l.unlock();
+	}
+	return ret;
+}
+
+int record_queue_release(struct MessageQueue *handle, const void *record)
+{
+	Debug::log("Record release called on: {}", handle);
+	auto        *consumer = &handle->consumer;
+	volatile int ret      = 0;
+	on_error(
+	  [&] {
+		  uint32_t consumerValue   = consumer->load();
+		  uint32_t consumerCounter = consumerValue & ~CounterReservedBits;
+		  auto    *header          = record_header_at(*handle, consumerCounter);
+		  // The receive lock must still be held by the peek.
+		  if (!(consumerValue & HighBitFlagLock::LockBit) ||
+		      (Capability{record}.address() !=
+		       Capability{header + 1}.address()))
+		  {
+			  ret = -EINVAL;
+			  return;
+		  }
+		  counter_store(consumer,
+		                add_and_wrap(handle->queueSize,
+		                             consumerCounter,
+		                             record_space(*header)));
+		  // This wakes any producers waiting for space, as well as any
+		  // consumers waiting for the lock.
+		  HighBitFlagLock{*consumer}.unlock();
+	  },
+	  [&]() { ret = -EPERM; });
+	return ret;
+}
+
+ssize_t record_queue_receive(Timeout             *timeout,
+                             struct MessageQueue *handle,
+                             void                *dst,
+                             size_t               dstLength)
+{
+	const void *record;
+	ssize_t     length = record_queue_peek(timeout, handle, &record);
+	if (length < 0)
+	{
+		return length;
+	}
+	if (static_cast<size_t>(length) > dstLength)
+	{
+		// Leave the record in the queue.
+		HighBitFlagLock{handle->consumer}.unlock();
+		return -ENOBUFS;
+	}
+	volatile ssize_t ret = length;
+	on_error([&] { memcpy(dst, record, length); }, [&]() { ret = -EPERM; });
+	if (ret < 0)
+	{
+		HighBitFlagLock{handle->consumer}.unlock();
+		return ret;
+	}
+	if (int released = record_queue_release(handle, record); released != 0)
+	{
+		return released;
+	}
+	return ret;
+}
+
+namespace
+{
+	/**
+	 * Priority queues keep a separate ring of `queueSize` elements for each
+	 * priority level, after a header that holds the number of levels and a
+	 * pair of counters for each level.  The level counters wrap in the same
+	 * way as the main counters.  The main counters count the elements in all
+	 * levels, so waiting, `queue_items_remaining`, and the multiwaiter work
+	 * as for any other queue.  The producer advances a level's tail before
+	 * the main producer counter, so a consumer that sees the main counters
+	 * report an element will always find one in some level, and no level can
+	 * hold more than `queueSize` elements.
+	 */
+	struct PriorityLevel
+	{
+		/// The consumer counter for this level.
+		MessageQueueCounter head;
+		/// The producer counter for this level.
+		MessageQueueCounter tail;
+	};
+
+	/// The largest number of priority levels in a priority queue.
+	constexpr size_t PriorityQueueMaxLevels = 8;
+
+	/**
+	 * Returns the space needed for the priority queue header with `levels`
+	 * levels.  This is padded so that the elements are capability aligned.
+	 */
+	constexpr size_t priority_header_size(size_t levels)
+	{
+		return __builtin_align_up(
+		  sizeof(uint32_t) + (levels * sizeof(PriorityLevel)), sizeof(void *));
+	}
+
+	/**
+	 * Returns a pointer to the priority queue header, immediately after the
+	 * `MessageQueue` structure.
+	 */
+	Capability<void> priority_header(struct MessageQueue &handle)
+	{
+		Capability<void> pointer{&handle};
+		pointer.address() += sizeof(MessageQueue);
+		return pointer;
+	}
+
+	/**
+	 * Returns a pointer to the number of levels in a priority queue.
+	 */
+	uint32_t *priority_level_count(struct MessageQueue &handle)
+	{
+		return static_cast<uint32_t *>(
+		  static_cast<void *>(priority_header(handle)));
+	}
+
+	/**
+	 * Returns a pointer to the counters for `level`.
+	 */
+	PriorityLevel *priority_level(struct MessageQueue &handle, uint32_t level)
+	{
+		auto pointer = priority_header(handle);
+		pointer.address() += sizeof(uint32_t) + (level * sizeof(PriorityLevel));
+		return static_cast<PriorityLevel *>(static_cast<void *>(pointer));
+	}
+
+	/**
+	 * Returns a pointer to the element indicated by `counter` in the ring for
+	 * `level`, in a queue with `levels` levels.
+	 */
+	Capability<void> priority_element_at(struct MessageQueue &handle,
+	                                     uint32_t             levels,
+	                                     uint32_t             level,
+	                                     uint32_t             counter)
+	{
+		size_t index =
+		  counter >= handle.queueSize ? counter - handle.queueSize : counter;
+		auto pointer = priority_header(handle);
+		pointer.address() +=
+		  priority_header_size(levels) +
+		  (((level * handle.queueSize) + index) * handle.elementSize);
+		return pointer;
+	}
+} // namespace
+
+int priority_queue_create(Timeout              *timeout,
+                          struct SObjStruct    *heapCapability,
+                          struct MessageQueue **outQueue,
+                          size_t                elementSize,
+                          size_t                elementCount,
+                          size_t                levels)
+{
+	size_t ringElements;
+	size_t allocSize;
+	if ((levels == 0) || (levels > PriorityQueueMaxLevels) ||
+	    __builtin_mul_overflow(elementCount, levels, &ringElements))
+	{
+		return -EINVAL;
+	}
+	ssize_t ringSize = queue_allocation_size(elementSize, ringElements);
+	if (ringSize < 0)
+	{
+		return ringSize;
+	}
+	if (__builtin_add_overflow(static_cast<size_t>(ringSize),
+	                           priority_header_size(levels),
+	                           &allocSize))
+	{
+		return -EINVAL;
+	}
+
+	Capability buffer{heap_allocate(timeout, heapCapability, allocSize)};
+	if (!buffer.is_valid())
+	{
+		return -ENOMEM;
+	}
+
+	auto *queue = new (buffer.get()) MessageQueue(elementSize, elementCount);
+	*priority_level_count(*queue) = levels;
+	for (uint32_t level = 0; level < levels; level++)
+	{
+		priority_level(*queue, level)->head = 0;
+		priority_level(*queue, level)->tail = 0;
+	}
+	*outQueue = queue;
+	return 0;
+}
+
+int priority_queue_send(Timeout             *timeout,
+                        struct MessageQueue *handle,
+                        const void          *src,
+                        uint32_t             priority)
+{
+	Debug::log("Priority send called on: {}", handle);
+	auto *producer   = &handle->producer;
+	auto *consumer   = &handle->consumer;
+	bool  shouldWake = false;
+	{
+		HighBitFlagLock l{*producer};
+		if (LockGuard g{l, timeout})
+		{
+			volatile int ret = 0;
+			// As with `queue_send`, the counter updates happen last, so any
+			// failure leaves the queue in the old state.
+			on_error(
+			  [&] {
+				  uint32_t levels = *priority_level_count(*handle);
+				  if (priority >= levels)
+				  {
+					  ret = -EINVAL;
+					  return;
+				  }
+				  uint32_t size            = handle->queueSize;
+				  uint32_t producerCounter = counter_load(producer);
+				  uint32_t consumerValue   = consumer->load();
+				  while (is_full(size,
+				                 producerCounter,
+				                 consumerValue & ~CounterReservedBits))
+				  {
+					  if (consumer->wait(timeout, consumerValue) == -ETIMEDOUT)
+					  {
+						  ret = -ETIMEDOUT;
+						  return;
+					  }
+					  consumerValue = consumer->load();
+				  }
+				  auto    *level = priority_level(*handle, priority);
+				  uint32_t tail  = level->tail.load(std::memory_order_relaxed);
+				  memcpy(priority_element_at(*handle, levels, priority, tail),
+				         src,
+				         handle->elementSize);
+				  level->tail.store(increment_and_wrap(size, tail),
+				                    std::memory_order_release);
+				  counter_store(producer,
+				                increment_and_wrap(size, producerCounter));
+				  shouldWake =
+				    is_empty(producerCounter, counter_load(consumer));
+			  },
+			  [&]() {
+				  ret = -EPERM;
+				  Debug::log("Error in priority send");
+			  });
+			if (ret != 0)
+			{
+				return ret;
+			}
+		}
+		else
+		{
+			return -ETIMEDOUT;
+		}
+	}
+	if (shouldWake)
+	{
+		handle->producer.notify_all();
+	}
+	return 0;
+}
+
+int priority_queue_receive(Timeout             *timeout,
+                           struct MessageQueue *handle,
+                           void                *dst)
+{
+	Debug::log("Priority receive called on: {}", handle);
+	auto        *producer   = &handle->producer;
+	auto        *consumer   = &handle->consumer;
+	bool         shouldWake = false;
+	volatile int ret        = 0;
+	{
+		HighBitFlagLock l{*consumer};
+		if (LockGuard g{l, timeout})
+		{
+			on_error(
+			  [&] {
+				  uint32_t size            = handle->queueSize;
+				  uint32_t consumerCounter = counter_load(consumer);
+				  uint32_t producerValue   = producer->load();
+				  while (is_empty(producerValue & ~CounterReservedBits,
+				                  consumerCounter))
+				  {
+					  if (producer->wait(timeout, producerValue) == -ETIMEDOUT)
+					  {
+						  ret = -ETIMEDOUT;
+						  return;
+					  }
+					  producerValue = producer->load();
+				  }
+				  uint32_t levels = *priority_level_count(*handle);
+				  for (uint32_t priority = levels; priority-- > 0;)
+				  {
+					  auto    *level = priority_level(*handle, priority);
+					  uint32_t head =
+					    level->head.load(std::memory_order_relaxed);
+					  if (is_empty(level->tail.load(std::memory_order_acquire),
+					               head))
+					  {
+						  continue;
+					  }
+					  memcpy(
+					    dst,
+					    priority_element_at(*handle, levels, priority, head),
+					    handle->elementSize);
+					  level->head.store(increment_and_wrap(size, head),
+					                    std::memory_order_release);
+					  counter_store(consumer,
+					                increment_and_wrap(size, consumerCounter));
+					  shouldWake =
+					    is_full(size, counter_load(producer), consumerCounter);
+					  ret = priority;
+					  return;
+				  }
+				  // The main counters report an element but no level holds
+				  // one, so the queue is corrupt.
+				  ret = -EINVAL;
+			  },
+			  [&]() {
+				  ret = -EPERM;
+				  Debug::log("Error in priority receive");
+			  });
+			if (ret < 0)
+			{
+				return ret;
+			}
+		}
+		else
+		{
+			return -ETIMEDOUT;
+		}
+	}
+	if (shouldWake)
+	{
+		handle->consumer.notify_all();
+	}
+	return ret;
 }
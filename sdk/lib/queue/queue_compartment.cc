@@ -56,6 +56,73 @@ namespace
 		return queue;
 	}
 
+	/**
+	 * Unseal something that is a queue handle or either kind of restricted
+	 * endpoint.
+	 */
+	MessageQueue *unseal_any(SObj handle)
+	{
+		MessageQueue *queue = unseal(send_key(), handle);
+		if (!queue)
+		{
+			if (auto *unsealed = token_unseal(
+			      receive_key(), Sealed<RestrictedEndpoint>{handle}))
+			{
+				queue = unsealed->handle;
+			}
+		}
+		return queue;
+	}
+
+	/**
+	 * Create a send (if `Send` is true) or receive view of the queue that
+	 * `handle` refers to.
+	 */
+	template<bool Send>
+	int view_create(SObj handle, MessageQueueView *outView)
+	{
+		MessageQueue *queue = unseal(Send ? send_key() : receive_key(), handle);
+		if (!queue ||
+		    !check_pointer<PermissionSet{Permission::Store,
+		                                 Permission::LoadStoreCapability}>(
+		      outView, sizeof(MessageQueueView)))
+		{
+			return -EINVAL;
+		}
+		Capability<MessageQueue> header{queue};
+		header.bounds() = sizeof(MessageQueue);
+		header.permissions() &= {
+		  Permission::Load, Permission::Store, Permission::Global};
+		size_t           length = queue->elementSize * queue->queueSize;
+		Capability<void> ring{queue};
+		ring.address() += sizeof(MessageQueue);
+		ring.bounds() = length;
+		if constexpr (Send)
+		{
+			ring.permissions() &= {Permission::Store,
+			                       Permission::LoadStoreCapability,
+			                       Permission::Global};
+		}
+		else
+		{
+			ring.permissions() &= {Permission::Load,
+			                       Permission::LoadStoreCapability,
+			                       Permission::LoadMutable,
+			                       Permission::LoadGlobal,
+			                       Permission::Global};
+		}
+		// Imprecise bounds would let the ring overlap the header or another
+		// object.
+		if ((header.length() != sizeof(MessageQueue)) ||
+		    (ring.length() != length) || !ring.is_valid())
+		{
+			return -EINVAL;
+		}
+		outView->queue  = header;
+		outView->buffer = ring;
+		return 0;
+	}
+
 } // namespace
 
 int queue_create_sealed(Timeout            *timeout,
@@ -84,6 +151,22 @@ int queue_create_sealed(Timeout            *timeout,
 	return 0;
 }
 
+int queue_create_sealed_wake_one(Timeout            *timeout,
+                                 struct SObjStruct  *heapCapability,
+                                 struct SObjStruct **outQueue,
+                                 size_t              elementSize,
+                                 size_t              elementCount)
+{
+	int ret = queue_create_sealed(
+	  timeout, heapCapability, outQueue, elementSize, elementCount);
+	if (ret == 0)
+	{
+		queue_wake_one_init(token_unseal(handle_key(),
+		                                 Sealed<MessageQueue>{*outQueue}));
+	}
+	return ret;
+}
+
 int queue_destroy_sealed(Timeout           *timeout,
                          struct SObjStruct *heapCapability,
                          struct SObjStruct *queueHandle)
@@ -128,6 +211,32 @@ int queue_receive_sealed(Timeout *timeout, struct SObjStruct *handle, void *dst)
 	return queue_receive(timeout, queue, dst);
 }
 
+ssize_t queue_send_multiple_sealed(Timeout           *timeout,
+                                   struct SObjStruct *handle,
+                                   const void        *src,
+                                   size_t             count)
+{
+	MessageQueue *queue = unseal(send_key(), handle);
+	if (!queue || !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	return queue_send_multiple(timeout, queue, src, count);
+}
+
+ssize_t queue_receive_multiple_sealed(Timeout           *timeout,
+                                      struct SObjStruct *handle,
+                                      void              *dst,
+                                      size_t             count)
+{
+	MessageQueue *queue = unseal(receive_key(), handle);
+	if (!queue || !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	return queue_receive_multiple(timeout, queue, dst, count);
+}
+
 int multiwaiter_queue_receive_init_sealed(struct EventWaiterSource *source,
                                           struct SObjStruct        *handle)
 {
@@ -154,25 +263,55 @@ int multiwaiter_queue_send_init_sealed(struct EventWaiterSource *source,
 
 int queue_items_remaining_sealed(struct SObjStruct *handle, size_t *items)
 {
-	MessageQueue *queue = unseal(send_key(), handle);
-	// This function takes either endpoint, so we need to try unsealing with
-	// both keys.
+	// This function takes either endpoint.
+	MessageQueue *queue = unseal_any(handle);
 	if (!queue)
 	{
-		if (auto *unsealed =
-		      token_unseal(receive_key(), Sealed<RestrictedEndpoint>{handle}))
-		{
-			queue = unsealed->handle;
-		}
+		return -EINVAL;
 	}
-	if (!queue)
+	queue_items_remaining(queue, items);
+	return 0;
+}
+
+int queue_create_sealed_with_statistics(Timeout            *timeout,
+                                        struct SObjStruct  *heapCapability,
+                                        struct SObjStruct **outQueue,
+                                        size_t              elementSize,
+                                        size_t              elementCount)
+{
+	ssize_t allocSize =
+	  queue_statistics_allocation_size(elementSize, elementCount);
+	if (allocSize < 0)
 	{
 		return -EINVAL;
 	}
-	queue_items_remaining(queue, items);
+
+	void *unsealed = nullptr;
+	auto  sealed   = token_sealed_unsealed_alloc(
+	     timeout, heapCapability, handle_key(), allocSize, &unsealed);
+	if (!unsealed)
+	{
+		return -ENOMEM;
+	}
+
+	queue_statistics_init(new (unsealed)
+	                        MessageQueue(elementSize, elementCount));
+	*outQueue = sealed;
 	return 0;
 }
 
+int queue_statistics_sealed(struct SObjStruct             *handle,
+                            struct MessageQueueStatistics *statistics)
+{
+	MessageQueue *queue = unseal_any(handle);
+	if (!queue || !check_pointer<PermissionSet{Permission::Store}>(
+	                statistics, sizeof(MessageQueueStatistics)))
+	{
+		return -EINVAL;
+	}
+	return queue_statistics(queue, statistics);
+}
+
 int queue_receive_handle_create_sealed(struct Timeout     *timeout,
                                        struct SObjStruct  *heapCapability,
                                        struct SObjStruct  *handle,
@@ -216,3 +355,15 @@ int queue_send_handle_create_sealed(struct Timeout     *timeout,
 	*outHandle       = sealed;
 	return 0;
 }
+
+int queue_send_view_create_sealed(struct SObjStruct       *handle,
+                                  struct MessageQueueView *outView)
+{
+	return view_create<true>(handle, outView);
+}
+
+int queue_receive_view_create_sealed(struct SObjStruct       *handle,
+                                     struct MessageQueueView *outView)
+{
+	return view_create<false>(handle, outView);
+}
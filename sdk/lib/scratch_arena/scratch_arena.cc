@@ -0,0 +1,109 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <cheri.hh>
+#include <errno.h>
+#include <scratch_arena.h>
+
+using namespace CHERI;
+
+namespace
+{
+	/// Objects are aligned to capabilities, as for the heap.
+	constexpr size_t Alignment = sizeof(void *);
+
+	/**
+	 * Returns the arena that `arena` points to, or null if it is not a valid
+	 * writable pointer to an arena.
+	 */
+	ScratchArena *arena_check(ScratchArena *arena)
+	{
+		Capability cap{arena};
+		if (!cap.is_valid() || cap.is_sealed() ||
+		    (cap.bounds() < sizeof(ScratchArena)) ||
+		    !cap.permissions().contains(Permission::Load,
+		                                Permission::Store,
+		                                Permission::LoadStoreCapability))
+		{
+			return nullptr;
+		}
+		return arena;
+	}
+} // namespace
+
+int scratch_arena_create(ScratchArena      *arena,
+                         Timeout           *timeout,
+                         struct SObjStruct *heapCapability,
+                         size_t             size)
+{
+	if (arena_check(arena) == nullptr)
+	{
+		return -EINVAL;
+	}
+	arena->memory = heap_allocate(timeout, heapCapability, size);
+	arena->used   = 0;
+	return Capability{arena->memory}.is_valid() ? 0 : -ENOMEM;
+}
+
+void *scratch_arena_allocate(ScratchArena *arena, size_t size)
+{
+	if ((arena_check(arena) == nullptr) || (size == 0))
+	{
+		return nullptr;
+	}
+	Capability<void> object{arena->memory};
+	if (!object.is_valid())
+	{
+		return nullptr;
+	}
+	// Large objects need stronger alignment and a rounded length for their
+	// bounds to be exact.
+	size_t    length = representable_length(size);
+	size_t    mask   = representable_alignment_mask(length) & ~(Alignment - 1);
+	ptraddr_t start  = (object.base() + arena->used + ~mask) & mask;
+	if ((length == 0) || (start < object.base()) ||
+	    (start + length > object.top()) || (start + length < start))
+	{
+		return nullptr;
+	}
+	object.address() = start;
+	object.bounds()  = length;
+	if (!object.is_valid())
+	{
+		return nullptr;
+	}
+	// The heap zeroed the backing allocation and space is never handed out
+	// twice, so the object is already zeroed.
+	arena->used = start + length - Capability{arena->memory}.base();
+	return object;
+}
+
+size_t scratch_arena_remaining(ScratchArena *arena)
+{
+	if (arena_check(arena) == nullptr)
+	{
+		return 0;
+	}
+	Capability memory{arena->memory};
+	if (!memory.is_valid() || (arena->used > memory.length()))
+	{
+		return 0;
+	}
+	return memory.length() - arena->used;
+}
+
+int scratch_arena_destroy(ScratchArena      *arena,
+                          struct SObjStruct *heapCapability)
+{
+	if (arena_check(arena) == nullptr)
+	{
+		return -EINVAL;
+	}
+	int ret = heap_free(heapCapability, arena->memory);
+	if (ret == 0)
+	{
+		arena->memory = nullptr;
+		arena->used   = 0;
+	}
+	return ret;
+}
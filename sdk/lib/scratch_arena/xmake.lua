@@ -0,0 +1,3 @@
+library("scratch_arena")
+  set_default(false)
+  add_files("scratch_arena.cc")
@@ -0,0 +1,570 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <algorithm>
+#include <array>
+#include <cheri.hh>
+#include <compartment.h>
+#include <errno.h>
+#include <locks.hh>
+#include <platform-gpio.hh>
+#include <platform-spi.hh>
+#include <spi_flash.h>
+#include <stdlib.h>
+#include <thread.h>
+
+using namespace CHERI;
+
+#ifndef CHERIOT_SPI_FLASH_CACHE_PAGES
+#	define CHERIOT_SPI_FLASH_CACHE_PAGES 4
+#endif
+
+#ifndef CHERIOT_SPI_FLASH_DEVICE
+#	if DEVICE_EXISTS(spi0) && DEVICE_EXISTS(gpio)
+// Sonata: the flash is on the first SPI controller.
+#		define CHERIOT_SPI_FLASH_DEVICE spi0
+#	else
+#		error The SPI flash driver does not support this board
+#	endif
+#endif
+
+#ifndef CHERIOT_SPI_FLASH_CHIP_SELECT
+#	define CHERIOT_SPI_FLASH_CHIP_SELECT 12
+#endif
+
+namespace
+{
+	/// The number of pages in the read cache.
+	constexpr size_t CachePages = CHERIOT_SPI_FLASH_CACHE_PAGES;
+	static_assert(CachePages > 0, "The SPI flash cache must have a page");
+
+	/// The size of a page.
+	constexpr uint32_t PageSize = SPI_FLASH_PAGE_SIZE;
+
+	/// The size of a sector.
+	constexpr uint32_t SectorSize = SPI_FLASH_SECTOR_SIZE;
+
+	/// The size of a block, the largest unit that can be erased at once.
+	constexpr uint32_t BlockSize = 64 * 1024;
+
+	/// An address that is not page aligned and so never matches a page.
+	constexpr uint32_t InvalidAddress = UINT32_MAX;
+
+	/// The largest number of bytes in one SPI controller operation.
+	constexpr uint32_t MaxTransfer = SonataSpi::StartByteCountMask;
+
+	/**
+	 * JEDEC SPI NOR commands.  The commands that take an address are the
+	 * variants with a 4-byte address, so that all of a flash larger than
+	 * 16 MiB is reachable whichever address mode the device is in.
+	 */
+	enum class Command : uint8_t
+	{
+		WriteEnable      = 0x06,
+		ReadStatus       = 0x05,
+		ReadIdentifier   = 0x9f,
+		ReleasePowerDown = 0xab,
+		FastRead         = 0x0c,
+		PageProgram      = 0x12,
+		SectorErase      = 0x21,
+		BlockErase       = 0xdc,
+	};
+
+	/// The write-in-progress bit of the status register.
+	constexpr uint8_t StatusBusy = 1 << 0;
+
+	/// A page in the read cache.
+	struct CachedPage
+	{
+		/// The flash address of the page, or `InvalidAddress` if unused.
+		uint32_t address = InvalidAddress;
+		/// The value of `useCounter` when this page was last used.
+		uint32_t lastUsed = 0;
+		/// The contents of the page.
+		std::array<uint8_t, PageSize> data;
+	};
+
+	/**
+	 * A page of data that has been written but not yet programmed.  Bytes
+	 * that have not been written are all ones, which programming leaves
+	 * unchanged.
+	 */
+	struct PendingPage
+	{
+		/// The flash address of the page, or `InvalidAddress` if none.
+		uint32_t address = InvalidAddress;
+		/// The offset of the first written byte in the page.
+		uint16_t first = 0;
+		/// The offset after the last written byte in the page.
+		uint16_t end = 0;
+		/// The data to program.
+		std::array<uint8_t, PageSize> data;
+	};
+
+	/// Lock serialising all access to the flash and to the state below.
+	FlagLock lock;
+
+	/// The size of the flash in bytes, or 0 if it has not been probed.
+	uint32_t flashSize;
+
+	/// The read cache.
+	std::array<CachedPage, CachePages> cache;
+
+	/// Counter used to find the least recently used cache page.
+	uint32_t useCounter;
+
+	/// The page being collected for programming.
+	PendingPage pending;
+
+	/// Returns the SPI controller that the flash is attached to.
+	[[nodiscard, gnu::always_inline]] Capability<volatile SonataSpi> spi()
+	{
+		return MMIO_CAPABILITY(SonataSpi, CHERIOT_SPI_FLASH_DEVICE);
+	}
+
+	/// Drive the (active-low) chip select.
+	void chip_select(bool selected)
+	{
+		auto     gpio   = MMIO_CAPABILITY(SonataGPIO, gpio);
+		uint32_t output = gpio->output;
+		output &= ~(1U << CHERIOT_SPI_FLASH_CHIP_SELECT);
+		output |= uint32_t(!selected) << CHERIOT_SPI_FLASH_CHIP_SELECT;
+		gpio->output = output;
+	}
+
+	/**
+	 * Select the flash and send `command`, followed by `address` (most
+	 * significant byte first) if `addressed` is true and then by a dummy
+	 * byte if `dummy` is true.  The flash stays selected for the rest of the
+	 * operation.
+	 */
+	void begin(Command  command,
+	           bool     addressed = false,
+	           uint32_t address   = 0,
+	           bool     dummy     = false)
+	{
+		uint8_t header[6] = {static_cast<uint8_t>(command),
+		                     uint8_t(address >> 24),
+		                     uint8_t(address >> 16),
+		                     uint8_t(address >> 8),
+		                     uint8_t(address),
+		                     0};
+		chip_select(true);
+		spi()->blocking_write(header, 1 + (addressed ? 4 : 0) + dummy);
+	}
+
+	/// Wait for the last byte to be sent and deselect the flash.
+	void end()
+	{
+		spi()->wait_idle();
+		chip_select(false);
+	}
+
+	/// Read the status register.
+	uint8_t status()
+	{
+		uint8_t value;
+		begin(Command::ReadStatus);
+		spi()->blocking_read(&value, 1);
+		end();
+		return value;
+	}
+
+	/**
+	 * Wait for the flash to finish a program or erase.  If `sleep` is true
+	 * (for erases, which take tens of milliseconds), this sleeps for a tick
+	 * between polls.  Returns 0 or `-ETIMEDOUT`.
+	 */
+	int wait_ready(Timeout *timeout, bool sleep)
+	{
+		while (status() & StatusBusy)
+		{
+			if (!sleep)
+			{
+				continue;
+			}
+			if (!timeout->may_block())
+			{
+				return -ETIMEDOUT;
+			}
+			Timeout tick{1};
+			thread_sleep(&tick);
+			timeout->elapse(tick.elapsed);
+		}
+		return 0;
+	}
+
+	/// Allow the next program or erase command.
+	void write_enable()
+	{
+		begin(Command::WriteEnable);
+		end();
+	}
+
+	/**
+	 * Read `length` bytes from `address` into `buffer` with a single
+	 * fast-read command.
+	 */
+	void read_flash(uint32_t address, uint8_t *buffer, size_t length)
+	{
+		begin(Command::FastRead, true, address, true);
+		// Chip select is a GPIO, so the command continues across several
+		// controller operations.
+		while (length > 0)
+		{
+			uint16_t chunk = std::min<size_t>(length, MaxTransfer);
+			spi()->blocking_read(buffer, chunk);
+			buffer += chunk;
+			length -= chunk;
+		}
+		end();
+	}
+
+	/**
+	 * Probe the flash on first use.  Returns 0 or `-ENODEV`.
+	 */
+	int probe()
+	{
+		if (flashSize != 0)
+		{
+			return 0;
+		}
+		// Mode 0, most significant bit first, at half the system clock.
+		spi()->init(false, false, true, 0);
+		chip_select(false);
+		begin(Command::ReleasePowerDown);
+		end();
+		uint8_t identifier[3];
+		begin(Command::ReadIdentifier);
+		spi()->blocking_read(identifier, sizeof(identifier));
+		end();
+		// The third byte is the base-two logarithm of the size.  A missing
+		// device reads as all zeroes or all ones.
+		uint8_t log2Size = identifier[2];
+		if ((log2Size < 16) || (log2Size > 31))
+		{
+			return -ENODEV;
+		}
+		flashSize = 1U << log2Size;
+		return 0;
+	}
+
+	/// Returns the cached copy of the page at `address`, if there is one.
+	CachedPage *find_page(uint32_t address)
+	{
+		for (auto &page : cache)
+		{
+			if (page.address == address)
+			{
+				page.lastUsed = ++useCounter;
+				return &page;
+			}
+		}
+		return nullptr;
+	}
+
+	/**
+	 * Returns the cached copy of the page at `address`, reading it into the
+	 * least recently used page if it is not cached.
+	 */
+	CachedPage *load_page(uint32_t address)
+	{
+		if (CachedPage *page = find_page(address))
+		{
+			return page;
+		}
+		CachedPage *victim = &*std::min_element(
+		  cache.begin(), cache.end(), [](auto &a, auto &b) {
+			  return a.lastUsed < b.lastUsed;
+		  });
+		victim->address  = InvalidAddress;
+		read_flash(address, victim->data.data(), PageSize);
+		victim->address  = address;
+		victim->lastUsed = ++useCounter;
+		return victim;
+	}
+
+	/**
+	 * Program the pending page, if there is one, and update any cached copy
+	 * of it.  Returns 0 or `-ETIMEDOUT`.
+	 */
+	int flush(Timeout *timeout)
+	{
+		if (pending.address == InvalidAddress)
+		{
+			return 0;
+		}
+		if (int ret = wait_ready(timeout, true); ret != 0)
+		{
+			return ret;
+		}
+		// Bytes outside the written range are all ones, so only the written
+		// range needs to be sent.
+		write_enable();
+		begin(Command::PageProgram, true, pending.address + pending.first);
+		spi()->blocking_write(pending.data.data() + pending.first,
+		                      pending.end - pending.first);
+		end();
+		// Programming a page takes around a millisecond, less than a tick.
+		wait_ready(timeout, false);
+		if (CachedPage *page = find_page(pending.address))
+		{
+			for (uint32_t i = pending.first; i < pending.end; i++)
+			{
+				page->data[i] &= pending.data[i];
+			}
+		}
+		pending.address = InvalidAddress;
+		return 0;
+	}
+
+	/**
+	 * Check that the range is in the flash and probe the flash if necessary.
+	 * Returns 0, `-EINVAL`, or `-ENODEV`.
+	 */
+	int check_range(uint32_t address, size_t length)
+	{
+		if (int ret = probe(); ret != 0)
+		{
+			return ret;
+		}
+		if ((address > flashSize) || (length > flashSize - address))
+		{
+			return -EINVAL;
+		}
+		return 0;
+	}
+} // namespace
+
+ssize_t spi_flash_size()
+{
+	LockGuard g{lock};
+	if (int ret = probe(); ret != 0)
+	{
+		return ret;
+	}
+	return flashSize;
+}
+
+int spi_flash_read(Timeout *timeout,
+                   uint32_t address,
+                   void    *buffer,
+                   size_t   length)
+{
+	if (!check_pointer<PermissionSet{Permission::Store}, false>(buffer,
+	                                                            length) ||
+	    !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, buffer) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = check_range(address, length); ret != 0)
+	{
+		return ret;
+	}
+	if (int ret = flush(timeout); ret != 0)
+	{
+		return ret;
+	}
+	if (int ret = wait_ready(timeout, true); ret != 0)
+	{
+		return ret;
+	}
+	auto *out = static_cast<uint8_t *>(buffer);
+	while (length > 0)
+	{
+		uint32_t pageAddress = address & ~(PageSize - 1);
+		uint32_t offset      = address - pageAddress;
+		uint32_t chunk       = std::min<size_t>(PageSize - offset, length);
+		if (CachedPage *page = find_page(pageAddress))
+		{
+			std::copy_n(page->data.data() + offset, chunk, out);
+		}
+		else if (chunk == PageSize)
+		{
+			// Read whole pages that are not cached directly, so that bulk
+			// reads do not evict the pages that small reads use.
+			uint32_t run = PageSize;
+			while ((run + PageSize <= length) &&
+			       (find_page(address + run) == nullptr))
+			{
+				run += PageSize;
+			}
+			read_flash(address, out, run);
+			chunk = run;
+		}
+		else
+		{
+			CachedPage *page = load_page(pageAddress);
+			std::copy_n(page->data.data() + offset, chunk, out);
+		}
+		address += chunk;
+		out += chunk;
+		length -= chunk;
+	}
+	return 0;
+}
+
+int spi_flash_write(Timeout    *timeout,
+                    uint32_t    address,
+                    const void *buffer,
+                    size_t      length)
+{
+	if (!check_pointer<PermissionSet{Permission::Load}, false>(buffer,
+	                                                           length) ||
+	    !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, buffer) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = check_range(address, length); ret != 0)
+	{
+		return ret;
+	}
+	auto *in = static_cast<const uint8_t *>(buffer);
+	while (length > 0)
+	{
+		uint32_t pageAddress = address & ~(PageSize - 1);
+		uint32_t offset      = address - pageAddress;
+		uint32_t chunk       = std::min<size_t>(PageSize - offset, length);
+		if (pending.address != pageAddress)
+		{
+			if (int ret = flush(timeout); ret != 0)
+			{
+				return ret;
+			}
+			pending.address = pageAddress;
+			pending.first   = offset;
+			pending.end     = offset;
+			pending.data.fill(0xff);
+		}
+		for (uint32_t i = 0; i < chunk; i++)
+		{
+			pending.data[offset + i] &= in[i];
+		}
+		pending.first = std::min<uint32_t>(pending.first, offset);
+		pending.end   = std::max<uint32_t>(pending.end, offset + chunk);
+		// A complete page will not be added to, so program it now.
+		if ((pending.first == 0) && (pending.end == PageSize))
+		{
+			if (int ret = flush(timeout); ret != 0)
+			{
+				return ret;
+			}
+		}
+		address += chunk;
+		in += chunk;
+		length -= chunk;
+	}
+	return 0;
+}
+
+int spi_flash_erase(Timeout *timeout, uint32_t address, size_t length)
+{
+	if (!check_timeout_pointer(timeout) || ((address % SectorSize) != 0) ||
+	    ((length % SectorSize) != 0))
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = check_range(address, length); ret != 0)
+	{
+		return ret;
+	}
+	if (int ret = flush(timeout); ret != 0)
+	{
+		return ret;
+	}
+	while (length > 0)
+	{
+		if (int ret = wait_ready(timeout, true); ret != 0)
+		{
+			return ret;
+		}
+		bool     block = ((address % BlockSize) == 0) && (length >= BlockSize);
+		uint32_t size  = block ? BlockSize : SectorSize;
+		for (auto &page : cache)
+		{
+			if ((page.address >= address) && (page.address < address + size))
+			{
+				page.address  = InvalidAddress;
+				page.lastUsed = 0;
+			}
+		}
+		write_enable();
+		begin(
+		  block ? Command::BlockErase : Command::SectorErase, true, address);
+		end();
+		address += size;
+		length -= size;
+	}
+	return wait_ready(timeout, true);
+}
+
+int spi_flash_sync(Timeout *timeout)
+{
+	if (!check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	if (int ret = probe(); ret != 0)
+	{
+		return ret;
+	}
+	if (int ret = flush(timeout); ret != 0)
+	{
+		return ret;
+	}
+	return wait_ready(timeout, true);
+}
+
+const void *spi_flash_map(uint32_t address, size_t length)
+{
+#if DEVICE_EXISTS(spi_flash_xip)
+	LockGuard g{lock};
+	if (check_range(address, length) != 0)
+	{
+		return nullptr;
+	}
+	Timeout t{UnlimitedTimeout};
+	if ((flush(&t) != 0) || (wait_ready(&t, true) != 0))
+	{
+		return nullptr;
+	}
+	Capability<const void> window{
+	  const_cast<const uint8_t *>(MMIO_CAPABILITY(uint8_t, spi_flash_xip))};
+	window.address() += address;
+	window.bounds()      = length;
+	window.permissions() = PermissionSet{Permission::Load, Permission::Global};
+	return window;
+#else
+	(void)address;
+	(void)length;
+	return nullptr;
+#endif
+}
@@ -0,0 +1,12 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../compartment_helpers")
+
+compartment("spi_flash")
+  set_default(false)
+  add_deps("locks", "compartment_helpers")
+  add_files("spi_flash.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_SPI_FLASH_CACHE_PAGES=" .. math.floor(tonumber(get_config("spi-flash-cache-pages"))))
+  end)
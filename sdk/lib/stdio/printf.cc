@@ -39,8 +39,10 @@
 
 #include <cdefs.h>
 #include <cheri-builtins.h>
+#include <cheri.hh>
 #include <compartment.h>
 #include <cstdint>
+#include <errno.h>
 #include <function_wrapper.hh>
 #include <inttypes.h>
 #include <platform-uart.hh>
@@ -66,11 +68,25 @@ namespace
 /* Max number conversion buffer length: a u_quad_t in base 2, plus NUL byte. */
 #define MAXNBUF (sizeof(intmax_t) * CHAR_BIT + 1)
 
+	/*
+	 * Pairs of decimal digits, so that decimal conversion can produce two
+	 * digits per division.
+	 */
+	constexpr char DecimalPairs[] =
+	  "000102030405060708091011121314151617181920212223242526272829"
+	  "303132333435363738394041424344454647484950515253545556575859"
+	  "606162636465666768697071727374757677787980818283848586878889"
+	  "90919293949596979899";
+
 	/*
 	 * Put a NUL-terminated ASCII number (base <= 36) in a buffer in reverse
 	 * order; return an optional length and a pointer to the last character
 	 * written in the buffer (i.e., the first character of the string).
 	 * The buffer pointed to by `nbuf' must have length >= MAXNBUF.
+	 *
+	 * Ibex has no fast divider, so the common bases avoid division: decimal
+	 * divides by 100 with a reciprocal multiplication and emits two digits
+	 * at a time, and powers of two use shifts and masks.
 	 */
 	// FIXME: Using `unsigned` for `num` instead of `uintmax_t` means that we
 	// are going to truncate large numbers, but it avoids needing a library
@@ -82,11 +98,42 @@ namespace
 
 		p  = nbuf;
 		*p = '\0';
-		do
+		if (base == 10)
 		{
-			c    = hex2ascii(num % base);
-			*++p = upper ? toupper(c) : c;
-		} while (num /= base);
+			while (num >= 100)
+			{
+				// (num * 0x51eb851f) >> 37 == num / 100 for all 32-bit num.
+				unsigned quotient = static_cast<unsigned>(
+				  (static_cast<uint64_t>(num) * 0x51eb851fU) >> 37);
+				unsigned pair = 2 * (num - quotient * 100);
+				*++p          = DecimalPairs[pair + 1];
+				*++p          = DecimalPairs[pair];
+				num           = quotient;
+			}
+			*++p = DecimalPairs[2 * num + 1];
+			if (num >= 10)
+			{
+				*++p = DecimalPairs[2 * num];
+			}
+		}
+		else if ((base & (base - 1)) == 0)
+		{
+			int      shift = __builtin_ctz(base);
+			unsigned mask  = base - 1;
+			do
+			{
+				c    = hex2ascii(num & mask);
+				*++p = upper ? toupper(c) : c;
+			} while (num >>= shift);
+		}
+		else
+		{
+			do
+			{
+				c    = hex2ascii(num % base);
+				*++p = upper ? toupper(c) : c;
+			} while (num /= base);
+		}
 		if (lenp)
 		{
 			*lenp = p - nbuf;
@@ -120,11 +167,12 @@ namespace
 	 *		("%6D", ptr, ":")   -> XX:XX:XX:XX:XX:XX
 	 *		("%*D", len, ptr, " " -> XX XX XX XX ...
 	 */
-	__noinline int kvprintf(char const                *fmt,
-	                        FunctionWrapper<void(int)> func,
-	                        void                      *arg,
-	                        int                        radix,
-	                        va_list                    ap)
+	__noinline int kvprintf(char const                                *fmt,
+	                        FunctionWrapper<void(int)>                 func,
+	                        FunctionWrapper<void(const char *, size_t)> write,
+	                        void                                      *arg,
+	                        int                                        radix,
+	                        va_list                                    ap)
 	{
 		char           nbuf[MAXNBUF];
 		const char    *p, *percent, *q;
@@ -142,6 +190,10 @@ namespace
 			func(c);
 			retval++;
 		};
+		auto putstring = [&](const char *str, size_t length) {
+			write(str, length);
+			retval += length;
+		};
 
 		if (fmt == nullptr)
 		{
@@ -157,13 +209,19 @@ namespace
 		{
 			padc  = ' ';
 			width = 0;
-			while ((ch = static_cast<unsigned char>(*fmt++)) != '%' || stop)
+			// Write runs of literal characters with a single call.
+			const char *run = fmt;
+			while ((*fmt != '\0') && ((*fmt != '%') || stop))
+			{
+				fmt++;
+			}
+			if (fmt != run)
 			{
-				if (ch == '\0')
-				{
-					return (retval);
-				}
-				putchar(ch);
+				putstring(run, fmt - run);
+			}
+			if ((ch = static_cast<unsigned char>(*fmt++)) == '\0')
+			{
+				return (retval);
 			}
 			percent   = fmt - 1;
 			qflag     = 0;
@@ -415,10 +473,7 @@ namespace
 							putchar(padc);
 						}
 					}
-					while (n--)
-					{
-						putchar(*p++);
-					}
+					putstring(p, n);
 					if (ladjust && width > 0)
 					{
 						while (width--)
@@ -626,7 +681,16 @@ vsnprintf(char *str, // NOLINT (clang-tidy spuriously thinks this should be
 			info.remain--;
 		}
 	};
-	int retval = kvprintf(format, callback, &info, 10, ap);
+	auto write = [&](const char *run, size_t length) {
+		if (info.remain >= 2)
+		{
+			size_t copied = (length < info.remain - 1) ? length : info.remain - 1;
+			memcpy(info.str, run, copied);
+			info.str += copied;
+			info.remain -= copied;
+		}
+	};
+	int retval = kvprintf(format, callback, write, &info, 10, ap);
 	if (info.remain >= 1)
 	{
 		*info.str++ = '\0';
@@ -634,15 +698,254 @@ vsnprintf(char *str, // NOLINT (clang-tidy spuriously thinks this should be
 	return (retval);
 }
 
-[[cheri::interrupt_state(disabled)]] int __cheri_libcall
-vfprintf(FILE *stream, const char *fmt, va_list ap)
+namespace
+{
+	/**
+	 * Returns the stream that `file` refers to, or null if it is a UART.
+	 * Memory-mapped UART capabilities cannot load or store capabilities.
+	 */
+	StdioStream *file_stream(FILE *file)
+	{
+		if ((__builtin_cheri_perms_get(const_cast<void *>(file)) &
+		     CHERI_PERM_LOAD_STORE_CAP) == 0)
+		{
+			return nullptr;
+		}
+		return static_cast<StdioStream *>(const_cast<void *>(file));
+	}
+
+	/**
+	 * Write out as much of the stream's buffer as the sink will accept,
+	 * keeping the rest.  Returns true if the buffer is now empty.
+	 */
+	bool stream_flush(StdioStream *stream)
+	{
+		size_t written = 0;
+		while (written < stream->used)
+		{
+			ssize_t result = stream->write(stream->context,
+			                               stream->buffer + written,
+			                               stream->used - written);
+			if (result <= 0)
+			{
+				break;
+			}
+			written += result;
+		}
+		if (written != 0)
+		{
+			stream->used -= written;
+			memmove(stream->buffer, stream->buffer + written, stream->used);
+		}
+		return stream->used == 0;
+	}
+
+	/**
+	 * Write directly to the sink of an unbuffered stream, dropping anything
+	 * that it does not accept.
+	 */
+	void stream_write_through(StdioStream *stream,
+	                          const char  *data,
+	                          size_t       length)
+	{
+		while (length > 0)
+		{
+			ssize_t result = stream->write(stream->context, data, length);
+			if (result <= 0)
+			{
+				stream->dropped += length;
+				return;
+			}
+			data += result;
+			length -= result;
+		}
+	}
+
+	/**
+	 * Append `length` bytes to the stream's buffer, flushing whenever it
+	 * fills.  Returns true if the data contained a newline.
+	 */
+	bool stream_append(StdioStream *stream, const char *data, size_t length)
+	{
+		if (stream->size == 0)
+		{
+			stream_write_through(stream, data, length);
+			return false;
+		}
+		bool newline = false;
+		while (length > 0)
+		{
+			if ((stream->used == stream->size) && !stream_flush(stream) &&
+			    (stream->used == stream->size))
+			{
+				stream->dropped += length;
+				break;
+			}
+			size_t space  = stream->size - stream->used;
+			size_t copied = (length < space) ? length : space;
+			memcpy(stream->buffer + stream->used, data, copied);
+			newline |= (memchr(data, '\n', copied) != nullptr);
+			stream->used += copied;
+			data += copied;
+			length -= copied;
+		}
+		return newline;
+	}
+
+	/**
+	 * Write to a stream and flush if its buffering mode requires it.
+	 * `endOfCall` is true for the last write of a call, which is when
+	 * unbuffered streams are flushed.
+	 */
+	void stream_put(StdioStream *stream,
+	                const char  *data,
+	                size_t       length,
+	                bool         endOfCall)
+	{
+		bool newline = stream_append(stream, data, length);
+		if (((stream->mode == _IOLBF) && newline) ||
+		    ((stream->mode == _IONBF) && endOfCall))
+		{
+			stream_flush(stream);
+		}
+	}
+
+	/**
+	 * Returns true if `mode` is a valid buffering mode.
+	 */
+	bool is_valid_mode(int mode)
+	{
+		return (mode == _IOFBF) || (mode == _IOLBF) || (mode == _IONBF);
+	}
+
+	/**
+	 * Write `length` bytes to a UART, polling for space.  The caller must
+	 * disable interrupts.
+	 */
+	void uart_write_bytes(FILE *stream, const char *data, size_t length)
+	{
+		for (size_t i = 0; i < length; i++)
+		{
+			static_cast<volatile Uart *>(stream)->blocking_write(data[i]);
+		}
+	}
+} // namespace
+
+int __cheri_libcall stdio_stream_init(StdioStream     *stream,
+                                      StdioStreamWrite write,
+                                      void            *context,
+                                      char            *buffer,
+                                      size_t           size,
+                                      int              mode)
+{
+	if ((write == nullptr) || !is_valid_mode(mode))
+	{
+		return -EINVAL;
+	}
+	*stream = {write, context, buffer, buffer == nullptr ? 0 : size, 0, mode, 0};
+	return 0;
+}
+
+[[cheri::interrupt_state(disabled)]] ssize_t __cheri_libcall
+stdio_stream_uart_write(void *uart, const char *data, size_t length)
 {
-	return kvprintf(
-	  fmt,
-	  [=](int ch) { static_cast<volatile Uart *>(stream)->blocking_write(ch); },
-	  nullptr,
-	  10,
-	  ap);
+	uart_write_bytes(uart, data, length);
+	return length;
+}
+
+int __cheri_libcall setvbuf(FILE *file, char *buffer, int mode, size_t size)
+{
+	if (!is_valid_mode(mode))
+	{
+		return EOF;
+	}
+	if (StdioStream *stream = file_stream(file))
+	{
+		stream_flush(stream);
+		// Anything that the sink did not accept is lost with the old buffer.
+		stream->dropped += stream->used;
+		stream->buffer = buffer;
+		stream->size   = (buffer == nullptr) ? 0 : size;
+		stream->used   = 0;
+		stream->mode   = mode;
+	}
+	return 0;
+}
+
+int __cheri_libcall fflush(FILE *file)
+{
+	if (StdioStream *stream = file_stream(file))
+	{
+		return stream_flush(stream) ? 0 : EOF;
+	}
+	return 0;
+}
+
+size_t __cheri_libcall fwrite(const void *data,
+                              size_t      size,
+                              size_t      count,
+                              FILE       *file)
+{
+	size_t length = size * count;
+	if (StdioStream *stream = file_stream(file))
+	{
+		stream_put(stream, static_cast<const char *>(data), length, true);
+	}
+	else
+	{
+		CHERI::with_interrupts_disabled([&]() {
+			uart_write_bytes(file, static_cast<const char *>(data), length);
+		});
+	}
+	return count;
+}
+
+int __cheri_libcall fputs(const char *str, FILE *file)
+{
+	fwrite(str, 1, strlen(str), file);
+	return 0;
+}
+
+int __cheri_libcall fputc(int c, FILE *file)
+{
+	char ch = static_cast<char>(c);
+	fwrite(&ch, 1, 1, file);
+	return static_cast<unsigned char>(c);
+}
+
+int __cheri_libcall vfprintf(FILE *file, const char *fmt, va_list ap)
+{
+	if (StdioStream *stream = file_stream(file))
+	{
+		// Format with interrupts enabled, directly into the stream's buffer.
+		int retval = kvprintf(
+		  fmt,
+		  [=](int ch) {
+			  char c = static_cast<char>(ch);
+			  stream_put(stream, &c, 1, false);
+		  },
+		  [=](const char *run, size_t length) {
+			  stream_put(stream, run, length, false);
+		  },
+		  nullptr,
+		  10,
+		  ap);
+		stream_put(stream, nullptr, 0, true);
+		return retval;
+	}
+	return CHERI::with_interrupts_disabled([&]() {
+		return kvprintf(
+		  fmt,
+		  [=](int ch) {
+			  static_cast<volatile Uart *>(file)->blocking_write(ch);
+		  },
+		  [=](const char *run, size_t length) {
+			  uart_write_bytes(file, run, length);
+		  },
+		  nullptr,
+		  10,
+		  ap);
+	});
 }
 
 int __cheri_libcall snprintf(char *str, size_t size, const char *format, ...)
@@ -1,6 +1,7 @@
 // Copyright SCI Semiconductor and CHERIoT Contributors.
 // SPDX-License-Identifier: MIT
 
+#include "word.h"
 #include <string.h>
 
 void *__cheri_libcall memchr(const void *voidString,
@@ -10,7 +11,35 @@ void *__cheri_libcall memchr(const void *voidString,
 	const unsigned char  c = (unsigned char)intChar;
 	const unsigned char *s = (const unsigned char *)voidString;
 
-	for (size_t i = 0; i != n; i++)
+	for (; (n != 0) && !string_is_aligned(s); n--)
+	{
+		if (*s == c)
+		{
+			return (void *)s;
+		}
+		s++;
+	}
+
+	// Only the part of the range that is within bounds can be read a word at
+	// a time.  Anything after that is read bytewise and traps if `n` was too
+	// large.
+	ptraddr_t top   = string_top(s);
+	ptraddr_t limit = __builtin_cheri_address_get(s) + n;
+	if ((limit > top) || (limit < __builtin_cheri_address_get(s)))
+	{
+		limit = top;
+	}
+	uint32_t pattern = string_word_repeat(c);
+	for (; string_word_fits(s, limit); s += sizeof(StringWord))
+	{
+		if (string_word_has_zero(*(const StringWord *)s ^ pattern))
+		{
+			break;
+		}
+		n -= sizeof(StringWord);
+	}
+
+	for (; n != 0; n--)
 	{
 		if (*s == c)
 		{
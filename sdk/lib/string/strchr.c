@@ -1,8 +1,32 @@
+#include "word.h"
 #include <string.h>
 
 char *__cheri_libcall strchr(const char *s, int intChar)
 {
-	char c = (char)intChar;
+	char      c       = (char)intChar;
+	uint32_t  pattern = string_word_repeat((unsigned char)c);
+	ptraddr_t top     = string_top(s);
+
+	while (!string_is_aligned(s))
+	{
+		if (*s == c)
+		{
+			return (char *)s;
+		}
+		if (!*s++)
+		{
+			return NULL;
+		}
+	}
+	// Skip words that contain neither the terminator nor the character.
+	for (; string_word_fits(s, top); s += sizeof(StringWord))
+	{
+		uint32_t word = *(const StringWord *)s;
+		if (string_word_has_zero(word) || string_word_has_zero(word ^ pattern))
+		{
+			break;
+		}
+	}
 	while (*s != c)
 	{
 		if (!*s++)
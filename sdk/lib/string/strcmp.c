@@ -29,15 +29,41 @@
  * SUCH DAMAGE.
  */
 
+#include "word.h"
 #include <cdefs.h>
 #include <stddef.h>
 
 /*
  * Compare strings.
+ *
+ * If both strings have the same alignment, compare a word at a time once
+ * they are aligned, until a word differs or contains a terminator, and
+ * then finish bytewise.
  */
 int __cheri_libcall
 strcmp(const char *s1, const char *s2)
 {
+	if (((__builtin_cheri_address_get(s1) ^
+	      __builtin_cheri_address_get(s2)) & (sizeof(StringWord) - 1)) == 0) {
+		ptraddr_t top1 = string_top(s1);
+		ptraddr_t top2 = string_top(s2);
+		for (; !string_is_aligned(s1); s1++, s2++) {
+			if (*s1 != *s2)
+				return (*(const unsigned char *)s1 -
+					*(const unsigned char *)s2);
+			if (*s1 == '\0')
+				return (0);
+		}
+		while (string_word_fits(s1, top1) &&
+		    string_word_fits(s2, top2)) {
+			uint32_t w1 = *(const StringWord *)s1;
+			if ((w1 != *(const StringWord *)s2) ||
+			    string_word_has_zero(w1))
+				break;
+			s1 += sizeof(StringWord);
+			s2 += sizeof(StringWord);
+		}
+	}
 	while (*s1 == *s2++)
 		if (*s1++ == '\0')
 			return (0);
@@ -1,14 +1,30 @@
 // Copyright Microsoft and CHERIoT Contributors.
 // SPDX-License-Identifier: MIT
 
+#include "word.h"
 #include <cdefs.h>
 #include <stddef.h>
 
 size_t __cheri_libcall strlen(const char *str)
 {
-	const char *s;
+	const char *s   = str;
+	ptraddr_t   top = string_top(str);
 
-	for (s = str; *s; ++s)
+	for (; !string_is_aligned(s); ++s)
+	{
+		if (!*s)
+		{
+			return (s - str);
+		}
+	}
+	for (; string_word_fits(s, top); s += sizeof(StringWord))
+	{
+		if (string_word_has_zero(*(const StringWord *)s))
+		{
+			break;
+		}
+	}
+	for (; *s; ++s)
 		;
 	return (s - str);
 }
@@ -1,24 +1,218 @@
 // Copyright Microsoft and CHERIoT Contributors.
 // SPDX-License-Identifier: MIT
 
+#include "word.h"
 #include <cdefs.h>
 #include <stddef.h>
 #include <string.h>
 
-char *__cheri_libcall strnstr(const char *haystack,
-                              const char *needle,
-                              size_t      haystackLength)
+/**
+ * Substring search with the Two-Way algorithm of Crochemore and Perrin
+ * ("Two-way string-matching", JACM 38(3), 1991).  This takes time linear in
+ * the length of the haystack and constant space, unlike the naive search,
+ * which is quadratic for needles such as `aaa...ab`.
+ */
+namespace
 {
-	size_t needleLen = strlen(needle);
+	/**
+	 * Returns the start of the maximal suffix of `needle` under the byte
+	 * ordering (if `reversed` is false) or its reverse, and stores the period
+	 * of that suffix in `period`.
+	 */
+	size_t maximal_suffix(const unsigned char *needle,
+	                      size_t               length,
+	                      bool                 reversed,
+	                      size_t              &period)
+	{
+		// `suffix` starts at -1 and relies on unsigned wrapping, so that
+		// `suffix + offset` is the position `offset - 1`.
+		size_t suffix = SIZE_MAX;
+		size_t start  = 0;
+		size_t offset = 1;
+		period        = 1;
+		while (start + offset < length)
+		{
+			unsigned char a = needle[start + offset];
+			unsigned char b = needle[suffix + offset];
+			if (reversed ? (a > b) : (a < b))
+			{
+				// The suffix is smaller, so the period is the whole prefix.
+				start += offset;
+				offset = 1;
+				period = start - suffix;
+			}
+			else if (a == b)
+			{
+				// Advance through a repetition of the current period.
+				if (offset != period)
+				{
+					offset++;
+				}
+				else
+				{
+					start += period;
+					offset = 1;
+				}
+			}
+			else
+			{
+				// The suffix is larger, so start again from here.
+				suffix = start++;
+				offset = period = 1;
+			}
+		}
+		return suffix + 1;
+	}
 
-	while ((haystackLength > needleLen) && (*haystack != 0))
+	/**
+	 * Returns the position of a critical factorisation of `needle` and
+	 * stores its period in `period`.  This is the longer of the maximal
+	 * suffixes under the byte ordering and its reverse.
+	 */
+	size_t critical_factorisation(const unsigned char *needle,
+	                              size_t               length,
+	                              size_t              &period)
 	{
-		if (strncmp(haystack, needle, needleLen) == 0)
+		size_t reversedPeriod;
+		size_t forward  = maximal_suffix(needle, length, false, period);
+		size_t backward = maximal_suffix(needle, length, true, reversedPeriod);
+		if (forward >= backward)
 		{
-			return const_cast<char *>(haystack);
+			return forward;
 		}
-		haystack++;
-		haystackLength--;
+		period = reversedPeriod;
+		return backward;
+	}
+
+	/**
+	 * Two-Way search for `needle` in `haystack`.  The needle must be neither
+	 * empty nor longer than the haystack.
+	 */
+	const unsigned char *two_way(const unsigned char *haystack,
+	                             size_t               haystackLength,
+	                             const unsigned char *needle,
+	                             size_t               needleLength)
+	{
+		size_t period;
+		size_t split = critical_factorisation(needle, needleLength, period);
+		size_t last  = haystackLength - needleLength;
+		if (memcmp(needle, needle + period, split) == 0)
+		{
+			// The needle is periodic.  After a mismatch in the left half, the
+			// needle can move only by the period, so remember how much of the
+			// right half is already known to match.
+			size_t memory = 0;
+			for (size_t position = 0; position <= last;)
+			{
+				size_t i = split > memory ? split : memory;
+				while ((i < needleLength) &&
+				       (needle[i] == haystack[position + i]))
+				{
+					i++;
+				}
+				if (i < needleLength)
+				{
+					position += i - split + 1;
+					memory = 0;
+					continue;
+				}
+				i = split;
+				while ((i > memory) &&
+				       (needle[i - 1] == haystack[position + i - 1]))
+				{
+					i--;
+				}
+				if (i <= memory)
+				{
+					return haystack + position;
+				}
+				position += period;
+				memory = needleLength - period;
+			}
+			return nullptr;
+		}
+		// The two halves of the needle are distinct, so any mismatch allows
+		// a maximal shift and no memory is needed.
+		size_t right = needleLength - split;
+		period       = (split > right ? split : right) + 1;
+		for (size_t position = 0; position <= last;)
+		{
+			size_t i = split;
+			while ((i < needleLength) && (needle[i] == haystack[position + i]))
+			{
+				i++;
+			}
+			if (i < needleLength)
+			{
+				position += i - split + 1;
+				continue;
+			}
+			i = split;
+			while ((i > 0) && (needle[i - 1] == haystack[position + i - 1]))
+			{
+				i--;
+			}
+			if (i == 0)
+			{
+				return haystack + position;
+			}
+			position += period;
+		}
+		return nullptr;
+	}
+} // namespace
+
+void *__cheri_libcall memmem(const void *haystack,
+                             size_t      haystackLength,
+                             const void *needle,
+                             size_t      needleLength)
+{
+	auto *h = static_cast<const unsigned char *>(haystack);
+	auto *n = static_cast<const unsigned char *>(needle);
+	if (needleLength == 0)
+	{
+		return const_cast<void *>(haystack);
+	}
+	if (needleLength > haystackLength)
+	{
+		return nullptr;
+	}
+	// Skip to the first occurrence of the first byte of the needle with the
+	// word-at-a-time `memchr`.  This is all that is needed for one-byte
+	// needles.
+	auto *first =
+	  static_cast<const unsigned char *>(memchr(h, n[0], haystackLength));
+	if ((first == nullptr) || (needleLength == 1))
+	{
+		return const_cast<unsigned char *>(first);
+	}
+	haystackLength -= first - h;
+	if (needleLength > haystackLength)
+	{
+		return nullptr;
+	}
+	return const_cast<unsigned char *>(
+	  two_way(first, haystackLength, n, needleLength));
+}
+
+char *__cheri_libcall strnstr(const char *haystack,
+                              const char *needle,
+                              size_t      haystackLength)
+{
+	// Find the end of the haystack with a single word-at-a-time scan, bounded
+	// by the capability as well as by the length so that `strstr` (which
+	// passes `SIZE_MAX`) does not need a separate `strlen`.
+	ptraddr_t address   = __builtin_cheri_address_get(haystack);
+	ptraddr_t top       = string_top(haystack);
+	size_t    available = (address < top) ? top - address : 0;
+	if (haystackLength > available)
+	{
+		haystackLength = available;
+	}
+	if (const void *end = memchr(haystack, 0, haystackLength))
+	{
+		haystackLength = static_cast<const char *>(end) - haystack;
 	}
-	return nullptr;
+	return static_cast<char *>(
+	  memmem(haystack, haystackLength, needle, strlen(needle)));
 }
@@ -0,0 +1,67 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Helpers for the word-at-a-time string functions.
+ *
+ * These functions read a 32-bit word at a time once the pointer is word
+ * aligned.  An aligned word load never crosses a page boundary, but on CHERIoT
+ * it may still cross the top of the capability (bounds are byte-granular for
+ * small objects), so each word load is guarded by a check that the whole word
+ * is within bounds.  The functions fall back to byte loads for the tail of the
+ * object, which then traps in exactly the same place as the byte-at-a-time
+ * versions would have done.
+ */
+
+/**
+ * A word that may alias any other type, so that loading strings through it
+ * does not violate strict aliasing.
+ */
+typedef uint32_t __attribute__((may_alias)) StringWord;
+
+/**
+ * Returns the address one past the end of the bounds of `p`.
+ */
+static inline ptraddr_t string_top(const void *p)
+{
+	return __builtin_cheri_base_get(p) + __builtin_cheri_length_get(p);
+}
+
+/**
+ * Returns true if `p` is word aligned.
+ */
+static inline _Bool string_is_aligned(const void *p)
+{
+	return (__builtin_cheri_address_get(p) & (sizeof(StringWord) - 1)) == 0;
+}
+
+/**
+ * Returns true if a full word can be loaded from `p` without going past `top`.
+ */
+static inline _Bool string_word_fits(const void *p, ptraddr_t top)
+{
+	return __builtin_cheri_address_get(p) + sizeof(StringWord) <= top;
+}
+
+/**
+ * Returns non-zero if any byte of `word` is zero.  This is the classic
+ * (x - 0x01...) & ~x & 0x80... test: it may report false positives only in
+ * bytes above an actual zero byte, which never matters because callers rescan
+ * the word a byte at a time.
+ */
+static inline uint32_t string_word_has_zero(uint32_t word)
+{
+	return (word - 0x01010101U) & ~word & 0x80808080U;
+}
+
+/**
+ * Returns a word with `c` in every byte.
+ */
+static inline uint32_t string_word_repeat(unsigned char c)
+{
+	return c * 0x01010101U;
+}
@@ -1,57 +1,411 @@
 // Copyright Microsoft and CHERIoT Contributors.
 // SPDX-License-Identifier: MIT
 
+#include <algorithm>
+#include <atomic>
 #include <errno.h>
-#include <queue.h>
-#include <ring_buffer.hh>
+#include <locks.hh>
 #include <thread.h>
 #include <thread_pool.h>
 
 using namespace CHERI;
 
+#ifndef THREAD_POOL_QUEUE_DEPTH
+#	define THREAD_POOL_QUEUE_DEPTH 8
+#endif
+#ifndef THREAD_POOL_WORKERS
+#	define THREAD_POOL_WORKERS 2
+#endif
+
 namespace
 {
+	/**
+	 * The number of messages that each worker's queue can hold.
+	 */
+	constexpr size_t QueueDepth = THREAD_POOL_QUEUE_DEPTH;
+	static_assert((QueueDepth > 0) && (QueueDepth <= 32),
+	              "Thread pool queues use a 32-bit mask of used slots");
+
+	/**
+	 * The number of per-worker queues.  Worker threads are assigned queues
+	 * round-robin as they start, so this should be the number of threads
+	 * whose entry point is `thread_pool_run`.
+	 */
+	constexpr size_t Workers = THREAD_POOL_WORKERS;
+	static_assert(Workers > 0, "The thread pool needs at least one queue");
 
 	/**
-	 * Ring buffer.  We use a ticket lock to ensure that things are dispatched
-	 * in order (independent of priority) on the sending side and a flag lock on
-	 * the other side to ensure that the highest-priority thread picks up
-	 * messages as soon as they're ready.
+	 * The number of priority buckets.  Messages in higher buckets are run
+	 * before messages in lower ones, messages in the same bucket are run in
+	 * the order in which they were submitted.
 	 */
-	RingBuffer<ThreadPoolMessage, 16, TicketLock, FlagLock> queue;
+	constexpr uint32_t PriorityBuckets = 4;
+
+	/**
+	 * Returns the bucket for a message with the given priority.  Messages
+	 * that run at the worker's priority go in the top bucket, because no
+	 * worker will run anything at a higher priority.  Explicit priorities
+	 * share the remaining buckets, with all priorities above the number of
+	 * buckets in the highest of them.
+	 */
+	uint32_t bucket_for_priority(int priority)
+	{
+		if (priority == ThreadPoolDefaultPriority)
+		{
+			return PriorityBuckets - 1;
+		}
+		return std::min<uint32_t>(priority, PriorityBuckets - 2);
+	}
+
+	/**
+	 * A worker's queue.  Slots are allocated from a fixed array and threaded
+	 * onto one FIFO list per priority bucket, so the queue as a whole holds
+	 * `QueueDepth` messages irrespective of how they are spread across
+	 * priorities.  Each queue has its own lock, so submitters and workers
+	 * contend only when they pick the same queue.  The set of non-empty
+	 * buckets can be read without the lock, so that workers can choose a
+	 * queue to take from (or steal from) without locking all of them.
+	 *
+	 * All-zero is an empty queue.
+	 */
+	class WorkQueue
+	{
+		/**
+		 * Lock protecting everything other than `occupied`'s readers.
+		 */
+		FlagLock lock;
+
+		/**
+		 * The messages.
+		 */
+		ThreadPoolMessage slots[QueueDepth];
+
+		/**
+		 * For each slot, the next slot in the same bucket, plus one.  Zero
+		 * marks the end of the list.
+		 */
+		uint8_t next[QueueDepth];
+
+		/**
+		 * The first and last slots in each bucket, plus one, or zero if the
+		 * bucket is empty.
+		 */
+		uint8_t head[PriorityBuckets];
+		uint8_t tail[PriorityBuckets];
+
+		/**
+		 * Bitmask of slots that hold messages.
+		 */
+		uint32_t used;
+
+		/**
+		 * Bitmask of non-empty buckets.  Modified only with the lock held.
+		 */
+		std::atomic<uint32_t> occupied;
+
+		public:
+		/**
+		 * Returns the highest non-empty bucket plus one, or zero if the queue
+		 * is empty.  This is a hint: the queue may change before the caller
+		 * acquires the lock.
+		 */
+		uint32_t top_bucket()
+		{
+			uint32_t mask = occupied.load(std::memory_order_relaxed);
+			return (mask == 0) ? 0 : 32 - __builtin_clz(mask);
+		}
+
+		/**
+		 * Append `message` to `bucket`.  Returns false if the queue is full.
+		 */
+		bool try_push(const ThreadPoolMessage &message, uint32_t bucket)
+		{
+			LockGuard g{lock};
+			if (used == (uint32_t(-1) >> (32 - QueueDepth)))
+			{
+				return false;
+			}
+			uint32_t slot = __builtin_ctz(~used);
+			used |= 1U << slot;
+			slots[slot] = message;
+			next[slot]  = 0;
+			if (tail[bucket] != 0)
+			{
+				next[tail[bucket] - 1] = slot + 1;
+			}
+			else
+			{
+				head[bucket] = slot + 1;
+			}
+			tail[bucket] = slot + 1;
+			occupied.store(occupied.load(std::memory_order_relaxed) |
+			               (1U << bucket));
+			return true;
+		}
+
+		/**
+		 * Remove the oldest message in the highest non-empty bucket and
+		 * store it in `message`.  Returns false if the queue is empty.
+		 */
+		bool try_pop(ThreadPoolMessage &message)
+		{
+			LockGuard g{lock};
+			uint32_t  mask = occupied.load(std::memory_order_relaxed);
+			if (mask == 0)
+			{
+				return false;
+			}
+			uint32_t bucket = 31 - __builtin_clz(mask);
+			uint32_t slot   = head[bucket] - 1;
+			message         = slots[slot];
+			head[bucket]    = next[slot];
+			if (head[bucket] == 0)
+			{
+				tail[bucket] = 0;
+				occupied.store(mask & ~(1U << bucket));
+			}
+			used &= ~(1U << slot);
+			return true;
+		}
+	};
+
+	/**
+	 * The per-worker queues.
+	 */
+	WorkQueue queues[Workers];
+
+	/**
+	 * The queue that the next submission tries first.  Submissions are spread
+	 * round-robin across the queues and fall back to the others if that one
+	 * is full.
+	 */
+	std::atomic<uint32_t> nextQueue;
+
+	/**
+	 * The number of workers that have started, used to assign each worker its
+	 * own queue.
+	 */
+	std::atomic<uint32_t> workerCount;
+
+	/**
+	 * Incremented after each message is queued.  Idle workers wait on this.
+	 */
+	std::atomic<uint32_t> workGeneration;
+
+	/**
+	 * The number of workers waiting on `workGeneration`, so that submitters
+	 * can skip the wake when every worker is busy.
+	 */
+	std::atomic<uint32_t> sleepingWorkers;
+
+	/**
+	 * Incremented after each message is removed from a queue.  Blocking
+	 * submitters wait on this when all queues are full.
+	 */
+	std::atomic<uint32_t> spaceGeneration;
+
+	/**
+	 * The number of submitters waiting on `spaceGeneration`.
+	 */
+	std::atomic<uint32_t> spaceWaiters;
+
+	/**
+	 * Queue `message`, trying each queue in turn.  If all queues are full,
+	 * blocks until a worker takes a message if `block` is true, or returns
+	 * `-EAGAIN` otherwise.
+	 */
+	int submit(const ThreadPoolMessage &message, bool block)
+	{
+		uint32_t bucket = bucket_for_priority(message.priority);
+		while (true)
+		{
+			// Read the generation before trying the queues, so that a message
+			// taken after we find them full changes it and we do not sleep.
+			uint32_t space = spaceGeneration.load();
+			uint32_t first = nextQueue.fetch_add(1);
+			for (uint32_t i = 0; i < Workers; i++)
+			{
+				if (queues[(first + i) % Workers].try_push(message, bucket))
+				{
+					workGeneration.fetch_add(1);
+					if (sleepingWorkers.load() > 0)
+					{
+						workGeneration.notify_one();
+					}
+					return 0;
+				}
+			}
+			if (!block)
+			{
+				return -EAGAIN;
+			}
+			spaceWaiters.fetch_add(1);
+			spaceGeneration.wait(space);
+			spaceWaiters.fetch_sub(1);
+		}
+	}
+
+	/**
+	 * Take the highest-priority message available to the worker that owns
+	 * queue `self`.  The worker's own queue is preferred, but a worker steals
+	 * from another queue if that queue has a message in a higher bucket or
+	 * its own queue is empty.  Returns false if all queues are empty.
+	 */
+	bool take(uint32_t self, ThreadPoolMessage &message)
+	{
+		while (true)
+		{
+			uint32_t best    = self;
+			uint32_t bestTop = queues[self].top_bucket();
+			for (uint32_t i = 1; i < Workers; i++)
+			{
+				uint32_t candidate = (self + i) % Workers;
+				uint32_t top       = queues[candidate].top_bucket();
+				if (top > bestTop)
+				{
+					best    = candidate;
+					bestTop = top;
+				}
+			}
+			if (bestTop == 0)
+			{
+				return false;
+			}
+			// If another worker emptied the queue first, look again.
+			if (queues[best].try_pop(message))
+			{
+				spaceGeneration.fetch_add(1);
+				if (spaceWaiters.load() > 0)
+				{
+					spaceGeneration.notify_all();
+				}
+				return true;
+			}
+		}
+	}
+
+	/**
+	 * Run the callback in `message` at the requested priority and then
+	 * signal completion, if requested.
+	 */
+	void run_message(ThreadPoolMessage &message)
+	{
+		if (message.priority == ThreadPoolDefaultPriority)
+		{
+			message.invoke(message.data);
+		}
+		else
+		{
+			// Run the callback at the requested priority and then return to
+			// our own priority to wait for the next message.  If the
+			// requested priority is higher than ours, this fails and the
+			// callback runs at our priority.
+			int ourPriority = thread_priority_set(message.priority);
+			message.invoke(message.data);
+			if (ourPriority >= 0)
+			{
+				thread_priority_set(ourPriority);
+			}
+		}
+		if (message.completion != nullptr)
+		{
+			auto *completion =
+			  reinterpret_cast<std::atomic<uint32_t> *>(message.completion);
+			completion->fetch_add(1);
+			completion->notify_all();
+		}
+	}
 
 } // namespace
 
 int thread_pool_async(ThreadPoolCallback fn, void *data)
 {
-	Capability<void> fnCap{reinterpret_cast<void *>(fn)};
-	Capability<void> dataCap{data};
-	// The function must be sealed with the type used for export table entries
-	// for us to be able to invoke it.  The data capability doesn't *have* to
-	// be sealed, but it's a bad idea if it is unsealed because it adds the
-	// thread pool to the TCB for confidentiality and integrity.
-	// We want to avoid this being able to make us trap and so we validate that
-	// the function is cross-compartment entry point and both can be stored in
-	// the message queue.
-	if (!fnCap.is_valid() || (fnCap.type() != 9) ||
-	    !fnCap.permissions().contains(Permission::Global) ||
-	    (dataCap.is_valid() && !dataCap.is_sealed()) ||
-	    (dataCap.is_valid() &&
-	     !dataCap.permissions().contains(Permission::Global)))
+	return thread_pool_async_priority(fn, data, ThreadPoolDefaultPriority);
+}
+
+int thread_pool_async_priority(ThreadPoolCallback fn, void *data, int priority)
+{
+	return thread_pool_async_completion(fn, data, priority, nullptr);
+}
+
+namespace
+{
+	/**
+	 * Check the arguments to the `thread_pool_async` family of functions and
+	 * queue the message.  See `submit` for the meaning of `block`.
+	 */
+	int async_message(ThreadPoolCallback fn,
+	                  void              *data,
+	                  int                priority,
+	                  uint32_t          *completion,
+	                  bool               block)
 	{
-		return -EINVAL;
+		Capability<void> fnCap{reinterpret_cast<void *>(fn)};
+		Capability<void> dataCap{data};
+		// The function must be sealed with the type used for export table
+		// entries for us to be able to invoke it.  The data capability doesn't
+		// *have* to be sealed, but it's a bad idea if it is unsealed because
+		// it adds the thread pool to the TCB for confidentiality and
+		// integrity.  We want to avoid this being able to make us trap and so
+		// we validate that the function is cross-compartment entry point and
+		// both can be stored in the queue.
+		if (!fnCap.is_valid() || (fnCap.type() != 9) ||
+		    !fnCap.permissions().contains(Permission::Global) ||
+		    (dataCap.is_valid() && !dataCap.is_sealed()) ||
+		    (dataCap.is_valid() &&
+		     !dataCap.permissions().contains(Permission::Global)) ||
+		    (priority < ThreadPoolDefaultPriority) ||
+		    (priority > UINT8_MAX))
+		{
+			return -EINVAL;
+		}
+		// The completion word is written after we return, so it must not be
+		// on the caller's stack, and we must not trap when we write to it.
+		if ((completion != nullptr) &&
+		    !check_pointer<PermissionSet{
+		      Permission::Load, Permission::Store, Permission::Global}>(
+		      completion))
+		{
+			return -EINVAL;
+		}
+
+		return submit({fn, data, priority, completion}, block);
 	}
+} // namespace
 
-	queue.push({fn, data});
+int thread_pool_async_completion(ThreadPoolCallback fn,
+                                 void              *data,
+                                 int                priority,
+                                 uint32_t          *completion)
+{
+	return async_message(fn, data, priority, completion, true);
+}
 
-	return 0;
+int thread_pool_try_async(ThreadPoolCallback fn,
+                          void              *data,
+                          int                priority,
+                          uint32_t          *completion)
+{
+	return async_message(fn, data, priority, completion, false);
 }
 
 void __cheri_compartment("thread_pool") thread_pool_run()
 {
+	uint32_t self = workerCount.fetch_add(1) % Workers;
 	while (true)
 	{
-		ThreadPoolMessage message = queue.pop();
-		message.invoke(message.data);
+		// Read the generation before looking for work, so that a message
+		// queued after we find the queues empty changes it and we do not
+		// sleep.
+		uint32_t          generation = workGeneration.load();
+		ThreadPoolMessage message;
+		if (take(self, message))
+		{
+			run_message(message);
+			continue;
+		}
+		sleepingWorkers.fetch_add(1);
+		workGeneration.wait(generation);
+		sleepingWorkers.fetch_sub(1);
 	}
 }
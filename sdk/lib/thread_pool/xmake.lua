@@ -4,3 +4,7 @@
 compartment("thread_pool")
     set_default(false)
     add_files("../thread_pool/thread_pool.cc")
+    on_load(function (target)
+        target:add('defines', "THREAD_POOL_QUEUE_DEPTH=" .. math.floor(tonumber(get_config("thread-pool-queue-depth"))))
+        target:add('defines', "THREAD_POOL_WORKERS=" .. math.floor(tonumber(get_config("thread-pool-workers"))))
+    end)
@@ -0,0 +1,345 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <atomic>
+#include <cheri.hh>
+#include <compartment.h>
+#include <errno.h>
+#include <locks.hh>
+#include <riscvreg.h>
+#include <tick_macros.h>
+#include <timeout.h>
+#include <timer_service.h>
+#include <token.h>
+
+using namespace CHERI;
+
+using Debug = ConditionalDebug<false, "Timer service">;
+
+#ifndef TIMER_SERVICE_MAX_TIMERS
+#	define TIMER_SERVICE_MAX_TIMERS 16
+#endif
+
+namespace
+{
+	/**
+	 * The maximum number of timers that can be running at once.
+	 */
+	constexpr size_t MaxRunningTimers = TIMER_SERVICE_MAX_TIMERS;
+	static_assert(MaxRunningTimers > 0,
+	              "The timer service must allow at least one running timer");
+
+	/**
+	 * The state of a timer.  Instances are allocated from the creator's
+	 * quota and sealed with `timer_key()`.
+	 */
+	struct TimerState
+	{
+		/// The callback to invoke when the timer expires.
+		TimerServiceCallback invoke;
+		/// The data passed to `timer_service_create`.
+		void *data;
+		/// The sealed handle to this timer.
+		SObj handle;
+		/// The period, in cycles.
+		uint64_t period;
+		/**
+		 * The value of the cycle counter at which the timer next expires,
+		 * or 0 if it is not running.
+		 */
+		uint64_t deadline;
+		/// The flags passed to `timer_service_create`.
+		uint32_t flags;
+	};
+
+	__always_inline SKey timer_key()
+	{
+		return STATIC_SEALING_TYPE(TimerServiceHandle);
+	}
+
+	/**
+	 * Lock protecting the running timers.
+	 */
+	FlagLock lock;
+
+	/**
+	 * The running timers.  The first `runningCount` entries are valid.
+	 */
+	TimerState *running[MaxRunningTimers];
+
+	/**
+	 * The number of running timers.
+	 */
+	size_t runningCount;
+
+	/**
+	 * Incremented whenever the set of running timers changes.  The service
+	 * thread waits on this until the next timer expires.
+	 */
+	std::atomic<uint32_t> generation;
+
+	/**
+	 * Returns the unsealed timer for `handle`, or null if it is not a timer.
+	 */
+	TimerState *unseal(SObj handle)
+	{
+		return token_unseal(timer_key(), Sealed<TimerState>{handle});
+	}
+
+	/**
+	 * Converts a period in ticks to cycles.
+	 */
+	uint64_t period_cycles(Ticks period)
+	{
+		return uint64_t(period) * TIMERCYCLES_PER_TICK;
+	}
+
+	/**
+	 * Wake the service thread so that it recomputes the next expiry.
+	 */
+	void wake_service()
+	{
+		generation.fetch_add(1);
+		generation.notify_one();
+	}
+
+	/**
+	 * Remove `timer` from the running timers.  Must be called with the lock
+	 * held.
+	 */
+	void remove_locked(TimerState *timer)
+	{
+		if (timer->deadline == 0)
+		{
+			return;
+		}
+		timer->deadline = 0;
+		for (size_t i = 0; i < runningCount; i++)
+		{
+			if (running[i] == timer)
+			{
+				// Order does not matter, so move the last timer into the gap.
+				running[i]            = running[--runningCount];
+				running[runningCount] = nullptr;
+				return;
+			}
+		}
+	}
+
+	/**
+	 * Start `timer`, or restart it if it is running, so that it next expires
+	 * one period from now.  Returns 0 on success or `-ENOSPC` if too many
+	 * timers are running.
+	 */
+	int start(TimerState *timer)
+	{
+		{
+			LockGuard g{lock};
+			if (timer->deadline == 0)
+			{
+				if (runningCount == MaxRunningTimers)
+				{
+					return -ENOSPC;
+				}
+				running[runningCount++] = timer;
+			}
+			timer->deadline = rdcycle64() + timer->period;
+		}
+		wake_service();
+		return 0;
+	}
+
+	/**
+	 * Returns true if `fn` is a callback that the service can invoke.
+	 */
+	bool is_callback(TimerServiceCallback fn)
+	{
+		Capability<void> fnCap{reinterpret_cast<void *>(fn)};
+		// As with the thread pool, the function must be sealed with the type
+		// used for export table entries for us to be able to invoke it.
+		return fnCap.is_valid() && (fnCap.type() == 9) &&
+		       fnCap.permissions().contains(Permission::Global);
+	}
+} // namespace
+
+int timer_service_create(Timeout             *timeout,
+                         SObjStruct          *heapCapability,
+                         SObjStruct         **outTimer,
+                         TimerServiceCallback fn,
+                         void                *data,
+                         Ticks                period,
+                         uint32_t             flags)
+{
+	Capability<void> dataCap{data};
+	// Data that is passed to the callback must not expose our compartment's
+	// view of the caller's memory, so it must be sealed.  Data that is only
+	// returned from `timer_service_data` is stored and so must be global.
+	bool passHandle = (flags & TimerServicePassHandle) != 0;
+	if (!is_callback(fn) || (period == 0) ||
+	    ((flags & ~(TimerServicePeriodic | TimerServicePassHandle)) != 0) ||
+	    (dataCap.is_valid() &&
+	     (!dataCap.permissions().contains(Permission::Global) ||
+	      (!passHandle && !dataCap.is_sealed()))) ||
+	    !check_timeout_pointer(timeout) ||
+	    !check_pointer<PermissionSet{Permission::Store}>(outTimer))
+	{
+		return -EINVAL;
+	}
+	void *unsealed = nullptr;
+	// The allocator zeroes the object, so the new timer is stopped.
+	SObj sealed = token_sealed_unsealed_alloc(
+	  timeout, heapCapability, timer_key(), sizeof(TimerState), &unsealed);
+	if (unsealed == nullptr)
+	{
+		return -ENOMEM;
+	}
+	auto *timer   = static_cast<TimerState *>(unsealed);
+	timer->invoke = fn;
+	timer->data   = data;
+	timer->handle = sealed;
+	timer->period = period_cycles(period);
+	timer->flags  = flags;
+	*outTimer     = sealed;
+	return 0;
+}
+
+int timer_service_start(SObjStruct *timerHandle)
+{
+	TimerState *timer = unseal(timerHandle);
+	if (timer == nullptr)
+	{
+		return -EINVAL;
+	}
+	return start(timer);
+}
+
+int timer_service_stop(SObjStruct *timerHandle)
+{
+	TimerState *timer = unseal(timerHandle);
+	if (timer == nullptr)
+	{
+		return -EINVAL;
+	}
+	{
+		LockGuard g{lock};
+		remove_locked(timer);
+	}
+	wake_service();
+	return 0;
+}
+
+int timer_service_change_period(SObjStruct *timerHandle, Ticks period)
+{
+	TimerState *timer = unseal(timerHandle);
+	if ((timer == nullptr) || (period == 0))
+	{
+		return -EINVAL;
+	}
+	{
+		LockGuard g{lock};
+		timer->period = period_cycles(period);
+	}
+	return start(timer);
+}
+
+int timer_service_is_active(SObjStruct *timerHandle)
+{
+	TimerState *timer = unseal(timerHandle);
+	if (timer == nullptr)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{lock};
+	return timer->deadline != 0;
+}
+
+void *timer_service_data(SObjStruct *timerHandle)
+{
+	TimerState *timer = unseal(timerHandle);
+	return (timer == nullptr) ? nullptr : timer->data;
+}
+
+int timer_service_destroy(SObjStruct *heapCapability, SObjStruct *timerHandle)
+{
+	TimerState *timer = unseal(timerHandle);
+	if (timer == nullptr)
+	{
+		return -EINVAL;
+	}
+	{
+		LockGuard g{lock};
+		remove_locked(timer);
+	}
+	return token_obj_destroy(heapCapability, timer_key(), timerHandle);
+}
+
+void timer_service_run()
+{
+	while (true)
+	{
+		// Read the generation before looking at the timers, so that a change
+		// made after we look makes the wait below return immediately.
+		uint32_t             observed = generation.load();
+		TimerServiceCallback invoke   = nullptr;
+		void                *argument = nullptr;
+		uint64_t             next     = 0;
+		{
+			LockGuard g{lock};
+			uint64_t  now      = rdcycle64();
+			size_t    earliest = 0;
+			for (size_t i = 0; i < runningCount;)
+			{
+				// If the creator's quota has been freed underneath the timer,
+				// the load barrier has cleared the tag.  Forget the timer.
+				if (!Capability{running[i]}.is_valid())
+				{
+					Debug::log("Dropping freed timer {}", running[i]);
+					running[i]            = running[--runningCount];
+					running[runningCount] = nullptr;
+					continue;
+				}
+				if (running[i]->deadline < running[earliest]->deadline)
+				{
+					earliest = i;
+				}
+				i++;
+			}
+			if (runningCount > 0)
+			{
+				TimerState *timer = running[earliest];
+				next              = timer->deadline;
+				if (next <= now)
+				{
+					invoke   = timer->invoke;
+					argument = (timer->flags & TimerServicePassHandle)
+					             ? timer->handle
+					             : timer->data;
+					if ((timer->flags & TimerServicePeriodic) == 0)
+					{
+						remove_locked(timer);
+					}
+					else if (next + timer->period <= now)
+					{
+						// We have missed at least one expiry.  Skip the missed
+						// ones rather than calling the callback in a burst.
+						timer->deadline = now + timer->period;
+					}
+					else
+					{
+						timer->deadline = next + timer->period;
+					}
+				}
+			}
+		}
+		// Call the callback without holding the lock, so that it can start,
+		// stop, or destroy timers (including its own).
+		if (invoke != nullptr)
+		{
+			invoke(argument);
+			continue;
+		}
+		Timeout t = (next == 0) ? Timeout{UnlimitedTimeout}
+		                        : Timeout::until(next);
+		generation.wait(&t, observed);
+	}
+}
@@ -0,0 +1,12 @@
+-- Copyright CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../compartment_helpers")
+
+compartment("timer_service")
+  set_default(false)
+  add_deps("locks", "compartment_helpers")
+  add_files("timer_service.cc")
+  on_load(function (target)
+	target:add('defines', "TIMER_SERVICE_MAX_TIMERS=" .. math.floor(tonumber(get_config("timer-service-max-timers"))))
+  end)
@@ -0,0 +1,350 @@
+// Copyright Microsoft and CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#include <array>
+#include <cheri.hh>
+#include <cheriot-atomic.hh>
+#include <compartment.h>
+#include <errno.h>
+#include <interrupt.h>
+#include <locks.hh>
+#include <platform-uart.hh>
+#include <stdlib.h>
+#include <string.h>
+#include <uart_driver.h>
+
+using namespace CHERI;
+
+#ifndef CHERIOT_UART_DRIVER_INTERRUPT
+#	define CHERIOT_UART_DRIVER_INTERRUPT UartRxWatermark
+#endif
+
+#ifndef CHERIOT_UART_DRIVER_TRANSMIT_INTERRUPT
+#	define CHERIOT_UART_DRIVER_TRANSMIT_INTERRUPT 0
+#endif
+
+#ifndef CHERIOT_UART_DRIVER_BUFFER_SIZE
+#	define CHERIOT_UART_DRIVER_BUFFER_SIZE 256
+#endif
+
+DECLARE_AND_DEFINE_INTERRUPT_CAPABILITY(uartInterrupt,
+                                        InterruptName::
+                                          CHERIOT_UART_DRIVER_INTERRUPT,
+                                        true,
+                                        true);
+
+namespace
+{
+	/**
+	 * Does the UART interrupt also carry the transmit watermark interrupt?
+	 */
+	constexpr bool TransmitInterrupt = CHERIOT_UART_DRIVER_TRANSMIT_INTERRUPT;
+
+	/**
+	 * A single-producer, single-consumer ring of bytes.  The driver thread is
+	 * one end of each ring, and the other end is serialised by a lock.
+	 *
+	 * Both counters are free running.  Each is a futex: readers wait for
+	 * `produced` to change and writers wait for `consumed` to change.
+	 */
+	template<size_t Size>
+	struct ByteRing
+	{
+		static_assert((Size & (Size - 1)) == 0,
+		              "UART driver buffer size must be a power of two");
+
+		/// The number of bytes ever added.
+		cheriot::atomic<uint32_t> produced;
+
+		/// The number of bytes ever removed.
+		cheriot::atomic<uint32_t> consumed;
+
+		/// The bytes.
+		std::array<uint8_t, Size> data;
+
+		/// Returns the number of bytes that can be removed.
+		uint32_t used()
+		{
+			return produced.load() - consumed.load();
+		}
+
+		/// Returns the number of bytes that can be added.
+		uint32_t space()
+		{
+			return Size - used();
+		}
+
+		/**
+		 * Copy up to `length` bytes in from `buffer`, returning the number
+		 * copied.  Must be called only by the producer.
+		 */
+		uint32_t push(const uint8_t *buffer, size_t length)
+		{
+			uint32_t count = std::min<size_t>(space(), length);
+			uint32_t start = produced.load();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				data[(start + i) & (Size - 1)] = buffer[i];
+			}
+			produced.store(start + count);
+			return count;
+		}
+
+		/**
+		 * Copy up to `length` bytes out into `buffer`, returning the number
+		 * copied.  Must be called only by the consumer.
+		 */
+		uint32_t pop(uint8_t *buffer, size_t length)
+		{
+			uint32_t count = std::min<size_t>(used(), length);
+			uint32_t start = consumed.load();
+			for (uint32_t i = 0; i < count; i++)
+			{
+				buffer[i] = data[(start + i) & (Size - 1)];
+			}
+			consumed.store(start + count);
+			return count;
+		}
+	};
+
+	/// Bytes received and not yet read.
+	ByteRing<CHERIOT_UART_DRIVER_BUFFER_SIZE> receiveRing;
+
+	/// Bytes written and not yet transmitted.
+	ByteRing<CHERIOT_UART_DRIVER_BUFFER_SIZE> transmitRing;
+
+	/// Serialises readers.
+	FlagLock readLock;
+
+	/// Serialises writers.
+	FlagLock writeLock;
+
+	/// The number of received bytes dropped because `receiveRing` was full.
+	uint32_t receiveOverflows;
+
+	/**
+	 * Move received bytes from the UART's FIFO into the receive ring.
+	 * Returns true if any bytes were added.
+	 */
+	bool drain_receive_fifo(volatile Uart *uart)
+	{
+		uint32_t start = receiveRing.produced.load();
+		uint32_t end   = start;
+		while (uart->can_read())
+		{
+			uint8_t byte = uart->readData;
+			if (end - receiveRing.consumed.load() ==
+			    CHERIOT_UART_DRIVER_BUFFER_SIZE)
+			{
+				receiveOverflows++;
+				continue;
+			}
+			receiveRing.data[end++ & (CHERIOT_UART_DRIVER_BUFFER_SIZE - 1)] =
+			  byte;
+		}
+		if (end == start)
+		{
+			return false;
+		}
+		receiveRing.produced.store(end);
+		receiveRing.produced.notify_all();
+		return true;
+	}
+
+	/**
+	 * Move bytes from the transmit ring into the UART's FIFO until either is
+	 * full or empty.
+	 */
+	void fill_transmit_fifo(volatile Uart *uart)
+	{
+		uint32_t start = transmitRing.consumed.load();
+		uint32_t end   = start;
+		uint32_t limit = transmitRing.produced.load();
+		while ((end != limit) && uart->can_write())
+		{
+			uart->writeData =
+			  transmitRing.data[end++ & (CHERIOT_UART_DRIVER_BUFFER_SIZE - 1)];
+		}
+		if (end != start)
+		{
+			transmitRing.consumed.store(end);
+			transmitRing.consumed.notify_all();
+		}
+	}
+
+	/**
+	 * Returns a read-only futex word of ours for use in a multiwaiter.
+	 */
+	uint32_t *read_only_futex(cheriot::atomic<uint32_t> &counter)
+	{
+		Capability<uint32_t> word{reinterpret_cast<uint32_t *>(&counter)};
+		word.bounds()      = sizeof(uint32_t);
+		word.permissions() =
+		  PermissionSet{Permission::Load, Permission::Global};
+		return word;
+	}
+} // namespace
+
+ssize_t uart_write(Timeout *timeout, const void *buffer, size_t length)
+{
+	if (!check_pointer<PermissionSet{Permission::Load}, false>(buffer,
+	                                                           length) ||
+	    !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, buffer) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{writeLock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	auto    *bytes   = static_cast<const uint8_t *>(buffer);
+	uint32_t written = 0;
+	while (written < length)
+	{
+		uint32_t consumed = transmitRing.consumed.load();
+		uint32_t pushed = transmitRing.push(bytes + written, length - written);
+		if (pushed != 0)
+		{
+			written += pushed;
+			// Let the driver thread know that there is data to send.
+			transmitRing.produced.notify_all();
+			continue;
+		}
+		if (transmitRing.consumed.wait(timeout, consumed) == -ETIMEDOUT)
+		{
+			break;
+		}
+	}
+	return (written == 0) && (length != 0) ? -ETIMEDOUT : written;
+}
+
+ssize_t uart_read(Timeout *timeout, void *buffer, size_t length)
+{
+	if (!check_pointer<PermissionSet{Permission::Store}, false>(buffer,
+	                                                            length) ||
+	    !check_timeout_pointer(timeout))
+	{
+		return -EINVAL;
+	}
+	if (heap_claim_fast(timeout, buffer) < 0)
+	{
+		return -EINVAL;
+	}
+	LockGuard g{readLock, timeout};
+	if (!g)
+	{
+		return -ETIMEDOUT;
+	}
+	while (true)
+	{
+		uint32_t produced = receiveRing.produced.load();
+		if (uint32_t read =
+		      receiveRing.pop(static_cast<uint8_t *>(buffer), length);
+		    (read != 0) || (length == 0))
+		{
+			return read;
+		}
+		if (receiveRing.produced.wait(timeout, produced) == -ETIMEDOUT)
+		{
+			return -ETIMEDOUT;
+		}
+	}
+}
+
+int multiwaiter_uart_read_init(EventWaiterSource *source)
+{
+	if (!check_pointer<PermissionSet{Permission::Store}, false>(source))
+	{
+		return -EINVAL;
+	}
+	// Fires immediately if there are unread bytes, otherwise when the driver
+	// next adds some.
+	source->eventSource = read_only_futex(receiveRing.produced);
+	source->kind        = EventWaiterFutex;
+	source->value       = receiveRing.consumed.load();
+	return 0;
+}
+
+int multiwaiter_uart_write_init(EventWaiterSource *source)
+{
+	if (!check_pointer<PermissionSet{Permission::Store}, false>(source))
+	{
+		return -EINVAL;
+	}
+	// Fires immediately if there is space, otherwise when the driver next
+	// sends some bytes.
+	uint32_t consumed   = transmitRing.consumed.load();
+	source->eventSource = read_only_futex(transmitRing.consumed);
+	source->kind        = EventWaiterFutex;
+	source->value       = (transmitRing.space() != 0) ? ~consumed : consumed;
+	return 0;
+}
+
+uint32_t uart_receive_overflows()
+{
+	return receiveOverflows;
+}
+
+void uart_driver_run()
+{
+	auto *uart = MMIO_CAPABILITY(Uart, uart);
+	const uint32_t *interruptFutex =
+	  interrupt_futex_get(STATIC_SEALED_VALUE(uartInterrupt));
+	MultiWaiter *waiter;
+	Timeout      unlimited{UnlimitedTimeout};
+	if (multiwaiter_create(&unlimited, MALLOC_CAPABILITY, &waiter, 2) != 0)
+	{
+		return;
+	}
+	// Wake for received data and for newly queued data to send.
+	EventWaiterSource events[2] = {
+	  {const_cast<uint32_t *>(interruptFutex),
+	   EventWaiterFutex,
+	   *interruptFutex},
+	  {reinterpret_cast<uint32_t *>(&transmitRing.produced),
+	   EventWaiterFutex,
+	   transmitRing.produced.load()}};
+	multiwaiter_register(waiter, events, 2);
+
+	uart->receive_watermark(OpenTitanUart::ReceiveWatermark::Level1);
+	uart->interrupt_enable(OpenTitanUart::InterruptReceiveWatermark);
+	while (true)
+	{
+		drain_receive_fifo(uart);
+		fill_transmit_fifo(uart);
+		bool transmitPending = transmitRing.used() != 0;
+		if constexpr (TransmitInterrupt)
+		{
+			// Ask to be woken when the transmit FIFO has drained below the
+			// watermark, only while there is more to send.
+			if (transmitPending)
+			{
+				uart->transmit_watermark(
+				  OpenTitanUart::TransmitWatermark::Level4);
+				uart->interrupt_enable(
+				  OpenTitanUart::InterruptTransmitWatermark);
+			}
+			else
+			{
+				uart->interrupt_disable(
+				  OpenTitanUart::InterruptTransmitWatermark);
+			}
+		}
+		// Clear the latched interrupts that have been handled.
+		uart->interruptState = OpenTitanUart::InterruptReceiveWatermark |
+		                       OpenTitanUart::InterruptTransmitWatermark;
+		interrupt_complete(STATIC_SEALED_VALUE(uartInterrupt));
+		// Without a transmit interrupt, poll the FIFO once per tick while
+		// there is data to send.
+		Timeout  wait{(transmitPending && !TransmitInterrupt)
+		               ? 1
+		               : UnlimitedTimeout};
+		uint32_t ready;
+		multiwaiter_wait_registered(&wait, waiter, &ready, nullptr);
+	}
+}
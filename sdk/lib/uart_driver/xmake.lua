@@ -0,0 +1,12 @@
+-- Copyright Microsoft and CHERIoT Contributors.
+-- SPDX-License-Identifier: MIT
+
+includes("../locks", "../compartment_helpers")
+
+compartment("uart_driver")
+  set_default(false)
+  add_deps("locks", "compartment_helpers")
+  add_files("uart_driver.cc")
+  on_load(function (target)
+	target:add('defines', "CHERIOT_UART_DRIVER_BUFFER_SIZE=" .. math.floor(tonumber(get_config("uart-driver-buffer-size"))))
+  end)
@@ -1,15 +1,28 @@
 includes(
+	"adc_sampler",
 	"atomic",
+	"buffer_lending",
+	"checksum",
 	"compartment_helpers",
+	"compress",
+	"crash_capture",
 	"crt",
 	"cxxrt",
 	"debug",
 	"event_group",
 	"freestanding",
+	"gpio_events",
+	"kvstore",
+	"led_frame",
 	"locks",
 	"microvium",
+	"pubsub",
 	"queue",
+	"scratch_arena",
+	"spi_flash",
 	"stdio",
 	"string",
 	"thread_pool",
+	"timer_service",
+	"uart_driver",
 	"unwind_error_handler")
@@ -22,7 +22,243 @@ end
 
 option("scheduler-accounting")
 	set_default(false)
-	set_description("Track per-thread cycle counts in the scheduler");
+	set_description("Track per-thread and per-compartment cycle counts in the scheduler");
+	set_showmenu(true)
+
+option("interrupt-handler-threads")
+	set_default(false)
+	set_description("Wake the thread bound to each interrupt directly from the trap handler and mask lower-priority interrupts while it runs");
+	set_showmenu(true)
+
+option("scheduler-trace-entries")
+	set_default("0")
+	set_description("Number of records in the scheduler event trace ring buffer (power of two, 0 to disable)");
+	set_showmenu(true)
+
+option("scheduler-profile-samples")
+	set_default("0")
+	set_description("Number of samples in the scheduler's sampling profiler ring buffer (power of two, 0 to disable)");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("scheduler-profile-period")
+	set_default("0")
+	set_description("Cycles between profiler samples while a thread runs (0 to sample only on timer interrupts that the scheduler takes anyway)");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("switcher-call-counters")
+	set_default(false)
+	set_description("Count the calls to each compartment export in the switcher");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("switcher-stack-peaks")
+	set_default(false)
+	set_description("Record the peak stack use of each compartment export in the switcher")
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("lock-profiling-entries")
+	set_default("0")
+	set_description("Number of locks for which the locks library records contention statistics (0 to disable)");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("debug-log-buffer")
+	set_default("0")
+	set_description("Size of the ring buffer that debug output is written to and drained from by the debug_log_drain compartment (power of two, 0 to write directly to the UART)");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("debug-log-binary")
+	set_default(false)
+	set_description("Write debug log messages as binary records for scripts/decode_binary_log.py to format on the host");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("debug-runtime-levels")
+	set_default(false)
+	set_description("Build components with debugging enabled so that their log messages are off until they are enabled at run time")
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("lto")
+	set_default(false)
+	set_description("Build unprivileged compartments and libraries with link-time optimisation")
+	set_showmenu(true)
+
+option("pgo")
+	set_default("none")
+	set_description("Profile-guided optimisation: build compartments with edge counters (generate) or optimise them with a profile (use)")
+	set_values("none", "generate", "use")
+	set_showmenu(true)
+
+option("pgo-profile")
+	set_default("")
+	set_description("Merged .profdata file used to optimise compartments with --pgo=use")
+	set_showmenu(true)
+
+option("strip-unused-exports")
+	set_default(false)
+	set_description("Relink compartments and libraries without the exports that nothing imports and link the firmware again")
+	set_showmenu(true)
+
+option("code-size-report")
+	set_default(false)
+	set_description("Print the size of each compartment and library after linking firmware and write it to a JSON file")
+	set_showmenu(true)
+
+option("code-size-baseline")
+	set_default("")
+	set_description("JSON file from an earlier --code-size-report build; the firmware link fails if any component has grown")
+	set_showmenu(true)
+
+option("allocator-profiling")
+	set_default(false)
+	set_description("Record call sites of live heap allocations for heap_profile_dump");
+	set_showmenu(true)
+
+option("allocator-lazy-zero")
+	set_default(false)
+	set_description("Zero heap memory in the allocator when it is first allocated, rather than in the loader at boot");
+	set_showmenu(true)
+
+option("allocator-size-class-cache")
+	set_default(false)
+	set_description("Cache small freed chunks by size class in the allocator");
+	set_showmenu(true)
+
+option("allocator-claim-index-size")
+	set_default("0")
+	set_description("Number of entries in the allocator's hashed claim index (power of two, 0 to disable)");
+	set_showmenu(true)
+
+option("allocator-owner-index-size")
+	set_default("0")
+	set_description("Number of entries in the allocator's index of chunks by owner, used by heap_free_all (power of two, 0 to disable)");
+	set_showmenu(true)
+
+option("allocator-large-region-size")
+	set_default("0")
+	set_description("Bytes at the top of the heap reserved for large allocations (0 to disable)");
+	set_showmenu(true)
+
+option("allocator-large-object-threshold")
+	set_default("8192")
+	set_description("Smallest allocation, in bytes, that is placed in the large-object region");
+	set_showmenu(true)
+
+option("allocator-sanity-samples")
+	set_default("0")
+	set_description("Number of chunks that debug builds of the allocator sanity check per operation, rather than periodically checking the whole heap (0 for periodic full checks)");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("hazard-pointers-per-thread")
+	set_default("2")
+	set_description("Number of hazard-pointer slots per thread for heap_claim_fast");
+	set_showmenu(true)
+
+option("loader-boot-profile")
+	set_default(false)
+	set_description("Report the cycles spent in each loader phase and compartment at boot");
+	set_showmenu(true)
+	set_category("Debugging")
+
+option("compressed-image")
+	set_default(false)
+	set_description("Also write an Intel HEX image with compressed compartments, which the loader decompresses at boot");
+	set_showmenu(true)
+
+option("stack-size-check")
+	set_default(false)
+	set_description("Fail the firmware link if a thread may need more trusted stack frames or stack than it is configured with");
+	set_showmenu(true)
+
+option("allocator-statistics")
+	set_default(false)
+	set_description("Collect allocator statistics and report them via heap_statistics");
+	set_showmenu(true)
+
+option("adc-sampler-block-size")
+	set_default("256")
+	set_description("Number of samples in each of the adc_sampler compartment's two sample blocks");
+	set_showmenu(true)
+
+option("adc-sampler-channel")
+	set_default("ArduinoA0")
+	set_description("ADC channel (SonataAnalogueDigitalConverter::MeasurementRegister) that the adc_sampler compartment samples");
+	set_showmenu(true)
+
+option("adc-sampler-rate")
+	set_default("1000")
+	set_description("Samples per second taken by the adc_sampler compartment");
+	set_showmenu(true)
+
+option("gpio-events-debounce-samples")
+	set_default("3")
+	set_description("Number of consecutive one-tick samples for which a GPIO input must change before the gpio_events compartment reports an edge");
+	set_showmenu(true)
+
+option("hardware-revoker-regions")
+	set_default(false)
+	set_description("Have the hardware revoker sweep the stacks, globals and heap as separate regions, skipping memory that cannot hold capabilities");
+	set_showmenu(true)
+
+option("hardware-revoker-gentle-chunk")
+	set_default("0")
+	set_description("Bytes that the hardware revoker sweeps at a time when there is little memory pressure (0 to always sweep at full speed)")
+	set_showmenu(true)
+
+option("kvstore-max-keys")
+	set_default("64")
+	set_description("Maximum number of keys in the kvstore compartment's in-RAM index");
+	set_showmenu(true)
+
+option("kvstore-sectors")
+	set_default("8")
+	set_description("Number of 4 KiB flash sectors that hold the kvstore compartment's log (at least 4)");
+	set_showmenu(true)
+
+option("software-revoker-tick-size")
+	set_default("4096")
+	set_description("Maximum number of capability-sized words that the software revoker scans per call");
+	set_showmenu(true)
+
+option("software-revoker-cycle-budget")
+	set_default("0")
+	set_description("Cycle budget for each software revoker call (0 disables the time budget)");
+	set_showmenu(true)
+
+option("software-revoker-background-thread")
+	set_default(false)
+	set_description("Run software revocation sweeps on an idle-priority thread in the revoker compartment");
+	set_showmenu(true)
+
+option("spi-flash-cache-pages")
+	set_default("4")
+	set_description("Number of 256-byte flash pages that the spi_flash compartment caches for small reads");
+	set_showmenu(true)
+
+option("thread-pool-queue-depth")
+	set_default("8")
+	set_description("Number of messages that each thread pool worker's queue can hold (at most 32)");
+	set_showmenu(true)
+
+option("thread-pool-workers")
+	set_default("2")
+	set_description("Number of per-worker queues in the thread pool (should match the number of worker threads)");
+	set_showmenu(true)
+
+option("timer-service-max-timers")
+	set_default("16")
+	set_description("Maximum number of software timers that the timer_service compartment can run at once")
+	set_showmenu(true)
+
+option("uart-driver-buffer-size")
+	set_default("256")
+	set_description("Size of each of the uart_driver compartment's receive and transmit buffers (power of two)");
 	set_showmenu(true)
 
 function debugOption(name)
@@ -136,6 +372,15 @@ rule("cheriot.component")
 		-- We don't want a lib prefix or equivalent.
 		target:set("prefixname", "")
 	end)
+	-- Optimise each unprivileged compartment or library as a single unit.
+	-- Components are still linked separately, so library code is never
+	-- inlined into its callers.
+	after_load(function (target)
+		local type = target:get("cheriot.type")
+		if get_config("lto") and ((type == "compartment") or (type == "library")) then
+			target:add("cxflags", "-flto", {force = true})
+		end
+	end)
 	before_build(function (target)
 		if not target:get("cheriot.board_file") then
 			raise("target " .. target:name() .. " is being built but does not " ..
@@ -189,6 +434,23 @@ rule("cheriot.compartment")
 	after_load(function (target)
 		local compartment = target:get("cheriot.compartment") or target:name()
 		target:add("cxflags", "-cheri-compartment=" .. compartment, {force=true})
+		-- Profile-guided optimisation.  Only compartments can be instrumented,
+		-- because the counters are globals.  Value profiling is off by
+		-- default with front-end instrumentation, so the counters are the only
+		-- state that the instrumented code updates.
+		local pgo = get_config("pgo")
+		if pgo == "generate" then
+			target:add("cxflags", "-fprofile-instr-generate", {force=true})
+			target:add("defines", "CHERIOT_PGO_GENERATE")
+		elseif pgo == "use" then
+			local profile = get_config("pgo-profile")
+			if (profile == nil) or (profile == "") then
+				raise("--pgo=use requires --pgo-profile")
+			end
+			-- Code that has changed since the profile was collected is
+			-- optimised without it, rather than failing the build.
+			target:add("cxflags", "-fprofile-instr-use=" .. path.absolute(profile), "-Wno-profile-instr-out-of-date", {force=true})
+		end
 	end)
 
 -- Privileged compartments are built as compartments, but with a slightly
@@ -229,6 +491,21 @@ target("cheriot.allocator")
 	on_load(function (target)
 		target:set("cheriot.compartment", "alloc")
 		target:set('cheriot.debug-name', "allocator")
+		target:add('defines', "CHERIOT_ALLOCATOR_SIZE_CLASS_CACHE=" .. tostring(get_config("allocator-size-class-cache")))
+		target:add('defines', "CHERIOT_ALLOCATOR_STATISTICS=" .. tostring(get_config("allocator-statistics")))
+		target:add('defines', "CHERIOT_ALLOCATOR_CLAIM_INDEX_SIZE=" .. tostring(get_config("allocator-claim-index-size")))
+		target:add('defines', "CHERIOT_ALLOCATOR_OWNER_INDEX_SIZE=" .. tostring(get_config("allocator-owner-index-size")))
+		target:add('defines', "CHERIOT_ALLOCATOR_SANITY_SAMPLES=" .. tostring(get_config("allocator-sanity-samples")))
+		local largeRegionSize = math.floor(tonumber(get_config("allocator-large-region-size")))
+		if largeRegionSize > 0 then
+			target:add('defines', "CHERIOT_ALLOCATOR_LARGE_REGION_SIZE=" .. tostring(largeRegionSize))
+			target:add('defines', "CHERIOT_ALLOCATOR_LARGE_OBJECT_THRESHOLD=" .. tostring(get_config("allocator-large-object-threshold")))
+		end
+		target:add('defines', "CHERIOT_HARDWARE_REVOKER_REGIONS=" .. tostring(get_config("hardware-revoker-regions")))
+		target:add('defines', "CHERIOT_HARDWARE_REVOKER_GENTLE_CHUNK=" .. tostring(get_config("hardware-revoker-gentle-chunk")))
+		if get_config("software-revoker-background-thread") then
+			target:add('defines', "CHERIOT_SOFTWARE_REVOKER_BACKGROUND_THREAD")
+		end
 	end)
 
 target("cheriot.token_library")
@@ -245,6 +522,11 @@ target("cheriot.software_revoker")
 	on_load(function (target)
 		target:set("cheriot.compartment", "software_revoker")
 		target:set("cheriot.ldscript", "software_revoker.ldscript")
+		target:add('defines', "CHERIOT_SOFTWARE_REVOKER_TICK_SIZE=" .. tostring(get_config("software-revoker-tick-size")))
+		target:add('defines', "CHERIOT_SOFTWARE_REVOKER_CYCLE_BUDGET=" .. tostring(get_config("software-revoker-cycle-budget")))
+		if get_config("software-revoker-background-thread") then
+			target:add('defines', "CHERIOT_SOFTWARE_REVOKER_BACKGROUND_THREAD")
+		end
 	end)
 
 -- Helper to get the board file for a given target
@@ -388,6 +670,22 @@ rule("firmware")
 			add_defines(board.defines)
 		end
 
+		if get_config("allocator-profiling") then
+			add_defines("CHERIOT_ALLOCATOR_PROFILING")
+		end
+		if get_config("allocator-lazy-zero") then
+			add_defines("CHERIOT_ALLOCATOR_LAZY_ZERO")
+		end
+		if get_config("switcher-call-counters") then
+			add_defines("CHERIOT_SWITCHER_CALL_COUNTERS")
+		end
+		if get_config("switcher-stack-peaks") then
+			if not board.stack_high_water_mark then
+				raise("--switcher-stack-peaks requires a board with stack_high_water_mark")
+			end
+			add_defines("CHERIOT_SWITCHER_STACK_PEAKS")
+		end
+		add_defines("CHERIOT_HAZARD_POINTERS_PER_THREAD=" .. math.floor(tonumber(get_config("hazard-pointers-per-thread"))))
 		add_defines("CPU_TIMER_HZ=" .. math.floor(board.timer_hz))
 		add_defines("TICK_RATE_HZ=" .. math.floor(board.tickrate_hz))
 
@@ -395,6 +693,17 @@ rule("firmware")
 			add_defines("SIMULATION")
 		end
 
+		-- Boards whose cores implement the A extension can use atomic
+		-- instructions instead of calls to the atomics library.
+		if board.atomics == "amo" then
+			visit_all_dependencies(function (target)
+				target:add("cxflags", "-Xclang", "-target-feature", "-Xclang", "+a", {force = true})
+				target:add("asflags", "-Xclang", "-target-feature", "-Xclang", "+a", {force = true})
+			end)
+		elseif board.atomics and board.atomics ~= "libcall" then
+			raise("Unknown atomics implementation '" .. tostring(board.atomics) .. "', expected 'amo' or 'libcall'")
+		end
+
 		local loader = target:deps()['cheriot.loader'];
 
 		if board.stack_high_water_mark then
@@ -443,6 +752,22 @@ rule("firmware")
 		if board.heap.start then
 			heap_start = format("0x%x", board.heap.start)
 		end
+
+		-- The allocator manages the heap below `fast_end` as a separate
+		-- region for allocator capabilities that prefer fast memory.
+		if board.heap.fast_end then
+			add_defines(format("CHERIOT_HEAP_FAST_END=0x%x", board.heap.fast_end))
+		end
+
+		-- Compartments and libraries (and the switcher and scheduler) that the
+		-- firmware asks to place in the board's fast instruction memory.  On
+		-- boards without fast instruction memory, they stay in the image.
+		local hot_code = {}
+		if board.fast_instruction_memory then
+			for _, name in ipairs(table.wrap(target:values("hot_code"))) do
+				hot_code[name] = true
+			end
+		end
 		
 		if board.interrupts then
 			-- The macro used to provide the interrupt enumeration in the public header
@@ -454,7 +779,9 @@ rule("firmware")
 				interruptConfiguration = interruptConfiguration .. "{"
 					.. math.floor(interrupt.number) .. ","
 					.. math.floor(interrupt.priority) .. ","
-					.. (interrupt.edge_triggered and "true" or "false")
+					.. (interrupt.edge_triggered and "true" or "false") .. ","
+					.. math.floor(interrupt.coalesce_count or 0) .. ","
+					.. math.floor((interrupt.coalesce_us or 0) * board.timer_hz / 1000000)
 					.. "},"
 			end
 			add_defines(interruptNames)
@@ -468,6 +795,18 @@ rule("firmware")
 		-- Get the threads config and prepare the predefined macros that describe them
 		local threads = target:values("threads")
 
+		-- The software revoker can sweep on its own idle-priority thread.  Add
+		-- it after the firmware's threads so that their IDs do not change.
+		if software_revoker and get_config("software-revoker-background-thread") then
+			table.insert(threads, {
+				compartment = "software_revoker",
+				priority = 0,
+				entry_point = "revoker_background_run",
+				stack_size = 0x200,
+				trusted_stack_frames = 2
+			})
+		end
+
 		-- Declare space and start and end symbols for a thread's C stack
 		local thread_stack_template =
 			"\n\t. = ALIGN(16);" ..
@@ -494,6 +833,8 @@ rule("firmware")
 				"\n\t\tSHORT(.thread_${thread_id}_stack_end - .thread_${thread_id}_stack_start);" ..
 				"\n\t\tLONG(.thread_${thread_id}_trusted_stack_start);" ..
 				"\n\t\tSHORT(.thread_${thread_id}_trusted_stack_end - .thread_${thread_id}_trusted_stack_start);" ..
+				"\n\t\tSHORT(${period});" ..
+				"\n\t\tSHORT(${budget});" ..
 				"\n\n"
 
 		--Pass the declared threads as macros when building the loader and the
@@ -516,6 +857,14 @@ rule("firmware")
 		-- Stacks must be less than this size or truncating them in compartment
 		-- switch may encounter precision errors.
 		local stack_size_limit = 8176
+		-- The total CPU utilisation of deadline-scheduled threads, used for
+		-- admission control.
+		local deadline_utilisation = 0
+		-- CPU budgets for threads and groups of threads, and the index of
+		-- each thread's budget (-1 for none).
+		local cpu_budgets = {}
+		local cpu_budget_groups = {}
+		local thread_cpu_budgets = {}
 		for i, thread in ipairs(threads) do
 			thread.mangled_entry_point = string.format("__export_%s__Z%d%sv", thread.compartment, string.len(thread.entry_point), thread.entry_point)
 			thread.thread_id = i
@@ -529,15 +878,80 @@ rule("firmware")
 				" are not yet supported in the compartment switcher.")
 			end
 
+			-- Threads with a period (in ticks) are deadline scheduled and may
+			-- run for at most `budget` ticks in each period.
+			thread.period = thread.period or 0
+			thread.budget = thread.budget or 0
+			if thread.period ~= 0 then
+				if (thread.period > 0xffff) or (thread.budget < 1) or (thread.budget > thread.period) then
+					raise("thread " .. i .. " has period " .. thread.period ..
+					" and budget " .. thread.budget ..
+					".  Periods must be less than 65536 ticks and budgets between 1 tick and the period.")
+				end
+				deadline_utilisation = deadline_utilisation + (thread.budget / thread.period)
+			elseif thread.budget ~= 0 then
+				raise("thread " .. i .. " has a budget but no period")
+			end
+
+			-- Threads with a CPU budget may run for at most `cpu_budget` ticks
+			-- in each `cpu_period` ticks, shared with the other threads in
+			-- the same `cpu_budget_group`, if any.
+			thread.cpu_period = thread.cpu_period or 0
+			thread.cpu_budget = thread.cpu_budget or 0
+			local budget_index = -1
+			if thread.cpu_period ~= 0 then
+				if (thread.cpu_period > 0xffff) or (thread.cpu_budget < 1) or (thread.cpu_budget > thread.cpu_period) then
+					raise("thread " .. i .. " has CPU period " .. thread.cpu_period ..
+					" and CPU budget " .. thread.cpu_budget ..
+					".  Periods must be less than 65536 ticks and budgets between 1 tick and the period.")
+				end
+				if thread.period ~= 0 then
+					raise("thread " .. i .. " is deadline scheduled and cannot also have a CPU budget")
+				end
+				local group = thread.cpu_budget_group and cpu_budget_groups[thread.cpu_budget_group]
+				if group then
+					if (group.period ~= thread.cpu_period) or (group.budget ~= thread.cpu_budget) then
+						raise("thread " .. i .. " has a different CPU period or budget from the other threads in CPU budget group " .. thread.cpu_budget_group)
+					end
+					budget_index = group.index
+				else
+					budget_index = #cpu_budgets
+					table.insert(cpu_budgets, "{" .. math.floor(thread.cpu_period) .. "," .. math.floor(thread.cpu_budget) .. "}")
+					if thread.cpu_budget_group then
+						cpu_budget_groups[thread.cpu_budget_group] = { period = thread.cpu_period, budget = thread.cpu_budget, index = budget_index }
+					end
+				end
+			elseif (thread.cpu_budget ~= 0) or thread.cpu_budget_group then
+				raise("thread " .. i .. " has a CPU budget or budget group but no CPU period")
+			end
+			table.insert(thread_cpu_budgets, tostring(budget_index))
+
 			thread_stacks = thread_stacks .. string.gsub(thread_stack_template, "${([_%w]*)}", thread)
 			thread_trusted_stacks = thread_trusted_stacks .. string.gsub(thread_trusted_stack_template, "${([_%w]*)}", thread)
 			thread_headers = thread_headers .. string.gsub(thread_template, "${([_%w]*)}", thread)
 
 		end
+		-- Earliest-deadline-first scheduling can meet every deadline if and only
+		-- if the deadline-scheduled threads need no more than the whole CPU.
+		if deadline_utilisation > 1 then
+			raise("deadline-scheduled threads require " ..
+			math.floor(deadline_utilisation * 100) ..
+			"% of the CPU, which cannot be guaranteed")
+		end
 		local add_defines = function(compartment, option_name)
 			target:deps()[compartment]:add('defines', "CONFIG_THREADS_NUM=" .. #(threads))
 		end
 		add_defines(target:name() .. ".scheduler", "scheduler")
+		-- Every compartment and library may size per-thread storage (see
+		-- thread-local.h) by the number of threads.
+		visit_all_dependencies(function (dep)
+			dep:add('defines', "CHERIOT_THREAD_COUNT=" .. #(threads))
+		end)
+		if #cpu_budgets > 0 then
+			local scheduler = target:deps()[target:name() .. ".scheduler"]
+			scheduler:add('defines', "SCHEDULER_CPU_BUDGETS=" .. table.concat(cpu_budgets, ","))
+			scheduler:add('defines', "SCHEDULER_THREAD_CPU_BUDGETS=" .. table.concat(thread_cpu_budgets, ","))
+		end
 
 		-- Next set up the substitutions for the linker scripts.
 
@@ -608,6 +1022,34 @@ rule("firmware")
 			cap_relocs = compartment_templates.cap_relocs,
 			sealed_objects = compartment_templates.sealed_objects
 		}
+		-- The switcher and scheduler code, which firmware can place in fast
+		-- instruction memory as it can other compartments.
+		local switcher_code =
+			"\n\tcompartment_switcher_code : CAPALIGN" ..
+			"\n\t{" ..
+			"\n\t\t.compartment_switcher_start = .;" ..
+			"\n\t\t*/switcher/entry.S.o(.text);" ..
+			"\n\t}" ..
+			"\n\t.compartment_switcher_end = .;\n"
+		local scheduler_code =
+			"\n\tscheduler_code : CAPALIGN" ..
+			"\n\t{" ..
+			"\n\t\t.scheduler_start = .;" ..
+			"\n\t\t*.scheduler.compartment(.compartment_sealing_keys);" ..
+			"\n\t\t.scheduler_import_start = .;" ..
+			"\n\t\t*.scheduler.compartment(.compartment_import_table);" ..
+			"\n\t\t.scheduler_import_end = .;" ..
+			"\n\t\t*.scheduler.compartment(.text .text.* .rodata .rodata.* .data.rel.ro);" ..
+			"\n\t}" ..
+			"\n\t.scheduler_end = .;\n"
+		-- Code in fast instruction memory is linked at its address there but
+		-- loaded after the rest of the code in the image.  Each section's load
+		-- address is set explicitly, at the same offset from the start of the
+		-- load area as the section has from the start of fast memory, so that
+		-- the loader can copy the whole range at once.
+		local fast_code_section = function (template)
+			return (string.gsub(template, " : CAPALIGN", " : AT(__fast_code_load_start + (. - __fast_code_start)) CAPALIGN"))
+		end
 		-- The substitutions that we're going to have in the final linker
 		-- script.  Initialised as empty strings.
 		local ldscript_substitutions = {
@@ -616,6 +1058,9 @@ rule("firmware")
 			cap_relocs="",
 			compartment_headers="",
 			pcc_ld="",
+			fast_pcc_ld="",
+			switcher_code=switcher_code,
+			scheduler_code=scheduler_code,
 			gdc_ld="",
 			software_revoker_code="",
 			software_revoker_globals="",
@@ -640,9 +1085,21 @@ rule("firmware")
 				return string.gsub(str, "${(%w*)}", { obj=obj, compartment=name })
 			end
 			for key, template in table.orderpairs(templates) do
+				if (key == "pcc_ld") and hot_code[name] then
+					key = "fast_pcc_ld"
+					template = fast_code_section(template)
+				end
 				ldscript_substitutions[key] = ldscript_substitutions[key] .. substitute(template)
 			end
 		end
+		if hot_code.switcher then
+			ldscript_substitutions.fast_pcc_ld = ldscript_substitutions.fast_pcc_ld .. fast_code_section(switcher_code)
+			ldscript_substitutions.switcher_code = ""
+		end
+		if hot_code.scheduler then
+			ldscript_substitutions.fast_pcc_ld = ldscript_substitutions.fast_pcc_ld .. fast_code_section(scheduler_code)
+			ldscript_substitutions.scheduler_code = ""
+		end
 
 		-- If this board requires the software revoker, add it as a dependency
 		-- and add the relevant bits to the linker script.
@@ -651,9 +1108,14 @@ rule("firmware")
 				"\tsoftware_revoker_code : CAPALIGN\n" ..
 				"\t{\n" ..
 				"\t\t.software_revoker_start = .;\n" ..
-				"\t\t.software_revoker_import_end = .;\n" ..
 				"\t\tsoftware_revoker.compartment(.text .text.* .rodata .rodata.* .data.rel.ro);\n" ..
 				"\t\t*/cheriot.software_revoker.compartment(.text .text.* .rodata .rodata.* .data.rel.ro);\n" ..
+				-- The import table follows the code (see
+				-- software_revoker.ldscript).
+				"\t\t. = ALIGN(8);\n" ..
+				"\t\t.software_revoker_import_start = .;\n" ..
+				"\t\t*/cheriot.software_revoker.compartment(.compartment_import_table);\n" ..
+				"\t\t.software_revoker_import_end = .;\n" ..
 				"\t}\n" ..
 				"\t.software_revoker_end = .;\n\n"
 			ldscript_substitutions.software_revoker_globals =
@@ -675,9 +1137,8 @@ rule("firmware")
 				"\n\t\tSHORT(.software_revoker_end - .software_revoker_start);" ..
 				"\n\t\tLONG(.software_revoker_globals);" ..
 				"\n\t\tSHORT(SIZEOF(.software_revoker_globals));" ..
-				-- The software revoker has no import table.
-				"\n\t\tLONG(0)" ..
-				"\n\t\tSHORT(0)" ..
+				"\n\t\tLONG(.software_revoker_import_start);" ..
+				"\n\t\tSHORT(.software_revoker_import_end - .software_revoker_import_start);" ..
 				"\n\t\tLONG(.software_revoker_export_table);" ..
 				"\n\t\tSHORT(.software_revoker_export_table_end - .software_revoker_export_table);\n" ..
 				"\n\t\tLONG(0);" ..
@@ -706,9 +1167,51 @@ rule("firmware")
 		local shared_objects = {
 			-- 32-bit counter for the hazard-pointer epoch.
 			allocator_epoch = 4,
-			-- Two hazard pointers per thread.
-			allocator_hazard_pointers = #(threads) * 8 * 2
+			-- Free bytes in the heap, published by the allocator.
+			allocator_free_bytes = 4,
+			-- Hazard pointers for each thread.
+			allocator_hazard_pointers = #(threads) * 8 * math.floor(tonumber(get_config("hazard-pointers-per-thread"))),
+			-- Per-bucket counts of futex waiters (FUTEX_WAITER_SUMMARY_BUCKETS).
+			scheduler_futex_waiters = 64
 			}
+		-- Scheduler trace ring buffer: an 8-byte header and 16-byte records.
+		local scheduler_trace_entries = math.floor(tonumber(get_config("scheduler-trace-entries")))
+		if scheduler_trace_entries > 0 then
+			shared_objects.scheduler_trace = 8 + scheduler_trace_entries * 16
+		end
+		-- Scheduler profiler ring buffer: an 8-byte header and 12-byte samples.
+		local scheduler_profile_samples = math.floor(tonumber(get_config("scheduler-profile-samples")))
+		if scheduler_profile_samples > 0 then
+			shared_objects.scheduler_profile = 8 + scheduler_profile_samples * 12
+		end
+		-- Lock contention statistics: one 32-byte LockProfileEntry per lock.
+		local lock_profiling_entries = math.floor(tonumber(get_config("lock-profiling-entries")))
+		if lock_profiling_entries > 0 then
+			shared_objects.lock_profile = lock_profiling_entries * 32
+		end
+		-- Buffered debug output: a 12-byte header and the ring.
+		local debug_log_buffer = math.floor(tonumber(get_config("debug-log-buffer")))
+		if debug_log_buffer > 0 then
+			shared_objects.debug_log_buffer = 12 + debug_log_buffer
+		end
+		-- Switcher call counters: one 32-bit counter per word of the
+		-- compartment export tables.
+		if get_config("switcher-call-counters") then
+			shared_objects.switcher_call_counters = "SIZEOF(.compartment_export_tables)"
+		end
+		-- Switcher stack peaks: one 32-bit record per word of the compartment
+		-- export tables.
+		if get_config("switcher-stack-peaks") then
+			shared_objects.switcher_stack_peaks = "SIZEOF(.compartment_export_tables)"
+		end
+		-- Run-time log levels: one 32-bit word for each component that has
+		-- debugging enabled.
+		visit_all_dependencies(function (target)
+			local object = target:get("cheriot.debug-level-object")
+			if object then
+				shared_objects[object] = 4
+			end
+		end)
 		visit_all_dependencies(function (target)
 			local globals = target:values("shared_objects")
 			if globals then
@@ -739,6 +1242,31 @@ rule("firmware")
 		end
 		ldscript_substitutions.shared_objects = shared_objects_section
 
+		-- Place the hot code in fast instruction memory and then return to
+		-- the image, after the space for its load image.  Without fast
+		-- instruction memory, the empty range tells the loader that there is
+		-- nothing to copy.
+		if board.fast_instruction_memory and (ldscript_substitutions.fast_pcc_ld ~= "") then
+			local fast_memory = board.fast_instruction_memory
+			ldscript_substitutions.fast_code =
+				"\n\t__fast_code_load_start = .;" ..
+				format("\n\t. = 0x%x;", fast_memory.start) ..
+				"\n\t__fast_code_start = .;\n" ..
+				ldscript_substitutions.fast_pcc_ld ..
+				"\n\t__fast_code_end = .;" ..
+				format("\n\tASSERT(__fast_code_end <= 0x%x, \"Hot code does not fit in fast instruction memory\");", fast_memory["end"]) ..
+				"\n\t. = __fast_code_load_start + (__fast_code_end - __fast_code_start);\n"
+			-- Sections without an explicit load address keep the offset of
+			-- the one before, so reset it for the globals that follow.
+			ldscript_substitutions.globals_load_address = "AT(.) "
+		else
+			ldscript_substitutions.fast_code =
+				"\n\t__fast_code_load_start = .;" ..
+				"\n\t__fast_code_start = .;" ..
+				"\n\t__fast_code_end = .;\n"
+			ldscript_substitutions.globals_load_address = ""
+		end
+
 		-- Add the counts of libraries and compartments to the substitution list.
 		ldscript_substitutions.compartment_count = compartment_count
 		ldscript_substitutions.library_count = library_count
@@ -768,9 +1296,74 @@ rule("firmware")
 			end
 		end)
 		batchcmds:vrunv(target:tool("ld"), table.join({"-n", "--script=" .. linkerscript, "--relax", "-o", target:targetfile(), "--compartment-report=" .. target:targetfile() .. ".json" }, objects), opt)
+		-- Relink the unprivileged components without the exports that the
+		-- report from the first link says that nothing imports, and then
+		-- link the firmware again with those components.
+		if get_config("strip-unused-exports") then
+			import("core.base.json")
+			local stripped_dir = path.join(config.buildir(), target:name() .. "-stripped")
+			local manifest = {
+				ld = target:tool("ld"),
+				output_dir = stripped_dir,
+				firmware_ldscript = linkerscript,
+				stripped_firmware_ldscript = path.join(stripped_dir, "firmware.ldscript"),
+				components = {}
+			}
+			local stripped_objects = {}
+			for _, object in ipairs(objects) do
+				stripped_objects[object] = object
+			end
+			visit_all_dependencies_of(target, function (dep)
+				local type = dep:get("cheriot.type")
+				if (type == "library") or (type == "compartment") then
+					local stripped = path.join(stripped_dir, path.filename(dep:targetfile()))
+					stripped_objects[dep:targetfile()] = stripped
+					table.insert(manifest.components, {
+						name = dep:get("cheriot.compartment") or dep:name(),
+						output = dep:targetfile(),
+						stripped = stripped,
+						ldscript = path.join(scriptdir, dep:get("cheriot.ldscript")),
+						objects = dep:objectfiles()
+					})
+				end
+			end)
+			local manifest_file = path.join(stripped_dir, "manifest.json")
+			os.mkdir(stripped_dir)
+			json.savefile(manifest_file, manifest)
+			local strip_args = {path.join(scriptdir, "..", "scripts", "strip_unused_exports.py"), "--report", target:targetfile() .. ".json", "--manifest", manifest_file}
+			for _, thread in ipairs(target:values("threads")) do
+				table.insert(strip_args, "--keep")
+				table.insert(strip_args, string.format("__export_%s__Z%d%sv", thread.compartment, string.len(thread.entry_point), thread.entry_point))
+			end
+			batchcmds:show_progress(opt.progress, "Stripping unused exports for " .. target:targetfile())
+			batchcmds:vrunv("python3", strip_args, opt)
+			local relink_objects = {}
+			for _, object in ipairs(objects) do
+				table.insert(relink_objects, stripped_objects[object])
+			end
+			batchcmds:vrunv(target:tool("ld"), table.join({"-n", "--script=" .. manifest.stripped_firmware_ldscript, "--relax", "-o", target:targetfile(), "--compartment-report=" .. target:targetfile() .. ".json" }, relink_objects), opt)
+		end
 		batchcmds:show_progress(opt.progress, "Creating firmware report " .. target:targetfile() .. ".json")
 		batchcmds:show_progress(opt.progress, "Creating firmware dump " .. target:targetfile() .. ".dump")
 		batchcmds:vexecv(target:tool("objdump"), {"-glxsdrS", "--demangle", target:targetfile()}, table.join(opt, {stdout = target:targetfile() .. ".dump"}))
+		local size_baseline = get_config("code-size-baseline") or ""
+		if get_config("code-size-report") or (size_baseline ~= "") then
+			batchcmds:show_progress(opt.progress, "Creating code size report " .. target:targetfile() .. ".sizes.json")
+			local size_args = {path.join(scriptdir, "..", "scripts", "code_size_report.py"), "--json", target:targetfile() .. ".sizes.json"}
+			if size_baseline ~= "" then
+				size_args = table.join(size_args, {"--baseline", size_baseline, "--check"})
+			end
+			table.insert(size_args, target:targetfile())
+			batchcmds:vrunv("python3", size_args, opt)
+		end
+		if get_config("stack-size-check") then
+			batchcmds:show_progress(opt.progress, "Checking thread stack sizes for " .. target:targetfile())
+			batchcmds:vrunv("python3", {path.join(scriptdir, "..", "scripts", "stack_sizes.py"), "--check", target:targetfile()}, opt)
+		end
+		if get_config("compressed-image") then
+			batchcmds:show_progress(opt.progress, "Creating compressed firmware image " .. target:targetfile() .. ".hex")
+			batchcmds:vrunv("python3", {path.join(scriptdir, "..", "scripts", "compress_firmware.py"), target:targetfile(), target:targetfile() .. ".hex"}, opt)
+		end
 		batchcmds:add_depfiles(linkerscript)
 		batchcmds:add_depfiles(objects)
 	end)
@@ -781,6 +1374,15 @@ rule("cheriot.component-debug")
 		local name = target:get("cheriot.debug-name") or target:name()
 		target:add('options', "debug-" .. name)
 		target:add('defines', "DEBUG_" .. name:upper() .. "=" .. tostring(get_config("debug-"..name)))
+		-- With run-time log levels, the component reads a word in a shared
+		-- object before each log message.  The loader cannot import shared
+		-- objects, so it always logs.
+		target:add('options', "debug-runtime-levels")
+		if get_config("debug-runtime-levels") and get_config("debug-"..name) and (name ~= "loader") then
+			local object = "debug_level_" .. name
+			target:set("cheriot.debug-level-object", object)
+			target:add('defines', "CHERIOT_DEBUG_LEVEL_OBJECT=" .. object)
+		end
 	end)
 
 -- Rule for conditionally enabling stack checks for a component.
@@ -791,6 +1393,17 @@ rule("cheriot.component-stack-checks")
 		target:add('defines', "CHERIOT_STACK_CHECKS_" .. name:upper() .. "=" .. tostring(get_config("stack-usage-check-"..name)))
 	end)
 
+-- Rule for building a component without locks around the initialisation of
+-- function-local statics.  The compiler still checks whether each static has
+-- been initialised, with a plain load, but never calls the C++ runtime's guard
+-- functions.  This is safe only if a static's initialiser cannot be
+-- preempted by another thread that uses the same static, for example in a
+-- compartment that is called by only one thread.
+rule("cheriot.single-threaded-statics")
+	on_load(function (target)
+		target:add("cxxflags", "-fno-threadsafe-statics", {force = true})
+	end)
+
 -- Build the loader.  The firmware rule will set the flags required for
 -- this to create threads.
 target("cheriot.loader")
@@ -808,6 +1421,8 @@ target("cheriot.loader")
 			loader_stack_size = 1024
 		}
 		target:add('defines', "CHERIOT_LOADER_STACK_SIZE=" .. config.loader_stack_size)
+		target:add('defines', "CHERIOT_LOADER_BOOT_PROFILE=" .. tostring(get_config("loader-boot-profile")))
+		target:add('defines', "CHERIOT_LOADER_COMPRESSED_IMAGE=" .. tostring(get_config("compressed-image")))
 		target:set('cheriot_loader_config', config)
 		for k, v in pairs(config) do
 			target:set(k, v)
@@ -826,6 +1441,10 @@ function firmware(name)
 			target:set("cheriot.compartment", "sched")
 			target:set('cheriot.debug-name', "scheduler")
 			target:add('defines', "SCHEDULER_ACCOUNTING=" .. tostring(get_config("scheduler-accounting")))
+			target:add('defines', "SCHEDULER_INTERRUPT_HANDLER_THREADS=" .. tostring(get_config("interrupt-handler-threads")))
+			target:add('defines', "SCHEDULER_TRACE_ENTRIES=" .. math.floor(tonumber(get_config("scheduler-trace-entries"))))
+			target:add('defines', "SCHEDULER_PROFILE_SAMPLES=" .. math.floor(tonumber(get_config("scheduler-profile-samples"))))
+			target:add('defines', "SCHEDULER_PROFILE_PERIOD=" .. math.floor(tonumber(get_config("scheduler-profile-period"))))
 		end)
 		add_files(path.join(coredir, "scheduler/main.cc"))
 
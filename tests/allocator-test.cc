@@ -14,6 +14,8 @@
 #include <errno.h>
 #include <futex.h>
 #include <global_constructors.hh>
+#include <rcu.hh>
+#include <scratch_arena.h>
 #include <switcher.h>
 #include <thread.h>
 #include <thread_pool.h>
@@ -28,6 +30,13 @@ using namespace CHERI;
 DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(emptyHeap, 0);
 #define EMPTY_HEAP STATIC_SEALED_VALUE(emptyHeap)
 
+#define FAST_HEAP_QUOTA 256U
+DECLARE_ALLOCATOR_CAPABILITY(fastHeap);
+DEFINE_ALLOCATOR_CAPABILITY_IN_REGION(fastHeap,
+                                      FAST_HEAP_QUOTA,
+                                      HeapRegionFast);
+#define FAST_HEAP STATIC_SEALED_VALUE(fastHeap)
+
 namespace
 {
 	/**
@@ -304,6 +313,355 @@ namespace
 		allocations.clear();
 	}
 
+	/**
+	 * Test that small allocations that are recycled through quarantine (and,
+	 * if enabled, the size-class cache) come back zeroed and correctly sized.
+	 */
+	void test_small_reuse()
+	{
+		static constexpr size_t SmallSizes[] = {16, 24, 48, 64, 96, 128};
+		static constexpr size_t Rounds       = 4;
+		for (size_t round = 0; round < Rounds; round++)
+		{
+			for (size_t size : SmallSizes)
+			{
+				Capability<uint8_t> p{static_cast<uint8_t *>(
+				  heap_allocate(&noWait, MALLOC_CAPABILITY, size))};
+				TEST(p.is_valid(), "Failed to allocate {} bytes", size);
+				TEST(p.length() >= size,
+				     "{}-byte allocation returned {}",
+				     size,
+				     p);
+				for (size_t i = 0; i < size; i++)
+				{
+					TEST(p[i] == 0,
+					     "{}-byte allocation {} is not zeroed at offset {}",
+					     size,
+					     p,
+					     i);
+				}
+				memset(p, 0xA5, size);
+				allocations.push_back(p);
+			}
+			for (auto allocation : allocations)
+			{
+				free(allocation);
+			}
+			allocations.clear();
+			// Drain quarantine so that the next round can reuse these chunks.
+			heap_quarantine_empty();
+		}
+	}
+
+	/**
+	 * Test that capabilities that prefer fast memory can allocate and free,
+	 * whether or not the board has a fast heap region.
+	 */
+	void test_fast_region()
+	{
+		Capability p{heap_allocate(&noWait, FAST_HEAP, 64)};
+		TEST(p.is_valid(), "Failed to allocate with a fast-region capability");
+		TEST(heap_quota_remaining(FAST_HEAP) <= FAST_HEAP_QUOTA - 64,
+		     "Fast-region allocation was not charged to its quota");
+		int ret = heap_free(FAST_HEAP, p);
+		TEST(ret == 0, "Freeing fast-region allocation failed: {}", ret);
+		TEST(heap_quota_remaining(FAST_HEAP) == FAST_HEAP_QUOTA,
+		     "Fast-region quota was not restored after free");
+	}
+
+	/**
+	 * Test that the published free size and quota match the values returned
+	 * by the allocator's compartment calls.
+	 */
+	void test_published_counters()
+	{
+		const volatile size_t *quota =
+		  heap_quota_remaining_pointer(SECOND_HEAP);
+		TEST(quota != nullptr, "Failed to get the published quota");
+		TEST(!Capability{quota}.permissions().contains(Permission::Store),
+		     "Published quota is writeable: {}",
+		     quota);
+		void *p = heap_allocate(&noWait, SECOND_HEAP, 64);
+		TEST(p != nullptr, "Failed to allocate with the second heap");
+		TEST_EQUAL(static_cast<ssize_t>(*quota),
+		           heap_quota_remaining(SECOND_HEAP),
+		           "Published quota does not match after allocation");
+		TEST_EQUAL(heap_available_fast(),
+		           heap_available(),
+		           "Published free size does not match after allocation");
+		heap_free(SECOND_HEAP, p);
+		TEST_EQUAL(static_cast<ssize_t>(*quota),
+		           heap_quota_remaining(SECOND_HEAP),
+		           "Published quota does not match after free");
+		TEST(heap_quota_remaining_pointer(nullptr) == nullptr,
+		     "Got a published quota for an invalid capability");
+	}
+
+	/**
+	 * Test that scratch arenas hand out disjoint, exactly bounded objects and
+	 * release them with a single free.
+	 */
+	void test_scratch_arena()
+	{
+		ScratchArena arena;
+		int ret = scratch_arena_create(&arena, &noWait, SECOND_HEAP, 256);
+		TEST(ret == 0, "Creating a scratch arena failed: {}", ret);
+		Capability first{scratch_arena_allocate(&arena, 20)};
+		Capability second{scratch_arena_allocate<uint64_t>(&arena)};
+		TEST(first.is_valid() && (first.length() == 20),
+		     "Scratch arena returned {} for a 20-byte object",
+		     first);
+		TEST(second.is_valid() && (second.length() == sizeof(uint64_t)) &&
+		       (second.address() % sizeof(void *) == 0),
+		     "Scratch arena returned {} for a uint64_t",
+		     second);
+		TEST(second.base() >= first.top(),
+		     "Scratch arena objects {} and {} overlap",
+		     first,
+		     second);
+		TEST(*second == 0, "Scratch arena object is not zeroed");
+		TEST(scratch_arena_allocate(&arena, 256) == nullptr,
+		     "Allocated more than the arena holds");
+		size_t quotaInUse =
+		  SECOND_HEAP_QUOTA - heap_quota_remaining(SECOND_HEAP);
+		TEST(quotaInUse < 256 + 64,
+		     "Arena objects were charged separately: {} bytes in use",
+		     quotaInUse);
+		ret = scratch_arena_destroy(&arena, SECOND_HEAP);
+		TEST(ret == 0, "Destroying a scratch arena failed: {}", ret);
+		TEST(heap_quota_remaining(SECOND_HEAP) == SECOND_HEAP_QUOTA,
+		     "Destroying a scratch arena did not restore the quota");
+	}
+
+	/**
+	 * Test the batch allocation and deallocation APIs.
+	 */
+	void test_batch()
+	{
+		static constexpr size_t BatchSize  = 8;
+		static constexpr size_t ObjectSize = 48;
+		void                   *objects[BatchSize];
+		auto    quotaBefore = heap_quota_remaining(SECOND_HEAP);
+		ssize_t allocated   = heap_allocate_batch(
+		    &noWait, SECOND_HEAP, objects, BatchSize, ObjectSize);
+		TEST(allocated == BatchSize,
+		     "Batch allocation returned {}, expected {}",
+		     allocated,
+		     BatchSize);
+		for (size_t i = 0; i < BatchSize; i++)
+		{
+			Capability object{objects[i]};
+			TEST(object.is_valid(), "Batch allocation {} is invalid", i);
+			TEST(object.length() >= ObjectSize,
+			     "Batch allocation {} is too small: {}",
+			     i,
+			     object);
+			for (size_t j = 0; j < i; j++)
+			{
+				TEST(objects[i] != objects[j],
+				     "Batch allocations {} and {} are the same object",
+				     i,
+				     j);
+			}
+		}
+		TEST(heap_quota_remaining(SECOND_HEAP) <=
+		       quotaBefore - ssize_t(BatchSize * ObjectSize),
+		     "Batch allocation was not charged to the quota");
+		// The quota is too small to allow this many objects.
+		void   *tooMany[SECOND_HEAP_QUOTA / ObjectSize];
+		ssize_t partial = heap_allocate_batch(
+		  &noWait, SECOND_HEAP, tooMany, std::size(tooMany), ObjectSize);
+		TEST((partial >= 0) && (partial < ssize_t(std::size(tooMany))),
+		     "Batch allocation exceeding the quota returned {}",
+		     partial);
+		TEST(heap_free_batch(SECOND_HEAP, tooMany, partial) == partial,
+		     "Failed to free partial batch");
+		// Freeing with the wrong capability should do nothing
+		TEST(heap_free_batch(MALLOC_CAPABILITY, objects, BatchSize) == 0,
+		     "Freed batch with the wrong capability");
+		ssize_t freed = heap_free_batch(SECOND_HEAP, objects, BatchSize);
+		TEST(freed == BatchSize,
+		     "Batch free returned {}, expected {}",
+		     freed,
+		     BatchSize);
+		TEST_EQUAL(heap_quota_remaining(SECOND_HEAP),
+		           quotaBefore,
+		           "Batch free did not restore quota");
+	}
+
+	/**
+	 * Check that reallocation preserves contents, zeroes new space, rejects
+	 * objects that the caller does not own, and restores the quota on free.
+	 */
+	void test_reallocate()
+	{
+		auto quotaBefore = heap_quota_remaining(SECOND_HEAP);
+		auto *object =
+		  static_cast<uint8_t *>(heap_allocate(&noWait, SECOND_HEAP, 32));
+		TEST(Capability{object}.is_valid(), "Failed to allocate 32 bytes");
+		for (size_t i = 0; i < 32; i++)
+		{
+			object[i] = i;
+		}
+		TEST(heap_reallocate(&noWait, MALLOC_CAPABILITY, object, 64) ==
+		       nullptr,
+		     "Reallocated an object with the wrong capability");
+		// A small shrink keeps the object.
+		TEST(heap_reallocate(&noWait, SECOND_HEAP, object, 30) == object,
+		     "Small shrink moved the object");
+		auto *grown = static_cast<uint8_t *>(
+		  heap_reallocate(&noWait, SECOND_HEAP, object, 128));
+		TEST(Capability{grown}.is_valid(), "Failed to grow object to 128 bytes");
+		TEST(Capability{grown}.length() >= 128,
+		     "Grown object is too small: {}",
+		     grown);
+		debug_log("Grew {} to {}", object, grown);
+		for (size_t i = 0; i < 32; i++)
+		{
+			TEST_EQUAL(grown[i], i, "Reallocation did not preserve contents");
+		}
+		for (size_t i = 32; i < 128; i++)
+		{
+			TEST_EQUAL(grown[i], 0, "Reallocation did not zero new space");
+		}
+		auto *shrunk = static_cast<uint8_t *>(
+		  heap_reallocate(&noWait, SECOND_HEAP, grown, 16));
+		TEST(Capability{shrunk}.is_valid(),
+		     "Failed to shrink object to 16 bytes");
+		TEST(Capability{shrunk}.length() < 128,
+		     "Shrunk object is too large: {}",
+		     shrunk);
+		TEST_EQUAL(shrunk[15], 15, "Shrinking did not preserve contents");
+		TEST_EQUAL(heap_free(SECOND_HEAP, shrunk),
+		           0,
+		           "Failed to free reallocated object");
+		TEST_EQUAL(heap_quota_remaining(SECOND_HEAP),
+		           quotaBefore,
+		           "Reallocation did not restore quota");
+	}
+
+	/**
+	 * Check that aligned allocations are aligned and zeroed, that invalid
+	 * alignments are rejected, and that the leading slack is not charged to
+	 * the quota.
+	 */
+	void test_allocate_aligned()
+	{
+		auto quotaBefore = heap_quota_remaining(SECOND_HEAP);
+		TEST(heap_allocate_aligned(&noWait, SECOND_HEAP, 32, 48) == nullptr,
+		     "Allocated with an alignment that is not a power of two");
+		for (size_t alignment : {64U, 256U, 1024U})
+		{
+			auto *object = static_cast<uint8_t *>(
+			  heap_allocate_aligned(&noWait, SECOND_HEAP, 32, alignment));
+			TEST(Capability{object}.is_valid(),
+			     "Failed to allocate 32 bytes aligned to {}",
+			     alignment);
+			TEST_EQUAL(Capability{object}.address() & (alignment - 1),
+			           0U,
+			           "Allocation is not aligned");
+			for (size_t i = 0; i < 32; i++)
+			{
+				TEST_EQUAL(object[i], 0, "Aligned allocation is not zeroed");
+			}
+			auto used = static_cast<size_t>(
+			  quotaBefore - heap_quota_remaining(SECOND_HEAP));
+			TEST(used < alignment,
+			     "Aligned allocation of 32 bytes used {} bytes of quota",
+			     used);
+			TEST_EQUAL(heap_free(SECOND_HEAP, object),
+			           0,
+			           "Failed to free aligned object");
+		}
+		TEST_EQUAL(heap_quota_remaining(SECOND_HEAP),
+		           quotaBefore,
+		           "Aligned allocation did not restore quota");
+	}
+
+	/**
+	 * Check that allocation-site identifiers in the flags do not change
+	 * allocation behaviour and that the live heap can be dumped.
+	 */
+	void test_profile()
+	{
+		Timeout t{5};
+		void   *p = heap_allocate(
+		    &t, SECOND_HEAP, 64, AllocateWaitAny | HEAP_ALLOCATION_SITE(0x1234));
+		TEST(Capability{p}.is_valid(), "Failed to allocate with a site tag");
+		// Site bits alone must not make the allocation blocking.
+		TEST(heap_allocate(&t,
+		                   EMPTY_HEAP,
+		                   64,
+		                   AllocateWaitNone | HEAP_ALLOCATION_SITE(0x1234)) ==
+		       nullptr,
+		     "Allocation from an empty quota succeeded");
+		TEST(t.remaining == 5, "Non-blocking tagged allocation blocked");
+		int ret = heap_profile_dump();
+		TEST((ret == 0) || (ret == -ENOTSUP),
+		     "heap_profile_dump returned {}",
+		     ret);
+		TEST_EQUAL(heap_free(SECOND_HEAP, p), 0, "Failed to free tagged object");
+	}
+
+	/**
+	 * Check that revocation progress is reported within the documented range
+	 * while memory is waiting in quarantine.
+	 */
+	void test_revocation_progress()
+	{
+		void *p = malloc(256);
+		TEST(p != nullptr, "Failed to allocate 256 bytes");
+		free(p);
+		int progress = heap_revocation_progress();
+		if (progress == -ENOTSUP)
+		{
+			debug_log("Revoker does not report progress");
+			return;
+		}
+		TEST(progress >= 0 && progress < 100,
+		     "Revocation progress {} is out of range",
+		     progress);
+		heap_quarantine_empty();
+	}
+
+	/**
+	 * Check that the statistics interface reports allocations, if the
+	 * allocator was built with statistics support.
+	 */
+	void test_statistics()
+	{
+		HeapStatistics before;
+		int            ret = heap_statistics(&before);
+		if (ret == -ENOTSUP)
+		{
+			debug_log("Allocator statistics are not enabled");
+			return;
+		}
+		TEST_EQUAL(ret, 0, "heap_statistics failed");
+		// 100 bytes lands in the (64, 128] bucket.
+		constexpr size_t Bucket = 3;
+		void            *p      = malloc(100);
+		TEST(p != nullptr, "Failed to allocate 100 bytes");
+		HeapStatistics after;
+		TEST_EQUAL(heap_statistics(&after), 0, "heap_statistics failed");
+		free(p);
+		TEST(after.allocationSizeHistogram[Bucket] ==
+		       before.allocationSizeHistogram[Bucket] + 1,
+		     "Histogram bucket {} went from {} to {}, expected one more",
+		     Bucket,
+		     before.allocationSizeHistogram[Bucket],
+		     after.allocationSizeHistogram[Bucket]);
+		TEST(after.lockAcquisitions > before.lockAcquisitions,
+		     "Lock acquisitions did not increase");
+		TEST(after.largestFreeChunk <= after.freeBytes,
+		     "Largest free chunk {} is larger than free space {}",
+		     after.largestFreeChunk,
+		     after.freeBytes);
+		TEST_EQUAL(heap_statistics(nullptr),
+		           -EINVAL,
+		           "heap_statistics accepted a null pointer");
+	}
+
 	void test_claims()
 	{
 		debug_log("Beginning tests on claims");
@@ -373,6 +731,60 @@ namespace
 		     alloc);
 	}
 
+	/**
+	 * Test that heap_claim_many and heap_release_many claim and release
+	 * several objects, reporting a status for each.
+	 */
+	void test_claim_many()
+	{
+		static constexpr size_t ObjectSize  = 48;
+		auto                    quotaBefore = heap_quota_remaining(SECOND_HEAP);
+
+		void *first  = heap_allocate(&noWait, MALLOC_CAPABILITY, ObjectSize);
+		void *second = heap_allocate(&noWait, MALLOC_CAPABILITY, ObjectSize);
+		TEST(Capability{first}.is_valid() && Capability{second}.is_valid(),
+		     "Allocation failed");
+		void   *pointers[] = {first, second, nullptr};
+		ssize_t claimResults[std::size(pointers)];
+		ssize_t claimed =
+		  heap_claim_many(SECOND_HEAP, pointers, claimResults, 3);
+		TEST_EQUAL(claimed, 2, "heap_claim_many claimed the wrong number");
+		for (size_t i = 0; i < 2; i++)
+		{
+			TEST(claimResults[i] >= ssize_t(ObjectSize),
+			     "Object {} claimed as {} bytes",
+			     i,
+			     claimResults[i]);
+		}
+		TEST_EQUAL(claimResults[2],
+		           -EINVAL,
+		           "Claiming a null pointer should fail");
+		TEST(heap_quota_remaining(SECOND_HEAP) < quotaBefore,
+		     "Claims were not charged to the quota");
+		// The claims keep the objects alive after the owner frees them.
+		TEST_EQUAL(heap_free_batch(MALLOC_CAPABILITY, pointers, 2),
+		           2,
+		           "Failed to free claimed objects");
+		TEST(Capability{first}.is_valid() && Capability{second}.is_valid(),
+		     "Claimed objects were freed");
+		int releaseResults[std::size(pointers)];
+		TEST_EQUAL(heap_release_many(SECOND_HEAP, pointers, releaseResults, 3),
+		           2,
+		           "heap_release_many released the wrong number");
+		TEST(releaseResults[0] == 0 && releaseResults[1] == 0,
+		     "Releasing claims failed: {}, {}",
+		     releaseResults[0],
+		     releaseResults[1]);
+		TEST_EQUAL(releaseResults[2],
+		           -EINVAL,
+		           "Releasing a null pointer should fail");
+		TEST_EQUAL(heap_quota_remaining(SECOND_HEAP),
+		           quotaBefore,
+		           "Releasing claims did not restore the quota");
+		TEST(!Capability{*__builtin_launder(&first)}.is_valid(),
+		     "Object still valid after releasing the last claim");
+	}
+
 	/**
 	 * Test heap_free_all.  Make sure that we can reclaim all memory associated
 	 * with a single quota.
@@ -481,6 +893,92 @@ namespace
 		debug_log("Hazard pointer tests done");
 	}
 
+	/**
+	 * Test the array variant of the fast claims interface.
+	 */
+	void test_hazards_array()
+	{
+		const void *pointers[CHERIOT_HAZARD_POINTERS_PER_THREAD + 1];
+		for (auto &pointer : pointers)
+		{
+			pointer = malloc(16);
+			TEST(pointer != nullptr, "Failed to allocate 16 bytes");
+		}
+		Timeout t{1};
+		int     claimed =
+		  heap_claim_fast_array(&t, pointers, CHERIOT_HAZARD_POINTERS_PER_THREAD);
+		TEST(claimed == 0, "Heap claim of all slots failed: {}", claimed);
+		claimed = heap_claim_fast_array(
+		  &t, pointers, CHERIOT_HAZARD_POINTERS_PER_THREAD + 1);
+		TEST(claimed == -EINVAL,
+		     "Heap claim of more pointers than slots returned {}",
+		     claimed);
+		for (auto &pointer : pointers)
+		{
+			free(const_cast<void *>(pointer));
+		}
+	}
+
+	/**
+	 * Test that an RCU pointer's readers keep the version that they claimed
+	 * until their next cross-compartment call, even after a writer has
+	 * replaced and freed it.
+	 */
+	void test_rcu()
+	{
+		struct Config
+		{
+			uint32_t generation;
+			uint32_t routes[4];
+		};
+		static RcuPointer<Config> config;
+		TEST(config.read() == nullptr,
+		     "Read a value from an unpublished RCU pointer");
+		Timeout writeTimeout{10};
+		int     result = config.update(&writeTimeout,
+		                               MALLOC_CAPABILITY,
+		                               [](Config &c) { c.generation = 1; });
+		TEST(result == 0,
+		     "Failed to publish the first RCU version: {}",
+		     result);
+
+		static cheriot::atomic<int> state = 0;
+		async([]() {
+			const Config *version = config.read();
+			TEST((version != nullptr) && (version->generation == 1),
+			     "RCU reader did not see the first version");
+			state = 1;
+			while (state.load() == 1) {}
+			// This thread has made no cross-compartment calls since the
+			// read, so the old version must still be usable.
+			TEST(Capability{version}.is_valid() && (version->generation == 1),
+			     "RCU version was reclaimed while a reader held it: {}",
+			     version);
+			state = 3;
+		});
+		while (state.load() != 1)
+		{
+			Timeout t{1};
+			thread_sleep(&t);
+		}
+		result = config.update(
+		  &writeTimeout, MALLOC_CAPABILITY, [](Config &c) { c.generation++; });
+		TEST(result == 0,
+		     "Failed to publish the second RCU version: {}",
+		     result);
+		state = 2;
+		while (state.load() != 3)
+		{
+			Timeout t{1};
+			thread_sleep(&t);
+		}
+		const Config *version = config.read();
+		TEST((version != nullptr) && (version->generation == 2),
+		     "RCU reader did not see the second version");
+		TEST(config.publish(MALLOC_CAPABILITY, nullptr) == 0,
+		     "Failed to free the last RCU version");
+	}
+
 	void test_large_token(size_t tokenSize)
 	{
 		void      *unsealedCapability;
@@ -519,6 +1017,21 @@ namespace
 		     "expected one ({} != {})",
 		     unsealedLarge,
 		     unsealedCapability);
+		TokenKey<void> key{sealingCapability};
+		TEST(key.unseal(sealedPointer.get()) == unsealedLarge,
+		     "Unsealing with a TokenKey gave {}, expected {}",
+		     key.unseal(sealedPointer.get()),
+		     unsealedLarge);
+		TEST(key.unseal(nullptr) == nullptr,
+		     "Unsealing null with a TokenKey succeeded");
+		Capability sealOnly{sealingCapability};
+		sealOnly.permissions() &=
+		  PermissionSet::omnipotent().without(Permission::Unseal);
+		TokenKey<void> sealOnlyKey{sealOnly.get()};
+		TEST(!sealOnlyKey.is_valid() &&
+		       (sealOnlyKey.unseal(sealedPointer.get()) == nullptr),
+		     "TokenKey without permit-unseal unsealed {}",
+		     sealedPointer);
 		int destroyed = token_obj_destroy(
 		  MALLOC_CAPABILITY, sealingCapability, sealedPointer);
 		TEST(destroyed == 0, "Failed to destroy large sealed capability");
@@ -618,6 +1131,120 @@ namespace
 		     SECOND_HEAP_QUOTA);
 	}
 
+	/**
+	 * Test allocating and recycling sealed objects in a token pool.
+	 */
+	__noinline void test_token_pool()
+	{
+		debug_log("Testing token pools");
+		auto    key = STATIC_SEALING_TYPE(sealingTest);
+		Timeout noWait{0};
+		SObj pool = token_pool_create(&noWait, MALLOC_CAPABILITY, key, 24, 2);
+		TEST(pool != INVALID_SOBJ, "Failed to create token pool");
+		void      *unsealed;
+		Capability first = token_pool_alloc(pool, key, &unsealed);
+		TEST(first.is_valid() && first.is_sealed(),
+		     "Failed to allocate a sealed object from a pool: {}",
+		     first);
+		TEST(token_obj_unseal(key, first) == unsealed,
+		     "Pooled object {} unsealed to {}, expected {}",
+		     first,
+		     token_obj_unseal(key, first),
+		     unsealed);
+		SObj second = token_pool_alloc(pool, key, nullptr);
+		TEST(second != INVALID_SOBJ, "Failed to allocate a second object");
+		TEST(token_pool_alloc(pool, key, nullptr) == INVALID_SOBJ,
+		     "Allocated more objects than the pool holds");
+		TEST(token_obj_destroy(MALLOC_CAPABILITY, key, first) != 0,
+		     "Destroyed a pooled object with token_obj_destroy");
+		static_cast<char *>(unsealed)[0] = 1;
+		int ret = token_pool_free(pool, key, first);
+		TEST(ret == 0, "token_pool_free returned {}, expected 0", ret);
+		TEST(token_obj_unseal(key, first) == nullptr,
+		     "Stale pool handle {} could be unsealed",
+		     first);
+		TEST(token_pool_free(pool, key, first) == -EINVAL,
+		     "Freed a stale pool handle");
+		Capability recycled =
+		  token_pool_alloc(pool, key, &unsealed);
+		TEST(recycled.is_valid() && (recycled.base() != first.base()),
+		     "Recycled handle {} should differ from the stale handle {}",
+		     recycled,
+		     first);
+		TEST(static_cast<char *>(unsealed)[0] == 0,
+		     "Recycled pool object was not zeroed");
+		// Recycle for long enough that the slot is retired and replaced.
+		for (size_t i = 0; i < 16; i++)
+		{
+			ret      = token_pool_free(pool, key, recycled);
+			recycled = token_pool_alloc(pool, key, nullptr);
+			TEST((ret == 0) && recycled.is_valid(),
+			     "Recycling pool object failed on iteration {}: {}",
+			     i,
+			     ret);
+		}
+		ret = token_pool_destroy(MALLOC_CAPABILITY, pool);
+		TEST(ret == 0, "token_pool_destroy returned {}, expected 0", ret);
+	}
+
+	/**
+	 * Test that sealing keys can be destroyed only once they have no live
+	 * objects.
+	 */
+	__noinline void test_token_key_destroy()
+	{
+		debug_log("Testing sealing key destruction");
+		Timeout noWait{0};
+		SKey    key = token_key_new();
+		TEST(key != INVALID_SKEY, "Failed to allocate a sealing key");
+		SObj sealed = token_sealed_alloc(&noWait, MALLOC_CAPABILITY, key, 16);
+		TEST(sealed != INVALID_SOBJ, "Failed to allocate a sealed object");
+		int ret = token_key_destroy(key);
+		TEST(ret == -EBUSY,
+		     "Destroying a key with live objects returned {}, expected {}",
+		     ret,
+		     -EBUSY);
+		TEST(token_obj_destroy(MALLOC_CAPABILITY, key, sealed) == 0,
+		     "Failed to destroy sealed object");
+		ret = token_key_destroy(key);
+		TEST(ret == 0, "token_key_destroy returned {}, expected 0", ret);
+		ret = token_key_destroy(key);
+		TEST(ret == -EINVAL,
+		     "Destroying a key twice returned {}, expected {}",
+		     ret,
+		     -EINVAL);
+		TEST(token_key_destroy(STATIC_SEALING_TYPE(sealingTest)) == -EINVAL,
+		     "Destroyed a static sealing key");
+	}
+
+	/**
+	 * Test that token_obj_destroy_batch destroys each valid object once and
+	 * skips null, duplicate, and wrongly authorised entries.
+	 */
+	__noinline void test_token_destroy_batch()
+	{
+		debug_log("Testing batched sealed object destruction");
+		Timeout noWait{0};
+		SKey    key = token_key_new();
+		TEST(key != INVALID_SKEY, "Failed to allocate a sealing key");
+		SObj live[3];
+		for (auto &object : live)
+		{
+			object = token_sealed_alloc(&noWait, MALLOC_CAPABILITY, key, 16);
+			TEST(object != INVALID_SOBJ, "Failed to allocate a sealed object");
+		}
+		SObj objects[] = {live[0], nullptr, live[1], live[0], live[2]};
+		TEST_EQUAL(token_obj_destroy_batch(SECOND_HEAP, key, objects, 5),
+		           0,
+		           "Destroyed sealed objects with the wrong allocator");
+		TEST_EQUAL(token_obj_destroy_batch(MALLOC_CAPABILITY, key, objects, 5),
+		           3,
+		           "Batched destroy returned the wrong count");
+		TEST_EQUAL(token_key_destroy(key),
+		           0,
+		           "Objects left alive after a batched destroy");
+	}
+
 } // namespace
 
 /**
@@ -638,7 +1265,12 @@ int test_allocator()
 	debug_log("Heap size is {} bytes", HeapSize);
 
 	test_token();
+	test_token_pool();
+	test_token_key_destroy();
+	test_token_destroy_batch();
 	test_hazards();
+	test_hazards_array();
+	test_rcu();
 
 	// Make sure that free works only on memory owned by the caller.
 	Timeout t{5};
@@ -662,6 +1294,7 @@ int test_allocator()
 	     "After alloc and free from 1024-byte quota, {} bytes left",
 	     quotaLeft);
 	test_claims();
+	test_claim_many();
 
 	TEST(heap_address_is_valid(&t) == false,
 	     "Stack object incorrectly reported as heap address");
@@ -682,6 +1315,16 @@ int test_allocator()
 	ret = heap_free(MALLOC_CAPABILITY, array);
 	TEST(ret == 0, "Freeing array failed: {}", ret);
 
+	test_small_reuse();
+	test_fast_region();
+	test_published_counters();
+	test_scratch_arena();
+	test_batch();
+	test_reallocate();
+	test_allocate_aligned();
+	test_revocation_progress();
+	test_statistics();
+	test_profile();
 	test_blocking_allocator();
 	heap_quarantine_empty();
 	test_revoke();
@@ -1,4 +1,5 @@
 #include <FreeRTOS-Compat/FreeRTOS.h>
+#include <FreeRTOS-Compat/timers.h>
 
 #if (CHERIOT_FREERTOS_SEMAPHORE + CHERIOT_FREERTOS_MUTEX +                     \
       CHERIOT_FREERTOS_RECURSIVE_MUTEX) == 1
@@ -3,6 +3,7 @@
 
 #define TEST_NAME "Test check_pointer"
 #include "tests.hh"
+#include <buffer_lending.h>
 
 int object;
 
@@ -128,8 +129,93 @@ void check_pointer_strict_mode(int *ptr)
 	     "with a raw capability.");
 }
 
+/**
+ * Test that `check_pointers` accepts a set of valid arguments and rejects the
+ * set if any one argument fails its check.
+ */
+void check_pointers_batch(int *ptr)
+{
+	int        onStack;
+	Capability readOnly{ptr};
+	readOnly.permissions() &= PermissionSet{Permission::Load};
+
+	TEST(check_pointers(pointer_check(ptr),
+	                    pointer_check<PermissionSet{Permission::Store}>(ptr),
+	                    pointer_check(readOnly, sizeof(int))),
+	     "check_pointers rejected valid arguments");
+	TEST(!check_pointers(pointer_check(ptr),
+	                     pointer_check<PermissionSet{Permission::Store}>(
+	                       readOnly, sizeof(int))),
+	     "check_pointers accepted a read-only pointer that must be writable");
+	TEST(!check_pointers(pointer_check(ptr),
+	                     pointer_check(ptr, sizeof(int) + 1)),
+	     "check_pointers accepted a pointer that is too small");
+	TEST(!check_pointers(pointer_check(ptr), pointer_check(&onStack)),
+	     "check_pointers accepted a pointer to the stack");
+	TEST(check_pointers(pointer_check<PermissionSet{Permission::Load}, false>(
+	       &onStack)),
+	     "check_pointers rejected a stack pointer without a stack check");
+}
+
+/**
+ * Test lending and freezing buffers.  The lent view must be exactly bounded,
+ * read-only, and local.  While a buffer is frozen, the owner's pointer must
+ * be read-only and global and the original must be restored on thaw.
+ */
+void check_buffer_lending()
+{
+	static constexpr size_t BufferSize = 64;
+	char *buffer = static_cast<char *>(malloc(BufferSize));
+	TEST(buffer != nullptr, "Failed to allocate a buffer to lend");
+
+	Capability lent{buffer_lend_read_only(buffer, BufferSize)};
+	TEST(lent.is_valid(), "Failed to lend a valid buffer");
+	TEST(lent.permissions() == PermissionSet{Permission::Load},
+	     "Lent buffer has permissions {}, expected only load",
+	     lent.permissions());
+	TEST(lent.length() == BufferSize,
+	     "Lent buffer has length {}, expected {}",
+	     lent.length(),
+	     BufferSize);
+	TEST(buffer_lend_read_only(buffer, BufferSize + 1) == nullptr,
+	     "Lent a view that is larger than the buffer");
+
+	void *owner = buffer;
+	void *original;
+	TEST_EQUAL(buffer_freeze(MALLOC_CAPABILITY, &owner, &original, BufferSize),
+	           0,
+	           "Failed to freeze a heap buffer");
+	TEST(original == buffer, "Freezing did not return the original buffer");
+	Capability frozen{owner};
+	TEST(frozen.is_valid() &&
+	       !frozen.permissions().contains(Permission::Store) &&
+	       frozen.permissions().contains(Permission::Global),
+	     "Frozen buffer has permissions {}, expected global read-only",
+	     frozen.permissions());
+	TEST_EQUAL(buffer_thaw(MALLOC_CAPABILITY, &owner, original),
+	           0,
+	           "Failed to thaw a frozen buffer");
+	TEST(owner == buffer, "Thawing did not restore the original buffer");
+
+	int result = with_frozen_buffer(
+	  MALLOC_CAPABILITY, buffer, BufferSize, [&](const char *view) {
+		  TEST(!Capability{buffer}.permissions().contains(Permission::Store),
+		       "Buffer is writable while frozen");
+		  return Capability{view}.permissions() ==
+		             PermissionSet{Permission::Load}
+		           ? 1
+		           : 0;
+	  });
+	TEST_EQUAL(result, 1, "Frozen buffer was not lent read-only");
+	TEST(Capability{buffer}.permissions().contains(Permission::Store),
+	     "Buffer was not restored after with_frozen_buffer");
+	free(buffer);
+}
+
 int test_check_pointer()
 {
 	check_pointer_strict_mode(&object);
+	check_pointers_batch(&object);
+	check_buffer_lending();
 	return 0;
 }
@@ -44,6 +44,52 @@ void test_number_of_arguments()
 	TEST(ret == 0, "compartment_call_inner returned {}", ret);
 }
 
+namespace
+{
+	/// The number of trusted-stack frames free in `tail_call_target`.
+	int tailCallFramesFree;
+
+	/**
+	 * Returns the number of further cross-compartment calls for which the
+	 * trusted stack has space.
+	 */
+	int trusted_stack_frames_free()
+	{
+		int frames = 0;
+		while (trusted_stack_has_space(frames + 1))
+		{
+			frames++;
+		}
+		return frames;
+	}
+
+	__cheri_callback int tail_call_target(int x0, const int *x1)
+	{
+		tailCallFramesFree = trusted_stack_frames_free();
+		return x0 + *x1;
+	}
+} // namespace
+
+void test_tail_call()
+{
+	debug_log("Test forwarding a call with a tail call");
+	__cheri_callback int (*target)(int, const int *) = &tail_call_target;
+	int value = 2;
+	int ret   = target(1, &value);
+	TEST(ret == 3, "Direct call returned {}", ret);
+	int directFramesFree = tailCallFramesFree;
+	ret                  = compartment_call_tail(target, 1, &value);
+	TEST(ret == 3, "Tail call returned {}", ret);
+	// The proxy's frame is reused, so the target runs at the same depth as
+	// when it is called directly.
+	TEST(tailCallFramesFree == directFramesFree,
+	     "Tail-called function had {} trusted-stack frames free, expected {}",
+	     tailCallFramesFree,
+	     directFramesFree);
+	ret = compartment_call_tail(nullptr, 1, &value);
+	TEST(ret == -EINVAL, "Tail call to an invalid callee returned {}", ret);
+}
+
 int test_compartment_call()
 {
 	bool outTestFailed = false;
@@ -68,6 +114,8 @@ int test_compartment_call()
 
 	test_number_of_arguments();
 
+	test_tail_call();
+
 	test_incorrect_export_table(nullptr, &outTestFailed);
 	TEST(outTestFailed == false,
 	     "Test incorrect entry point without error handler failed");
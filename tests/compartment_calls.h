@@ -45,4 +45,8 @@ __cheri_compartment(
   "compartment_calls_inner_with_"
   "handler") int test_incorrect_export_table_with_handler(__cheri_callback int (*fn)());
 __cheri_compartment("compartment_calls_outer") void compartment_call_outer();
+__cheri_compartment("compartment_calls_inner") int compartment_call_tail(
+  __cheri_callback int (*fn)(int, const int *),
+  int        x0,
+  const int *x1);
 constexpr int ConstantValue = 0x41414141;
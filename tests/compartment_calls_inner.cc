@@ -6,6 +6,7 @@
 #include "tests.hh"
 #include <cheri.hh>
 #include <errno.h>
+#include <switcher.h>
 #include <tuple>
 
 using namespace CHERI;
@@ -112,3 +113,12 @@ void test_incorrect_export_table(__cheri_callback void (*fn)(),
 
 	*outTestFailed = false;
 }
+
+int compartment_call_tail(__cheri_callback int (*fn)(int, const int *),
+                          int        x0,
+                          const int *x1)
+{
+	debug_log("Forwarding call with a tail call");
+	// This returns only if the tail call fails.
+	return switcher_tail_call(fn, x0, x1);
+}
@@ -5,11 +5,17 @@
 #include "crash_recovery.h"
 #include <atomic>
 #include <cheri.hh>
+#include <compartment_reset.h>
 #include <errno.h>
 
 int               crashes = 0;
 std::atomic<bool> expectFault;
 
+/// Quota for the snapshot of this compartment's globals.
+DEFINE_ALLOCATOR_CAPABILITY(SnapshotHeap, 1024)
+/// Quota that the compartment reset frees.
+DEFINE_ALLOCATOR_CAPABILITY(ResetHeap, 256)
+
 static void test_irqs_are_enabled()
 {
 	void *r = __builtin_return_address(0);
@@ -46,8 +52,34 @@ compartment_error_handler(struct ErrorState *frame, size_t mcause, size_t mtval)
 	return ErrorRecoveryBehaviour::InstallContext;
 }
 
+/**
+ * Check that resetting the compartment restores globals from the snapshot
+ * taken at the start of the test and frees the reset quota.
+ */
+static void test_compartment_reset()
+{
+	debug_log("Resetting the compartment");
+	Timeout t{UnlimitedTimeout};
+	void   *object = heap_allocate(&t, STATIC_SEALED_VALUE(ResetHeap), 64);
+	TEST(__builtin_cheri_tag_get(object), "Failed to allocate from reset heap");
+	TEST(crashes != 0, "Crash count should be non-zero before reset");
+	int ret = compartment_globals_reset(STATIC_SEALED_VALUE(ResetHeap));
+	TEST_EQUAL(ret, 0, "Compartment reset failed");
+	TEST_EQUAL(crashes, 0, "Compartment reset did not restore globals");
+	TEST_EQUAL(heap_quota_remaining(STATIC_SEALED_VALUE(ResetHeap)),
+	           256,
+	           "Compartment reset did not free its quota");
+	ret = compartment_globals_snapshot_free(STATIC_SEALED_VALUE(SnapshotHeap));
+	TEST_EQUAL(ret, 0, "Failed to free the globals snapshot");
+}
+
 int test_crash_recovery()
 {
+	Timeout t{UnlimitedTimeout};
+	int     snapshotResult =
+	  compartment_globals_snapshot(&t, STATIC_SEALED_VALUE(SnapshotHeap));
+	TEST_EQUAL(
+	  snapshotResult, 0, "Failed to snapshot the compartment's globals");
 	debug_log("Calling crashy compartment indirectly");
 	test_crash_recovery_outer(0);
 	check_stack();
@@ -105,5 +137,6 @@ int test_crash_recovery()
 		asm volatile("c.unimp");
 	}
 	TEST(crashes == MaxCrashes, "Failed to notice crash");
+	test_compartment_reset();
 	return 0;
 }
@@ -70,5 +70,31 @@ int test_eventgroup()
 	ret = eventgroup_clear(&t, group, &bits, 0b100);
 	TEST(ret == 0, "Failed to clear event group bits: {}", ret);
 	TEST(bits == 0b1000, "Bits should be 0b1000, but is {}", bits);
+
+	// Setting bits that a waiter does not want must not wake it.
+	static std::atomic<int> waiterResult{1};
+	async([=]() {
+		Timeout  t{20};
+		uint32_t bits;
+		waiterResult = eventgroup_wait(&t, group, &bits, 0b10000, false, true);
+		waiterResult.notify_all();
+	});
+	Timeout sleepTimeout{2};
+	thread_sleep(&sleepTimeout);
+	ret = eventgroup_set(&t, group, &bits, 0b100000);
+	TEST(ret == 0, "Failed to set bits for event group: {}", ret);
+	sleepTimeout = 2;
+	thread_sleep(&sleepTimeout);
+	TEST(waiterResult == 1,
+	     "Waiter returned {} after unrelated bits were set",
+	     waiterResult.load());
+	ret = eventgroup_set(&t, group, &bits, 0b10000);
+	TEST(ret == 0, "Failed to set bits for event group: {}", ret);
+	waiterResult.wait(1);
+	TEST(waiterResult == 0, "Waiter failed: {}", waiterResult.load());
+	eventgroup_get(group, &bits);
+	TEST(bits == 0b101000,
+	     "Bits should be 0b101000 after clearOnExit, but is {}",
+	     bits);
 	return 0;
 }
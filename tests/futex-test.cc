@@ -32,6 +32,8 @@ int test_futex()
 	// has been set to 1.
 	async([]() {
 		futex = 1;
+		TEST(futex_may_have_waiters(&futex),
+		     "Futex waiter summary does not include the waiting thread");
 		futex_wake(&futex, 1);
 	});
 	debug_log("Calling blocking futex_wait");
@@ -55,6 +57,35 @@ int test_futex()
 		     "futex_timed_wait timed out but elapsed ticks {} too small",
 		     t.elapsed);
 	}
+	debug_log("Calling futex with an absolute deadline");
+	{
+		uint64_t deadline = rdcycle64() + 2 * TIMERCYCLES_PER_TICK + 1;
+		Timeout  t        = Timeout::until(deadline);
+		auto     err      = futex_timed_wait(&t, &futex, 1);
+		uint64_t now      = rdcycle64();
+		TEST(err == -ETIMEDOUT,
+		     "futex_timed_wait returned {}, expected {}",
+		     err,
+		     -ETIMEDOUT);
+		TEST(now >= deadline,
+		     "futex_timed_wait returned {} cycles before its deadline",
+		     deadline - now);
+		TEST(t.remaining == 0,
+		     "Timeout has {} ticks remaining after its deadline",
+		     t.remaining);
+	}
+	debug_log("Calling futex with timer slack");
+	{
+		Timeout t   = Timeout::with_slack(2, TIMERCYCLES_PER_TICK);
+		auto    err = futex_timed_wait(&t, &futex, 1);
+		TEST(err == -ETIMEDOUT,
+		     "futex_timed_wait returned {}, expected {}",
+		     err,
+		     -ETIMEDOUT);
+		TEST(t.elapsed >= 2,
+		     "futex_timed_wait with slack woke after only {} ticks",
+		     t.elapsed);
+	}
 	Timeout t{3};
 	auto    err = futex_timed_wait(&t, &futex, 0);
 	TEST(err == 0, "futex_timed_wait returned {}, expected {}", err, 0);
@@ -110,6 +141,79 @@ int test_futex()
 	     "interrupt_complete returned success unexpectedly");
 #endif
 
+	debug_log("Testing thread notifications");
+	{
+		uint16_t self = thread_id_get();
+		uint32_t value;
+		Timeout  t{0};
+		ret = thread_notify(self, 5, ThreadNotifySetBits);
+		TEST(ret == 0, "thread_notify returned {}, expected 0", ret);
+		ret = thread_notify(self, 7, ThreadNotifySetValueWithoutOverwrite);
+		TEST(ret == -EAGAIN,
+		     "thread_notify overwrote a pending notification, returned {}",
+		     ret);
+		ret = thread_notify_wait(&t, 0, UINT32_MAX, &value);
+		TEST((ret == 0) && (value == 5),
+		     "thread_notify_wait returned {} with value {}, expected 0 and 5",
+		     ret,
+		     value);
+		ret = thread_notify_wait(&t, 0, 0, &value);
+		TEST(ret == -ETIMEDOUT,
+		     "thread_notify_wait returned {} with no notification pending",
+		     ret);
+		async([=]() { thread_notify(self, 0, ThreadNotifyIncrement); });
+		t   = Timeout{UnlimitedTimeout};
+		ret = thread_notify_take(&t, true, &value);
+		TEST((ret == 0) && (value == 1),
+		     "thread_notify_take returned {} with value {}, expected 0 and 1",
+		     ret,
+		     value);
+		ret = thread_notify(0, 0, ThreadNotifyIncrement);
+		TEST(ret == -EINVAL,
+		     "thread_notify to thread 0 returned {}, expected {}",
+		     ret,
+		     -EINVAL);
+	}
+
+	debug_log("Testing futex_requeue");
+	{
+		static uint32_t                  from;
+		static uint32_t                  to;
+		static cheriot::atomic<uint32_t> woken;
+		auto                             waiter = []() {
+            futex_wait(&from, 0);
+            woken++;
+		};
+		async(waiter);
+		async(waiter);
+		// Give both waiters time to block.
+		Timeout sleep{2};
+		thread_sleep(&sleep);
+		ret = futex_requeue(&from, &to, 1, 1, 1);
+		TEST(ret == -EAGAIN,
+		     "futex_requeue with the wrong expected value returned {}, "
+		     "expected {}",
+		     ret,
+		     -EAGAIN);
+		ret = futex_requeue(&from, &to, 0, 1, 1);
+		TEST(ret == 2, "futex_requeue returned {}, expected 2", ret);
+		sleep = Timeout{2};
+		thread_sleep(&sleep);
+		TEST(woken == 1,
+		     "futex_requeue woke {} threads, expected 1",
+		     woken.load());
+		ret = futex_wake(&from, 1);
+		TEST(ret == 0, "futex_wake on the source woke {} threads", ret);
+		ret = futex_wake(&to, 1);
+		TEST(ret == 1,
+		     "futex_wake on the requeue target woke {} threads, expected 1",
+		     ret);
+		while (woken != 2)
+		{
+			yield();
+		}
+	}
+
 	debug_log("Starting priority inheritance test");
 	futex = 0;
 
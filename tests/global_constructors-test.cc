@@ -18,6 +18,16 @@ struct X
 	}
 } x;
 
+/// The number of times that the lazy static in `lazy` has been initialised.
+int lazyInitialisations;
+
+/// Returns a lazily initialised static.
+int &lazy()
+{
+	static cheriot::LazyStatic<int> value;
+	return value.get([]() { return ++lazyInitialisations + 41; });
+}
+
 /// Check that we run global constructors precisely once.
 void test_global_constructors()
 {
@@ -26,4 +36,13 @@ void test_global_constructors()
 	TEST(X::setInCtor == 1, "Constructor not run");
 	GlobalConstructors::run();
 	TEST(X::setInCtor == 1, "Constructor run twice");
-}
+	int ret = GlobalConstructors::on_first_call([]() { return X::setInCtor; });
+	TEST(ret == 1, "Constructor run again by on_first_call");
+	// Lazy statics are initialised on first use, precisely once.
+	TEST(lazy() == 42, "Lazy static has the wrong value");
+	lazy()++;
+	TEST(lazy() == 43, "Lazy static was reinitialised");
+	TEST(lazyInitialisations == 1,
+	     "Lazy static initialised {} times",
+	     lazyInitialisations);
+}
\ No newline at end of file
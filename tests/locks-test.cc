@@ -15,9 +15,12 @@ using namespace thread_pool;
 namespace
 {
 
-	FlagLock                  flagLock;
-	FlagLockPriorityInherited flagLockPriorityInherited;
-	TicketLock                ticketLock;
+	FlagLock                          flagLock;
+	FlagLockPriorityInherited         flagLockPriorityInherited;
+	FlagLockAdaptive                  flagLockAdaptive;
+	TicketLock                        ticketLock;
+	ReaderWriterLock                  readerWriterLock;
+	ReaderWriterLockPriorityInherited readerWriterLockPriorityInherited;
 
 	cheriot::atomic<bool> modified;
 	cheriot::atomic<int>  counter;
@@ -394,23 +397,310 @@ namespace
 		     counter.load());
 	}
 
+	/**
+	 * Test that a reader-writer lock allows concurrent readers, excludes
+	 * readers while a writer holds the lock, and prefers waiting writers to
+	 * new readers.
+	 */
+	template<typename Lock>
+	void test_reader_writer_lock(Lock &lock)
+	{
+		counter = 0;
+		{
+			SharedLockGuard g{lock};
+			async([&]() {
+				Timeout t{5};
+				SharedLockGuard g{lock, &t};
+				TEST(g, "Failed to acquire a read lock held by another reader");
+				counter++;
+			});
+			while (counter.load() == 0)
+			{
+				sleep(1);
+			}
+			Timeout t{1};
+			TEST(lock.try_lock(&t) == false,
+			     "Acquired a write lock while a reader holds the lock");
+		}
+		{
+			LockGuard g{lock};
+			Timeout   t{1};
+			TEST(lock.try_lock_shared(&t) == false,
+			     "Acquired a read lock while a writer holds the lock");
+		}
+
+		// Hold the lock for reading while another thread waits to write.
+		modified = false;
+		counter  = 0;
+		lock.lock_shared();
+		async([&]() {
+			counter++;
+			LockGuard g{lock};
+			modified = true;
+		});
+		while (counter.load() == 0)
+		{
+			sleep(1);
+		}
+		sleep(1);
+		TEST(modified == false, "Writer acquired the lock while it was read");
+		Timeout t{1};
+		TEST(lock.try_lock_shared(&t) == false,
+		     "New reader acquired the lock while a writer is waiting");
+		lock.unlock_shared();
+		while (!modified)
+		{
+			sleep(1);
+		}
+		TEST(lock.try_lock_shared(),
+		     "Failed to acquire a read lock after the writer released it");
+		lock.unlock_shared();
+	}
+
+	/**
+	 * Test that condition variables wake waiters when notified with the lock
+	 * held and that waits time out.
+	 */
+	template<typename Lock>
+	void test_condition_variable(Lock &lock)
+	{
+		static ConditionVariable condition;
+		static bool              ready;
+		ready   = false;
+		counter = 0;
+		{
+			LockGuard g{lock};
+			Timeout   t{1};
+			TEST(condition.wait(&t, lock) == -ETIMEDOUT,
+			     "Waiting on a condition variable without a notify did not "
+			     "time out");
+		}
+		for (int i = 0; i < 2; i++)
+		{
+			async([&]() {
+				LockGuard g{lock};
+				Timeout   t{20};
+				TEST(condition.wait(&t, lock, []() { return ready; }),
+				     "Condition variable wait timed out");
+				counter++;
+			});
+		}
+		sleep(2);
+		TEST(counter == 0, "Condition variable waiters woke before notify");
+		{
+			LockGuard g{lock};
+			ready = true;
+			condition.notify_all(lock);
+		}
+		for (int sleeps = 0; (counter.load() < 2) && (sleeps < 20); sleeps++)
+		{
+			sleep(1);
+		}
+		TEST(counter == 2,
+		     "Expected two condition variable waiters to wake, {} did",
+		     counter.load());
+	}
+
+	/**
+	 * Test that a latch releases its waiters only once it has been counted
+	 * down to zero, and that waits time out.
+	 */
+	void test_latch()
+	{
+		static Latch latch{2};
+		Timeout      t{1};
+		TEST(!latch.wait(&t),
+		     "Waiting on a latch that was not counted down did not time out");
+		TEST(!latch.count_down(3),
+		     "Counted a latch down by more than its count");
+		for (int i = 0; i < 2; i++)
+		{
+			async([]() { latch.count_down(); });
+		}
+		Timeout wait{20};
+		TEST(latch.wait(&wait), "Latch wait timed out");
+		TEST(latch.try_wait(), "Latch is not released after waiting");
+	}
+
+	/**
+	 * Test that a barrier holds each thread until all have arrived, that
+	 * exactly one thread completes each phase, and that a thread that times
+	 * out withdraws its arrival.
+	 */
+	void test_barrier()
+	{
+		static Barrier barrier{3};
+		counter = 0;
+		static cheriot::atomic<int> completions;
+		completions = 0;
+
+		auto twoPhases = []() {
+			for (int phase = 1; phase <= 2; phase++)
+			{
+				counter++;
+				Timeout t{20};
+				int     ret = barrier.arrive_and_wait(&t);
+				TEST(ret >= 0, "Barrier wait failed: {}", ret);
+				TEST(counter.load() >= phase * 3,
+				     "Left barrier phase {} with only {} arrivals",
+				     phase,
+				     counter.load());
+				completions += ret;
+			}
+		};
+		async(twoPhases);
+		async(twoPhases);
+		twoPhases();
+		// Wait for the other threads to record their results.
+		for (int sleeps = 0; (completions.load() < 2) && (sleeps < 20);
+		     sleeps++)
+		{
+			sleep(1);
+		}
+		sleep(1);
+		TEST(completions == 2,
+		     "Expected one thread to complete each of two barrier phases, {} "
+		     "did",
+		     completions.load());
+
+		static Barrier pair{2};
+		Timeout        t{1};
+		TEST(pair.arrive_and_wait(&t) == -ETIMEDOUT,
+		     "Waiting alone at a barrier did not time out");
+		async([]() {
+			Timeout t{20};
+			pair.arrive_and_wait(&t);
+		});
+		Timeout wait{20};
+		TEST(pair.arrive_and_wait(&wait) >= 0,
+		     "Barrier did not complete after a timed-out arrival was "
+		     "withdrawn");
+	}
+
+	/**
+	 * Test that sequence lock readers never see a torn value while another
+	 * thread is writing, and can read through a read-only capability.
+	 */
+	void test_seqlock()
+	{
+		struct Pair
+		{
+			uint32_t first;
+			uint32_t second;
+		};
+		static SeqLock<Pair> seqLock;
+		constexpr uint32_t   Writes = 200;
+		modified                    = false;
+		async([&]() {
+			for (uint32_t i = 1; i <= Writes; i++)
+			{
+				seqLock.write({i, ~i});
+				if ((i % 16) == 0)
+				{
+					sleep(1);
+				}
+			}
+			modified = true;
+		});
+		Capability<const SeqLock<Pair>> readOnly{&seqLock};
+		readOnly.permissions() &= PermissionSet{Permission::Load};
+		uint32_t last = 0;
+		while (!modified)
+		{
+			Pair value = readOnly->read();
+			TEST(value.second == ~value.first,
+			     "Sequence lock read a torn value: {}, {}",
+			     value.first,
+			     value.second);
+			TEST(value.first >= last,
+			     "Sequence lock value went backwards from {} to {}",
+			     last,
+			     value.first);
+			last = value.first;
+			sleep(1);
+		}
+		Pair value;
+		TEST(readOnly->try_read(value) && (value.first == Writes),
+		     "Sequence lock holds {} after the last write, expected {}",
+		     value.first,
+		     Writes);
+		TEST(seqLock.version() == 2 * Writes,
+		     "Sequence lock version is {}, expected {}",
+		     seqLock.version(),
+		     2 * Writes);
+	}
+
+	/**
+	 * Test that priority-ceiling locks raise the holder to the ceiling and
+	 * restore its priority on release, including when nested.
+	 */
+	void test_priority_ceiling()
+	{
+		FlagLockPriorityCeiling outer{2};
+		FlagLockPriorityCeiling inner{3};
+		int                     original = thread_priority_set(1);
+		TEST(original >= 3, "Failed to lower priority: {}", original);
+		{
+			LockGuard g{outer};
+			TEST_EQUAL(thread_priority_get(),
+			           2,
+			           "Holding a ceiling lock did not raise priority");
+			{
+				LockGuard g{inner};
+				TEST_EQUAL(thread_priority_get(),
+				           3,
+				           "Holding a nested ceiling lock did not raise "
+				           "priority");
+			}
+			TEST_EQUAL(thread_priority_get(),
+			           2,
+			           "Releasing a nested ceiling lock did not restore "
+			           "priority");
+		}
+		TEST_EQUAL(thread_priority_get(),
+		           1,
+		           "Releasing a ceiling lock did not restore priority");
+		// The test runner cannot raise itself above its configured priority.
+		FlagLockPriorityCeiling tooHigh{uint8_t(original + 1)};
+		TEST(!tooHigh.try_lock(), "Acquired a lock with an unreachable ceiling");
+		TEST_EQUAL(thread_priority_get(),
+		           1,
+		           "Failing to acquire a ceiling lock changed priority");
+		thread_priority_set(original);
+	}
+
 } // namespace
 
 int test_locks()
 {
 	test_lock(flagLock);
 	test_lock(flagLockPriorityInherited);
+	test_lock(flagLockAdaptive);
 	test_lock(ticketLock);
 	test_get_owner_thread_id(flagLockPriorityInherited);
 	test_flaglock_unlock();
 	test_trylock(flagLock);
 	test_trylock(flagLockPriorityInherited);
+	test_trylock(flagLockAdaptive);
 	test_destruct_lock_wake_up(flagLock);
 	test_destruct_lock_wake_up(flagLockPriorityInherited);
+	test_destruct_lock_wake_up(flagLockAdaptive);
 	test_destruct_flag_lock_acquire();
 	test_destruct_flag_lock_unlock();
 	test_ticket_lock_ordering();
 	test_ticket_lock_overflow();
 	test_recursive_mutex();
+	test_lock(readerWriterLock);
+	test_lock(readerWriterLockPriorityInherited);
+	test_reader_writer_lock(readerWriterLock);
+	test_reader_writer_lock(readerWriterLockPriorityInherited);
+	test_condition_variable(flagLock);
+	test_condition_variable(flagLockPriorityInherited);
+	static RecursiveMutex recursiveMutex;
+	test_condition_variable(recursiveMutex);
+	test_latch();
+	test_barrier();
+	test_seqlock();
+	test_priority_ceiling();
 	return 0;
 }
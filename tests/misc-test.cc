@@ -3,9 +3,21 @@
 
 #define TEST_NAME "Test misc APIs"
 #include "tests.hh"
+#include <algorithm>
+#include <channel.hh>
+#include <checksum.h>
+#include <compress.h>
 #include <compartment-macros.h>
+#include <ds/divide.h>
+#include <ds/hash_map.h>
 #include <ds/pointer.h>
+#include <ds/pool.h>
+#include <errno.h>
+#include <ring_buffer.hh>
 #include <string.h>
+#include <thread-local.h>
+#include <thread.h>
+#include <time.h>
 #include <timeout.h>
 
 using namespace CHERI;
@@ -13,6 +25,33 @@ using namespace CHERI;
 namespace
 {
 
+	/**
+	 * Check that the monotonic clock advances and that a sub-tick sleep
+	 * sleeps for at least the requested time.
+	 */
+	void check_clock()
+	{
+		debug_log("Test the monotonic clock and microsecond sleeps.");
+		timespec before;
+		timespec after;
+		int      ret = clock_gettime(CLOCK_MONOTONIC, &before);
+		TEST(ret == 0, "clock_gettime failed: {}", ret);
+		TEST(clock_gettime(0, &after) == -EINVAL,
+		     "clock_gettime accepted an unknown clock");
+		uint64_t start = thread_time_cycles_get();
+		thread_microsecond_sleep(200);
+		uint64_t slept = thread_time_cycles_get() - start;
+		TEST(slept >= (200ULL * CPU_TIMER_HZ) / 1'000'000,
+		     "Microsecond sleep returned after {} cycles",
+		     slept);
+		clock_gettime(CLOCK_MONOTONIC, &after);
+		TEST((after.tv_sec > before.tv_sec) ||
+		       ((after.tv_sec == before.tv_sec) &&
+		        (after.tv_nsec > before.tv_nsec)),
+		     "Monotonic clock did not advance");
+		TEST(after.tv_nsec < 1'000'000'000, "Too many nanoseconds");
+	}
+
 	/**
 	 * Test timeouts.
 	 *
@@ -130,6 +169,181 @@ namespace
 		     "memrchr must return NULL for zero-size pointers.");
 	}
 
+	/**
+	 * Test memmem and strstr, including needles that make a naive search
+	 * quadratic, periodic needles, and matches at the very end of the
+	 * haystack.
+	 */
+	void check_memmem()
+	{
+		debug_log("Test memmem and strstr.");
+
+		const char haystack[] = "one two three two one";
+		TEST(memmem(haystack, sizeof(haystack) - 1, "two", 3) == &haystack[4],
+		     "memmem did not find the first occurrence");
+		TEST(memmem(haystack, sizeof(haystack) - 1, "one", 3) == &haystack[0],
+		     "memmem did not find a match at the start");
+		TEST(memmem(haystack, sizeof(haystack) - 1, "o one", 5) ==
+		       &haystack[16],
+		     "memmem did not find a match at the end");
+		TEST(memmem(haystack, sizeof(haystack) - 2, "o one", 5) == nullptr,
+		     "memmem found a match that extends past the haystack");
+		TEST(memmem(haystack, sizeof(haystack) - 1, "four", 4) == nullptr,
+		     "memmem found a needle that is not present");
+		TEST(memmem(haystack, 0, "", 0) == haystack,
+		     "memmem did not match an empty needle");
+
+		static char repeated[512];
+		memset(repeated, 'a', sizeof(repeated));
+		repeated[sizeof(repeated) - 1] = 'b';
+		const char needle[]            = "aaaaaaaaaaaaaaab";
+		TEST(memmem(repeated, sizeof(repeated), needle, sizeof(needle) - 1) ==
+		       &repeated[sizeof(repeated) - (sizeof(needle) - 1)],
+		     "memmem did not find a needle at the end of a repetitive "
+		     "haystack");
+		TEST(memmem(repeated, sizeof(repeated) - 1, "aaab", 4) == nullptr,
+		     "memmem found a needle that is not present");
+		const char periodic[] = "abcabcabd";
+		const char text[]     = "abcabcabcabcabdabc";
+		TEST(memmem(text, sizeof(text) - 1, periodic, sizeof(periodic) - 1) ==
+		       &text[6],
+		     "memmem did not find a periodic needle");
+
+		TEST(strstr(haystack, "three") == &haystack[8],
+		     "strstr did not find a substring");
+		TEST(strstr(haystack, "") == haystack,
+		     "strstr did not match an empty needle");
+		TEST(strnstr(haystack, "three", 13) == &haystack[8],
+		     "strnstr did not find a match that ends at the length");
+		TEST(strnstr(haystack, "three", 12) == nullptr,
+		     "strnstr found a match that extends past the length");
+		Capability<const char> bounded{haystack};
+		bounded.bounds() = 7;
+		TEST(strstr(bounded.get(), "three") == nullptr,
+		     "strstr searched past the bounds of an unterminated haystack");
+	}
+
+	/**
+	 * Test the word-at-a-time string functions.
+	 *
+	 * This test checks, for strings at every alignment and of lengths around
+	 * a multiple of the word size, that strlen, strchr, memchr, and strcmp
+	 * give the same results as the bytewise definitions and do not read past
+	 * the end of a capability bounded to the string and its terminator.
+	 */
+	void check_string_word_at_a_time()
+	{
+		debug_log("Test word-at-a-time string functions.");
+
+		alignas(4) char buffer[16];
+		alignas(4) char other[16];
+		for (size_t offset = 0; offset < 4; offset++)
+		{
+			for (size_t length = 0; length < 12; length++)
+			{
+				for (size_t i = 0; i < length; i++)
+				{
+					buffer[offset + i] = static_cast<char>('a' + i);
+					other[offset + i]  = static_cast<char>('a' + i);
+				}
+				buffer[offset + length] = '\0';
+				other[offset + length]  = '\0';
+				Capability<const char> sBounded{&buffer[offset]};
+				sBounded.bounds() = length + 1;
+				Capability<const char> tBounded{&other[offset]};
+				tBounded.bounds() = length + 1;
+				const char *s     = sBounded.get();
+				const char *t     = tBounded.get();
+				TEST_EQUAL(strlen(s), length, "strlen returned the wrong length");
+				TEST(strchr(s, '\0') == s + length,
+				     "strchr did not find the terminator");
+				TEST(memchr(s, '\0', length + 1) == s + length,
+				     "memchr did not find the terminator");
+				TEST(strcmp(s, t) == 0, "strcmp found equal strings different");
+				if (length > 0)
+				{
+					TEST(strchr(s, 'a' + length - 1) == s + length - 1,
+					     "strchr did not find the last character");
+					TEST(memchr(s, 'a' + length - 1, length) == s + length - 1,
+					     "memchr did not find the last character");
+					TEST(strchr(s, 'z') == nullptr,
+					     "strchr found a character that is not present");
+					other[offset + length - 1] = 'z';
+					TEST(strcmp(s, t) < 0,
+					     "strcmp did not order strings that differ in the last "
+					     "character");
+					TEST(strcmp(t, s) > 0,
+					     "strcmp did not order strings that differ in the last "
+					     "character");
+				}
+			}
+		}
+	}
+
+	/**
+	 * Test memcpy and memset.
+	 *
+	 * This test checks that memcpy preserves tags when copying capabilities
+	 * between capability-aligned buffers, that it copies the right bytes
+	 * (including between overlapping buffers) for every relative alignment
+	 * of the source and destination, and that memset fills exactly the
+	 * requested range with both zero and non-zero values.
+	 */
+	void check_memcpy_memset()
+	{
+		debug_log("Test memcpy and memset.");
+
+		void *pointers[6];
+		void *copies[6];
+		for (auto &pointer : pointers)
+		{
+			pointer = &pointer;
+		}
+		memcpy(copies, pointers, sizeof(pointers));
+		for (size_t i = 0; i < 6; i++)
+		{
+			TEST(Capability{copies[i]}.is_valid(),
+			     "memcpy did not preserve the tag of pointer {}",
+			     i);
+			TEST(copies[i] == pointers[i], "memcpy corrupted pointer {}", i);
+		}
+
+		alignas(8) unsigned char buffer[80];
+		for (size_t source = 0; source < 8; source++)
+		{
+			for (size_t destination = 0; destination < 8; destination++)
+			{
+				for (size_t i = 0; i < sizeof(buffer); i++)
+				{
+					buffer[i] = static_cast<unsigned char>(i);
+				}
+				memmove(&buffer[destination + 4], &buffer[source + 4], 64);
+				for (size_t i = 0; i < 64; i++)
+				{
+					TEST_EQUAL(buffer[destination + 4 + i],
+					           static_cast<unsigned char>(source + 4 + i),
+					           "memmove copied the wrong byte");
+				}
+			}
+		}
+
+		for (int value : {0, 0xa5})
+		{
+			for (size_t offset = 0; offset < 8; offset++)
+			{
+				memset(buffer, 0x11, sizeof(buffer));
+				memset(&buffer[offset], value, 61);
+				for (size_t i = 0; i < sizeof(buffer); i++)
+				{
+					bool inside = (i >= offset) && (i < offset + 61);
+					TEST_EQUAL(buffer[i],
+					           static_cast<unsigned char>(inside ? value : 0x11),
+					           "memset wrote the wrong value");
+				}
+			}
+		}
+	}
+
 	/**
 	 * Test pointer utilities.
 	 *
@@ -157,6 +371,234 @@ namespace
 		  "The pointer proxy `=` operator does not correctly set the pointer.");
 	}
 
+	/**
+	 * Test the fixed-size object pool: objects are exactly bounded, the pool
+	 * is exhausted after `Count` allocations, freed objects are reused and
+	 * zeroed, and pointers that the pool does not own are rejected.
+	 */
+	void check_pool()
+	{
+		debug_log("Test object pools.");
+
+		static ds::pool::Pool<uint64_t, 4> pool;
+		uint64_t                          *objects[4];
+		for (auto &object : objects)
+		{
+			object = static_cast<uint64_t *>(pool.allocate());
+			TEST(object != nullptr, "Failed to allocate from a pool");
+			TEST(Capability{object}.length() == sizeof(uint64_t),
+			     "Pool object {} has the wrong bounds",
+			     object);
+			*object = 42;
+		}
+		TEST(pool.allocate() == nullptr,
+		     "Allocated more objects than the pool holds");
+
+		TEST(pool.deallocate(objects[1]), "Failed to free a pool object");
+		uint64_t *reused = static_cast<uint64_t *>(pool.allocate());
+		TEST(Capability{reused}.address() == Capability{objects[1]}.address(),
+		     "Freed pool object {} was not reused ({})",
+		     objects[1],
+		     reused);
+		TEST(*reused == 0, "Reused pool object was not zeroed");
+
+		uint64_t notInPool;
+		TEST(!pool.deallocate(&notInPool),
+		     "Freed a pointer that is not in the pool");
+		TEST(!pool.deallocate(reinterpret_cast<char *>(objects[2]) + 1),
+		     "Freed a pointer into the middle of a pool object");
+
+		TEST(pool.destroy(objects[3]), "Failed to destroy a pool object");
+		uint64_t *created = pool.create(uint64_t{7});
+		TEST((created != nullptr) && (*created == 7),
+		     "Failed to create an object in a pool");
+		uint64_t *live[] = {objects[0], reused, objects[2], created};
+		for (auto *object : live)
+		{
+			TEST(pool.destroy(object), "Failed to destroy a pool object");
+		}
+	}
+
+	/**
+	 * Test hash maps, with enough colliding inserts and erases to exercise
+	 * Robin Hood displacement and backward-shift deletion.
+	 */
+	void check_hash_map()
+	{
+		debug_log("Test hash maps.");
+
+		static ds::hash_map::FixedHashMap<uint32_t, uint32_t, 16> map;
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			uint32_t *value = map.insert(i * 16, i);
+			TEST((value != nullptr) && (*value == i),
+			     "Failed to insert key {} in a hash map",
+			     i * 16);
+		}
+		TEST(map.size() == 16,
+		     "Hash map has {} entries, expected 16",
+		     map.size());
+		TEST(map.insert(1, 1) == nullptr, "Inserted into a full hash map");
+		TEST(*map.insert(32, 42) == 42, "Failed to replace a hash map value");
+		for (uint32_t i = 0; i < 16; i += 2)
+		{
+			TEST(map.erase(i * 16), "Failed to erase key {}", i * 16);
+		}
+		TEST(!map.erase(0), "Erased a key that is no longer present");
+		for (uint32_t i = 0; i < 16; i++)
+		{
+			uint32_t *value = map.find(i * 16);
+			TEST((value != nullptr) == ((i & 1) == 1),
+			     "Key {} is {}present",
+			     i * 16,
+			     value == nullptr ? "not " : "");
+			TEST((value == nullptr) || (*value == i),
+			     "Key {} has the wrong value",
+			     i * 16);
+		}
+		size_t visited = 0;
+		map.for_each([&](uint32_t key, uint32_t &value) {
+			TEST(key == value * 16, "Key {} has value {}", key, value);
+			visited++;
+		});
+		TEST(visited == 8, "Visited {} hash map entries, expected 8", visited);
+		map.clear();
+		TEST(map.empty() && !map.contains(16), "Failed to clear a hash map");
+
+		// Capability keys are compared by address only.
+		uint32_t                                                 objects[2];
+		ds::hash_map::FixedHashMap<Capability<uint32_t>, int, 4> byAddress;
+		byAddress.insert(Capability{&objects[0]}, 1);
+		Capability<uint32_t> narrowed{&objects[0]};
+		narrowed.permissions() &= PermissionSet{Permission::Load};
+		TEST((byAddress.find(narrowed) != nullptr) &&
+		       (*byAddress.find(narrowed) == 1),
+		     "Failed to find a capability key with different permissions");
+		TEST(!byAddress.contains(Capability{&objects[1]}),
+		     "Found a capability key that was not inserted");
+	}
+
+	/**
+	 * Test 64-bit division, both through the runtime helpers (with operands
+	 * that the compiler cannot see) and with constant reciprocals, against
+	 * quotients computed at compile time.
+	 */
+	void check_division()
+	{
+		debug_log("Test 64-bit division.");
+
+		struct Case
+		{
+			uint64_t dividend;
+			uint64_t divisor;
+			uint64_t quotient;
+			uint64_t remainder;
+		};
+		static constexpr auto Make = [](uint64_t a, uint64_t b) {
+			return Case{a, b, a / b, a % b};
+		};
+		static constexpr Case Cases[] = {
+		  Make(0xffff'ffff'ffff'ffff, 1),
+		  Make(0xffff'ffff'ffff'ffff, 10),
+		  Make(0x1234'5678'9abc'def0, 0xffff'ffff),
+		  Make(0x1234'5678'9abc'def0, 0x1'0000'0001),
+		  Make(0x8000'0000'0000'0000, 0x8000'0000'0000'0001),
+		  Make(0xffff'ffff'ffff'fffe, 0xffff'ffff'ffff'ffff),
+		  Make(0x0000'0001'0000'0000, 3),
+		  Make(0xdead'beef'cafe'f00d, 0x0000'1234'5678'9abc),
+		  Make(0xdead'beef'cafe'f00d, 0x8000'0001),
+		  Make(1'000'000'007, 1'000'000'008),
+		};
+		for (const auto &c : Cases)
+		{
+			volatile uint64_t dividend = c.dividend;
+			volatile uint64_t divisor  = c.divisor;
+			uint64_t          quotient = dividend / divisor;
+			TEST(quotient == c.quotient,
+			     "{} / {} gave {}, expected {}",
+			     c.dividend,
+			     c.divisor,
+			     quotient,
+			     c.quotient);
+			uint64_t remainder = dividend % divisor;
+			TEST(remainder == c.remainder,
+			     "{} % {} gave {}, expected {}",
+			     c.dividend,
+			     c.divisor,
+			     remainder,
+			     c.remainder);
+			int64_t          half           = c.dividend >> 1;
+			volatile int64_t negative       = -half;
+			int64_t          signedQuotient = negative / 3;
+			TEST(signedQuotient == -(half / 3),
+			     "{} / 3 gave {}",
+			     -half,
+			     signedQuotient);
+		}
+
+		volatile uint64_t cycles = 0x0123'4567'89ab'cdef;
+		TEST(ds::divide::Reciprocal<10>::divide(cycles) ==
+		       0x0123'4567'89ab'cdefULL / 10,
+		     "Reciprocal division by 10 failed");
+		TEST(ds::divide::Reciprocal<10>::remainder(cycles) ==
+		       0x0123'4567'89ab'cdefULL % 10,
+		     "Reciprocal remainder by 10 failed");
+		TEST(ds::divide::Reciprocal<TIMERCYCLES_PER_TICK>::divide(cycles) ==
+		       0x0123'4567'89ab'cdefULL / TIMERCYCLES_PER_TICK,
+		     "Reciprocal division by the tick length failed");
+		TEST(ds::divide::Reciprocal<0xffff'ffff>::divide(~uint64_t(0)) ==
+		       ~uint64_t(0) / 0xffff'ffff,
+		     "Reciprocal division by the largest divisor failed");
+		TEST(ds::divide::Reciprocal<64>::divide(cycles) ==
+		       0x0123'4567'89ab'cdefULL / 64,
+		     "Reciprocal division by a power of two failed");
+		TEST(ds::divide::multiply_high(~uint64_t(0), ~uint64_t(0)) ==
+		       ~uint64_t(0) - 1,
+		     "multiply_high of the largest values failed");
+	}
+
+	/**
+	 * Test bulk ring buffer operations, including runs that wrap around the
+	 * end of the buffer.
+	 */
+	void check_ring_buffer_bulk()
+	{
+		debug_log("Test bulk ring buffer operations.");
+
+		static RingBuffer<uint32_t, 4> ring;
+		uint32_t                       next     = 0;
+		uint32_t                       expected = 0;
+		int                            segments = 0;
+		auto fill = [&](uint32_t *run, size_t length) {
+			segments++;
+			for (size_t i = 0; i < length; i++)
+			{
+				run[i] = next++;
+			}
+		};
+		auto drain = [&](uint32_t *run, size_t length) {
+			segments++;
+			for (size_t i = 0; i < length; i++)
+			{
+				TEST_EQUAL(run[i], expected++, "Messages were reordered");
+			}
+		};
+
+		size_t count = ring.push_bulk(3, fill);
+		TEST_EQUAL(count, size_t(3), "Bulk push into an empty ring");
+		count = ring.pop_bulk(2, drain);
+		TEST_EQUAL(count, size_t(2), "Bulk pop from a partly full ring");
+		segments = 0;
+		count    = ring.push_bulk(8, fill);
+		TEST_EQUAL(count, size_t(3), "Bulk push into a partly full ring");
+		TEST_EQUAL(segments, 2, "Bulk push did not wrap around the ring");
+		segments = 0;
+		count    = ring.pop_bulk(8, drain);
+		TEST_EQUAL(count, size_t(4), "Bulk pop from a full ring");
+		TEST_EQUAL(segments, 2, "Bulk pop did not wrap around the ring");
+		TEST_EQUAL(expected, next, "Bulk pop lost messages");
+	}
+
 	void check_shared_object(const char      *name,
 	                         Capability<void> object,
 	                         size_t           size,
@@ -223,6 +665,263 @@ namespace
 		free(p);
 	}
 
+	/**
+	 * Test memcmp on every combination of small misalignments and lengths,
+	 * with the first difference at every position, so that both the word and
+	 * the byte paths are covered.  The constant-time variants are checked
+	 * against the same results.
+	 */
+	void check_memcmp()
+	{
+		debug_log("Test memcmp.");
+		alignas(4) unsigned char first[24];
+		alignas(4) unsigned char second[24];
+		auto sign = [](int value) { return (value > 0) - (value < 0); };
+		for (size_t offset = 0; offset < 4; offset++)
+		{
+			for (size_t length = 0; length <= 16; length++)
+			{
+				for (size_t difference = 0; difference <= length; difference++)
+				{
+					memset(first, 'a', sizeof(first));
+					memset(second, 'a', sizeof(second));
+					int expected = 0;
+					if (difference < length)
+					{
+						second[offset + difference] = 'b';
+						expected                    = -1;
+					}
+					TEST(sign(memcmp(first + offset,
+					                 second + offset,
+					                 length)) == expected,
+					     "memcmp of {} bytes at offset {} with a difference at "
+					     "{} is wrong",
+					     length,
+					     offset,
+					     difference);
+					TEST(sign(memcmp(second + offset,
+					                 first + offset,
+					                 length)) == -expected,
+					     "Reversed memcmp of {} bytes at offset {} is wrong",
+					     length,
+					     offset);
+					TEST(sign(timingsafe_memcmp(
+					       second + offset, first + offset, length)) ==
+					       -expected,
+					     "timingsafe_memcmp of {} bytes at offset {} is wrong",
+					     length,
+					     offset);
+					TEST((timingsafe_bcmp(first + offset,
+					                      second + offset,
+					                      length) != 0) == (expected != 0),
+					     "timingsafe_bcmp of {} bytes at offset {} is wrong",
+					     length,
+					     offset);
+				}
+			}
+		}
+		// Misaligned relative to each other, so only the byte path is used.
+		memset(first, 'a', sizeof(first));
+		memset(second, 'a', sizeof(second));
+		TEST(memcmp(first, second + 1, 16) == 0,
+		     "memcmp of mutually misaligned buffers is wrong");
+		second[9] = 0xff;
+		TEST(memcmp(first, second + 1, 16) < 0,
+		     "memcmp does not compare bytes as unsigned");
+	}
+
+	/**
+	 * Check the checksum library against known values, at every alignment.
+	 */
+	void check_checksums()
+	{
+		debug_log("Testing checksums.");
+		static const char Check[] = "_123456789";
+		for (size_t offset = 0; offset < 4; offset++)
+		{
+			char buffer[16];
+			memcpy(buffer + offset, Check + 1, 9);
+			TEST_EQUAL(checksum_crc32(0, buffer + offset, 9),
+			           0xcbf43926U,
+			           "CRC-32 of the check string is wrong");
+			TEST_EQUAL(checksum_crc16_ccitt(0xffff, buffer + offset, 9),
+			           0x29b1,
+			           "CRC-16-CCITT of the check string is wrong");
+		}
+		TEST_EQUAL(
+		  checksum_crc32(checksum_crc32(0, Check + 1, 4), Check + 5, 5),
+		  0xcbf43926U,
+		  "Chained CRC-32 of the check string is wrong");
+		// The example from RFC 1071, section 3, summed as little-endian
+		// words.
+		static const uint8_t Words[] = {
+		  0x00, 0x01, 0xf2, 0x03, 0xf4, 0xf5, 0xf6, 0xf7};
+		for (size_t offset = 0; offset < 4; offset++)
+		{
+			uint8_t buffer[16];
+			memcpy(buffer + offset, Words, sizeof(Words));
+			TEST_EQUAL(checksum_internet(buffer + offset, sizeof(Words)),
+			           uint16_t(~0xf2ddU),
+			           "Internet checksum of the RFC 1071 example is wrong");
+		}
+		uint32_t sum = checksum_internet_partial(Words, 2, 0);
+		sum          = checksum_internet_partial(Words + 2, 6, sum);
+		TEST_EQUAL(checksum_internet_finish(sum),
+		           uint16_t(~0xf2ddU),
+		           "Chained Internet checksum is wrong");
+		uint8_t updated[sizeof(Words)];
+		memcpy(updated, Words, sizeof(Words));
+		updated[2]       = 0x12;
+		uint16_t oldWord = Words[2] | (Words[3] << 8);
+		uint16_t newWord = updated[2] | (updated[3] << 8);
+		TEST_EQUAL(checksum_internet_update(
+		             checksum_internet(Words, sizeof(Words)), oldWord, newWord),
+		           checksum_internet(updated, sizeof(updated)),
+		           "Incrementally updated Internet checksum is wrong");
+	}
+
+	/**
+	 * Check that the compression library round trips a block and a stream
+	 * and that it compresses repetitive text.
+	 */
+	void check_compression()
+	{
+		debug_log("Testing compression.");
+		static uint32_t workspace[COMPRESS_LZ4_WORKSPACE_SIZE / 4];
+		static char     text[2000];
+		static char     compressed[sizeof(text) + 32];
+		static char     decompressed[sizeof(text)];
+		for (size_t i = 0; i < sizeof(text); i++)
+		{
+			text[i] = "sensor=3 temp=21 ok\n"[i % 20] + ((i % 97) == 0);
+		}
+		ssize_t length = compress_lz4(
+		  text, sizeof(text), compressed, sizeof(compressed), workspace);
+		TEST(length > 0, "Compression failed: {}", length);
+		TEST(length < ssize_t(sizeof(text)) / 4,
+		     "Repetitive text compressed to only {} bytes",
+		     length);
+		TEST_EQUAL(decompress_lz4(
+		             compressed, length, decompressed, sizeof(decompressed)),
+		           ssize_t(sizeof(text)),
+		           "Decompressed block has the wrong length");
+		TEST(memcmp(text, decompressed, sizeof(text)) == 0,
+		     "Decompressed block does not match");
+		TEST_EQUAL(decompress_lz4(compressed, length, decompressed, 100),
+		           -ENOSPC,
+		           "Decompressing into a short buffer should fail");
+		// Stream the text through blocks of 512 bytes, with a sink that
+		// collects frames in `compressed`.
+		struct Sink
+		{
+			size_t used;
+		} sink{0};
+		auto collect = [](void *context, const char *data, size_t size) {
+			auto *sink = static_cast<Sink *>(context);
+			size = std::min(size, sizeof(compressed) - sink->used);
+			memcpy(compressed + sink->used, data, size);
+			sink->used += size;
+			return ssize_t(size);
+		};
+		static uint8_t input[512];
+		static uint8_t output[sizeof(input) + COMPRESS_FRAME_HEADER_SIZE];
+		CompressStream stream;
+		TEST_EQUAL(compress_stream_init(&stream,
+		                                collect,
+		                                &sink,
+		                                input,
+		                                sizeof(input),
+		                                output,
+		                                sizeof(output),
+		                                workspace),
+		           0,
+		           "Failed to initialise compression stream");
+		for (size_t i = 0; i < sizeof(text); i += 100)
+		{
+			TEST_EQUAL(compress_stream_write(&stream, text + i, 100),
+			           100,
+			           "Compression stream did not accept data");
+		}
+		TEST_EQUAL(compress_stream_flush(&stream),
+		           0,
+		           "Failed to flush compression stream");
+		size_t offset = 0;
+		size_t total  = 0;
+		while (offset < sink.used)
+		{
+			size_t  consumed;
+			ssize_t block = decompress_frame(compressed + offset,
+			                                 sink.used - offset,
+			                                 decompressed + total,
+			                                 sizeof(decompressed) - total,
+			                                 &consumed);
+			TEST(block > 0, "Decompressing frame failed: {}", block);
+			offset += consumed;
+			total += block;
+		}
+		TEST_EQUAL(total, sizeof(text), "Decompressed stream is truncated");
+		TEST(memcmp(text, decompressed, sizeof(text)) == 0,
+		     "Decompressed stream does not match");
+	}
+
+	/**
+	 * Check that a channel delivers messages in order and reports when it is
+	 * full and empty.  Both ends are in this compartment.
+	 */
+	void check_channel()
+	{
+		debug_log("Testing channels.");
+		using TestChannel = cheriot::Channel<uint32_t, 4>;
+		auto producer     = CHANNEL_PRODUCER(TestChannel, test_channel);
+		auto consumer     = CHANNEL_CONSUMER(TestChannel, test_channel);
+
+		uint32_t message;
+		TEST_EQUAL(consumer.try_receive(message),
+		           -EAGAIN,
+		           "Received from an empty channel");
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			TEST_EQUAL(producer.try_send(i * 3), 0, "Failed to send {}", i);
+		}
+		TEST_EQUAL(producer.try_send(12), -EAGAIN, "Sent to a full channel");
+		TEST_EQUAL(consumer.size(), 4U, "Channel has the wrong size");
+		for (uint32_t i = 0; i < 4; i++)
+		{
+			Timeout timeout{1};
+			TEST_EQUAL(consumer.receive(&timeout, message),
+			           0,
+			           "Failed to receive {}",
+			           i);
+			TEST_EQUAL(message, i * 3, "Received messages out of order");
+		}
+		TEST_EQUAL(*consumer.doorbell(),
+		           consumer.consumed_count(),
+		           "Doorbell does not match the consumed count when empty");
+	}
+
+	/// Per-thread storage in this compartment.
+	COMPARTMENT_THREAD_LOCAL(uint32_t, threadLocalCounter);
+
+	/**
+	 * Check that the thread ID stored at the top of the stack matches the
+	 * switcher's and that compartment thread-local storage is per thread.
+	 */
+	void check_thread_local()
+	{
+		debug_log("Testing compartment thread-local storage.");
+		TEST_EQUAL(thread_id_get_fast(),
+		           thread_id_get(),
+		           "Thread ID at the top of the stack is wrong");
+		uint32_t &counter = COMPARTMENT_THREAD_LOCAL_GET(threadLocalCounter);
+		TEST(&counter == &threadLocalCounter[thread_id_get() - 1],
+		     "Thread-local storage is not indexed by thread");
+		uint32_t before = counter;
+		COMPARTMENT_THREAD_LOCAL_GET(threadLocalCounter)++;
+		TEST_EQUAL(counter,
+		           before + 1,
+		           "Thread-local storage did not keep its value");
+	}
+
 	/**
 	 * This is a regression test for #368.  There are many different ways for
 	 * the compiler to generate a memcmp call and this manages to trigger one of
@@ -243,9 +942,21 @@ namespace
 int test_misc()
 {
 	check_timeouts();
+	check_clock();
 	check_memchr();
 	check_memrchr();
+	check_memmem();
+	check_string_word_at_a_time();
+	check_memcpy_memset();
 	check_pointer_utilities();
+	check_pool();
+	check_hash_map();
+	check_ring_buffer_bulk();
+	check_division();
+	check_checksums();
+	check_compression();
+	check_channel();
+	check_thread_local();
 	check_capability_set_inexact_at_most();
 	debug_log("Testing shared objects.");
 	check_shared_object("exampleK",
@@ -271,6 +982,7 @@ int test_misc()
 	                      void, test_word, true, false, false, false),
 	                    4,
 	                    {Permission::Global, Permission::Load});
+	check_memcmp();
 	check_odd_memcmp();
 	return 0;
 }
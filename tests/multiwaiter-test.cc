@@ -3,8 +3,10 @@
 
 #define TEST_NAME "Multiwaiter"
 #include "tests.hh"
+#include <async.hh>
 #include <cheri.hh>
 #include <errno.h>
+#include <event.h>
 #include <futex.h>
 #include <multiwaiter.h>
 #include <queue.h>
@@ -14,6 +16,82 @@
 using namespace CHERI;
 using namespace thread_pool;
 
+namespace
+{
+	/// Values returned from `co_await` in the event-loop tasks.
+	int asyncResults[4];
+
+	/// The value received by `async_consumer`.
+	uint32_t asyncReceived;
+
+	cheriot::async::Task async_consumer(MessageQueue *queue)
+	{
+		asyncResults[0] =
+		  co_await cheriot::async::queue_receive(queue, &asyncReceived);
+	}
+
+	cheriot::async::Task async_producer(MessageQueue *queue, EventGroup *group)
+	{
+		uint32_t value = 42;
+		co_await cheriot::async::sleep(1);
+		asyncResults[1] = co_await cheriot::async::queue_send(queue, &value);
+		uint32_t bits;
+		Timeout  t{UnlimitedTimeout};
+		eventgroup_set(&t, group, &bits, 1);
+	}
+
+	cheriot::async::Task async_events(EventGroup *group)
+	{
+		uint32_t bits;
+		asyncResults[2] = co_await cheriot::async::eventgroup_wait(
+		  group, &bits, 1, false, true);
+	}
+
+	cheriot::async::Task async_timeout(uint32_t *futex)
+	{
+		asyncResults[3] = co_await cheriot::async::futex_wait(futex, 0, 2);
+	}
+
+	/**
+	 * Run four tasks on one event loop: one waits for a queue that another
+	 * sends to after sleeping, one waits for an event group, and one waits
+	 * for a futex that is never woken.
+	 */
+	void test_event_loop()
+	{
+		static uint32_t futex = 0;
+		debug_log("Testing coroutine event loop");
+		Timeout       t{UnlimitedTimeout};
+		MessageQueue *queue;
+		EventGroup   *group;
+		int           ret =
+		  queue_create(&t, MALLOC_CAPABILITY, &queue, sizeof(uint32_t), 1);
+		TEST(ret == 0, "Queue create failed: {}", ret);
+		ret = eventgroup_create(&t, MALLOC_CAPABILITY, &group);
+		TEST(ret == 0, "Event group create failed: {}", ret);
+		cheriot::async::EventLoop<4> loop;
+		ret = loop.init(&t, MALLOC_CAPABILITY);
+		TEST(ret == 0, "Event loop init failed: {}", ret);
+		TEST_EQUAL(loop.spawn(async_consumer(queue)), 0, "Spawn failed");
+		TEST_EQUAL(loop.spawn(async_producer(queue, group)), 0, "Spawn failed");
+		TEST_EQUAL(loop.spawn(async_events(group)), 0, "Spawn failed");
+		TEST_EQUAL(loop.spawn(async_timeout(&futex)), 0, "Spawn failed");
+		TEST_EQUAL(loop.spawn(async_timeout(&futex)),
+		           -ENOSPC,
+		           "Spawn succeeded on a full event loop");
+		loop.run();
+		TEST_EQUAL(asyncResults[0], 0, "Receive in task failed");
+		TEST_EQUAL(asyncReceived, 42U, "Task received the wrong value");
+		TEST_EQUAL(asyncResults[1], 0, "Send in task failed");
+		TEST_EQUAL(asyncResults[2], 0, "Event group wait in task failed");
+		TEST_EQUAL(
+		  asyncResults[3], -ETIMEDOUT, "Futex wait in task did not time out");
+		loop.destroy(MALLOC_CAPABILITY);
+		eventgroup_destroy(MALLOC_CAPABILITY, group);
+		queue_destroy(MALLOC_CAPABILITY, queue);
+	}
+} // namespace
+
 int test_multiwaiter()
 {
 	static uint32_t futex  = 0;
@@ -126,6 +204,69 @@ int test_multiwaiter()
 	     "Queue reports ready to receive but should be empty.");
 	TEST(events[1].value == 1, "Futex reports no wake");
 
+	debug_log("Testing edge-triggered futexes");
+	futex       = 1;
+	events[0]   = {&futex, EventWaiterFutexEdgeTriggered, 0};
+	t.remaining = 0;
+	ret         = multiwaiter_wait(&t, mw, events, 1);
+	TEST(ret == 0, "First edge-triggered wait returned {}", ret);
+	events[0] = {&futex, EventWaiterFutexEdgeTriggered, 0};
+	ret       = multiwaiter_wait(&t, mw, events, 1);
+	TEST(ret == -ETIMEDOUT,
+	     "Edge-triggered wait with no change returned {}",
+	     ret);
+	futex     = 2;
+	events[0] = {&futex, EventWaiterFutexEdgeTriggered, 0};
+	ret       = multiwaiter_wait(&t, mw, events, 1);
+	TEST(ret == 0, "Edge-triggered wait after a change returned {}", ret);
+	TEST(events[0].value == 1, "Edge-triggered futex reports no change");
+
+	debug_log("Testing registered futexes");
+	futex  = 0;
+	futex2 = 0;
+	events[0] = {&futex, EventWaiterFutex, 0};
+	events[1] = {&futex2, EventWaiterFutex, 0};
+	ret       = multiwaiter_register(mw, events, 2);
+	TEST(ret == 0, "multiwaiter_register returned {}", ret);
+	ret = multiwaiter_wait(&t, mw, events, 1);
+	TEST(ret == -EINVAL,
+	     "One-shot wait on registered multiwaiter returned {}",
+	     ret);
+	uint32_t ready    = 0;
+	uint32_t timedOut = 0;
+	setFutex(&futex2, 1);
+	t.remaining = 6;
+	ret         = multiwaiter_wait_registered(&t, mw, &ready, &timedOut);
+	TEST(ret == 0, "multiwaiter_wait_registered returned {}", ret);
+	TEST(ready == 2, "Registered wait returned ready set {}", ready);
+	TEST(timedOut == 0, "Registered wait returned timed-out set {}", timedOut);
+	t.remaining = 0;
+	ret         = multiwaiter_wait_registered(&t, mw, &ready, nullptr);
+	TEST(ret == -ETIMEDOUT,
+	     "Registered wait with no new events returned {}",
+	     ret);
+
+	debug_log("Testing per-event timeouts");
+	ret = multiwaiter_registered_timeout_set(mw, 2, 1);
+	TEST(ret == -EINVAL, "Timeout for an unregistered index returned {}", ret);
+	ret = multiwaiter_registered_timeout_set(mw, 0, 2);
+	TEST(ret == 0, "multiwaiter_registered_timeout_set returned {}", ret);
+	t   = Timeout{10};
+	ret = multiwaiter_wait_registered(&t, mw, &ready, &timedOut);
+	TEST(ret == 0, "Wait with a per-event timeout returned {}", ret);
+	TEST(ready == 0, "Per-event timeout returned ready set {}", ready);
+	TEST(timedOut == 1, "Per-event timeout returned timed-out set {}", timedOut);
+	TEST(t.remaining > 0, "Per-event timeout used the whole wait");
+	t.remaining = 2;
+	ret         = multiwaiter_wait_registered(&t, mw, &ready, &timedOut);
+	TEST(ret == -ETIMEDOUT, "Expired per-event timeout fired again: {}", ret);
+
+	ret = multiwaiter_register(mw, nullptr, 0);
+	TEST(ret == 0, "Removing registration returned {}", ret);
+	ret = multiwaiter_wait_registered(&t, mw, &ready, nullptr);
+	TEST(ret == -EINVAL, "Wait without registration returned {}", ret);
+
 	multiwaiter_delete(MALLOC_CAPABILITY, mw);
+	test_event_loop();
 	return 0;
 }
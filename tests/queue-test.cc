@@ -9,6 +9,7 @@
 #include <FreeRTOS-Compat/queue.h>
 #include <debug.hh>
 #include <errno.h>
+#include <pubsub.h>
 #include <queue.h>
 #include <timeout.h>
 
@@ -16,6 +17,9 @@ static constexpr size_t ItemSize                    = 8;
 static constexpr size_t MaxItems                    = 2;
 static constexpr char   Message[MaxItems][ItemSize] = {"TstMsg0", "TstMsg1"};
 
+DECLARE_AND_DEFINE_ALLOCATOR_CAPABILITY(subscriberHeap, 1024);
+#define SUBSCRIBER_HEAP STATIC_SEALED_VALUE(subscriberHeap)
+
 extern "C" ErrorRecoveryBehaviour
 compartment_error_handler(ErrorState *frame, size_t mcause, size_t mtval)
 {
@@ -96,11 +100,362 @@ void test_queue_unsealed()
 	checkSpace(1);
 	queue_receive(&timeout, queue, bytes);
 	checkSpace(0);
+	debug_log("Testing batched queue operations");
+	char          batch[MaxItems][ItemSize];
+	const ssize_t Batch = MaxItems;
+	// Asking for more messages than fit sends only as many as there is space
+	// for.
+	ssize_t moved = queue_send_multiple(&timeout, queue, Message, Batch + 1);
+	TEST(moved == Batch, "Batched send sent {}, expected {}", moved, Batch);
+	checkSpace(MaxItems);
+	timeout.remaining = 5;
+	moved             = queue_send_multiple(&timeout, queue, Message, Batch);
+	TEST(moved == -ETIMEDOUT,
+	     "Batched send to a full queue didn't time out as expected, returned "
+	     "{}",
+	     moved);
+	moved = queue_receive_multiple(&timeout, queue, batch, Batch + 1);
+	TEST(
+	  moved == Batch, "Batched receive received {}, expected {}", moved, Batch);
+	TEST(memcmp(Message, batch, sizeof(batch)) == 0,
+	     "Batched receive returned the wrong messages");
+	checkSpace(0);
+	// Move the counters so that the next batch wraps around the end of the
+	// ring buffer.
+	queue_send(&timeout, queue, Message[0]);
+	queue_receive(&timeout, queue, bytes);
+	moved = queue_send_multiple(&timeout, queue, Message, Batch);
+	TEST(moved == Batch, "Wrapping batched send sent {}", moved);
+	moved = queue_receive_multiple(&timeout, queue, batch, Batch);
+	TEST(moved == Batch, "Wrapping batched receive received {}", moved);
+	TEST(memcmp(Message, batch, sizeof(batch)) == 0,
+	     "Wrapping batched receive returned the wrong messages");
+	checkSpace(0);
+	timeout.remaining = 5;
+	moved             = queue_receive_multiple(&timeout, queue, batch, Batch);
+	TEST(moved == -ETIMEDOUT,
+	     "Batched receive from an empty queue didn't time out as expected, "
+	     "returned {}",
+	     moved);
+	debug_log("Testing in-place queue operations");
+	void *slot;
+	rv = queue_send_reserve(&timeout, queue, &slot);
+	TEST(rv == 0, "Reserving a slot failed with {}", rv);
+	TEST(!CHERI::Capability{slot}.permissions().contains(
+	       CHERI::Permission::Global),
+	     "Reserved slot {} is capturable",
+	     slot);
+	TEST(CHERI::Capability{slot}.length() == ItemSize,
+	     "Reserved slot {} has the wrong bounds",
+	     slot);
+	checkSpace(0);
+	memcpy(slot, Message[1], ItemSize);
+	rv = queue_send_commit(queue, bytes);
+	TEST(rv == -EINVAL, "Committing the wrong slot returned {}", rv);
+	rv = queue_send_commit(queue, slot);
+	TEST(rv == 0, "Committing a slot failed with {}", rv);
+	checkSpace(1);
+	const void *peeked;
+	rv = queue_receive_peek(&timeout, queue, &peeked);
+	TEST(rv == 0, "Peeking failed with {}", rv);
+	TEST(!CHERI::Capability{peeked}.permissions().contains(
+	       CHERI::Permission::Store),
+	     "Peeked slot {} is writeable",
+	     peeked);
+	TEST(memcmp(peeked, Message[1], ItemSize) == 0,
+	     "Peeked message is not as expected");
+	rv = queue_receive_release(queue, peeked);
+	TEST(rv == 0, "Releasing a slot failed with {}", rv);
+	checkSpace(0);
 	rv = queue_destroy(MALLOC_CAPABILITY, queue);
 	TEST(rv == 0, "MessageQueue deletion failed with {}", rv);
 	debug_log("All queue library tests successful");
 }
 
+void test_queue_single_producer_consumer()
+{
+	char                 bytes[ItemSize];
+	char                 batch[MaxItems][ItemSize];
+	static MessageQueue *queue;
+	Timeout              timeout{0, 0};
+	size_t               items;
+	debug_log("Testing single-producer, single-consumer queues");
+	int rv = queue_create_single_producer_consumer(
+	  &timeout, MALLOC_CAPABILITY, &queue, ItemSize, MaxItems);
+	TEST(rv == 0, "MessageQueue creation failed with {}", rv);
+	EventWaiterSource source;
+	multiwaiter_queue_receive_init(&source, queue);
+	TEST(*static_cast<uint32_t *>(source.eventSource) == source.value,
+	     "Empty queue should not be ready to receive");
+	rv = queue_send(&timeout, queue, Message[0]);
+	TEST(rv == 0, "Sending the first message failed with {}", rv);
+	ssize_t moved = queue_send_multiple(&timeout, queue, Message, MaxItems);
+	TEST(moved == 1, "Batched send to a nearly full queue sent {}", moved);
+	queue_items_remaining(queue, &items);
+	TEST(items == MaxItems, "Queue reports {} items, should be full", items);
+	timeout.remaining = 5;
+	rv                = queue_send(&timeout, queue, Message[1]);
+	TEST(rv == -ETIMEDOUT,
+	     "Sending to a full queue didn't time out as expected, returned {}",
+	     rv);
+	multiwaiter_queue_send_init(&source, queue);
+	TEST(*static_cast<uint32_t *>(source.eventSource) == source.value,
+	     "Full queue should not be ready to send");
+	rv = queue_receive(&timeout, queue, bytes);
+	TEST(rv == 0, "Receiving the first message failed with {}", rv);
+	TEST(memcmp(Message[0], bytes, ItemSize) == 0,
+	     "First message received but not as expected. Got {}",
+	     bytes);
+	// The next batch wraps around the end of the ring buffer.
+	rv = queue_send(&timeout, queue, Message[1]);
+	TEST(rv == 0, "Sending the third message failed with {}", rv);
+	moved = queue_receive_multiple(&timeout, queue, batch, MaxItems + 1);
+	TEST(moved == MaxItems, "Batched receive received {}", moved);
+	TEST(memcmp(Message[0], batch[0], ItemSize) == 0 &&
+	       memcmp(Message[1], batch[1], ItemSize) == 0,
+	     "Batched receive returned the wrong messages");
+	timeout.remaining = 5;
+	rv                = queue_receive(&timeout, queue, bytes);
+	TEST(
+	  rv == -ETIMEDOUT,
+	  "Receiving from an empty queue didn't time out as expected, returned {}",
+	  rv);
+	rv = queue_destroy(MALLOC_CAPABILITY, queue);
+	TEST(rv == 0, "MessageQueue deletion failed with {}", rv);
+	debug_log("All single-producer, single-consumer queue tests successful");
+}
+
+void test_queue_wake_one()
+{
+	char                 bytes[ItemSize];
+	static MessageQueue *queue;
+	Timeout              timeout{0, 0};
+	size_t               items;
+	debug_log("Testing wake-one queues");
+	int rv = queue_create_wake_one(
+	  &timeout, MALLOC_CAPABILITY, &queue, ItemSize, MaxItems);
+	TEST(rv == 0, "MessageQueue creation failed with {}", rv);
+	EventWaiterSource source;
+	multiwaiter_queue_receive_init(&source, queue);
+	TEST(*static_cast<uint32_t *>(source.eventSource) == source.value,
+	     "Empty queue should not be ready to receive");
+	for (auto &message : Message)
+	{
+		rv = queue_send(&timeout, queue, message);
+		TEST(rv == 0, "Sending to a wake-one queue failed with {}", rv);
+	}
+	queue_items_remaining(queue, &items);
+	TEST(items == MaxItems, "Queue reports {} items, should be full", items);
+	multiwaiter_queue_send_init(&source, queue);
+	TEST(*static_cast<uint32_t *>(source.eventSource) == source.value,
+	     "Full queue should not be ready to send");
+	for (auto &message : Message)
+	{
+		rv = queue_receive(&timeout, queue, bytes);
+		TEST(rv == 0, "Receiving from a wake-one queue failed with {}", rv);
+		TEST(memcmp(message, bytes, ItemSize) == 0,
+		     "Message received but not as expected. Got {}",
+		     bytes);
+	}
+	rv = queue_destroy(MALLOC_CAPABILITY, queue);
+	TEST(rv == 0, "MessageQueue deletion failed with {}", rv);
+
+	SObj sealedQueue;
+	rv = queue_create_sealed_wake_one(
+	  &timeout, MALLOC_CAPABILITY, &sealedQueue, ItemSize, MaxItems);
+	TEST(rv == 0, "Sealed wake-one queue creation failed with {}", rv);
+	rv = queue_send_sealed(&timeout, sealedQueue, Message[0]);
+	TEST(rv == 0, "Sending to a sealed wake-one queue failed with {}", rv);
+	rv = queue_receive_sealed(&timeout, sealedQueue, bytes);
+	TEST(rv == 0, "Receiving from a sealed wake-one queue failed with {}", rv);
+	TEST(memcmp(Message[0], bytes, ItemSize) == 0,
+	     "Message received but not as expected. Got {}",
+	     bytes);
+	rv = queue_destroy_sealed(&timeout, MALLOC_CAPABILITY, sealedQueue);
+	TEST(rv == 0, "Sealed queue deletion failed with {}", rv);
+	debug_log("All wake-one queue tests successful");
+}
+
+void test_record_queue()
+{
+	static MessageQueue *queue;
+	Timeout              timeout{0, 0};
+	char                 bytes[ItemSize];
+	debug_log("Testing record queues");
+	// Room for an eight-byte and a three-byte record, but not another
+	// eight-byte record.
+	int rv = record_queue_create(&timeout, MALLOC_CAPABILITY, &queue, 26);
+	TEST(rv == 0, "Record queue creation failed with {}", rv);
+	TEST(queue->queueSize == 28,
+	     "Record queue capacity is {}, expected 28",
+	     queue->queueSize);
+	rv = record_queue_send(&timeout, queue, Message[0], ItemSize);
+	TEST(rv == 0, "Sending the first record failed with {}", rv);
+	rv = record_queue_send(&timeout, queue, "abc", 3);
+	TEST(rv == 0, "Sending the second record failed with {}", rv);
+	timeout.remaining = 5;
+	rv                = record_queue_send(&timeout, queue, Message[1], ItemSize);
+	TEST(rv == -ETIMEDOUT,
+	     "Sending to a full record queue didn't time out, returned {}",
+	     rv);
+	rv = record_queue_send(&timeout, queue, bytes, 64);
+	TEST(rv == -EMSGSIZE, "Sending an oversized record returned {}", rv);
+	ssize_t length = record_queue_receive(&timeout, queue, bytes, 2);
+	TEST(length == -ENOBUFS,
+	     "Receiving into a short buffer returned {}",
+	     length);
+	length = record_queue_receive(&timeout, queue, bytes, sizeof(bytes));
+	TEST(length == static_cast<ssize_t>(ItemSize),
+	     "First record has length {}",
+	     length);
+	TEST(memcmp(Message[0], bytes, ItemSize) == 0,
+	     "First record received but not as expected. Got {}",
+	     bytes);
+	// This record does not fit before the end of the ring and so wraps.
+	rv = record_queue_send(&timeout, queue, Message[1], ItemSize);
+	TEST(rv == 0, "Sending the wrapping record failed with {}", rv);
+	const void *record;
+	length = record_queue_peek(&timeout, queue, &record);
+	TEST(length == 3, "Second record has length {}", length);
+	TEST(memcmp(record, "abc", 3) == 0, "Second record is not as expected");
+	TEST(!CHERI::Capability{record}.permissions().contains(
+	       CHERI::Permission::Global),
+	     "Peeked record {} is capturable",
+	     record);
+	rv = record_queue_release(queue, record);
+	TEST(rv == 0, "Releasing the second record failed with {}", rv);
+	length = record_queue_peek(&timeout, queue, &record);
+	TEST(length == static_cast<ssize_t>(ItemSize),
+	     "Wrapped record has length {}",
+	     length);
+	TEST(memcmp(record, Message[1], ItemSize) == 0,
+	     "Wrapped record is not as expected");
+	rv = record_queue_release(queue, record);
+	TEST(rv == 0, "Releasing the wrapped record failed with {}", rv);
+	size_t items;
+	queue_items_remaining(queue, &items);
+	TEST(items == 0, "Record queue reports {} bytes in use", items);
+	rv = queue_destroy(MALLOC_CAPABILITY, queue);
+	TEST(rv == 0, "Record queue deletion failed with {}", rv);
+	debug_log("All record queue tests successful");
+}
+
+void test_queue_statistics()
+{
+	char                   bytes[ItemSize];
+	static MessageQueue   *queue;
+	Timeout                timeout{0, 0};
+	MessageQueueStatistics statistics;
+	debug_log("Testing queue statistics");
+	int rv =
+	  queue_create(&timeout, MALLOC_CAPABILITY, &queue, ItemSize, MaxItems);
+	TEST(rv == 0, "MessageQueue creation failed with {}", rv);
+	rv = queue_statistics(queue, &statistics);
+	TEST(rv == -ENOTSUP, "Statistics for a plain queue returned {}", rv);
+	rv = queue_destroy(MALLOC_CAPABILITY, queue);
+	TEST(rv == 0, "MessageQueue deletion failed with {}", rv);
+
+	rv = queue_create_with_statistics(
+	  &timeout, MALLOC_CAPABILITY, &queue, ItemSize, MaxItems);
+	TEST(rv == 0, "MessageQueue creation failed with {}", rv);
+	for (auto &message : Message)
+	{
+		rv = queue_send(&timeout, queue, message);
+		TEST(rv == 0, "Sending to an instrumented queue failed with {}", rv);
+	}
+	for (size_t i = 0; i < MaxItems; i++)
+	{
+		rv = queue_receive(&timeout, queue, bytes);
+		TEST(
+		  rv == 0, "Receiving from an instrumented queue failed with {}", rv);
+	}
+	timeout.remaining = 5;
+	rv                = queue_receive(&timeout, queue, bytes);
+	TEST(rv == -ETIMEDOUT,
+	     "Receiving from an empty queue didn't time out, returned {}",
+	     rv);
+	rv = queue_statistics(queue, &statistics);
+	TEST(rv == 0, "Reading queue statistics failed with {}", rv);
+	TEST_EQUAL(statistics.sends, MaxItems, "Incorrect send count");
+	TEST_EQUAL(statistics.receives, MaxItems, "Incorrect receive count");
+	TEST_EQUAL(statistics.blockedSends, 0U, "Incorrect blocked send count");
+	TEST_EQUAL(
+	  statistics.blockedReceives, 1U, "Incorrect blocked receive count");
+	TEST_EQUAL(statistics.maxOccupancy, MaxItems, "Incorrect max occupancy");
+	uint32_t histogramTotal = 0;
+	for (auto bucket : statistics.timeInQueueHistogram)
+	{
+		histogramTotal += bucket;
+	}
+	TEST_EQUAL(histogramTotal, MaxItems, "Incorrect histogram total");
+	rv = queue_destroy(MALLOC_CAPABILITY, queue);
+	TEST(rv == 0, "MessageQueue deletion failed with {}", rv);
+
+	SObj sealedQueue;
+	rv = queue_create_sealed_with_statistics(
+	  &timeout, MALLOC_CAPABILITY, &sealedQueue, ItemSize, MaxItems);
+	TEST(rv == 0, "Sealed instrumented queue creation failed with {}", rv);
+	rv = queue_send_sealed(&timeout, sealedQueue, Message[0]);
+	TEST(rv == 0, "Sending to a sealed instrumented queue failed with {}", rv);
+	rv = queue_statistics_sealed(sealedQueue, &statistics);
+	TEST(rv == 0, "Reading sealed queue statistics failed with {}", rv);
+	TEST_EQUAL(statistics.sends, 1U, "Incorrect sealed send count");
+	rv = queue_destroy_sealed(&timeout, MALLOC_CAPABILITY, sealedQueue);
+	TEST(rv == 0, "Sealed queue deletion failed with {}", rv);
+	debug_log("All queue statistics tests successful");
+}
+
+void test_priority_queue()
+{
+	char                 bytes[ItemSize];
+	static MessageQueue *queue;
+	Timeout              timeout{0, 0};
+	size_t               items;
+	debug_log("Testing priority queues");
+	int rv = priority_queue_create(
+	  &timeout, MALLOC_CAPABILITY, &queue, ItemSize, MaxItems, 3);
+	TEST(rv == 0, "Priority queue creation failed with {}", rv);
+	EventWaiterSource source;
+	multiwaiter_queue_receive_init(&source, queue);
+	TEST(*static_cast<uint32_t *>(source.eventSource) == source.value,
+	     "Empty priority queue should not be ready to receive");
+	rv = priority_queue_send(&timeout, queue, Message[0], 3);
+	TEST(rv == -EINVAL, "Sending with an invalid priority returned {}", rv);
+	rv = priority_queue_send(&timeout, queue, Message[0], 0);
+	TEST(rv == 0, "Sending a low-priority message failed with {}", rv);
+	rv = priority_queue_send(&timeout, queue, Message[1], 2);
+	TEST(rv == 0, "Sending a high-priority message failed with {}", rv);
+	queue_items_remaining(queue, &items);
+	TEST(items == MaxItems, "Queue reports {} items, should be full", items);
+	timeout.remaining = 5;
+	rv                = priority_queue_send(&timeout, queue, Message[1], 1);
+	TEST(rv == -ETIMEDOUT,
+	     "Sending to a full priority queue didn't time out, returned {}",
+	     rv);
+	rv = priority_queue_receive(&timeout, queue, bytes);
+	TEST(rv == 2, "First message received had priority {}", rv);
+	TEST(memcmp(Message[1], bytes, ItemSize) == 0,
+	     "High-priority message received but not as expected. Got {}",
+	     bytes);
+	rv = priority_queue_send(&timeout, queue, Message[1], 1);
+	TEST(rv == 0, "Sending a medium-priority message failed with {}", rv);
+	rv = priority_queue_receive(&timeout, queue, bytes);
+	TEST(rv == 1, "Second message received had priority {}", rv);
+	rv = priority_queue_receive(&timeout, queue, bytes);
+	TEST(rv == 0, "Third message received had priority {}", rv);
+	TEST(memcmp(Message[0], bytes, ItemSize) == 0,
+	     "Low-priority message received but not as expected. Got {}",
+	     bytes);
+	timeout.remaining = 5;
+	rv                = priority_queue_receive(&timeout, queue, bytes);
+	TEST(rv == -ETIMEDOUT,
+	     "Receiving from an empty priority queue didn't time out, returned {}",
+	     rv);
+	rv = queue_destroy(MALLOC_CAPABILITY, queue);
+	TEST(rv == 0, "Priority queue deletion failed with {}", rv);
+	debug_log("All priority queue tests successful");
+}
+
 void test_queue_sealed()
 {
 	auto    heapSpace = heap_quota_remaining(MALLOC_CAPABILITY);
@@ -159,6 +514,56 @@ void test_queue_sealed()
 	     "Receiving with valid buffer should return 0, returned {}",
 	     ret);
 
+	ssize_t moved = queue_send_multiple_sealed(&t, receiveHandle, Message, 2);
+	TEST(moved == -EINVAL,
+	     "Batched send with a receive handle should return -EINVAL, returned "
+	     "{}",
+	     moved);
+	moved = queue_send_multiple_sealed(&t, sendHandle, Message[1], MaxItems);
+	TEST(moved == -EPERM,
+	     "Batched send with a short buffer should return -EPERM, returned {}",
+	     moved);
+	moved = queue_send_multiple_sealed(&t, sendHandle, Message, MaxItems);
+	TEST(moved == MaxItems, "Batched sealed send sent {}", moved);
+	char batch[MaxItems][ItemSize];
+	moved = queue_receive_multiple_sealed(&t, receiveHandle, batch, MaxItems);
+	TEST(moved == MaxItems, "Batched sealed receive received {}", moved);
+	TEST(memcmp(Message, batch, sizeof(batch)) == 0,
+	     "Batched sealed receive returned the wrong messages");
+
+	MessageQueueView sendView;
+	MessageQueueView receiveView;
+	ret = queue_send_view_create_sealed(receiveHandle, &sendView);
+	TEST(ret == -EINVAL,
+	     "Creating a send view from a receive handle returned {}",
+	     ret);
+	ret = queue_send_view_create_sealed(sendHandle, &sendView);
+	TEST(ret == 0, "Creating a send view failed with {}", ret);
+	ret = queue_receive_view_create_sealed(receiveHandle, &receiveView);
+	TEST(ret == 0, "Creating a receive view failed with {}", ret);
+	TEST(!CHERI::Capability{sendView.buffer}.permissions().contains(
+	       CHERI::Permission::Load),
+	     "Send view can read messages: {}",
+	     sendView.buffer);
+	TEST(!CHERI::Capability{receiveView.buffer}.permissions().contains(
+	       CHERI::Permission::Store),
+	     "Receive view can write messages: {}",
+	     receiveView.buffer);
+	ret = queue_send_view(&t, &sendView, Message[0]);
+	TEST(ret == 0, "Sending via a view failed with {}", ret);
+	ret = queue_receive_view(&t, &sendView, bytes);
+	TEST(ret == -EPERM, "Receiving via a send view returned {}", ret);
+	ret = queue_receive_sealed(&t, receiveHandle, bytes);
+	TEST(ret == 0, "Receiving a message sent via a view failed with {}", ret);
+	TEST(memcmp(Message[0], bytes, ItemSize) == 0,
+	     "Message sent via a view is not as expected");
+	ret = queue_send_sealed(&t, sendHandle, Message[1]);
+	TEST(ret == 0, "Sending with valid buffer failed with {}", ret);
+	ret = queue_receive_view(&t, &receiveView, bytes);
+	TEST(ret == 0, "Receiving via a view failed with {}", ret);
+	TEST(memcmp(Message[1], bytes, ItemSize) == 0,
+	     "Message received via a view is not as expected");
+
 	// Put something in the queue before we delete the send handle.
 	ret = queue_send_sealed(&t, sendHandle, Message[1]);
 	TEST(
@@ -195,11 +600,92 @@ void test_queue_freertos()
 	debug_log("All FreeRTOS queue tests successful");
 }
 
+void test_pubsub()
+{
+	PubSubBus          *bus;
+	PubSubSubscription *first;
+	PubSubSubscription *second;
+	PubSubSubscription *third;
+	Timeout             timeout{0, 0};
+	const void         *received[2];
+	debug_log("Testing publish-subscribe bus");
+	int rv = pubsub_create(&timeout, MALLOC_CAPABILITY, &bus, 2);
+	TEST(rv == 0, "Bus creation failed with {}", rv);
+	rv = pubsub_subscribe(&timeout, MALLOC_CAPABILITY, bus, &first, 1);
+	TEST(rv == 0, "First subscription failed with {}", rv);
+	rv = pubsub_subscribe(&timeout, SUBSCRIBER_HEAP, bus, &second, 1);
+	TEST(rv == 0, "Second subscription failed with {}", rv);
+	rv = pubsub_subscribe(&timeout, MALLOC_CAPABILITY, bus, &third, 1);
+	TEST(rv == -ENOSPC, "Subscribing to a full bus returned {}", rv);
+	ssize_t quota = heap_quota_remaining(SUBSCRIBER_HEAP);
+	rv = pubsub_publish(&timeout, MALLOC_CAPABILITY, bus, Message[0], ItemSize);
+	TEST(rv == 2, "Message delivered to {} subscribers, expected 2", rv);
+	TEST(heap_quota_remaining(SUBSCRIBER_HEAP) < quota,
+	     "Delivered message was not charged to the subscriber");
+	rv = pubsub_receive(&timeout, first, &received[0]);
+	TEST(rv == 0, "First subscriber failed to receive: {}", rv);
+	rv = pubsub_receive(&timeout, second, &received[1]);
+	TEST(rv == 0, "Second subscriber failed to receive: {}", rv);
+	TEST(received[0] == received[1],
+	     "Subscribers received different copies: {} and {}",
+	     received[0],
+	     received[1]);
+	TEST(memcmp(received[0], Message[0], ItemSize) == 0,
+	     "Received message is not as expected");
+	CHERI::Capability view{received[0]};
+	TEST(!view.permissions().contains(CHERI::Permission::Store) &&
+	       !view.permissions().contains(CHERI::Permission::Global),
+	     "Received message {} is writeable or capturable",
+	     view);
+	// Both queues are full, so a non-blocking publish reaches nobody.
+	rv = pubsub_publish(&timeout, MALLOC_CAPABILITY, bus, Message[1], ItemSize);
+	TEST(rv == 0, "Message delivered to {} full subscribers", rv);
+	TEST((first->dropped == 1) && (second->dropped == 1),
+	     "Dropped messages not counted: {} and {}",
+	     first->dropped,
+	     second->dropped);
+	rv = pubsub_release(first, received[0]);
+	TEST(rv == 0, "First release failed with {}", rv);
+	TEST(memcmp(received[1], Message[0], ItemSize) == 0,
+	     "Message corrupted after one subscriber released it");
+	rv = pubsub_release(second, received[1]);
+	TEST(rv == 0, "Second release failed with {}", rv);
+	TEST(heap_quota_remaining(SUBSCRIBER_HEAP) == quota,
+	     "Releasing the message did not refund the subscriber's quota");
+	// Unsubscribing releases messages that are still queued.
+	rv = pubsub_publish(&timeout, MALLOC_CAPABILITY, bus, Message[1], ItemSize);
+	TEST(rv == 2, "Message delivered to {} subscribers, expected 2", rv);
+	rv = pubsub_unsubscribe(&timeout, SUBSCRIBER_HEAP, bus, second);
+	TEST(rv == 0, "Unsubscribing failed with {}", rv);
+	TEST(heap_quota_remaining(SUBSCRIBER_HEAP) == 1024,
+	     "Unsubscribing leaked {} bytes of the subscriber's quota",
+	     1024 - heap_quota_remaining(SUBSCRIBER_HEAP));
+	rv = pubsub_receive(&timeout, first, &received[0]);
+	TEST(rv == 0, "Receiving after unsubscribe failed with {}", rv);
+	TEST(memcmp(received[0], Message[1], ItemSize) == 0,
+	     "Message received after unsubscribe is not as expected");
+	rv = pubsub_release(first, received[0]);
+	TEST(rv == 0, "Release failed with {}", rv);
+	rv = pubsub_destroy(MALLOC_CAPABILITY, bus);
+	TEST(rv == -EBUSY, "Destroying a bus with subscribers returned {}", rv);
+	rv = pubsub_unsubscribe(&timeout, MALLOC_CAPABILITY, bus, first);
+	TEST(rv == 0, "Unsubscribing failed with {}", rv);
+	rv = pubsub_destroy(MALLOC_CAPABILITY, bus);
+	TEST(rv == 0, "Bus destruction failed with {}", rv);
+	debug_log("All publish-subscribe tests successful");
+}
+
 int test_queue()
 {
 	test_queue_unsealed();
+	test_queue_single_producer_consumer();
+	test_queue_wake_one();
+	test_record_queue();
+	test_priority_queue();
+	test_queue_statistics();
 	test_queue_sealed();
 	test_queue_freertos();
+	test_pubsub();
 	debug_log("All queue tests successful");
 	return 0;
 }
@@ -6,6 +6,7 @@
 #include "tests.hh"
 #include <cheri.hh>
 #include <errno.h>
+#include <thread.h>
 
 using namespace CHERI;
 
@@ -184,5 +185,25 @@ int test_stack()
 	expect_handler(false);
 
 	test_stack_invalid_on_call(callback);
+
+	debug_log("stack high water mark");
+	volatile char buffer[256];
+	buffer[0]         = 0;
+	int highWaterMark = thread_stack_high_water_mark(thread_id_get());
+	if (highWaterMark != -ENOTSUP)
+	{
+		// The thread has used at least the stack from the top of this
+		// compartment's stack down to the start of the buffer.
+		Capability<void> csp{__builtin_cheri_stack_get()};
+		ptraddr_t        used = csp.top() - Capability{buffer}.address();
+		TEST(highWaterMark >= static_cast<int>(used),
+		     "Stack high water mark {} is below the {} bytes used",
+		     highWaterMark,
+		     used);
+	}
+	ret = thread_stack_high_water_mark(0);
+	TEST(ret == -EINVAL || ret == -ENOTSUP,
+	     "Stack high water mark for thread 0 returned {}",
+	     ret);
 	return 0;
 }
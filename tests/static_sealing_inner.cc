@@ -8,6 +8,14 @@
 
 using namespace CHERI;
 
+// A static sealed object owned by this compartment, whose body it can use
+// without unsealing.
+DECLARE_AND_DEFINE_STATIC_SEALED_VALUE(TestType,
+                                       static_sealing_inner,
+                                       SealingType,
+                                       innerTest,
+                                       43);
+
 int test_static_sealed_object(Sealed<TestType> obj)
 {
 	// Get our static sealing key.
@@ -49,5 +57,19 @@ int test_static_sealed_object(Sealed<TestType> obj)
 	                                  Permission::Global}>(unsealed, 1)),
 	     "Incorrect permissions on unsealed statically sealed object {}",
 	     unsealed);
+
+	// The loader-provided payload must be the same as the unsealed object.
+	Capability<TestType> payload = STATIC_SEALED_VALUE_PAYLOAD(innerTest);
+	Capability<TestType> ownUnsealed =
+	  token_unseal(key, Sealed<TestType>{STATIC_SEALED_VALUE(innerTest)});
+	debug_log("Static sealed object payload: {}", payload);
+	TEST(payload->value == 43, "Unexpected value in static sealed payload");
+	TEST_EQUAL(payload.base(),
+	           ownUnsealed.base(),
+	           "Static sealed payload has the wrong base");
+	TEST_EQUAL(payload.length(),
+	           ownUnsealed.length(),
+	           "Static sealed payload has the wrong length");
+	TEST(!payload.is_sealed(), "Static sealed payload {} is sealed", payload);
 	return 0;
 }
@@ -1,7 +1,99 @@
 #include <cstdio>
 #define TEST_NAME "stdio"
 #include "tests.hh"
+#include <algorithm>
+#include <errno.h>
 #include <stdio.h>
+#include <string.h>
+
+namespace
+{
+	/// Output captured by `capture_write`.
+	char   captured[64];
+	size_t capturedLength;
+	/// The number of bytes that `capture_write` accepts per call.
+	size_t captureLimit = sizeof(captured);
+
+	/**
+	 * Stream write function that appends to `captured`, accepting at most
+	 * `captureLimit` bytes per call.
+	 */
+	ssize_t capture_write(void *, const char *data, size_t length)
+	{
+		size_t space = sizeof(captured) - capturedLength;
+		length       = std::min({length, space, captureLimit});
+		memcpy(captured + capturedLength, data, length);
+		capturedLength += length;
+		return length;
+	}
+
+	std::string_view captured_output()
+	{
+		return {captured, capturedLength};
+	}
+
+	/**
+	 * Test buffered streams writing to an in-memory sink.
+	 */
+	void test_streams()
+	{
+		StdioStream stream;
+		char        buffer[16];
+		TEST(stdio_stream_init(
+		       &stream, capture_write, nullptr, buffer, sizeof(buffer), 42) ==
+		       -EINVAL,
+		     "stdio_stream_init accepted an invalid mode");
+
+		debug_log("Testing line-buffered streams");
+		stdio_stream_init(
+		  &stream, capture_write, nullptr, buffer, sizeof(buffer), _IOLBF);
+		fprintf(&stream, "line %d", 1);
+		TEST(capturedLength == 0,
+		     "Line-buffered stream flushed without a newline: {}",
+		     captured_output());
+		fputs(" end\n", &stream);
+		TEST(captured_output() == "line 1 end\n",
+		     "Line-buffered stream wrote '{}'",
+		     captured_output());
+
+		debug_log("Testing fully buffered streams");
+		capturedLength = 0;
+		stdio_stream_init(
+		  &stream, capture_write, nullptr, buffer, sizeof(buffer), _IOFBF);
+		fprintf(&stream, "%s\n", "0123456789abcdefXYZ");
+		TEST(captured_output() == "0123456789abcdef",
+		     "Fully buffered stream wrote '{}' before flushing",
+		     captured_output());
+		TEST(fflush(&stream) == 0, "fflush failed");
+		TEST(captured_output() == "0123456789abcdefXYZ\n",
+		     "Fully buffered stream wrote '{}' after flushing",
+		     captured_output());
+
+		debug_log("Testing streams whose sink makes no progress");
+		capturedLength = 0;
+		captureLimit   = 0;
+		fwrite("0123456789abcdefXYZ", 1, 19, &stream);
+		TEST(stream.dropped == 3,
+		     "Stream dropped {} bytes, expected 3",
+		     stream.dropped);
+		TEST(fflush(&stream) == EOF, "fflush succeeded without progress");
+		captureLimit = 5;
+		TEST(fflush(&stream) == 0, "fflush failed with partial writes");
+		TEST(captured_output() == "0123456789abcdef",
+		     "Stream wrote '{}' with partial writes",
+		     captured_output());
+		captureLimit = sizeof(captured);
+
+		debug_log("Testing unbuffered streams");
+		capturedLength = 0;
+		setvbuf(&stream, nullptr, _IONBF, 0);
+		fputc('x', &stream);
+		fprintf(&stream, "%d", 42);
+		TEST(captured_output() == "x42",
+		     "Unbuffered stream wrote '{}'",
+		     captured_output());
+	}
+} // namespace
 
 int test_stdio()
 {
@@ -19,5 +111,22 @@ int test_stdio()
 	TEST(strcmp(buffer, "-42") == 0,
 	     "snprintf(\"%d\", -42) gave {}",
 	     std::string_view{buffer, BufferSize});
+	snprintf(buffer,
+	         BufferSize,
+	         "{\"id\":%u,\"t\":%d,\"x\":\"%x\",\"s\":\"%-4s\"}",
+	         4294967295U,
+	         -1234567890,
+	         0xc0ffee,
+	         "ab");
+	TEST(strcmp(buffer,
+	            "{\"id\":4294967295,\"t\":-1234567890,\"x\":\"c0ffee\","
+	            "\"s\":\"ab  \"}") == 0,
+	     "snprintf of a JSON record gave {}",
+	     std::string_view{buffer, BufferSize});
+	snprintf(buffer, 8, "literal text %d", 7);
+	TEST(strcmp(buffer, "literal") == 0,
+	     "snprintf did not truncate a literal run, gave {}",
+	     std::string_view{buffer, BufferSize});
+	test_streams();
 	return 0;
 }
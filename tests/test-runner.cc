@@ -3,8 +3,12 @@
 
 #include "tests.hh"
 #include <compartment.h>
+#include <perf.h>
 #include <simulator.h>
 #include <string>
+#ifdef CHERIOT_SWITCHER_STACK_PEAKS
+#	include <switcher_stack_peaks.h>
+#endif
 
 using namespace CHERI;
 using namespace std::string_literals;
@@ -14,30 +18,13 @@ namespace
 	/// Have we detected a crash in any of the compartments?
 	volatile bool crashDetected = false;
 
-	/**
-	 * Read the cycle counter.
-	 */
-	int rdcycle()
-	{
-		int cycles;
-#ifdef SAIL
-		// On Sail, report the number of instructions, the cycle count is
-		// meaningless.
-		__asm__ volatile("csrr %0, minstret" : "=r"(cycles));
-#elif defined(IBEX)
-		__asm__ volatile("csrr %0, mcycle" : "=r"(cycles));
-#else
-		__asm__ volatile("rdcycle %0" : "=r"(cycles));
-#endif
-		return cycles;
-	}
 	/**
 	 * Call `fn` and log a message informing the user how long it took.
 	 */
 	void run_timed(const char *msg, auto &&fn)
 	{
-		bool failed      = false;
-		int  startCycles = rdcycle();
+		bool     failed      = false;
+		uint64_t startCycles = perf_cycles();
 		if constexpr (std::is_same_v<std::invoke_result_t<decltype(fn)>, void>)
 		{
 			fn();
@@ -46,7 +33,7 @@ namespace
 		{
 			failed = (fn() != 0);
 		}
-		int cycles = rdcycle();
+		uint64_t cycles = perf_cycles();
 
 		if (failed)
 		{
@@ -150,6 +137,7 @@ void __cheri_compartment("test_runner") run_tests()
 		run_timed("Misc APIs", test_misc);
 		run_timed("Stacks exhaustion in the switcher", test_stack);
 		run_timed("Thread pool", test_thread_pool);
+		run_timed("Timer service", test_timer_service);
 		run_timed("Global Constructors", test_global_constructors);
 		run_timed("Queue", test_queue);
 		run_timed("Futex", test_futex);
@@ -162,6 +150,13 @@ void __cheri_compartment("test_runner") run_tests()
 
 	TEST(crashDetected == false, "One or more tests failed");
 
+#ifdef CHERIOT_SWITCHER_STACK_PEAKS
+	// The test suite exercises the core compartments' exports through their
+	// worst known paths, so its peaks can be used to calibrate the exports'
+	// minimum stack annotations with `scripts/stack_sizes.py --calibrate`.
+	switcher_stack_peaks_dump<Test>();
+#endif
+
 	// Exit the simulator if we are running in simulation.
 #ifdef SIMULATION
 	simulation_exit();
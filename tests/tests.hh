@@ -9,6 +9,7 @@ __cheri_compartment("eventgroup_test") int test_eventgroup();
 __cheri_compartment("mmio_test") int test_mmio();
 __cheri_compartment("allocator_test") int test_allocator();
 __cheri_compartment("thread_pool_test") int test_thread_pool();
+__cheri_compartment("timer_service_test") int test_timer_service();
 __cheri_compartment("futex_test") int test_futex();
 __cheri_compartment("queue_test") int test_queue();
 __cheri_compartment("locks_test") int test_locks();
@@ -37,7 +38,8 @@ using Test = ConditionalDebug<true,
                               >;
 
 template<typename... Args>
-void debug_log(const char *fmt, Args... args)
+void debug_log(DebugFormatString<std::type_identity_t<Args>...> fmt,
+               Args... args)
 {
 	Test::log(fmt, args...);
 }
@@ -6,6 +6,9 @@
 #include "tests.hh"
 #include <cheri.hh>
 #include <cheriot-atomic.hh>
+#include <errno.h>
+#include <futex.h>
+#include <multiwaiter.h>
 #include <switcher.h>
 #include <thread.h>
 #include <thread_pool.h>
@@ -19,6 +22,9 @@ cheriot::atomic<bool> errorHandled     = false;
 cheriot::atomic<bool> interruptStarted = false;
 cheriot::atomic<int>  interruptThreadNumber;
 
+/// Authorises lowering the lowest-priority thread-pool thread.
+DECLARE_AND_DEFINE_THREAD_PRIORITY_CAPABILITY(lowPoolThreadPriority, 3, 1);
+
 extern "C" ErrorRecoveryBehaviour
 compartment_error_handler(ErrorState *frame, size_t mcause, size_t mtval)
 {
@@ -44,6 +50,14 @@ compartment_error_handler(ErrorState *frame, size_t mcause, size_t mtval)
 	return ErrorRecoveryBehaviour::InstallContext;
 }
 
+namespace
+{
+	__cheri_callback void increment_counter(void *)
+	{
+		with_interrupts_disabled([]() { counter++; });
+	}
+} // namespace
+
 int test_thread_pool()
 {
 	// We can't share stack variables, so create a heap allocation that we can
@@ -52,6 +66,34 @@ int test_thread_pool()
 	TEST(thread_id_get() == 1,
 	     "Thread id of main thread should be 1, is {}",
 	     thread_id_get());
+	TEST(thread_period_wait() == -EPERM,
+	     "Waiting for the next period should fail on a thread that is not "
+	     "deadline scheduled");
+	int mainPriority = thread_priority_set(0);
+	TEST(mainPriority > 0,
+	     "Lowering the main thread's priority returned {}",
+	     mainPriority);
+	TEST(thread_priority_set(mainPriority) == 0,
+	     "Restoring the main thread's priority failed");
+	TEST(thread_priority_set(mainPriority + 1) == -EPERM,
+	     "Raising the main thread above its configured priority should fail");
+	auto *priorityCapability = STATIC_SEALED_VALUE(lowPoolThreadPriority);
+	TEST_EQUAL(thread_priority_set_for(priorityCapability, 3, 0),
+	           1,
+	           "Lowering a thread-pool thread's priority");
+	TEST_EQUAL(thread_priority_set_for(priorityCapability, 3, 1),
+	           0,
+	           "Restoring a thread-pool thread's priority");
+	TEST_EQUAL(thread_priority_set_for(priorityCapability, 3, 2),
+	           -EPERM,
+	           "Raising a thread above the capability's maximum");
+	TEST_EQUAL(thread_priority_set_for(priorityCapability, 2, 0),
+	           -EPERM,
+	           "Changing the priority of a thread that the capability does "
+	           "not name");
+	TEST_EQUAL(thread_priority_set_for(priorityCapability, 0, 0),
+	           -EINVAL,
+	           "Changing the priority of an invalid thread");
 	// Run a simple stateless callback that increments a global in the thread
 	// pool.  This demonstrates that we can correctly capture a stateless
 	// function and pass it to the worker thread.
@@ -85,6 +127,92 @@ int test_thread_pool()
 	debug_log("Freeing heap int: {}", heapInt);
 	free(heapInt);
 
+	// Call a function with copied arguments and wait for the completion
+	// futex.
+	static uint32_t completion = 0;
+	async_call(
+	  &completion,
+	  [](int increment) {
+		  with_interrupts_disabled([=]() { counter += increment; });
+	  },
+	  2);
+	Timeout completionTimeout{100};
+	while ((completion == 0) && completionTimeout.may_block())
+	{
+		futex_timed_wait(&completionTimeout, &completion, 0);
+	}
+	TEST(completion == 1, "Completion futex is {}, should be 1", completion);
+	TEST(counter == 4, "Counter is {}, should be 4", counter);
+
+	// The non-blocking variant should check its arguments in the same way and
+	// then queue the callback if there is space.
+	TEST(thread_pool_try_async(nullptr,
+	                           nullptr,
+	                           ThreadPoolDefaultPriority,
+	                           nullptr) == -EINVAL,
+	     "Queueing a null callback should fail");
+	int submitted = thread_pool_try_async(
+	  &increment_counter, nullptr, ThreadPoolDefaultPriority, &completion);
+	TEST(submitted == 0, "Non-blocking submission failed: {}", submitted);
+	Timeout tryCompletionTimeout{100};
+	while ((completion == 1) && tryCompletionTimeout.may_block())
+	{
+		futex_timed_wait(&tryCompletionTimeout, &completion, 1);
+	}
+	TEST(completion == 2, "Completion futex is {}, should be 2", completion);
+	TEST(counter == 5, "Counter is {}, should be 5", counter);
+
+	// Small stateful lambdas are held in sealed objects that are reused, so
+	// once the first has run, dispatching more does not use the heap.
+	ssize_t quota = 0;
+	for (int i = 0; i < 4; i++)
+	{
+		uint32_t before = completion;
+		async([=]() { with_interrupts_disabled([=]() { counter += i; }); },
+		      ThreadPoolDefaultPriority,
+		      &completion);
+		Timeout reuseTimeout{100};
+		while ((completion == before) && reuseTimeout.may_block())
+		{
+			futex_timed_wait(&reuseTimeout, &completion, before);
+		}
+		if (i == 0)
+		{
+			quota = heap_quota_remaining(MALLOC_CAPABILITY);
+		}
+	}
+	TEST(counter == 11, "Counter is {}, should be 11", counter);
+	TEST(heap_quota_remaining(MALLOC_CAPABILITY) == quota,
+	     "Dispatching small lambdas used {} bytes of heap",
+	     quota - heap_quota_remaining(MALLOC_CAPABILITY));
+
+	// Futures return results, and can be waited for together.
+	{
+		auto increment = []() {
+			with_interrupts_disabled([]() { counter++; });
+		};
+		Timeout futureTimeout{100};
+		auto    answer  = async_future([]() { return 42; });
+		auto    touched = async_future(increment);
+		TEST(answer.valid() && touched.valid(), "Failed to create futures");
+		MultiWaiter *mw;
+		TEST_EQUAL(multiwaiter_create(&futureTimeout, MALLOC_CAPABILITY, &mw, 2),
+		           0,
+		           "Failed to create multiwaiter");
+		FutureBase *const futures[] = {&answer, &touched};
+		ssize_t           first     = wait_any(&futureTimeout, mw, futures);
+		TEST(first == 0 || first == 1, "wait_any returned {}", first);
+		TEST(futures[first]->ready(), "wait_any returned an unfinished future");
+		TEST_EQUAL(wait_all(&futureTimeout, futures),
+		           0,
+		           "Futures did not finish");
+		int *result = answer.get(&futureTimeout);
+		TEST(result != nullptr, "Future has no result");
+		TEST_EQUAL(*result, 42, "Future has the wrong result");
+		TEST(counter == 12, "Counter is {}, should be 12", counter);
+		multiwaiter_delete(MALLOC_CAPABILITY, mw);
+	}
+
 	async([]() {
 		auto fast = thread_id_get();
 		auto slow = thread_id_get();
@@ -106,6 +234,12 @@ int test_thread_pool()
 	     "Interrupting null thread should fail");
 	TEST(!switcher_interrupt_thread(&sleeps),
 	     "Interrupting invalid thread should fail");
+	TEST(switcher_thread_compartment(mainThread) != 0,
+	     "Failed to find the compartment of the current thread");
+	TEST(switcher_thread_compartment(nullptr) == 0,
+	     "Finding the compartment of a null thread should fail");
+	TEST(switcher_thread_compartment(&sleeps) == 0,
+	     "Finding the compartment of an invalid thread should fail");
 
 	static void *asyncThread;
 	static bool  interrupted;
@@ -0,0 +1,119 @@
+// Copyright CHERIoT Contributors.
+// SPDX-License-Identifier: MIT
+
+#define TEST_NAME "Timer service"
+#include "tests.hh"
+#include <atomic>
+#include <errno.h>
+#include <stdlib.h>
+#include <thread.h>
+#include <timer_service.h>
+
+namespace
+{
+	/// The number of times that a timer callback has run.
+	std::atomic<uint32_t> expiries;
+
+	/// The argument that the last callback was called with.
+	void *lastArgument;
+
+	__cheri_callback void on_expiry(void *argument)
+	{
+		lastArgument = argument;
+		expiries.fetch_add(1);
+		expiries.notify_all();
+	}
+
+	/**
+	 * Wait for up to `ticks` ticks for the expiry count to be greater than
+	 * `count`.  Returns the count.
+	 */
+	uint32_t wait_for_expiry_after(uint32_t count, Ticks ticks)
+	{
+		Timeout  t{ticks};
+		uint32_t seen;
+		while (((seen = expiries.load()) <= count) && t.may_block())
+		{
+			expiries.wait(&t, seen);
+		}
+		return seen;
+	}
+} // namespace
+
+int test_timer_service()
+{
+	SObj    timer;
+	Timeout timeout{UnlimitedTimeout};
+
+	int rv = timer_service_create(
+	  &timeout, MALLOC_CAPABILITY, &timer, &on_expiry, nullptr, 0, 0);
+	TEST(rv == -EINVAL, "Creating a timer with no period returned {}", rv);
+	rv = timer_service_create(
+	  &timeout, MALLOC_CAPABILITY, &timer, &on_expiry, &expiries, 1, 0);
+	TEST(rv == -EINVAL, "Creating a timer with unsealed data returned {}", rv);
+
+	// A one-shot timer runs once and then stops.
+	rv = timer_service_create(
+	  &timeout, MALLOC_CAPABILITY, &timer, &on_expiry, nullptr, 2, 0);
+	TEST(rv == 0, "Creating a one-shot timer failed with {}", rv);
+	TEST(timer_service_is_active(timer) == 0,
+	     "Newly created timer is running");
+	rv = timer_service_start(timer);
+	TEST(rv == 0, "Starting a timer failed with {}", rv);
+	TEST(timer_service_is_active(timer) == 1, "Started timer is not running");
+	uint32_t seen = wait_for_expiry_after(0, 10);
+	TEST(seen == 1, "One-shot timer expired {} times", seen);
+	sleep(4);
+	TEST(expiries.load() == 1,
+	     "One-shot timer expired again ({} expiries)",
+	     expiries.load());
+	TEST(timer_service_is_active(timer) == 0,
+	     "One-shot timer is still running after it expired");
+	TEST(lastArgument == nullptr,
+	     "Callback was passed {}, not its data",
+	     lastArgument);
+	rv = timer_service_destroy(MALLOC_CAPABILITY, timer);
+	TEST(rv == 0, "Destroying a timer failed with {}", rv);
+	TEST(timer_service_start(timer) == -EINVAL,
+	     "Starting a destroyed timer did not fail");
+
+	// A periodic timer runs until it is stopped, and can be asked to pass
+	// its handle to the callback.
+	auto    *id    = reinterpret_cast<void *>(uintptr_t(42));
+	uint32_t flags = TimerServicePeriodic | TimerServicePassHandle;
+	rv = timer_service_create(
+	  &timeout, MALLOC_CAPABILITY, &timer, &on_expiry, id, 1, flags);
+	TEST(rv == 0, "Creating a periodic timer failed with {}", rv);
+	TEST(timer_service_data(timer) == id,
+	     "Timer data is {}, expected {}",
+	     timer_service_data(timer),
+	     id);
+	rv = timer_service_start(timer);
+	TEST(rv == 0, "Starting a periodic timer failed with {}", rv);
+	seen = wait_for_expiry_after(3, 20);
+	TEST(seen >= 4, "Periodic timer expired only {} times", seen);
+	TEST(lastArgument == timer,
+	     "Callback was passed {}, not its handle {}",
+	     lastArgument,
+	     timer);
+	rv = timer_service_stop(timer);
+	TEST(rv == 0, "Stopping a timer failed with {}", rv);
+	// A callback that had already started may still finish.
+	sleep(2);
+	seen = expiries.load();
+	sleep(4);
+	TEST(expiries.load() == seen,
+	     "Stopped timer expired {} more times",
+	     expiries.load() - seen);
+	uint32_t before = seen;
+	rv              = timer_service_change_period(timer, 3);
+	TEST(rv == 0, "Changing the period failed with {}", rv);
+	TEST(timer_service_is_active(timer) == 1,
+	     "Changing the period did not restart the timer");
+	seen = wait_for_expiry_after(before, 10);
+	TEST(seen > before, "Restarted timer did not expire");
+	rv = timer_service_destroy(MALLOC_CAPABILITY, timer);
+	TEST(rv == 0, "Destroying a running timer failed with {}", rv);
+	debug_log("All timer service tests successful");
+	return 0;
+}
@@ -31,6 +31,7 @@ freertos_compile_test("semaphore-only", {"CHERIOT_EXPOSE_FREERTOS_SEMAPHORE"})
 freertos_compile_test("mutex-only", {"CHERIOT_EXPOSE_FREERTOS_MUTEX"})
 freertos_compile_test("recursive-mutex-only", {"CHERIOT_EXPOSE_FREERTOS_RECURSIVE_MUTEX"})
 freertos_compile_test("all-options", {"CHERIOT_EXPOSE_FREERTOS_SEMAPHORE", "CHERIOT_EXPOSE_FREERTOS_MUTEX", "CHERIOT_EXPOSE_FREERTOS_RECURSIVE_MUTEX"})
+freertos_compile_test("futex-event-groups", {"CHERIOT_EXPOSE_FREERTOS_SEMAPHORE", "CHERIOT_FREERTOS_FUTEX_EVENT_GROUPS"})
 
 -- Fake compartment that owns all C-compile-only tests
 compartment("ccompile_test")
@@ -38,7 +39,8 @@ compartment("ccompile_test")
 	add_deps("freertos-compile-semaphore-only",
 	"freertos-compile-mutex-only",
 	"freertos-compile-recursive-mutex-only",
-	"freertos-compile-all-options")
+	"freertos-compile-all-options",
+	"freertos-compile-futex-event-groups")
 
 -- Test MMIO access
 test("mmio")
@@ -46,6 +48,8 @@ test("mmio")
 test("allocator")
 -- Test the thread pool
 test("thread_pool")
+-- Test software timers
+test("timer_service")
 -- Test the futex implementation
 test("futex")
 -- Test locks built on top of the futex
@@ -84,7 +88,7 @@ test("check_pointer")
 -- Test various APIs that are too small to deserve their own test file
 test("misc")
     on_load(function(target)
-        target:values_set("shared_objects", { exampleK = 1024, test_word = 4 }, {expand = false})
+        target:values_set("shared_objects", { exampleK = 1024, test_word = 4, test_channel = 24, test_channel_consumed = 4 }, {expand = false})
     end)
 test("unwind_cleanup")
     add_deps("unwind_error_handler")
@@ -98,16 +102,17 @@ compartment("test_runner")
 -- Firmware image for the test suite.
 firmware("test-suite")
     -- Main entry points
-    add_deps("test_runner", "thread_pool")
+    add_deps("test_runner", "thread_pool", "timer_service")
     -- Helper libraries
-    add_deps("freestanding", "string", "crt", "cxxrt", "atomic_fixed", "compartment_helpers", "debug")
-    add_deps("message_queue", "locks", "event_group")
+    add_deps("freestanding", "string", "crt", "cxxrt", "atomic_fixed", "compartment_helpers", "buffer_lending", "scratch_arena", "debug", "checksum", "compress")
+    add_deps("message_queue", "locks", "event_group", "pubsub")
     add_deps("stdio")
     -- Tests
     add_deps("mmio_test")
     add_deps("eventgroup_test")
     add_deps("allocator_test")
     add_deps("thread_pool_test")
+    add_deps("timer_service_test")
     add_deps("futex_test")
     add_deps("queue_test")
     add_deps("locks_test")
@@ -149,6 +154,13 @@ firmware("test-suite")
                 entry_point = "thread_pool_run",
                 stack_size = 0x600,
                 trusted_stack_frames = 8
+            },
+            {
+                compartment = "timer_service",
+                priority = 2,
+                entry_point = "timer_service_run",
+                stack_size = 0x400,
+                trusted_stack_frames = 4
             }
         }, {expand = false})
     end)